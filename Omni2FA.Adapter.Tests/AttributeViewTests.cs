@@ -0,0 +1,183 @@
+using System;
+using System.Collections.Generic;
+using System.Net;
+using System.Runtime.InteropServices;
+using System.Text;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Omni2FA.Net.Utils;
+using OpenCymd.Nps.Plugin;
+
+namespace Omni2FA.Adapter.Tests
+{
+    /// <summary>
+    /// Tests for the in-place attribute value views, over unmanaged buffers as NPS hands them out
+    /// </summary>
+    [TestClass]
+    public class AttributeViewTests
+    {
+        private readonly List<IntPtr> _buffers = new List<IntPtr>();
+
+        [TestCleanup]
+        public void Cleanup()
+        {
+            foreach (var buffer in _buffers)
+            {
+                Marshal.FreeHGlobal(buffer);
+            }
+            _buffers.Clear();
+        }
+
+        private AttributeView View(int attributeId, byte[] value)
+        {
+            var buffer = Marshal.AllocHGlobal(Math.Max(value.Length, 1));
+            Marshal.Copy(value, 0, buffer, value.Length);
+            _buffers.Add(buffer);
+            return AttributeView.FromBuffer(attributeId, buffer, value.Length);
+        }
+
+        private AttributeView View(int attributeId, string value)
+        {
+            return View(attributeId, Encoding.ASCII.GetBytes(value));
+        }
+
+        [TestMethod]
+        public void Equals_IgnoresAsciiCase()
+        {
+            // Arrange
+            var view = View((int)RadiusAttributeType.PolicyName, "Secure VPN");
+
+            // Act & Assert
+            Assert.IsTrue(view.Equals("secure vpn", StringComparison.OrdinalIgnoreCase));
+            Assert.IsFalse(view.Equals("secure vpn", StringComparison.Ordinal));
+            Assert.IsTrue(view.Equals("Secure VPN", StringComparison.Ordinal));
+            Assert.IsFalse(view.Equals("Secure VPN 2", StringComparison.OrdinalIgnoreCase));
+            Assert.IsFalse(view.Equals("Secure-VPN", StringComparison.OrdinalIgnoreCase));
+            Assert.IsFalse(view.Equals(null, StringComparison.OrdinalIgnoreCase));
+        }
+
+        [TestMethod]
+        public void Equals_DoesNotFoldPunctuation()
+        {
+            // Arrange: '-' and '\r' differ only by bit 0x20
+            var view = View((int)RadiusAttributeType.PolicyName, "a-b");
+
+            // Act & Assert
+            Assert.IsFalse(view.Equals("a\rb", StringComparison.OrdinalIgnoreCase));
+        }
+
+        [TestMethod]
+        public void Equals_NonAsciiFallsBackToDecodedString()
+        {
+            // Arrange
+            var view = View((int)RadiusAttributeType.PolicyName, new byte[] { 0x41, 0xE9 });
+            var expected = Marshal.PtrToStringAnsi(_buffers[0], 2);
+
+            // Act & Assert
+            Assert.IsTrue(view.Equals(expected, StringComparison.Ordinal));
+        }
+
+        [TestMethod]
+        public void ToString_SanitizesLikeAttributeLookup()
+        {
+            // Arrange
+            var trailingNul = View(1, new byte[] { (byte)' ', (byte)'u', 0 });
+            var blanks = View(1, "  user \r\n");
+            var empty = View(1, new byte[0]);
+
+            // Act & Assert
+            Assert.AreEqual(" u", trailingNul.ToString());
+            Assert.AreEqual("user", blanks.ToString());
+            Assert.AreEqual(4, blanks.Length);
+            Assert.AreEqual((byte)'u', blanks[0]);
+            Assert.AreEqual(string.Empty, empty.ToString());
+        }
+
+        [TestMethod]
+        public void ManagedAttribute_ViewMatchesValue()
+        {
+            // Arrange
+            var attributes = new List<RadiusAttribute>
+            {
+                new RadiusAttribute(RadiusAttributeType.PolicyName, " Secure VPN "),
+                new RadiusAttribute(RadiusAttributeType.NASPort, 1812),
+                new RadiusAttribute(RadiusAttributeType.NASIPAddress, IPAddress.Parse("10.0.0.1"))
+            };
+
+            // Act
+            var policy = Radius.AttributeLookupView(attributes, RadiusAttributeType.PolicyName);
+            var port = Radius.AttributeLookupView(attributes, RadiusAttributeType.NASPort);
+            var nas = Radius.AttributeLookupView(attributes, RadiusAttributeType.NASIPAddress);
+
+            // Assert
+            Assert.AreEqual("Secure VPN", policy.ToString());
+            Assert.IsTrue(Radius.AttributeEquals(attributes, RadiusAttributeType.PolicyName, "secure vpn", StringComparison.OrdinalIgnoreCase));
+            Assert.IsTrue(port.TryGetInteger(out uint value));
+            Assert.AreEqual(1812u, value);
+            Assert.IsTrue(nas.TryGetAddress(out IPAddress address));
+            Assert.AreEqual(IPAddress.Parse("10.0.0.1"), address);
+            Assert.IsFalse(nas.TryGetInteger(out value));
+        }
+
+        [TestMethod]
+        public void TryGetVendorAttribute_FindsSubAttributeInPlace()
+        {
+            // Arrange: Microsoft (311) with MS-CHAP-Error (2) and MS-Primary-DNS-Server (28)
+            var view = View((int)RadiusAttributeType.VendorSpecific, new byte[] {
+                0x00, 0x00, 0x01, 0x37, 0x02, 0x05, 0x61, 0x62, 0x63, 0x1C, 0x06, 0x0A, 0x00, 0x00, 0x01 });
+
+            // Act & Assert
+            Assert.IsTrue(view.TryGetVendorAttribute(311, 2, out AttributeView error));
+            Assert.AreEqual("abc", error.ToString());
+            Assert.IsTrue(view.TryGetVendorAttribute(311, 28, out AttributeView dns));
+            Assert.AreEqual(4, dns.Length);
+            Assert.AreEqual(0x0A, dns[0]);
+            Assert.IsFalse(view.TryGetVendorAttribute(311, 3, out _));
+            Assert.IsFalse(view.TryGetVendorAttribute(9, 2, out _));
+            Assert.AreEqual("VSA: ID=311, Type=2, Data=616263", view.ToString());
+        }
+
+        [TestMethod]
+        public void TryGetVendorAttribute_SkipsMalformedValue()
+        {
+            // Arrange: a Cisco value whose second sub-attribute overruns it
+            var view = View((int)RadiusAttributeType.VendorSpecific, new byte[] {
+                0x00, 0x00, 0x00, 0x09, 0x01, 0x03, 0x78, 0x01, 0x09, 0x79 });
+
+            // Act & Assert
+            Assert.IsFalse(view.TryGetVendorAttribute(9, 1, out _));
+        }
+
+        [TestMethod]
+        public void VendorAttributeLookupView_ReadsManagedAttributes()
+        {
+            // Arrange
+            var attributes = new List<RadiusAttribute>
+            {
+                new RadiusAttribute(RadiusAttributeType.PolicyName, "Secure VPN"),
+                new RadiusAttribute(RadiusAttributeType.VendorSpecific, new VendorSpecificAttribute(9, 1, new byte[] { 0x61 })),
+            };
+
+            // Act
+            var avpair = Radius.VendorAttributeLookupView(attributes, 9, 1);
+
+            // Assert
+            Assert.AreEqual("a", avpair.ToString());
+            Assert.IsTrue(Radius.VendorAttributeLookupView(attributes, 311, 1).IsEmpty);
+        }
+
+        [TestMethod]
+        public void MissingAttribute_ViewIsEmpty()
+        {
+            // Arrange
+            var attributes = new List<RadiusAttribute>();
+
+            // Act
+            var view = Radius.AttributeLookupView(attributes, RadiusAttributeType.PolicyName);
+
+            // Assert
+            Assert.IsTrue(view.IsEmpty);
+            Assert.AreEqual(string.Empty, view.ToString());
+            Assert.IsFalse(Radius.AttributeEquals(attributes, RadiusAttributeType.PolicyName, string.Empty, StringComparison.Ordinal));
+        }
+    }
+}
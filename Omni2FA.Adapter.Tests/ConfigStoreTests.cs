@@ -0,0 +1,355 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Threading;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Omni2FA.Net.Utils;
+
+namespace Omni2FA.Adapter.Tests
+{
+    /// <summary>
+    /// Tests for the configuration snapshot and its store, driven by a settings file
+    /// instead of the registry
+    /// </summary>
+    [TestClass]
+    public class ConfigStoreTests
+    {
+        private string _path = string.Empty;
+        private List<string> _resolved = new List<string>();
+
+        [TestInitialize]
+        public void Setup()
+        {
+            _path = Path.Combine(Path.GetTempPath(), $"omni2fa-config-{Guid.NewGuid():N}.txt");
+            _resolved = new List<string>();
+        }
+
+        [TestCleanup]
+        public void Cleanup()
+        {
+            if (File.Exists(_path))
+            {
+                File.Delete(_path);
+            }
+        }
+
+        // Resolves "DOMAIN\Name" to a fake SID without touching Active Directory
+        private GroupResolutionResult? Resolve(string groupName)
+        {
+            lock (_resolved)
+            {
+                _resolved.Add(groupName);
+            }
+            if (groupName.EndsWith("Missing", StringComparison.OrdinalIgnoreCase))
+            {
+                return null;
+            }
+            return new GroupResolutionResult
+            {
+                GroupName = groupName,
+                Sid = "S-1-5-21-" + groupName.GetHashCode().ToString("X8"),
+                IsLocal = false
+            };
+        }
+
+        private ConfigStore CreateStore(params string[] lines)
+        {
+            File.WriteAllLines(_path, lines);
+            return new ConfigStore(new FileConfigSource(_path, 20), Resolve);
+        }
+
+        [TestMethod]
+        public void Current_WithMissingFile_ShouldUseDefaults()
+        {
+            // Arrange
+            using (var store = new ConfigStore(new FileConfigSource(_path), Resolve))
+            {
+                // Act
+                var config = store.Current;
+
+                // Assert
+                Assert.AreEqual(1, config.Version);
+                Assert.AreEqual("http://localhost:8000", config.ServiceUrl);
+                Assert.AreEqual(1, config.ServiceUrls.Count);
+                Assert.AreEqual(60, config.AuthTimeout);
+                Assert.AreEqual(10, config.WaitBeforePoll);
+                Assert.AreEqual(1, config.PollInterval);
+                Assert.AreEqual(60, config.PollMaxSeconds);
+                Assert.IsFalse(config.EnableTraceLogging);
+                Assert.AreEqual(string.Empty, config.MfaEnabledNpsPolicy);
+                Assert.AreEqual(0, config.NoMfaGroups.Count);
+            }
+        }
+
+        [TestMethod]
+        public void Current_ShouldParseSettingsFile()
+        {
+            // Arrange
+            using (var store = CreateStore(
+                "# Omni2FA settings",
+                "ServiceUrl=https://mfa.example.com",
+                "PollInterval = 3",
+                "EnableTraceLogging=1",
+                "MfaEnabledNPSPolicy=\" RDG Policy \"",
+                "; ignored comment",
+                "NoMfaGroups=SMK\\Admins, SMK\\Service;SMK\\Missing",
+                "not a setting"))
+            {
+                // Act
+                var config = store.Current;
+
+                // Assert
+                Assert.AreEqual("https://mfa.example.com", config.ServiceUrl);
+                Assert.AreEqual(3, config.PollInterval);
+                Assert.IsTrue(config.EnableTraceLogging);
+                Assert.AreEqual("RDG Policy", config.MfaEnabledNpsPolicy);
+                CollectionAssert.AreEqual(new[] { "SMK\\Admins", "SMK\\Service", "SMK\\Missing" }, config.NoMfaGroups.ToArray());
+                Assert.AreEqual(2, config.NoMfaGroupSids.Count);
+                Assert.IsTrue(config.IsNoMfaGroup(Resolve("SMK\\Admins")!.Sid));
+                Assert.IsFalse(config.IsNoMfaGroup("S-1-5-32-544"));
+                Assert.IsFalse(config.IsNoMfaGroup(null));
+            }
+        }
+
+        [TestMethod]
+        public void Current_ShouldParseMfaRules()
+        {
+            // Arrange
+            using (var store = CreateStore(
+                "MfaRules=Office: skip if nas=10.1.0.0/16 & called=*:CORP ; Admins: MFA if groups=SMK\\Admins, SMK\\Missing;;Default: mfa"))
+            {
+                // Act
+                var config = store.Current;
+
+                // Assert
+                CollectionAssert.AreEqual(new[] { "Office: skip if nas=10.1.0.0/16 & called=*:CORP", "Admins: MFA if groups=SMK\\Admins, SMK\\Missing", "Default: mfa" },
+                    config.MfaRules.ToArray());
+                Assert.AreEqual(3, config.Rules.Count);
+                Assert.AreEqual("Office", config.Rules[0].Name);
+                Assert.IsFalse(config.Rules[0].RequiresMfa);
+                Assert.IsFalse(config.Rules[0].HasGroups);
+                Assert.IsTrue(config.Rules[1].RequiresMfa);
+                CollectionAssert.AreEqual(new[] { "SMK\\Admins", "SMK\\Missing" }, config.Rules[1].Groups.ToArray());
+                CollectionAssert.IsSubsetOf(new[] { "SMK\\Admins", "SMK\\Missing" }, _resolved);
+                Assert.IsTrue(config.Rules[2].RequiresMfa);
+                Assert.AreNotEqual(0L, config.MfaRulesTag);
+            }
+        }
+
+        [TestMethod]
+        public void Current_WithSeveralServiceUrls_ShouldKeepFirstAsServiceUrl()
+        {
+            // Arrange
+            using (var store = CreateStore("ServiceUrl=http://mfa1:8000; http://mfa2:8000,,http://mfa3:8000"))
+            {
+                // Act
+                var config = store.Current;
+
+                // Assert
+                Assert.AreEqual("http://mfa1:8000", config.ServiceUrl);
+                CollectionAssert.AreEqual(new[] { "http://mfa1:8000", "http://mfa2:8000", "http://mfa3:8000" }, config.ServiceUrls.ToArray());
+                Assert.AreEqual(100, config.MfaHedgeMinMs);
+            }
+        }
+
+        [TestMethod]
+        public void Reload_WithTraceDumpValueBytesChanged_ShouldPublishIt()
+        {
+            // Arrange
+            using (var store = CreateStore("EnableTraceLogging=1"))
+            {
+                var first = store.Current;
+                File.WriteAllLines(_path, new[] { "EnableTraceLogging=1", "TraceDumpValueBytes=512" });
+
+                // Act
+                store.Reload();
+
+                // Assert
+                Assert.AreEqual(128, first.TraceDumpValueBytes);
+                Assert.AreEqual(512, store.Current.TraceDumpValueBytes);
+            }
+        }
+
+        [TestMethod]
+        public void Reload_WithOtherSettingChanged_ShouldKeepMfaRulesTag()
+        {
+            // Arrange
+            using (var store = CreateStore("PollInterval=1", "MfaRules=Default: mfa"))
+            {
+                var first = store.Current;
+                File.WriteAllLines(_path, new[] { "PollInterval=5", "MfaRules=Default: mfa" });
+
+                // Act
+                store.Reload();
+                var unchanged = store.Current;
+                File.WriteAllLines(_path, new[] { "PollInterval=5", "MfaRules=Default: skip" });
+                store.Reload();
+
+                // Assert
+                Assert.AreEqual(first.MfaRulesTag, unchanged.MfaRulesTag);
+                Assert.AreNotEqual(first.MfaRulesTag, store.Current.MfaRulesTag);
+            }
+        }
+
+        [TestMethod]
+        public void Current_WithInvalidNumbers_ShouldFallBackToDefaults()
+        {
+            // Arrange
+            using (var store = CreateStore("PollInterval=fast", "EnableTraceLogging=yes", "AuthTimeout="))
+            {
+                // Act
+                var config = store.Current;
+
+                // Assert
+                Assert.AreEqual(1, config.PollInterval);
+                Assert.IsFalse(config.EnableTraceLogging);
+                Assert.AreEqual(60, config.AuthTimeout);
+            }
+        }
+
+        [TestMethod]
+        public void Reload_WithChangedFile_ShouldPublishNewSnapshot()
+        {
+            // Arrange
+            using (var store = CreateStore("PollInterval=1", "NoMfaGroups=SMK\\Admins"))
+            {
+                var first = store.Current;
+                ConfigSnapshot? published = null;
+                store.Changed += config => published = config;
+                File.WriteAllLines(_path, new[] { "PollInterval=5", "NoMfaGroups=SMK\\Service" });
+
+                // Act
+                bool reloaded = store.Reload();
+
+                // Assert
+                Assert.IsTrue(reloaded);
+                Assert.AreSame(store.Current, published);
+                Assert.AreEqual(first.Version + 1, store.Current.Version);
+                Assert.AreEqual(5, store.Current.PollInterval);
+                Assert.IsTrue(store.Current.IsNoMfaGroup(Resolve("SMK\\Service")!.Sid));
+                Assert.IsFalse(store.Current.IsNoMfaGroup(Resolve("SMK\\Admins")!.Sid));
+                // The old snapshot is never modified
+                Assert.AreEqual(1, first.PollInterval);
+                Assert.IsTrue(first.IsNoMfaGroup(Resolve("SMK\\Admins")!.Sid));
+            }
+        }
+
+        [TestMethod]
+        public void Reload_WithUnchangedValues_ShouldKeepSnapshotAndSkipResolution()
+        {
+            // Arrange
+            using (var store = CreateStore("NoMfaGroups=SMK\\Admins"))
+            {
+                var first = store.Current;
+                int resolutions = _resolved.Count;
+
+                // Act
+                bool reloaded = store.Reload();
+
+                // Assert
+                Assert.IsFalse(reloaded);
+                Assert.AreSame(first, store.Current);
+                Assert.AreEqual(resolutions, _resolved.Count);
+            }
+        }
+
+        [TestMethod]
+        public void Changed_WithThrowingHandler_ShouldStillPublish()
+        {
+            // Arrange
+            using (var store = CreateStore("PollInterval=1"))
+            {
+                var first = store.Current;
+                store.Changed += config => throw new InvalidOperationException("handler failure");
+                File.WriteAllLines(_path, new[] { "PollInterval=2" });
+
+                // Act
+                bool reloaded = store.Reload();
+
+                // Assert
+                Assert.IsTrue(reloaded);
+                Assert.AreEqual(2, store.Current.PollInterval);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(15000)]
+        public void StartWatching_WhenFileChanges_ShouldSwapSnapshot()
+        {
+            // Arrange
+            using (var store = CreateStore("ServiceUrl=http://one"))
+            using (var changed = new ManualResetEventSlim(false))
+            {
+                Assert.AreEqual("http://one", store.Current.ServiceUrl);
+                store.Changed += config => changed.Set();
+                store.StartWatching(10000);
+                Assert.IsTrue(store.IsWatching);
+
+                // Act
+                File.WriteAllLines(_path, new[] { "ServiceUrl=http://second", "NoMfaGroups=SMK\\Admins" });
+
+                // Assert
+                Assert.IsTrue(changed.Wait(10000), "Watcher did not pick up the change");
+                Assert.AreEqual("http://second", store.Current.ServiceUrl);
+                Assert.AreEqual(1, store.Current.NoMfaGroupSids.Count);
+                store.StopWatching();
+                Assert.IsFalse(store.IsWatching);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(15000)]
+        public void Current_WhileReloading_ShouldNeverBlockOrTear()
+        {
+            // Arrange
+            using (var store = CreateStore("PollInterval=0", "PollMaxSeconds=0"))
+            {
+                _ = store.Current;
+                int errors = 0;
+                bool stop = false;
+                var readers = Enumerable.Range(0, 4).Select(_ => new Thread(() =>
+                {
+                    while (!Volatile.Read(ref stop))
+                    {
+                        // Both values are written together, so a snapshot always has them equal
+                        var config = store.Current;
+                        if (config.PollInterval != config.PollMaxSeconds)
+                        {
+                            Interlocked.Increment(ref errors);
+                        }
+                    }
+                })).ToList();
+                readers.ForEach(t => t.Start());
+
+                // Act
+                for (int i = 1; i <= 50; i++)
+                {
+                    File.WriteAllLines(_path, new[] { $"PollInterval={i}", $"PollMaxSeconds={i}" });
+                    store.Reload();
+                }
+                Volatile.Write(ref stop, true);
+                readers.ForEach(t => t.Join());
+
+                // Assert
+                Assert.AreEqual(0, errors);
+                Assert.AreEqual(50, store.Current.PollInterval);
+            }
+        }
+
+        [TestMethod]
+        public void Dispose_ShouldStopWatcher()
+        {
+            // Arrange
+            var store = CreateStore("PollInterval=1");
+            store.StartWatching(10000);
+
+            // Act
+            store.Dispose();
+
+            // Assert
+            Assert.IsFalse(store.IsWatching);
+            Assert.ThrowsException<ObjectDisposedException>(() => store.StartWatching());
+        }
+    }
+}
@@ -0,0 +1,278 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Omni2FA.Net.Utils;
+
+namespace Omni2FA.Adapter.Tests
+{
+    /// <summary>
+    /// Tests for the binary SID set and the group membership cache, backed by a fake directory
+    /// </summary>
+    [TestClass]
+    public class GroupMembershipCacheTests
+    {
+        private const string DomainAdmins = "S-1-5-21-3623811015-3361044348-30300820-512";
+        private const string DomainUsers = "S-1-5-21-3623811015-3361044348-30300820-513";
+        private const string NoMfa = "S-1-5-21-3623811015-3361044348-30300820-1105";
+
+        private class FakeDirectory : IGroupDirectory
+        {
+            public readonly Dictionary<string, string[]> Users = new Dictionary<string, string[]>(StringComparer.OrdinalIgnoreCase);
+            public string? Error;
+            public int Calls;
+
+            public UserResolutionResult? ResolveUserGroups(string userName)
+            {
+                Interlocked.Increment(ref Calls);
+                if (Error != null)
+                {
+                    return new UserResolutionResult { UserName = userName, Error = Error };
+                }
+                if (!Users.TryGetValue(userName, out var sids))
+                {
+                    return null;
+                }
+                return new UserResolutionResult { UserName = userName, GroupSids = new HashSet<string>(sids) };
+            }
+        }
+
+        private FakeDirectory _directory = new FakeDirectory();
+        private long _now;
+        private List<Action> _scheduled = new List<Action>();
+
+        [TestInitialize]
+        public void Setup()
+        {
+            _directory = new FakeDirectory();
+            _directory.Users["SMK\\alice"] = new[] { DomainUsers, NoMfa };
+            _directory.Users["SMK\\bob"] = new[] { DomainUsers, DomainAdmins };
+            _now = TimeSpan.FromHours(1).Ticks;
+            _scheduled = new List<Action>();
+        }
+
+        private GroupMembershipCache CreateCache(int capacity = 100, int ttlSeconds = 60, int negativeSeconds = 10)
+        {
+            return new GroupMembershipCache(_directory, capacity, TimeSpan.FromSeconds(ttlSeconds), TimeSpan.FromSeconds(negativeSeconds),
+                work => _scheduled.Add(work), () => _now);
+        }
+
+        private void Advance(int seconds)
+        {
+            _now += TimeSpan.FromSeconds(seconds).Ticks;
+        }
+
+        [TestMethod]
+        public void SidSet_ShouldRoundTripAndDeduplicate()
+        {
+            // Act
+            var set = SidSet.FromStrings(new[] { DomainUsers, "S-1-5-32-544", DomainUsers, "not a sid", "S-1-1-0" });
+
+            // Assert
+            Assert.AreEqual(3, set.Count);
+            CollectionAssert.AreEquivalent(new[] { DomainUsers, "S-1-5-32-544", "S-1-1-0" }, set.ToStrings().ToArray());
+            Assert.AreEqual(28 + 16 + 12, set.DataSize);
+            Assert.IsTrue(set.Contains(DomainUsers));
+            Assert.IsFalse(set.Contains(DomainAdmins));
+            Assert.IsFalse(set.Contains("garbage"));
+        }
+
+        [TestMethod]
+        public void SidSet_ToBinary_ShouldMatchWindowsLayout()
+        {
+            // Act
+            var binary = SidSet.ToBinary("S-1-5-32-544");
+
+            // Assert - revision, count, authority (big-endian), sub-authority (little-endian)
+            CollectionAssert.AreEqual(new byte[] { 1, 2, 0, 0, 0, 0, 0, 5, 0x20, 0, 0, 0, 0x20, 0x02, 0, 0 }, binary);
+            Assert.IsNull(SidSet.ToBinary("S-1"));
+            Assert.IsNull(SidSet.ToBinary("S-1-5-x"));
+            Assert.IsNull(SidSet.ToBinary("S-1-281474976710656-1"));
+        }
+
+        [TestMethod]
+        public void SidSet_CountCommon_ShouldMatchLinqIntersect()
+        {
+            // Arrange
+            var random = new Random(7);
+            for (int round = 0; round < 50; round++)
+            {
+                var a = Enumerable.Range(0, random.Next(0, 40)).Select(_ => "S-1-5-21-1-2-3-" + random.Next(0, 60)).ToList();
+                var b = Enumerable.Range(0, random.Next(0, 40)).Select(_ => "S-1-5-21-1-2-3-" + random.Next(0, 60)).ToList();
+
+                // Act
+                int common = SidSet.FromStrings(a).CountCommon(SidSet.FromStrings(b));
+
+                // Assert
+                Assert.AreEqual(a.Intersect(b).Count(), common);
+                Assert.AreEqual(common > 0, SidSet.FromStrings(a).Overlaps(SidSet.FromStrings(b)));
+            }
+            Assert.AreEqual(0, SidSet.Empty.CountCommon(null!));
+        }
+
+        [TestMethod]
+        public void Resolve_SecondCall_ShouldBeServedFromCache()
+        {
+            // Arrange
+            var cache = CreateCache();
+            var noMfa = SidSet.FromStrings(new[] { NoMfa });
+
+            // Act
+            var first = cache.Resolve("SMK\\alice");
+            var second = cache.Resolve("smk\\ALICE");
+
+            // Assert
+            Assert.IsTrue(first.Success);
+            Assert.AreSame(first, second);
+            Assert.AreEqual(1, _directory.Calls);
+            Assert.AreEqual(1, noMfa.CountCommon(second.GroupSids));
+            var stats = cache.GetStats();
+            Assert.AreEqual(1, stats.Hits);
+            Assert.AreEqual(1, stats.Misses);
+        }
+
+        [TestMethod]
+        public void Resolve_UnknownUser_ShouldBeCachedForNegativeTtl()
+        {
+            // Arrange
+            var cache = CreateCache(ttlSeconds: 60, negativeSeconds: 5);
+
+            // Act
+            var first = cache.Resolve("SMK\\nobody");
+            var second = cache.Resolve("SMK\\nobody");
+            Advance(6);
+            var third = cache.Resolve("SMK\\nobody");
+
+            // Assert
+            Assert.IsFalse(first.Success);
+            Assert.IsNull(first.Error);
+            Assert.AreSame(first, second);
+            Assert.AreNotSame(second, third);
+            Assert.AreEqual(2, _directory.Calls);
+            Assert.AreEqual(1, cache.GetStats().NegativeHits);
+        }
+
+        [TestMethod]
+        public void Resolve_DirectoryError_ShouldBeCachedForNegativeTtl()
+        {
+            // Arrange
+            var cache = CreateCache();
+            _directory.Error = "The server is not operational.";
+
+            // Act
+            var first = cache.Resolve("SMK\\alice");
+            _directory.Error = null;
+            var second = cache.Resolve("SMK\\alice");
+            Advance(11);
+            var third = cache.Resolve("SMK\\alice");
+
+            // Assert
+            Assert.AreEqual("The server is not operational.", first.Error);
+            Assert.AreSame(first, second);
+            Assert.IsTrue(third.Success);
+        }
+
+        [TestMethod]
+        public void Resolve_HotEntryNearExpiry_ShouldRefreshInBackground()
+        {
+            // Arrange
+            var cache = CreateCache(ttlSeconds: 100);
+            var first = cache.Resolve("SMK\\bob");
+            _directory.Users["SMK\\bob"] = new[] { DomainUsers, NoMfa };
+
+            // Act - past 80% of the TTL the stale entry is served and one refresh is queued
+            Advance(85);
+            var stale = cache.Resolve("SMK\\bob");
+            var staleAgain = cache.Resolve("SMK\\bob");
+            Assert.AreEqual(1, _scheduled.Count);
+            _scheduled[0]();
+            var refreshed = cache.Resolve("SMK\\bob");
+
+            // Assert
+            Assert.AreSame(first, stale);
+            Assert.AreSame(first, staleAgain);
+            Assert.AreNotSame(first, refreshed);
+            Assert.IsTrue(refreshed.GroupSids!.Contains(NoMfa));
+            Assert.AreEqual(2, _directory.Calls);
+            Assert.AreEqual(1, cache.GetStats().Refreshes);
+        }
+
+        [TestMethod]
+        public void Resolve_RefreshFailure_ShouldKeepServingLastGoodEntry()
+        {
+            // Arrange
+            var cache = CreateCache(ttlSeconds: 100);
+            var first = cache.Resolve("SMK\\alice");
+            Advance(90);
+            cache.Resolve("SMK\\alice");
+            _directory.Error = "timeout";
+
+            // Act
+            _scheduled[0]();
+            var afterFailure = cache.Resolve("SMK\\alice");
+
+            // Assert - no second refresh is queued while the directory is failing
+            Assert.AreSame(first, afterFailure);
+            Assert.AreEqual(1, _scheduled.Count);
+            Assert.AreEqual(1, cache.GetStats().RefreshFailures);
+        }
+
+        [TestMethod]
+        public void Resolve_WithZeroTtl_ShouldAlwaysAskDirectory()
+        {
+            // Arrange
+            var cache = CreateCache(ttlSeconds: 0, negativeSeconds: 0);
+
+            // Act
+            cache.Resolve("SMK\\alice");
+            cache.Resolve("SMK\\alice");
+
+            // Assert
+            Assert.AreEqual(2, _directory.Calls);
+            Assert.AreEqual(0, cache.GetStats().Count);
+        }
+
+        [TestMethod]
+        public void Resolve_OverCapacity_ShouldEvict()
+        {
+            // Arrange
+            var cache = CreateCache(capacity: 4);
+            for (int i = 0; i < 20; i++)
+            {
+                _directory.Users["SMK\\user" + i] = new[] { DomainUsers };
+            }
+
+            // Act
+            for (int i = 0; i < 20; i++)
+            {
+                cache.Resolve("SMK\\user" + i);
+            }
+
+            // Assert
+            var stats = cache.GetStats();
+            Assert.IsTrue(stats.Count <= 4);
+            Assert.AreEqual(20 - stats.Count, stats.Evictions);
+        }
+
+        [TestMethod]
+        public void Resolve_ManyUsers_ShouldFillTheWholeCapacity()
+        {
+            // Arrange - 7 entries do not split evenly over the shards
+            var cache = CreateCache(capacity: 7);
+            for (int i = 0; i < 500; i++)
+            {
+                _directory.Users["SMK\\user" + i] = new[] { DomainUsers };
+            }
+
+            // Act
+            for (int i = 0; i < 500; i++)
+            {
+                cache.Resolve("SMK\\user" + i);
+            }
+
+            // Assert
+            Assert.AreEqual(7L, cache.GetStats().Count);
+        }
+    }
+}
@@ -0,0 +1,258 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Threading;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Omni2FA.Net.Utils;
+
+namespace Omni2FA.Adapter.Tests
+{
+    /// <summary>
+    /// Tests for the parallel group resolver and its SID snapshot file, backed by a fake directory
+    /// </summary>
+    [TestClass]
+    public class GroupSidResolverTests
+    {
+        private const string Admins = "S-1-5-21-3623811015-3361044348-30300820-512";
+        private const string NoMfa = "S-1-5-21-3623811015-3361044348-30300820-1105";
+        private const string NoMfaRecreated = "S-1-5-21-3623811015-3361044348-30300820-1187";
+
+        private class FakeDirectory
+        {
+            public readonly Dictionary<string, string> Groups = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            // Lookups wait here until the test opens it
+            public readonly ManualResetEventSlim Open = new ManualResetEventSlim(true);
+            public string? Error;
+            public int Calls;
+            public int Running;
+            public int MaxRunning;
+
+            public GroupResolutionResult? Resolve(string name)
+            {
+                Interlocked.Increment(ref Calls);
+                int running = Interlocked.Increment(ref Running);
+                lock (Groups)
+                {
+                    MaxRunning = Math.Max(MaxRunning, running);
+                }
+                try
+                {
+                    Open.Wait(TimeSpan.FromSeconds(10));
+                    string? sid;
+                    lock (Groups)
+                    {
+                        if (Error != null)
+                        {
+                            return new GroupResolutionResult { GroupName = name, Error = Error };
+                        }
+                        if (!Groups.TryGetValue(name, out sid))
+                        {
+                            return null;
+                        }
+                    }
+                    return new GroupResolutionResult { GroupName = name, Sid = sid };
+                }
+                finally
+                {
+                    Interlocked.Decrement(ref Running);
+                }
+            }
+
+            public void Set(string name, string sid)
+            {
+                lock (Groups)
+                {
+                    Groups[name] = sid;
+                }
+            }
+        }
+
+        private FakeDirectory _directory = new FakeDirectory();
+        private string _snapshotPath = string.Empty;
+        private string _configPath = string.Empty;
+
+        [TestInitialize]
+        public void Setup()
+        {
+            _directory = new FakeDirectory();
+            _directory.Set("SMK\\Admins", Admins);
+            _directory.Set("SMK\\TSG NO MFA", NoMfa);
+            _snapshotPath = Path.Combine(Path.GetTempPath(), $"omni2fa-groups-{Guid.NewGuid():N}.groups");
+            _configPath = Path.Combine(Path.GetTempPath(), $"omni2fa-config-{Guid.NewGuid():N}.txt");
+        }
+
+        [TestCleanup]
+        public void Cleanup()
+        {
+            _directory.Open.Set();
+            foreach (var path in new[] { _snapshotPath, _configPath })
+            {
+                if (File.Exists(path))
+                {
+                    File.Delete(path);
+                }
+            }
+        }
+
+        private static void WaitFor(ManualResetEventSlim signal)
+        {
+            Assert.IsTrue(signal.Wait(TimeSpan.FromSeconds(10)), "Timed out waiting for a background lookup");
+        }
+
+        [TestMethod]
+        [Timeout(20000)]
+        public void ResolveAll_ShouldLookUpGroupsInParallel()
+        {
+            // Arrange
+            var names = new List<string>();
+            for (int i = 0; i < 8; i++)
+            {
+                names.Add($"SMK\\Group{i}");
+                _directory.Set($"SMK\\Group{i}", $"S-1-5-21-1-2-3-{1100 + i}");
+            }
+            var resolver = new GroupSidResolver(_directory.Resolve);
+            _directory.Open.Reset();
+            var release = new Thread(() =>
+            {
+                // Let the lookups pile up before any of them answers
+                var wait = Stopwatch.StartNew();
+                while (Volatile.Read(ref _directory.Running) < 4 && wait.ElapsedMilliseconds < 8000)
+                {
+                    Thread.Sleep(10);
+                }
+                _directory.Open.Set();
+            });
+            release.Start();
+
+            // Act
+            var results = resolver.ResolveAll(names, TimeSpan.FromSeconds(15));
+            release.Join();
+
+            // Assert
+            Assert.AreEqual(8, results.Count);
+            Assert.AreEqual("S-1-5-21-1-2-3-1105", results["smk\\group5"].Sid);
+            Assert.IsTrue(_directory.MaxRunning >= 4, $"Only {_directory.MaxRunning} lookups ran at the same time");
+        }
+
+        [TestMethod]
+        [Timeout(20000)]
+        public void ResolveAll_WhenDirectoryIsSlow_ShouldReturnAfterTimeoutAndRevalidateLater()
+        {
+            // Arrange
+            var resolver = new GroupSidResolver(_directory.Resolve);
+            var revalidated = new ManualResetEventSlim(false);
+            resolver.Revalidated += () => revalidated.Set();
+            _directory.Open.Reset();
+
+            // Act
+            var watch = Stopwatch.StartNew();
+            var results = resolver.ResolveAll(new[] { "SMK\\Admins", "SMK\\TSG NO MFA" }, TimeSpan.FromMilliseconds(200));
+            watch.Stop();
+            _directory.Open.Set();
+            WaitFor(revalidated);
+            var known = resolver.ResolveKnown(new[] { "SMK\\Admins", "SMK\\TSG NO MFA" });
+
+            // Assert
+            Assert.IsTrue(watch.ElapsedMilliseconds < 5000, $"ResolveAll took {watch.ElapsedMilliseconds} ms");
+            Assert.IsFalse(results["SMK\\Admins"].Success);
+            StringAssert.Contains(results["SMK\\Admins"].Error, "not resolved within");
+            Assert.AreEqual(Admins, known["SMK\\Admins"].Sid);
+            Assert.AreEqual(NoMfa, known["SMK\\TSG NO MFA"].Sid);
+        }
+
+        [TestMethod]
+        [Timeout(20000)]
+        public void ResolveAll_WhenLookupFails_ShouldKeepLastKnownSid()
+        {
+            // Arrange
+            var resolver = new GroupSidResolver(_directory.Resolve);
+            resolver.ResolveAll(new[] { "SMK\\Admins", "SMK\\Missing" }, TimeSpan.FromSeconds(10));
+            _directory.Error = "The server is not operational.";
+
+            // Act
+            var results = resolver.ResolveAll(new[] { "SMK\\Admins", "SMK\\Missing" }, TimeSpan.FromSeconds(10));
+
+            // Assert
+            Assert.AreEqual(Admins, results["SMK\\Admins"].Sid);
+            Assert.IsFalse(results["SMK\\Missing"].Success);
+            Assert.AreEqual("The server is not operational.", results["SMK\\Missing"].Error);
+        }
+
+        [TestMethod]
+        [Timeout(20000)]
+        public void ResolveAll_WithSnapshot_ShouldAnswerAtOnceAndRevalidateInBackground()
+        {
+            // Arrange
+            var first = new GroupSidResolver(_directory.Resolve, _snapshotPath);
+            first.ResolveAll(new[] { "SMK\\Admins", "SMK\\TSG NO MFA", "SMK\\Missing" }, TimeSpan.FromSeconds(10));
+            Assert.IsTrue(File.Exists(_snapshotPath));
+
+            // The group was recreated while NPS was down, and the directory is slow now
+            _directory.Set("SMK\\TSG NO MFA", NoMfaRecreated);
+            _directory.Open.Reset();
+            var restarted = new GroupSidResolver(_directory.Resolve, _snapshotPath);
+            var revalidated = new ManualResetEventSlim(false);
+            restarted.Revalidated += () => revalidated.Set();
+
+            // Act
+            var watch = Stopwatch.StartNew();
+            var results = restarted.ResolveAll(new[] { "SMK\\Admins", "SMK\\TSG NO MFA" }, TimeSpan.FromSeconds(10));
+            watch.Stop();
+            _directory.Open.Set();
+            WaitFor(revalidated);
+            var known = restarted.ResolveKnown(new[] { "SMK\\Admins", "SMK\\TSG NO MFA" });
+
+            // Assert
+            Assert.AreEqual(2, restarted.KnownCount);
+            Assert.IsTrue(watch.ElapsedMilliseconds < 2000, $"ResolveAll took {watch.ElapsedMilliseconds} ms");
+            Assert.AreEqual(Admins, results["SMK\\Admins"].Sid);
+            Assert.AreEqual(NoMfa, results["SMK\\TSG NO MFA"].Sid);
+            Assert.AreEqual(NoMfaRecreated, known["SMK\\TSG NO MFA"].Sid);
+            StringAssert.Contains(File.ReadAllText(_snapshotPath), NoMfaRecreated);
+        }
+
+        [TestMethod]
+        public void Constructor_WithDamagedSnapshot_ShouldStartEmpty()
+        {
+            // Arrange
+            File.WriteAllText(_snapshotPath, "garbage\nSMK\\Admins\tS-1-5-21-1\tD\n");
+
+            // Act
+            var resolver = new GroupSidResolver(_directory.Resolve, _snapshotPath);
+
+            // Assert
+            Assert.AreEqual(0, resolver.KnownCount);
+        }
+
+        [TestMethod]
+        [Timeout(20000)]
+        public void ConfigStore_WhenRevalidationChangesSid_ShouldPublishRebuiltSnapshot()
+        {
+            // Arrange
+            File.WriteAllLines(_configPath, new[] { "NoMfaGroups=SMK\\TSG NO MFA" });
+            using (var store = new ConfigStore(new FileConfigSource(_configPath, 20), _directory.Resolve, _snapshotPath))
+            {
+                Assert.IsTrue(store.Current.IsNoMfaGroup(NoMfa));
+            }
+            _directory.Set("SMK\\TSG NO MFA", NoMfaRecreated);
+            _directory.Open.Reset();
+            using (var store = new ConfigStore(new FileConfigSource(_configPath, 20), _directory.Resolve, _snapshotPath))
+            {
+                var first = store.Current;
+                var changed = new ManualResetEventSlim(false);
+                store.Changed += snapshot => changed.Set();
+
+                // Act
+                _directory.Open.Set();
+                WaitFor(changed);
+
+                // Assert
+                Assert.IsTrue(first.IsNoMfaGroup(NoMfa));
+                Assert.AreEqual(first.Version + 1, store.Current.Version);
+                Assert.IsTrue(store.Current.IsNoMfaGroup(NoMfaRecreated));
+                Assert.IsFalse(store.Current.IsNoMfaGroup(NoMfa));
+            }
+        }
+    }
+}
@@ -0,0 +1,91 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Omni2FA.Net.Utils;
+
+namespace Omni2FA.Adapter.Tests
+{
+    /// <summary>
+    /// Tests for the managed side of the plugin metrics, with the native sinks replaced by lists
+    /// </summary>
+    [TestClass]
+    public class MetricsTests
+    {
+        private List<KeyValuePair<int, long>> _samples = new List<KeyValuePair<int, long>>();
+        private List<int> _counters = new List<int>();
+
+        [TestInitialize]
+        public void Setup()
+        {
+            _samples = new List<KeyValuePair<int, long>>();
+            _counters = new List<int>();
+            Metrics.Sink = (phase, micros) => _samples.Add(new KeyValuePair<int, long>(phase, micros));
+            Metrics.CounterSink = counter => _counters.Add(counter);
+        }
+
+        [TestCleanup]
+        public void Cleanup()
+        {
+            Metrics.Sink = null;
+            Metrics.CounterSink = null;
+        }
+
+        [TestMethod]
+        public void Record_PassesPhaseIndexAndElapsedMicroseconds()
+        {
+            // Arrange
+            var start = Metrics.Start();
+            Thread.Sleep(5);
+
+            // Act
+            Metrics.Record(MetricsPhase.Groups, start);
+
+            // Assert
+            Assert.AreEqual(1, _samples.Count);
+            Assert.AreEqual(3, _samples[0].Key);
+            Assert.IsTrue(_samples[0].Value >= 4000, $"elapsed {_samples[0].Value} us");
+        }
+
+        [TestMethod]
+        public void Increment_PassesCounterIndex()
+        {
+            // Act
+            Metrics.Increment(MetricsCounter.MfaFailed);
+
+            // Assert
+            CollectionAssert.AreEqual(new[] { 2 }, _counters);
+        }
+
+        [TestMethod]
+        public void Record_WithoutSink_DoesNothing()
+        {
+            // Arrange
+            Metrics.Sink = null;
+            Metrics.CounterSink = null;
+
+            // Act
+            Metrics.Record(MetricsPhase.Lookup, Metrics.Start());
+            Metrics.Increment(MetricsCounter.MfaSucceeded);
+
+            // Assert
+            Assert.AreEqual(0, _samples.Count);
+            Assert.AreEqual(0, _counters.Count);
+        }
+
+        [TestMethod]
+        public void AttributeLookup_RecordsLookupPhase()
+        {
+            // Arrange
+            var attributes = new List<OpenCymd.Nps.Plugin.RadiusAttribute>();
+
+            // Act
+            var value = Radius.AttributeLookup(attributes, OpenCymd.Nps.Plugin.RadiusAttributeType.UserName);
+
+            // Assert
+            Assert.AreEqual(string.Empty, value);
+            Assert.AreEqual(1, _samples.Count);
+            Assert.AreEqual((int)MetricsPhase.Lookup, _samples[0].Key);
+        }
+    }
+}
@@ -22,18 +22,46 @@ namespace Omni2FA.Adapter {
         private static int initCount = 0;
         // Add a static field for the authenticator
         private static Authenticator _authenticator;
-        // Store NoMFA group SIDs
-        private static HashSet<string> _noMfaGroupSids = new HashSet<string>();
-        private static bool _enableTraceLogging = false;
-        // Store MFA-enabled NPS policy name
-        private static string _mfaEnabledNpsPolicy = string.Empty;
-        // Registry path and value name for NoMFA groups
+        // Settings (NoMfaGroups, MfaEnabledNPSPolicy, EnableTraceLogging, ...) come from the shared
+        // snapshot and are picked up without restarting NPS when the registry changes
         // [HKEY_LOCAL_MACHINE\SOFTWARE\Omni2FA.NPS]
         // "NoMfaGroups"="Group1;Group2;Group3"
-        private const string _regPath = @"SOFTWARE\Omni2FA.NPS";
-        private const string _noMfaKey = "NoMfaGroups";
-        private const string _enableTraceLoggingKey = "EnableTraceLogging";
-        private const string _mfaEnabledNpsPolicyKey = "MfaEnabledNPSPolicy";
+        private static ConfigStore _config;
+        // Recent MFA results per user, NAS and policy (MfaCacheSeconds); replaced when MfaCacheMaxEntries changes
+        private static MfaResultCache _mfaCache;
+        // Group SIDs per user (GroupCacheSeconds); replaced when its settings change
+        private static GroupMembershipCache _groupCache;
+        // Limits concurrent MFA exchanges (MfaMaxConcurrent); null when there is no limit
+        private static MfaAdmission _admission;
+        // MFA exchanges in progress per user, NAS and policy, shared by NAS retransmissions (MfaCoalesceRequests)
+        private static MfaSingleFlight<MfaOutcome> _flights;
+
+        private enum MfaOutcome {
+            Succeeded,
+            Failed,
+            // Turned away by the concurrency limit
+            QueueFull,
+            QueueTimeout,
+            // Turned away by the open circuit breaker
+            CircuitOpen
+        }
+
+        /// <summary>
+        /// Set by Omni2FA.NPS.Plugin while its native MFA client is active (NativeMfaClient);
+        /// when null the managed <see cref="Authenticator"/> is used.
+        /// </summary>
+        public static Func<string, bool> NativeAuthenticate;
+
+        /// <summary>
+        /// Set by Omni2FA.NPS.Plugin: evaluates the compiled MfaRules for the request (ECB pointer), from the given
+        /// rule index on, and returns the index of the first rule whose conditions other than groups hold,
+        /// <see cref="RuleNotMatched"/>, or <see cref="RulesUnavailable"/> if the plugin has no rules compiled
+        /// from the given <see cref="ConfigSnapshot.MfaRulesTag"/>.
+        /// </summary>
+        public static Func<IntPtr, long, int, int> NativeMatchRule;
+
+        public const int RuleNotMatched = -1;
+        public const int RulesUnavailable = -2;
 
         /// <summary>
         /// <para>Called by NPS while the service is starting up</para>
@@ -48,51 +76,21 @@ namespace Omni2FA.Adapter {
 
             if (initCount == 0) {
                 initCount++;
-                _authenticator = new Authenticator();
 
-                // Initialize the Groups helper
+                // Initialize the Groups helper before the first snapshot resolves NoMfaGroups
                 Groups.Initialize();
                 Log.Event(Log.Level.Trace, 12, $"Hostname detected: {Groups.Hostname}");
 
-                using (var registry = new Registry(_regPath)) {
-                    // Read trace logging setting
-                    _enableTraceLogging = registry.GetBoolRegistryValue(_enableTraceLoggingKey, false);
-                    
-                    Log.SetTraceLoggingEnabled(_enableTraceLogging);
-
-                    // Read MFA-enabled NPS policy name
-                    _mfaEnabledNpsPolicy = registry.GetStringRegistryValue(_mfaEnabledNpsPolicyKey, string.Empty);
-                    if (!string.IsNullOrEmpty(_mfaEnabledNpsPolicy)) {
-                        _mfaEnabledNpsPolicy = _mfaEnabledNpsPolicy.Trim();
-                        Log.Event(Log.Level.Information, 201, $"MFA-enabled NPS policy set to: {_mfaEnabledNpsPolicy}");
-                    }
-                    else {
-                        Log.Event(Log.Level.Information, 202, "MfaEnabledNPSPolicy registry value is empty or missing.");
-                    }
-
-                    // Read NoMFA group names and resolve to SIDs
-                    var groupNames = registry.GetStringRegistryValue(_noMfaKey, string.Empty);
-                    if (!string.IsNullOrEmpty(groupNames)) {
-                        foreach (var groupName in groupNames.Split(new[] { ';', ',' }, StringSplitOptions.RemoveEmptyEntries)) {
-                            string trimmedName = groupName.Trim();
-                            var result = Groups.ResolveGroup(trimmedName);
+                _config = ConfigStore.Shared;
+                Log.SetTraceLoggingEnabled(_config.Current.EnableTraceLogging);
+                _mfaCache = new MfaResultCache(_config.Current.MfaCacheMaxEntries);
+                _groupCache = CreateGroupCache(_config.Current);
+                _admission = CreateAdmission(_config.Current);
+                _flights = new MfaSingleFlight<MfaOutcome>();
+                _config.Changed += OnConfigChanged;
+                _config.StartWatching();
 
-                            if (result != null && result.Success) {
-                                _noMfaGroupSids.Add(result.Sid);
-                                Log.Event(Log.Level.Information, 140, $"NoMFA group added ({result.ContextName}): {trimmedName} (SID: {result.Sid})");
-                            }
-                            else if (result != null && !string.IsNullOrEmpty(result.Error)) {
-                                Log.Event(Log.Level.Warning, 302, $"Error resolving group '{trimmedName}' in {result.ContextName}: {result.Error}");
-                            }
-                            else {
-                                Log.Event(Log.Level.Warning, 303, $"NoMFA group not found: {trimmedName}");
-                            }
-                        }
-                    }
-                    else {
-                        Log.Event(Log.Level.Warning, 304, "NoMfaGroups registry value is empty or missing.");
-                    }
-                } // Registry is properly disposed here
+                _authenticator = new Authenticator(null, _config);
             }
             return 0;
         }
@@ -105,15 +103,226 @@ namespace Omni2FA.Adapter {
             initCount--;
             if (initCount == 0) {
                 Log.Event(Log.Level.Trace, 11, "RadiusExtensionTerm called");
-                
+
+                if (_config != null) {
+                    _config.Changed -= OnConfigChanged;
+                    _config.StopWatching();
+                    _config = null;
+                }
+
+                if (_mfaCache != null) {
+                    Log.Event(Log.Level.Information, 113, $"MFA result cache {_mfaCache.GetStats()}");
+                    _mfaCache = null;
+                }
+
+                if (_groupCache != null) {
+                    Log.Event(Log.Level.Information, 114, $"Group membership cache {_groupCache.GetStats()}");
+                    _groupCache = null;
+                }
+
+                if (_admission != null) {
+                    Log.Event(Log.Level.Information, 116, $"MFA admission {_admission.GetStats()}");
+                    _admission = null;
+                }
+
+                if (_flights != null) {
+                    Log.Event(Log.Level.Information, 117, $"MFA request coalescing {_flights.GetStats()}");
+                    _flights = null;
+                }
+
                 // Dispose authenticator to free resources
                 if (_authenticator != null) {
+                    Log.Event(Log.Level.Information, 218, $"MFA result polling {_authenticator.GetPollStats()}");
                     (_authenticator as IDisposable)?.Dispose();
                     _authenticator = null;
                 }
             }
         }
+
+        // The managed client sends a warm-up request after this long without traffic, well
+        // within the idle time after which the framework closes pooled connections (100 s)
+        private static readonly TimeSpan KeepWarmIdle = TimeSpan.FromSeconds(60);
+
+        /// <summary>
+        /// Called by Omni2FA.NPS.Plugin on its warm-up thread after RadiusExtensionInit: compiles the
+        /// Omni2FA code ahead of the first request and connects the managed client to the MFA service.
+        /// </summary>
+        /// <returns>The number of methods compiled.</returns>
+        public static int WarmUp() {
+            int prepared = 0;
+            var assemblies = new[] { typeof(NpsAdapter).Assembly, typeof(Authenticator).Assembly, typeof(ConfigSnapshot).Assembly };
+            foreach (var assembly in assemblies.Distinct()) {
+                prepared += PrepareMethods(assembly);
+            }
+            KeepWarm();
+            return prepared;
+        }
+
+        /// <summary>
+        /// Called by Omni2FA.NPS.Plugin every MfaKeepWarmSeconds: keeps a connection of the managed client
+        /// open while it is the one in use. The native client keeps its own pool warm.
+        /// </summary>
+        public static void KeepWarm() {
+            var authenticator = _authenticator;
+            if (authenticator != null && NativeAuthenticate == null) {
+                authenticator.WarmUpAsync(KeepWarmIdle).Wait();
+            }
+        }
+
+        // Compiles the non-generic methods of the assembly, which the JIT would otherwise do on the first request
+        private static int PrepareMethods(System.Reflection.Assembly assembly) {
+            const System.Reflection.BindingFlags declared = System.Reflection.BindingFlags.DeclaredOnly |
+                System.Reflection.BindingFlags.Public | System.Reflection.BindingFlags.NonPublic |
+                System.Reflection.BindingFlags.Instance | System.Reflection.BindingFlags.Static;
+            Type[] types;
+            try {
+                types = assembly.GetTypes();
+            }
+            catch (System.Reflection.ReflectionTypeLoadException ex) {
+                types = ex.Types.Where(type => type != null).ToArray();
+            }
+            int prepared = 0;
+            foreach (var type in types) {
+                if (type.ContainsGenericParameters) {
+                    continue;
+                }
+                var methods = type.GetMethods(declared).Cast<System.Reflection.MethodBase>().Concat(type.GetConstructors(declared));
+                foreach (var method in methods) {
+                    if (method.IsAbstract || method.ContainsGenericParameters) {
+                        continue;
+                    }
+                    try {
+                        System.Runtime.CompilerServices.RuntimeHelpers.PrepareMethod(method.MethodHandle);
+                        prepared++;
+                    }
+                    catch (Exception) {
+                        // P/Invoke stubs and methods with missing dependencies are compiled on first use
+                    }
+                }
+            }
+            return prepared;
+        }
         
+        /// <summary>
+        /// Group SIDs of the user, from the group membership cache when possible.
+        /// </summary>
+        private static GroupMembership ResolveMembership(string userName) {
+            try {
+                var groupsStart = Metrics.Start();
+                var groupCache = _groupCache;
+                var membership = groupCache != null
+                    ? groupCache.Resolve(userName)
+                    : GroupMembership.FromResult(userName, Groups.ResolveUserGroups(userName));
+                Metrics.Record(MetricsPhase.Groups, groupsStart);
+                return membership;
+            }
+            catch (Exception ex) {
+                return new GroupMembership(userName, null, ex.Message);
+            }
+        }
+
+        /// <summary>
+        /// Applies MfaRules to the request. Returns false if no rule matches, leaving the decision to
+        /// MfaEnabledNPSPolicy. The plugin evaluates everything but the groups condition; for a rule with
+        /// groups the user's groups are resolved once and, if they do not match, evaluation goes on after it.
+        /// </summary>
+        private static bool ApplyRules(IntPtr ecbPointer, ConfigSnapshot config, string userName, ref GroupMembership membership, out bool performMfa) {
+            performMfa = true;
+            var matchRule = NativeMatchRule;
+            int index = matchRule != null ? matchRule(ecbPointer, config.MfaRulesTag, 0) : RulesUnavailable;
+            while (index >= 0 && index < config.Rules.Count && config.Rules[index].HasGroups) {
+                var candidate = config.Rules[index];
+                if (membership == null) {
+                    membership = ResolveMembership(userName);
+                }
+                if (membership.Success ? candidate.GroupSids.CountCommon(membership.GroupSids) > 0 : candidate.RequiresMfa) {
+                    // Without the user's groups an mfa rule applies and a skip rule does not
+                    break;
+                }
+                index = matchRule(ecbPointer, config.MfaRulesTag, index + 1);
+            }
+            if (index == RuleNotMatched) {
+                return false;
+            }
+            if (index < 0 || index >= config.Rules.Count) {
+                Log.Event(Log.Level.Warning, 314, "MfaRules are set but the plugin has not loaded them, MFA will be performed.");
+                return true;
+            }
+            var rule = config.Rules[index];
+            performMfa = rule.RequiresMfa;
+            Log.Event(Log.Level.Information, 136, $"MFA rule '{rule.Name}' matched for user {userName}, {(performMfa ? "MFA will be performed" : "skipping MFA")}.");
+            return true;
+        }
+
+        private static GroupMembershipCache CreateGroupCache(ConfigSnapshot config) {
+            return new GroupMembershipCache(new PrincipalGroupDirectory(), config.GroupCacheMaxEntries,
+                TimeSpan.FromSeconds(config.GroupCacheSeconds), TimeSpan.FromSeconds(config.GroupCacheNegativeSeconds));
+        }
+
+        /// <summary>
+        /// Runs one MFA exchange within the concurrency limit, unless the circuit breaker holds it back.
+        /// </summary>
+        private static MfaOutcome RunMfa(string userName, ConfigSnapshot config) {
+            var admission = _admission;
+            if (admission != null) {
+                var admitted = admission.TryEnter(TimeSpan.FromSeconds(config.MfaQueueTimeoutSeconds));
+                if (admitted != MfaAdmissionResult.Admitted) {
+                    return admitted == MfaAdmissionResult.QueueFull ? MfaOutcome.QueueFull : MfaOutcome.QueueTimeout;
+                }
+            }
+            try {
+                // Asked once admitted, so a half-open probe is never lost in the queue
+                if (!MfaBreaker.Allow()) {
+                    return MfaOutcome.CircuitOpen;
+                }
+                bool resMfa;
+                var nativeAuthenticate = NativeAuthenticate;
+                if (nativeAuthenticate != null) {
+                    resMfa = nativeAuthenticate(userName);
+                }
+                else {
+                    // calling AuthenticateAsync synchronously
+                    resMfa = _authenticator.AuthenticateAsync(userName).Result;
+                }
+                return resMfa ? MfaOutcome.Succeeded : MfaOutcome.Failed;
+            }
+            finally {
+                admission?.Exit();
+            }
+        }
+
+        private static MfaAdmission CreateAdmission(ConfigSnapshot config) {
+            return config.MfaMaxConcurrent > 0 ? new MfaAdmission(config.MfaMaxConcurrent, config.MfaMaxQueue) : null;
+        }
+
+        private static void OnConfigChanged(ConfigSnapshot config) {
+            Log.SetTraceLoggingEnabled(config.EnableTraceLogging);
+            // Requests holding a slot of the previous instance release it there
+            var admission = _admission;
+            if ((admission?.MaxConcurrent ?? 0) != config.MfaMaxConcurrent ||
+                (admission != null && admission.MaxQueue != config.MfaMaxQueue)) {
+                _admission = CreateAdmission(config);
+            }
+            var groupCache = _groupCache;
+            if (groupCache != null &&
+                (groupCache.Capacity != config.GroupCacheMaxEntries ||
+                 groupCache.Ttl != TimeSpan.FromSeconds(config.GroupCacheSeconds) ||
+                 groupCache.NegativeTtl != TimeSpan.FromSeconds(config.GroupCacheNegativeSeconds))) {
+                _groupCache = CreateGroupCache(config);
+            }
+            // Cached results may no longer match the new policy, groups or TTLs
+            var cache = _mfaCache;
+            if (cache == null) {
+                return;
+            }
+            if (cache.Capacity != config.MfaCacheMaxEntries) {
+                _mfaCache = new MfaResultCache(config.MfaCacheMaxEntries);
+            }
+            else {
+                cache.Clear();
+            }
+        }
+
         /// <summary>
         /// Called by the NPS host to process an authentication or authorization request.
         /// </summary>
@@ -121,6 +330,8 @@ namespace Omni2FA.Adapter {
         /// <returns>0 if all plugins were processed successfully or 5 (access denied) when at least one of the plugins failed.</returns>
         public static uint RadiusExtensionProcess2(IntPtr ecbPointer) {
             var control = new ExtensionControl(ecbPointer);
+            // One snapshot for the whole request, even if the settings change meanwhile
+            var config = ConfigStore.Shared.Current;
             string userName = string.Empty;
             Log.logRequest(control);
             /* 
@@ -138,18 +349,24 @@ namespace Omni2FA.Adapter {
                      */
                     Log.Event(Log.Level.Trace, 124, "Processing authorized AccessRequest for MFA");
                     bool performMfa = true;
-                    var policyName = Radius.AttributeLookup(control.Request, RadiusAttributeType.PolicyName);
+                    // Compared in place; the policy name is only decoded for logging and the cache key
+                    var policy = Radius.AttributeLookupView(control.Request, RadiusAttributeType.PolicyName);
+                    userName = Radius.AttributeLookup(control.Request, RadiusAttributeType.UserName).Trim();
+                    // Resolved at most once, by the first rule with groups or by the NoMFA check
+                    GroupMembership membership = null;
 
+                    if (config.Rules.Count > 0 && ApplyRules(ecbPointer, config, userName, ref membership, out performMfa)) {
+                        // Decided by a rule; MfaEnabledNPSPolicy only applies when none matches
+                    }
                     // Check if we should perform MFA based on policy configuration
-                    if (!string.IsNullOrEmpty(_mfaEnabledNpsPolicy)) {
+                    else if (!string.IsNullOrEmpty(config.MfaEnabledNpsPolicy)) {
                         // MFA policy is configured - only perform MFA if current policy matches
-                        if (string.IsNullOrEmpty(policyName) ||
-                            !string.Equals(policyName, _mfaEnabledNpsPolicy, StringComparison.OrdinalIgnoreCase)) {
+                        if (policy.IsEmpty || !policy.Equals(config.MfaEnabledNpsPolicy, StringComparison.OrdinalIgnoreCase)) {
                             performMfa = false;
-                            Log.Event(Log.Level.Information, 203, $"Policy '{policyName}' does NOT match MFA-enabled policy '{_mfaEnabledNpsPolicy}', skipping MFA.");
+                            Log.Event(Log.Level.Information, 203, $"Policy '{policy}' does NOT match MFA-enabled policy '{config.MfaEnabledNpsPolicy}', skipping MFA.");
                         }
                         else {
-                            Log.Event(Log.Level.Trace, 125, $"Policy '{policyName}' matches MFA-enabled policy '{_mfaEnabledNpsPolicy}', MFA will be performed.");
+                            Log.Event(Log.Level.Trace, 125, $"Policy '{policy}' matches MFA-enabled policy '{config.MfaEnabledNpsPolicy}', MFA will be performed.");
                         }
                     }
                     else {
@@ -158,40 +375,75 @@ namespace Omni2FA.Adapter {
                     }
 
                     if (performMfa) {
-                        try {
-                            userName = Radius.AttributeLookup(control.Request, RadiusAttributeType.UserName).Trim();
-
-                            // Resolve user groups using the helper
-                            var userResult = Groups.ResolveUserGroups(userName);
-
-                            if (userResult != null && userResult.Success) {
-                                // Check if any of the user's groups are in the NoMFA list
-                                var matchingSids = userResult.GroupSids.Intersect(_noMfaGroupSids).ToList();
-                                if (matchingSids.Any()) {
-                                    performMfa = false;
-                                    Log.Event(Log.Level.Information, 141, $"User {userName} is in NoMFA group (matched {matchingSids.Count} SID(s)), skipping MFA.");
-                                }
-                            }
-                            else if (userResult != null && !string.IsNullOrEmpty(userResult.Error)) {
-                                Log.Event(Log.Level.Warning, 305, $"Error checking NoMFA group membership for user '{userName}': {userResult.Error}");
+                        if (membership == null) {
+                            membership = ResolveMembership(userName);
+                        }
+                        if (membership.Success) {
+                            // Check if any of the user's groups are in the NoMFA list
+                            int matchingSids = config.NoMfaSidSet.CountCommon(membership.GroupSids);
+                            if (matchingSids > 0) {
+                                performMfa = false;
+                                Log.Event(Log.Level.Information, 141, $"User {userName} is in NoMFA group (matched {matchingSids} SID(s)), skipping MFA.");
                             }
                         }
-                        catch (Exception ex) {
-                            Log.Event(Log.Level.Warning, 305, $"Error checking NoMFA group membership for user '{userName}': {ex.Message}");
+                        else if (!string.IsNullOrEmpty(membership.Error)) {
+                            Log.Event(Log.Level.Warning, 305, $"Error checking NoMFA group membership for user '{userName}': {membership.Error}");
                         }
                     }
 
                     if (performMfa) {
-                        // calling AuthenticateAsync synchronously
-                        bool resMfa = _authenticator.AuthenticateAsync(userName).Result;
+                        bool resMfa;
+                        var cache = _mfaCache;
+                        var flights = config.MfaCoalesceRequests ? _flights : null;
+                        bool useCache = cache != null && (config.MfaCacheSeconds > 0 || config.MfaCacheFailureSeconds > 0);
+                        string cacheKey = useCache || flights != null
+                            ? MfaResultCache.MakeKey(userName,
+                                Radius.AttributeLookup(control.Request, RadiusAttributeType.NASIPAddress),
+                                Radius.AttributeLookup(control.Request, RadiusAttributeType.CalledStationId),
+                                policy.ToString())
+                            : null;
+                        if (useCache && cache.TryGet(cacheKey, out resMfa)) {
+                            Log.Event(Log.Level.Information, 133, $"MFA result for user {userName} reused from cache: {(resMfa ? "success" : "failure")}");
+                        }
+                        else {
+                            bool coalesced = false;
+                            var outcome = flights != null
+                                ? flights.Run(cacheKey, () => RunMfa(userName, config), out coalesced)
+                                : RunMfa(userName, config);
+                            if (coalesced) {
+                                Log.Event(Log.Level.Information, 135, $"MFA for user {userName} joined the exchange already in progress (retransmission)");
+                            }
+                            if (outcome == MfaOutcome.QueueFull || outcome == MfaOutcome.QueueTimeout) {
+                                // Too many MFA exchanges in progress: answer now instead of holding the NPS thread
+                                control.ResponseType = config.MfaFailOpen ? RadiusCode.AccessAccept : RadiusCode.AccessReject;
+                                Log.Event(Log.Level.Warning, 134, $"MFA not started for user {userName} ({(outcome == MfaOutcome.QueueFull ? "queue full" : "queue timeout")}), " +
+                                    $"{(config.MfaFailOpen ? "accepting (MfaFailOpen)" : "rejecting")} request. {_admission?.GetStats()}");
+                                return 0;
+                            }
+                            if (outcome == MfaOutcome.CircuitOpen) {
+                                // The MFA service is failing: answer now; the breaker logs its own transitions
+                                control.ResponseType = config.MfaFailOpen ? RadiusCode.AccessAccept : RadiusCode.AccessReject;
+                                Metrics.Increment(MetricsCounter.MfaCircuitRejected);
+                                Log.Event(Log.Level.Trace, 14, $"MFA not started for user {userName} (circuit open), " +
+                                    $"{(config.MfaFailOpen ? "accepting (MfaFailOpen)" : "rejecting")} request.");
+                                return 0;
+                            }
+                            resMfa = outcome == MfaOutcome.Succeeded;
+                            // The caller that ran the exchange has stored its result already
+                            if (useCache && !coalesced) {
+                                cache.Set(cacheKey, resMfa, TimeSpan.FromSeconds(resMfa ? config.MfaCacheSeconds : config.MfaCacheFailureSeconds));
+                            }
+                        }
                         if (resMfa) {
                             /* Keep final disposition to AccessAccept - Note that could be changed by other extensions */
                             control.ResponseType = RadiusCode.AccessAccept;
+                            Metrics.Increment(MetricsCounter.MfaSucceeded);
                             Log.Event(Log.Level.Information, 130, $"MFA succeeded for user {userName}");
                         }
                         else {
                             /* Set final disposition to AccessReject - Note that could be changed by other extensions */
                             control.ResponseType = RadiusCode.AccessReject;
+                            Metrics.Increment(MetricsCounter.MfaFailed);
                             Log.Event(Log.Level.Warning, 131, $"MFA failed for user {userName}");
                         }
                     }
@@ -0,0 +1,143 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Net;
+using System.Net.Http;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Moq;
+using Moq.Protected;
+using Omni2FA.Net.Utils;
+
+namespace Omni2FA.AuthClient.Tests
+{
+    /// <summary>
+    /// Tests that the Authenticator follows configuration changes without being recreated.
+    /// </summary>
+    [TestClass]
+    public class AuthenticatorConfigTests
+    {
+        private string _path = string.Empty;
+
+        [TestInitialize]
+        public void Setup()
+        {
+            _path = Path.Combine(Path.GetTempPath(), $"omni2fa-auth-config-{Guid.NewGuid():N}.txt");
+        }
+
+        [TestCleanup]
+        public void Cleanup()
+        {
+            if (File.Exists(_path))
+            {
+                File.Delete(_path);
+            }
+        }
+
+        /// <summary>
+        /// Helper method to create a mock HttpClient that answers every call with a given status and records the URLs.
+        /// </summary>
+        private HttpClient CreateRecordingHttpClient(List<string> urls, string responseContent)
+        {
+            var mockHandler = new Mock<HttpMessageHandler>();
+
+            mockHandler.Protected()
+                .Setup<Task<HttpResponseMessage>>(
+                    "SendAsync",
+                    ItExpr.IsAny<HttpRequestMessage>(),
+                    ItExpr.IsAny<CancellationToken>()
+                )
+                .ReturnsAsync((HttpRequestMessage request, CancellationToken token) =>
+                {
+                    lock (urls)
+                    {
+                        urls.Add(request.RequestUri!.ToString());
+                    }
+                    return new HttpResponseMessage
+                    {
+                        StatusCode = HttpStatusCode.OK,
+                        Content = new StringContent(responseContent, Encoding.UTF8, "application/json")
+                    };
+                });
+
+            return new HttpClient(mockHandler.Object);
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task AuthenticateAsync_AfterReload_ShouldUseNewServiceUrl()
+        {
+            // Arrange
+            File.WriteAllLines(_path, new[] { "ServiceUrl=http://first.example" });
+            var urls = new List<string>();
+            using (var config = new ConfigStore(new FileConfigSource(_path), name => null))
+            using (var authenticator = new Authenticator(CreateRecordingHttpClient(urls, "{\"status\": 1}"), config))
+            {
+                Assert.IsTrue(await authenticator.AuthenticateAsync("testuser"));
+
+                // Act
+                File.WriteAllLines(_path, new[] { "ServiceUrl=http://second.example" });
+                Assert.IsTrue(config.Reload());
+                var result = await authenticator.AuthenticateAsync("testuser");
+
+                // Assert
+                Assert.IsTrue(result);
+                CollectionAssert.AreEqual(
+                    new[] { "http://first.example/Authenticate", "http://second.example/Authenticate" },
+                    urls);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(10000)]
+        public async Task AuthenticateAsync_AfterReload_ShouldUseNewPollLimit()
+        {
+            // Arrange
+            File.WriteAllLines(_path, new[] { "WaitBeforePoll=0", "PollInterval=0", "PollMaxSeconds=3" });
+            var urls = new List<string>();
+            using (var config = new ConfigStore(new FileConfigSource(_path), name => null))
+            using (var authenticator = new Authenticator(CreateRecordingHttpClient(urls, "{\"status\": 0}"), config))
+            {
+                // Act
+                File.WriteAllLines(_path, new[] { "WaitBeforePoll=0", "PollInterval=0", "PollMaxSeconds=1" });
+                config.Reload();
+                var result = await authenticator.AuthenticateAsync("testuser");
+
+                // Assert - one Authenticate call and a single poll, as set after the authenticator was created
+                Assert.IsFalse(result);
+                Assert.AreEqual(2, urls.Count);
+                StringAssert.EndsWith(urls[1], "/AuthResult");
+            }
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task WarmUpAsync_ShouldOnlySendWhenIdle()
+        {
+            // Arrange
+            File.WriteAllLines(_path, new[] { "ServiceUrl=http://mfa.example" });
+            var urls = new List<string>();
+            using (var config = new ConfigStore(new FileConfigSource(_path), name => null))
+            using (var authenticator = new Authenticator(CreateRecordingHttpClient(urls, "{\"status\": 1}"), config))
+            {
+                // Act
+                bool first = await authenticator.WarmUpAsync(TimeSpan.FromMinutes(1));
+                bool recentlyWarmed = await authenticator.WarmUpAsync(TimeSpan.FromMinutes(1));
+                Assert.IsTrue(await authenticator.AuthenticateAsync("testuser"));
+                bool recentlyUsed = await authenticator.WarmUpAsync(TimeSpan.FromMinutes(1));
+                bool idle = await authenticator.WarmUpAsync(TimeSpan.Zero);
+
+                // Assert
+                Assert.IsTrue(first);
+                Assert.IsFalse(recentlyWarmed);
+                Assert.IsFalse(recentlyUsed);
+                Assert.IsTrue(idle);
+                CollectionAssert.AreEqual(
+                    new[] { "http://mfa.example/", "http://mfa.example/Authenticate", "http://mfa.example/" },
+                    urls);
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+
+namespace Omni2FA.AuthClient.Tests
+{
+    /// <summary>
+    /// Tests for the MFA concurrency limit and its wait queue.
+    /// </summary>
+    [TestClass]
+    public class MfaAdmissionTests
+    {
+        private static readonly TimeSpan LongWait = TimeSpan.FromSeconds(10);
+
+        [TestMethod]
+        public void Constructor_WithInvalidLimits_ShouldThrow()
+        {
+            Assert.ThrowsException<ArgumentOutOfRangeException>(() => new MfaAdmission(0, 10));
+            Assert.ThrowsException<ArgumentOutOfRangeException>(() => new MfaAdmission(1, -1));
+        }
+
+        [TestMethod]
+        public void TryEnter_BelowLimit_ShouldAdmitAndTrackInFlight()
+        {
+            // Arrange
+            var admission = new MfaAdmission(2, 0);
+
+            // Act
+            var first = admission.TryEnter(TimeSpan.Zero);
+            var second = admission.TryEnter(TimeSpan.Zero);
+
+            // Assert
+            Assert.AreEqual(MfaAdmissionResult.Admitted, first);
+            Assert.AreEqual(MfaAdmissionResult.Admitted, second);
+            Assert.AreEqual(2, admission.InFlight);
+            admission.Exit();
+            admission.Exit();
+            var stats = admission.GetStats();
+            Assert.AreEqual(0, stats.InFlight);
+            Assert.AreEqual(2, stats.PeakInFlight);
+            Assert.AreEqual(2, stats.Admitted);
+        }
+
+        [TestMethod]
+        public void TryEnter_WithNoQueue_ShouldRejectImmediatelyWhenFull()
+        {
+            // Arrange
+            var admission = new MfaAdmission(1, 0);
+            admission.TryEnter(TimeSpan.Zero);
+
+            // Act
+            var rejected = admission.TryEnter(LongWait);
+
+            // Assert - the long budget is not used when there is no room to wait
+            Assert.AreEqual(MfaAdmissionResult.QueueFull, rejected);
+            Assert.AreEqual(1, admission.Rejected);
+            Assert.AreEqual(1, admission.GetStats().RejectedQueueFull);
+        }
+
+        [TestMethod]
+        public void TryEnter_WhenQueueBudgetRunsOut_ShouldTimeOut()
+        {
+            // Arrange
+            var admission = new MfaAdmission(1, 5);
+            admission.TryEnter(TimeSpan.Zero);
+
+            // Act
+            var result = admission.TryEnter(TimeSpan.FromMilliseconds(50));
+
+            // Assert
+            Assert.AreEqual(MfaAdmissionResult.TimedOut, result);
+            Assert.AreEqual(0, admission.Queued);
+            Assert.AreEqual(1, admission.GetStats().RejectedTimedOut);
+        }
+
+        [TestMethod]
+        public void TryEnter_Queued_ShouldBeAdmittedWhenSlotIsReleased()
+        {
+            // Arrange
+            var admission = new MfaAdmission(1, 1);
+            admission.TryEnter(TimeSpan.Zero);
+            var waiter = Task.Run(() => admission.TryEnter(LongWait));
+            SpinWait.SpinUntil(() => admission.Queued == 1, 5000);
+
+            // Act - a second waiter does not fit in the queue
+            var overflow = admission.TryEnter(LongWait);
+            admission.Exit();
+
+            // Assert
+            Assert.AreEqual(MfaAdmissionResult.QueueFull, overflow);
+            Assert.AreEqual(MfaAdmissionResult.Admitted, waiter.Result);
+            var stats = admission.GetStats();
+            Assert.AreEqual(1, stats.InFlight);
+            Assert.AreEqual(1, stats.PeakQueued);
+            Assert.AreEqual(1, stats.AdmittedAfterWait);
+        }
+
+        [TestMethod]
+        public void TryEnter_UnderConcurrency_ShouldNeverExceedLimit()
+        {
+            // Arrange
+            var admission = new MfaAdmission(3, 100);
+            int running = 0;
+            int maxRunning = 0;
+            var tasks = new List<Task<MfaAdmissionResult>>();
+
+            // Act
+            for (int i = 0; i < 40; i++)
+            {
+                tasks.Add(Task.Run(() =>
+                {
+                    var result = admission.TryEnter(LongWait);
+                    if (result == MfaAdmissionResult.Admitted)
+                    {
+                        int now = Interlocked.Increment(ref running);
+                        InterlockedMax(ref maxRunning, now);
+                        Thread.Sleep(5);
+                        Interlocked.Decrement(ref running);
+                        admission.Exit();
+                    }
+                    return result;
+                }));
+            }
+            Task.WaitAll(tasks.ToArray());
+
+            // Assert
+            foreach (var task in tasks)
+            {
+                Assert.AreEqual(MfaAdmissionResult.Admitted, task.Result);
+            }
+            Assert.IsTrue(maxRunning <= 3, $"{maxRunning} exchanges ran at once");
+            var stats = admission.GetStats();
+            Assert.AreEqual(40, stats.Admitted);
+            Assert.AreEqual(0, stats.InFlight);
+            Assert.AreEqual(0, stats.Queued);
+            Assert.IsTrue(stats.PeakInFlight <= 3);
+        }
+
+        private static void InterlockedMax(ref int target, int value)
+        {
+            int current;
+            while (value > (current = Volatile.Read(ref target)) &&
+                Interlocked.CompareExchange(ref target, value, current) != current)
+            {
+            }
+        }
+    }
+}
@@ -0,0 +1,355 @@
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Net;
+using System.Net.Http;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Newtonsoft.Json;
+
+namespace Omni2FA.AuthClient.Tests
+{
+    /// <summary>
+    /// Tests for the shared /AuthResult poller, against an in-process stub of the MFA service.
+    /// </summary>
+    [TestClass]
+    public class MfaPollSchedulerTests
+    {
+        private const string ServiceUrl = "http://mfa.example";
+        private static readonly TimeSpan FastTick = TimeSpan.FromMilliseconds(10);
+
+        /// <summary>
+        /// Stub MFA service. Users are pending until their approval time; /AuthResults can be switched off.
+        /// </summary>
+        private sealed class StubBackend : HttpMessageHandler
+        {
+            private readonly Stopwatch _clock = Stopwatch.StartNew();
+            private readonly ConcurrentDictionary<string, (TimeSpan at, int status)> _decisions = new ConcurrentDictionary<string, (TimeSpan, int)>();
+            private int _authResultCalls;
+            private int _authResultsCalls;
+            private int _largestBatch;
+
+            public HttpStatusCode BatchStatus { get; set; } = HttpStatusCode.OK;
+            // Host that answers /AuthResults with 404 whatever BatchStatus says
+            public string? NoBatchHost { get; set; }
+            public HashSet<string> LeftOutOfBatches { get; } = new HashSet<string>();
+            public int AuthResultCalls => Volatile.Read(ref _authResultCalls);
+            public int AuthResultsCalls => Volatile.Read(ref _authResultsCalls);
+            public int LargestBatch => Volatile.Read(ref _largestBatch);
+            public TimeSpan Now => _clock.Elapsed;
+
+            public void Decide(string samid, TimeSpan after, int status)
+            {
+                _decisions[samid] = (_clock.Elapsed + after, status);
+            }
+
+            public TimeSpan DecidedAt(string samid) => _decisions[samid].at;
+
+            private int StatusOf(string samid)
+            {
+                return _decisions.TryGetValue(samid, out var decision) && _clock.Elapsed >= decision.at ? decision.status : 0;
+            }
+
+            protected override async Task<HttpResponseMessage> SendAsync(HttpRequestMessage request, CancellationToken cancellationToken)
+            {
+                var body = await request.Content!.ReadAsStringAsync();
+                switch (request.RequestUri!.AbsolutePath)
+                {
+                    case "/AuthResult":
+                        Interlocked.Increment(ref _authResultCalls);
+                        var single = JsonConvert.DeserializeObject<UserRequest>(body)!;
+                        return Json(HttpStatusCode.OK, new { status = StatusOf(single.samid!) });
+                    case "/AuthResults":
+                        Interlocked.Increment(ref _authResultsCalls);
+                        var batchStatus = request.RequestUri.Host == NoBatchHost ? HttpStatusCode.NotFound : BatchStatus;
+                        if (batchStatus != HttpStatusCode.OK)
+                        {
+                            return Json(batchStatus, new { error = "no batches here" });
+                        }
+                        var batch = JsonConvert.DeserializeObject<BatchRequest>(body)!;
+                        int size = batch.requests!.Count;
+                        int largest;
+                        while (size > (largest = Volatile.Read(ref _largestBatch)) && Interlocked.CompareExchange(ref _largestBatch, size, largest) != largest)
+                        {
+                        }
+                        var results = batch.requests
+                            .Where(user => !LeftOutOfBatches.Contains(user.samid!))
+                            .Select(user => new { samid = user.samid, status = StatusOf(user.samid!) })
+                            .ToList();
+                        return Json(HttpStatusCode.OK, new { results = results });
+                    default:
+                        return new HttpResponseMessage(HttpStatusCode.NotFound);
+                }
+            }
+
+            private static HttpResponseMessage Json(HttpStatusCode status, object content)
+            {
+                return new HttpResponseMessage(status)
+                {
+                    Content = new StringContent(JsonConvert.SerializeObject(content), Encoding.UTF8, "application/json")
+                };
+            }
+        }
+
+        private sealed class UserRequest
+        {
+            public string? samid { get; set; }
+            public string? requestor { get; set; }
+        }
+
+        private sealed class BatchRequest
+        {
+            public List<UserRequest>? requests { get; set; }
+        }
+
+        private static Task<MfaPollOutcome> Wait(MfaPollScheduler scheduler, string samid, int waitMs, int intervalMs, int maxPolls)
+        {
+            return Wait(scheduler, ServiceUrl, samid, waitMs, intervalMs, maxPolls);
+        }
+
+        private static Task<MfaPollOutcome> Wait(MfaPollScheduler scheduler, string serviceUrl, string samid, int waitMs, int intervalMs, int maxPolls)
+        {
+            var requestJson = JsonConvert.SerializeObject(new { samid = samid, requestor = "SMK-RDG" });
+            return scheduler.WaitAsync(samid, serviceUrl, requestJson,
+                TimeSpan.FromMilliseconds(waitMs), TimeSpan.FromMilliseconds(intervalMs), maxPolls);
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task WaitAsync_SingleRequest_ShouldPollPerUser()
+        {
+            // Arrange
+            var backend = new StubBackend();
+            backend.Decide("alice", TimeSpan.FromMilliseconds(200), 1);
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), FastTick))
+            {
+                // Act
+                var outcome = await Wait(scheduler, "alice", 0, 20, 100);
+
+                // Assert
+                Assert.AreEqual(MfaPollResult.Succeeded, outcome.Result);
+                Assert.IsTrue(outcome.Polls >= 2);
+                Assert.AreEqual(outcome.Polls, backend.AuthResultCalls);
+                Assert.AreEqual(0, backend.AuthResultsCalls);
+                Assert.AreEqual(0, scheduler.Pending);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task WaitAsync_DeniedOrNeverAnswered_ShouldEndTheWait()
+        {
+            // Arrange
+            var backend = new StubBackend();
+            backend.Decide("mallory", TimeSpan.Zero, -1);
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), FastTick))
+            {
+                // Act
+                var denied = await Wait(scheduler, "mallory", 0, 0, 10);
+                var exhausted = await Wait(scheduler, "bob", 0, 0, 3);
+                var noPolls = await Wait(scheduler, "bob", 0, 0, 0);
+
+                // Assert
+                Assert.AreEqual(MfaPollResult.Denied, denied.Result);
+                Assert.AreEqual(1, denied.Polls);
+                Assert.AreEqual(MfaPollResult.Exhausted, exhausted.Result);
+                Assert.AreEqual(3, exhausted.Polls);
+                Assert.AreEqual(MfaPollResult.Exhausted, noPolls.Result);
+                Assert.AreEqual(4, backend.AuthResultCalls);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(30000)]
+        public async Task WaitAsync_ManyConcurrentLogins_ShouldShareBatchedPolls()
+        {
+            // Arrange - 500 users logging in over half a second, each approving within a second
+            const int users = 500;
+            var backend = new StubBackend();
+            var random = new Random(42);
+            var arrivals = Enumerable.Range(0, users).Select(_ => random.Next(500)).ToArray();
+            var approvals = Enumerable.Range(0, users).Select(_ => random.Next(1000)).ToArray();
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), TimeSpan.FromMilliseconds(20)))
+            {
+                // Act
+                var waits = Enumerable.Range(0, users).Select(async i =>
+                {
+                    await Task.Delay(arrivals[i]);
+                    backend.Decide($"user{i}", TimeSpan.FromMilliseconds(approvals[i]), 1);
+                    var outcome = await Wait(scheduler, $"user{i}", 20, 50, 100);
+                    return (outcome, late: backend.Now - backend.DecidedAt($"user{i}"));
+                }).ToArray();
+                var results = await Task.WhenAll(waits);
+
+                // Assert - everyone got through, with one request per tick instead of one per user and poll
+                foreach (var (outcome, late) in results)
+                {
+                    Assert.AreEqual(MfaPollResult.Succeeded, outcome.Result);
+                    // Completed within about one stretched interval of the approval
+                    Assert.IsTrue(late < TimeSpan.FromSeconds(1), $"completed {late.TotalMilliseconds} ms after the approval");
+                }
+                var stats = scheduler.GetStats();
+                int polls = results.Sum(result => result.outcome.Polls);
+                Assert.AreEqual(polls, stats.BatchedPolls + stats.SinglePolls);
+                Assert.IsTrue(stats.BatchedPolls > polls * 9 / 10, stats.ToString());
+                Assert.IsTrue(backend.AuthResultsCalls * 10 < polls, $"{backend.AuthResultsCalls} batches for {polls} polls");
+                Assert.IsTrue(backend.LargestBatch > 10);
+                Assert.AreEqual(users, stats.Completed);
+                Assert.AreEqual(0, stats.Pending);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(10000)]
+        public async Task WaitAsync_BatchNotSupported_ShouldFallBackToPerUserPolls()
+        {
+            // Arrange
+            var backend = new StubBackend { BatchStatus = HttpStatusCode.NotFound };
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), TimeSpan.FromMilliseconds(50)))
+            {
+                for (int i = 0; i < 20; i++)
+                {
+                    backend.Decide($"user{i}", TimeSpan.FromMilliseconds(100), 1);
+                }
+
+                // Act
+                var outcomes = await Task.WhenAll(Enumerable.Range(0, 20).Select(i => Wait(scheduler, $"user{i}", 50, 50, 100)));
+
+                // Assert - asked once, then polled per user until renegotiation
+                Assert.IsTrue(outcomes.All(outcome => outcome.Result == MfaPollResult.Succeeded));
+                Assert.AreEqual(1, backend.AuthResultsCalls);
+                Assert.AreEqual(1, scheduler.GetStats().Fallbacks);
+                Assert.AreEqual(0, scheduler.GetStats().BatchedPolls);
+                Assert.AreEqual(outcomes.Sum(outcome => outcome.Polls), backend.AuthResultCalls);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(10000)]
+        public async Task WaitAsync_OneServiceWithoutBatches_ShouldKeepBatchingTheOthers()
+        {
+            // Arrange
+            const string LegacyUrl = "http://legacy-mfa.example";
+            var backend = new StubBackend { NoBatchHost = new Uri(LegacyUrl).Host };
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), TimeSpan.FromMilliseconds(50)))
+            {
+                for (int i = 0; i < 20; i++)
+                {
+                    backend.Decide($"user{i}", TimeSpan.FromMilliseconds(200), 1);
+                }
+
+                // Act
+                var outcomes = await Task.WhenAll(Enumerable.Range(0, 20).Select(i =>
+                    Wait(scheduler, i % 2 == 0 ? LegacyUrl : ServiceUrl, $"user{i}", 50, 50, 100)));
+
+                // Assert - the legacy service fell back once, the other one kept batching
+                var stats = scheduler.GetStats();
+                Assert.IsTrue(outcomes.All(outcome => outcome.Result == MfaPollResult.Succeeded));
+                Assert.AreEqual(1, stats.Fallbacks, stats.ToString());
+                Assert.IsTrue(stats.Batches >= 2, stats.ToString());
+                Assert.IsTrue(stats.BatchedPolls >= 10, stats.ToString());
+            }
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task WaitAsync_BatchFails_ShouldFailEveryRequestInIt()
+        {
+            // Arrange
+            var backend = new StubBackend { BatchStatus = HttpStatusCode.InternalServerError };
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), TimeSpan.FromMilliseconds(50)))
+            {
+                // Act - both requests are due in the same tick
+                var outcomes = await Task.WhenAll(Wait(scheduler, "alice", 0, 0, 10), Wait(scheduler, "bob", 0, 0, 10));
+
+                // Assert
+                foreach (var outcome in outcomes)
+                {
+                    Assert.AreEqual(MfaPollResult.HttpError, outcome.Result);
+                    StringAssert.Contains(outcome.Detail, "InternalServerError");
+                }
+                Assert.AreEqual(1, backend.AuthResultsCalls);
+                Assert.AreEqual(0, backend.AuthResultCalls);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task WaitAsync_UserLeftOutOfBatch_ShouldBePolledAlone()
+        {
+            // Arrange
+            var backend = new StubBackend();
+            backend.LeftOutOfBatches.Add("carol");
+            backend.Decide("alice", TimeSpan.Zero, 1);
+            backend.Decide("carol", TimeSpan.Zero, 1);
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), TimeSpan.FromMilliseconds(50)))
+            {
+                // Act
+                var outcomes = await Task.WhenAll(Wait(scheduler, "alice", 0, 0, 10), Wait(scheduler, "carol", 0, 0, 10));
+
+                // Assert
+                Assert.IsTrue(outcomes.All(outcome => outcome.Result == MfaPollResult.Succeeded && outcome.Polls == 1));
+                Assert.AreEqual(1, backend.AuthResultsCalls);
+                Assert.AreEqual(1, backend.AuthResultCalls);
+            }
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task WaitAsync_BeyondTheInnerWheel_ShouldWaitTheFullDelay()
+        {
+            // Arrange - one inner turn is 256 ms, so the first poll is parked on the outer wheel
+            var backend = new StubBackend();
+            backend.Decide("alice", TimeSpan.Zero, 1);
+            using (var scheduler = new MfaPollScheduler(new HttpClient(backend), TimeSpan.FromMilliseconds(1)))
+            {
+                var watch = Stopwatch.StartNew();
+
+                // Act
+                var outcome = await Wait(scheduler, "alice", 600, 0, 10);
+
+                // Assert
+                Assert.AreEqual(MfaPollResult.Succeeded, outcome.Result);
+                Assert.IsTrue(watch.Elapsed >= TimeSpan.FromMilliseconds(590), $"polled after {watch.ElapsedMilliseconds} ms");
+                Assert.AreEqual(1, backend.AuthResultCalls);
+            }
+        }
+
+        [TestMethod]
+        public void PollDelay_ShouldStretchUpToTwiceTheInterval()
+        {
+            var interval = TimeSpan.FromSeconds(1);
+
+            Assert.AreEqual(TimeSpan.FromSeconds(1), MfaPollScheduler.PollDelay(interval, 1));
+            Assert.AreEqual(TimeSpan.FromSeconds(1.5), MfaPollScheduler.PollDelay(interval, 5));
+            Assert.AreEqual(TimeSpan.FromSeconds(2), MfaPollScheduler.PollDelay(interval, 9));
+            Assert.AreEqual(TimeSpan.FromSeconds(2), MfaPollScheduler.PollDelay(interval, 60));
+            Assert.AreEqual(TimeSpan.Zero, MfaPollScheduler.PollDelay(TimeSpan.Zero, 60));
+        }
+
+        [TestMethod]
+        [Timeout(5000)]
+        public async Task Dispose_ShouldStopWaitingRequests()
+        {
+            // Arrange
+            var backend = new StubBackend();
+            var scheduler = new MfaPollScheduler(new HttpClient(backend), FastTick);
+            var waiting = Wait(scheduler, "alice", 10000, 1000, 10);
+
+            // Act
+            scheduler.Dispose();
+            var outcome = await waiting;
+            var afterDispose = await Wait(scheduler, "bob", 0, 0, 10);
+
+            // Assert
+            Assert.AreEqual(MfaPollResult.Stopped, outcome.Result);
+            Assert.AreEqual(MfaPollResult.Stopped, afterDispose.Result);
+            Assert.AreEqual(0, backend.AuthResultCalls);
+            Assert.AreEqual(0, scheduler.Pending);
+        }
+    }
+}
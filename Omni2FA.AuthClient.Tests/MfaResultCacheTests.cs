@@ -0,0 +1,194 @@
+using System;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+
+namespace Omni2FA.AuthClient.Tests
+{
+    /// <summary>
+    /// Tests for the sharded MFA result cache.
+    /// </summary>
+    [TestClass]
+    public class MfaResultCacheTests
+    {
+        private static readonly TimeSpan OneMinute = TimeSpan.FromMinutes(1);
+
+        [TestMethod]
+        public void TryGet_WithUnknownKey_ShouldMiss()
+        {
+            // Arrange
+            var cache = new MfaResultCache();
+
+            // Act
+            bool found = cache.TryGet("nobody", out bool success);
+
+            // Assert
+            Assert.IsFalse(found);
+            Assert.IsFalse(success);
+            Assert.AreEqual(1, cache.GetStats().Misses);
+        }
+
+        [TestMethod]
+        public void TryGet_AfterSet_ShouldReturnStoredResult()
+        {
+            // Arrange
+            var cache = new MfaResultCache();
+            cache.Set("alice", true, OneMinute);
+            cache.Set("bob", false, OneMinute);
+
+            // Act & Assert
+            Assert.IsTrue(cache.TryGet("alice", out bool alice));
+            Assert.IsTrue(alice);
+            Assert.IsTrue(cache.TryGet("bob", out bool bob));
+            Assert.IsFalse(bob);
+            Assert.AreEqual(2, cache.GetStats().Hits);
+        }
+
+        [TestMethod]
+        public void TryGet_AfterTtl_ShouldMissAndCountExpiration()
+        {
+            // Arrange
+            var cache = new MfaResultCache();
+            cache.Set("alice", true, TimeSpan.FromMilliseconds(30));
+            Thread.Sleep(100);
+
+            // Act
+            bool found = cache.TryGet("alice", out _);
+
+            // Assert
+            Assert.IsFalse(found);
+            var stats = cache.GetStats();
+            Assert.AreEqual(1, stats.Expirations);
+            Assert.AreEqual(0, stats.Count);
+        }
+
+        [TestMethod]
+        public void Set_WithZeroTtl_ShouldRemoveEntry()
+        {
+            // Arrange
+            var cache = new MfaResultCache();
+            cache.Set("alice", true, OneMinute);
+
+            // Act
+            cache.Set("alice", false, TimeSpan.Zero);
+
+            // Assert
+            Assert.IsFalse(cache.TryGet("alice", out _));
+            Assert.AreEqual(0, cache.Count);
+        }
+
+        [TestMethod]
+        public void Set_OverCapacity_ShouldEvictLeastRecentlyUsed()
+        {
+            // Arrange - one shard so the LRU order is global
+            var cache = new MfaResultCache(2, 1);
+            cache.Set("a", true, OneMinute);
+            cache.Set("b", true, OneMinute);
+            Assert.IsTrue(cache.TryGet("a", out _)); // "b" is now least recently used
+
+            // Act
+            cache.Set("c", true, OneMinute);
+
+            // Assert
+            Assert.IsTrue(cache.TryGet("a", out _));
+            Assert.IsFalse(cache.TryGet("b", out _));
+            Assert.IsTrue(cache.TryGet("c", out _));
+            Assert.AreEqual(1, cache.GetStats().Evictions);
+            Assert.AreEqual(2, cache.Count);
+        }
+
+        [TestMethod]
+        public void Set_ExistingKey_ShouldReplaceWithoutEviction()
+        {
+            // Arrange
+            var cache = new MfaResultCache(1, 1);
+            cache.Set("a", true, OneMinute);
+
+            // Act
+            cache.Set("a", false, OneMinute);
+
+            // Assert
+            Assert.IsTrue(cache.TryGet("a", out bool success));
+            Assert.IsFalse(success);
+            Assert.AreEqual(0, cache.GetStats().Evictions);
+        }
+
+        [TestMethod]
+        public void Constructor_ShouldRoundShardsAndKeepCapacity()
+        {
+            // Act
+            var cache = new MfaResultCache(100, 5);
+            var tiny = new MfaResultCache(3, 64);
+
+            // Assert
+            Assert.AreEqual(8, cache.ShardCount);
+            Assert.AreEqual(100, cache.Capacity);
+            Assert.IsTrue(tiny.ShardCount <= 3);
+            Assert.ThrowsException<ArgumentOutOfRangeException>(() => new MfaResultCache(0));
+        }
+
+        [TestMethod]
+        public void Capacity_WithManyKeys_ShouldBoundEntries()
+        {
+            // Arrange
+            var cache = new MfaResultCache(64, 4);
+
+            // Act
+            for (int i = 0; i < 1000; i++)
+            {
+                cache.Set("user" + i, true, OneMinute);
+            }
+
+            // Assert
+            Assert.IsTrue(cache.Count <= 64);
+            Assert.AreEqual(1000 - cache.Count, cache.GetStats().Evictions);
+        }
+
+        [TestMethod]
+        public void MakeKey_ShouldNormalizeUserAndSeparateNas()
+        {
+            // Act
+            var key1 = MfaResultCache.MakeKey(" SMK\\Alice ", "10.0.0.1", "aa-bb", "RDG");
+            var key2 = MfaResultCache.MakeKey("smk\\alice", "10.0.0.1", "AA-BB", "rdg");
+            var otherNas = MfaResultCache.MakeKey("smk\\alice", "10.0.0.2", "AA-BB", "rdg");
+            var otherPolicy = MfaResultCache.MakeKey("smk\\alice", "10.0.0.1", "AA-BB", "VPN");
+
+            // Assert
+            Assert.AreEqual(key1, key2);
+            Assert.AreNotEqual(key1, otherNas);
+            Assert.AreNotEqual(key1, otherPolicy);
+            Assert.AreNotEqual(MfaResultCache.MakeKey("a", "b", "", ""), MfaResultCache.MakeKey("a", "", "b", ""));
+        }
+
+        [TestMethod]
+        [Timeout(15000)]
+        public void ConcurrentAccess_ShouldKeepCountersConsistent()
+        {
+            // Arrange
+            var cache = new MfaResultCache(1000);
+            const int threads = 8;
+            const int operations = 20000;
+
+            // Act
+            Parallel.For(0, threads, t =>
+            {
+                for (int i = 0; i < operations; i++)
+                {
+                    var key = "user" + ((i * 7 + t) % 2000);
+                    if (!cache.TryGet(key, out _))
+                    {
+                        cache.Set(key, true, OneMinute);
+                    }
+                }
+            });
+
+            // Assert
+            var stats = cache.GetStats();
+            Assert.AreEqual(threads * operations, stats.Hits + stats.Misses);
+            Assert.IsTrue(stats.Count <= 1000);
+            Assert.IsTrue(stats.Hits > 0);
+            Assert.IsTrue(stats.Evictions > 0);
+        }
+    }
+}
@@ -0,0 +1,143 @@
+using System;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+
+namespace Omni2FA.AuthClient.Tests
+{
+    /// <summary>
+    /// Tests for coalescing concurrent MFA requests with the same key.
+    /// </summary>
+    [TestClass]
+    public class MfaSingleFlightTests
+    {
+        private static readonly TimeSpan LongWait = TimeSpan.FromSeconds(10);
+
+        [TestMethod]
+        public void Run_SingleCaller_ShouldRunWorkOnce()
+        {
+            // Arrange
+            var flights = new MfaSingleFlight<bool>();
+            int calls = 0;
+
+            // Act
+            bool result = flights.Run("alice", () => { calls++; return true; }, out bool coalesced);
+
+            // Assert
+            Assert.IsTrue(result);
+            Assert.IsFalse(coalesced);
+            Assert.AreEqual(1, calls);
+            Assert.AreEqual(0, flights.Pending);
+            Assert.AreEqual(1, flights.GetStats().Started);
+        }
+
+        [TestMethod]
+        public void Run_ConcurrentSameKey_ShouldShareOneRun()
+        {
+            // Arrange
+            var flights = new MfaSingleFlight<bool>();
+            var release = new ManualResetEventSlim(false);
+            int calls = 0;
+            var leader = Task.Run(() => flights.Run("alice", () =>
+            {
+                Interlocked.Increment(ref calls);
+                release.Wait(LongWait);
+                return true;
+            }, out _));
+            SpinWait.SpinUntil(() => flights.Pending == 1, 5000);
+
+            // Act - retransmissions arrive while the first request is still waiting for the user
+            var followers = Enumerable.Range(0, 3).Select(_ => Task.Run(() =>
+            {
+                bool result = flights.Run("alice", () => { Interlocked.Increment(ref calls); return false; }, out bool coalesced);
+                return (result, coalesced);
+            })).ToArray();
+            SpinWait.SpinUntil(() => flights.GetStats().Coalesced == 3, 5000);
+            release.Set();
+
+            // Assert
+            Assert.IsTrue(leader.Result);
+            foreach (var follower in followers)
+            {
+                Assert.IsTrue(follower.Result.result);
+                Assert.IsTrue(follower.Result.coalesced);
+            }
+            Assert.AreEqual(1, calls);
+            var stats = flights.GetStats();
+            Assert.AreEqual(1, stats.Started);
+            Assert.AreEqual(3, stats.Coalesced);
+            Assert.AreEqual(0, stats.Pending);
+        }
+
+        [TestMethod]
+        public void Run_DifferentKeys_ShouldNotCoalesce()
+        {
+            // Arrange
+            var flights = new MfaSingleFlight<int>();
+            var release = new ManualResetEventSlim(false);
+            var first = Task.Run(() => flights.Run("alice", () => { release.Wait(LongWait); return 1; }, out _));
+            SpinWait.SpinUntil(() => flights.Pending == 1, 5000);
+
+            // Act
+            int second = flights.Run("bob", () => 2, out bool coalesced);
+            release.Set();
+
+            // Assert
+            Assert.AreEqual(2, second);
+            Assert.IsFalse(coalesced);
+            Assert.AreEqual(1, first.Result);
+            Assert.AreEqual(2, flights.GetStats().Started);
+        }
+
+        [TestMethod]
+        public void Run_AfterCompletion_ShouldStartNewRun()
+        {
+            // Arrange
+            var flights = new MfaSingleFlight<bool>();
+            flights.Run("alice", () => false, out _);
+
+            // Act
+            bool result = flights.Run("alice", () => true, out bool coalesced);
+
+            // Assert - finished runs are not reused, that is what the result cache is for
+            Assert.IsTrue(result);
+            Assert.IsFalse(coalesced);
+            Assert.AreEqual(2, flights.GetStats().Started);
+        }
+
+        [TestMethod]
+        public void Run_WhenWorkThrows_ShouldRethrowToAllCallersAndForgetRun()
+        {
+            // Arrange
+            var flights = new MfaSingleFlight<bool>();
+            var release = new ManualResetEventSlim(false);
+            var leader = Task.Run(() => flights.Run("alice", () =>
+            {
+                release.Wait(LongWait);
+                throw new InvalidOperationException("service down");
+            }, out _));
+            SpinWait.SpinUntil(() => flights.Pending == 1, 5000);
+            var follower = Task.Run(() => flights.Run("alice", () => true, out _));
+            SpinWait.SpinUntil(() => flights.GetStats().Coalesced == 1, 5000);
+
+            // Act
+            release.Set();
+
+            // Assert
+            var leaderError = Assert.ThrowsException<AggregateException>(() => leader.Wait(LongWait));
+            Assert.IsInstanceOfType(leaderError.InnerException, typeof(InvalidOperationException));
+            var followerError = Assert.ThrowsException<AggregateException>(() => follower.Wait(LongWait));
+            Assert.IsInstanceOfType(followerError.InnerException, typeof(InvalidOperationException));
+            Assert.IsTrue(flights.Run("alice", () => true, out bool coalesced));
+            Assert.IsFalse(coalesced);
+        }
+
+        [TestMethod]
+        public void Run_WithNullKey_ShouldThrow()
+        {
+            var flights = new MfaSingleFlight<bool>();
+            Assert.ThrowsException<ArgumentNullException>(() => flights.Run(null!, () => true, out _));
+        }
+    }
+}
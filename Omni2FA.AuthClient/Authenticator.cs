@@ -1,6 +1,8 @@
 using System;
+using System.Diagnostics;
 using System.Net.Http;
 using System.Text;
+using System.Threading;
 using System.Threading.Tasks;
 using Newtonsoft.Json;
 using Omni2FA.Net.Utils;
@@ -12,26 +14,18 @@ namespace Omni2FA.AuthClient {
         private readonly bool _ownsHttpClient; // Track if we own the HttpClient
         private bool _disposed = false;
 
-        private int _authTimeout = 60; // seconds
-        private string _serviceUrl = "http://localhost:8000";
-        private int _waitBeforePoll = 10; // seconds
-        private int _pollInterval = 1; // seconds
-        private int _pollMaxSeconds = 60; // seconds
-        private bool _enableTraceLogging = false;
-        private bool _ignoreSslErrors = false;
-        private string _basicAuthUsername = "";
-        private string _basicAuthPassword = "";
-
-        private const string _regPath = @"SOFTWARE\Omni2FA.NPS";
-        private const string _authTimeoutKey = "AuthTimeout";
-        private const string _serviceUrlKey = "ServiceUrl";
-        private const string _waitBeforePollKey = "WaitBeforePoll";
-        private const string _pollIntervalKey = "PollInterval";
-        private const string _pollMaxSecondsKey = "PollMaxSeconds";
-        private const string _enableTraceLoggingKey = "EnableTraceLogging";
-        private const string _ignoreSslErrorsKey = "IgnoreSslErrors";
-        private const string _basicAuthUsernameKey = "BasicAuthUsername";
-        private const string _basicAuthPasswordKey = "BasicAuthPassword";
+        // Settings snapshot source; poll timings and the service URL are read per request,
+        // so changes apply to the next authentication without restarting NPS
+        private readonly ConfigStore _config;
+
+        // Stopwatch timestamp of the last /Authenticate sent to the service, see WarmUpAsync
+        private long _lastRequestTimestamp;
+
+        // Polls /AuthResult for every pending authentication of this authenticator
+        private readonly MfaPollScheduler _polls;
+
+        // Sent with every request as the "requestor" field
+        internal const string Requestor = "SMK-RDG";
 
         public enum AuthStatusEnum {
             AUTH_FAILED = -1,
@@ -54,25 +48,23 @@ namespace Omni2FA.AuthClient {
         /// Creates an Authenticator with an injected HttpClient for testing.
         /// </summary>
         /// <param name="httpClient">Optional HttpClient instance. If null, creates a default one.</param>
-        public Authenticator(HttpClient httpClient) {
+        public Authenticator(HttpClient httpClient) : this(httpClient, null) {
+        }
+
+        /// <summary>
+        /// Creates an Authenticator reading its settings from the given store.
+        /// </summary>
+        /// <param name="httpClient">Optional HttpClient instance. If null, creates a default one.</param>
+        /// <param name="config">Settings store. If null, uses <see cref="ConfigStore.Shared"/>.</param>
+        public Authenticator(HttpClient httpClient, ConfigStore config) {
             // Log component initialization with datetime and size
             var moduleInfo = Log.GetModuleInfo();
             Log.Event(Log.Level.Information, 103, $"Initializing Omni2FA.AuthClient {moduleInfo}");
-            
-            using (var registry = new Registry(_regPath)) {
-                // Read settings from registry
-                _authTimeout        = registry.GetIntRegistryValue(_authTimeoutKey, 60);
-                _serviceUrl         = registry.GetStringRegistryValue(_serviceUrlKey, "http://localhost:8000");
-                _waitBeforePoll     = registry.GetIntRegistryValue(_waitBeforePollKey, 10);
-                _pollInterval       = registry.GetIntRegistryValue(_pollIntervalKey, 1);
-                _pollMaxSeconds     = registry.GetIntRegistryValue(_pollMaxSecondsKey, 60);
-                _enableTraceLogging = registry.GetBoolRegistryValue(_enableTraceLoggingKey, false);
-                _ignoreSslErrors    = registry.GetBoolRegistryValue(_ignoreSslErrorsKey, false);
-                _basicAuthUsername  = registry.GetStringRegistryValue(_basicAuthUsernameKey, "");
-                _basicAuthPassword  = registry.GetStringRegistryValue(_basicAuthPasswordKey, "");
-            }
-                 
-            Log.SetTraceLoggingEnabled(_enableTraceLogging);
+
+            _config = config ?? ConfigStore.Shared;
+            var settings = _config.Current;
+
+            Log.SetTraceLoggingEnabled(settings.EnableTraceLogging);
 
             if (httpClient != null) {
                 // Use injected HttpClient (typically for testing)
@@ -81,21 +73,24 @@ namespace Omni2FA.AuthClient {
                 Log.Event(Log.Level.Trace, 29, "Using injected HttpClient");
             } else {
                 // Create default HttpClient with configuration from registry
-                _httpClient = CreateDefaultHttpClient();
+                _httpClient = CreateDefaultHttpClient(settings);
                 _ownsHttpClient = true;
             }
 
-            Log.Event(Log.Level.Information, 204, $"Omni2FA.Auth initialized with service URL: {_serviceUrl}");
+            _polls = new MfaPollScheduler(_httpClient);
+
+            Log.Event(Log.Level.Information, 204, $"Omni2FA.Auth initialized with service URL: {settings.ServiceUrl}");
         }
 
         /// <summary>
         /// Creates the default HttpClient with SSL and authentication configuration.
+        /// These settings are applied once; changing them still needs an NPS restart.
         /// </summary>
-        private HttpClient CreateDefaultHttpClient() {
+        private HttpClient CreateDefaultHttpClient(ConfigSnapshot settings) {
             var handler = new HttpClientHandler();
             
             // Configure SSL certificate validation
-            if (_ignoreSslErrors) {
+            if (settings.IgnoreSslErrors) {
                 handler.ServerCertificateCustomValidationCallback = (sender, certificate, chain, sslPolicyErrors) => {
                     Log.Event(Log.Level.Warning, 301, "SSL certificate validation bypassed due to IgnoreSslErrors setting");
                     return true; // Accept all certificates
@@ -104,13 +99,13 @@ namespace Omni2FA.AuthClient {
             }
 
             var client = new HttpClient(handler);
-            client.Timeout = TimeSpan.FromSeconds(_authTimeout);
+            client.Timeout = TimeSpan.FromSeconds(settings.AuthTimeout);
 
             // Configure basic authentication if credentials are provided
-            if (!string.IsNullOrEmpty(_basicAuthUsername) && !string.IsNullOrEmpty(_basicAuthPassword)) {
-                var authValue = Convert.ToBase64String(Encoding.ASCII.GetBytes($"{_basicAuthUsername}:{_basicAuthPassword}"));
+            if (!string.IsNullOrEmpty(settings.BasicAuthUsername) && !string.IsNullOrEmpty(settings.BasicAuthPassword)) {
+                var authValue = Convert.ToBase64String(Encoding.ASCII.GetBytes($"{settings.BasicAuthUsername}:{settings.BasicAuthPassword}"));
                 client.DefaultRequestHeaders.Authorization = new System.Net.Http.Headers.AuthenticationHeaderValue("Basic", authValue);
-                Log.Event(Log.Level.Information, 206, $"Basic authentication configured for user: {_basicAuthUsername}");
+                Log.Event(Log.Level.Information, 206, $"Basic authentication configured for user: {settings.BasicAuthUsername}");
             }
 
             return client;
@@ -119,19 +114,35 @@ namespace Omni2FA.AuthClient {
         /// <summary>
         /// Gets the service URL for testing purposes.
         /// </summary>
-        internal string ServiceUrl => _serviceUrl;
+        internal string ServiceUrl => _config.Current.ServiceUrl;
+
+        /// <summary>
+        /// Counters of the shared /AuthResult poller.
+        /// </summary>
+        public MfaPollSchedulerStats GetPollStats() {
+            return _polls.GetStats();
+        }
 
         public async Task<bool> AuthenticateAsync(string samid) {
+            // Keep one snapshot for the whole exchange
+            var settings = _config.Current;
+            // Only the outcome of /Authenticate goes to the circuit breaker, and only once
+            long authenticateStart = Metrics.Start();
+            bool authenticateReported = false;
             try {
                 // TODO: lets generate requestid here, send auth request, then poll for result
                 //var requestId = Guid.NewGuid().ToString();
-                var authRequestJson = JsonConvert.SerializeObject(new { samid = samid, requestor = "SMK-RDG" });
-                Log.Event(Log.Level.Trace, 20, $"Sending authentication request for user: {samid} to {_serviceUrl}/Authenticate");
+                var authRequestJson = JsonConvert.SerializeObject(new { samid = samid, requestor = Requestor });
+                Log.Event(Log.Level.Trace, 20, $"Sending authentication request for user: {samid} to {settings.ServiceUrl}/Authenticate");
+                Interlocked.Exchange(ref _lastRequestTimestamp, Stopwatch.GetTimestamp());
+                authenticateStart = Metrics.Start();
                 var authenticateResponse = await _httpClient.PostAsync(
-                    $"{_serviceUrl}/Authenticate", 
+                    $"{settings.ServiceUrl}/Authenticate", 
                     new StringContent(authRequestJson, Encoding.UTF8, "application/json")
                 );
+                Metrics.Record(MetricsPhase.Authenticate, authenticateStart);
                 if (!authenticateResponse.IsSuccessStatusCode) {
+                    ReportAuthenticate(ref authenticateReported, true, authenticateStart);
                     var responseContent = await authenticateResponse.Content.ReadAsStringAsync();
                     Log.Event(Log.Level.Error, 410, $"Service responded with status: {authenticateResponse.StatusCode}, content: {responseContent}");
                     return false;
@@ -140,6 +151,7 @@ namespace Omni2FA.AuthClient {
                 Log.Event(Log.Level.Trace, 21, $"Received authentication response for user: {samid}, response: {authenticateResponseJson}");
                 var authenticateResponseObj = JsonConvert.DeserializeObject<AuthResultResponse>(authenticateResponseJson);
                 Log.Event(Log.Level.Trace, 22, $"Deserialized authentication response for user: {samid}, status: {authenticateResponseObj?.status}");
+                ReportAuthenticate(ref authenticateReported, authenticateResponseObj == null, authenticateStart);
                 if (authenticateResponseObj == null) {
                     Log.Event(Log.Level.Error, 411, $"Invalid response from service for user: {samid}");
                     return false;
@@ -153,67 +165,88 @@ namespace Omni2FA.AuthClient {
                     return true;
                 }
 
-                await Task.Delay(_waitBeforePoll * 1000);
-                for (int i = 0; i < _pollMaxSeconds; i++) {
-                    try {
-                        Log.Event(Log.Level.Trace, 25, $"Polling AuthResult for user: {samid}, attempt: {i + 1}");
-                        var authResultResponse = await _httpClient.PostAsync(
-                            $"{_serviceUrl}/AuthResult",
-                            new StringContent(authRequestJson, Encoding.UTF8, "application/json")
-                        );
-                        var authResultResponseContent = await authResultResponse.Content.ReadAsStringAsync();
-                        if (!authResultResponse.IsSuccessStatusCode) {
-                            Log.Event(Log.Level.Warning, 310, $"AuthResult responded with status: {authResultResponse.StatusCode}, content: {authResultResponseContent}");
-                            return false;
-                        }
-                        var authResultResponseJson = JsonConvert.DeserializeObject<AuthResultResponse>(authResultResponseContent);
-                        Log.Event(Log.Level.Trace, 26, $"Polled AuthResult for user: {samid}, response: {authResultResponseContent}");
-                        if (authResultResponseJson == null) {
-                            Log.Event(Log.Level.Error, 412, $"Invalid AuthResult response for user {samid}");
-                            return false;
-                        }
-                        if (authResultResponseJson.status > 0) { // auth success
-                            Log.Event(Log.Level.Trace, 27, $"Authentication succeeded for user: {samid}");
-                            return true;
-                        }
-                        if (authResultResponseJson.status < 0) { // auth failure
-                            Log.Event(Log.Level.Trace, 28, $"Authentication failed for user: {samid}");
-                            return false;
-                        }
-                        // result == 1 (pending), continue polling
-                        await Task.Delay(_pollInterval * 1000);
-                    }
-                    catch (TaskCanceledException ex) {
-                        Log.Event(Log.Level.Error, 417, $"Timeout reached while polling AuthResult for user {samid}", ex);
+                var outcome = await _polls.WaitAsync(samid, settings.ServiceUrl, authRequestJson,
+                    TimeSpan.FromSeconds(settings.WaitBeforePoll), TimeSpan.FromSeconds(settings.PollInterval), settings.PollMaxSeconds);
+                switch (outcome.Result) {
+                    case MfaPollResult.Succeeded:
+                        Log.Event(Log.Level.Trace, 27, $"Authentication succeeded for user: {samid}");
+                        return true;
+                    case MfaPollResult.Denied:
+                        Log.Event(Log.Level.Trace, 28, $"Authentication failed for user: {samid}");
                         return false;
-                    }
-                    catch (HttpRequestException ex) {
-                        Log.Event(Log.Level.Error, 418, $"MFA Service is unreachable while polling AuthResult for user {samid}", ex);
+                    case MfaPollResult.HttpError:
+                        Log.Event(Log.Level.Warning, 310, $"AuthResult responded with status: {outcome.Detail}");
                         return false;
-                    }
-                    catch (Exception ex) {
-                        Log.Event(Log.Level.Error, 419, $"Error polling AuthResult for user {samid}", ex);
+                    case MfaPollResult.BadResponse:
+                        Log.Event(Log.Level.Error, 412, $"Invalid AuthResult response for user {samid}");
+                        return false;
+                    case MfaPollResult.TimedOut:
+                        Log.Event(Log.Level.Error, 417, $"Timeout reached while polling AuthResult for user {samid}", outcome.Exception);
+                        return false;
+                    case MfaPollResult.Unreachable:
+                        Log.Event(Log.Level.Error, 418, $"MFA Service is unreachable while polling AuthResult for user {samid}", outcome.Exception);
+                        return false;
+                    case MfaPollResult.Error:
+                        Log.Event(Log.Level.Error, 419, $"Error polling AuthResult for user {samid}", outcome.Exception);
+                        return false;
+                    case MfaPollResult.Stopped:
+                        Log.Event(Log.Level.Error, 419, $"Polling AuthResult for user {samid} stopped because the authenticator was disposed");
+                        return false;
+                    default:
+                        Log.Event(Log.Level.Error, 413, $"Authentication result not received in time for user: {samid}");
                         return false;
-                    }
-                    await Task.Delay(1000); // Wait 1 second before next poll
                 }
-                Log.Event(Log.Level.Error, 413, $"Authentication result not received in time for user: {samid}");
-                return false;
             }
             catch (TaskCanceledException ex) {
+                ReportAuthenticate(ref authenticateReported, true, authenticateStart);
                 Log.Event(Log.Level.Error, 414, $"Timeout reached while authenticating user {samid}", ex);
                 return false;
             }
             catch (HttpRequestException ex) {
+                ReportAuthenticate(ref authenticateReported, true, authenticateStart);
                 Log.Event(Log.Level.Error, 415, $"MFA Service is unreachable while authenticating user {samid}", ex);
                 return false;
             }
             catch (Exception ex) {
+                ReportAuthenticate(ref authenticateReported, true, authenticateStart);
                 Log.Event(Log.Level.Error, 416, $"Error authenticating user {samid}", ex);
                 return false;
             }
         }
 
+        private static void ReportAuthenticate(ref bool reported, bool failed, long start) {
+            if (!reported) {
+                reported = true;
+                MfaBreaker.Record(failed, start);
+            }
+        }
+
+        /// <summary>
+        /// Opens a connection to the MFA service before the first user needs it, or keeps an idle one
+        /// from being dropped, with a HEAD request to ServiceUrl whose answer is not looked at.
+        /// Nothing is sent if a request went to the service within <paramref name="minIdle"/>.
+        /// </summary>
+        /// <returns>True if a request was sent and the service answered it</returns>
+        public async Task<bool> WarmUpAsync(TimeSpan minIdle) {
+            var settings = _config.Current;
+            long now = Stopwatch.GetTimestamp();
+            long last = Math.Max(Interlocked.Read(ref _lastRequestTimestamp), _polls.LastSendTimestamp);
+            if (last != 0 && now - last < minIdle.TotalSeconds * Stopwatch.Frequency) {
+                return false;
+            }
+            Interlocked.Exchange(ref _lastRequestTimestamp, now);
+            try {
+                using (var request = new HttpRequestMessage(HttpMethod.Head, settings.ServiceUrl))
+                using (await _httpClient.SendAsync(request)) {
+                    return true;
+                }
+            }
+            catch (Exception ex) {
+                Log.Event(Log.Level.Trace, 31, $"Warm-up request to {settings.ServiceUrl} failed: {ex.Message}");
+                return false;
+            }
+        }
+
         public void Dispose() {
             Dispose(true);
             GC.SuppressFinalize(this);
@@ -222,6 +255,8 @@ namespace Omni2FA.AuthClient {
         protected virtual void Dispose(bool disposing) {
             if (!_disposed) {
                 if (disposing) {
+                    // Ends the waits still in progress before the HttpClient goes away
+                    _polls.Dispose();
                     // Only dispose HttpClient if we own it
                     if (_ownsHttpClient) {
                         _httpClient?.Dispose();
@@ -0,0 +1,152 @@
+using System;
+using System.Threading;
+
+namespace Omni2FA.AuthClient {
+    /// <summary>
+    /// Outcome of <see cref="MfaAdmission.TryEnter"/>.
+    /// </summary>
+    public enum MfaAdmissionResult {
+        Admitted,
+        /// <summary>All slots were busy and the wait queue was full</summary>
+        QueueFull,
+        /// <summary>No slot became free within the queue-time budget</summary>
+        TimedOut
+    }
+
+    /// <summary>
+    /// Bounds the number of MFA exchanges running at the same time.
+    /// <para>NPS calls the extension synchronously on its own worker threads and an MFA can block
+    /// one of them for WaitBeforePoll + PollMaxSeconds. Requests beyond the concurrency limit wait
+    /// in a bounded queue for at most the queue-time budget; when the queue is full they are turned
+    /// away at once, so a burst of logins cannot hold every NPS thread and stall other traffic.</para>
+    /// </summary>
+    public sealed class MfaAdmission {
+        private readonly SemaphoreSlim _slots;
+        private int _inFlight;
+        private int _queued;
+        private int _peakInFlight;
+        private int _peakQueued;
+        private long _admitted;
+        private long _admittedAfterWait;
+        private long _rejectedQueueFull;
+        private long _rejectedTimedOut;
+
+        /// <param name="maxConcurrent">MFA exchanges allowed to run at the same time</param>
+        /// <param name="maxQueue">Requests allowed to wait for a slot; 0 rejects as soon as all slots are busy</param>
+        public MfaAdmission(int maxConcurrent, int maxQueue) {
+            if (maxConcurrent <= 0) throw new ArgumentOutOfRangeException(nameof(maxConcurrent));
+            if (maxQueue < 0) throw new ArgumentOutOfRangeException(nameof(maxQueue));
+            MaxConcurrent = maxConcurrent;
+            MaxQueue = maxQueue;
+            _slots = new SemaphoreSlim(maxConcurrent, maxConcurrent);
+        }
+
+        public int MaxConcurrent { get; }
+
+        public int MaxQueue { get; }
+
+        /// <summary>Gauge: MFA exchanges running now</summary>
+        public int InFlight => Volatile.Read(ref _inFlight);
+
+        /// <summary>Gauge: requests waiting for a slot now</summary>
+        public int Queued => Volatile.Read(ref _queued);
+
+        /// <summary>Requests turned away so far, queue full and timed out together</summary>
+        public long Rejected => Interlocked.Read(ref _rejectedQueueFull) + Interlocked.Read(ref _rejectedTimedOut);
+
+        /// <summary>
+        /// Takes a slot, waiting up to <paramref name="queueTimeout"/> when all are busy.
+        /// Every <see cref="MfaAdmissionResult.Admitted"/> must be followed by one <see cref="Exit"/>.
+        /// </summary>
+        public MfaAdmissionResult TryEnter(TimeSpan queueTimeout) {
+            if (_slots.Wait(0)) {
+                OnAdmitted();
+                return MfaAdmissionResult.Admitted;
+            }
+            int queued = Interlocked.Increment(ref _queued);
+            if (queued > MaxQueue) {
+                Interlocked.Decrement(ref _queued);
+                Interlocked.Increment(ref _rejectedQueueFull);
+                return MfaAdmissionResult.QueueFull;
+            }
+            UpdatePeak(ref _peakQueued, queued);
+            bool entered;
+            try {
+                entered = queueTimeout > TimeSpan.Zero && _slots.Wait(queueTimeout);
+            }
+            finally {
+                Interlocked.Decrement(ref _queued);
+            }
+            if (!entered) {
+                Interlocked.Increment(ref _rejectedTimedOut);
+                return MfaAdmissionResult.TimedOut;
+            }
+            Interlocked.Increment(ref _admittedAfterWait);
+            OnAdmitted();
+            return MfaAdmissionResult.Admitted;
+        }
+
+        /// <summary>
+        /// Returns the slot taken by a successful <see cref="TryEnter"/>.
+        /// </summary>
+        public void Exit() {
+            Interlocked.Decrement(ref _inFlight);
+            _slots.Release();
+        }
+
+        public MfaAdmissionStats GetStats() {
+            return new MfaAdmissionStats {
+                MaxConcurrent = MaxConcurrent,
+                MaxQueue = MaxQueue,
+                InFlight = InFlight,
+                Queued = Queued,
+                PeakInFlight = Volatile.Read(ref _peakInFlight),
+                PeakQueued = Volatile.Read(ref _peakQueued),
+                Admitted = Interlocked.Read(ref _admitted),
+                AdmittedAfterWait = Interlocked.Read(ref _admittedAfterWait),
+                RejectedQueueFull = Interlocked.Read(ref _rejectedQueueFull),
+                RejectedTimedOut = Interlocked.Read(ref _rejectedTimedOut)
+            };
+        }
+
+        private void OnAdmitted() {
+            Interlocked.Increment(ref _admitted);
+            UpdatePeak(ref _peakInFlight, Interlocked.Increment(ref _inFlight));
+        }
+
+        private static void UpdatePeak(ref int peak, int value) {
+            int current = Volatile.Read(ref peak);
+            while (value > current) {
+                int seen = Interlocked.CompareExchange(ref peak, value, current);
+                if (seen == current) {
+                    return;
+                }
+                current = seen;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Gauges and counters of an <see cref="MfaAdmission"/>.
+    /// </summary>
+    public struct MfaAdmissionStats {
+        public int MaxConcurrent;
+        public int MaxQueue;
+        public int InFlight;
+        public int Queued;
+        public int PeakInFlight;
+        public int PeakQueued;
+        public long Admitted;
+        /// <summary>Admitted after waiting in the queue</summary>
+        public long AdmittedAfterWait;
+        public long RejectedQueueFull;
+        public long RejectedTimedOut;
+
+        public long Rejected => RejectedQueueFull + RejectedTimedOut;
+
+        public override string ToString() {
+            return $"in flight: {InFlight}/{MaxConcurrent} (peak {PeakInFlight}), queued: {Queued}/{MaxQueue} (peak {PeakQueued}), " +
+                $"admitted: {Admitted} ({AdmittedAfterWait} after waiting), rejected: {RejectedQueueFull} queue full, {RejectedTimedOut} timed out";
+        }
+    }
+}
@@ -0,0 +1,531 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Net;
+using System.Net.Http;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using Newtonsoft.Json;
+using Omni2FA.Net.Utils;
+
+namespace Omni2FA.AuthClient {
+    /// <summary>
+    /// How a wait for an MFA result ended, see <see cref="MfaPollScheduler.WaitAsync"/>.
+    /// </summary>
+    public enum MfaPollResult {
+        Succeeded,
+        Denied,
+        /// <summary>Still pending after the last allowed poll</summary>
+        Exhausted,
+        /// <summary>The service answered a poll with an error status</summary>
+        HttpError,
+        /// <summary>The answer to a poll was empty</summary>
+        BadResponse,
+        TimedOut,
+        Unreachable,
+        /// <summary>Any other exception while polling</summary>
+        Error,
+        /// <summary>The scheduler was disposed while the request waited</summary>
+        Stopped
+    }
+
+    /// <summary>
+    /// Result of one <see cref="MfaPollScheduler.WaitAsync"/>.
+    /// </summary>
+    public sealed class MfaPollOutcome {
+        public MfaPollOutcome(MfaPollResult result, int polls, string detail, Exception exception) {
+            Result = result;
+            Polls = polls;
+            Detail = detail;
+            Exception = exception;
+        }
+
+        public MfaPollResult Result { get; }
+
+        /// <summary>Polls that included this request, batched or not</summary>
+        public int Polls { get; }
+
+        /// <summary>Status code and content of the answer for <see cref="MfaPollResult.HttpError"/></summary>
+        public string Detail { get; }
+
+        public Exception Exception { get; }
+    }
+
+    /// <summary>
+    /// Polls the MFA service for the result of every pending MFA of the process from one timer.
+    /// <para>Pending requests sit in a hierarchical timer wheel (<see cref="WheelSlots"/> slots of one tick,
+    /// then <see cref="OuterSlots"/> slots of one turn of the inner wheel each) instead of each running its own
+    /// Task.Delay. On every tick the requests that are due are polled together: with one POST to /AuthResults
+    /// listing all their users when the service supports it, otherwise with one /AuthResult per user as before.
+    /// Support for /AuthResults is found out with the first batch to each ServiceUrl; a service that answers it
+    /// with 404, 405 or 501, or with something other than a list of results, is polled per user and asked again
+    /// after <see cref="RenegotiateAfter"/>. Other services keep batching. A single due request always uses /AuthResult.</para>
+    /// <para>A request that is still pending is polled again after its poll interval, stretched by an eighth
+    /// per pending answer up to twice the interval (see <see cref="PollDelay"/>), and completed as soon as an
+    /// answer says it succeeded or was denied. A failed poll ends the wait, as it did for a per-user poll.</para>
+    /// </summary>
+    public sealed class MfaPollScheduler : IDisposable {
+        public const int WheelSlots = 256;
+        public const int OuterSlots = 64;
+        public static readonly TimeSpan DefaultTick = TimeSpan.FromMilliseconds(200);
+        public static readonly TimeSpan RenegotiateAfter = TimeSpan.FromMinutes(10);
+
+        private readonly HttpClient _httpClient;
+        private readonly long _tickLength; // in Stopwatch ticks
+        private readonly long _origin = Stopwatch.GetTimestamp();
+        private readonly object _lock = new object();
+        private readonly List<Waiter>[] _inner = CreateSlots(WheelSlots);
+        private readonly List<Waiter>[] _outer = CreateSlots(OuterSlots);
+        private readonly Timer _timer;
+        // Guarded by _lock
+        private long _currentTick;
+        private int _scheduled;
+        private int _polling;
+        private bool _timerRunning;
+        private bool _disposed;
+        // Stopwatch timestamp per ServiceUrl before which /AuthResults is not tried; services that
+        // support it, or were never tried, have no entry
+        private readonly Dictionary<string, long> _batchRetryAt = new Dictionary<string, long>(StringComparer.Ordinal);
+
+        private int _ticking;
+        private long _lastSendTimestamp;
+        private long _batches;
+        private long _batchedPolls;
+        private long _singlePolls;
+        private long _fallbacks;
+        private long _completed;
+
+        /// <param name="httpClient">Client the polls are sent with; not disposed by the scheduler</param>
+        public MfaPollScheduler(HttpClient httpClient) : this(httpClient, DefaultTick) {
+        }
+
+        /// <param name="httpClient">Client the polls are sent with; not disposed by the scheduler</param>
+        /// <param name="tick">Wheel resolution; requests due within one tick are polled together</param>
+        public MfaPollScheduler(HttpClient httpClient, TimeSpan tick) {
+            if (tick <= TimeSpan.Zero) throw new ArgumentOutOfRangeException(nameof(tick));
+            _httpClient = httpClient ?? throw new ArgumentNullException(nameof(httpClient));
+            _tickLength = Math.Max(1, (long)(tick.TotalSeconds * Stopwatch.Frequency));
+            _timer = new Timer(OnTick, null, Timeout.Infinite, Timeout.Infinite);
+            Tick = tick;
+        }
+
+        public TimeSpan Tick { get; }
+
+        /// <summary>Gauge: requests waiting for their next poll or being polled now</summary>
+        public int Pending {
+            get {
+                lock (_lock) {
+                    return _scheduled + _polling;
+                }
+            }
+        }
+
+        /// <summary>Stopwatch timestamp of the last poll sent, 0 before the first</summary>
+        public long LastSendTimestamp => Interlocked.Read(ref _lastSendTimestamp);
+
+        /// <summary>
+        /// Delay before the next poll of a request that has been answered pending <paramref name="polls"/> times.
+        /// </summary>
+        public static TimeSpan PollDelay(TimeSpan interval, int polls) {
+            double stretch = Math.Min(2.0, 1.0 + Math.Max(0, polls - 1) / 8.0);
+            return TimeSpan.FromTicks((long)(interval.Ticks * stretch));
+        }
+
+        /// <summary>
+        /// Waits for the result of an MFA whose push the service has accepted.
+        /// </summary>
+        /// <param name="samid">User the push was sent for</param>
+        /// <param name="serviceUrl">Service to poll, without the trailing path</param>
+        /// <param name="requestJson">Body of a per-user /AuthResult poll</param>
+        /// <param name="waitBeforePoll">Delay before the first poll</param>
+        /// <param name="pollInterval">Delay between polls before back-off</param>
+        /// <param name="maxPolls">Polls after which a pending request gives up</param>
+        public Task<MfaPollOutcome> WaitAsync(string samid, string serviceUrl, string requestJson, TimeSpan waitBeforePoll, TimeSpan pollInterval, int maxPolls) {
+            if (samid == null) throw new ArgumentNullException(nameof(samid));
+            if (serviceUrl == null) throw new ArgumentNullException(nameof(serviceUrl));
+            if (maxPolls <= 0) {
+                return Task.FromResult(new MfaPollOutcome(MfaPollResult.Exhausted, 0, null, null));
+            }
+            var pending = new Waiter(samid, serviceUrl, requestJson, pollInterval < TimeSpan.Zero ? TimeSpan.Zero : pollInterval, maxPolls);
+            lock (_lock) {
+                if (_disposed) {
+                    return Task.FromResult(new MfaPollOutcome(MfaPollResult.Stopped, 0, null, null));
+                }
+                Schedule(pending, waitBeforePoll);
+            }
+            return pending.Completion.Task;
+        }
+
+        public MfaPollSchedulerStats GetStats() {
+            return new MfaPollSchedulerStats {
+                Batches = Interlocked.Read(ref _batches),
+                BatchedPolls = Interlocked.Read(ref _batchedPolls),
+                SinglePolls = Interlocked.Read(ref _singlePolls),
+                Fallbacks = Interlocked.Read(ref _fallbacks),
+                Completed = Interlocked.Read(ref _completed),
+                Pending = Pending
+            };
+        }
+
+        /// <summary>
+        /// Stops the timer and ends every waiting request with <see cref="MfaPollResult.Stopped"/>. Requests
+        /// being polled get the answer of their poll, or Stopped if it says pending.
+        /// </summary>
+        public void Dispose() {
+            var stopped = new List<Waiter>();
+            lock (_lock) {
+                if (_disposed) {
+                    return;
+                }
+                _disposed = true;
+                foreach (var slot in _inner.Concat(_outer)) {
+                    stopped.AddRange(slot);
+                    slot.Clear();
+                }
+                _scheduled = 0;
+            }
+            _timer.Dispose();
+            foreach (var pending in stopped) {
+                pending.Completion.TrySetResult(new MfaPollOutcome(MfaPollResult.Stopped, pending.Polls, null, null));
+            }
+        }
+
+        private static List<Waiter>[] CreateSlots(int count) {
+            var slots = new List<Waiter>[count];
+            for (int i = 0; i < slots.Length; i++) {
+                slots[i] = new List<Waiter>();
+            }
+            return slots;
+        }
+
+        private long NowTick() {
+            return (Stopwatch.GetTimestamp() - _origin) / _tickLength;
+        }
+
+        // Called under _lock
+        private void Schedule(Waiter pending, TimeSpan delay) {
+            if (!_timerRunning) {
+                // Nothing is in the wheel; skip the ticks that passed while the timer was stopped
+                _currentTick = Math.Max(_currentTick, NowTick());
+                _timerRunning = true;
+                _timer.Change(Tick, Tick);
+            }
+            long delayTicks = (long)(Math.Max(0, delay.TotalSeconds) * Stopwatch.Frequency);
+            pending.DueTick = (Stopwatch.GetTimestamp() - _origin + delayTicks + _tickLength - 1) / _tickLength;
+            Insert(pending);
+        }
+
+        // Called under _lock
+        private void Insert(Waiter pending) {
+            if (pending.DueTick <= _currentTick) {
+                pending.DueTick = _currentTick + 1;
+            }
+            if (pending.DueTick - _currentTick < WheelSlots) {
+                _inner[pending.DueTick % WheelSlots].Add(pending);
+            }
+            else {
+                // Beyond the outer wheel the request is parked in its last slot and placed again from there
+                long turn = Math.Min(pending.DueTick / WheelSlots, _currentTick / WheelSlots + OuterSlots - 1);
+                _outer[turn % OuterSlots].Add(pending);
+            }
+            _scheduled++;
+        }
+
+        // Moves the wheel up to nowTick and returns the requests that became due; called under _lock
+        private List<Waiter> Advance(long nowTick) {
+            List<Waiter> due = null;
+            while (_currentTick < nowTick) {
+                long tick = ++_currentTick;
+                if (tick % WheelSlots == 0) {
+                    var turn = _outer[(tick / WheelSlots) % OuterSlots];
+                    if (turn.Count > 0) {
+                        var cascaded = turn.ToArray();
+                        turn.Clear();
+                        _scheduled -= cascaded.Length;
+                        foreach (var pending in cascaded) {
+                            if (pending.DueTick <= tick) {
+                                (due = due ?? new List<Waiter>()).Add(pending);
+                            }
+                            else {
+                                Insert(pending);
+                            }
+                        }
+                    }
+                }
+                var slot = _inner[tick % WheelSlots];
+                if (slot.Count > 0) {
+                    (due = due ?? new List<Waiter>()).AddRange(slot);
+                    _scheduled -= slot.Count;
+                    slot.Clear();
+                }
+            }
+            return due;
+        }
+
+        private void OnTick(object state) {
+            // A tick that fires while the previous one still moves the wheel has nothing left to do
+            if (Interlocked.Exchange(ref _ticking, 1) != 0) {
+                return;
+            }
+            try {
+                List<Waiter> due;
+                lock (_lock) {
+                    if (_disposed) {
+                        return;
+                    }
+                    due = Advance(NowTick());
+                    if (due != null) {
+                        _polling += due.Count;
+                    }
+                    if (_scheduled == 0 && _polling == 0 && _timerRunning) {
+                        _timerRunning = false;
+                        _timer.Change(Timeout.Infinite, Timeout.Infinite);
+                    }
+                }
+                if (due != null) {
+                    _ = PollAsync(due);
+                }
+            }
+            finally {
+                Volatile.Write(ref _ticking, 0);
+            }
+        }
+
+        private async Task PollAsync(List<Waiter> due) {
+            // Settings may change while requests wait, so requests can be due for different services
+            await Task.WhenAll(due.GroupBy(pending => pending.ServiceUrl, StringComparer.Ordinal)
+                .Select(group => PollServiceAsync(group.Key, group.ToList())));
+        }
+
+        private async Task PollServiceAsync(string serviceUrl, List<Waiter> due) {
+            var single = due;
+            if (due.Count > 1 && CanBatch(serviceUrl)) {
+                single = await PollBatchAsync(serviceUrl, due);
+            }
+            if (single.Count > 0) {
+                await Task.WhenAll(single.Select(PollOneAsync));
+            }
+        }
+
+        private async Task PollOneAsync(Waiter pending) {
+            pending.Polls++;
+            Interlocked.Increment(ref _singlePolls);
+            try {
+                Log.Event(Log.Level.Trace, 25, $"Polling AuthResult for user: {pending.Samid}, attempt: {pending.Polls}");
+                var pollStart = Metrics.Start();
+                Interlocked.Exchange(ref _lastSendTimestamp, Stopwatch.GetTimestamp());
+                using (var response = await _httpClient.PostAsync(
+                    $"{pending.ServiceUrl}/AuthResult",
+                    new StringContent(pending.RequestJson, Encoding.UTF8, "application/json"))) {
+                    Metrics.Record(MetricsPhase.AuthResult, pollStart);
+                    var content = await response.Content.ReadAsStringAsync();
+                    if (!response.IsSuccessStatusCode) {
+                        Complete(pending, MfaPollResult.HttpError, $"{response.StatusCode}, content: {content}", null);
+                        return;
+                    }
+                    var answer = JsonConvert.DeserializeObject<Authenticator.AuthResultResponse>(content);
+                    Log.Event(Log.Level.Trace, 26, $"Polled AuthResult for user: {pending.Samid}, response: {content}");
+                    if (answer == null) {
+                        Complete(pending, MfaPollResult.BadResponse, null, null);
+                        return;
+                    }
+                    Answer(pending, answer.status);
+                }
+            }
+            catch (Exception ex) {
+                Complete(pending, Classify(ex), null, ex);
+            }
+        }
+
+        // Returns the requests still to be polled one by one
+        private async Task<List<Waiter>> PollBatchAsync(string serviceUrl, List<Waiter> due) {
+            var users = due.Select(pending => pending.Samid).Distinct(StringComparer.Ordinal).ToList();
+            var body = JsonConvert.SerializeObject(new {
+                requests = users.Select(user => new { samid = user, requestor = Authenticator.Requestor }).ToList()
+            });
+            try {
+                Log.Event(Log.Level.Trace, 32, $"Polling AuthResults for {users.Count} users");
+                var pollStart = Metrics.Start();
+                Interlocked.Exchange(ref _lastSendTimestamp, Stopwatch.GetTimestamp());
+                using (var response = await _httpClient.PostAsync(
+                    $"{serviceUrl}/AuthResults",
+                    new StringContent(body, Encoding.UTF8, "application/json"))) {
+                    Metrics.Record(MetricsPhase.AuthResult, pollStart);
+                    var content = await response.Content.ReadAsStringAsync();
+                    if (response.StatusCode == HttpStatusCode.NotFound || response.StatusCode == HttpStatusCode.MethodNotAllowed ||
+                        response.StatusCode == HttpStatusCode.NotImplemented) {
+                        FallBack(serviceUrl, $"status {response.StatusCode}");
+                        return due;
+                    }
+                    if (!response.IsSuccessStatusCode) {
+                        foreach (var pending in due) {
+                            pending.Polls++;
+                            Complete(pending, MfaPollResult.HttpError, $"{response.StatusCode}, content: {content}", null);
+                        }
+                        return new List<Waiter>();
+                    }
+                    AuthResultsResponse answer = null;
+                    try {
+                        answer = JsonConvert.DeserializeObject<AuthResultsResponse>(content);
+                    }
+                    catch (Exception) {
+                        // Not a batch answer; handled below
+                    }
+                    if (answer?.results == null) {
+                        FallBack(serviceUrl, "the answer has no results");
+                        return due;
+                    }
+                    lock (_lock) {
+                        _batchRetryAt.Remove(serviceUrl);
+                    }
+                    Interlocked.Increment(ref _batches);
+                    var statuses = new Dictionary<string, Authenticator.AuthStatusEnum>(StringComparer.Ordinal);
+                    foreach (var result in answer.results) {
+                        if (result?.samid != null) {
+                            statuses[result.samid] = result.status;
+                        }
+                    }
+                    // Users the answer left out are asked for one by one
+                    var missing = new List<Waiter>();
+                    foreach (var pending in due) {
+                        if (statuses.TryGetValue(pending.Samid, out var status)) {
+                            pending.Polls++;
+                            Interlocked.Increment(ref _batchedPolls);
+                            Answer(pending, status);
+                        }
+                        else {
+                            missing.Add(pending);
+                        }
+                    }
+                    Log.Event(Log.Level.Trace, 33, $"Polled AuthResults for {users.Count} users, {statuses.Count} answered");
+                    return missing;
+                }
+            }
+            catch (Exception ex) {
+                var result = Classify(ex);
+                foreach (var pending in due) {
+                    pending.Polls++;
+                    Complete(pending, result, null, ex);
+                }
+                return new List<Waiter>();
+            }
+        }
+
+        private bool CanBatch(string serviceUrl) {
+            lock (_lock) {
+                return !_batchRetryAt.TryGetValue(serviceUrl, out long retryAt) || Stopwatch.GetTimestamp() >= retryAt;
+            }
+        }
+
+        private void FallBack(string serviceUrl, string reason) {
+            long retryAt = Stopwatch.GetTimestamp() + (long)(RenegotiateAfter.TotalSeconds * Stopwatch.Frequency);
+            bool first;
+            lock (_lock) {
+                first = !_batchRetryAt.ContainsKey(serviceUrl);
+                _batchRetryAt[serviceUrl] = retryAt;
+            }
+            if (first) {
+                Log.Event(Log.Level.Information, 217, $"MFA service {serviceUrl} does not support batched AuthResults ({reason}), polling per user");
+            }
+            Interlocked.Increment(ref _fallbacks);
+        }
+
+        private static MfaPollResult Classify(Exception ex) {
+            if (ex is TaskCanceledException) {
+                return MfaPollResult.TimedOut;
+            }
+            if (ex is HttpRequestException) {
+                return MfaPollResult.Unreachable;
+            }
+            return MfaPollResult.Error;
+        }
+
+        private void Answer(Waiter pending, Authenticator.AuthStatusEnum status) {
+            if (status > 0) {
+                Complete(pending, MfaPollResult.Succeeded, null, null);
+            }
+            else if (status < 0) {
+                Complete(pending, MfaPollResult.Denied, null, null);
+            }
+            else if (pending.Polls >= pending.MaxPolls) {
+                Complete(pending, MfaPollResult.Exhausted, null, null);
+            }
+            else {
+                lock (_lock) {
+                    _polling--;
+                    if (_disposed) {
+                        pending.Completion.TrySetResult(new MfaPollOutcome(MfaPollResult.Stopped, pending.Polls, null, null));
+                        return;
+                    }
+                    Schedule(pending, PollDelay(pending.Interval, pending.Polls));
+                }
+            }
+        }
+
+        private void Complete(Waiter pending, MfaPollResult result, string detail, Exception exception) {
+            lock (_lock) {
+                _polling--;
+            }
+            Interlocked.Increment(ref _completed);
+            pending.Completion.TrySetResult(new MfaPollOutcome(result, pending.Polls, detail, exception));
+        }
+
+        private sealed class Waiter {
+            public Waiter(string samid, string serviceUrl, string requestJson, TimeSpan interval, int maxPolls) {
+                Samid = samid;
+                ServiceUrl = serviceUrl;
+                RequestJson = requestJson;
+                Interval = interval;
+                MaxPolls = maxPolls;
+            }
+
+            public readonly string Samid;
+            public readonly string ServiceUrl;
+            public readonly string RequestJson;
+            public readonly TimeSpan Interval;
+            public readonly int MaxPolls;
+            // Only touched by the poll that owns the request at the time
+            public int Polls;
+            // Guarded by the scheduler's lock
+            public long DueTick;
+            // Nothing queued on the task may run inline on the thread that answers the poll
+            public readonly TaskCompletionSource<MfaPollOutcome> Completion = new TaskCompletionSource<MfaPollOutcome>(TaskCreationOptions.RunContinuationsAsynchronously);
+        }
+
+        /// <summary>
+        /// Answer to a batched poll. The request is {"requests": [{"samid": ..., "requestor": ...}, ...]};
+        /// the answer holds one result per user the service knows.
+        /// </summary>
+        public class AuthResultsResponse {
+            public List<AuthResultsEntry> results { get; set; }
+        }
+
+        public class AuthResultsEntry {
+            public string samid { get; set; }
+            public Authenticator.AuthStatusEnum status { get; set; }
+        }
+    }
+
+    /// <summary>
+    /// Counters of an <see cref="MfaPollScheduler"/>.
+    /// </summary>
+    public struct MfaPollSchedulerStats {
+        /// <summary>/AuthResults requests answered with results</summary>
+        public long Batches;
+        /// <summary>Users answered by those batches</summary>
+        public long BatchedPolls;
+        /// <summary>/AuthResult requests</summary>
+        public long SinglePolls;
+        /// <summary>Batches the service did not understand, polled per user instead</summary>
+        public long Fallbacks;
+        /// <summary>Waits ended with a result</summary>
+        public long Completed;
+        public int Pending;
+
+        public override string ToString() {
+            return $"batches: {Batches}, batched polls: {BatchedPolls}, single polls: {SinglePolls}, fallbacks: {Fallbacks}, completed: {Completed}, pending: {Pending}";
+        }
+    }
+}
@@ -0,0 +1,244 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace Omni2FA.AuthClient {
+    /// <summary>
+    /// Remembers recent MFA results so that a reconnect from the same user and NAS
+    /// (VPN rekey, RD Gateway reconnect, Wi-Fi roaming) does not trigger another push.
+    /// <para>Entries are spread over independently locked shards, so concurrent requests
+    /// for different users rarely contend. Every shard is an LRU list bounded to its share
+    /// of the capacity; entries also expire after the TTL given when they were added.</para>
+    /// </summary>
+    public sealed class MfaResultCache {
+        public const int DefaultCapacity = 10000;
+
+        private readonly Shard[] _shards;
+        private readonly int _shardMask;
+
+        /// <param name="capacity">Maximum number of entries over all shards</param>
+        /// <param name="shardCount">Number of shards, rounded up to a power of two; 0 picks one from the processor count</param>
+        public MfaResultCache(int capacity = DefaultCapacity, int shardCount = 0) {
+            if (capacity <= 0) throw new ArgumentOutOfRangeException(nameof(capacity));
+            if (shardCount <= 0) {
+                shardCount = Environment.ProcessorCount * 2;
+            }
+            int shards = 1;
+            while (shards < shardCount && shards < 256) {
+                shards <<= 1;
+            }
+            // Never more shards than entries, or some shards could hold nothing
+            while (shards > 1 && shards > capacity) {
+                shards >>= 1;
+            }
+            _shards = new Shard[shards];
+            _shardMask = shards - 1;
+            int perShard = capacity / shards;
+            int remainder = capacity % shards;
+            for (int i = 0; i < shards; i++) {
+                _shards[i] = new Shard(perShard + (i < remainder ? 1 : 0));
+            }
+            Capacity = capacity;
+        }
+
+        public int Capacity { get; }
+
+        public int ShardCount => _shards.Length;
+
+        /// <summary>
+        /// Builds the cache key for a request: the user name, the NAS the user connects through
+        /// and the NPS policy that matched. User names are compared case-insensitively.
+        /// </summary>
+        public static string MakeKey(string userName, string nasIpAddress, string calledStationId, string policyName) {
+            return string.Join("\u001f",
+                (userName ?? string.Empty).Trim().ToUpperInvariant(),
+                (nasIpAddress ?? string.Empty).Trim(),
+                (calledStationId ?? string.Empty).Trim().ToUpperInvariant(),
+                (policyName ?? string.Empty).Trim().ToUpperInvariant());
+        }
+
+        /// <summary>
+        /// Looks up a result that has not expired yet.
+        /// </summary>
+        public bool TryGet(string key, out bool success) {
+            return ShardFor(key).TryGet(key, Stopwatch.GetTimestamp(), out success);
+        }
+
+        /// <summary>
+        /// Adds or replaces the result for a key. A TTL of zero or less removes the key instead.
+        /// </summary>
+        public void Set(string key, bool success, TimeSpan ttl) {
+            var shard = ShardFor(key);
+            if (ttl <= TimeSpan.Zero) {
+                shard.Remove(key);
+                return;
+            }
+            long now = Stopwatch.GetTimestamp();
+            long ttlTicks = (long)(Math.Min(ttl.TotalSeconds, int.MaxValue) * Stopwatch.Frequency);
+            shard.Set(key, success, now + ttlTicks, now);
+        }
+
+        public bool Remove(string key) {
+            return ShardFor(key).Remove(key);
+        }
+
+        public void Clear() {
+            foreach (var shard in _shards) {
+                shard.Clear();
+            }
+        }
+
+        public int Count {
+            get {
+                int count = 0;
+                foreach (var shard in _shards) {
+                    count += shard.Count;
+                }
+                return count;
+            }
+        }
+
+        /// <summary>
+        /// Counters summed over all shards.
+        /// </summary>
+        public MfaResultCacheStats GetStats() {
+            var stats = new MfaResultCacheStats();
+            foreach (var shard in _shards) {
+                shard.AddStats(ref stats);
+            }
+            return stats;
+        }
+
+        private Shard ShardFor(string key) {
+            if (key == null) throw new ArgumentNullException(nameof(key));
+            // Spread the string hash, its low bits are not well mixed
+            uint hash = (uint)StringComparer.Ordinal.GetHashCode(key);
+            hash ^= hash >> 16;
+            hash *= 0x45d9f3b;
+            hash ^= hash >> 16;
+            return _shards[hash & _shardMask];
+        }
+
+        private struct Entry {
+            public string Key;
+            public bool Success;
+            public long ExpiresAt;
+        }
+
+        private sealed class Shard {
+            private readonly object _lock = new object();
+            private readonly int _capacity;
+            private readonly Dictionary<string, LinkedListNode<Entry>> _map;
+            // Most recently used first
+            private readonly LinkedList<Entry> _lru = new LinkedList<Entry>();
+            private long _hits;
+            private long _misses;
+            private long _evictions;
+            private long _expirations;
+
+            public Shard(int capacity) {
+                _capacity = Math.Max(1, capacity);
+                _map = new Dictionary<string, LinkedListNode<Entry>>(StringComparer.Ordinal);
+            }
+
+            public int Count {
+                get {
+                    lock (_lock) {
+                        return _map.Count;
+                    }
+                }
+            }
+
+            public bool TryGet(string key, long now, out bool success) {
+                lock (_lock) {
+                    if (_map.TryGetValue(key, out var node)) {
+                        if (node.Value.ExpiresAt > now) {
+                            _lru.Remove(node);
+                            _lru.AddFirst(node);
+                            _hits++;
+                            success = node.Value.Success;
+                            return true;
+                        }
+                        _map.Remove(key);
+                        _lru.Remove(node);
+                        _expirations++;
+                    }
+                    _misses++;
+                    success = false;
+                    return false;
+                }
+            }
+
+            public void Set(string key, bool success, long expiresAt, long now) {
+                lock (_lock) {
+                    if (_map.TryGetValue(key, out var node)) {
+                        node.Value = new Entry { Key = key, Success = success, ExpiresAt = expiresAt };
+                        _lru.Remove(node);
+                        _lru.AddFirst(node);
+                        return;
+                    }
+                    if (_map.Count >= _capacity) {
+                        // Drop the least recently used entry; if its TTL had already passed
+                        // it counts as expired rather than evicted
+                        var last = _lru.Last;
+                        if (last.Value.ExpiresAt <= now) {
+                            _expirations++;
+                        }
+                        else {
+                            _evictions++;
+                        }
+                        _map.Remove(last.Value.Key);
+                        _lru.RemoveLast();
+                    }
+                    node = _lru.AddFirst(new Entry { Key = key, Success = success, ExpiresAt = expiresAt });
+                    _map.Add(key, node);
+                }
+            }
+
+            public bool Remove(string key) {
+                lock (_lock) {
+                    if (!_map.TryGetValue(key, out var node)) {
+                        return false;
+                    }
+                    _map.Remove(key);
+                    _lru.Remove(node);
+                    return true;
+                }
+            }
+
+            public void Clear() {
+                lock (_lock) {
+                    _map.Clear();
+                    _lru.Clear();
+                }
+            }
+
+            public void AddStats(ref MfaResultCacheStats stats) {
+                lock (_lock) {
+                    stats.Hits += _hits;
+                    stats.Misses += _misses;
+                    stats.Evictions += _evictions;
+                    stats.Expirations += _expirations;
+                    stats.Count += _map.Count;
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Counters of an <see cref="MfaResultCache"/>.
+    /// </summary>
+    public struct MfaResultCacheStats {
+        public long Hits;
+        public long Misses;
+        /// <summary>Entries dropped to make room while still valid</summary>
+        public long Evictions;
+        /// <summary>Entries dropped because their TTL had passed</summary>
+        public long Expirations;
+        public long Count;
+
+        public override string ToString() {
+            return $"hits: {Hits}, misses: {Misses}, evictions: {Evictions}, expirations: {Expirations}, entries: {Count}";
+        }
+    }
+}
@@ -0,0 +1,86 @@
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Omni2FA.AuthClient {
+    /// <summary>
+    /// Runs at most one MFA exchange per key at a time. NASes retransmit an Access-Request
+    /// after a few seconds while the user is still answering the push; with the same key
+    /// (see <see cref="MfaResultCache.MakeKey"/>) the retransmission waits for the exchange
+    /// already in progress and gets its result instead of sending another push.
+    /// <para>The first caller runs the work on its own thread; later callers block until it
+    /// finishes. An exception thrown by the work is rethrown to every caller.</para>
+    /// </summary>
+    public sealed class MfaSingleFlight<T> {
+        private readonly ConcurrentDictionary<string, Flight> _flights = new ConcurrentDictionary<string, Flight>(StringComparer.Ordinal);
+        private long _started;
+        private long _coalesced;
+
+        /// <summary>Exchanges in progress now</summary>
+        public int Pending => _flights.Count;
+
+        /// <summary>
+        /// Runs <paramref name="work"/>, or waits for the run already in progress for the same key.
+        /// </summary>
+        /// <param name="coalesced">True when the result came from a run started by another caller</param>
+        public T Run(string key, Func<T> work, out bool coalesced) {
+            if (key == null) throw new ArgumentNullException(nameof(key));
+            if (work == null) throw new ArgumentNullException(nameof(work));
+            var flight = new Flight();
+            var current = _flights.GetOrAdd(key, flight);
+            if (current != flight) {
+                Interlocked.Increment(ref _coalesced);
+                coalesced = true;
+                return current.Completion.Task.GetAwaiter().GetResult();
+            }
+
+            Interlocked.Increment(ref _started);
+            coalesced = false;
+            try {
+                T result = work();
+                flight.Completion.SetResult(result);
+                return result;
+            }
+            catch (Exception ex) {
+                flight.Completion.SetException(ex);
+                // Observed here so that a failure nobody waited for is not reported as unobserved
+                _ = flight.Completion.Task.Exception;
+                throw;
+            }
+            finally {
+                // Removes the entry only if it is still this run
+                ((ICollection<KeyValuePair<string, Flight>>)_flights).Remove(new KeyValuePair<string, Flight>(key, flight));
+            }
+        }
+
+        public MfaSingleFlightStats GetStats() {
+            return new MfaSingleFlightStats {
+                Started = Interlocked.Read(ref _started),
+                Coalesced = Interlocked.Read(ref _coalesced),
+                Pending = Pending
+            };
+        }
+
+        private sealed class Flight {
+            // Nothing queued on the task may run inline on the thread that completes the run
+            public readonly TaskCompletionSource<T> Completion = new TaskCompletionSource<T>(TaskCreationOptions.RunContinuationsAsynchronously);
+        }
+    }
+
+    /// <summary>
+    /// Counters of an <see cref="MfaSingleFlight{T}"/>.
+    /// </summary>
+    public struct MfaSingleFlightStats {
+        /// <summary>Exchanges actually started</summary>
+        public long Started;
+        /// <summary>Requests answered with the result of an exchange started by another request</summary>
+        public long Coalesced;
+        public int Pending;
+
+        public override string ToString() {
+            return $"started: {Started}, coalesced: {Coalesced}, pending: {Pending}";
+        }
+    }
+}
@@ -0,0 +1,701 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+//   Load generator replaying an ECB capture written by Omni2FA.NPS.Plugin
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+//
+// Usage: Omni2FA.EcbReplay [options] <capture file>
+//        Omni2FA.EcbReplay --generate <count> <capture file>
+//
+// Rebuilds a RADIUS_EXTENSION_CONTROL_BLOCK for every record of the capture
+// (EcbCapturePath) and runs it through the native request path of
+// RadiusExtensionProcess2: the pre-filter, the attribute lookup, and for MFA
+// candidates an /Authenticate and /AuthResult exchange by the native MFA client
+// against a stub MFA service on 127.0.0.1 started by the tool. Nothing outside
+// the process is needed, so it runs on Windows and on Linux alike.
+//
+// Options:
+//   --concurrency <n>    worker threads (default 8)
+//   --rate <n>           requests per second, open loop; 0 runs every worker
+//                        back to back (default 0)
+//   --recorded           keeps the pace of the capture instead of --rate
+//   --count <n>          requests to send; the capture is repeated as needed
+//                        (default: one pass)
+//   --mfa-latency <ms>   delay of every stub response (default 1)
+//   --polls <n>          AuthResult calls answered "pending" before the stub
+//                        reports success (default 0)
+//   --poll-interval <ms> WaitBeforePoll and PollInterval of the client (default 10)
+//   --no-mfa             skips the MFA exchange
+//
+// --generate writes a synthetic capture instead: mostly accepted
+// Access-Requests from a few hundred users, with some accounting and rejected
+// requests in between, 1 ms apart.
+//
+// Latencies are reported per phase as p50/p95/p99/max in microseconds. With a
+// rate the total is measured from the time the request was due, so a stalled
+// worker shows up in the percentiles instead of just lowering throughput; "lag"
+// is how late the request actually started.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <windows.h>
+#include <authif.h>
+#include "ecbcapture.h"
+#include "mfaclient.h"
+#include "radutil.h"
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET StubSocket;
+const StubSocket kNoSocket = INVALID_SOCKET;
+const int kSendFlags = 0;
+void CloseStubSocket(StubSocket s) { closesocket(s); }
+void ShutdownStubSocket(StubSocket s) { shutdown(s, SD_BOTH); }
+#else
+typedef int StubSocket;
+const StubSocket kNoSocket = -1;
+const int kSendFlags = MSG_NOSIGNAL;
+void CloseStubSocket(StubSocket s) { close(s); }
+void ShutdownStubSocket(StubSocket s) { shutdown(s, SHUT_RDWR); }
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// Attributes the adapter reads from every request
+const DWORD kLookupTypes[] = { 1, 4, 30, 31, 265, 266, 270, 275 };
+const DWORD kLookupCount = sizeof(kLookupTypes) / sizeof(kLookupTypes[0]);
+
+uint64_t MicrosSince(Clock::time_point from, Clock::time_point to) {
+    return to > from ? (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(to - from).count() : 0;
+}
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    data.clear();
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(file);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Mock ECB
+// ---------------------------------------------------------------------------
+
+// RADIUS_ATTRIBUTE_ARRAY over attributes whose values point into the capture
+// image. The array header must stay the first member: NPS passes the array
+// itself as _This.
+struct ReplayAttributeArray {
+    RADIUS_ATTRIBUTE_ARRAY base;
+    std::vector<RADIUS_ATTRIBUTE> attributes;
+
+    ReplayAttributeArray() {
+        base.cbSize = sizeof(RADIUS_ATTRIBUTE_ARRAY);
+        base.Add = &Add;
+        base.AttributeAt = &AttributeAt;
+        base.GetSize = &GetSize;
+        base.InsertAt = &InsertAt;
+        base.RemoveAt = &RemoveAt;
+        base.SetAt = &SetAt;
+    }
+
+    static ReplayAttributeArray* Of(RADIUS_ATTRIBUTE_ARRAY* pThis) {
+        return reinterpret_cast<ReplayAttributeArray*>(pThis);
+    }
+
+    static const ReplayAttributeArray* Of(const RADIUS_ATTRIBUTE_ARRAY* pThis) {
+        return reinterpret_cast<const ReplayAttributeArray*>(pThis);
+    }
+
+    static DWORD WINAPI Add(RADIUS_ATTRIBUTE_ARRAY* pThis, const RADIUS_ATTRIBUTE* pAttr) {
+        Of(pThis)->attributes.push_back(*pAttr);
+        return NO_ERROR;
+    }
+
+    static const RADIUS_ATTRIBUTE* WINAPI AttributeAt(const RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex) {
+        const ReplayAttributeArray* array = Of(pThis);
+        return dwIndex < array->attributes.size() ? &array->attributes[dwIndex] : nullptr;
+    }
+
+    static DWORD WINAPI GetSize(const RADIUS_ATTRIBUTE_ARRAY* pThis) {
+        return (DWORD)Of(pThis)->attributes.size();
+    }
+
+    static DWORD WINAPI InsertAt(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr) {
+        ReplayAttributeArray* array = Of(pThis);
+        if (dwIndex > array->attributes.size())
+            return ERROR_INVALID_PARAMETER;
+        array->attributes.insert(array->attributes.begin() + dwIndex, *pAttr);
+        return NO_ERROR;
+    }
+
+    static DWORD WINAPI RemoveAt(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex) {
+        ReplayAttributeArray* array = Of(pThis);
+        if (dwIndex >= array->attributes.size())
+            return ERROR_INVALID_PARAMETER;
+        array->attributes.erase(array->attributes.begin() + dwIndex);
+        return NO_ERROR;
+    }
+
+    static DWORD WINAPI SetAt(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr) {
+        ReplayAttributeArray* array = Of(pThis);
+        if (dwIndex >= array->attributes.size())
+            return ERROR_INVALID_PARAMETER;
+        array->attributes[dwIndex] = *pAttr;
+        return NO_ERROR;
+    }
+};
+
+// One request rebuilt from a capture record. The ECB header must stay the
+// first member, like the attribute arrays above.
+struct ReplayEcb {
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb;
+    ReplayAttributeArray request;
+    ReplayAttributeArray accept;
+    // Returned for any other response type
+    ReplayAttributeArray other;
+
+    ReplayEcb() {
+        memset(&ecb, 0, sizeof(ecb));
+        ecb.cbSize = sizeof(ecb);
+        ecb.dwVersion = 1;
+        ecb.GetRequest = &GetRequest;
+        ecb.GetResponse = &GetResponse;
+        ecb.SetResponseType = &SetResponseType;
+    }
+
+    void Load(const EcbCaptureRecordView& view) {
+        ecb.repPoint = (RADIUS_EXTENSION_POINT)view.record->extensionPoint;
+        ecb.rcRequestType = (RADIUS_CODE)view.record->requestType;
+        ecb.rcResponseType = (RADIUS_CODE)view.record->responseType;
+        request.attributes.clear();
+        accept.attributes.clear();
+        other.attributes.clear();
+        const uint8_t* cursor = view.attributes;
+        const uint8_t* value;
+        const EcbCaptureAttribute* attr;
+        while ((attr = EcbCaptureNextAttribute(view, &cursor, &value)) != nullptr) {
+            RADIUS_ATTRIBUTE radius;
+            memset(&radius, 0, sizeof(radius));
+            radius.dwAttrType = attr->type;
+            radius.fDataType = (RADIUS_DATA_TYPE)attr->dataType;
+            if ((radius.fDataType == rdtAddress || radius.fDataType == rdtInteger || radius.fDataType == rdtTime) &&
+                attr->length == sizeof(DWORD)) {
+                radius.cbDataLength = sizeof(DWORD);
+                memcpy(&radius.dwValue, value, sizeof(DWORD));
+            } else {
+                radius.cbDataLength = attr->length;
+                radius.lpValue = value;
+            }
+            if (attr->flags & ECB_CAPTURE_ATTR_RESPONSE)
+                accept.attributes.push_back(radius);
+            else
+                request.attributes.push_back(radius);
+        }
+    }
+
+    static ReplayEcb* Of(RADIUS_EXTENSION_CONTROL_BLOCK* pThis) {
+        return reinterpret_cast<ReplayEcb*>(pThis);
+    }
+
+    static PRADIUS_ATTRIBUTE_ARRAY WINAPI GetRequest(RADIUS_EXTENSION_CONTROL_BLOCK* pThis) {
+        return &Of(pThis)->request.base;
+    }
+
+    static PRADIUS_ATTRIBUTE_ARRAY WINAPI GetResponse(RADIUS_EXTENSION_CONTROL_BLOCK* pThis, RADIUS_CODE rcResponseType) {
+        return rcResponseType == rcAccessAccept ? &Of(pThis)->accept.base : &Of(pThis)->other.base;
+    }
+
+    static DWORD WINAPI SetResponseType(RADIUS_EXTENSION_CONTROL_BLOCK* pThis, RADIUS_CODE rcResponseType) {
+        pThis->rcResponseType = rcResponseType;
+        return NO_ERROR;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Stub MFA service
+// ---------------------------------------------------------------------------
+
+// Keep-alive HTTP/1.1 server on 127.0.0.1 answering /Authenticate and
+// /AuthResult with Content-Length framed JSON. Every connection gets a thread,
+// which is fine for the few connections the client pool keeps open.
+class StubService {
+public:
+    StubService(uint32_t latencyMs, uint32_t polls) : latencyMs_(latencyMs), polls_(polls) {}
+
+    ~StubService() { Stop(); }
+
+    bool Start() {
+        listener_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener_ == kNoSocket)
+            return false;
+        int reuse = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(listener_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener_, 256) != 0 ||
+            getsockname(listener_, (sockaddr*)&address, &length) != 0) {
+            CloseStubSocket(listener_);
+            listener_ = kNoSocket;
+            return false;
+        }
+        port_ = ntohs(address.sin_port);
+        acceptor_ = std::thread([this] { AcceptLoop(); });
+        return true;
+    }
+
+    void Stop() {
+        if (listener_ == kNoSocket || stopped_.exchange(true))
+            return;
+        ShutdownStubSocket(listener_);
+        CloseStubSocket(listener_);
+        acceptor_.join();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            for (StubSocket client : clients_)
+                ShutdownStubSocket(client);
+        }
+        for (std::thread& worker : workers_)
+            worker.join();
+    }
+
+    uint16_t port() const { return port_; }
+    uint64_t requests() const { return requests_.load(); }
+    uint64_t connections() const { return connections_.load(); }
+
+private:
+    void AcceptLoop() {
+        for (;;) {
+            StubSocket client = accept(listener_, nullptr, nullptr);
+            if (client == kNoSocket || stopped_.load()) {
+                if (client != kNoSocket)
+                    CloseStubSocket(client);
+                return;
+            }
+            int noDelay = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+            ++connections_;
+            std::lock_guard<std::mutex> guard(lock_);
+            clients_.push_back(client);
+            workers_.emplace_back([this, client] { Serve(client); });
+        }
+    }
+
+    void Serve(StubSocket client) {
+        std::string pending;
+        char buffer[4096];
+        for (;;) {
+            size_t headerEnd;
+            while ((headerEnd = pending.find("\r\n\r\n")) == std::string::npos) {
+                int received = (int)recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                    return;
+                pending.append(buffer, (size_t)received);
+            }
+            std::string headers = pending.substr(0, headerEnd + 4);
+            size_t contentLength = 0;
+            size_t lengthAt = headers.find("Content-Length: ");
+            if (lengthAt != std::string::npos)
+                contentLength = (size_t)atoi(headers.c_str() + lengthAt + 16);
+            pending.erase(0, headerEnd + 4);
+            while (pending.size() < contentLength) {
+                int received = (int)recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                    return;
+                pending.append(buffer, (size_t)received);
+            }
+            std::string body = pending.substr(0, contentLength);
+            pending.erase(0, contentLength);
+            ++requests_;
+            int status = Answer(headers.find("/AuthResult") != std::string::npos, body);
+            if (latencyMs_ > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs_));
+            std::string json = "{\"status\":" + std::to_string(status) + ",\"message\":\"\"}";
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json; charset=utf-8\r\n"
+                "Content-Length: " + std::to_string(json.size()) + "\r\n\r\n" + json;
+            if (send(client, response.data(), (int)response.size(), kSendFlags) != (int)response.size())
+                return;
+        }
+    }
+
+    // Pending (0) until the user has polled polls_ times, then success (1)
+    int Answer(bool poll, const std::string& body) {
+        if (polls_ == 0)
+            return 1;
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!poll) {
+            polled_[body] = 0;
+            return 0;
+        }
+        uint32_t& count = polled_[body];
+        if (++count <= polls_)
+            return 0;
+        polled_.erase(body);
+        return 1;
+    }
+
+    uint32_t latencyMs_;
+    uint32_t polls_;
+    StubSocket listener_ = kNoSocket;
+    uint16_t port_ = 0;
+    std::thread acceptor_;
+    std::atomic<bool> stopped_{ false };
+    std::atomic<uint64_t> requests_{ 0 };
+    std::atomic<uint64_t> connections_{ 0 };
+    std::mutex lock_;
+    std::vector<StubSocket> clients_;
+    std::vector<std::thread> workers_;
+    // AuthResult calls so far, by request body (it carries the user name)
+    std::map<std::string, uint32_t> polled_;
+};
+
+// ---------------------------------------------------------------------------
+// Replay
+// ---------------------------------------------------------------------------
+
+enum Phase {
+    PhaseLag = 0,
+    PhasePrefilter,
+    PhaseLookup,
+    PhaseMfa,
+    PhaseTotal,
+    PhaseCount
+};
+
+const char* const kPhaseNames[PhaseCount] = { "lag", "prefilter", "lookup", "mfa", "total" };
+
+struct Options {
+    int concurrency = 8;
+    double rate = 0;
+    bool recorded = false;
+    uint64_t count = 0;
+    uint32_t mfaLatencyMs = 1;
+    uint32_t polls = 0;
+    uint32_t pollIntervalMs = 10;
+    bool mfa = true;
+};
+
+// Latencies of one worker; merged once the run is over
+struct WorkerResults {
+    std::vector<uint64_t> phases[PhaseCount];
+    std::vector<uint64_t> mfaPhases[MfaPhaseCount];
+    uint64_t candidates = 0;
+    uint64_t results[MfaClientNotStarted + 1] = {};
+};
+
+struct Replay {
+    Options options;
+    std::vector<EcbCaptureRecordView> records;
+    uint64_t span = 0;          // recorded duration of one pass, microseconds
+    std::atomic<uint64_t> next{ 0 };
+    Clock::time_point start;
+};
+
+void CollectRecord(void* context, const EcbCaptureRecordView& view) {
+    static_cast<std::vector<EcbCaptureRecordView>*>(context)->push_back(view);
+}
+
+// When request i is due, relative to the start of the run
+uint64_t DueMicros(const Replay& replay, uint64_t i) {
+    if (replay.options.recorded) {
+        const std::vector<EcbCaptureRecordView>& records = replay.records;
+        uint64_t first = records.front().record->offsetMicros;
+        return (i / records.size()) * replay.span + records[i % records.size()].record->offsetMicros - first;
+    }
+    if (replay.options.rate > 0)
+        return (uint64_t)((double)i * 1000000.0 / replay.options.rate);
+    return 0;
+}
+
+void RunWorker(Replay* replay, WorkerResults* results) {
+    ReplayEcb ecb;
+    const RADIUS_ATTRIBUTE* found[kLookupCount];
+    bool paced = replay->options.recorded || replay->options.rate > 0;
+    for (;;) {
+        uint64_t i = replay->next.fetch_add(1);
+        if (i >= replay->options.count)
+            return;
+        ecb.Load(replay->records[i % replay->records.size()]);
+
+        Clock::time_point due = replay->start + std::chrono::microseconds(DueMicros(*replay, i));
+        if (paced)
+            std::this_thread::sleep_until(due);
+        Clock::time_point begin = Clock::now();
+        if (!paced)
+            due = begin;
+
+        bool candidate = RadiusIsMfaCandidate(&ecb.ecb) != FALSE;
+        Clock::time_point filtered = Clock::now();
+        Clock::time_point looked = filtered;
+        Clock::time_point end = filtered;
+        if (candidate) {
+            results->candidates++;
+            RadiusFindAttributes(ecb.ecb.GetRequest(&ecb.ecb), kLookupTypes, kLookupCount, found);
+            looked = Clock::now();
+            end = looked;
+            RADIUS_VALUE_VIEW user;
+            char samid[MFA_CLIENT_MAX_USER + 1];
+            if (replay->options.mfa && RadiusViewInit(found[0], &user) && user.cbData > 0 &&
+                RadiusViewCopyString(&user, samid, sizeof(samid)) == NO_ERROR) {
+                MfaClientTiming timing;
+                MfaClientResult result = MfaClientAuthenticate(samid, &timing);
+                end = Clock::now();
+                results->results[result]++;
+                results->phases[PhaseMfa].push_back(MicrosSince(looked, end));
+                for (int phase = 0; phase < MfaPhaseCount; ++phase)
+                    results->mfaPhases[phase].push_back(timing.phaseMicros[phase]);
+            }
+            results->phases[PhaseLookup].push_back(MicrosSince(filtered, looked));
+        }
+        results->phases[PhaseLag].push_back(MicrosSince(due, begin));
+        results->phases[PhasePrefilter].push_back(MicrosSince(begin, filtered));
+        results->phases[PhaseTotal].push_back(MicrosSince(due, end));
+    }
+}
+
+uint64_t Percentile(const std::vector<uint64_t>& sorted, double percentile) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t)(percentile / 100.0 * (double)sorted.size() + 0.5);
+    rank = std::min(std::max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1];
+}
+
+void PrintPhase(const char* name, std::vector<uint64_t>& values) {
+    std::sort(values.begin(), values.end());
+    printf("%-12s %10llu %10llu %10llu %10llu %10llu\n", name, (unsigned long long)values.size(),
+        (unsigned long long)Percentile(values, 50), (unsigned long long)Percentile(values, 95),
+        (unsigned long long)Percentile(values, 99), (unsigned long long)(values.empty() ? 0 : values.back()));
+}
+
+int RunReplay(const Options& options, const std::string& path) {
+    std::vector<uint8_t> data;
+    if (!ReadFile(path, data)) {
+        fprintf(stderr, "%s: cannot be read\n", path.c_str());
+        return 1;
+    }
+    Replay replay;
+    replay.options = options;
+    if (EcbCaptureRead(data.data(), data.size(), &CollectRecord, &replay.records) < 0) {
+        fprintf(stderr, "%s: not an ECB capture file\n", path.c_str());
+        return 1;
+    }
+    if (replay.records.empty()) {
+        fprintf(stderr, "%s: no records\n", path.c_str());
+        return 1;
+    }
+    if (replay.options.count == 0)
+        replay.options.count = replay.records.size();
+    // One pass lasts until the last record plus the average gap, so the next pass does not start in a burst
+    uint64_t first = replay.records.front().record->offsetMicros;
+    uint64_t last = replay.records.back().record->offsetMicros;
+    replay.span = (last - first) + (last - first) / replay.records.size() + 1;
+
+    StubService stub(options.mfaLatencyMs, options.polls);
+    if (options.mfa) {
+        if (!stub.Start()) {
+            fprintf(stderr, "The stub MFA service could not be started.\n");
+            return 1;
+        }
+        MfaClientConfig config;
+        MfaClientDefaultConfig(&config);
+        strcpy(config.host, "127.0.0.1");
+        config.port = stub.port();
+        config.waitBeforePollMs = options.pollIntervalMs;
+        config.pollIntervalMs = options.pollIntervalMs;
+        config.pollCount = options.polls + 1;
+        config.timeoutMs = 10000;
+        config.maxIdleConnections = std::min((uint32_t)options.concurrency, (uint32_t)MFA_CLIENT_MAX_POOL);
+        if (!MfaClientStart(&config)) {
+            fprintf(stderr, "The native MFA client could not be started.\n");
+            return 1;
+        }
+    }
+
+    std::vector<WorkerResults> results((size_t)options.concurrency);
+    std::vector<std::thread> workers;
+    replay.start = Clock::now();
+    for (int i = 0; i < options.concurrency; ++i)
+        workers.emplace_back(&RunWorker, &replay, &results[(size_t)i]);
+    for (std::thread& worker : workers)
+        worker.join();
+    double seconds = (double)MicrosSince(replay.start, Clock::now()) / 1000000.0;
+    if (options.mfa) {
+        MfaClientStop();
+        stub.Stop();
+    }
+
+    WorkerResults merged;
+    for (WorkerResults& worker : results) {
+        for (int phase = 0; phase < PhaseCount; ++phase)
+            merged.phases[phase].insert(merged.phases[phase].end(), worker.phases[phase].begin(), worker.phases[phase].end());
+        for (int phase = 0; phase < MfaPhaseCount; ++phase)
+            merged.mfaPhases[phase].insert(merged.mfaPhases[phase].end(), worker.mfaPhases[phase].begin(), worker.mfaPhases[phase].end());
+        merged.candidates += worker.candidates;
+        for (int result = 0; result <= MfaClientNotStarted; ++result)
+            merged.results[result] += worker.results[result];
+    }
+
+    char pace[64];
+    if (options.recorded)
+        snprintf(pace, sizeof(pace), "recorded pace");
+    else if (options.rate > 0)
+        snprintf(pace, sizeof(pace), "%.0f req/s offered", options.rate);
+    else
+        snprintf(pace, sizeof(pace), "closed loop");
+    printf("Replayed %llu request(s) from %u record(s) in %.3f s: %.0f req/s, concurrency %d, %s\n",
+        (unsigned long long)replay.options.count, (unsigned)replay.records.size(), seconds,
+        seconds > 0 ? (double)replay.options.count / seconds : 0.0, options.concurrency, pace);
+    printf("MFA candidates: %llu\n\n", (unsigned long long)merged.candidates);
+    printf("%-12s %10s %10s %10s %10s %10s\n", "phase (us)", "count", "p50", "p95", "p99", "max");
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        PrintPhase(kPhaseNames[phase], merged.phases[phase]);
+        if (phase == PhaseMfa && !merged.phases[PhaseMfa].empty()) {
+            for (int mfaPhase = 0; mfaPhase < MfaPhaseCount; ++mfaPhase)
+                PrintPhase((std::string("  ") + MfaClientPhaseName((MfaClientPhase)mfaPhase)).c_str(), merged.mfaPhases[mfaPhase]);
+        }
+    }
+    if (options.mfa && !merged.phases[PhaseMfa].empty()) {
+        printf("\nMFA results:");
+        for (int result = 0; result <= MfaClientNotStarted; ++result) {
+            if (merged.results[result] > 0)
+                printf(" %s %llu", MfaClientResultName((MfaClientResult)result), (unsigned long long)merged.results[result]);
+        }
+        printf("\nStub service: %llu HTTP request(s) on %llu connection(s)\n",
+            (unsigned long long)stub.requests(), (unsigned long long)stub.connections());
+    }
+    return merged.results[MfaClientSucceeded] == merged.phases[PhaseMfa].size() ? 0 : 3;
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic capture
+// ---------------------------------------------------------------------------
+
+void AddString(EcbCaptureWriter* writer, uint32_t type, const std::string& value, uint32_t flags = 0) {
+    EcbCaptureAddAttribute(writer, type, rdtString, flags, value.data(), (uint32_t)value.size());
+}
+
+void AddInteger(EcbCaptureWriter* writer, uint32_t type, RADIUS_DATA_TYPE dataType, uint32_t value) {
+    EcbCaptureAddAttribute(writer, type, dataType, 0, &value, sizeof(value));
+}
+
+int Generate(uint64_t count, const std::string& path) {
+    if (!EcbCaptureOpen(path.c_str(), (uint64_t)1 << 34)) {
+        fprintf(stderr, "%s: cannot be created\n", path.c_str());
+        return 1;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        // About 80% accepted Access-Requests, the rest accounting and rejects
+        uint32_t kind = (uint32_t)(i % 10);
+        EcbCaptureWriter writer;
+        if (kind == 8)
+            EcbCaptureBegin(&writer, repAuthorization, rcAccountingRequest, rcAccountingResponse);
+        else if (kind == 9)
+            EcbCaptureBegin(&writer, repAuthorization, rcAccessRequest, rcAccessReject);
+        else
+            EcbCaptureBegin(&writer, repAuthorization, rcAccessRequest, rcAccessAccept);
+        // 1 ms apart, whatever the time it takes to write them
+        ((EcbCaptureRecord*)writer.buffer)->offsetMicros = i * 1000;
+        AddString(&writer, 1, "user" + std::to_string(i % 300));
+        AddString(&writer, 2, "secret");
+        AddInteger(&writer, 4, rdtAddress, 0x0100000Au + (uint32_t)((i % 4) << 24));
+        AddInteger(&writer, 5, rdtInteger, (uint32_t)i);
+        AddString(&writer, 30, "203.0.113.10");
+        AddString(&writer, 31, "198.51.100." + std::to_string(i % 250));
+        for (uint32_t filler = 0; filler < 12; ++filler)
+            AddString(&writer, 26, std::string(24, (char)('a' + filler)));
+        AddInteger(&writer, 265, rdtAddress, 0x0200000Au);
+        AddInteger(&writer, 266, rdtInteger, 1812);
+        AddString(&writer, 270, "VPN");
+        AddString(&writer, 275, "Default");
+        if (kind < 8)
+            AddString(&writer, 25, "grp", ECB_CAPTURE_ATTR_RESPONSE);
+        EcbCaptureCommit(&writer);
+    }
+    EcbCaptureClose();
+    EcbCaptureStats stats = EcbCaptureGetStats();
+    fprintf(stderr, "%llu record(s), %llu bytes written to %s.\n", (unsigned long long)stats.records,
+        (unsigned long long)stats.bytes, path.c_str());
+    return stats.records == count ? 0 : 1;
+}
+
+void Usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--concurrency <n>] [--rate <n> | --recorded] [--count <n>]\n"
+        "       [--mfa-latency <ms>] [--polls <n>] [--poll-interval <ms>] [--no-mfa] <capture file>\n"
+        "       %s --generate <count> <capture file>\n", program, program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+    // The stub service opens its socket before the client initializes Winsock
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    Options options;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--generate" && i + 2 < argc) {
+            uint64_t count = strtoull(argv[i + 1], nullptr, 10);
+            return Generate(count, argv[i + 2]);
+        } else if (arg == "--concurrency" && hasValue) {
+            options.concurrency = atoi(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = atof(argv[++i]);
+        } else if (arg == "--recorded") {
+            options.recorded = true;
+        } else if (arg == "--count" && hasValue) {
+            options.count = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--mfa-latency" && hasValue) {
+            options.mfaLatencyMs = (uint32_t)atoi(argv[++i]);
+        } else if (arg == "--polls" && hasValue) {
+            options.polls = (uint32_t)atoi(argv[++i]);
+        } else if (arg == "--poll-interval" && hasValue) {
+            options.pollIntervalMs = (uint32_t)atoi(argv[++i]);
+        } else if (arg == "--no-mfa") {
+            options.mfa = false;
+        } else if (arg[0] != '-' && path.empty()) {
+            path = arg;
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path.empty() || options.concurrency <= 0 || options.rate < 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+    return RunReplay(options, path);
+}
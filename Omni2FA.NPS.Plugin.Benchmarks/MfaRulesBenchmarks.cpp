@@ -0,0 +1,55 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Benchmarks for the compiled MfaRules evaluation of mfarules.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <benchmark/benchmark.h>
+#include "mfarules.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A site list of the given size: per site a skip rule for the office NAS
+// range and SSID, an MFA rule for its VPN policy at night, and a catch-all
+std::vector<std::string> MakeRules(int sites) {
+    std::vector<std::string> rules;
+    for (int i = 0; i < sites; ++i) {
+        std::string site = std::to_string(i);
+        rules.push_back("Office " + site + ": skip if nas=10." + site + ".0.0/16 & called=*:CORP-WIFI-" + site);
+        rules.push_back("VPN " + site + ": mfa if policy=VPN " + site + ",VPN " + site + " backup & time=Mon-Fri 18:00-08:00");
+    }
+    rules.push_back("Default: mfa");
+    return rules;
+}
+
+void BM_MfaRulesEvaluate(benchmark::State& state) {
+    std::vector<std::string> texts = MakeRules(static_cast<int>(state.range(0)));
+    std::vector<const char*> pointers;
+    for (const std::string& text : texts)
+        pointers.push_back(text.c_str());
+    MfaRuleSet* rules = MfaRulesCompile(pointers.data(), pointers.size(), 1, nullptr, 0);
+    // Matches only the catch-all, after every field has been looked at
+    const char* policy = "VPN 1";
+    const char* called = "00-11-22-33-44-55:GUEST";
+    MfaRuleRequest request = {};
+    request.policy = policy;
+    request.policyLength = strlen(policy);
+    request.calledStationId = called;
+    request.calledStationIdLength = strlen(called);
+    request.nasIp = (10u << 24) | (1u << 16) | 7;
+    request.hasNasIp = true;
+    request.minuteOfWeek = MfaRulesMinuteOfWeek(3, 12, 0);
+    MfaRuleMatch match;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MfaRulesEvaluate(rules, &request, 0, &match));
+    }
+    MfaRulesFree(rules);
+}
+BENCHMARK(BM_MfaRulesEvaluate)->ArgName("sites")->RangeMultiplier(4)->Range(1, 31);
+
+}  // namespace
@@ -0,0 +1,404 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Benchmarks for radutil.cpp attribute lookups
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <benchmark/benchmark.h>
+#include <windows.h>
+#include "radutil.h"
+#include "MockRadiusAttributeArray.h"
+
+namespace {
+
+// Attribute types looked up for every authorization request: User-Name,
+// NAS-IP-Address, Called-Station-Id, Src-IP-Address, Policy-Name and
+// CRP-Policy-Name.
+const DWORD kWantedTypes[] = { 1, 4, 30, 265, 270, 275 };
+
+// Fills the mock with a request of the given size. The wanted attributes are
+// spread through the array the way NPS places them: standard attributes near
+// the front, internal attributes (>= 262) near the end.
+void FillRequest(MockRadiusAttributeArray& mock, int size) {
+    mock.attributes.clear();
+    mock.convertedAttributes.clear();
+    for (int i = 0; i < size; ++i) {
+        TestRadiusAttribute attr = {};
+        attr.dwAttrType = 100 + (i % 60);
+        attr.fDataType = rdtString;
+        mock.attributes.push_back(attr);
+    }
+    int slot = 0;
+    for (DWORD type : kWantedTypes) {
+        int pos = (type < 262) ? slot : size - 1 - slot;
+        if (pos >= 0 && pos < size) {
+            mock.attributes[pos].dwAttrType = type;
+        }
+        ++slot;
+    }
+}
+
+void BM_ScanLookups(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    for (auto _ : state) {
+        for (DWORD type : kWantedTypes) {
+            benchmark::DoNotOptimize(RadiusFindFirstAttribute(pAttrs, type));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (sizeof(kWantedTypes) / sizeof(kWantedTypes[0])));
+}
+BENCHMARK(BM_ScanLookups)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_IndexLookups(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    RADIUS_ATTRIBUTE_INDEX index;
+    for (auto _ : state) {
+        // Includes the cost of building the index, as on the request path.
+        RadiusIndexInit(&index, mock.ToRadiusArray());
+        for (DWORD type : kWantedTypes) {
+            benchmark::DoNotOptimize(RadiusIndexFindFirstAttribute(&index, type));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (sizeof(kWantedTypes) / sizeof(kWantedTypes[0])));
+}
+BENCHMARK(BM_IndexLookups)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_IndexBuild(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, mock.ToRadiusArray());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusIndexBuild(&index));
+    }
+}
+BENCHMARK(BM_IndexBuild)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_IndexLookupsPrebuilt(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, mock.ToRadiusArray());
+    RadiusIndexBuild(&index);
+    for (auto _ : state) {
+        for (DWORD type : kWantedTypes) {
+            benchmark::DoNotOptimize(RadiusIndexFindFirstAttribute(&index, type));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (sizeof(kWantedTypes) / sizeof(kWantedTypes[0])));
+}
+BENCHMARK(BM_IndexLookupsPrebuilt)->Arg(16)->Arg(40)->Arg(80);
+
+// The ten attribute types the adapter request path and trace dump resolve:
+// the six above plus Class, Vendor-Specific, State and NAS-Identifier.
+const DWORD kDumpTypes[] = { 1, 4, 30, 265, 270, 275, 25, 26, 24, 32 };
+const DWORD kDumpTypeCount = sizeof(kDumpTypes) / sizeof(kDumpTypes[0]);
+
+void BM_ScanLookupsTenTypes(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    for (auto _ : state) {
+        for (DWORD type : kDumpTypes) {
+            benchmark::DoNotOptimize(RadiusFindFirstAttribute(pAttrs, type));
+        }
+    }
+}
+BENCHMARK(BM_ScanLookupsTenTypes)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_BatchedLookupsTenTypes(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    const RADIUS_ATTRIBUTE* out[kDumpTypeCount];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusFindAttributes(pAttrs, kDumpTypes, kDumpTypeCount, out));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_BatchedLookupsTenTypes)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_BatchedAllMatchesTenTypes(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    RADIUS_ATTRIBUTE_MATCH matches[64];
+    DWORD found = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusFindAllAttributes(pAttrs, kDumpTypes, kDumpTypeCount, matches, 64, &found));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_BatchedAllMatchesTenTypes)->Arg(16)->Arg(40)->Arg(80);
+
+// ----------------------------------------------------------------------------
+// Scan functions over 4 to 512 attributes with three placements of the probed
+// type. Run with --benchmark_out=<file> --benchmark_out_format=json to keep
+// results for comparing releases.
+// ----------------------------------------------------------------------------
+
+// Class: a type NPS requests often carry, and never one of the filler types.
+const DWORD kProbeType = 25;
+
+enum Layout {
+    // The probed type occurs once, in the middle of the array
+    kLayoutHit = 0,
+    // The probed type does not occur
+    kLayoutMiss,
+    // The probed type fills every other slot of the second half
+    kLayoutDuplicate
+};
+
+const char* const kLayoutNames[] = { "hit", "miss", "duplicate" };
+
+void FillLayout(MockRadiusAttributeArray& mock, int size, int layout) {
+    mock.attributes.clear();
+    mock.convertedAttributes.clear();
+    for (int i = 0; i < size; ++i) {
+        TestRadiusAttribute attr = {};
+        attr.dwAttrType = 100 + (i % 60);
+        attr.fDataType = rdtString;
+        attr.cbDataLength = 8;
+        mock.attributes.push_back(attr);
+    }
+    if (layout == kLayoutHit) {
+        mock.attributes[size / 2].dwAttrType = kProbeType;
+    }
+    else if (layout == kLayoutDuplicate) {
+        for (int i = size / 2; i < size; i += 2) {
+            mock.attributes[i].dwAttrType = kProbeType;
+        }
+    }
+}
+
+void SizesAndLayouts(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "size", "layout" });
+    for (int size = 4; size <= 512; size *= 2) {
+        for (int layout = kLayoutHit; layout <= kLayoutDuplicate; ++layout) {
+            b->Args({ size, layout });
+        }
+    }
+}
+
+void BM_FindFirstIndex(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillLayout(mock, static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusFindFirstIndex(pAttrs, kProbeType));
+    }
+    state.SetLabel(kLayoutNames[state.range(1)]);
+}
+BENCHMARK(BM_FindFirstIndex)->Apply(SizesAndLayouts);
+
+void BM_FindFirstAttribute(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillLayout(mock, static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusFindFirstAttribute(pAttrs, kProbeType));
+    }
+    state.SetLabel(kLayoutNames[state.range(1)]);
+}
+BENCHMARK(BM_FindFirstAttribute)->Apply(SizesAndLayouts);
+
+void BM_ReplaceFirstAttribute(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    int layout = static_cast<int>(state.range(1));
+    FillLayout(mock, static_cast<int>(state.range(0)), layout);
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    const BYTE value[] = { 'S', 'M', 'K', '-', 'R', 'D', 'G' };
+    RADIUS_ATTRIBUTE replacement = {};
+    replacement.dwAttrType = kProbeType;
+    replacement.fDataType = rdtString;
+    replacement.cbDataLength = sizeof(value);
+    replacement.lpValue = value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusReplaceFirstAttribute(pAttrs, &replacement));
+        if (layout == kLayoutMiss) {
+            // A miss appends the attribute; drop it so every iteration misses
+            mock.attributes.pop_back();
+        }
+    }
+    state.SetLabel(kLayoutNames[layout]);
+}
+BENCHMARK(BM_ReplaceFirstAttribute)->Apply(SizesAndLayouts);
+
+// Reply attributes written for an accepted request: Reply-Message,
+// Session-Timeout and Filter-Id upserted, two Class values and a
+// Vendor-Specific appended, stale State values removed
+const BYTE kReplyValue[] = { 'O', 'm', 'n', 'i', '2', 'F', 'A' };
+const RADIUS_EDIT_OPERATION kReplyOperations[] = { raeUpsert, raeUpsert, raeUpsert, raeAppend, raeAppend, raeAppend, raeRemoveAll };
+const DWORD kReplyTypes[] = { 18, 27, 11, 25, 25, 26, 24 };
+const DWORD kReplyEdits = sizeof(kReplyTypes) / sizeof(kReplyTypes[0]);
+
+void MakeReplyEdits(RADIUS_ATTRIBUTE_EDIT* edits) {
+    for (DWORD i = 0; i < kReplyEdits; ++i) {
+        edits[i] = RADIUS_ATTRIBUTE_EDIT();
+        edits[i].eOperation = kReplyOperations[i];
+        edits[i].attr.dwAttrType = kReplyTypes[i];
+        edits[i].attr.fDataType = rdtString;
+        edits[i].attr.cbDataLength = sizeof(kReplyValue);
+        edits[i].attr.lpValue = kReplyValue;
+    }
+}
+
+// The reply edits one call each, removing with a rescan per removed attribute.
+// Restoring the array is part of both loops.
+void BM_ReplyEditsOneByOne(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    std::vector<TestRadiusAttribute> original = mock.attributes;
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    RADIUS_ATTRIBUTE_EDIT edits[kReplyEdits];
+    MakeReplyEdits(edits);
+    for (auto _ : state) {
+        mock.attributes = original;
+        for (const RADIUS_ATTRIBUTE_EDIT& edit : edits) {
+            if (edit.eOperation == raeUpsert) {
+                RadiusReplaceFirstAttribute(pAttrs, &edit.attr);
+            } else if (edit.eOperation == raeAppend) {
+                pAttrs->Add(pAttrs, &edit.attr);
+            } else {
+                DWORD dwIndex;
+                while ((dwIndex = RadiusFindFirstIndex(pAttrs, edit.attr.dwAttrType)) != RADIUS_ATTR_NOT_FOUND) {
+                    pAttrs->RemoveAt(pAttrs, dwIndex);
+                }
+            }
+        }
+        benchmark::DoNotOptimize(mock.attributes.data());
+    }
+}
+BENCHMARK(BM_ReplyEditsOneByOne)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_ReplyEditsBatched(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    std::vector<TestRadiusAttribute> original = mock.attributes;
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    RADIUS_ATTRIBUTE_EDIT edits[kReplyEdits];
+    MakeReplyEdits(edits);
+    for (auto _ : state) {
+        mock.attributes = original;
+        benchmark::DoNotOptimize(RadiusApplyEdits(pAttrs, edits, kReplyEdits));
+    }
+}
+BENCHMARK(BM_ReplyEditsBatched)->Arg(16)->Arg(40)->Arg(80);
+
+// A request with the given number of attributes ending in five Vendor-Specific
+// attributes of three sub-attributes each. The Cisco and Microsoft routing
+// keys are the last sub-attributes of the last two.
+void FillVsaRequest(MockRadiusAttributeArray& mock, int size) {
+    FillRequest(mock, size - 5);
+    RADIUS_VSA_BUILDER builder;
+    RadiusVsaBuilderInit(&builder, mock.ToRadiusArray());
+    const BYTE value[] = { 'r', 'o', 'u', 't', 'e', '=', 'a' };
+    const DWORD vendors[] = { 3902, 3903, 3904, RADIUS_VENDOR_CISCO, RADIUS_VENDOR_MICROSOFT };
+    for (DWORD vendor : vendors) {
+        BYTE last = vendor == RADIUS_VENDOR_CISCO ? 1 : (vendor == RADIUS_VENDOR_MICROSOFT ? 25 : 3);
+        RadiusVsaBuilderAdd(&builder, vendor, 4, value, sizeof(value));
+        RadiusVsaBuilderAdd(&builder, vendor, 5, value, sizeof(value));
+        RadiusVsaBuilderAdd(&builder, vendor, last, value, sizeof(value));
+    }
+    RadiusVsaBuilderFlush(&builder);
+}
+
+// The routing decision: one Microsoft and one Cisco sub-attribute
+void BM_VsaFind(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillVsaRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    RADIUS_VSA_VIEW vsa;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RadiusFindVsa(pAttrs, RADIUS_VENDOR_MICROSOFT, 25, &vsa));
+        benchmark::DoNotOptimize(RadiusFindVsa(pAttrs, RADIUS_VENDOR_CISCO, 1, &vsa));
+    }
+}
+BENCHMARK(BM_VsaFind)->Arg(16)->Arg(40)->Arg(80);
+
+void BM_VsaIndexFind(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillVsaRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    RADIUS_VSA_INDEX index;
+    for (auto _ : state) {
+        RadiusVsaIndexBuild(&index, pAttrs);
+        benchmark::DoNotOptimize(RadiusVsaIndexFind(&index, RADIUS_VENDOR_MICROSOFT, 25));
+        benchmark::DoNotOptimize(RadiusVsaIndexFind(&index, RADIUS_VENDOR_CISCO, 1));
+    }
+}
+BENCHMARK(BM_VsaIndexFind)->Arg(16)->Arg(40)->Arg(80);
+
+// Allocation of a buffer for the given number of attributes
+void BM_AllocFree(benchmark::State& state) {
+    SIZE_T bytes = static_cast<SIZE_T>(state.range(0)) * sizeof(RADIUS_ATTRIBUTE);
+    for (auto _ : state) {
+        LPVOID p = RadiusAlloc(bytes);
+        benchmark::DoNotOptimize(p);
+        RadiusFree(p);
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_AllocFree)->ArgName("size")->RangeMultiplier(2)->Range(4, 512);
+
+// A request worth of attribute values from the request arena: 16 allocations
+// of the given size between RadiusArenaBegin and RadiusArenaEnd
+void BM_ArenaRequest(benchmark::State& state) {
+    SIZE_T bytes = static_cast<SIZE_T>(state.range(0));
+    for (auto _ : state) {
+        RadiusArenaBegin();
+        for (int i = 0; i < 16; ++i) {
+            LPVOID p = RadiusAlloc(bytes);
+            benchmark::DoNotOptimize(p);
+            RadiusFree(p);
+        }
+        RadiusArenaEnd();
+    }
+    state.SetItemsProcessed(state.iterations() * 16);
+}
+BENCHMARK(BM_ArenaRequest)->ArgName("size")->RangeMultiplier(4)->Range(16, 4096);
+
+// The same allocations from the process heap, as outside an arena scope
+void BM_HeapRequest(benchmark::State& state) {
+    SIZE_T bytes = static_cast<SIZE_T>(state.range(0));
+    for (auto _ : state) {
+        for (int i = 0; i < 16; ++i) {
+            LPVOID p = RadiusAlloc(bytes);
+            benchmark::DoNotOptimize(p);
+            RadiusFree(p);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 16);
+}
+BENCHMARK(BM_HeapRequest)->ArgName("size")->RangeMultiplier(4)->Range(16, 4096);
+
+// The native part of RadiusExtensionProcess2 for an accepted Access-Request:
+// the pre-filter check and the attribute lookups of the request path.
+void BM_RequestPath(benchmark::State& state) {
+    MockRadiusAttributeArray mock;
+    FillRequest(mock, static_cast<int>(state.range(0)));
+    PRADIUS_ATTRIBUTE_ARRAY pAttrs = mock.ToRadiusArray();
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb = {};
+    ecb.cbSize = sizeof(ecb);
+    ecb.repPoint = repAuthorization;
+    ecb.rcRequestType = rcAccessRequest;
+    ecb.rcResponseType = rcAccessAccept;
+    const DWORD typeCount = sizeof(kWantedTypes) / sizeof(kWantedTypes[0]);
+    const RADIUS_ATTRIBUTE* out[typeCount];
+    for (auto _ : state) {
+        if (RadiusIsMfaCandidate(&ecb)) {
+            benchmark::DoNotOptimize(RadiusFindAttributes(pAttrs, kWantedTypes, typeCount, out));
+        }
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_RequestPath)->ArgName("size")->RangeMultiplier(2)->Range(4, 512);
+
+}  // namespace
+
+BENCHMARK_MAIN();
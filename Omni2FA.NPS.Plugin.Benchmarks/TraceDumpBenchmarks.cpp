@@ -0,0 +1,122 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Benchmarks for the tracedump.cpp attribute dumps of events 122 and 123
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <benchmark/benchmark.h>
+#include "tracedump.h"
+#include "tracejournal.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint32_t kString = 1;
+const uint32_t kInteger = 3;
+
+struct DumpAttribute {
+    uint32_t type;
+    uint32_t dataType;
+    std::vector<uint8_t> value;
+};
+
+// A PEAP request: a few short strings and integers, then State and EAP-Message
+// fragments of 253 bytes, which dominate the dump
+std::vector<DumpAttribute> MakeRequest(int size) {
+    std::vector<DumpAttribute> attrs;
+    const char* text = "host/client01.example.local";
+    for (int i = 0; i < size; ++i) {
+        DumpAttribute attr;
+        switch (i % 4) {
+        case 0:
+            attr.type = 1;
+            attr.dataType = kString;
+            attr.value.assign(text, text + strlen(text));
+            break;
+        case 1:
+            attr.type = 5;
+            attr.dataType = kInteger;
+            attr.value.assign(4, 7);
+            break;
+        case 2:
+            attr.type = 24;
+            attr.dataType = kString;
+            attr.value.assign(48, 0x9C);
+            break;
+        default:
+            attr.type = 79;
+            attr.dataType = kString;
+            attr.value.resize(253);
+            for (size_t b = 0; b < attr.value.size(); ++b)
+                attr.value[b] = (uint8_t)(b * 7);
+            break;
+        }
+        attrs.push_back(attr);
+    }
+    return attrs;
+}
+
+// The managed path this replaces: one string per attribute from
+// Radius.AttributesToList, Str.sanitize, and s += " | " + item
+std::string DumpLikeManaged(const std::vector<DumpAttribute>& attrs) {
+    std::string s;
+    for (const DumpAttribute& attr : attrs) {
+        const char* name = TraceJournalAttributeName(attr.type);
+        std::string item = name != nullptr ? std::string(name) : std::to_string(attr.type);
+        std::string value;
+        if (attr.dataType == kInteger) {
+            uint32_t dw;
+            memcpy(&dw, attr.value.data(), 4);
+            value = std::to_string(dw);
+        } else {
+            value.assign(attr.value.begin(), attr.value.end());
+        }
+        item = item + ": " + value;
+        if (!item.empty() && item.back() == '\0')
+            item = item.substr(0, item.size() - 1);
+        s = s + " | " + item;
+    }
+    return s;
+}
+
+void BM_DumpManagedLike(benchmark::State& state) {
+    std::vector<DumpAttribute> attrs = MakeRequest(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        std::string s = DumpLikeManaged(attrs);
+        benchmark::DoNotOptimize(s.data());
+    }
+}
+BENCHMARK(BM_DumpManagedLike)->ArgName("size")->RangeMultiplier(4)->Range(8, 128);
+
+void BM_TraceDump(benchmark::State& state) {
+    std::vector<DumpAttribute> attrs = MakeRequest(static_cast<int>(state.range(0)));
+    std::vector<char> buffer(TRACE_DUMP_BUFFER_SIZE);
+    TraceDumpWriter writer;
+    for (auto _ : state) {
+        TraceDumpBegin(&writer, buffer.data(), buffer.size(), TRACE_DUMP_DEFAULT_VALUE_BYTES);
+        for (const DumpAttribute& attr : attrs)
+            TraceDumpAddAttribute(&writer, " | ", attr.type, attr.dataType, attr.value.data(), (uint32_t)attr.value.size());
+        benchmark::DoNotOptimize(TraceDumpText(&writer));
+    }
+}
+BENCHMARK(BM_TraceDump)->ArgName("size")->RangeMultiplier(4)->Range(8, 128);
+
+// The escaping kernel alone on mostly printable text
+void BM_TraceDumpEscape(benchmark::State& state) {
+    std::vector<uint8_t> text(static_cast<size_t>(state.range(0)), 'a');
+    for (size_t i = 0; i < text.size(); i += 97)
+        text[i] = '\t';
+    std::vector<char> out(text.size() * 4);
+    size_t consumed;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(TraceDumpEscape(text.data(), text.size(), out.data(), out.size(), &consumed));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_TraceDumpEscape)->ArgName("size")->RangeMultiplier(4)->Range(64, 4096);
+
+}  // namespace
@@ -0,0 +1,284 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for ecbcapture.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "ecbcapture.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Values of RADIUS_DATA_TYPE from authif.h
+const uint32_t kString = 1;
+const uint32_t kInteger = 3;
+
+std::vector<uint8_t> ReadCaptureFile(const std::string& path) {
+    std::vector<uint8_t> data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return data;
+    uint8_t chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(file);
+    return data;
+}
+
+struct CapturedAttribute {
+    uint32_t type;
+    uint32_t dataType;
+    uint32_t flags;
+    std::string value;
+};
+
+struct CapturedRecord {
+    uint32_t extensionPoint;
+    uint32_t requestType;
+    uint32_t responseType;
+    uint64_t offsetMicros;
+    std::vector<CapturedAttribute> attributes;
+};
+
+void Collect(void* context, const EcbCaptureRecordView& view) {
+    std::vector<CapturedRecord>* records = static_cast<std::vector<CapturedRecord>*>(context);
+    CapturedRecord record;
+    record.extensionPoint = view.record->extensionPoint;
+    record.requestType = view.record->requestType;
+    record.responseType = view.record->responseType;
+    record.offsetMicros = view.record->offsetMicros;
+    const uint8_t* cursor = view.attributes;
+    const uint8_t* value;
+    const EcbCaptureAttribute* attr;
+    while ((attr = EcbCaptureNextAttribute(view, &cursor, &value)) != nullptr)
+        record.attributes.push_back({ attr->type, attr->dataType, attr->flags, std::string((const char*)value, attr->length) });
+    records->push_back(record);
+}
+
+void WriteRequest(const char* user) {
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, 1, 1, 2);
+    EcbCaptureAddAttribute(&writer, 1, kString, 0, user, (uint32_t)strlen(user));
+    EcbCaptureCommit(&writer);
+}
+
+}  // namespace
+
+// Test fixture: each test gets its own capture file
+class EcbCaptureTest : public ::testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = ::testing::TempDir() + "omni2fa_capture_" +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        remove(path.c_str());
+    }
+
+    void TearDown() override {
+        EcbCaptureClose();
+        remove(path.c_str());
+    }
+
+    std::vector<CapturedRecord> ReadAll(int* count = nullptr) {
+        std::vector<uint8_t> data = ReadCaptureFile(path);
+        std::vector<CapturedRecord> records;
+        int read = EcbCaptureRead(data.data(), data.size(), &Collect, &records);
+        if (count != nullptr)
+            *count = read;
+        return records;
+    }
+};
+
+// ============================================================================
+// Open / close
+// ============================================================================
+
+TEST_F(EcbCaptureTest, Open_InvalidParameters_Fails) {
+    EXPECT_FALSE(EcbCaptureOpen(nullptr, 1 << 20));
+    EXPECT_FALSE(EcbCaptureOpen(path.c_str(), 8));
+    EXPECT_FALSE(EcbCaptureIsOpen());
+}
+
+TEST_F(EcbCaptureTest, Open_Twice_Fails) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    EXPECT_FALSE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    EXPECT_TRUE(EcbCaptureIsOpen());
+}
+
+TEST_F(EcbCaptureTest, Commit_WhenClosed_ReturnsFalse) {
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, 1, 1, 2);
+    EXPECT_FALSE(EcbCaptureCommit(&writer));
+}
+
+TEST_F(EcbCaptureTest, Read_RejectsForeignData) {
+    uint8_t garbage[256] = { 1, 2, 3 };
+    EXPECT_EQ(-1, EcbCaptureRead(garbage, sizeof(garbage), nullptr, nullptr));
+    EXPECT_EQ(-1, EcbCaptureRead(garbage, 8, nullptr, nullptr));
+}
+
+// ============================================================================
+// Round trip
+// ============================================================================
+
+TEST_F(EcbCaptureTest, RoundTrip_KeepsTypesAndAttributes) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, 1, 1, 2);
+    const char user[] = "alice";
+    uint32_t port = 1812;
+    const char classValue[] = "grp";
+    EcbCaptureAddAttribute(&writer, 1, kString, 0, user, sizeof(user) - 1);
+    EcbCaptureAddAttribute(&writer, 266, kInteger, 0, &port, sizeof(port));
+    EcbCaptureAddAttribute(&writer, 25, kString, ECB_CAPTURE_ATTR_RESPONSE, classValue, sizeof(classValue) - 1);
+    ASSERT_TRUE(EcbCaptureCommit(&writer));
+    EcbCaptureClose();
+
+    int count = 0;
+    std::vector<CapturedRecord> records = ReadAll(&count);
+    ASSERT_EQ(1, count);
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ(1u, records[0].extensionPoint);
+    EXPECT_EQ(1u, records[0].requestType);
+    EXPECT_EQ(2u, records[0].responseType);
+    ASSERT_EQ(3u, records[0].attributes.size());
+    EXPECT_EQ(1u, records[0].attributes[0].type);
+    EXPECT_EQ("alice", records[0].attributes[0].value);
+    EXPECT_EQ(kInteger, records[0].attributes[1].dataType);
+    EXPECT_EQ(std::string((const char*)&port, 4), records[0].attributes[1].value);
+    EXPECT_EQ((uint32_t)ECB_CAPTURE_ATTR_RESPONSE, records[0].attributes[2].flags);
+    EXPECT_EQ("grp", records[0].attributes[2].value);
+}
+
+TEST_F(EcbCaptureTest, RoundTrip_OffsetsGrow) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    WriteRequest("alice");
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    WriteRequest("bob");
+    EcbCaptureClose();
+
+    std::vector<CapturedRecord> records = ReadAll();
+    ASSERT_EQ(2u, records.size());
+    EXPECT_GE(records[1].offsetMicros, records[0].offsetMicros + 4000);
+}
+
+TEST_F(EcbCaptureTest, AddAttribute_RedactsPasswords) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, 1, 1, 2);
+    const char password[] = "hunter2";
+    EcbCaptureAddAttribute(&writer, 2, kString, 0, password, sizeof(password) - 1);
+    ASSERT_TRUE(EcbCaptureCommit(&writer));
+    EcbCaptureClose();
+
+    std::vector<CapturedRecord> records = ReadAll();
+    ASSERT_EQ(1u, records.size());
+    ASSERT_EQ(1u, records[0].attributes.size());
+    EXPECT_EQ((uint32_t)ECB_CAPTURE_ATTR_REDACTED, records[0].attributes[0].flags);
+    EXPECT_TRUE(records[0].attributes[0].value.empty());
+}
+
+TEST_F(EcbCaptureTest, AddAttribute_TruncatesLongValues) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, 1, 1, 2);
+    std::string longValue(ECB_CAPTURE_MAX_VALUE + 100, 'x');
+    EcbCaptureAddAttribute(&writer, 79, 6, 0, longValue.data(), (uint32_t)longValue.size());
+    ASSERT_TRUE(EcbCaptureCommit(&writer));
+    EcbCaptureClose();
+
+    std::vector<CapturedRecord> records = ReadAll();
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ((uint32_t)ECB_CAPTURE_ATTR_TRUNCATED, records[0].attributes[0].flags);
+    EXPECT_EQ((size_t)ECB_CAPTURE_MAX_VALUE, records[0].attributes[0].value.size());
+}
+
+// ============================================================================
+// Limits
+// ============================================================================
+
+TEST_F(EcbCaptureTest, Commit_OversizedRecord_IsDroppedWhole) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, 1, 1, 2);
+    std::string value(ECB_CAPTURE_MAX_VALUE, 'x');
+    for (int i = 0; i < 5; ++i)
+        EcbCaptureAddAttribute(&writer, 79, 6, 0, value.data(), (uint32_t)value.size());
+    EXPECT_TRUE(writer.overflow);
+    EXPECT_FALSE(EcbCaptureCommit(&writer));
+    WriteRequest("alice");
+    EcbCaptureClose();
+
+    EcbCaptureStats stats = EcbCaptureGetStats();
+    EXPECT_EQ(1u, stats.records);
+    EXPECT_EQ(1u, stats.dropped);
+    EXPECT_EQ(1u, ReadAll().size());
+}
+
+TEST_F(EcbCaptureTest, Commit_StopsAtSizeLimit) {
+    const uint64_t limit = 1024;
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), limit));
+    for (int i = 0; i < 100; ++i)
+        WriteRequest("alice");
+    EcbCaptureClose();
+
+    EcbCaptureStats stats = EcbCaptureGetStats();
+    EXPECT_GT(stats.records, 0u);
+    EXPECT_EQ(100u, stats.records + stats.dropped);
+    EXPECT_LE(stats.bytes, limit);
+    EXPECT_EQ(stats.bytes, ReadCaptureFile(path).size());
+    EXPECT_EQ(stats.records, ReadAll().size());
+}
+
+TEST_F(EcbCaptureTest, Read_StopsAtTornRecord) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 1 << 20));
+    WriteRequest("alice");
+    WriteRequest("bob");
+    EcbCaptureClose();
+
+    std::vector<uint8_t> data = ReadCaptureFile(path);
+    data.resize(data.size() - 6);
+    std::vector<CapturedRecord> records;
+    EXPECT_EQ(1, EcbCaptureRead(data.data(), data.size(), &Collect, &records));
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ("alice", records[0].attributes[0].value);
+}
+
+// ============================================================================
+// Concurrency
+// ============================================================================
+
+TEST_F(EcbCaptureTest, Commit_FromManyThreads_KeepsRecordsWhole) {
+    ASSERT_TRUE(EcbCaptureOpen(path.c_str(), 16 << 20));
+    const int threads = 8;
+    const int perThread = 500;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([t]() {
+            std::string user = "user" + std::to_string(t);
+            for (int i = 0; i < perThread; ++i)
+                WriteRequest(user.c_str());
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    EcbCaptureClose();
+
+    int count = 0;
+    std::vector<CapturedRecord> records = ReadAll(&count);
+    EXPECT_EQ(threads * perThread, count);
+    for (const CapturedRecord& record : records) {
+        ASSERT_EQ(1u, record.attributes.size());
+        EXPECT_EQ(0u, record.attributes[0].value.find("user"));
+    }
+}
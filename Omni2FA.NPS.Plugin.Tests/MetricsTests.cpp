@@ -0,0 +1,303 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for metrics.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "metrics.h"
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string ReadText(const std::string& path) {
+    std::string text;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return text;
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        text.append(chunk, read);
+    fclose(file);
+    return text;
+}
+
+std::unique_ptr<MetricsSnapshot> Snapshot() {
+    std::unique_ptr<MetricsSnapshot> snapshot(new MetricsSnapshot());
+    MetricsTakeSnapshot(snapshot.get());
+    return snapshot;
+}
+
+std::unique_ptr<MetricsHistogram> HistogramOf(const std::vector<uint64_t>& values) {
+    std::unique_ptr<MetricsHistogram> histogram(new MetricsHistogram());
+    for (uint64_t value : values) {
+        histogram->buckets[MetricsBucketIndex(value)]++;
+        histogram->count++;
+        histogram->sum += value;
+        if (value > histogram->max)
+            histogram->max = value;
+    }
+    return histogram;
+}
+
+}  // namespace
+
+// Test fixture: the metrics are process-wide, so every test starts from zero
+class MetricsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        MetricsReset();
+    }
+
+    void TearDown() override {
+        MetricsExporterStop();
+        MetricsReset();
+    }
+};
+
+// ============================================================================
+// Buckets
+// ============================================================================
+
+TEST_F(MetricsTest, BucketIndex_IsExactBelow64) {
+    for (uint64_t value = 0; value < 64; ++value) {
+        EXPECT_EQ(value, MetricsBucketIndex(value));
+        EXPECT_EQ(value, MetricsBucketUpperBound((uint32_t)value));
+    }
+}
+
+TEST_F(MetricsTest, BucketIndex_ContainsValueWithinThreePercent) {
+    uint32_t previous = 0;
+    for (uint64_t value = 1; value <= METRICS_MAX_VALUE; value = value * 3 / 2 + 1) {
+        uint32_t index = MetricsBucketIndex(value);
+        ASSERT_LT(index, (uint32_t)METRICS_BUCKETS);
+        EXPECT_GE(index, previous);
+        uint64_t upper = MetricsBucketUpperBound(index);
+        EXPECT_GE(upper, value);
+        EXPECT_LE(upper - value, value / 32 + 1);
+        if (index > 0) {
+            EXPECT_LT(MetricsBucketUpperBound(index - 1), value);
+        }
+        previous = index;
+    }
+}
+
+TEST_F(MetricsTest, BucketIndex_ClampsLargeValues) {
+    EXPECT_EQ((uint32_t)METRICS_BUCKETS - 1, MetricsBucketIndex(METRICS_MAX_VALUE));
+    EXPECT_EQ((uint32_t)METRICS_BUCKETS - 1, MetricsBucketIndex(~0ull));
+    EXPECT_EQ(METRICS_MAX_VALUE, MetricsBucketUpperBound(METRICS_BUCKETS - 1));
+}
+
+// ============================================================================
+// Percentiles
+// ============================================================================
+
+TEST_F(MetricsTest, Percentile_EmptyHistogram_IsZero) {
+    std::unique_ptr<MetricsHistogram> histogram = HistogramOf({});
+    EXPECT_EQ(0u, MetricsValueAtPercentile(*histogram, 50));
+}
+
+TEST_F(MetricsTest, Percentile_UniformValues) {
+    std::vector<uint64_t> values;
+    for (uint64_t i = 1; i <= 1000; ++i)
+        values.push_back(i * 100);
+    std::unique_ptr<MetricsHistogram> histogram = HistogramOf(values);
+
+    uint64_t p50 = MetricsValueAtPercentile(*histogram, 50);
+    uint64_t p99 = MetricsValueAtPercentile(*histogram, 99);
+    EXPECT_GE(p50, 50000u);
+    EXPECT_LE(p50, 50000u + 50000u / 32);
+    EXPECT_GE(p99, 99000u);
+    EXPECT_LE(p99, 99000u + 99000u / 32);
+    EXPECT_EQ(100000u, MetricsValueAtPercentile(*histogram, 100));
+}
+
+TEST_F(MetricsTest, Percentile_IsCappedAtMax) {
+    std::unique_ptr<MetricsHistogram> histogram = HistogramOf({ 1000, 1000, 1000 });
+    EXPECT_EQ(1000u, MetricsValueAtPercentile(*histogram, 99.9));
+}
+
+// ============================================================================
+// Recording and snapshots
+// ============================================================================
+
+TEST_F(MetricsTest, Record_AddsToSnapshot) {
+    MetricsRecord(MetricsPhaseLookup, 10);
+    MetricsRecord(MetricsPhaseLookup, 30);
+    MetricsRecord(MetricsPhaseAuthenticate, 250000);
+    MetricsIncrement(MetricsCounterMfaSucceeded);
+
+    std::unique_ptr<MetricsSnapshot> snapshot = Snapshot();
+    EXPECT_EQ(2u, snapshot->phases[MetricsPhaseLookup].count);
+    EXPECT_EQ(40u, snapshot->phases[MetricsPhaseLookup].sum);
+    EXPECT_EQ(30u, snapshot->phases[MetricsPhaseLookup].max);
+    EXPECT_EQ(1u, snapshot->phases[MetricsPhaseAuthenticate].count);
+    EXPECT_EQ(0u, snapshot->phases[MetricsPhaseProcess].count);
+    EXPECT_EQ(1u, snapshot->counters[MetricsCounterMfaSucceeded]);
+    EXPECT_GE(snapshot->shards, 1u);
+}
+
+TEST_F(MetricsTest, Record_IgnoresUnknownPhasesAndCounters) {
+    MetricsRecord(-1, 10);
+    MetricsRecord(MetricsPhaseCount, 10);
+    MetricsIncrement(MetricsCounterCount);
+
+    std::unique_ptr<MetricsSnapshot> snapshot = Snapshot();
+    for (int p = 0; p < MetricsPhaseCount; ++p)
+        EXPECT_EQ(0u, snapshot->phases[p].count);
+    for (int c = 0; c < MetricsCounterCount; ++c)
+        EXPECT_EQ(0u, snapshot->counters[c]);
+}
+
+TEST_F(MetricsTest, RecordSince_MeasuresElapsedTime) {
+    uint64_t start = MetricsNowMicros();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    MetricsRecordSince(MetricsPhaseGroups, start);
+
+    std::unique_ptr<MetricsSnapshot> snapshot = Snapshot();
+    EXPECT_EQ(1u, snapshot->phases[MetricsPhaseGroups].count);
+    EXPECT_GE(snapshot->phases[MetricsPhaseGroups].max, 4000u);
+}
+
+TEST_F(MetricsTest, Record_FromManyThreads_LosesNothing) {
+    const int threads = 8;
+    const int perThread = 20000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([t]() {
+            for (int i = 0; i < perThread; ++i) {
+                MetricsRecord(MetricsPhaseProcess, (uint64_t)(i % 500));
+                MetricsIncrement(MetricsCounterShortCircuited);
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    std::unique_ptr<MetricsSnapshot> snapshot = Snapshot();
+    const MetricsHistogram& process = snapshot->phases[MetricsPhaseProcess];
+    EXPECT_EQ((uint64_t)threads * perThread, process.count);
+    uint64_t inBuckets = 0;
+    for (uint32_t i = 0; i < METRICS_BUCKETS; ++i)
+        inBuckets += process.buckets[i];
+    EXPECT_EQ(process.count, inBuckets);
+    EXPECT_EQ(499u, process.max);
+    EXPECT_EQ((uint64_t)threads * perThread, snapshot->counters[MetricsCounterShortCircuited]);
+}
+
+TEST_F(MetricsTest, Shards_AreReusedByLaterThreads) {
+    for (int round = 0; round < 4; ++round)
+        std::thread([]() { MetricsRecord(MetricsPhaseInit, 1); }).join();
+    uint32_t shards = Snapshot()->shards;
+    for (int round = 0; round < 16; ++round)
+        std::thread([]() { MetricsRecord(MetricsPhaseInit, 1); }).join();
+
+    std::unique_ptr<MetricsSnapshot> snapshot = Snapshot();
+    EXPECT_EQ(shards, snapshot->shards);
+    EXPECT_EQ(20u, snapshot->phases[MetricsPhaseInit].count);
+}
+
+TEST_F(MetricsTest, Delta_CoversOnlyTheInterval) {
+    MetricsRecord(MetricsPhaseAuthResult, 90000);
+    MetricsIncrement(MetricsCounterMfaFailed);
+    std::unique_ptr<MetricsSnapshot> before = Snapshot();
+    MetricsRecord(MetricsPhaseAuthResult, 100);
+    MetricsRecord(MetricsPhaseAuthResult, 200);
+    std::unique_ptr<MetricsSnapshot> now = Snapshot();
+
+    std::unique_ptr<MetricsSnapshot> delta(new MetricsSnapshot());
+    MetricsDelta(*now, *before, delta.get());
+    const MetricsHistogram& polls = delta->phases[MetricsPhaseAuthResult];
+    EXPECT_EQ(2u, polls.count);
+    EXPECT_EQ(300u, polls.sum);
+    EXPECT_GE(polls.max, 200u);
+    EXPECT_LE(polls.max, 200u + 200u / 32);
+    EXPECT_EQ(0u, delta->counters[MetricsCounterMfaFailed]);
+}
+
+TEST_F(MetricsTest, Gauges_KeepTheLastValue) {
+    MetricsSetGauge(MetricsGaugeMfaBreakerState, 1);
+    std::unique_ptr<MetricsSnapshot> before = Snapshot();
+    MetricsSetGauge(MetricsGaugeMfaBreakerState, 2);
+    MetricsSetGauge(MetricsGaugeCount, 5);
+    std::unique_ptr<MetricsSnapshot> now = Snapshot();
+
+    std::unique_ptr<MetricsSnapshot> delta(new MetricsSnapshot());
+    MetricsDelta(*now, *before, delta.get());
+    EXPECT_EQ(1, before->gauges[MetricsGaugeMfaBreakerState]);
+    EXPECT_EQ(2, delta->gauges[MetricsGaugeMfaBreakerState]);
+    EXPECT_NE(std::string::npos, MetricsFormatPrometheus(*now).find("omni2fa_mfa_breaker_state 2\n"));
+
+    MetricsReset();
+    EXPECT_EQ(0, Snapshot()->gauges[MetricsGaugeMfaBreakerState]);
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+TEST_F(MetricsTest, FormatPrometheus_ListsEveryPhaseAndCounter) {
+    MetricsRecord(MetricsPhaseProcess, 85);
+    MetricsIncrement(MetricsCounterShortCircuited);
+    std::string text = MetricsFormatPrometheus(*Snapshot());
+
+    EXPECT_NE(std::string::npos, text.find("# TYPE omni2fa_phase_latency_microseconds summary\n"));
+    EXPECT_NE(std::string::npos, text.find("omni2fa_phase_latency_microseconds{phase=\"process\",quantile=\"0.5\"} 85\n"));
+    EXPECT_NE(std::string::npos, text.find("omni2fa_phase_latency_microseconds_count{phase=\"process\"} 1\n"));
+    EXPECT_NE(std::string::npos, text.find("omni2fa_phase_latency_microseconds_count{phase=\"auth_result\"} 0\n"));
+    EXPECT_NE(std::string::npos, text.find("omni2fa_events_total{event=\"short_circuited\"} 1\n"));
+    EXPECT_NE(std::string::npos, text.find("omni2fa_events_total{event=\"mfa_failed\"} 0\n"));
+}
+
+TEST_F(MetricsTest, FormatSummary_SkipsPhasesWithoutSamples) {
+    EXPECT_EQ("", MetricsFormatSummary(*Snapshot()));
+
+    MetricsRecord(MetricsPhaseAuthenticate, 1500);
+    std::string summary = MetricsFormatSummary(*Snapshot());
+    EXPECT_NE(std::string::npos, summary.find("authenticate: 1 samples"));
+    EXPECT_EQ(std::string::npos, summary.find("lookup:"));
+    EXPECT_NE(std::string::npos, summary.find("MFA succeeded 0"));
+}
+
+TEST_F(MetricsTest, WriteSnapshotFile_ReplacesTheFile) {
+    std::string path = ::testing::TempDir() + "omni2fa_metrics.prom";
+    remove(path.c_str());
+    MetricsRecord(MetricsPhaseLookup, 7);
+    ASSERT_TRUE(MetricsWriteSnapshotFile(path.c_str(), *Snapshot()));
+    MetricsRecord(MetricsPhaseLookup, 7);
+    ASSERT_TRUE(MetricsWriteSnapshotFile(path.c_str(), *Snapshot()));
+
+    std::string text = ReadText(path);
+    EXPECT_NE(std::string::npos, text.find("omni2fa_phase_latency_microseconds_count{phase=\"lookup\"} 2\n"));
+    EXPECT_EQ("", ReadText(path + ".tmp"));
+    remove(path.c_str());
+}
+
+TEST_F(MetricsTest, WriteSnapshotFile_MissingDirectory_Fails) {
+    std::string path = ::testing::TempDir() + "omni2fa_no_such_dir/metrics.prom";
+    EXPECT_FALSE(MetricsWriteSnapshotFile(path.c_str(), *Snapshot()));
+    EXPECT_FALSE(MetricsWriteSnapshotFile(nullptr, *Snapshot()));
+}
+
+TEST_F(MetricsTest, Exporter_WritesSnapshotPeriodicallyAndOnStop) {
+    std::string path = ::testing::TempDir() + "omni2fa_metrics_exporter.prom";
+    remove(path.c_str());
+    ASSERT_TRUE(MetricsExporterStart(path.c_str(), 10, 0));
+    EXPECT_FALSE(MetricsExporterStart(path.c_str(), 10, 0));
+    for (int i = 0; i < 200 && ReadText(path).empty(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_NE("", ReadText(path));
+
+    MetricsRecord(MetricsPhaseInit, 42);
+    MetricsExporterStop();
+    EXPECT_NE(std::string::npos, ReadText(path).find("omni2fa_phase_latency_microseconds_count{phase=\"init\"} 1\n"));
+    remove(path.c_str());
+}
@@ -0,0 +1,227 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for mfabreaker.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "mfabreaker.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Transition {
+    MfaBreakerState from;
+    MfaBreakerState to;
+    MfaBreakerStats stats;
+};
+
+void RecordTransition(MfaBreakerState from, MfaBreakerState to, const MfaBreakerStats* stats, void* context) {
+    static_cast<std::vector<Transition>*>(context)->push_back({ from, to, *stats });
+}
+
+void Sleep(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class MfaBreakerTest : public ::testing::Test {
+protected:
+    MfaBreakerConfig config;
+    std::vector<Transition> transitions;
+
+    void SetUp() override {
+        MfaBreakerReset();
+        MfaBreakerSetListener(&RecordTransition, &transitions);
+        MfaBreakerDefaultConfig(&config);
+        config.failurePercent = 50;
+        config.minRequests = 4;
+        config.windowMs = 10000;
+        config.slowMs = 100;
+        config.openMs = 50;
+        config.probeTimeoutMs = 10000;
+    }
+
+    void TearDown() override {
+        MfaBreakerSetListener(nullptr, nullptr);
+        MfaBreakerReset();
+    }
+
+    void Record(int succeeded, int failed) {
+        for (int i = 0; i < succeeded; ++i)
+            MfaBreakerRecord(false, 1000);
+        for (int i = 0; i < failed; ++i)
+            MfaBreakerRecord(true, 1000);
+    }
+};
+
+}  // namespace
+
+TEST_F(MfaBreakerTest, DisabledBreakerAllowsEverything) {
+    config.failurePercent = 0;
+    MfaBreakerConfigure(&config);
+    Record(0, 20);
+
+    EXPECT_TRUE(MfaBreakerAllow());
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_EQ(0u, MfaBreakerGetStats().requests);
+    EXPECT_TRUE(transitions.empty());
+}
+
+TEST_F(MfaBreakerTest, OpensOnceMinRequestsReachTheThreshold) {
+    MfaBreakerConfigure(&config);
+    Record(0, 3);
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_EQ(3u, MfaBreakerGetStats().failures);
+
+    Record(0, 1);
+
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+    EXPECT_FALSE(MfaBreakerAllow());
+    EXPECT_FALSE(MfaBreakerAllow());
+    MfaBreakerStats stats = MfaBreakerGetStats();
+    EXPECT_EQ(1u, stats.opened);
+    EXPECT_EQ(2u, stats.rejected);
+    ASSERT_EQ(1u, transitions.size());
+    EXPECT_EQ(MfaBreakerClosed, transitions[0].from);
+    EXPECT_EQ(MfaBreakerOpen, transitions[0].to);
+    EXPECT_EQ(4u, transitions[0].stats.requests);
+    EXPECT_EQ(4u, transitions[0].stats.failures);
+}
+
+TEST_F(MfaBreakerTest, StaysClosedBelowTheThreshold) {
+    MfaBreakerConfigure(&config);
+    Record(6, 5);
+
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_TRUE(MfaBreakerAllow());
+    EXPECT_EQ(11u, MfaBreakerGetStats().requests);
+}
+
+TEST_F(MfaBreakerTest, SlowCallsCountAsFailures) {
+    MfaBreakerConfigure(&config);
+    Record(2, 0);
+    MfaBreakerRecord(false, 150000);
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    MfaBreakerRecord(false, 500000);
+
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+    ASSERT_EQ(1u, transitions.size());
+    EXPECT_EQ(0u, transitions[0].stats.failures);
+    EXPECT_EQ(2u, transitions[0].stats.slow);
+}
+
+TEST_F(MfaBreakerTest, OldOutcomesLeaveTheWindow) {
+    config.windowMs = 100;
+    MfaBreakerConfigure(&config);
+    Record(0, 3);
+    Sleep(150);
+    Record(1, 1);
+
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_EQ(2u, MfaBreakerGetStats().requests);
+}
+
+TEST_F(MfaBreakerTest, HalfOpenLetsOneProbeThroughAndClosesOnSuccess) {
+    MfaBreakerConfigure(&config);
+    Record(0, 4);
+    Sleep(80);
+
+    EXPECT_TRUE(MfaBreakerAllow());
+    EXPECT_EQ(MfaBreakerHalfOpen, MfaBreakerGetState());
+    EXPECT_FALSE(MfaBreakerAllow());
+    MfaBreakerRecord(false, 1000);
+
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_TRUE(MfaBreakerAllow());
+    EXPECT_TRUE(MfaBreakerAllow());
+    MfaBreakerStats stats = MfaBreakerGetStats();
+    EXPECT_EQ(1u, stats.probes);
+    EXPECT_EQ(0u, stats.requests);
+    ASSERT_EQ(3u, transitions.size());
+    EXPECT_EQ(MfaBreakerHalfOpen, transitions[1].to);
+    EXPECT_EQ(MfaBreakerHalfOpen, transitions[2].from);
+    EXPECT_EQ(MfaBreakerClosed, transitions[2].to);
+}
+
+TEST_F(MfaBreakerTest, FailedOrSlowProbeOpensAgain) {
+    MfaBreakerConfigure(&config);
+    Record(0, 4);
+    Sleep(80);
+    ASSERT_TRUE(MfaBreakerAllow());
+    MfaBreakerRecord(true, 1000);
+
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+    EXPECT_FALSE(MfaBreakerAllow());
+
+    Sleep(80);
+    ASSERT_TRUE(MfaBreakerAllow());
+    MfaBreakerRecord(false, 500000);
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+    EXPECT_EQ(3u, MfaBreakerGetStats().opened);
+}
+
+TEST_F(MfaBreakerTest, LostProbeIsReplacedAfterProbeTimeout) {
+    config.probeTimeoutMs = 50;
+    MfaBreakerConfigure(&config);
+    Record(0, 4);
+    Sleep(80);
+    ASSERT_TRUE(MfaBreakerAllow());
+    EXPECT_FALSE(MfaBreakerAllow());
+
+    Sleep(80);
+
+    EXPECT_TRUE(MfaBreakerAllow());
+    EXPECT_EQ(MfaBreakerHalfOpen, MfaBreakerGetState());
+    EXPECT_EQ(2u, MfaBreakerGetStats().probes);
+}
+
+TEST_F(MfaBreakerTest, CallsFromBeforeTheTripAreIgnoredWhileOpen) {
+    MfaBreakerConfigure(&config);
+    Record(0, 4);
+    Record(10, 0);
+
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+    EXPECT_EQ(0u, MfaBreakerGetStats().requests);
+}
+
+TEST_F(MfaBreakerTest, ReconfiguringKeepsStateUnlessSettingsChange) {
+    MfaBreakerConfigure(&config);
+    Record(0, 4);
+    MfaBreakerConfigure(&config);
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+
+    config.openMs = 60000;
+    MfaBreakerConfigure(&config);
+
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_TRUE(MfaBreakerAllow());
+    ASSERT_EQ(2u, transitions.size());
+    EXPECT_EQ(MfaBreakerClosed, transitions[1].to);
+}
+
+TEST_F(MfaBreakerTest, ConcurrentCallersSeeOneProbe) {
+    MfaBreakerConfigure(&config);
+    Record(0, 4);
+    Sleep(80);
+
+    std::atomic<int> allowed(0);
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 8; ++t) {
+        callers.emplace_back([&allowed] {
+            for (int i = 0; i < 100; ++i) {
+                if (MfaBreakerAllow())
+                    ++allowed;
+            }
+        });
+    }
+    for (std::thread& caller : callers)
+        caller.join();
+
+    EXPECT_EQ(1, allowed.load());
+    EXPECT_EQ(799u, MfaBreakerGetStats().rejected);
+}
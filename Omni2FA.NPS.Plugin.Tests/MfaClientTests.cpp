@@ -0,0 +1,958 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for mfaclient.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "mfaclient.h"
+#include "mfabreaker.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET TestSocket;
+const TestSocket kNoSocket = INVALID_SOCKET;
+const int kSendFlags = 0;
+void CloseTestSocket(TestSocket s) { closesocket(s); }
+void ShutdownTestSocket(TestSocket s) { shutdown(s, SD_BOTH); }
+
+// The stub server opens sockets before the client has initialized Winsock
+struct WinsockInit {
+    WinsockInit() {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    }
+} g_winsock;
+#else
+typedef int TestSocket;
+const TestSocket kNoSocket = -1;
+// The client may already have given up on a response the stub is still sending
+const int kSendFlags = MSG_NOSIGNAL;
+void CloseTestSocket(TestSocket s) { close(s); }
+void ShutdownTestSocket(TestSocket s) { shutdown(s, SHUT_RDWR); }
+#endif
+
+struct StubRequest {
+    std::string path;
+    std::string headers;
+    std::string body;
+    int connection;
+};
+
+// Answer of the stub: raw HTTP bytes, and whether to close the connection afterwards
+struct StubResponse {
+    std::string raw;
+    bool close;
+};
+
+StubResponse Json(const std::string& body, int httpStatus = 200, bool close = false) {
+    std::string raw = "HTTP/1.1 " + std::to_string(httpStatus) + (httpStatus == 200 ? " OK" : " Error") + "\r\n" +
+        "Content-Type: application/json; charset=utf-8\r\n" +
+        "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+        (close ? "Connection: close\r\n" : "") + "\r\n" + body;
+    return { raw, close };
+}
+
+StubResponse Status(int status) {
+    return Json("{\"status\":" + std::to_string(status) + ",\"message\":\"\"}");
+}
+
+// Minimal HTTP/1.1 server on 127.0.0.1 standing in for the MFA service.
+// Every connection is served by its own thread until either side closes it.
+class StubServer {
+public:
+    typedef std::function<StubResponse(const StubRequest&)> Handler;
+
+    explicit StubServer(Handler handler) : handler_(handler) {
+        listener_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        int reuse = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        bind(listener_, (sockaddr*)&address, sizeof(address));
+        listen(listener_, 64);
+        socklen_t length = sizeof(address);
+        getsockname(listener_, (sockaddr*)&address, &length);
+        port_ = ntohs(address.sin_port);
+        acceptor_ = std::thread([this] { AcceptLoop(); });
+    }
+
+    ~StubServer() { Stop(); }
+
+    void Stop() {
+        if (stopped_.exchange(true))
+            return;
+        ShutdownTestSocket(listener_);
+        CloseTestSocket(listener_);
+        acceptor_.join();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            for (TestSocket client : clients_)
+                ShutdownTestSocket(client);
+        }
+        for (std::thread& worker : workers_)
+            worker.join();
+    }
+
+    uint16_t port() const { return port_; }
+    int connections() const { return connections_.load(); }
+
+    // Connections are counted by the accept loop, which may lag behind the client that opened
+    // them; waits until at least expected are counted (or a deadline) and returns the count
+    int waitForConnections(int expected, int timeoutMs = 2000) const {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (connections_.load() < expected && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return connections_.load();
+    }
+
+    std::vector<StubRequest> requests() {
+        std::lock_guard<std::mutex> guard(lock_);
+        return requests_;
+    }
+
+private:
+    void AcceptLoop() {
+        for (;;) {
+            TestSocket client = accept(listener_, nullptr, nullptr);
+            if (client == kNoSocket || stopped_.load()) {
+                if (client != kNoSocket)
+                    CloseTestSocket(client);
+                return;
+            }
+            int id = ++connections_;
+            std::lock_guard<std::mutex> guard(lock_);
+            clients_.push_back(client);
+            workers_.emplace_back([this, client, id] { Serve(client, id); });
+        }
+    }
+
+    void Serve(TestSocket client, int id) {
+        std::string pending;
+        char buffer[4096];
+        for (;;) {
+            size_t headerEnd;
+            while ((headerEnd = pending.find("\r\n\r\n")) == std::string::npos) {
+                int received = (int)recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    Disconnect(client);
+                    return;
+                }
+                pending.append(buffer, (size_t)received);
+            }
+            StubRequest request;
+            request.connection = id;
+            request.headers = pending.substr(0, headerEnd + 4);
+            size_t pathStart = request.headers.find(' ') + 1;
+            request.path = request.headers.substr(pathStart, request.headers.find(' ', pathStart) - pathStart);
+            size_t contentLength = 0;
+            size_t lengthAt = request.headers.find("Content-Length: ");
+            if (lengthAt != std::string::npos)
+                contentLength = (size_t)atoi(request.headers.c_str() + lengthAt + 16);
+            pending.erase(0, headerEnd + 4);
+            while (pending.size() < contentLength) {
+                int received = (int)recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    Disconnect(client);
+                    return;
+                }
+                pending.append(buffer, (size_t)received);
+            }
+            request.body = pending.substr(0, contentLength);
+            pending.erase(0, contentLength);
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                requests_.push_back(request);
+            }
+            StubResponse response = handler_(request);
+            send(client, response.raw.data(), (int)response.raw.size(), kSendFlags);
+            if (response.close) {
+                ShutdownTestSocket(client);
+                Disconnect(client);
+                return;
+            }
+        }
+    }
+
+    // Forgets the socket before closing it, so Stop never shuts down a reused handle
+    void Disconnect(TestSocket client) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            for (size_t i = 0; i < clients_.size(); ++i) {
+                if (clients_[i] == client) {
+                    clients_.erase(clients_.begin() + i);
+                    break;
+                }
+            }
+        }
+        CloseTestSocket(client);
+    }
+
+    Handler handler_;
+    TestSocket listener_;
+    uint16_t port_ = 0;
+    std::thread acceptor_;
+    std::atomic<bool> stopped_{ false };
+    std::atomic<int> connections_{ 0 };
+    std::mutex lock_;
+    std::vector<TestSocket> clients_;
+    std::vector<std::thread> workers_;
+    std::vector<StubRequest> requests_;
+};
+
+MfaResponseParser Parse(const std::string& response, MfaResponseState* state, size_t* consumed = nullptr) {
+    MfaResponseParser parser;
+    MfaResponseParserInit(&parser);
+    size_t used = 0;
+    *state = MfaResponseParserFeed(&parser, response.data(), response.size(), &used);
+    if (consumed != nullptr)
+        *consumed = used;
+    return parser;
+}
+
+// Feeds the response one byte at a time, as if every byte arrived in its own recv
+MfaResponseParser ParseBytewise(const std::string& response, MfaResponseState* state) {
+    MfaResponseParser parser;
+    MfaResponseParserInit(&parser);
+    *state = MfaResponseNeedMore;
+    for (size_t i = 0; i < response.size() && *state == MfaResponseNeedMore; ++i)
+        *state = MfaResponseParserFeed(&parser, response.data() + i, 1, nullptr);
+    return parser;
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Response parser
+// ---------------------------------------------------------------------------
+
+TEST(MfaResponseParserTest, ParsesContentLengthResponse) {
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 29\r\n\r\n"
+        "{\"status\":1,\"message\":\"ok\"}  ";
+    MfaResponseState state;
+    size_t consumed;
+    MfaResponseParser parser = Parse(response, &state, &consumed);
+
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_EQ(response.size(), consumed);
+    EXPECT_EQ(200u, parser.httpStatus);
+    EXPECT_TRUE(parser.hasStatus);
+    EXPECT_EQ(1, parser.status);
+    EXPECT_TRUE(parser.keepAlive);
+}
+
+TEST(MfaResponseParserTest, ByteAtATimeGivesSameResult) {
+    std::string response = "HTTP/1.1 200 OK\r\ncontent-LENGTH:  13\r\nX-Other: status\r\n\r\n{\"status\":-1}";
+    MfaResponseState state;
+    MfaResponseParser parser = ParseBytewise(response, &state);
+
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_TRUE(parser.hasStatus);
+    EXPECT_EQ(-1, parser.status);
+}
+
+TEST(MfaResponseParserTest, ParsesChunkedBodySplitInsideTheNumber) {
+    std::string response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "b\r\n{\"status\":1\r\n"
+        "3;ext=1\r\n23}\r\n"
+        "0\r\nX-Trailer: yes\r\n\r\n";
+    MfaResponseState state;
+    size_t consumed;
+    MfaResponseParser parser = Parse(response, &state, &consumed);
+
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_EQ(response.size(), consumed);
+    EXPECT_EQ(123, parser.status);
+    EXPECT_TRUE(parser.keepAlive);
+
+    parser = ParseBytewise(response, &state);
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_EQ(123, parser.status);
+}
+
+TEST(MfaResponseParserTest, OnlyMatchesTopLevelStatusKey) {
+    std::string body = "{\"message\":\"\\\"status\\\":1\",\"details\":{\"status\":1},\"list\":[{\"status\":1}],\"Status\" : 0}";
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    MfaResponseState state;
+    MfaResponseParser parser = Parse(response, &state);
+
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_TRUE(parser.hasStatus);
+    EXPECT_EQ(0, parser.status);
+}
+
+TEST(MfaResponseParserTest, MissingStatusIsReported) {
+    MfaResponseState state;
+    MfaResponseParser parser = Parse("HTTP/1.1 200 OK\r\nContent-Length: 20\r\n\r\n{\"status\":\"pending\"}", &state);
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_FALSE(parser.hasStatus);
+
+    parser = Parse("HTTP/1.1 200 OK\r\nContent-Length: 7\r\n\r\n[1,2,3]", &state);
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_FALSE(parser.hasStatus);
+}
+
+TEST(MfaResponseParserTest, HonoursConnectionHeaderAndHttp10) {
+    MfaResponseState state;
+    MfaResponseParser parser = Parse("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n{}", &state);
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_FALSE(parser.keepAlive);
+
+    parser = Parse("HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\n{}", &state);
+    EXPECT_FALSE(parser.keepAlive);
+
+    parser = Parse("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 2\r\n\r\n{}", &state);
+    EXPECT_TRUE(parser.keepAlive);
+}
+
+TEST(MfaResponseParserTest, BodyWithoutLengthEndsAtClose) {
+    MfaResponseState state;
+    MfaResponseParser parser = Parse("HTTP/1.1 200 OK\r\n\r\n{\"status\":1", &state);
+    EXPECT_EQ(MfaResponseNeedMore, state);
+    EXPECT_FALSE(parser.keepAlive);
+
+    EXPECT_EQ(MfaResponseComplete, MfaResponseParserFinish(&parser));
+    EXPECT_TRUE(parser.hasStatus);
+    EXPECT_EQ(1, parser.status);
+}
+
+TEST(MfaResponseParserTest, SkipsInterimResponse) {
+    MfaResponseState state;
+    MfaResponseParser parser = Parse("HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 401 Unauthorized\r\nContent-Length: 0\r\n\r\n", &state);
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_EQ(401u, parser.httpStatus);
+    EXPECT_FALSE(parser.hasStatus);
+}
+
+TEST(MfaResponseParserTest, StopsAtEndOfResponse) {
+    std::string first = "HTTP/1.1 200 OK\r\nContent-Length: 12\r\n\r\n{\"status\":1}";
+    MfaResponseState state;
+    size_t consumed;
+    Parse(first + "HTTP/1.1 200 OK\r\n", &state, &consumed);
+    EXPECT_EQ(MfaResponseComplete, state);
+    EXPECT_EQ(first.size(), consumed);
+}
+
+TEST(MfaResponseParserTest, RejectsMalformedResponses) {
+    MfaResponseState state;
+    Parse("HTTX/1.1 200 OK\r\n\r\n", &state);
+    EXPECT_EQ(MfaResponseInvalid, state);
+    Parse("HTTP/1.1 2x0 OK\r\n\r\n", &state);
+    EXPECT_EQ(MfaResponseInvalid, state);
+    Parse("HTTP/1.1 200 OK\r\nContent-Length: 1a\r\n\r\n", &state);
+    EXPECT_EQ(MfaResponseInvalid, state);
+    Parse("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", &state);
+    EXPECT_EQ(MfaResponseInvalid, state);
+
+    MfaResponseParser parser;
+    MfaResponseParserInit(&parser);
+    EXPECT_EQ(MfaResponseInvalid, MfaResponseParserFinish(&parser));
+}
+
+// ---------------------------------------------------------------------------
+// Configuration
+// ---------------------------------------------------------------------------
+
+TEST(MfaClientConfigTest, ParsesHttpUrls) {
+    MfaClientConfig config;
+    MfaClientDefaultConfig(&config);
+
+    ASSERT_TRUE(MfaClientParseUrl("http://auth.smk:8443/api/v1/", &config));
+    EXPECT_STREQ("auth.smk", config.host);
+    EXPECT_EQ(8443, config.port);
+    EXPECT_STREQ("/api/v1", config.basePath);
+
+    ASSERT_TRUE(MfaClientParseUrl("HTTP://10.0.0.5", &config));
+    EXPECT_STREQ("10.0.0.5", config.host);
+    EXPECT_EQ(80, config.port);
+    EXPECT_STREQ("", config.basePath);
+
+    ASSERT_TRUE(MfaClientParseUrl("http://[::1]:9000", &config));
+    EXPECT_STREQ("::1", config.host);
+    EXPECT_EQ(9000, config.port);
+}
+
+TEST(MfaClientConfigTest, RejectsHttpsAndMalformedUrls) {
+    MfaClientConfig config;
+    MfaClientDefaultConfig(&config);
+    EXPECT_FALSE(MfaClientParseUrl("https://auth.smk:8443", &config));
+    EXPECT_FALSE(MfaClientParseUrl("http://", &config));
+    EXPECT_FALSE(MfaClientParseUrl("http://host:0", &config));
+    EXPECT_FALSE(MfaClientParseUrl("http://host:70000", &config));
+    EXPECT_FALSE(MfaClientParseUrl("http://host/path?query=1", &config));
+    EXPECT_FALSE(MfaClientParseUrl(nullptr, &config));
+}
+
+TEST(MfaClientConfigTest, FormatsTiming) {
+    MfaClientTiming timing = {};
+    timing.phaseMicros[MfaPhaseConnect] = 400;
+    timing.phaseMicros[MfaPhaseWait] = 12100;
+    timing.phaseMicros[MfaPhasePollDelay] = 10000000;
+    timing.totalMicros = 10012680;
+    EXPECT_EQ("connect 0.4 ms, send 0.0 ms, wait 12.1 ms, receive 0.0 ms, poll delay 10000.0 ms, total 10012.7 ms",
+        MfaClientFormatTiming(timing));
+}
+
+// ---------------------------------------------------------------------------
+// Client against the loopback stub
+// ---------------------------------------------------------------------------
+
+class MfaClientTest : public ::testing::Test {
+protected:
+    MfaClientConfig config;
+
+    void SetUp() override {
+        MfaClientStop();
+        MfaBreakerReset();
+        MfaClientDefaultConfig(&config);
+        strcpy(config.host, "127.0.0.1");
+        config.timeoutMs = 2000;
+        config.waitBeforePollMs = 0;
+        config.pollIntervalMs = 1;
+        config.pollCount = 5;
+    }
+
+    void TearDown() override {
+        MfaClientStop();
+        MfaBreakerReset();
+    }
+
+    void Start(const StubServer& server) {
+        config.port = server.port();
+        ASSERT_TRUE(MfaClientStart(&config));
+    }
+};
+
+TEST_F(MfaClientTest, NotStartedWithoutConfiguration) {
+    EXPECT_FALSE(MfaClientIsStarted());
+    EXPECT_EQ(MfaClientNotStarted, MfaClientAuthenticate("alice", nullptr));
+}
+
+TEST_F(MfaClientTest, SendsPreRenderedRequest) {
+    StubServer server([](const StubRequest&) { return Status(1); });
+    strcpy(config.basePath, "/mfa");
+    strcpy(config.credentials, "user:pass");
+    Start(server);
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("SMK\\alice \"x\"", &timing));
+
+    std::vector<StubRequest> requests = server.requests();
+    ASSERT_EQ(1u, requests.size());
+    EXPECT_EQ("/mfa/Authenticate", requests[0].path);
+    EXPECT_EQ("{\"samid\":\"SMK\\\\alice \\\"x\\\"\",\"requestor\":\"SMK-RDG\"}", requests[0].body);
+    EXPECT_NE(std::string::npos, requests[0].headers.find("Host: 127.0.0.1:" + std::to_string(server.port()) + "\r\n"));
+    EXPECT_NE(std::string::npos, requests[0].headers.find("Authorization: Basic dXNlcjpwYXNz\r\n"));
+    EXPECT_NE(std::string::npos, requests[0].headers.find("Content-Type: application/json; charset=utf-8\r\n"));
+    EXPECT_EQ(1u, timing.exchanges);
+    EXPECT_EQ(1u, timing.connectionsOpened);
+    EXPECT_EQ(200u, timing.httpStatus);
+    EXPECT_EQ(1, timing.status);
+}
+
+TEST_F(MfaClientTest, PollsOverOneKeepAliveConnection) {
+    std::atomic<int> polls(0);
+    StubServer server([&polls](const StubRequest& request) {
+        if (request.path == "/Authenticate")
+            return Status(0);
+        return Status(++polls < 3 ? 0 : 1);
+    });
+    Start(server);
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+
+    EXPECT_EQ(4u, timing.exchanges);
+    EXPECT_EQ(1u, timing.connectionsOpened);
+    EXPECT_EQ(3u, timing.connectionsReused);
+    EXPECT_EQ(1, server.connections());
+    std::vector<StubRequest> requests = server.requests();
+    ASSERT_EQ(4u, requests.size());
+    EXPECT_EQ("/AuthResult", requests[3].path);
+    EXPECT_EQ(requests[0].body, requests[3].body);
+    EXPECT_GT(timing.phaseMicros[MfaPhaseWait], 0u);
+    EXPECT_GT(timing.phaseMicros[MfaPhasePollDelay], 0u);
+    EXPECT_GE(timing.totalMicros, timing.phaseMicros[MfaPhaseWait]);
+
+    // The next request starts on the connection left in the pool
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("bob", &timing));
+    EXPECT_EQ(0u, timing.connectionsOpened);
+    EXPECT_EQ(1, server.connections());
+}
+
+TEST_F(MfaClientTest, WarmUpFillsThePoolAheadOfRequests) {
+    StubServer server([](const StubRequest&) { return Status(1); });
+    EXPECT_EQ(0u, MfaClientWarmUp(2));
+    Start(server);
+
+    EXPECT_EQ(2u, MfaClientWarmUp(2));
+    // Both connections are still pooled and usable
+    EXPECT_EQ(0u, MfaClientWarmUp(2));
+    EXPECT_EQ(1u, MfaClientWarmUp(3));
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(0u, timing.connectionsOpened);
+    EXPECT_EQ(1u, timing.connectionsReused);
+    EXPECT_EQ(3, server.waitForConnections(3));
+}
+
+TEST_F(MfaClientTest, WarmUpReplacesExpiredConnections) {
+    StubServer server([](const StubRequest&) { return Status(1); });
+    config.idleTimeoutMs = 20;
+    Start(server);
+
+    MfaClientStats before = MfaClientGetStats();
+    EXPECT_EQ(1u, MfaClientWarmUp(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(1u, MfaClientWarmUp(1));
+    EXPECT_EQ(2u, MfaClientGetStats().connectionsOpened - before.connectionsOpened);
+    EXPECT_EQ(2, server.waitForConnections(2));
+}
+
+TEST_F(MfaClientTest, ReportsDeniedPendingAndHttpErrors) {
+    std::atomic<int> mode(0);
+    StubServer server([&mode](const StubRequest& request) {
+        switch (mode.load()) {
+        case 0: return Status(-1);
+        case 1: return Status(0);
+        case 2: return Json("oops", 500);
+        default: return request.path == "/Authenticate" ? Status(0) : Json("{\"message\":\"none\"}");
+        }
+    });
+    Start(server);
+
+    EXPECT_EQ(MfaClientDenied, MfaClientAuthenticate("alice", nullptr));
+
+    mode = 1;
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientPending, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(1u + config.pollCount, timing.exchanges);
+
+    mode = 2;
+    EXPECT_EQ(MfaClientHttpError, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(500u, timing.httpStatus);
+
+    mode = 3;
+    EXPECT_EQ(MfaClientBadResponse, MfaClientAuthenticate("alice", nullptr));
+}
+
+TEST_F(MfaClientTest, ReconnectsWhenServerClosesConnection) {
+    StubServer server([](const StubRequest& request) {
+        return request.path == "/Authenticate" ? Json("{\"status\":0}", 200, true) : Json("{\"status\":1}", 200, true);
+    });
+    Start(server);
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(2u, timing.connectionsOpened);
+    EXPECT_EQ(0u, timing.connectionsReused);
+    EXPECT_EQ(2, server.connections());
+}
+
+// The service may have sent the push before dropping the connection, so the
+// request is not sent again on a new one
+TEST_F(MfaClientTest, AuthenticateIsNotResentWhenReusedConnectionClosesWithoutAnswer) {
+    StubServer server([](const StubRequest&) { return StubResponse{ "", true }; });
+    Start(server);
+    EXPECT_EQ(1u, MfaClientWarmUp(1));
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientUnreachable, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(1u, timing.connectionsReused);
+    EXPECT_EQ(0u, timing.connectionsOpened);
+    EXPECT_EQ(1u, server.requests().size());
+}
+
+TEST_F(MfaClientTest, PollIsResentWhenReusedConnectionClosesWithoutAnswer) {
+    std::atomic<int> polls(0);
+    StubServer server([&polls](const StubRequest& request) {
+        if (request.path == "/Authenticate")
+            return Status(0);
+        return polls.fetch_add(1) == 0 ? StubResponse{ "", true } : Status(1);
+    });
+    Start(server);
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(2, polls.load());
+    EXPECT_EQ(2u, timing.connectionsOpened);
+    EXPECT_EQ(1u, timing.connectionsReused);
+}
+
+TEST_F(MfaClientTest, UnreachableServerFailsFast) {
+    uint16_t port;
+    {
+        StubServer server([](const StubRequest&) { return Status(1); });
+        port = server.port();
+    }
+    config.port = port;
+    ASSERT_TRUE(MfaClientStart(&config));
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientUnreachable, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(0u, timing.exchanges);
+}
+
+TEST_F(MfaClientTest, SlowServerTimesOut) {
+    StubServer server([](const StubRequest&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        return Status(1);
+    });
+    config.timeoutMs = 150;
+    Start(server);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(MfaClientTimedOut, MfaClientAuthenticate("alice", nullptr));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(550));
+}
+
+TEST_F(MfaClientTest, StopWakesRequestWaitingToPoll) {
+    StubServer server([](const StubRequest&) { return Status(0); });
+    config.waitBeforePollMs = 30000;
+    Start(server);
+
+    MfaClientResult result = MfaClientSucceeded;
+    auto start = std::chrono::steady_clock::now();
+    std::thread caller([&result] { result = MfaClientAuthenticate("alice", nullptr); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    MfaClientStop();
+    caller.join();
+
+    EXPECT_EQ(MfaClientNotStarted, result);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST_F(MfaClientTest, RejectsOversizedUserName) {
+    StubServer server([](const StubRequest&) { return Status(1); });
+    Start(server);
+
+    EXPECT_EQ(MfaClientNotStarted, MfaClientAuthenticate(std::string(MFA_CLIENT_MAX_USER + 1, 'a').c_str(), nullptr));
+    EXPECT_EQ(MfaClientNotStarted, MfaClientAuthenticate("", nullptr));
+    EXPECT_EQ(0u, server.requests().size());
+}
+
+TEST_F(MfaClientTest, ConcurrentRequestsShareThePool) {
+    StubServer server([](const StubRequest& request) {
+        return request.path == "/Authenticate" ? Status(0) : Status(1);
+    });
+    Start(server);
+    MfaClientStats before = MfaClientGetStats();
+
+    const int threads = 8;
+    const int perThread = 25;
+    std::atomic<int> succeeded(0);
+    std::vector<std::thread> callers;
+    for (int t = 0; t < threads; ++t) {
+        callers.emplace_back([&succeeded, t] {
+            for (int i = 0; i < perThread; ++i) {
+                std::string user = "user" + std::to_string(t) + "_" + std::to_string(i);
+                if (MfaClientAuthenticate(user.c_str(), nullptr) == MfaClientSucceeded)
+                    ++succeeded;
+            }
+        });
+    }
+    for (std::thread& caller : callers)
+        caller.join();
+
+    MfaClientStats after = MfaClientGetStats();
+    EXPECT_EQ(threads * perThread, succeeded.load());
+    EXPECT_EQ((uint64_t)threads * perThread, after.requests - before.requests);
+    EXPECT_EQ((uint64_t)threads * perThread * 2, after.exchanges - before.exchanges);
+    // Each thread holds at most one connection at a time
+    EXPECT_LE(server.connections(), threads);
+    EXPECT_GT(after.connectionsReused - before.connectionsReused, after.connectionsOpened - before.connectionsOpened);
+}
+
+// ---------------------------------------------------------------------------
+// Circuit breaker fed by the client
+// ---------------------------------------------------------------------------
+
+class MfaClientBreakerTest : public MfaClientTest {
+protected:
+    MfaBreakerConfig breaker;
+
+    void SetUp() override {
+        MfaClientTest::SetUp();
+        MfaBreakerDefaultConfig(&breaker);
+        breaker.minRequests = 3;
+        breaker.slowMs = 0;
+        breaker.openMs = 100;
+        MfaBreakerConfigure(&breaker);
+    }
+
+    // What the adapter does: ask the breaker, then call the service
+    MfaClientResult Guarded(const char* samid) {
+        return MfaBreakerAllow() ? MfaClientAuthenticate(samid, nullptr) : MfaClientNotStarted;
+    }
+};
+
+TEST_F(MfaClientBreakerTest, RefusedConnectionsOpenTheBreaker) {
+    uint16_t port;
+    {
+        StubServer server([](const StubRequest&) { return Status(1); });
+        port = server.port();
+    }
+    config.port = port;
+    ASSERT_TRUE(MfaClientStart(&config));
+
+    for (int i = 0; i < 3; ++i)
+        EXPECT_EQ(MfaClientUnreachable, Guarded("alice"));
+
+    EXPECT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+    EXPECT_EQ(MfaClientNotStarted, Guarded("alice"));
+    EXPECT_EQ(1u, MfaBreakerGetStats().rejected);
+}
+
+TEST_F(MfaClientBreakerTest, HangingServerOpensAndRecoveryCloses) {
+    std::atomic<bool> hanging(true);
+    StubServer server([&hanging](const StubRequest&) {
+        if (hanging)
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return Status(1);
+    });
+    config.timeoutMs = 100;
+    Start(server);
+
+    for (int i = 0; i < 3; ++i)
+        EXPECT_EQ(MfaClientTimedOut, Guarded("alice"));
+    ASSERT_EQ(MfaBreakerOpen, MfaBreakerGetState());
+
+    // Open: requests are answered without waiting for the service
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(MfaClientNotStarted, Guarded("alice"));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    size_t seen = server.requests().size();
+
+    hanging = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    EXPECT_EQ(MfaClientSucceeded, Guarded("alice"));
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    EXPECT_EQ(1u, MfaBreakerGetStats().probes);
+    EXPECT_EQ(MfaClientSucceeded, Guarded("bob"));
+    EXPECT_EQ(seen + 2, server.requests().size());
+}
+
+TEST_F(MfaClientBreakerTest, DeniedPushesDoNotCount) {
+    StubServer server([](const StubRequest&) { return Status(-1); });
+    Start(server);
+
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(MfaClientDenied, Guarded("alice"));
+
+    EXPECT_EQ(MfaBreakerClosed, MfaBreakerGetState());
+    MfaBreakerStats stats = MfaBreakerGetStats();
+    EXPECT_EQ(10u, stats.requests);
+    EXPECT_EQ(0u, stats.failures);
+}
+
+// ---------------------------------------------------------------------------
+// Several endpoints
+// ---------------------------------------------------------------------------
+
+class MfaClientEndpointsTest : public MfaClientTest {
+protected:
+    std::vector<MfaClientConfig> configs;
+
+    // Dead ports are given as 0 and replaced by the port of a server that is gone
+    void StartAll(std::initializer_list<uint16_t> ports) {
+        for (uint16_t port : ports) {
+            MfaClientConfig endpoint = config;
+            endpoint.port = port != 0 ? port : DeadPort();
+            configs.push_back(endpoint);
+        }
+        ASSERT_TRUE(MfaClientStartEndpoints(configs.data(), (uint32_t)configs.size()));
+    }
+
+    static uint16_t DeadPort() {
+        StubServer server([](const StubRequest&) { return Status(1); });
+        return server.port();
+    }
+
+    static size_t Count(StubServer& server, const std::string& path) {
+        size_t count = 0;
+        for (const StubRequest& request : server.requests())
+            count += request.path == path ? 1 : 0;
+        return count;
+    }
+};
+
+TEST_F(MfaClientEndpointsTest, AuthenticateGoesToTheFastestEndpoint) {
+    StubServer slow([](const StubRequest&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return Status(1);
+    });
+    StubServer fast([](const StubRequest&) { return Status(1); });
+    StartAll({ slow.port(), fast.port() });
+
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", nullptr));
+
+    // Each endpoint is measured once, then the fast one takes everything
+    EXPECT_EQ(1u, slow.requests().size());
+    EXPECT_EQ(9u, fast.requests().size());
+    MfaClientEndpointStats stats[2];
+    ASSERT_EQ(2u, MfaClientGetEndpointStats(stats, 2));
+    EXPECT_GT(stats[0].ewmaMicros, stats[1].ewmaMicros);
+    EXPECT_TRUE(stats[0].healthy);
+    EXPECT_EQ(fast.port(), stats[1].port);
+}
+
+TEST_F(MfaClientEndpointsTest, RefusedEndpointIsSkippedWithoutLosingRequests) {
+    StubServer live([](const StubRequest&) { return Status(1); });
+    StartAll({ 0, live.port() });
+    MfaClientStats before = MfaClientGetStats();
+
+    MfaClientTiming timing;
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+        EXPECT_EQ(1u, timing.endpoint);
+    }
+
+    // Tried until it counts as unhealthy, then left alone
+    EXPECT_EQ((uint64_t)MFA_CLIENT_UNHEALTHY_FAILURES, MfaClientGetStats().failovers - before.failovers);
+    EXPECT_EQ(0u, timing.failovers);
+    MfaClientEndpointStats stats[2];
+    MfaClientGetEndpointStats(stats, 2);
+    EXPECT_FALSE(stats[0].healthy);
+    EXPECT_EQ((uint64_t)MFA_CLIENT_UNHEALTHY_FAILURES, stats[0].failures);
+    EXPECT_EQ(6u, live.requests().size());
+}
+
+TEST_F(MfaClientEndpointsTest, UnhealthyEndpointIsTriedAgainLater) {
+    std::atomic<bool> failing(true);
+    StubServer flaky([&failing](const StubRequest&) { return failing ? Json("down", 503) : Status(1); });
+    StubServer live([](const StubRequest&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return Status(1);
+    });
+    config.unhealthyMs = 100;
+    StartAll({ flaky.port(), live.port() });
+
+    // The push was delivered, so a 503 is reported rather than sent again elsewhere
+    for (int i = 0; i < MFA_CLIENT_UNHEALTHY_FAILURES; ++i)
+        EXPECT_EQ(MfaClientHttpError, MfaClientAuthenticate("alice", nullptr));
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", nullptr));
+    EXPECT_EQ(1u, live.requests().size());
+
+    failing = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(0u, timing.endpoint);
+}
+
+TEST_F(MfaClientEndpointsTest, PushIsNeverSentTwice) {
+    StubServer dropping([](const StubRequest&) { return StubResponse{ "", true }; });
+    StubServer live([](const StubRequest&) { return Status(1); });
+    StartAll({ dropping.port(), live.port() });
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientUnreachable, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(0u, timing.failovers);
+    EXPECT_EQ(1u, dropping.requests().size());
+    EXPECT_EQ(0u, live.requests().size());
+}
+
+TEST_F(MfaClientEndpointsTest, SlowPollIsHedgedToTheNextEndpoint) {
+    StubServer primary([](const StubRequest& request) {
+        if (request.path == "/AuthResult")
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        return Status(request.path == "/Authenticate" ? 0 : 1);
+    });
+    StubServer backup([](const StubRequest& request) { return Status(request.path == "/Authenticate" ? 0 : 1); });
+    config.hedgeMinMs = 50;
+    config.pollCount = 1;
+    StartAll({ primary.port(), backup.port() });
+    MfaClientStats before = MfaClientGetStats();
+
+    MfaClientTiming timing;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(400));
+
+    EXPECT_EQ(0u, timing.endpoint);
+    EXPECT_EQ(1u, timing.hedges);
+    MfaClientStats after = MfaClientGetStats();
+    EXPECT_EQ(1u, after.hedges - before.hedges);
+    EXPECT_EQ(1u, after.hedgesWon - before.hedgesWon);
+    EXPECT_EQ(1u, Count(primary, "/Authenticate"));
+    EXPECT_EQ(0u, Count(backup, "/Authenticate"));
+    EXPECT_EQ(1u, Count(backup, "/AuthResult"));
+}
+
+TEST_F(MfaClientEndpointsTest, FastPollIsNotHedged) {
+    StubServer primary([](const StubRequest& request) { return Status(request.path == "/Authenticate" ? 0 : 1); });
+    StubServer backup([](const StubRequest&) { return Status(1); });
+    config.hedgeMinMs = 200;
+    StartAll({ primary.port(), backup.port() });
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(0u, timing.hedges);
+    EXPECT_EQ(0u, backup.requests().size());
+}
+
+TEST_F(MfaClientEndpointsTest, FailedPollMovesToTheNextEndpointAtOnce) {
+    StubServer primary([](const StubRequest& request) {
+        return request.path == "/Authenticate" ? Status(0) : StubResponse{ "", true };
+    });
+    StubServer backup([](const StubRequest&) { return Status(1); });
+    config.hedgeMinMs = 5000;
+    StartAll({ primary.port(), backup.port() });
+
+    MfaClientTiming timing;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+    EXPECT_EQ(1u, timing.hedges);
+    EXPECT_EQ(1u, Count(backup, "/AuthResult"));
+}
+
+TEST_F(MfaClientEndpointsTest, PoolKeepsConnectionsPerEndpoint) {
+    StubServer first([](const StubRequest&) { return Status(1); });
+    StubServer second([](const StubRequest&) { return Status(1); });
+    StartAll({ first.port(), second.port() });
+
+    EXPECT_EQ(4u, MfaClientWarmUp(2));
+    EXPECT_EQ(0u, MfaClientWarmUp(2));
+
+    MfaClientTiming timing;
+    EXPECT_EQ(MfaClientSucceeded, MfaClientAuthenticate("alice", &timing));
+    EXPECT_EQ(0u, timing.connectionsOpened);
+    EXPECT_EQ(2, first.connections());
+    EXPECT_EQ(2, second.connections());
+}
+
+TEST_F(MfaClientEndpointsTest, RejectsTooManyEndpoints) {
+    std::vector<MfaClientConfig> many(MFA_CLIENT_MAX_ENDPOINTS + 1, config);
+    for (MfaClientConfig& endpoint : many)
+        endpoint.port = 80;
+    EXPECT_FALSE(MfaClientStartEndpoints(many.data(), (uint32_t)many.size()));
+    EXPECT_FALSE(MfaClientStartEndpoints(many.data(), 0));
+    EXPECT_TRUE(MfaClientStartEndpoints(many.data(), MFA_CLIENT_MAX_ENDPOINTS));
+}
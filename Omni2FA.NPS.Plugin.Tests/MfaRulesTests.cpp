@@ -0,0 +1,233 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for mfarules.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "mfarules.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Monday 10:00
+const uint32_t kMondayMorning = 10 * 60;
+
+class MfaRulesTest : public ::testing::Test {
+protected:
+    MfaRuleSet* rules = nullptr;
+    char error[MFA_RULES_MAX_ERROR];
+
+    void TearDown() override {
+        MfaRulesFree(rules);
+    }
+
+    bool Compile(const std::vector<const char*>& texts) {
+        MfaRulesFree(rules);
+        rules = MfaRulesCompile(texts.data(), texts.size(), 7, error, sizeof(error));
+        return rules != nullptr;
+    }
+
+    static MfaRuleRequest Request(const char* policy, const char* nasIp, const char* called, uint32_t minuteOfWeek = kMondayMorning) {
+        MfaRuleRequest request = {};
+        request.policy = policy;
+        request.policyLength = policy != nullptr ? strlen(policy) : 0;
+        request.calledStationId = called;
+        request.calledStationIdLength = called != nullptr ? strlen(called) : 0;
+        unsigned a, b, c, d;
+        if (nasIp != nullptr && sscanf(nasIp, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+            request.nasIp = (a << 24) | (b << 16) | (c << 8) | d;
+            request.hasNasIp = true;
+        }
+        request.minuteOfWeek = minuteOfWeek;
+        return request;
+    }
+
+    // Name of the deciding rule, or "" if none matches
+    std::string Decide(const MfaRuleRequest& request, uint32_t firstRule = 0) {
+        MfaRuleMatch match;
+        return MfaRulesEvaluate(rules, &request, firstRule, &match) ? match.name : "";
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// MfaRulesCompile Tests
+// ============================================================================
+
+TEST_F(MfaRulesTest, CompilesEveryField) {
+    ASSERT_TRUE(Compile({
+        "Office: skip if nas=10.1.0.0/16, 10.2.3.4 & called=*:CORP-WIFI",
+        "VPN: MFA if policy=Secure VPN,Remote VPN & crp=Use Windows authentication & time=Mon-Fri 18:00-08:00, Sat-Sun 00:00-24:00",
+        "Admins: mfa if groups=DOMAIN\\NPS Admins",
+        "Default: mfa",
+    })) << error;
+    EXPECT_EQ(MfaRulesCount(rules), 4u);
+    EXPECT_EQ(MfaRulesTag(rules), 7u);
+}
+
+TEST_F(MfaRulesTest, ReportsTheFirstInvalidRule) {
+    EXPECT_FALSE(Compile({ "A: mfa", "B: mfa if vlan=10" }));
+    EXPECT_STREQ(error, "rule 2: unknown field 'vlan'");
+    EXPECT_FALSE(Compile({ "A: allow" }));
+    EXPECT_STREQ(error, "rule 1: expected 'mfa' or 'skip' after the name");
+    EXPECT_FALSE(Compile({ "A: skip if nas=10.0.0.0/33" }));
+    EXPECT_STREQ(error, "rule 1: invalid IPv4 prefix '10.0.0.0/33'");
+    EXPECT_FALSE(Compile({ "A: skip if time=Mon 25:00-26:00" }));
+    EXPECT_STREQ(error, "rule 1: invalid time window 'Mon 25:00-26:00'");
+    EXPECT_FALSE(Compile({ "A: skip if policy=x & policy=y" }));
+    EXPECT_STREQ(error, "rule 1: field 'policy' is given twice");
+    EXPECT_FALSE(Compile({ "no colon" }));
+    EXPECT_FALSE(Compile({ "A: skip if policy=x," }));
+}
+
+TEST_F(MfaRulesTest, RejectsMoreRulesThanMaskBits) {
+    std::vector<const char*> texts(MFA_RULES_MAX_RULES + 1, "A: mfa");
+    EXPECT_FALSE(Compile(texts));
+    texts.pop_back();
+    EXPECT_TRUE(Compile(texts)) << error;
+}
+
+// ============================================================================
+// MfaRulesEvaluate Tests
+// ============================================================================
+
+TEST_F(MfaRulesTest, FirstMatchingRuleDecides) {
+    ASSERT_TRUE(Compile({
+        "Office: skip if nas=10.1.0.0/16",
+        "VPN: mfa if policy=Secure VPN, Remote VPN",
+        "Default: mfa",
+    })) << error;
+    MfaRuleMatch match;
+    MfaRuleRequest office = Request("Secure VPN", "10.1.200.7", nullptr);
+    ASSERT_TRUE(MfaRulesEvaluate(rules, &office, 0, &match));
+    EXPECT_EQ(match.rule, 0u);
+    EXPECT_EQ(match.action, MfaRuleSkip);
+    EXPECT_FALSE(match.needsGroups);
+    EXPECT_EQ(Decide(Request("remote vpn", "192.168.0.1", nullptr)), "VPN");
+    EXPECT_EQ(Decide(Request("Other", "192.168.0.1", nullptr)), "Default");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr)), "Default");
+}
+
+TEST_F(MfaRulesTest, NoMatchWithoutCatchAll) {
+    ASSERT_TRUE(Compile({ "VPN: mfa if policy=Secure VPN" })) << error;
+    EXPECT_EQ(Decide(Request("Secure VPN 2", nullptr, nullptr)), "");
+    EXPECT_EQ(Decide(Request("Secure VP", nullptr, nullptr)), "");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr)), "");
+}
+
+TEST_F(MfaRulesTest, NasPrefixesUseTheRadixTree) {
+    ASSERT_TRUE(Compile({
+        "Host: skip if nas=10.1.2.3",
+        "Subnet: mfa if nas=10.1.0.0/16",
+        "Wide: skip if nas=10.0.0.0/8, 172.16.0.0/12",
+        "Any: mfa if nas=0.0.0.0/0",
+    })) << error;
+    EXPECT_EQ(Decide(Request(nullptr, "10.1.2.3", nullptr)), "Host");
+    EXPECT_EQ(Decide(Request(nullptr, "10.1.2.4", nullptr)), "Subnet");
+    EXPECT_EQ(Decide(Request(nullptr, "10.200.0.1", nullptr)), "Wide");
+    EXPECT_EQ(Decide(Request(nullptr, "172.31.255.255", nullptr)), "Wide");
+    EXPECT_EQ(Decide(Request(nullptr, "172.32.0.0", nullptr)), "Any");
+    // A request without NAS-IP-Address matches no nas condition, not even /0
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr)), "");
+}
+
+TEST_F(MfaRulesTest, CalledStationPatterns) {
+    ASSERT_TRUE(Compile({
+        "Wifi: skip if called=*:corp-wifi",
+        "Ap: mfa if called=00-11-22-*, *guest*lobby*",
+        "Single: mfa if called=10.0.0.?",
+    })) << error;
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "AA-BB-CC-DD-EE-FF:CORP-WIFI")), "Wifi");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "AA-BB-CC-DD-EE-FF:CORP-WIFI2")), "");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "00-11-22-33-44-55:Other")), "Ap");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "00-11-2")), "");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "x-Guest-Hall-Lobby-2")), "Ap");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "lobby-guest")), "");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "10.0.0.1")), "Single");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, "10.0.0.10")), "");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr)), "");
+}
+
+TEST_F(MfaRulesTest, TimeWindowsRunPastMidnight) {
+    ASSERT_TRUE(Compile({
+        "Night: mfa if time=Mon-Fri 18:00-08:00",
+        "Weekend: mfa if time=Sat-Sun 00:00-24:00",
+        "Day: skip",
+    })) << error;
+    const uint32_t day = 24 * 60;
+    EXPECT_EQ(MfaRulesMinuteOfWeek(1, 10, 0), kMondayMorning);
+    EXPECT_EQ(MfaRulesMinuteOfWeek(0, 23, 59), 7 * day - 1);
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr, kMondayMorning)), "Day");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr, MfaRulesMinuteOfWeek(1, 19, 30))), "Night");
+    // Tuesday 07:59 belongs to Monday's night, Monday 07:59 to Sunday's, which is not listed
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr, MfaRulesMinuteOfWeek(2, 7, 59))), "Night");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr, MfaRulesMinuteOfWeek(1, 7, 59))), "Day");
+    // Saturday 07:00 is Friday's night, which comes first
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr, MfaRulesMinuteOfWeek(6, 7, 0))), "Night");
+    EXPECT_EQ(Decide(Request(nullptr, nullptr, nullptr, MfaRulesMinuteOfWeek(6, 12, 0))), "Weekend");
+}
+
+TEST_F(MfaRulesTest, GroupRulesAreLeftToTheCaller) {
+    ASSERT_TRUE(Compile({
+        "Admins: mfa if groups=DOMAIN\\Admins & policy=VPN",
+        "Rest: skip if policy=VPN",
+    })) << error;
+    MfaRuleRequest request = Request("VPN", nullptr, nullptr);
+    MfaRuleMatch match;
+    ASSERT_TRUE(MfaRulesEvaluate(rules, &request, 0, &match));
+    EXPECT_STREQ(match.name, "Admins");
+    EXPECT_TRUE(match.needsGroups);
+    // Not in the group: continue after the rule
+    ASSERT_TRUE(MfaRulesEvaluate(rules, &request, match.rule + 1, &match));
+    EXPECT_STREQ(match.name, "Rest");
+    EXPECT_FALSE(match.needsGroups);
+    EXPECT_FALSE(MfaRulesEvaluate(rules, &request, 2, &match));
+}
+
+TEST_F(MfaRulesTest, AllConditionsOfARuleMustHold) {
+    ASSERT_TRUE(Compile({
+        "Both: skip if policy=Wifi & nas=10.0.0.0/8 & called=*:CORP",
+        "Else: mfa",
+    })) << error;
+    EXPECT_EQ(Decide(Request("wifi", "10.9.9.9", "AP1:corp")), "Both");
+    EXPECT_EQ(Decide(Request("wifi", "11.9.9.9", "AP1:corp")), "Else");
+    EXPECT_EQ(Decide(Request("wifi", "10.9.9.9", "AP1:guest")), "Else");
+    EXPECT_EQ(Decide(Request("vpn", "10.9.9.9", "AP1:corp")), "Else");
+}
+
+TEST_F(MfaRulesTest, ManyRulesUseEveryMaskBit) {
+    std::vector<std::string> texts;
+    for (int i = 0; i < MFA_RULES_MAX_RULES; ++i)
+        texts.push_back("R" + std::to_string(i) + ": mfa if policy=P" + std::to_string(i));
+    std::vector<const char*> pointers;
+    for (const std::string& text : texts)
+        pointers.push_back(text.c_str());
+    ASSERT_TRUE(Compile(pointers)) << error;
+    EXPECT_EQ(Decide(Request("p0", nullptr, nullptr)), "R0");
+    EXPECT_EQ(Decide(Request("P63", nullptr, nullptr)), "R63");
+    EXPECT_EQ(Decide(Request("P64", nullptr, nullptr)), "");
+}
+
+// ============================================================================
+// MfaRulesInstall Tests
+// ============================================================================
+
+TEST(MfaRulesInstallTest, ReplacedSetsStayReadable) {
+    const char* first[] = { "A: mfa" };
+    const char* second[] = { "B: skip" };
+    MfaRulesInstall(MfaRulesCompile(first, 1, 1, nullptr, 0));
+    const MfaRuleSet* old = MfaRulesCurrent();
+    MfaRulesInstall(MfaRulesCompile(second, 1, 2, nullptr, 0));
+    EXPECT_EQ(MfaRulesTag(MfaRulesCurrent()), 2u);
+    // A request that picked up the old set before the swap can still use it
+    EXPECT_EQ(MfaRulesTag(old), 1u);
+    MfaRulesShutdown();
+    EXPECT_EQ(MfaRulesCurrent(), nullptr);
+}
@@ -0,0 +1,153 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//   
+//   In-memory RADIUS_ATTRIBUTE_ARRAY shared by the unit tests and benchmarks
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <windows.h>
+#include <authif.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+// Mock RADIUS_ATTRIBUTE structure that we can actually modify
+struct TestRadiusAttribute {
+    DWORD dwAttrType;
+    RADIUS_DATA_TYPE fDataType;
+    DWORD cbDataLength;
+    BYTE buffer[256];  // Local buffer instead of const pointer
+};
+
+// Mock RADIUS_ATTRIBUTE_ARRAY for testing  
+// Must match the exact memory layout of RADIUS_ATTRIBUTE_ARRAY from authif.h
+class MockRadiusAttributeArray {
+private:
+    // The actual RADIUS_ATTRIBUTE_ARRAY structure layout:
+    DWORD cbSize;  // Size of structure
+    DWORD (WINAPI *Add_ptr)(RADIUS_ATTRIBUTE_ARRAY*, const RADIUS_ATTRIBUTE*);
+    const RADIUS_ATTRIBUTE* (WINAPI *AttributeAt_ptr)(const RADIUS_ATTRIBUTE_ARRAY*, DWORD);
+    DWORD (WINAPI *GetSize_ptr)(const RADIUS_ATTRIBUTE_ARRAY*);
+    DWORD (WINAPI *InsertAt_ptr)(RADIUS_ATTRIBUTE_ARRAY*, DWORD, const RADIUS_ATTRIBUTE*);
+    DWORD (WINAPI *RemoveAt_ptr)(RADIUS_ATTRIBUTE_ARRAY*, DWORD);
+    DWORD (WINAPI *SetAt_ptr)(RADIUS_ATTRIBUTE_ARRAY*, DWORD, const RADIUS_ATTRIBUTE*);
+
+public:
+    std::vector<TestRadiusAttribute> attributes;
+    // A deque keeps previously returned pointers valid when it grows, just
+    // like NPS keeps them valid until the array is modified.
+    mutable std::deque<RADIUS_ATTRIBUTE> convertedAttributes;
+    // Attribute type the mutators refuse with ERROR_ACCESS_DENIED, as NPS does
+    // for attributes extensions may not change; 0 for none
+    DWORD readOnlyType = 0;
+    // Index AttributeAt answers with NULL although it is below GetSize, as
+    // NPS may for an entry it cannot return; (DWORD)-1 for none
+    DWORD nullIndex = (DWORD)-1;
+
+    MockRadiusAttributeArray() {
+        // Initialize function pointers - order matters!
+        cbSize = sizeof(RADIUS_ATTRIBUTE_ARRAY);
+        Add_ptr = Add_Impl;
+        AttributeAt_ptr = AttributeAt_Impl;
+        GetSize_ptr = GetSize_Impl;
+        InsertAt_ptr = InsertAt_Impl;
+        RemoveAt_ptr = RemoveAt_Impl;
+        SetAt_ptr = SetAt_Impl;
+    }
+
+    static DWORD WINAPI GetSize_Impl(const RADIUS_ATTRIBUTE_ARRAY* pThis) {
+        // Skip past the RADIUS_ATTRIBUTE_ARRAY structure part to get to our data
+        auto* mock = reinterpret_cast<const MockRadiusAttributeArray*>(pThis);
+        return static_cast<DWORD>(mock->attributes.size());
+    }
+
+    static const RADIUS_ATTRIBUTE* WINAPI AttributeAt_Impl(const RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex) {
+        auto* mock = reinterpret_cast<const MockRadiusAttributeArray*>(pThis);
+        if (dwIndex < mock->attributes.size() && dwIndex != mock->nullIndex) {
+            // Ensure we have space in convertedAttributes
+            if (mock->convertedAttributes.size() <= dwIndex) {
+                mock->convertedAttributes.resize(mock->attributes.size());
+            }
+            
+            // Build RADIUS_ATTRIBUTE pointing to our buffer
+            mock->convertedAttributes[dwIndex].dwAttrType = mock->attributes[dwIndex].dwAttrType;
+            mock->convertedAttributes[dwIndex].fDataType = mock->attributes[dwIndex].fDataType;
+            mock->convertedAttributes[dwIndex].cbDataLength = mock->attributes[dwIndex].cbDataLength;
+            // Point to the actual buffer in our attributes vector
+            mock->convertedAttributes[dwIndex].lpValue = const_cast<BYTE*>(mock->attributes[dwIndex].buffer);
+            
+            return &mock->convertedAttributes[dwIndex];
+        }
+        return nullptr;
+    }
+
+    static DWORD WINAPI SetAt_Impl(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr) {
+        auto* mock = reinterpret_cast<MockRadiusAttributeArray*>(pThis);
+        if (dwIndex < mock->attributes.size() && pAttr != nullptr) {
+            if (mock->IsReadOnly(mock->attributes[dwIndex].dwAttrType) || mock->IsReadOnly(pAttr->dwAttrType)) {
+                return ERROR_ACCESS_DENIED;
+            }
+            mock->attributes[dwIndex] = Convert(pAttr);
+            return NO_ERROR;
+        }
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    static DWORD WINAPI Add_Impl(RADIUS_ATTRIBUTE_ARRAY* pThis, const RADIUS_ATTRIBUTE* pAttr) {
+        auto* mock = reinterpret_cast<MockRadiusAttributeArray*>(pThis);
+        if (pAttr != nullptr) {
+            if (mock->IsReadOnly(pAttr->dwAttrType)) {
+                return ERROR_ACCESS_DENIED;
+            }
+            mock->attributes.push_back(Convert(pAttr));
+            return NO_ERROR;
+        }
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    // Inserting at the end is allowed, like Add
+    static DWORD WINAPI InsertAt_Impl(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr) {
+        auto* mock = reinterpret_cast<MockRadiusAttributeArray*>(pThis);
+        if (dwIndex <= mock->attributes.size() && pAttr != nullptr) {
+            if (mock->IsReadOnly(pAttr->dwAttrType)) {
+                return ERROR_ACCESS_DENIED;
+            }
+            mock->attributes.insert(mock->attributes.begin() + dwIndex, Convert(pAttr));
+            return NO_ERROR;
+        }
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    static DWORD WINAPI RemoveAt_Impl(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex) {
+        auto* mock = reinterpret_cast<MockRadiusAttributeArray*>(pThis);
+        if (dwIndex < mock->attributes.size()) {
+            if (mock->IsReadOnly(mock->attributes[dwIndex].dwAttrType)) {
+                return ERROR_ACCESS_DENIED;
+            }
+            mock->attributes.erase(mock->attributes.begin() + dwIndex);
+            return NO_ERROR;
+        }
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    bool IsReadOnly(DWORD dwAttrType) const {
+        return readOnlyType != 0 && dwAttrType == readOnlyType;
+    }
+
+    static TestRadiusAttribute Convert(const RADIUS_ATTRIBUTE* pAttr) {
+        TestRadiusAttribute attr = {};
+        attr.dwAttrType = pAttr->dwAttrType;
+        attr.fDataType = pAttr->fDataType;
+        attr.cbDataLength = pAttr->cbDataLength;
+        if (pAttr->cbDataLength > 0 && pAttr->lpValue != nullptr && pAttr->cbDataLength <= 256) {
+            memcpy(attr.buffer, pAttr->lpValue, pAttr->cbDataLength);
+        }
+        return attr;
+    }
+
+    RADIUS_ATTRIBUTE_ARRAY* ToRadiusArray() {
+        return reinterpret_cast<RADIUS_ATTRIBUTE_ARRAY*>(this);
+    }
+};
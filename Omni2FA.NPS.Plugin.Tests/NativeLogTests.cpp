@@ -0,0 +1,250 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for nativelog.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "nativelog.h"
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct CapturedEvent {
+    int level;
+    int eventCode;
+    std::string message;
+};
+
+// In-memory sink standing in for the Event Log
+struct MemorySink {
+    std::mutex lock;
+    std::vector<CapturedEvent> events;
+
+    static void Write(void* context, int level, int eventCode, const char* message) {
+        MemorySink* self = static_cast<MemorySink*>(context);
+        std::lock_guard<std::mutex> guard(self->lock);
+        self->events.push_back({ level, eventCode, message });
+    }
+};
+
+int g_evaluated = 0;
+
+int CountEvaluation() {
+    return ++g_evaluated;
+}
+
+}  // namespace
+
+// Test fixture: every test starts with a stopped, drained logger and one memory sink
+class NativeLogTest : public ::testing::Test {
+protected:
+    MemorySink sink;
+
+    void SetUp() override {
+        NativeLogStop();
+        NativeLogFlush();
+        NativeLogClearSinks();
+        NativeLogAddSink(&MemorySink::Write, &sink);
+        NativeLogSetLevel(NativeLogTrace);
+    }
+
+    void TearDown() override {
+        NativeLogStop();
+        NativeLogFlush();
+        NativeLogClearSinks();
+        NativeLogSetLevel(NativeLogInformation);
+    }
+};
+
+// ============================================================================
+// Formatting
+// ============================================================================
+
+TEST_F(NativeLogTest, Format_SubstitutesPlaceholders) {
+    NATIVE_LOG(NativeLogInformation, 112, "Short-circuited {0} of {1} requests, last {2}: {3}",
+        5, 7u, -3LL, "done");
+    NativeLogFlush();
+
+    ASSERT_EQ(1u, sink.events.size());
+    EXPECT_EQ("Short-circuited 5 of 7 requests, last -3: done", sink.events[0].message);
+    EXPECT_EQ(112, sink.events[0].eventCode);
+    EXPECT_EQ(NativeLogInformation, sink.events[0].level);
+}
+
+TEST_F(NativeLogTest, Format_PlaceholderWithoutArgument_IsDropped) {
+    NATIVE_LOG(NativeLogInformation, 200, "value: {1}{0}", std::string("x"));
+    NativeLogFlush();
+
+    ASSERT_EQ(1u, sink.events.size());
+    EXPECT_EQ("value: x", sink.events[0].message);
+}
+
+TEST_F(NativeLogTest, Format_LongString_IsNotTruncated) {
+    std::string longText(NATIVE_LOG_TEXT_SIZE * 4, 'e');
+    NATIVE_LOG(NativeLogError, 405, "Error: {0} ({1})", longText, "short");
+    NativeLogFlush();
+
+    ASSERT_EQ(1u, sink.events.size());
+    EXPECT_EQ("Error: " + longText + " (short)", sink.events[0].message);
+}
+
+TEST_F(NativeLogTest, Format_TextArgumentsShareInlineBuffer) {
+    NativeLogRecord record = {};
+    record.format = "{0}-{1}";
+    NativeLogAppendArgs(&record, "ab", std::string("cd"));
+
+    EXPECT_EQ(NativeLogArgText, record.args[0].type);
+    EXPECT_EQ(NativeLogArgText, record.args[1].type);
+    EXPECT_EQ(4u, record.textUsed);
+    EXPECT_EQ("ab-cd", NativeLogFormat(record));
+}
+
+// ============================================================================
+// Level gate
+// ============================================================================
+
+TEST_F(NativeLogTest, LevelGate_DisabledLevel_DoesNotEvaluateArguments) {
+    NativeLogSetLevel(NativeLogInformation);
+    g_evaluated = 0;
+    uint64_t before = NativeLogGetStats().written;
+
+    NATIVE_LOG(NativeLogTrace, 6, "completed with result: {0}", CountEvaluation());
+    NativeLogFlush();
+
+    EXPECT_EQ(0, g_evaluated);
+    EXPECT_EQ(before, NativeLogGetStats().written);
+    EXPECT_TRUE(sink.events.empty());
+}
+
+TEST_F(NativeLogTest, LevelGate_EnabledLevel_WritesRecord) {
+    NativeLogSetLevel(NativeLogWarning);
+
+    NATIVE_LOG(NativeLogInformation, 200, "dropped");
+    NATIVE_LOG(NativeLogWarning, 300, "kept");
+    NATIVE_LOG(NativeLogError, 400, "kept too");
+    NativeLogFlush();
+
+    ASSERT_EQ(2u, sink.events.size());
+    EXPECT_EQ(300, sink.events[0].eventCode);
+    EXPECT_EQ(400, sink.events[1].eventCode);
+}
+
+TEST_F(NativeLogTest, LevelGate_Off_DisablesEverything) {
+    NativeLogSetLevel(NativeLogOff);
+    EXPECT_FALSE(NativeLogIsEnabled(NativeLogError));
+    EXPECT_EQ(NativeLogOff, NativeLogGetLevel());
+}
+
+// ============================================================================
+// Ring buffer and flusher
+// ============================================================================
+
+TEST_F(NativeLogTest, Flusher_DeliversRecordsInOrder) {
+    NativeLogStart();
+    for (int i = 0; i < 50; ++i) {
+        NATIVE_LOG(NativeLogInformation, i, "record {0}", i);
+    }
+    NativeLogFlush();
+
+    ASSERT_EQ(50u, sink.events.size());
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_EQ(i, sink.events[i].eventCode);
+        EXPECT_EQ("record " + std::to_string(i), sink.events[i].message);
+    }
+}
+
+TEST_F(NativeLogTest, Flusher_DrainsOnStop) {
+    NativeLogStart();
+    NATIVE_LOG(NativeLogInformation, 111, "cleaned up");
+    NativeLogStop();
+
+    ASSERT_EQ(1u, sink.events.size());
+    EXPECT_EQ("cleaned up", sink.events[0].message);
+}
+
+TEST_F(NativeLogTest, Ring_Full_DropsInsteadOfBlocking) {
+    // No flusher is running, so nothing frees slots until the explicit flush
+    uint64_t droppedBefore = NativeLogGetStats().dropped;
+    for (int i = 0; i < NATIVE_LOG_RING_SIZE + 10; ++i) {
+        NATIVE_LOG(NativeLogInformation, 200, "{0}", i);
+    }
+
+    EXPECT_EQ(droppedBefore + 10, NativeLogGetStats().dropped);
+    NativeLogFlush();
+    ASSERT_EQ(static_cast<size_t>(NATIVE_LOG_RING_SIZE), sink.events.size());
+    EXPECT_EQ("0", sink.events.front().message);
+    EXPECT_EQ(std::to_string(NATIVE_LOG_RING_SIZE - 1), sink.events.back().message);
+}
+
+TEST_F(NativeLogTest, Ring_ConcurrentProducers_LoseNothingButDrops) {
+    const int threads = 4;
+    const int perThread = 2000;
+    NativeLogStats before = NativeLogGetStats();
+    NativeLogStart();
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+        producers.emplace_back([t]() {
+            for (int i = 0; i < perThread; ++i) {
+                NATIVE_LOG(NativeLogInformation, t, "{0}:{1}", t, i);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    NativeLogFlush();
+
+    NativeLogStats after = NativeLogGetStats();
+    uint64_t written = after.written - before.written;
+    uint64_t dropped = after.dropped - before.dropped;
+    EXPECT_EQ(static_cast<uint64_t>(threads * perThread), written + dropped);
+    EXPECT_EQ(written, sink.events.size());
+
+    // Records of one producer keep their relative order
+    std::vector<int> last(threads, -1);
+    for (const auto& e : sink.events) {
+        int index = std::stoi(e.message.substr(e.message.find(':') + 1));
+        EXPECT_GT(index, last[e.eventCode]);
+        last[e.eventCode] = index;
+    }
+}
+
+// ============================================================================
+// Sinks
+// ============================================================================
+
+TEST_F(NativeLogTest, FileSink_WritesOneLinePerRecord) {
+    FILE* file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    NativeLogAddSink(&NativeLogFileSink, file);
+
+    NATIVE_LOG(NativeLogWarning, 300, "Assembly not found: {0}", "Foo.dll");
+    NATIVE_LOG(NativeLogTrace, 3, "RadiusExtensionProcess2 called.");
+    NativeLogFlush();
+
+    rewind(file);
+    char line[256];
+    ASSERT_NE(nullptr, fgets(line, sizeof(line), file));
+    EXPECT_STREQ("WARN 300 Assembly not found: Foo.dll\n", line);
+    ASSERT_NE(nullptr, fgets(line, sizeof(line), file));
+    EXPECT_STREQ("TRACE 3 RadiusExtensionProcess2 called.\n", line);
+    fclose(file);
+}
+
+TEST_F(NativeLogTest, AddSink_RejectsNullAndOverflow) {
+    EXPECT_FALSE(NativeLogAddSink(nullptr, nullptr));
+    int added = 0;
+    while (NativeLogAddSink(&MemorySink::Write, &sink)) {
+        ++added;
+        ASSERT_LT(added, 100);
+    }
+    EXPECT_GT(added, 0);
+}
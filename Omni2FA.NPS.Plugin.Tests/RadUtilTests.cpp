@@ -9,105 +9,11 @@
 #include <gtest/gtest.h>
 #include <windows.h>
 #include "radutil.h"
+#include "MockRadiusAttributeArray.h"
 #include <vector>
 #include <memory>
-
-// Mock RADIUS_ATTRIBUTE structure that we can actually modify
-struct TestRadiusAttribute {
-    DWORD dwAttrType;
-    RADIUS_DATA_TYPE fDataType;
-    DWORD cbDataLength;
-    BYTE buffer[256];  // Local buffer instead of const pointer
-};
-
-// Mock RADIUS_ATTRIBUTE_ARRAY for testing  
-// Must match the exact memory layout of RADIUS_ATTRIBUTE_ARRAY from authif.h
-class MockRadiusAttributeArray {
-private:
-    // The actual RADIUS_ATTRIBUTE_ARRAY structure layout:
-    DWORD cbSize;  // Size of structure
-    DWORD (WINAPI *Add_ptr)(RADIUS_ATTRIBUTE_ARRAY*, const RADIUS_ATTRIBUTE*);
-    const RADIUS_ATTRIBUTE* (WINAPI *AttributeAt_ptr)(const RADIUS_ATTRIBUTE_ARRAY*, DWORD);
-    DWORD (WINAPI *GetSize_ptr)(const RADIUS_ATTRIBUTE_ARRAY*);
-    DWORD (WINAPI *InsertAt_ptr)(RADIUS_ATTRIBUTE_ARRAY*, DWORD, const RADIUS_ATTRIBUTE*);
-    DWORD (WINAPI *RemoveAt_ptr)(RADIUS_ATTRIBUTE_ARRAY*, DWORD);
-    DWORD (WINAPI *SetAt_ptr)(RADIUS_ATTRIBUTE_ARRAY*, DWORD, const RADIUS_ATTRIBUTE*);
-
-public:
-    std::vector<TestRadiusAttribute> attributes;
-    mutable std::vector<RADIUS_ATTRIBUTE> convertedAttributes;
-
-    MockRadiusAttributeArray() {
-        // Initialize function pointers - order matters!
-        cbSize = sizeof(RADIUS_ATTRIBUTE_ARRAY);
-        Add_ptr = Add_Impl;
-        AttributeAt_ptr = AttributeAt_Impl;
-        GetSize_ptr = GetSize_Impl;
-        InsertAt_ptr = nullptr;  // Not implemented
-        RemoveAt_ptr = nullptr;  // Not implemented
-        SetAt_ptr = SetAt_Impl;
-    }
-
-    static DWORD WINAPI GetSize_Impl(const RADIUS_ATTRIBUTE_ARRAY* pThis) {
-        // Skip past the RADIUS_ATTRIBUTE_ARRAY structure part to get to our data
-        auto* mock = reinterpret_cast<const MockRadiusAttributeArray*>(pThis);
-        return static_cast<DWORD>(mock->attributes.size());
-    }
-
-    static const RADIUS_ATTRIBUTE* WINAPI AttributeAt_Impl(const RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex) {
-        auto* mock = reinterpret_cast<const MockRadiusAttributeArray*>(pThis);
-        if (dwIndex < mock->attributes.size()) {
-            // Ensure we have space in convertedAttributes
-            if (mock->convertedAttributes.size() <= dwIndex) {
-                mock->convertedAttributes.resize(mock->attributes.size());
-            }
-            
-            // Build RADIUS_ATTRIBUTE pointing to our buffer
-            mock->convertedAttributes[dwIndex].dwAttrType = mock->attributes[dwIndex].dwAttrType;
-            mock->convertedAttributes[dwIndex].fDataType = mock->attributes[dwIndex].fDataType;
-            mock->convertedAttributes[dwIndex].cbDataLength = mock->attributes[dwIndex].cbDataLength;
-            // Point to the actual buffer in our attributes vector
-            mock->convertedAttributes[dwIndex].lpValue = const_cast<BYTE*>(mock->attributes[dwIndex].buffer);
-            
-            return &mock->convertedAttributes[dwIndex];
-        }
-        return nullptr;
-    }
-
-    static DWORD WINAPI SetAt_Impl(RADIUS_ATTRIBUTE_ARRAY* pThis, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr) {
-        auto* mock = reinterpret_cast<MockRadiusAttributeArray*>(pThis);
-        if (dwIndex < mock->attributes.size() && pAttr != nullptr) {
-            mock->attributes[dwIndex].dwAttrType = pAttr->dwAttrType;
-            mock->attributes[dwIndex].fDataType = pAttr->fDataType;
-            mock->attributes[dwIndex].cbDataLength = pAttr->cbDataLength;
-            if (pAttr->cbDataLength > 0 && pAttr->lpValue != nullptr && pAttr->cbDataLength <= 256) {
-                memcpy(mock->attributes[dwIndex].buffer, pAttr->lpValue, pAttr->cbDataLength);
-            }
-            return NO_ERROR;
-        }
-        return ERROR_INVALID_PARAMETER;
-    }
-
-    static DWORD WINAPI Add_Impl(RADIUS_ATTRIBUTE_ARRAY* pThis, const RADIUS_ATTRIBUTE* pAttr) {
-        auto* mock = reinterpret_cast<MockRadiusAttributeArray*>(pThis);
-        if (pAttr != nullptr) {
-            TestRadiusAttribute attr = {};
-            attr.dwAttrType = pAttr->dwAttrType;
-            attr.fDataType = pAttr->fDataType;
-            attr.cbDataLength = pAttr->cbDataLength;
-            if (pAttr->cbDataLength > 0 && pAttr->lpValue != nullptr && pAttr->cbDataLength <= 256) {
-                memcpy(attr.buffer, pAttr->lpValue, pAttr->cbDataLength);
-            }
-            mock->attributes.push_back(attr);
-            return NO_ERROR;
-        }
-        return ERROR_INVALID_PARAMETER;
-    }
-
-    RADIUS_ATTRIBUTE_ARRAY* ToRadiusArray() {
-        return reinterpret_cast<RADIUS_ATTRIBUTE_ARRAY*>(this);
-    }
-};
+#include <random>
+#include <string>
 
 // Test fixture for RadUtil tests
 class RadUtilTest : public ::testing::Test {
@@ -174,6 +80,197 @@ TEST(RadiusFreeTest, FreesNullPointer) {
     SUCCEED();
 }
 
+// ============================================================================
+// Request Arena Tests
+// ============================================================================
+
+class RadiusArenaTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        RadiusArenaResetStats();
+    }
+
+    RADIUS_ARENA_STATS Stats() {
+        RADIUS_ARENA_STATS stats = {};
+        RadiusArenaGetStats(&stats);
+        return stats;
+    }
+};
+
+TEST_F(RadiusArenaTest, ReusesMemoryAfterEnd) {
+    RadiusArenaBegin();
+    LPVOID first = RadiusAlloc(100);
+    ASSERT_NE(first, nullptr);
+    RadiusArenaEnd();
+
+    RadiusArenaBegin();
+    LPVOID second = RadiusAlloc(100);
+    RadiusArenaEnd();
+
+    EXPECT_EQ(first, second);
+}
+
+TEST_F(RadiusArenaTest, WarmThreadAllocatesNoBlocks) {
+    // Warm up: the first request takes the blocks it needs
+    RadiusArenaBegin();
+    for (int i = 0; i < 50; ++i) {
+        RadiusAlloc(253);
+    }
+    RadiusArenaEnd();
+    RadiusArenaResetStats();
+
+    for (int request = 0; request < 100; ++request) {
+        RadiusArenaBegin();
+        for (int i = 0; i < 50; ++i) {
+            ASSERT_NE(RadiusAlloc(253), nullptr);
+        }
+        RadiusArenaEnd();
+    }
+
+    RADIUS_ARENA_STATS stats = Stats();
+    EXPECT_EQ(stats.ullRequests, 100u);
+    EXPECT_EQ(stats.ullArenaAllocations, 5000u);
+    EXPECT_EQ(stats.ullHeapAllocations, 0u);
+    EXPECT_EQ(stats.ullBlocksAllocated, 0u);
+}
+
+TEST_F(RadiusArenaTest, OversizeBlockComesFromHeap) {
+    RadiusArenaBegin();
+    LPVOID ptr = RadiusAlloc(RADIUS_ARENA_MAX_ALLOC + 1);
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, 0xAB, RADIUS_ARENA_MAX_ALLOC + 1);
+    RadiusFree(ptr);
+    RadiusArenaEnd();
+
+    RADIUS_ARENA_STATS stats = Stats();
+    EXPECT_EQ(stats.ullHeapAllocations, 1u);
+    EXPECT_EQ(stats.ullArenaAllocations, 0u);
+}
+
+TEST_F(RadiusArenaTest, OutsideScopeUsesHeap) {
+    LPVOID ptr = RadiusAlloc(16);
+    ASSERT_NE(ptr, nullptr);
+    RadiusFree(ptr);
+
+    EXPECT_EQ(Stats().ullHeapAllocations, 1u);
+}
+
+TEST_F(RadiusArenaTest, FreeOfArenaBlockIsIgnored) {
+    RadiusArenaBegin();
+    BYTE* first = (BYTE*)RadiusAlloc(64);
+    memset(first, 0x11, 64);
+    RadiusFree(first);
+    BYTE* second = (BYTE*)RadiusAlloc(64);
+    memset(second, 0x22, 64);
+
+    // The freed block is not handed out again within the request
+    EXPECT_NE(first, second);
+    EXPECT_EQ(first[0], 0x11);
+    RadiusArenaEnd();
+}
+
+TEST_F(RadiusArenaTest, AllocationsAreAligned) {
+    RadiusArenaBegin();
+    for (SIZE_T size = 0; size < 64; ++size) {
+        LPVOID ptr = RadiusAlloc(size);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ((uintptr_t)ptr % 16, 0u) << "size " << size;
+    }
+    RadiusArenaEnd();
+}
+
+TEST_F(RadiusArenaTest, AllocationsDoNotOverlap) {
+    std::vector<BYTE*> blocks;
+    RadiusArenaBegin();
+    // Enough to span several arena blocks
+    for (int i = 0; i < 100; ++i) {
+        BYTE* ptr = (BYTE*)RadiusAlloc(4000);
+        ASSERT_NE(ptr, nullptr);
+        memset(ptr, i, 4000);
+        blocks.push_back(ptr);
+    }
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(blocks[i][0], (BYTE)i);
+        EXPECT_EQ(blocks[i][3999], (BYTE)i);
+    }
+    RadiusArenaEnd();
+
+    EXPECT_GT(Stats().ullPeakBytes, 100u * 4000u - 1u);
+}
+
+TEST_F(RadiusArenaTest, ReleasesBlocksBeyondKeepLimit) {
+    RadiusArenaBegin();
+    // Each allocation takes most of a block
+    for (int i = 0; i < RADIUS_ARENA_KEEP_BLOCKS * 10; ++i) {
+        ASSERT_NE(RadiusAlloc(RADIUS_ARENA_MAX_ALLOC), nullptr);
+    }
+    RadiusArenaEnd();
+
+    RADIUS_ARENA_STATS stats = Stats();
+    EXPECT_GT(stats.ullBlocksAllocated, (ULONGLONG)RADIUS_ARENA_KEEP_BLOCKS);
+    EXPECT_GT(stats.ullBlocksReleased, 0u);
+}
+
+TEST_F(RadiusArenaTest, NestedScopesReleaseOnOutermostEnd) {
+    RadiusArenaBegin();
+    BYTE* outer = (BYTE*)RadiusAlloc(32);
+    RadiusArenaBegin();
+    BYTE* inner = (BYTE*)RadiusAlloc(32);
+    RadiusArenaEnd();
+
+    // Still in the outer scope: inner memory is still live
+    BYTE* next = (BYTE*)RadiusAlloc(32);
+    EXPECT_NE(next, inner);
+    EXPECT_NE(next, outer);
+    RadiusArenaEnd();
+
+    EXPECT_EQ(Stats().ullRequests, 1u);
+}
+
+TEST_F(RadiusArenaTest, UnbalancedEndIsIgnored) {
+    RadiusArenaEnd();
+    EXPECT_EQ(Stats().ullRequests, 0u);
+}
+
+TEST_F(RadiusArenaTest, GetStatsAcceptsNull) {
+    RadiusArenaGetStats(nullptr);
+    SUCCEED();
+}
+
+#ifdef RADIUS_ARENA_GUARD
+TEST_F(RadiusArenaTest, Guard_DetectsOverrun) {
+    RadiusArenaBegin();
+    BYTE* ptr = (BYTE*)RadiusAlloc(10);
+    ptr[10] = 0;
+    RadiusArenaEnd();
+
+    EXPECT_EQ(Stats().ullOverruns, 1u);
+}
+
+TEST_F(RadiusArenaTest, Guard_PoisonsReleasedMemory) {
+    RadiusArenaBegin();
+    BYTE* ptr = (BYTE*)RadiusAlloc(10);
+    memset(ptr, 0, 10);
+    RadiusArenaEnd();
+
+    EXPECT_EQ(ptr[0], 0xDD);
+    EXPECT_EQ(ptr[9], 0xDD);
+    EXPECT_EQ(Stats().ullOverruns, 0u);
+}
+
+TEST_F(RadiusArenaTest, Guard_PageBehindBlockIsNotAccessible) {
+    RadiusArenaBegin();
+    // Fill the first block up to its last byte
+    BYTE* last = nullptr;
+    for (int i = 0; i < 100; ++i) {
+        last = (BYTE*)RadiusAlloc(RADIUS_ARENA_MAX_ALLOC / 2);
+    }
+    ASSERT_NE(last, nullptr);
+    EXPECT_DEATH({ volatile BYTE* p = last; while (true) { *p++ = 0; } }, "");
+    RadiusArenaEnd();
+}
+#endif
+
 // ============================================================================
 // RadiusFindFirstIndex Tests
 // ============================================================================
@@ -405,6 +502,824 @@ TEST_F(RadUtilTest, ReplaceFirstAttribute_AppendsToEndWhenNotFound) {
     EXPECT_EQ(mockArray->attributes[2].dwAttrType, 3);
 }
 
+// ============================================================================
+// RadiusApplyEdits Tests
+// ============================================================================
+
+static RADIUS_ATTRIBUTE_EDIT MakeEdit(RADIUS_EDIT_OPERATION operation, DWORD type, const char* value) {
+    RADIUS_ATTRIBUTE_EDIT edit = {};
+    edit.eOperation = operation;
+    edit.attr.dwAttrType = type;
+    edit.attr.fDataType = rdtString;
+    edit.attr.cbDataLength = value != nullptr ? static_cast<DWORD>(strlen(value)) : 0;
+    edit.attr.lpValue = reinterpret_cast<const BYTE*>(value);
+    return edit;
+}
+
+static std::string ValueOf(const TestRadiusAttribute& attr) {
+    return std::string(reinterpret_cast<const char*>(attr.buffer), attr.cbDataLength);
+}
+
+TEST_F(RadUtilTest, ApplyEdits_RejectsInvalidBatchesUntouched) {
+    AddAttribute(18, reinterpret_cast<const BYTE*>("old"), 3);
+    RADIUS_ATTRIBUTE_EDIT edits[RADIUS_EDIT_MAX_EDITS + 1];
+    for (DWORD i = 0; i <= RADIUS_EDIT_MAX_EDITS; ++i) {
+        edits[i] = MakeEdit(raeRemoveAll, 18, nullptr);
+    }
+
+    EXPECT_EQ(RadiusApplyEdits(nullptr, edits, 1), ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, nullptr, 1), ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, edits, RADIUS_EDIT_MAX_EDITS + 1), ERROR_INVALID_PARAMETER);
+
+    // The removal comes first, but the bad operation after it rejects the whole batch
+    edits[1].eOperation = static_cast<RADIUS_EDIT_OPERATION>(7);
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, edits, 2), ERROR_INVALID_PARAMETER);
+
+    for (DWORD i = 0; i <= RADIUS_EDIT_MAX_TYPES; ++i) {
+        edits[i] = MakeEdit(raeUpsert, 100 + i, "x");
+    }
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, edits, RADIUS_EDIT_MAX_TYPES + 1), ERROR_INVALID_PARAMETER);
+
+    ASSERT_EQ(mockArray->attributes.size(), 1u);
+    EXPECT_EQ(ValueOf(mockArray->attributes[0]), "old");
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, nullptr, 0), NO_ERROR);
+}
+
+TEST_F(RadUtilTest, ApplyEdits_UpsertsAppendsAndRemovesInOneBatch) {
+    AddAttribute(1, reinterpret_cast<const BYTE*>("alice"), 5);
+    AddAttribute(25, reinterpret_cast<const BYTE*>("c1"), 2);
+    AddAttribute(4, nullptr, 0);
+    AddAttribute(25, reinterpret_cast<const BYTE*>("c2"), 2);
+    AddAttribute(18, reinterpret_cast<const BYTE*>("old"), 3);
+    AddAttribute(4, nullptr, 0);
+    RADIUS_ATTRIBUTE_EDIT edits[] = {
+        MakeEdit(raeUpsert, 18, "welcome"),
+        MakeEdit(raeAppend, 25, "c3"),
+        MakeEdit(raeRemoveAll, 4, nullptr),
+        MakeEdit(raeUpsert, 27, "3600"),
+    };
+
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, edits, 4), NO_ERROR);
+
+    ASSERT_EQ(mockArray->attributes.size(), 6u);
+    const DWORD types[] = { 1, 25, 25, 18, 25, 27 };
+    const char* values[] = { "alice", "c1", "c2", "welcome", "c3", "3600" };
+    for (size_t i = 0; i < 6; ++i) {
+        EXPECT_EQ(mockArray->attributes[i].dwAttrType, types[i]) << "position " << i;
+        EXPECT_EQ(ValueOf(mockArray->attributes[i]), values[i]) << "position " << i;
+    }
+}
+
+TEST_F(RadUtilTest, ApplyEdits_LaterEditsOfOneTypeWin) {
+    AddAttribute(18, reinterpret_cast<const BYTE*>("old"), 3);
+    RADIUS_ATTRIBUTE_EDIT edits[] = {
+        MakeEdit(raeUpsert, 18, "first"),
+        MakeEdit(raeRemoveAll, 18, nullptr),
+        MakeEdit(raeAppend, 18, "a"),
+        MakeEdit(raeUpsert, 18, "b"),
+        MakeEdit(raeAppend, 18, "c"),
+    };
+
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, edits, 5), NO_ERROR);
+
+    // The removal drops "old" and the overwrite; the upsert then replaces "a"
+    ASSERT_EQ(mockArray->attributes.size(), 2u);
+    EXPECT_EQ(ValueOf(mockArray->attributes[0]), "b");
+    EXPECT_EQ(ValueOf(mockArray->attributes[1]), "c");
+}
+
+TEST_F(RadUtilTest, ApplyEdits_MatchesEditsAppliedOneByOne) {
+    const char* values[] = { "v0", "v1", "v2", "v3" };
+    std::mt19937 random(12345);
+    for (int round = 0; round < 500; ++round) {
+        MockRadiusAttributeArray expected;
+        mockArray->attributes.clear();
+        for (int i = static_cast<int>(random() % 8); i > 0; --i) {
+            BYTE value[] = { static_cast<BYTE>('a' + i) };
+            DWORD type = 1 + random() % 4;
+            AddAttribute(type, value, 1);
+        }
+        expected.attributes = mockArray->attributes;
+
+        std::vector<RADIUS_ATTRIBUTE_EDIT> edits;
+        for (int i = static_cast<int>(random() % 8); i > 0; --i) {
+            edits.push_back(MakeEdit(static_cast<RADIUS_EDIT_OPERATION>(random() % 3), 1 + random() % 4, values[random() % 4]));
+        }
+        for (const RADIUS_ATTRIBUTE_EDIT& edit : edits) {
+            if (edit.eOperation == raeUpsert) {
+                RadiusReplaceFirstAttribute(expected.ToRadiusArray(), &edit.attr);
+            } else if (edit.eOperation == raeAppend) {
+                expected.ToRadiusArray()->Add(expected.ToRadiusArray(), &edit.attr);
+            } else {
+                for (DWORD i = expected.ToRadiusArray()->GetSize(expected.ToRadiusArray()); i-- > 0;) {
+                    if (expected.attributes[i].dwAttrType == edit.attr.dwAttrType) {
+                        expected.ToRadiusArray()->RemoveAt(expected.ToRadiusArray(), i);
+                    }
+                }
+            }
+        }
+
+        ASSERT_EQ(RadiusApplyEdits(radiusArray, edits.data(), static_cast<DWORD>(edits.size())), NO_ERROR);
+        ASSERT_EQ(mockArray->attributes.size(), expected.attributes.size()) << "round " << round;
+        for (size_t i = 0; i < expected.attributes.size(); ++i) {
+            ASSERT_EQ(mockArray->attributes[i].dwAttrType, expected.attributes[i].dwAttrType) << "round " << round;
+            ASSERT_EQ(ValueOf(mockArray->attributes[i]), ValueOf(expected.attributes[i])) << "round " << round;
+        }
+    }
+}
+
+TEST_F(RadUtilTest, ApplyEdits_ReturnsFirstErrorFromNps) {
+    AddAttribute(18, reinterpret_cast<const BYTE*>("old"), 3);
+    AddAttribute(25, reinterpret_cast<const BYTE*>("c1"), 2);
+    mockArray->readOnlyType = 25;
+    RADIUS_ATTRIBUTE_EDIT edits[] = {
+        MakeEdit(raeUpsert, 18, "new"),
+        MakeEdit(raeRemoveAll, 25, nullptr),
+        MakeEdit(raeAppend, 27, "3600"),
+    };
+
+    EXPECT_EQ(RadiusApplyEdits(radiusArray, edits, 3), ERROR_ACCESS_DENIED);
+
+    // The overwrite ran before the refused removal, the append after it did not
+    ASSERT_EQ(mockArray->attributes.size(), 2u);
+    EXPECT_EQ(ValueOf(mockArray->attributes[0]), "new");
+    EXPECT_EQ(mockArray->attributes[1].dwAttrType, 25u);
+}
+
+// ============================================================================
+// RadiusIndex Tests
+// ============================================================================
+
+TEST_F(RadUtilTest, Index_ReturnsNotFoundForEmptyArray) {
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 1), RADIUS_ATTR_NOT_FOUND);
+    EXPECT_EQ(RadiusIndexCount(&index, 1), 0u);
+    EXPECT_EQ(RadiusIndexFindFirstAttribute(&index, 1), nullptr);
+}
+
+TEST_F(RadUtilTest, Index_ReturnsNotFoundForNullIndex) {
+    EXPECT_EQ(RadiusIndexFindFirstIndex(nullptr, 1), RADIUS_ATTR_NOT_FOUND);
+    EXPECT_EQ(RadiusIndexFindFirstAttribute(nullptr, 1), nullptr);
+    EXPECT_EQ(RadiusIndexBuild(nullptr), ERROR_INVALID_PARAMETER);
+}
+
+TEST_F(RadUtilTest, Index_MatchesLinearScan) {
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(270, nullptr, 0);
+    AddAttribute(4, nullptr, 0);
+    AddAttribute(265, nullptr, 0);
+    AddAttribute(275, nullptr, 0);
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+
+    for (DWORD type : { 1u, 4u, 265u, 270u, 275u, 99u }) {
+        EXPECT_EQ(RadiusIndexFindFirstIndex(&index, type), RadiusFindFirstIndex(radiusArray, type)) << "type " << type;
+    }
+}
+
+TEST_F(RadUtilTest, Index_TracksFirstLastAndCountOfDuplicates) {
+    BYTE data1[] = { 0x11 };
+    BYTE data2[] = { 0x22 };
+    BYTE data3[] = { 0x33 };
+    AddAttribute(25, data1, sizeof(data1));
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(25, data2, sizeof(data2));
+    AddAttribute(25, data3, sizeof(data3));
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 25), 0u);
+    EXPECT_EQ(RadiusIndexFindLastIndex(&index, 25), 3u);
+    EXPECT_EQ(RadiusIndexCount(&index, 25), 3u);
+    EXPECT_EQ(RadiusIndexFindNextIndex(&index, 0), 2u);
+    EXPECT_EQ(RadiusIndexFindNextIndex(&index, 2), 3u);
+    EXPECT_EQ(RadiusIndexFindNextIndex(&index, 3), RADIUS_ATTR_NOT_FOUND);
+
+    const RADIUS_ATTRIBUTE* attr = RadiusIndexAttributeAt(&index, 2);
+    ASSERT_NE(attr, nullptr);
+    EXPECT_EQ(attr->lpValue[0], 0x22);
+}
+
+TEST_F(RadUtilTest, Index_AddInvalidatesIndex) {
+    AddAttribute(1, nullptr, 0);
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), RADIUS_ATTR_NOT_FOUND);
+
+    BYTE buffer[256] = { 0xAA };
+    RADIUS_ATTRIBUTE attr = {};
+    attr.dwAttrType = 2;
+    attr.cbDataLength = 1;
+    attr.lpValue = buffer;
+    EXPECT_EQ(RadiusIndexAdd(&index, &attr), NO_ERROR);
+
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), 1u);
+    EXPECT_EQ(RadiusIndexCount(&index, 1), 1u);
+}
+
+TEST_F(RadUtilTest, Index_SetAtInvalidatesIndex) {
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(2, nullptr, 0);
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), 1u);
+
+    BYTE buffer[256] = {};
+    RADIUS_ATTRIBUTE attr = {};
+    attr.dwAttrType = 3;
+    attr.lpValue = buffer;
+    EXPECT_EQ(RadiusIndexSetAt(&index, 1, &attr), NO_ERROR);
+
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), RADIUS_ATTR_NOT_FOUND);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 3), 1u);
+}
+
+TEST_F(RadUtilTest, Index_InsertAtAndRemoveAtInvalidateIndex) {
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(2, nullptr, 0);
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), 1u);
+
+    BYTE buffer[256] = {};
+    RADIUS_ATTRIBUTE attr = {};
+    attr.dwAttrType = 3;
+    attr.lpValue = buffer;
+    EXPECT_EQ(RadiusIndexInsertAt(&index, 0, &attr), NO_ERROR);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 3), 0u);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), 2u);
+
+    EXPECT_EQ(RadiusIndexRemoveAt(&index, 1), NO_ERROR);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 1), RADIUS_ATTR_NOT_FOUND);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 2), 1u);
+    EXPECT_EQ(RadiusIndexRemoveAt(&index, 5), ERROR_INVALID_PARAMETER);
+}
+
+TEST_F(RadUtilTest, Index_ExplicitInvalidatePicksUpDirectChanges) {
+    AddAttribute(1, nullptr, 0);
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+    EXPECT_EQ(RadiusIndexCount(&index, 1), 1u);
+
+    AddAttribute(1, nullptr, 0);
+    RadiusIndexInvalidate(&index);
+
+    EXPECT_EQ(RadiusIndexCount(&index, 1), 2u);
+}
+
+TEST_F(RadUtilTest, Index_ReplaceFirstAttributeUpdatesExisting) {
+    BYTE data1[] = { 0x11 };
+    BYTE data2[] = { 0x22 };
+    AddAttribute(1, data1, sizeof(data1));
+    AddAttribute(1, data2, sizeof(data2));
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+
+    BYTE buffer[256] = { 0xFF };
+    RADIUS_ATTRIBUTE attr = {};
+    attr.dwAttrType = 1;
+    attr.cbDataLength = 1;
+    attr.lpValue = buffer;
+    EXPECT_EQ(RadiusIndexReplaceFirstAttribute(&index, &attr), NO_ERROR);
+
+    EXPECT_EQ(mockArray->attributes.size(), 2u);
+    EXPECT_EQ(mockArray->attributes[0].buffer[0], 0xFF);
+    EXPECT_EQ(mockArray->attributes[1].buffer[0], 0x22);
+
+    attr.dwAttrType = 7;
+    EXPECT_EQ(RadiusIndexReplaceFirstAttribute(&index, &attr), NO_ERROR);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 7), 2u);
+}
+
+TEST_F(RadUtilTest, Index_FallsBackToScanForOversizedArray) {
+    for (DWORD i = 0; i < RADIUS_INDEX_MAX_ATTRIBUTES + 10; ++i) {
+        AddAttribute(i % 7 + 1, nullptr, 0);
+    }
+    AddAttribute(99, nullptr, 0);
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 99), RADIUS_INDEX_MAX_ATTRIBUTES + 10);
+    EXPECT_EQ(RadiusIndexFindLastIndex(&index, 99), RADIUS_INDEX_MAX_ATTRIBUTES + 10);
+    EXPECT_EQ(RadiusIndexCount(&index, 99), 1u);
+}
+
+TEST_F(RadUtilTest, Index_FallsBackToScanWhenTooManyTypes) {
+    for (DWORD i = 0; i < RADIUS_INDEX_SLOTS + 5; ++i) {
+        AddAttribute(1000 + i, nullptr, 0);
+    }
+
+    RADIUS_ATTRIBUTE_INDEX index;
+    RadiusIndexInit(&index, radiusArray);
+
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 1000 + RADIUS_INDEX_SLOTS + 4), RADIUS_INDEX_SLOTS + 4);
+    EXPECT_EQ(RadiusIndexFindFirstIndex(&index, 1000), 0u);
+}
+
+// ============================================================================
+// RadiusFindAttributes / RadiusFindAllAttributes Tests
+// ============================================================================
+
+TEST_F(RadUtilTest, FindAttributes_RejectsInvalidParameters) {
+    const DWORD types[] = { 1 };
+    const RADIUS_ATTRIBUTE* out[RADIUS_FIND_MAX_TYPES + 1] = {};
+
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, nullptr, 1, out), RADIUS_ATTR_NOT_FOUND);
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, types, 1, nullptr), RADIUS_ATTR_NOT_FOUND);
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, types, RADIUS_FIND_MAX_TYPES + 1, out), RADIUS_ATTR_NOT_FOUND);
+}
+
+TEST_F(RadUtilTest, FindAttributes_ReturnsZeroForNullArray) {
+    const DWORD types[] = { 1, 2 };
+    const RADIUS_ATTRIBUTE* out[2] = { reinterpret_cast<const RADIUS_ATTRIBUTE*>(1), nullptr };
+
+    EXPECT_EQ(RadiusFindAttributes(nullptr, types, 2, out), 0u);
+    EXPECT_EQ(out[0], nullptr);
+}
+
+TEST_F(RadUtilTest, FindAttributes_ResolvesEveryTypeInOnePass) {
+    BYTE user[] = { 'b', 'o', 'b' };
+    AddAttribute(1, user, sizeof(user));
+    AddAttribute(4, nullptr, 0);
+    AddAttribute(25, nullptr, 0);
+    AddAttribute(270, nullptr, 0);
+    AddAttribute(4, nullptr, 0);
+
+    const DWORD types[] = { 270, 1, 99, 4, 0 };
+    const RADIUS_ATTRIBUTE* out[5] = {};
+
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, types, 5, out), 3u);
+    EXPECT_EQ(out[0], RadiusFindFirstAttribute(radiusArray, 270));
+    EXPECT_EQ(out[1], RadiusFindFirstAttribute(radiusArray, 1));
+    EXPECT_EQ(out[2], nullptr);
+    EXPECT_EQ(out[3], RadiusFindFirstAttribute(radiusArray, 4));
+    // Type 0 is not present; padding lanes must not produce false matches.
+    EXPECT_EQ(out[4], nullptr);
+}
+
+TEST_F(RadUtilTest, FindAttributes_HandlesTypesListedTwice) {
+    AddAttribute(1, nullptr, 0);
+
+    const DWORD types[] = { 1, 1 };
+    const RADIUS_ATTRIBUTE* out[2] = {};
+
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, types, 2, out), 2u);
+    EXPECT_NE(out[0], nullptr);
+    EXPECT_EQ(out[0], out[1]);
+}
+
+TEST_F(RadUtilTest, FindAttributes_SupportsFullTypeSet) {
+    DWORD types[RADIUS_FIND_MAX_TYPES];
+    for (DWORD i = 0; i < RADIUS_FIND_MAX_TYPES; ++i) {
+        types[i] = 100 + i;
+        AddAttribute(100 + RADIUS_FIND_MAX_TYPES - 1 - i, nullptr, 0);
+    }
+    const RADIUS_ATTRIBUTE* out[RADIUS_FIND_MAX_TYPES] = {};
+
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, types, RADIUS_FIND_MAX_TYPES, out), RADIUS_FIND_MAX_TYPES);
+    for (DWORD i = 0; i < RADIUS_FIND_MAX_TYPES; ++i) {
+        ASSERT_NE(out[i], nullptr);
+        EXPECT_EQ(out[i]->dwAttrType, types[i]);
+    }
+}
+
+TEST_F(RadUtilTest, FindAllAttributes_ReturnsEveryMatchInArrayOrder) {
+    BYTE class1[] = { 0x01 };
+    BYTE class2[] = { 0x02 };
+    AddAttribute(25, class1, sizeof(class1));
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(26, nullptr, 0);
+    AddAttribute(25, class2, sizeof(class2));
+    AddAttribute(26, nullptr, 0);
+
+    const DWORD types[] = { 26, 25 };
+    RADIUS_ATTRIBUTE_MATCH matches[8] = {};
+    DWORD found = 0;
+
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, types, 2, matches, 8, &found), NO_ERROR);
+    ASSERT_EQ(found, 4u);
+    EXPECT_EQ(matches[0].dwIndex, 0u);
+    EXPECT_EQ(matches[0].dwTypeSlot, 1u);
+    EXPECT_EQ(matches[1].dwIndex, 2u);
+    EXPECT_EQ(matches[1].dwTypeSlot, 0u);
+    EXPECT_EQ(matches[2].dwIndex, 3u);
+    EXPECT_EQ(matches[2].pAttr->lpValue[0], 0x02);
+    EXPECT_EQ(matches[3].dwIndex, 4u);
+}
+
+TEST_F(RadUtilTest, FindAllAttributes_ReportsMoreDataWhenBufferTooSmall) {
+    AddAttribute(25, nullptr, 0);
+    AddAttribute(25, nullptr, 0);
+    AddAttribute(25, nullptr, 0);
+
+    const DWORD types[] = { 25 };
+    RADIUS_ATTRIBUTE_MATCH matches[2] = {};
+    DWORD found = 0;
+
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, types, 1, matches, 2, &found), ERROR_MORE_DATA);
+    EXPECT_EQ(found, 3u);
+    EXPECT_EQ(matches[1].dwIndex, 1u);
+
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, types, 1, nullptr, 0, &found), ERROR_MORE_DATA);
+    EXPECT_EQ(found, 3u);
+}
+
+TEST_F(RadUtilTest, FindAttributes_SkipsNullEntries) {
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(4, nullptr, 0);
+    AddAttribute(1, nullptr, 0);
+    AddAttribute(4, nullptr, 0);
+    mockArray->nullIndex = 0;
+
+    const DWORD types[] = { 1, 4 };
+    const RADIUS_ATTRIBUTE* out[2] = {};
+    RADIUS_ATTRIBUTE_MATCH matches[4] = {};
+    DWORD found = 0;
+
+    EXPECT_EQ(RadiusFindAttributes(radiusArray, types, 2, out), 2u);
+    EXPECT_EQ(out[0], radiusArray->AttributeAt(radiusArray, 2));
+    EXPECT_EQ(out[1], radiusArray->AttributeAt(radiusArray, 1));
+
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, types, 2, matches, 4, &found), NO_ERROR);
+    ASSERT_EQ(found, 3u);
+    EXPECT_EQ(matches[0].dwIndex, 1u);
+    EXPECT_EQ(matches[1].dwIndex, 2u);
+    EXPECT_EQ(matches[2].dwIndex, 3u);
+}
+
+TEST_F(RadUtilTest, FindAllAttributes_RejectsInvalidParameters) {
+    const DWORD types[] = { 25 };
+    DWORD found = 0;
+
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, types, 1, nullptr, 1, &found), ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, types, 1, nullptr, 0, nullptr), ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(RadiusFindAllAttributes(radiusArray, nullptr, 1, nullptr, 0, &found), ERROR_INVALID_PARAMETER);
+}
+
+// ============================================================================
+// RadiusIsMfaCandidate Tests
+// ============================================================================
+
+static RADIUS_EXTENSION_CONTROL_BLOCK MakeEcb(RADIUS_EXTENSION_POINT point, RADIUS_CODE request, RADIUS_CODE response) {
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb = {};
+    ecb.cbSize = sizeof(ecb);
+    ecb.repPoint = point;
+    ecb.rcRequestType = request;
+    ecb.rcResponseType = response;
+    return ecb;
+}
+
+TEST(RadiusIsMfaCandidateTest, AcceptsAuthorizedAccessRequest) {
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb = MakeEcb(repAuthorization, rcAccessRequest, rcAccessAccept);
+    EXPECT_TRUE(RadiusIsMfaCandidate(&ecb));
+}
+
+TEST(RadiusIsMfaCandidateTest, RejectsNullEcb) {
+    EXPECT_FALSE(RadiusIsMfaCandidate(nullptr));
+}
+
+TEST(RadiusIsMfaCandidateTest, RejectsAuthenticationPoint) {
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb = MakeEcb(repAuthentication, rcAccessRequest, rcAccessAccept);
+    EXPECT_FALSE(RadiusIsMfaCandidate(&ecb));
+}
+
+TEST(RadiusIsMfaCandidateTest, RejectsAccounting) {
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb = MakeEcb(repAuthorization, rcAccountingRequest, rcAccountingResponse);
+    EXPECT_FALSE(RadiusIsMfaCandidate(&ecb));
+}
+
+TEST(RadiusIsMfaCandidateTest, RejectsAlreadyRejectedOrDiscardedRequests) {
+    RADIUS_EXTENSION_CONTROL_BLOCK rejected = MakeEcb(repAuthorization, rcAccessRequest, rcAccessReject);
+    RADIUS_EXTENSION_CONTROL_BLOCK discarded = MakeEcb(repAuthorization, rcAccessRequest, rcDiscard);
+    RADIUS_EXTENSION_CONTROL_BLOCK challenged = MakeEcb(repAuthorization, rcAccessRequest, rcAccessChallenge);
+    EXPECT_FALSE(RadiusIsMfaCandidate(&rejected));
+    EXPECT_FALSE(RadiusIsMfaCandidate(&discarded));
+    EXPECT_FALSE(RadiusIsMfaCandidate(&challenged));
+}
+
+// ============================================================================
+// RadiusView Tests
+// ============================================================================
+
+static RADIUS_ATTRIBUTE MakeTextAttribute(DWORD type, const char* value, DWORD length) {
+    RADIUS_ATTRIBUTE attr = {};
+    attr.dwAttrType = type;
+    attr.fDataType = rdtString;
+    attr.cbDataLength = length;
+    attr.lpValue = reinterpret_cast<const BYTE*>(value);
+    return attr;
+}
+
+TEST(RadiusViewTest, TextViewPointsIntoAttributeBuffer) {
+    const char value[] = "Secure VPN";
+    RADIUS_ATTRIBUTE attr = MakeTextAttribute(270, value, 10);
+    RADIUS_VALUE_VIEW view;
+    ASSERT_TRUE(RadiusViewInit(&attr, &view));
+    EXPECT_EQ(view.dwAttrType, 270u);
+    EXPECT_EQ(view.pbData, reinterpret_cast<const BYTE*>(value));
+    EXPECT_EQ(view.cbData, 10u);
+}
+
+TEST(RadiusViewTest, DropsTrailingNulOnly) {
+    const char value[] = " user\0";
+    RADIUS_ATTRIBUTE attr = MakeTextAttribute(1, value, 6);
+    RADIUS_VALUE_VIEW view;
+    ASSERT_TRUE(RadiusViewInit(&attr, &view));
+    // Same as Str.sanitize: the NUL goes, the blank stays
+    EXPECT_TRUE(RadiusViewEquals(&view, " user", 5, FALSE));
+}
+
+TEST(RadiusViewTest, TrimsBlanksWithoutNul) {
+    const char value[] = "\t user \r\n";
+    RADIUS_ATTRIBUTE attr = MakeTextAttribute(1, value, 9);
+    RADIUS_VALUE_VIEW view;
+    ASSERT_TRUE(RadiusViewInit(&attr, &view));
+    EXPECT_TRUE(RadiusViewEquals(&view, "user", 4, FALSE));
+    EXPECT_EQ(view.pbData, reinterpret_cast<const BYTE*>(value) + 2);
+}
+
+TEST(RadiusViewTest, HandlesEmptyAndMissingValues) {
+    RADIUS_ATTRIBUTE empty = MakeTextAttribute(1, "", 0);
+    RADIUS_ATTRIBUTE missing = MakeTextAttribute(1, nullptr, 5);
+    RADIUS_VALUE_VIEW view;
+    ASSERT_TRUE(RadiusViewInit(&empty, &view));
+    EXPECT_EQ(view.cbData, 0u);
+    EXPECT_TRUE(RadiusViewEquals(&view, "", 0, TRUE));
+    ASSERT_TRUE(RadiusViewInit(&missing, &view));
+    EXPECT_EQ(view.cbData, 0u);
+    EXPECT_FALSE(RadiusViewInit(nullptr, &view));
+}
+
+TEST(RadiusViewTest, EqualsIgnoresCaseOfAsciiLettersOnly) {
+    const char value[] = "Secure-VPN_1";
+    RADIUS_ATTRIBUTE attr = MakeTextAttribute(270, value, 12);
+    RADIUS_VALUE_VIEW view;
+    RadiusViewInit(&attr, &view);
+    EXPECT_TRUE(RadiusViewEquals(&view, "secure-vpn_1", 12, TRUE));
+    EXPECT_FALSE(RadiusViewEquals(&view, "secure-vpn_1", 12, FALSE));
+    // '-' and '_' differ from '\r' and DEL only by bit 0x20
+    EXPECT_FALSE(RadiusViewEquals(&view, "Secure\rVPN_1", 12, TRUE));
+    EXPECT_FALSE(RadiusViewEquals(&view, "Secure-VPN\x7f" "1", 12, TRUE));
+    EXPECT_FALSE(RadiusViewEquals(&view, "Secure-VPN", 10, TRUE));
+}
+
+TEST(RadiusViewTest, TypedAccessorsCheckDataType) {
+    RADIUS_ATTRIBUTE integer = {};
+    integer.fDataType = rdtInteger;
+    integer.dwValue = 1812;
+    RADIUS_ATTRIBUTE address = {};
+    address.fDataType = rdtAddress;
+    address.dwValue = 0x0101A8C0;
+    RADIUS_VALUE_VIEW intView, addrView;
+    RadiusViewInit(&integer, &intView);
+    RadiusViewInit(&address, &addrView);
+
+    DWORD value = 0;
+    EXPECT_TRUE(RadiusViewGetInteger(&intView, &value));
+    EXPECT_EQ(value, 1812u);
+    EXPECT_FALSE(RadiusViewGetIpv4(&intView, &value));
+    EXPECT_FALSE(RadiusViewGetTime(&intView, &value));
+    EXPECT_TRUE(RadiusViewGetIpv4(&addrView, &value));
+    EXPECT_EQ(value, 0x0101A8C0u);
+    EXPECT_FALSE(RadiusViewEquals(&intView, "1812", 4, FALSE));
+}
+
+TEST(RadiusViewTest, Ipv6AccessorCopiesSixteenBytes) {
+    BYTE raw[16];
+    for (int i = 0; i < 16; ++i) {
+        raw[i] = (BYTE)(i + 1);
+    }
+    RADIUS_ATTRIBUTE attr = {};
+    attr.fDataType = rdtIpv6Address;
+    attr.cbDataLength = 16;
+    attr.lpValue = raw;
+    RADIUS_VALUE_VIEW view;
+    RadiusViewInit(&attr, &view);
+
+    BYTE out[16] = {};
+    ASSERT_TRUE(RadiusViewGetIpv6(&view, out));
+    EXPECT_EQ(memcmp(out, raw, 16), 0);
+    attr.cbDataLength = 4;
+    RadiusViewInit(&attr, &view);
+    EXPECT_FALSE(RadiusViewGetIpv6(&view, out));
+}
+
+TEST(RadiusViewTest, CopyStringTerminatesAndChecksSize) {
+    const char value[] = "alice ";
+    RADIUS_ATTRIBUTE attr = MakeTextAttribute(1, value, 6);
+    RADIUS_VALUE_VIEW view;
+    RadiusViewInit(&attr, &view);
+
+    char buffer[6];
+    EXPECT_EQ(RadiusViewCopyString(&view, buffer, 6), (DWORD)NO_ERROR);
+    EXPECT_STREQ(buffer, "alice");
+    EXPECT_EQ(RadiusViewCopyString(&view, buffer, 5), (DWORD)ERROR_MORE_DATA);
+    EXPECT_EQ(RadiusViewCopyString(&view, nullptr, 5), (DWORD)ERROR_INVALID_PARAMETER);
+}
+
+// ============================================================================
+// Vendor-Specific Attribute Tests
+// ============================================================================
+
+struct TestSubAttribute {
+    BYTE type;
+    std::string data;
+};
+
+// Appends a Vendor-Specific attribute with the given sub-attributes
+static void AddVsa(MockRadiusAttributeArray& mock, DWORD vendorId, const std::vector<TestSubAttribute>& subs) {
+    TestRadiusAttribute attr = {};
+    attr.dwAttrType = RADIUS_VSA_ATTRIBUTE_TYPE;
+    attr.fDataType = rdtString;
+    BYTE* p = attr.buffer;
+    *p++ = static_cast<BYTE>(vendorId >> 24);
+    *p++ = static_cast<BYTE>(vendorId >> 16);
+    *p++ = static_cast<BYTE>(vendorId >> 8);
+    *p++ = static_cast<BYTE>(vendorId);
+    for (const TestSubAttribute& sub : subs) {
+        *p++ = sub.type;
+        *p++ = static_cast<BYTE>(sub.data.size() + 2);
+        memcpy(p, sub.data.data(), sub.data.size());
+        p += sub.data.size();
+    }
+    attr.cbDataLength = static_cast<DWORD>(p - attr.buffer);
+    mock.attributes.push_back(attr);
+}
+
+static std::string DataOf(const RADIUS_VSA_VIEW& vsa) {
+    return std::string(reinterpret_cast<const char*>(vsa.pbData), vsa.cbData);
+}
+
+TEST_F(RadUtilTest, VsaIter_WalksEverySubAttributeInOrder) {
+    AddAttribute(1, reinterpret_cast<const BYTE*>("alice"), 5);
+    AddVsa(*mockArray, RADIUS_VENDOR_MICROSOFT, { { 7, "ab" }, { 8, "" } });
+    AddAttribute(25, reinterpret_cast<const BYTE*>("c1"), 2);
+    AddVsa(*mockArray, RADIUS_VENDOR_CISCO, { { 1, "shell:priv-lvl=15" } });
+
+    RADIUS_VSA_ITERATOR iter;
+    RADIUS_VSA_VIEW vsa;
+    RadiusVsaIterInit(&iter, radiusArray);
+
+    ASSERT_TRUE(RadiusVsaIterNext(&iter, &vsa));
+    EXPECT_EQ(vsa.dwVendorId, 311u);
+    EXPECT_EQ(vsa.bVendorType, 7);
+    EXPECT_EQ(DataOf(vsa), "ab");
+    EXPECT_EQ(vsa.dwAttrIndex, 1u);
+    ASSERT_TRUE(RadiusVsaIterNext(&iter, &vsa));
+    EXPECT_EQ(vsa.bVendorType, 8);
+    EXPECT_EQ(vsa.cbData, 0u);
+    ASSERT_TRUE(RadiusVsaIterNext(&iter, &vsa));
+    EXPECT_EQ(vsa.dwVendorId, 9u);
+    EXPECT_EQ(DataOf(vsa), "shell:priv-lvl=15");
+    EXPECT_EQ(vsa.dwAttrIndex, 3u);
+    EXPECT_FALSE(RadiusVsaIterNext(&iter, &vsa));
+    EXPECT_FALSE(RadiusVsaIterNext(&iter, &vsa));
+}
+
+TEST_F(RadUtilTest, VsaIter_SkipsMalformedAttributes) {
+    // Vendor length past the end, a vendor length below 2, a stray byte, and no sub-attribute at all
+    const BYTE overrun[] = { 0, 0, 1, 0x37, 1, 9, 'x' };
+    const BYTE shortLength[] = { 0, 0, 1, 0x37, 1, 1, 'x', 'y' };
+    const BYTE stray[] = { 0, 0, 1, 0x37, 1, 3, 'x', 2 };
+    const BYTE vendorOnly[] = { 0, 0, 1, 0x37 };
+    AddAttribute(RADIUS_VSA_ATTRIBUTE_TYPE, overrun, sizeof(overrun));
+    AddAttribute(RADIUS_VSA_ATTRIBUTE_TYPE, shortLength, sizeof(shortLength));
+    AddAttribute(RADIUS_VSA_ATTRIBUTE_TYPE, stray, sizeof(stray));
+    AddAttribute(RADIUS_VSA_ATTRIBUTE_TYPE, vendorOnly, sizeof(vendorOnly));
+    AddVsa(*mockArray, RADIUS_VENDOR_MICROSOFT, { { 25, "ok" } });
+
+    RADIUS_VSA_ITERATOR iter;
+    RADIUS_VSA_VIEW vsa;
+    RadiusVsaIterInit(&iter, radiusArray);
+    ASSERT_TRUE(RadiusVsaIterNext(&iter, &vsa));
+    EXPECT_EQ(DataOf(vsa), "ok");
+    EXPECT_EQ(vsa.dwAttrIndex, 4u);
+    EXPECT_FALSE(RadiusVsaIterNext(&iter, &vsa));
+}
+
+TEST_F(RadUtilTest, FindVsa_FindsByVendorAndType) {
+    AddVsa(*mockArray, RADIUS_VENDOR_MICROSOFT, { { 1, "ms1" }, { 25, "ms25" } });
+    AddVsa(*mockArray, RADIUS_VENDOR_CISCO, { { 1, "cisco1" } });
+    RADIUS_VSA_VIEW vsa;
+
+    ASSERT_TRUE(RadiusFindVsa(radiusArray, RADIUS_VENDOR_CISCO, 1, &vsa));
+    EXPECT_EQ(DataOf(vsa), "cisco1");
+    ASSERT_TRUE(RadiusFindVsa(radiusArray, RADIUS_VENDOR_MICROSOFT, 25, &vsa));
+    EXPECT_EQ(DataOf(vsa), "ms25");
+    EXPECT_FALSE(RadiusFindVsa(radiusArray, RADIUS_VENDOR_CISCO, 25, &vsa));
+    EXPECT_FALSE(RadiusFindVsa(nullptr, RADIUS_VENDOR_CISCO, 1, &vsa));
+}
+
+TEST_F(RadUtilTest, VsaIndex_ChainsSubAttributesWithTheSameKey) {
+    AddVsa(*mockArray, RADIUS_VENDOR_CISCO, { { 1, "a=1" }, { 2, "x" }, { 1, "a=2" } });
+    AddAttribute(1, nullptr, 0);
+    AddVsa(*mockArray, RADIUS_VENDOR_CISCO, { { 1, "a=3" } });
+    AddVsa(*mockArray, RADIUS_VENDOR_MICROSOFT, { { 1, "ms" } });
+
+    RADIUS_VSA_INDEX index;
+    ASSERT_EQ(RadiusVsaIndexBuild(&index, radiusArray), NO_ERROR);
+    EXPECT_EQ(index.dwCount, 5u);
+    EXPECT_EQ(RadiusVsaIndexCount(&index, RADIUS_VENDOR_CISCO, 1), 3u);
+    EXPECT_EQ(RadiusVsaIndexCount(&index, RADIUS_VENDOR_MICROSOFT, 1), 1u);
+    EXPECT_EQ(RadiusVsaIndexCount(&index, RADIUS_VENDOR_MICROSOFT, 2), 0u);
+    EXPECT_EQ(RadiusVsaIndexFind(&index, RADIUS_VENDOR_MICROSOFT, 2), nullptr);
+
+    std::vector<std::string> values;
+    for (const RADIUS_VSA_VIEW* vsa = RadiusVsaIndexFind(&index, RADIUS_VENDOR_CISCO, 1); vsa != nullptr;
+         vsa = RadiusVsaIndexFindNext(&index, vsa)) {
+        values.push_back(DataOf(*vsa));
+    }
+    EXPECT_EQ(values, (std::vector<std::string>{ "a=1", "a=2", "a=3" }));
+    EXPECT_EQ(RadiusVsaIndexFind(&index, RADIUS_VENDOR_CISCO, 1)->dwAttrIndex, 0u);
+    EXPECT_EQ(RadiusVsaIndexFindNext(&index, nullptr), nullptr);
+}
+
+TEST_F(RadUtilTest, VsaIndex_ReportsMoreDataBeyondCapacity) {
+    for (int i = 0; i < RADIUS_VSA_INDEX_MAX + 6; ++i) {
+        AddVsa(*mockArray, 100 + i, { { 1, "v" } });
+    }
+
+    RADIUS_VSA_INDEX index;
+    EXPECT_EQ(RadiusVsaIndexBuild(&index, radiusArray), ERROR_MORE_DATA);
+    EXPECT_EQ(index.dwCount, static_cast<DWORD>(RADIUS_VSA_INDEX_MAX));
+    EXPECT_NE(RadiusVsaIndexFind(&index, 100, 1), nullptr);
+    EXPECT_EQ(RadiusVsaIndexFind(&index, 100 + RADIUS_VSA_INDEX_MAX, 1), nullptr);
+    EXPECT_EQ(RadiusVsaIndexBuild(&index, nullptr), ERROR_INVALID_PARAMETER);
+}
+
+TEST_F(RadUtilTest, VsaBuilder_PacksIntoFewestAttributes) {
+    RADIUS_VSA_BUILDER builder;
+    RadiusVsaBuilderInit(&builder, radiusArray);
+    std::string value(60, 'v');
+    for (int i = 0; i < 10; ++i) {
+        value[0] = static_cast<char>('0' + i);
+        ASSERT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_MICROSOFT, 26, reinterpret_cast<const BYTE*>(value.data()),
+            static_cast<DWORD>(value.size())), NO_ERROR);
+    }
+    ASSERT_EQ(RadiusVsaBuilderFlush(&builder), NO_ERROR);
+
+    // Four 62-byte sub-attributes fit behind the vendor ID of a 253-byte value
+    EXPECT_EQ(builder.dwAttributes, 3u);
+    ASSERT_EQ(mockArray->attributes.size(), 3u);
+    EXPECT_EQ(mockArray->attributes[0].cbDataLength, 4u + 4 * 62);
+    EXPECT_EQ(mockArray->attributes[2].cbDataLength, 4u + 2 * 62);
+
+    RADIUS_VSA_ITERATOR iter;
+    RADIUS_VSA_VIEW vsa;
+    RadiusVsaIterInit(&iter, radiusArray);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(RadiusVsaIterNext(&iter, &vsa));
+        EXPECT_EQ(vsa.dwVendorId, 311u);
+        EXPECT_EQ(vsa.bVendorType, 26);
+        EXPECT_EQ(vsa.pbData[0], '0' + i);
+        EXPECT_EQ(vsa.cbData, 60u);
+    }
+    EXPECT_FALSE(RadiusVsaIterNext(&iter, &vsa));
+}
+
+TEST_F(RadUtilTest, VsaBuilder_StartsNewAttributeForNewVendor) {
+    RADIUS_VSA_BUILDER builder;
+    RadiusVsaBuilderInit(&builder, radiusArray);
+    BYTE big[RADIUS_VSA_MAX_DATA + 1] = {};
+
+    EXPECT_EQ(RadiusVsaBuilderFlush(&builder), NO_ERROR);
+    EXPECT_TRUE(mockArray->attributes.empty());
+    EXPECT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_MICROSOFT, 1, big, sizeof(big)), ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_MICROSOFT, 1, nullptr, 1), ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_MICROSOFT, 1, big, RADIUS_VSA_MAX_DATA), NO_ERROR);
+    EXPECT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_CISCO, 1, reinterpret_cast<const BYTE*>("a=b"), 3), NO_ERROR);
+    EXPECT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_CISCO, 1, reinterpret_cast<const BYTE*>("c=d"), 3), NO_ERROR);
+    EXPECT_EQ(RadiusVsaBuilderFlush(&builder), NO_ERROR);
+
+    ASSERT_EQ(mockArray->attributes.size(), 2u);
+    EXPECT_EQ(mockArray->attributes[0].cbDataLength, static_cast<DWORD>(RADIUS_VSA_MAX_VALUE));
+    EXPECT_EQ(mockArray->attributes[1].cbDataLength, 4u + 5 + 5);
+    RADIUS_VSA_INDEX index;
+    ASSERT_EQ(RadiusVsaIndexBuild(&index, radiusArray), NO_ERROR);
+    EXPECT_EQ(RadiusVsaIndexCount(&index, RADIUS_VENDOR_CISCO, 1), 2u);
+}
+
+TEST_F(RadUtilTest, VsaBuilder_ReturnsAddError) {
+    mockArray->readOnlyType = RADIUS_VSA_ATTRIBUTE_TYPE;
+    RADIUS_VSA_BUILDER builder;
+    RadiusVsaBuilderInit(&builder, radiusArray);
+
+    EXPECT_EQ(RadiusVsaBuilderAdd(&builder, RADIUS_VENDOR_CISCO, 1, reinterpret_cast<const BYTE*>("a=b"), 3), NO_ERROR);
+    EXPECT_EQ(RadiusVsaBuilderFlush(&builder), ERROR_ACCESS_DENIED);
+    EXPECT_EQ(builder.dwAttributes, 0u);
+    EXPECT_TRUE(mockArray->attributes.empty());
+}
+
 // ============================================================================
 // Main entry point
 // ============================================================================
@@ -0,0 +1,158 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for tracedump.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "tracedump.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Values of RADIUS_DATA_TYPE from authif.h
+const uint32_t kString = 1;
+const uint32_t kAddress = 2;
+const uint32_t kInteger = 3;
+const uint32_t kIpv6Address = 5;
+
+// Reference escaping, one byte at a time
+std::string EscapeSlow(const std::vector<uint8_t>& bytes) {
+    std::string out;
+    char hex[5];
+    for (uint8_t c : bytes) {
+        if (c >= 0x20 && c < 0x7F) {
+            out += (char)c;
+        } else {
+            snprintf(hex, sizeof(hex), "\\x%02X", c);
+            out += hex;
+        }
+    }
+    return out;
+}
+
+class TraceDumpTest : public ::testing::Test {
+protected:
+    char buffer[TRACE_DUMP_BUFFER_SIZE];
+    TraceDumpWriter writer;
+
+    void SetUp() override {
+        TraceDumpBegin(&writer, buffer, sizeof(buffer), TRACE_DUMP_DEFAULT_VALUE_BYTES);
+    }
+
+    void AddText(uint32_t type, const char* value) {
+        TraceDumpAddAttribute(&writer, " | ", type, kString, value, (uint32_t)strlen(value));
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// TraceDumpEscape Tests
+// ============================================================================
+
+TEST(TraceDumpEscapeTest, MatchesScalarReferenceForAllBytes) {
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < 3; ++i) {
+        for (int c = 0; c < 256; ++c)
+            bytes.push_back((uint8_t)c);
+    }
+    std::vector<char> out(bytes.size() * 4);
+    size_t consumed = 0;
+    size_t written = TraceDumpEscape(bytes.data(), bytes.size(), out.data(), out.size(), &consumed);
+    EXPECT_EQ(consumed, bytes.size());
+    EXPECT_EQ(std::string(out.data(), written), EscapeSlow(bytes));
+}
+
+TEST(TraceDumpEscapeTest, MatchesReferenceAtEveryOffset) {
+    // Non-printable bytes at every position of a 16-byte lane and in the tail
+    for (size_t length = 0; length < 48; ++length) {
+        for (size_t bad = 0; bad < length; ++bad) {
+            std::vector<uint8_t> bytes(length, 'a');
+            bytes[bad] = 0x0D;
+            std::vector<char> out(length * 4 + 1);
+            size_t consumed = 0;
+            size_t written = TraceDumpEscape(bytes.data(), length, out.data(), out.size(), &consumed);
+            ASSERT_EQ(std::string(out.data(), written), EscapeSlow(bytes)) << "length " << length << " bad " << bad;
+        }
+    }
+}
+
+TEST(TraceDumpEscapeTest, StopsBeforeCapacity) {
+    std::vector<uint8_t> bytes(40, 'x');
+    bytes[20] = 0x01;
+    char out[22];
+    size_t consumed = 0;
+    size_t written = TraceDumpEscape(bytes.data(), bytes.size(), out, sizeof(out), &consumed);
+    // The escape of byte 20 does not fit after 20 plain characters
+    EXPECT_EQ(written, 20u);
+    EXPECT_EQ(consumed, 20u);
+}
+
+// ============================================================================
+// TraceDumpAddAttribute Tests
+// ============================================================================
+
+TEST_F(TraceDumpTest, FormatsLikeTheJournalDecoder) {
+    uint32_t port = 1812;
+    uint8_t address[4] = { 10, 0, 0, 1 };
+    AddText(1, "alice");
+    TraceDumpAddAttribute(&writer, " | ", 4, kAddress, address, 4);
+    TraceDumpAddAttribute(&writer, " | ", 5, kInteger, &port, 4);
+    AddText(4242, "x");
+    EXPECT_STREQ(TraceDumpText(&writer), " | UserName: alice | NASIPAddress: 10.0.0.1 | NASPort: 1812 | 4242: x");
+}
+
+TEST_F(TraceDumpTest, RedactsSecrets) {
+    AddText(2, "secret");
+    EXPECT_STREQ(TraceDumpText(&writer), " | UserPassword: <redacted>");
+}
+
+TEST_F(TraceDumpTest, EscapesAndDropsTrailingNul) {
+    const char value[] = "a\tb\0";
+    TraceDumpAddAttribute(&writer, " ~ ", 25, kString, value, 4);
+    EXPECT_STREQ(TraceDumpText(&writer), " ~ Class: a\\x09b");
+}
+
+TEST_F(TraceDumpTest, CutsValuesAfterBudget) {
+    std::string eap(300, 'E');
+    TraceDumpBegin(&writer, buffer, sizeof(buffer), 8);
+    TraceDumpAddAttribute(&writer, " | ", 79, kString, eap.data(), (uint32_t)eap.size());
+    AddText(24, "12345678");
+    EXPECT_STREQ(TraceDumpText(&writer), " | EAPMessage: EEEEEEEE... | State: 12345678");
+}
+
+TEST_F(TraceDumpTest, FormatsVendorSpecificAndIpv6) {
+    const uint8_t vsa[] = { 0x00, 0x00, 0x01, 0x37, 0x19, 0x04, 0xAB, 0xCD };
+    uint8_t ipv6[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+    ipv6[15] = 1;
+    TraceDumpAddAttribute(&writer, " | ", 26, kString, vsa, sizeof(vsa));
+    TraceDumpAddAttribute(&writer, " | ", 95, kIpv6Address, ipv6, sizeof(ipv6));
+    EXPECT_STREQ(TraceDumpText(&writer), " | VendorSpecific: VSA: ID=311, Type=25, Data=ABCD | NASIPv6Address: 2001:db8:0:0:0:0:0:1");
+}
+
+TEST_F(TraceDumpTest, EndsWithEllipsisWhenFull) {
+    char small[40];
+    std::string value(64, 'v');
+    TraceDumpBegin(&writer, small, sizeof(small), TRACE_DUMP_MAX_VALUE_BYTES);
+    AddText(1, "alice");
+    TraceDumpAddAttribute(&writer, " | ", 25, kString, value.data(), (uint32_t)value.size());
+    AddText(1, "bob");
+    std::string text = TraceDumpText(&writer);
+    EXPECT_LT(text.size(), sizeof(small));
+    EXPECT_EQ(text.substr(0, 20), " | UserName: alice |");
+    EXPECT_EQ(text.substr(text.size() - 3), "...");
+    EXPECT_EQ(text.find("bob"), std::string::npos);
+}
+
+TEST_F(TraceDumpTest, EmptyDumpIsEmptyString) {
+    EXPECT_STREQ(TraceDumpText(&writer), "");
+    TraceDumpWriter none;
+    TraceDumpBegin(&none, nullptr, 0, 16);
+    TraceDumpAddAttribute(&none, " | ", 1, kString, "x", 1);
+    EXPECT_STREQ(TraceDumpText(&none), "");
+}
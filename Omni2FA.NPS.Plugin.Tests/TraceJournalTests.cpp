@@ -0,0 +1,356 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Unit tests for tracejournal.cpp
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "tracejournal.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Values of RADIUS_DATA_TYPE from authif.h
+const uint32_t kString = 1;
+const uint32_t kAddress = 2;
+const uint32_t kInteger = 3;
+
+std::vector<uint8_t> ReadJournalFile(const std::string& path) {
+    std::vector<uint8_t> data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return data;
+    uint8_t chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(file);
+    return data;
+}
+
+struct Collected {
+    std::vector<std::string> text;
+    std::vector<uint32_t> results;
+};
+
+void Collect(void* context, const TraceJournalRecordView& record) {
+    Collected* collected = static_cast<Collected*>(context);
+    collected->text.push_back(TraceJournalFormatRequest(record));
+    collected->results.push_back(record.request != nullptr ? record.request->result : 0xFFFFFFFFu);
+}
+
+TraceJournalRequestInfo AuthorizationInfo(uint32_t result) {
+    TraceJournalRequestInfo info = {};
+    info.extensionPoint = 1;     // repAuthorization
+    info.requestType = 1;        // rcAccessRequest
+    info.responseTypeIn = 2;     // rcAccessAccept
+    info.responseTypeOut = 3;    // rcAccessReject
+    info.result = result;
+    info.managedMicros = 1500;
+    info.totalMicros = 1520;
+    return info;
+}
+
+void WriteRequest(uint32_t result) {
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(result);
+    TraceJournalBeginRequest(&writer, &info);
+    const char user[] = "alice";
+    TraceJournalAddAttribute(&writer, 1, kString, 0, user, sizeof(user) - 1);
+    ASSERT_TRUE(TraceJournalCommit(&writer));
+}
+
+}  // namespace
+
+// Test fixture: each test gets its own journal base path
+class TraceJournalTest : public ::testing::Test {
+protected:
+    std::string basePath;
+
+    void SetUp() override {
+        basePath = ::testing::TempDir() + "omni2fa_journal_" +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        RemoveFiles();
+    }
+
+    void TearDown() override {
+        TraceJournalClose();
+        RemoveFiles();
+    }
+
+    void RemoveFiles() {
+        for (int i = 0; i < TRACE_JOURNAL_MAX_FILES; ++i)
+            remove(FilePath(i).c_str());
+    }
+
+    std::string FilePath(int index) const {
+        return basePath + "." + std::to_string(index);
+    }
+
+    // Reads all files oldest generation first, like the decoder does
+    Collected ReadAll(int fileCount) {
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> files;
+        for (int i = 0; i < fileCount; ++i) {
+            std::vector<uint8_t> data = ReadJournalFile(FilePath(i));
+            uint32_t generation = 0;
+            if (TraceJournalRead(data.data(), data.size(), &generation, nullptr, nullptr) >= 0)
+                files.emplace_back(generation, std::move(data));
+        }
+        std::sort(files.begin(), files.end(),
+            [](const std::pair<uint32_t, std::vector<uint8_t>>& a, const std::pair<uint32_t, std::vector<uint8_t>>& b) {
+                return a.first < b.first;
+            });
+        Collected collected;
+        for (auto& file : files)
+            TraceJournalRead(file.second.data(), file.second.size(), nullptr, &Collect, &collected);
+        return collected;
+    }
+};
+
+// ============================================================================
+// Open / close
+// ============================================================================
+
+TEST_F(TraceJournalTest, Open_InvalidParameters_Fails) {
+    EXPECT_FALSE(TraceJournalOpen(nullptr, 2, 1 << 20));
+    EXPECT_FALSE(TraceJournalOpen(basePath.c_str(), 0, 1 << 20));
+    EXPECT_FALSE(TraceJournalOpen(basePath.c_str(), TRACE_JOURNAL_MAX_FILES + 1, 1 << 20));
+    EXPECT_FALSE(TraceJournalOpen(basePath.c_str(), 2, 128));
+    EXPECT_FALSE(TraceJournalIsOpen());
+}
+
+TEST_F(TraceJournalTest, Commit_WhenClosed_ReturnsFalse) {
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(0);
+    TraceJournalBeginRequest(&writer, &info);
+    EXPECT_FALSE(TraceJournalCommit(&writer));
+}
+
+TEST_F(TraceJournalTest, Read_RejectsForeignData) {
+    uint8_t garbage[256] = { 1, 2, 3 };
+    EXPECT_EQ(-1, TraceJournalRead(garbage, sizeof(garbage), nullptr, nullptr, nullptr));
+    EXPECT_EQ(-1, TraceJournalRead(garbage, 8, nullptr, nullptr, nullptr));
+}
+
+// ============================================================================
+// Round trip
+// ============================================================================
+
+TEST_F(TraceJournalTest, RoundTrip_DecodesEvents120To123) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 2, 1 << 20));
+
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(0);
+    TraceJournalBeginRequest(&writer, &info);
+    const char user[] = "alice\0";
+    uint32_t nasIp = 0x0100000A;   // 10.0.0.1 in network byte order
+    uint32_t srcIp = 0x0200000A;
+    uint32_t port = 1812;
+    const char policy[] = "VPN";
+    const char crp[] = "Default";
+    const char classValue[] = "grp";
+    TraceJournalAddAttribute(&writer, 1, kString, 0, user, sizeof(user) - 1);
+    TraceJournalAddAttribute(&writer, 4, kAddress, 0, &nasIp, 4);
+    TraceJournalAddAttribute(&writer, 265, kAddress, 0, &srcIp, 4);
+    TraceJournalAddAttribute(&writer, 266, kInteger, 0, &port, 4);
+    TraceJournalAddAttribute(&writer, 270, kString, 0, policy, sizeof(policy) - 1);
+    TraceJournalAddAttribute(&writer, 275, kString, 0, crp, sizeof(crp) - 1);
+    TraceJournalAddAttribute(&writer, 25, kString, TRACE_JOURNAL_ATTR_RESPONSE, classValue, sizeof(classValue) - 1);
+    ASSERT_TRUE(TraceJournalCommit(&writer));
+    TraceJournalClose();
+
+    Collected collected = ReadAll(2);
+    ASSERT_EQ(1u, collected.text.size());
+    const std::string& text = collected.text[0];
+    EXPECT_NE(std::string::npos, text.find("120 RadiusExtensionProcess2 called with params:\nNPS request start\n"
+        "-ExtensionPoint: Authorization\n-RequestType: AccessRequest\n-ResponseType: AccessAccept\n"));
+    EXPECT_NE(std::string::npos, text.find("-UserName: alice\n-NAS IPAddress: 10.0.0.1\n-Src IPAddress: 10.0.0.2\n"
+        "-Connection Request Policy Name: 'Default'\n-Network Policy Name: 'VPN'\n"));
+    EXPECT_NE(std::string::npos, text.find("122 Request components:  | UserName: alice | NASIPAddress: 10.0.0.1"
+        " | SrcIPAddress: 10.0.0.2 | SrcPort: 1812 | PolicyName: VPN | CRPPolicyName: Default\n"));
+    EXPECT_NE(std::string::npos, text.find("123 Response components:  ~ Class: grp\n"));
+    EXPECT_NE(std::string::npos, text.find("Result: 0, ResponseType: AccessAccept -> AccessReject, adapter 1500 us, total 1520 us"));
+}
+
+TEST_F(TraceJournalTest, RoundTrip_ShortCircuitedRequest) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 1, 1 << 16));
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = {};
+    info.extensionPoint = 0;
+    info.requestType = 4;
+    info.responseTypeIn = 5;
+    info.responseTypeOut = 5;
+    info.flags = TRACE_JOURNAL_SHORT_CIRCUITED;
+    TraceJournalBeginRequest(&writer, &info);
+    ASSERT_TRUE(TraceJournalCommit(&writer));
+    TraceJournalClose();
+
+    Collected collected = ReadAll(1);
+    ASSERT_EQ(1u, collected.text.size());
+    EXPECT_NE(std::string::npos, collected.text[0].find("-ExtensionPoint: Authentication\n-RequestType: AccountingRequest\n"));
+    EXPECT_NE(std::string::npos, collected.text[0].find("short-circuited by the native pre-filter"));
+    // No user name: event 121 carries only the request parameters
+    EXPECT_EQ(std::string::npos, collected.text[0].find("-UserName"));
+}
+
+TEST_F(TraceJournalTest, Attributes_SecretsAreRedacted) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 1, 1 << 16));
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(0);
+    TraceJournalBeginRequest(&writer, &info);
+    const char secret[] = "hunter2";
+    TraceJournalAddAttribute(&writer, 2, kString, 0, secret, sizeof(secret) - 1);
+    TraceJournalAddAttribute(&writer, 277, kString, 0, secret, sizeof(secret) - 1);
+    ASSERT_TRUE(TraceJournalCommit(&writer));
+    TraceJournalClose();
+
+    std::vector<uint8_t> raw = ReadJournalFile(FilePath(0));
+    EXPECT_EQ(raw.end(), std::search(raw.begin(), raw.end(), secret, secret + sizeof(secret) - 1));
+    Collected collected = ReadAll(1);
+    ASSERT_EQ(1u, collected.text.size());
+    EXPECT_NE(std::string::npos, collected.text[0].find("UserPassword: <redacted>"));
+    EXPECT_NE(std::string::npos, collected.text[0].find("ClearTextPassword: <redacted>"));
+}
+
+TEST_F(TraceJournalTest, Attributes_LongValuesAreTruncated) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 1, 1 << 16));
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(0);
+    TraceJournalBeginRequest(&writer, &info);
+    std::string eap(TRACE_JOURNAL_MAX_VALUE + 100, 'x');
+    TraceJournalAddAttribute(&writer, 79, kString, 0, eap.data(), (uint32_t)eap.size());
+    ASSERT_TRUE(TraceJournalCommit(&writer));
+    TraceJournalClose();
+
+    Collected collected = ReadAll(1);
+    ASSERT_EQ(1u, collected.text.size());
+    EXPECT_NE(std::string::npos, collected.text[0].find("EAPMessage: " + std::string(TRACE_JOURNAL_MAX_VALUE, 'x') + "..."));
+}
+
+TEST_F(TraceJournalTest, Attributes_NonPrintableBytesAreEscaped) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 1, 1 << 16));
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(0);
+    TraceJournalBeginRequest(&writer, &info);
+    const uint8_t state[] = { 'a', 0x01, 0xFF };
+    TraceJournalAddAttribute(&writer, 24, kString, 0, state, sizeof(state));
+    ASSERT_TRUE(TraceJournalCommit(&writer));
+    TraceJournalClose();
+
+    Collected collected = ReadAll(1);
+    ASSERT_EQ(1u, collected.text.size());
+    EXPECT_NE(std::string::npos, collected.text[0].find("State: a\\x01\\xFF"));
+}
+
+TEST_F(TraceJournalTest, Writer_Overflow_CommitsWhatFits) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 1, 1 << 16));
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = AuthorizationInfo(0);
+    TraceJournalBeginRequest(&writer, &info);
+    std::string value(TRACE_JOURNAL_MAX_VALUE, 'v');
+    for (int i = 0; i < 64; ++i)
+        TraceJournalAddAttribute(&writer, 25, kString, 0, value.data(), (uint32_t)value.size());
+    EXPECT_TRUE(writer.overflow);
+    EXPECT_FALSE(TraceJournalCommit(&writer));
+    TraceJournalClose();
+
+    Collected collected = ReadAll(1);
+    EXPECT_EQ(1u, collected.text.size());
+}
+
+// ============================================================================
+// Rotation and concurrency
+// ============================================================================
+
+TEST_F(TraceJournalTest, Rotation_KeepsMostRecentRecordsInOrder) {
+    // Small files so a few dozen records rotate through all of them several times
+    const uint32_t files = 3;
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), files, sizeof(TraceJournalFileHeader) + TRACE_JOURNAL_MAX_RECORD));
+    for (uint32_t i = 0; i < 500; ++i)
+        WriteRequest(i);
+    TraceJournalClose();
+
+    Collected collected = ReadAll(files);
+    ASSERT_FALSE(collected.results.empty());
+    EXPECT_LT(collected.results.size(), 500u);
+    EXPECT_EQ(499u, collected.results.back());
+    for (size_t i = 1; i < collected.results.size(); ++i)
+        EXPECT_EQ(collected.results[i - 1] + 1, collected.results[i]);
+}
+
+TEST_F(TraceJournalTest, Reopen_ContinuesAfterPreviousRun) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 2, 1 << 16));
+    WriteRequest(1);
+    TraceJournalClose();
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 2, 1 << 16));
+    WriteRequest(2);
+    TraceJournalClose();
+
+    Collected collected = ReadAll(2);
+    ASSERT_EQ(2u, collected.results.size());
+    EXPECT_EQ(1u, collected.results[0]);
+    EXPECT_EQ(2u, collected.results[1]);
+}
+
+TEST_F(TraceJournalTest, Read_StopsAtTornRecord) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 1, 1 << 16));
+    WriteRequest(1);
+    WriteRequest(2);
+    TraceJournalClose();
+
+    std::vector<uint8_t> data = ReadJournalFile(FilePath(0));
+    ASSERT_EQ(2, TraceJournalRead(data.data(), data.size(), nullptr, nullptr, nullptr));
+    // Simulate a writer that died before publishing the second record
+    TraceJournalRecordHeader* first = (TraceJournalRecordHeader*)(data.data() + sizeof(TraceJournalFileHeader));
+    TraceJournalRecordHeader* second = (TraceJournalRecordHeader*)((uint8_t*)first + first->size);
+    second->generation = 0;
+    EXPECT_EQ(1, TraceJournalRead(data.data(), data.size(), nullptr, nullptr, nullptr));
+}
+
+TEST_F(TraceJournalTest, ConcurrentWriters_AllRecordsArrive) {
+    const int threads = 4;
+    const int perThread = 500;
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 2, 8 << 20));
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([t]() {
+            for (int i = 0; i < perThread; ++i)
+                WriteRequest((uint32_t)(t * perThread + i));
+        });
+    }
+    for (auto& writer : writers)
+        writer.join();
+    TraceJournalClose();
+
+    Collected collected = ReadAll(2);
+    ASSERT_EQ(static_cast<size_t>(threads * perThread), collected.results.size());
+    std::sort(collected.results.begin(), collected.results.end());
+    for (size_t i = 0; i < collected.results.size(); ++i)
+        EXPECT_EQ(i, collected.results[i]);
+}
+
+TEST_F(TraceJournalTest, ConcurrentWriters_WithRotation_NoTornRecords) {
+    ASSERT_TRUE(TraceJournalOpen(basePath.c_str(), 2, sizeof(TraceJournalFileHeader) + 4 * TRACE_JOURNAL_MAX_RECORD));
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([]() {
+            for (int i = 0; i < 2000; ++i)
+                WriteRequest(7);
+        });
+    }
+    for (auto& writer : writers)
+        writer.join();
+    TraceJournalClose();
+
+    Collected collected = ReadAll(2);
+    EXPECT_FALSE(collected.results.empty());
+    for (uint32_t result : collected.results)
+        EXPECT_EQ(7u, result);
+}
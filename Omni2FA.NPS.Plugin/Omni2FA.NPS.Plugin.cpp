@@ -10,8 +10,18 @@
 #include <authif.h>
 #include <lmcons.h>
 #include "radutil.h"
+#include "nativelog.h"
+#include "tracejournal.h"
+#include "tracedump.h"
+#include "ecbcapture.h"
+#include "metrics.h"
+#include "mfabreaker.h"
+#include "mfaclient.h"
+#include "mfarules.h"
 #include "libloaderapi.h"
 #include <msclr/marshal_cppstd.h>
+#include <msclr/lock.h>
+#include <vector>
 
 using namespace System;
 using namespace System::Runtime::InteropServices;
@@ -19,20 +29,64 @@ using namespace ::System::Reflection;
 using namespace System::IO;
 using namespace System::Diagnostics;
 
-// LogLevel enum
-public enum class LogLevel {
-    Trace,
-    Information,
-    Warning,
-    Error
-};
+// Set once Initialize has run. RadiusExtensionInit and the first requests can race
+// to initialize, so Initialize runs under g_initLock; afterwards the flag is read
+// with acquire semantics and no lock, see EnsureInitialized.
+#pragma managed(push, off)
+static volatile LONG g_initialized = FALSE;
+static SRWLOCK g_initLock = SRWLOCK_INIT;
+
+static bool IsInitialized()
+{
+    return ReadAcquire(&g_initialized) != FALSE;
+}
+
+static void SetInitialized(bool initialized)
+{
+    WriteRelease(&g_initialized, initialized ? TRUE : FALSE);
+}
+
+static void LockInit()
+{
+    AcquireSRWLockExclusive(&g_initLock);
+}
 
-static bool g_initialized = false;
-static bool g_enableTraceLogging = false;
+static void UnlockInit()
+{
+    ReleaseSRWLockExclusive(&g_initLock);
+}
+#pragma managed(pop)
+
+// Mirrors EnableTraceLogging from the shared configuration snapshot, see ConfigListener
+static volatile bool g_enableTraceLogging = false;
+// Value bytes shown per attribute in the request dumps of events 122 and 123,
+// mirrors TraceDumpValueBytes like g_enableTraceLogging
+static volatile DWORD g_traceDumpValueBytes = TRACE_DUMP_DEFAULT_VALUE_BYTES;
+
+// Requests seen by RadiusExtensionProcess2 and how many of them were answered
+// by the native pre-filter without entering managed code
+static volatile LONG g_processedRequests = 0;
+static volatile LONG g_shortCircuitedRequests = 0;
 
 // Registry path and key
 static const wchar_t* REG_PATH = L"SOFTWARE\\Omni2FA.NPS";
-static const wchar_t* ENABLE_TRACE_KEY = L"EnableTraceLogging";
+static const wchar_t* TRACE_JOURNAL_PATH_KEY = L"TraceJournalPath";
+static const wchar_t* TRACE_JOURNAL_FILES_KEY = L"TraceJournalFiles";
+static const wchar_t* TRACE_JOURNAL_SIZE_KEY = L"TraceJournalFileSizeMB";
+static const wchar_t* ECB_CAPTURE_PATH_KEY = L"EcbCapturePath";
+static const wchar_t* ECB_CAPTURE_SIZE_KEY = L"EcbCaptureMaxMB";
+static const wchar_t* METRICS_PATH_KEY = L"MetricsPath";
+static const wchar_t* METRICS_EXPORT_KEY = L"MetricsExportSeconds";
+static const wchar_t* METRICS_SUMMARY_KEY = L"MetricsSummaryMinutes";
+
+// Trace journal defaults: 4 files of 32 MB
+static const DWORD TRACE_JOURNAL_DEFAULT_FILES = 4;
+static const DWORD TRACE_JOURNAL_DEFAULT_SIZE_MB = 32;
+// ECB capture default size limit
+static const DWORD ECB_CAPTURE_DEFAULT_SIZE_MB = 256;
+// Metrics defaults: snapshot file every 15 seconds, Event Log summary every hour
+static const DWORD METRICS_DEFAULT_EXPORT_SECONDS = 15;
+static const DWORD METRICS_DEFAULT_SUMMARY_MINUTES = 60;
 
 // Log name and source constants
 public ref class LogConstants abstract sealed
@@ -42,79 +96,872 @@ public:
     literal System::String^ LOG_SOURCE = "Omni2FA.NPS.Plugin";
 };
 
-// Map LogLevel to EventLogEntryType
-EventLogEntryType MapLogLevel(LogLevel level) {
-    switch (level) {
-    case LogLevel::Trace:
-        return EventLogEntryType::Information;
-    case LogLevel::Information:
-        return EventLogEntryType::Information;
-    case LogLevel::Warning:
-        return EventLogEntryType::Warning;
-    case LogLevel::Error:
-        return EventLogEntryType::Error;
-    default:
-        return EventLogEntryType::Information;
+// Event source name handed to the native Event Log sink
+static const wchar_t* LOG_SOURCE_NAME = L"Omni2FA.NPS.Plugin";
+
+// Copies a managed string into a log argument; only used on error and trace paths
+std::string ToUtf8(System::String^ text)
+{
+    if (text == nullptr)
+        return std::string();
+    array<Byte>^ bytes = System::Text::Encoding::UTF8->GetBytes(text);
+    if (bytes->Length == 0)
+        return std::string();
+    pin_ptr<Byte> pinned = &bytes[0];
+    return std::string(reinterpret_cast<const char*>(pinned), bytes->Length);
+}
+
+// Registers the event source once per process instead of checking it on every write.
+// Records are queued by NATIVE_LOG and written to the Event Log by the flusher thread.
+void StartLogging()
+{
+    try
+    {
+        if (!EventLog::SourceExists(LogConstants::LOG_SOURCE))
+        {
+            EventLog::CreateEventSource(LogConstants::LOG_SOURCE, LogConstants::LOG_NAME);
+        }
+    }
+    catch (Exception^)
+    {
+        // Source lookup needs rights NPS normally has; ReportEvent still works without it
     }
+    NativeLogSetLevel(g_enableTraceLogging ? NativeLogTrace : NativeLogInformation);
+    NativeLogClearSinks();
+    NativeLogAddSink(&NativeLogEventLogSink, (void*)LOG_SOURCE_NAME);
+    NativeLogStart();
 }
 
-// Log to Windows Application Event Log, fallback: append error to log file in DLL directory
-void LogEvent(LogLevel level, int eventCode, System::String^ message)
+// Hands MFA exchanges to the native keep-alive client (mfaclient.cpp) while
+// NativeMfaClient is set and ServiceUrl is plain http://; otherwise the adapter
+// keeps using the managed Authenticator.
+ref class NativeMfa abstract sealed
 {
-    if (level == LogLevel::Trace && !g_enableTraceLogging)
-        return;
-    if (!EventLog::SourceExists(LogConstants::LOG_SOURCE))
+public:
+    static void Configure(Omni2FA::Net::Utils::ConfigSnapshot^ config)
+    {
+        if (!config->NativeMfaClient)
+        {
+            Disable();
+            return;
+        }
+        MfaClientConfig native;
+        MfaClientDefaultConfig(&native);
+        std::string url = ToUtf8(config->ServiceUrl);
+        if (!MfaClientParseUrl(url.c_str(), &native))
+        {
+            NATIVE_LOG(NativeLogWarning, 308, "NativeMfaClient is set but ServiceUrl {0} is not an http:// URL, using the managed client.", url);
+            Disable();
+            return;
+        }
+        // The first URL carries the settings; the others only their address
+        int count = Math::Min(config->ServiceUrls->Count, MFA_CLIENT_MAX_ENDPOINTS);
+        if (config->ServiceUrls->Count > count)
+            NATIVE_LOG(NativeLogWarning, 308, "ServiceUrl lists {0} URLs, the native MFA client uses the first {1}.", config->ServiceUrls->Count, count);
+        std::vector<MfaClientConfig> endpoints((size_t)count);
+        for (int i = 1; i < count; ++i)
+        {
+            std::string other = ToUtf8(config->ServiceUrls[i]);
+            if (!MfaClientParseUrl(other.c_str(), &endpoints[i]))
+            {
+                NATIVE_LOG(NativeLogWarning, 308, "NativeMfaClient is set but ServiceUrl {0} is not an http:// URL, using the managed client.", other);
+                Disable();
+                return;
+            }
+            url += ", " + other;
+        }
+        if (!String::IsNullOrEmpty(config->BasicAuthUsername) && !String::IsNullOrEmpty(config->BasicAuthPassword))
+        {
+            std::string credentials = ToUtf8(config->BasicAuthUsername + ":" + config->BasicAuthPassword);
+            if (credentials.size() >= sizeof(native.credentials))
+            {
+                NATIVE_LOG(NativeLogWarning, 308, "NativeMfaClient is set but the basic authentication credentials are too long, using the managed client.");
+                Disable();
+                return;
+            }
+            memcpy(native.credentials, credentials.c_str(), credentials.size() + 1);
+        }
+        native.timeoutMs = (uint32_t)Math::Max(1, config->AuthTimeout) * 1000;
+        native.waitBeforePollMs = (uint32_t)Math::Max(0, config->WaitBeforePoll) * 1000;
+        native.pollIntervalMs = (uint32_t)Math::Max(0, config->PollInterval) * 1000;
+        native.pollCount = (uint32_t)Math::Max(0, config->PollMaxSeconds);
+        native.hedgeMinMs = (uint32_t)config->MfaHedgeMinMs;
+        endpoints[0] = native;
+        if (!MfaClientStartEndpoints(endpoints.data(), (uint32_t)count))
+        {
+            Disable();
+            return;
+        }
+        if (Omni2FA::Adapter::NpsAdapter::NativeAuthenticate == nullptr)
+            Omni2FA::Adapter::NpsAdapter::NativeAuthenticate = gcnew Func<String^, bool>(&NativeMfa::Authenticate);
+        NATIVE_LOG(NativeLogInformation, 209, "Native MFA client enabled for {0}.", url);
+    }
+
+    // Requests already inside the native client finish on it; pooled connections
+    // are closed by Stop at RadiusExtensionTerm.
+    static void Disable()
+    {
+        Omni2FA::Adapter::NpsAdapter::NativeAuthenticate = nullptr;
+    }
+
+    static void Stop()
+    {
+        Disable();
+        if (!MfaClientIsStarted())
+            return;
+        MfaClientStats stats = MfaClientGetStats();
+        NATIVE_LOG(NativeLogInformation, 115, "Native MFA client: {0} requests, {1} connections opened, {2} reused, {3} failures.",
+            stats.requests, stats.connectionsOpened, stats.connectionsReused, stats.failures);
+        MfaClientEndpointStats endpoints[MFA_CLIENT_MAX_ENDPOINTS];
+        uint32_t count = MfaClientGetEndpointStats(endpoints, MFA_CLIENT_MAX_ENDPOINTS);
+        if (count > 1)
+        {
+            NATIVE_LOG(NativeLogInformation, 115, "Native MFA client: {0} failovers, {1} hedged polls, {2} answered first by the second endpoint.",
+                stats.failovers, stats.hedges, stats.hedgesWon);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                std::string address = std::string(endpoints[i].host) + ":" + std::to_string(endpoints[i].port);
+                NATIVE_LOG(NativeLogInformation, 115, "Native MFA endpoint {0}: {1} exchanges, {2} failed, poll p95 {3} us.",
+                    address, endpoints[i].exchanges, endpoints[i].failures, endpoints[i].pollP95Micros);
+            }
+        }
+        MfaClientStop();
+    }
+
+    static bool Authenticate(String^ samid)
+    {
+        std::string user = ToUtf8(samid);
+        MfaClientTiming timing;
+        MfaClientResult result = MfaClientAuthenticate(user.c_str(), &timing);
+        NATIVE_LOG(NativeLogTrace, 30, "Native MFA for {0}: {1} after {2} requests ({3}).",
+            user, MfaClientResultName(result), timing.exchanges, MfaClientFormatTiming(timing));
+        return result == MfaClientSucceeded;
+    }
+};
+
+// Lets the adapter and the managed MFA client record into the native histograms
+// (metrics.cpp) through Omni2FA.Net.Utils.Metrics
+ref class NativeMetrics abstract sealed
+{
+public:
+    static void Attach()
+    {
+        Omni2FA::Net::Utils::Metrics::Sink = gcnew Action<int, long long>(&NativeMetrics::Record);
+        Omni2FA::Net::Utils::Metrics::CounterSink = gcnew Action<int>(&NativeMetrics::Increment);
+    }
+
+    static void Detach()
+    {
+        Omni2FA::Net::Utils::Metrics::Sink = nullptr;
+        Omni2FA::Net::Utils::Metrics::CounterSink = nullptr;
+    }
+
+    static void Record(int phase, long long micros)
+    {
+        MetricsRecord(phase, micros > 0 ? (uint64_t)micros : 0);
+    }
+
+    static void Increment(int counter)
+    {
+        MetricsIncrement(counter);
+    }
+};
+
+// Routes the native attribute values built by the managed RadiusAttribute through
+// RadiusAlloc/RadiusFree, so they come from the request arena of the NPS thread
+ref class NativeAttributeMemory abstract sealed
+{
+public:
+    static void Attach()
+    {
+        OpenCymd::Nps::Plugin::AttributeMemory::Allocate = gcnew Func<int, IntPtr>(&NativeAttributeMemory::Allocate);
+        OpenCymd::Nps::Plugin::AttributeMemory::Free = gcnew Action<IntPtr>(&NativeAttributeMemory::Free);
+    }
+
+    static void Detach()
+    {
+        OpenCymd::Nps::Plugin::AttributeMemory::Reset();
+    }
+
+    static IntPtr Allocate(int cb)
+    {
+        LPVOID p = RadiusAlloc(cb > 0 ? (SIZE_T)cb : 0);
+        if (p == NULL)
+            throw gcnew OutOfMemoryException();
+        return IntPtr(p);
+    }
+
+    static void Free(IntPtr p)
+    {
+        RadiusFree(p.ToPointer());
+    }
+};
+
+// Attributes an MfaRules condition can test, plus User-Name for the log
+static const DWORD RULE_ATTRIBUTE_TYPES[] = { ratPolicyName, ratCRPPolicyName, ratNASIPAddress, ratCalledStationId, ratUserName };
+enum { RuleAttrPolicy, RuleAttrCrp, RuleAttrNas, RuleAttrCalled, RuleAttrUser, RuleAttrCount };
+
+#pragma managed(push, off)
+static void ViewRuleText(const RADIUS_ATTRIBUTE* pAttr, const char** text, size_t* length)
+{
+    RADIUS_VALUE_VIEW view;
+    if (RadiusViewInit(pAttr, &view) && view.pbData != NULL && (view.fDataType == rdtString || view.fDataType == rdtUnknown))
     {
-        EventLog::CreateEventSource(LogConstants::LOG_SOURCE, LogConstants::LOG_NAME);
+        *text = (const char*)view.pbData;
+        *length = view.cbData;
     }
-    EventLog^ eventLog = gcnew EventLog(LogConstants::LOG_NAME);
-    eventLog->Source = LogConstants::LOG_SOURCE;
-    if (level == LogLevel::Trace)
-        message = String::Concat("[TRACE] ", message);
-    eventLog->WriteEntry(message, MapLogLevel(level), eventCode);
 }
 
-// Read EnableTraceLogging from registry
-void ReadTraceLoggingSetting()
+// Fills the MfaRules view of the request with one pass over its attributes. Text
+// values point into the request; ppUser receives User-Name or NULL.
+static void ReadRuleRequest(PRADIUS_EXTENSION_CONTROL_BLOCK pECB, MfaRuleRequest* request, const RADIUS_ATTRIBUTE** ppUser)
 {
-    HKEY hKey;
-    DWORD traceVal = 0;
-    DWORD dwType = REG_DWORD;
-    DWORD dwSize = sizeof(DWORD);
-    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, REG_PATH, 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+    const RADIUS_ATTRIBUTE* found[RuleAttrCount];
+    RADIUS_VALUE_VIEW view;
+    DWORD address;
+    const BYTE* pbAddress;
+    SYSTEMTIME now;
+    memset(request, 0, sizeof(*request));
+    if (RadiusFindAttributes(pECB->GetRequest(pECB), RULE_ATTRIBUTE_TYPES, RuleAttrCount, found) == RADIUS_ATTR_NOT_FOUND)
+        memset(found, 0, sizeof(found));
+    ViewRuleText(found[RuleAttrPolicy], &request->policy, &request->policyLength);
+    ViewRuleText(found[RuleAttrCrp], &request->crp, &request->crpLength);
+    ViewRuleText(found[RuleAttrCalled], &request->calledStationId, &request->calledStationIdLength);
+    if (RadiusViewInit(found[RuleAttrNas], &view) && RadiusViewGetIpv4(&view, &address))
     {
-        if (RegQueryValueExW(hKey, ENABLE_TRACE_KEY, nullptr, &dwType, (LPBYTE)&traceVal, &dwSize) == ERROR_SUCCESS)
+        // Network byte order: the first byte is the first octet
+        pbAddress = (const BYTE*)&address;
+        request->nasIp = ((uint32_t)pbAddress[0] << 24) | ((uint32_t)pbAddress[1] << 16) | ((uint32_t)pbAddress[2] << 8) | pbAddress[3];
+        request->hasNasIp = true;
+    }
+    GetLocalTime(&now);
+    request->minuteOfWeek = MfaRulesMinuteOfWeek(now.wDayOfWeek, now.wHour, now.wMinute);
+    if (ppUser != NULL)
+        *ppUser = found[RuleAttrUser];
+}
+#pragma managed(pop)
+
+// Compiles MfaRules (mfarules.cpp) whenever their text changes and evaluates them
+// for the adapter through NpsAdapter.NativeMatchRule. Rules that do not compile
+// are not installed, so every request gets MFA until they are fixed.
+ref class NativeRules abstract sealed
+{
+public:
+    static void Attach()
+    {
+        Omni2FA::Adapter::NpsAdapter::NativeMatchRule = gcnew Func<IntPtr, long long, int, int>(&NativeRules::Match);
+    }
+
+    // Called after ConfigListener::Stop, so no other set is installed meanwhile
+    static void Detach()
+    {
+        Omni2FA::Adapter::NpsAdapter::NativeMatchRule = nullptr;
+        MfaRulesShutdown();
+    }
+
+    static void Configure(Omni2FA::Net::Utils::ConfigSnapshot^ config)
+    {
+        const MfaRuleSet* current = MfaRulesCurrent();
+        if (config->MfaRules->Count == 0)
         {
-            g_enableTraceLogging = (traceVal == 1);
+            if (current != nullptr)
+            {
+                MfaRulesInstall(nullptr);
+                NATIVE_LOG(NativeLogInformation, 213, "MfaRules removed.");
+            }
+            return;
+        }
+        if (current != nullptr && MfaRulesTag(current) == (uint64_t)config->MfaRulesTag)
+            return;
+        std::vector<std::string> texts;
+        std::vector<const char*> rules;
+        for each (String^ rule in config->MfaRules)
+            texts.push_back(ToUtf8(rule));
+        for (size_t i = 0; i < texts.size(); ++i)
+            rules.push_back(texts[i].c_str());
+        char error[MFA_RULES_MAX_ERROR];
+        MfaRuleSet* compiled = MfaRulesCompile(rules.data(), rules.size(), (uint64_t)config->MfaRulesTag, error, sizeof(error));
+        if (compiled == nullptr)
+        {
+            MfaRulesInstall(nullptr);
+            NATIVE_LOG(NativeLogWarning, 313, "MfaRules not loaded, MFA is performed for every request: {0}", std::string(error));
+            return;
         }
-        RegCloseKey(hKey);
+        MfaRulesInstall(compiled);
+        NATIVE_LOG(NativeLogInformation, 213, "MfaRules loaded: {0} rules.", (DWORD)rules.size());
+    }
+
+    static int Match(IntPtr ecb, long long tag, int firstRule)
+    {
+        const MfaRuleSet* rules = MfaRulesCurrent();
+        MfaRuleRequest request;
+        MfaRuleMatch match;
+        if (rules == nullptr || MfaRulesTag(rules) != (uint64_t)tag)
+            return Omni2FA::Adapter::NpsAdapter::RulesUnavailable;
+        ReadRuleRequest((PRADIUS_EXTENSION_CONTROL_BLOCK)ecb.ToPointer(), &request, nullptr);
+        if (!MfaRulesEvaluate(rules, &request, (uint32_t)Math::Max(0, firstRule), &match))
+            return Omni2FA::Adapter::NpsAdapter::RuleNotMatched;
+        return (int)match.rule;
+    }
+};
+
+#pragma managed(push, off)
+// Runs on the request thread that changed the state, outside the breaker's lock;
+// the only place the breaker is logged, so an outage costs a few events, not one per request.
+static void OnBreakerTransition(MfaBreakerState from, MfaBreakerState to, const MfaBreakerStats* stats, void*)
+{
+    MetricsSetGauge(MetricsGaugeMfaBreakerState, to);
+    if (to == MfaBreakerOpen)
+    {
+        MetricsIncrement(MetricsCounterMfaCircuitOpened);
+        NATIVE_LOG(NativeLogWarning, 317, "MFA circuit breaker {0} -> open: {1} of {2} MFA service calls failed and {3} were slow; MFA requests are answered without the service.",
+            MfaBreakerStateName(from), stats->failures, stats->requests, stats->slow);
+    }
+    else
+    {
+        NATIVE_LOG(NativeLogInformation, 215, "MFA circuit breaker {0} -> {1} ({2} requests answered while open, {3} probes).",
+            MfaBreakerStateName(from), MfaBreakerStateName(to), stats->rejected, stats->probes);
     }
 }
+#pragma managed(pop)
 
-// Custom assembly resolution method
-Assembly^ LocalAssemblyResolver(Object^ sender, ResolveEventArgs^ args)
+// Keeps the MFA circuit breaker (mfabreaker.cpp) configured from the MfaBreaker*
+// settings and lets the adapter and the managed MFA client reach it through
+// Omni2FA.Net.Utils.MfaBreaker. Both clients report to the same breaker, so
+// switching NativeMfaClient does not reset what it has seen.
+ref class NativeBreaker abstract sealed
 {
-    LogEvent(LogLevel::Trace, 7, "LocalAssemblyResolver called.");
-    try
+public:
+    static void Attach()
+    {
+        MfaBreakerSetListener(&OnBreakerTransition, nullptr);
+        Omni2FA::Net::Utils::MfaBreaker::AllowSink = gcnew Func<bool>(&NativeBreaker::Allow);
+        Omni2FA::Net::Utils::MfaBreaker::RecordSink = gcnew Action<bool, long long>(&NativeBreaker::Record);
+    }
+
+    static void Detach()
+    {
+        Omni2FA::Net::Utils::MfaBreaker::AllowSink = nullptr;
+        Omni2FA::Net::Utils::MfaBreaker::RecordSink = nullptr;
+        MfaBreakerSetListener(nullptr, nullptr);
+        MfaBreakerReset();
+        MetricsSetGauge(MetricsGaugeMfaBreakerState, MfaBreakerClosed);
+    }
+
+    static void Configure(Omni2FA::Net::Utils::ConfigSnapshot^ config)
     {
-        System::String^ folderPath = Path::GetDirectoryName(Assembly::GetExecutingAssembly()->Location);
-        System::String^ assemblyPath = Path::Combine(folderPath, String::Concat(args->Name->Split(',')[0], ".dll"));
-        LogEvent(LogLevel::Information, 200, String::Concat("Assembly resolve requested: ", args->Name));
+        MfaBreakerConfig native;
+        MfaBreakerDefaultConfig(&native);
+        native.failurePercent = (uint32_t)config->MfaBreakerFailurePercent;
+        native.minRequests = (uint32_t)config->MfaBreakerMinRequests;
+        native.windowMs = (uint32_t)config->MfaBreakerWindowSeconds * 1000;
+        native.slowMs = (uint32_t)config->MfaBreakerSlowSeconds * 1000;
+        native.openMs = (uint32_t)config->MfaBreakerOpenSeconds * 1000;
+        // A probe has the whole /Authenticate timeout to report back
+        native.probeTimeoutMs = ((uint32_t)Math::Max(1, config->AuthTimeout) + 5) * 1000;
+        MfaBreakerConfigure(&native);
+    }
 
-        if (File::Exists(assemblyPath))
+    static bool Allow()
+    {
+        return MfaBreakerAllow();
+    }
+
+    static void Record(bool failed, long long micros)
+    {
+        MfaBreakerRecord(failed, micros > 0 ? (uint64_t)micros : 0);
+    }
+};
+
+// Resolves the dependencies of the plugin from its own folder. Each name is looked
+// up on disk once. The names found are saved to a manifest next to the plugin, from
+// which the warm-up loads them at the next start before a request needs them.
+ref class LocalAssemblies abstract sealed
+{
+public:
+    static Assembly^ Resolve(Object^ sender, ResolveEventArgs^ args)
+    {
+        NATIVE_LOG(NativeLogTrace, 7, "LocalAssemblyResolver called.");
+        try
         {
-            LogEvent(LogLevel::Information, 200, String::Concat("Loading assembly from: ", assemblyPath));
-            return Assembly::LoadFrom(assemblyPath);
+            String^ name = (gcnew AssemblyName(args->Name))->Name;
+            Assembly^ assembly = nullptr;
+            {
+                msclr::lock guard(resolved);
+                if (resolved->TryGetValue(name, assembly))
+                    return assembly;
+            }
+            System::String^ assemblyPath = Path::Combine(Folder(), String::Concat(name, ".dll"));
+            NATIVE_LOG(NativeLogInformation, 200, "Assembly resolve requested: {0}", ToUtf8(args->Name));
+            if (File::Exists(assemblyPath))
+            {
+                NATIVE_LOG(NativeLogInformation, 200, "Loading assembly from: {0}", ToUtf8(assemblyPath));
+                assembly = Assembly::LoadFrom(assemblyPath);
+            }
+            else
+            {
+                NATIVE_LOG(NativeLogWarning, 300, "Assembly not found: {0}", ToUtf8(assemblyPath));
+            }
+            msclr::lock guard(resolved);
+            resolved[name] = assembly;
+            if (assembly != nullptr)
+                learned = true;
+            return assembly;
+        }
+        catch (Exception^ ex)
+        {
+            NATIVE_LOG(NativeLogError, 400, "Error in LocalAssemblyResolver: {0}", ToUtf8(ex->ToString()));
+            return nullptr;
         }
+    }
 
-        LogEvent(LogLevel::Warning, 300, String::Concat("Assembly not found: ", assemblyPath));
-        return nullptr;
+    // Loads the assemblies listed in the manifest; returns how many were loaded
+    static int Preload()
+    {
+        String^ manifest = ManifestPath();
+        if (!File::Exists(manifest))
+            return 0;
+        int loaded = 0;
+        for each (String^ line in File::ReadAllLines(manifest))
+        {
+            String^ name = line->Trim();
+            if (name->Length == 0)
+                continue;
+            {
+                msclr::lock guard(resolved);
+                if (resolved->ContainsKey(name))
+                    continue;
+            }
+            String^ assemblyPath = Path::Combine(Folder(), String::Concat(name, ".dll"));
+            if (!File::Exists(assemblyPath))
+                continue;
+            Assembly^ assembly = Assembly::LoadFrom(assemblyPath);
+            msclr::lock guard(resolved);
+            resolved[name] = assembly;
+            loaded++;
+        }
+        return loaded;
     }
-    catch (Exception^ ex)
+
+    // Rewrites the manifest if assemblies were resolved that it did not list
+    static void SaveManifest()
     {
-        LogEvent(LogLevel::Error, 400, String::Concat("Error in LocalAssemblyResolver: ", ex->ToString()));
-        return nullptr;
+        try
+        {
+            Collections::Generic::List<String^>^ names = gcnew Collections::Generic::List<String^>();
+            {
+                msclr::lock guard(resolved);
+                if (!learned)
+                    return;
+                learned = false;
+                for each (Collections::Generic::KeyValuePair<String^, Assembly^> entry in resolved)
+                {
+                    if (entry.Value != nullptr)
+                        names->Add(entry.Key);
+                }
+            }
+            names->Sort(StringComparer::OrdinalIgnoreCase);
+            File::WriteAllLines(ManifestPath(), names);
+        }
+        catch (Exception^ ex)
+        {
+            // NPS may not be allowed to write to the plugin folder; the warm-up then resolves on demand
+            NATIVE_LOG(NativeLogTrace, 8, "Assembly manifest not saved: {0}", ToUtf8(ex->Message));
+        }
     }
+
+private:
+    static String^ Folder()
+    {
+        return Path::GetDirectoryName(Assembly::GetExecutingAssembly()->Location);
+    }
+
+    static String^ ManifestPath()
+    {
+        return Path::Combine(Folder(), MANIFEST_NAME);
+    }
+
+    literal String^ MANIFEST_NAME = "Omni2FA.NPS.Plugin.assemblies";
+    // Resolved assemblies by simple name; null for names not found in the folder
+    static Collections::Generic::Dictionary<String^, Assembly^>^ resolved =
+        gcnew Collections::Generic::Dictionary<String^, Assembly^>(StringComparer::OrdinalIgnoreCase);
+    static bool learned = false;
+};
+
+// Synthetic Access-Request the warm-up sends through the adapter. NPS has rejected
+// it already, so the adapter reads it, logs it and leaves it alone: the request path
+// gets compiled and its caches created without an MFA push to anyone.
+static const DWORD WARMUP_MAX_ATTRIBUTES = 8;
+static const char WARMUP_USER_NAME[] = "omni2fa-warmup";
+static const char WARMUP_CALLED_STATION[] = "00-00-00-00-00-00:omni2fa-warmup";
+static const char WARMUP_POLICY_NAME[] = "Omni2FA warm-up";
+
+#pragma managed(push, off)
+// The array header must stay the first member: the ECB passes the array itself as _This
+struct WarmupAttributeArray
+{
+    RADIUS_ATTRIBUTE_ARRAY base;
+    RADIUS_ATTRIBUTE attributes[WARMUP_MAX_ATTRIBUTES];
+    DWORD count;
+};
+
+// The ECB header must stay the first member, like the attribute arrays
+struct WarmupEcb
+{
+    RADIUS_EXTENSION_CONTROL_BLOCK ecb;
+    WarmupAttributeArray request;
+    WarmupAttributeArray response;
+};
+
+static DWORD WINAPI WarmupInsertAt(PRADIUS_ATTRIBUTE_ARRAY This, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr)
+{
+    WarmupAttributeArray* array = (WarmupAttributeArray*)This;
+    if (dwIndex > array->count || array->count == WARMUP_MAX_ATTRIBUTES)
+        return ERROR_INVALID_PARAMETER;
+    memmove(&array->attributes[dwIndex + 1], &array->attributes[dwIndex], (array->count - dwIndex) * sizeof(RADIUS_ATTRIBUTE));
+    array->attributes[dwIndex] = *pAttr;
+    array->count++;
+    return NO_ERROR;
+}
+
+static DWORD WINAPI WarmupAdd(PRADIUS_ATTRIBUTE_ARRAY This, const RADIUS_ATTRIBUTE* pAttr)
+{
+    return WarmupInsertAt(This, ((WarmupAttributeArray*)This)->count, pAttr);
+}
+
+static const RADIUS_ATTRIBUTE* WINAPI WarmupAttributeAt(const RADIUS_ATTRIBUTE_ARRAY* This, DWORD dwIndex)
+{
+    const WarmupAttributeArray* array = (const WarmupAttributeArray*)This;
+    return dwIndex < array->count ? &array->attributes[dwIndex] : NULL;
+}
+
+static DWORD WINAPI WarmupGetSize(const RADIUS_ATTRIBUTE_ARRAY* This)
+{
+    return ((const WarmupAttributeArray*)This)->count;
+}
+
+static DWORD WINAPI WarmupRemoveAt(PRADIUS_ATTRIBUTE_ARRAY This, DWORD dwIndex)
+{
+    WarmupAttributeArray* array = (WarmupAttributeArray*)This;
+    if (dwIndex >= array->count)
+        return ERROR_INVALID_PARAMETER;
+    array->count--;
+    memmove(&array->attributes[dwIndex], &array->attributes[dwIndex + 1], (array->count - dwIndex) * sizeof(RADIUS_ATTRIBUTE));
+    return NO_ERROR;
+}
+
+static DWORD WINAPI WarmupSetAt(PRADIUS_ATTRIBUTE_ARRAY This, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr)
+{
+    WarmupAttributeArray* array = (WarmupAttributeArray*)This;
+    if (dwIndex >= array->count)
+        return ERROR_INVALID_PARAMETER;
+    array->attributes[dwIndex] = *pAttr;
+    return NO_ERROR;
+}
+
+static PRADIUS_ATTRIBUTE_ARRAY WINAPI WarmupGetRequest(PRADIUS_EXTENSION_CONTROL_BLOCK This)
+{
+    return &((WarmupEcb*)This)->request.base;
+}
+
+static PRADIUS_ATTRIBUTE_ARRAY WINAPI WarmupGetResponse(PRADIUS_EXTENSION_CONTROL_BLOCK This, RADIUS_CODE rcResponseType)
+{
+    return &((WarmupEcb*)This)->response.base;
+}
+
+static DWORD WINAPI WarmupSetResponseType(PRADIUS_EXTENSION_CONTROL_BLOCK This, RADIUS_CODE rcResponseType)
+{
+    This->rcResponseType = rcResponseType;
+    return NO_ERROR;
+}
+
+static void InitWarmupArray(WarmupAttributeArray* array)
+{
+    memset(array, 0, sizeof(*array));
+    array->base.cbSize = sizeof(RADIUS_ATTRIBUTE_ARRAY);
+    array->base.Add = &WarmupAdd;
+    array->base.AttributeAt = &WarmupAttributeAt;
+    array->base.GetSize = &WarmupGetSize;
+    array->base.InsertAt = &WarmupInsertAt;
+    array->base.RemoveAt = &WarmupRemoveAt;
+    array->base.SetAt = &WarmupSetAt;
+}
+
+static void AddWarmupText(WarmupAttributeArray* array, DWORD dwAttrType, const char* text, DWORD cbText)
+{
+    RADIUS_ATTRIBUTE attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.dwAttrType = dwAttrType;
+    attr.fDataType = rdtString;
+    attr.cbDataLength = cbText;
+    attr.lpValue = (const BYTE*)text;
+    WarmupAdd(&array->base, &attr);
+}
+
+static void InitWarmupEcb(WarmupEcb* pEcb)
+{
+    RADIUS_ATTRIBUTE attr;
+    memset(&pEcb->ecb, 0, sizeof(pEcb->ecb));
+    pEcb->ecb.cbSize = sizeof(RADIUS_EXTENSION_CONTROL_BLOCK);
+    pEcb->ecb.dwVersion = 1;
+    pEcb->ecb.repPoint = repAuthorization;
+    pEcb->ecb.rcRequestType = rcAccessRequest;
+    pEcb->ecb.rcResponseType = rcAccessReject;
+    pEcb->ecb.GetRequest = &WarmupGetRequest;
+    pEcb->ecb.GetResponse = &WarmupGetResponse;
+    pEcb->ecb.SetResponseType = &WarmupSetResponseType;
+    InitWarmupArray(&pEcb->request);
+    InitWarmupArray(&pEcb->response);
+    AddWarmupText(&pEcb->request, ratUserName, WARMUP_USER_NAME, sizeof(WARMUP_USER_NAME) - 1);
+    AddWarmupText(&pEcb->request, ratCalledStationId, WARMUP_CALLED_STATION, sizeof(WARMUP_CALLED_STATION) - 1);
+    AddWarmupText(&pEcb->request, ratPolicyName, WARMUP_POLICY_NAME, sizeof(WARMUP_POLICY_NAME) - 1);
+    memset(&attr, 0, sizeof(attr));
+    attr.dwAttrType = ratNASIPAddress;
+    attr.fDataType = rdtAddress;
+    attr.cbDataLength = sizeof(DWORD);
+    // 127.0.0.1 in network byte order
+    attr.dwValue = 0x0100007F;
+    WarmupAdd(&pEcb->request.base, &attr);
+}
+#pragma managed(pop)
+
+// Takes the first-request costs off the first request: on a background thread
+// started by RadiusExtensionInit it loads the dependencies listed in the assembly
+// manifest, compiles the adapter, sends a synthetic request through it and opens
+// connections to the MFA service. The connections are then kept open every
+// MfaKeepWarmSeconds, so a quiet night does not make the morning's first user wait.
+ref class Warmup abstract sealed
+{
+public:
+    static void Start()
+    {
+        stopping = false;
+        thread = gcnew System::Threading::Thread(gcnew System::Threading::ThreadStart(&Warmup::Run));
+        thread->IsBackground = true;
+        thread->Name = "Omni2FA warm-up";
+        thread->Start();
+    }
+
+    static void Stop()
+    {
+        System::Threading::Timer^ stopped;
+        {
+            msclr::lock guard(sync);
+            stopping = true;
+            stopped = timer;
+            timer = nullptr;
+        }
+        // Lets a keep-warm tick in progress finish before the clients are stopped
+        if (stopped != nullptr)
+        {
+            System::Threading::ManualResetEvent^ done = gcnew System::Threading::ManualResetEvent(false);
+            if (stopped->Dispose(done))
+                done->WaitOne(STOP_WAIT_MS);
+        }
+        if (thread != nullptr)
+        {
+            thread->Join(STOP_WAIT_MS);
+            thread = nullptr;
+        }
+    }
+
+    // Follows MfaKeepWarmSeconds; does nothing until the startup warm-up has finished
+    static void Configure(Omni2FA::Net::Utils::ConfigSnapshot^ config)
+    {
+        msclr::lock guard(sync);
+        if (timer != nullptr)
+            timer->Change(Period(config), Period(config));
+    }
+
+private:
+    static void Run()
+    {
+        try
+        {
+            uint64_t start = MetricsNowMicros();
+            int assemblies = LocalAssemblies::Preload();
+            uint64_t preloaded = MetricsNowMicros();
+            int methods = Omni2FA::Adapter::NpsAdapter::WarmUp();
+            uint64_t compiled = MetricsNowMicros();
+            SendSyntheticRequest();
+            uint64_t requested = MetricsNowMicros();
+            uint32_t connections = NativeClientActive() ? MfaClientWarmUp(WARMUP_CONNECTIONS) : 0;
+            uint64_t end = MetricsNowMicros();
+            LocalAssemblies::SaveManifest();
+            NATIVE_LOG(NativeLogInformation, 214,
+                "Warm-up completed in {0} ms: {1} assemblies preloaded in {2} ms, {3} methods compiled in {4} ms, synthetic request {5} ms, {6} native MFA connections opened in {7} ms.",
+                (DWORD)((end - start) / 1000), assemblies, (DWORD)((preloaded - start) / 1000), methods, (DWORD)((compiled - preloaded) / 1000),
+                (DWORD)((requested - compiled) / 1000), connections, (DWORD)((end - requested) / 1000));
+        }
+        catch (Exception^ ex)
+        {
+            NATIVE_LOG(NativeLogWarning, 316, "Warm-up failed, the first requests take longer: {0}", ToUtf8(ex->Message));
+        }
+        msclr::lock guard(sync);
+        if (!stopping)
+        {
+            int period = Period(Omni2FA::Net::Utils::ConfigStore::Shared->Current);
+            timer = gcnew System::Threading::Timer(gcnew System::Threading::TimerCallback(&Warmup::KeepWarm), nullptr, period, period);
+        }
+    }
+
+    static void SendSyntheticRequest()
+    {
+        WarmupEcb ecb;
+        InitWarmupEcb(&ecb);
+        RadiusArenaBegin();
+        try
+        {
+            Omni2FA::Adapter::NpsAdapter::RadiusExtensionProcess2(IntPtr(&ecb.ecb));
+        }
+        finally
+        {
+            RadiusArenaEnd();
+        }
+    }
+
+    static void KeepWarm(Object^ state)
+    {
+        try
+        {
+            if (NativeClientActive())
+                MfaClientWarmUp(WARMUP_CONNECTIONS);
+            Omni2FA::Adapter::NpsAdapter::KeepWarm();
+        }
+        catch (Exception^ ex)
+        {
+            NATIVE_LOG(NativeLogTrace, 9, "Keep-warm failed: {0}", ToUtf8(ex->Message));
+        }
+    }
+
+    static bool NativeClientActive()
+    {
+        return Omni2FA::Adapter::NpsAdapter::NativeAuthenticate != nullptr && MfaClientIsStarted();
+    }
+
+    static int Period(Omni2FA::Net::Utils::ConfigSnapshot^ config)
+    {
+        return config->MfaKeepWarmSeconds > 0 ? config->MfaKeepWarmSeconds * 1000 : System::Threading::Timeout::Infinite;
+    }
+
+    // Connections opened at startup and kept pooled between requests
+    literal int WARMUP_CONNECTIONS = 2;
+    // RadiusExtensionTerm waits this long for a warm-up still running
+    literal int STOP_WAIT_MS = 5000;
+    static Object^ sync = gcnew Object();
+    static System::Threading::Thread^ thread = nullptr;
+    static System::Threading::Timer^ timer = nullptr;
+    static bool stopping = false;
+};
+
+// Keeps the native copies of EnableTraceLogging and TraceDumpValueBytes in step with the configuration snapshot
+// owned by Omni2FA.Net.Utils. The adapter starts the registry watcher; this only
+// follows its changes, so turning trace logging on or off needs no NPS restart.
+ref class ConfigListener abstract sealed
+{
+public:
+    static void Start()
+    {
+        if (listening)
+            return;
+        listening = true;
+        Omni2FA::Net::Utils::ConfigStore^ store = Omni2FA::Net::Utils::ConfigStore::Shared;
+        OnChanged(store->Current);
+        store->Changed += gcnew Action<Omni2FA::Net::Utils::ConfigSnapshot^>(&ConfigListener::OnChanged);
+    }
+
+    static void Stop()
+    {
+        if (!listening)
+            return;
+        listening = false;
+        Omni2FA::Net::Utils::ConfigStore::Shared->Changed -= gcnew Action<Omni2FA::Net::Utils::ConfigSnapshot^>(&ConfigListener::OnChanged);
+        NativeMfa::Stop();
+    }
+
+    static void OnChanged(Omni2FA::Net::Utils::ConfigSnapshot^ config)
+    {
+        g_enableTraceLogging = config->EnableTraceLogging;
+        NativeLogSetLevel(g_enableTraceLogging ? NativeLogTrace : NativeLogInformation);
+        DWORD valueBytes = (DWORD)config->TraceDumpValueBytes;
+        g_traceDumpValueBytes = (valueBytes == 0 || valueBytes > TRACE_DUMP_MAX_VALUE_BYTES) ? TRACE_DUMP_DEFAULT_VALUE_BYTES : valueBytes;
+        NativeMfa::Configure(config);
+        NativeRules::Configure(config);
+        NativeBreaker::Configure(config);
+        Warmup::Configure(config);
+    }
+
+private:
+    static bool listening = false;
+};
+
+// The TraceJournal*, EcbCapture* and Metrics* settings are read once at startup, before
+// the configuration snapshot exists, so changing them still needs an NPS restart.
+
+// Reads a REG_SZ or REG_EXPAND_SZ path setting as UTF-8; false if it is missing or empty
+static bool ReadPathSetting(const wchar_t* name, char* utf8Path, int size)
+{
+    wchar_t path[MAX_PATH];
+    DWORD dwSize = sizeof(path);
+    if (RegGetValueW(HKEY_LOCAL_MACHINE, REG_PATH, name, RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ | RRF_NOEXPAND,
+            nullptr, path, &dwSize) != ERROR_SUCCESS || path[0] == L'\0')
+        return false;
+    return WideCharToMultiByte(CP_UTF8, 0, path, -1, utf8Path, size, NULL, NULL) != 0;
+}
+
+// Reads a REG_DWORD setting; defaultValue if it is missing or outside minValue..maxValue
+static DWORD ReadDwordSetting(const wchar_t* name, DWORD minValue, DWORD maxValue, DWORD defaultValue)
+{
+    DWORD value;
+    DWORD dwSize = sizeof(value);
+    if (RegGetValueW(HKEY_LOCAL_MACHINE, REG_PATH, name, RRF_RT_REG_DWORD, nullptr, &value, &dwSize) != ERROR_SUCCESS ||
+        value < minValue || value > maxValue)
+        return defaultValue;
+    return value;
+}
+
+// Opens the binary trace journal when TraceJournalPath is set. The journal records
+// every request natively, so it can stay on under load where EnableTraceLogging cannot.
+void OpenTraceJournal()
+{
+    char utf8Path[MAX_PATH * 3];
+    if (!ReadPathSetting(TRACE_JOURNAL_PATH_KEY, utf8Path, sizeof(utf8Path)))
+        return;
+    DWORD files = ReadDwordSetting(TRACE_JOURNAL_FILES_KEY, 1, TRACE_JOURNAL_MAX_FILES, TRACE_JOURNAL_DEFAULT_FILES);
+    DWORD sizeMb = ReadDwordSetting(TRACE_JOURNAL_SIZE_KEY, 1, 1024, TRACE_JOURNAL_DEFAULT_SIZE_MB);
+    if (TraceJournalOpen(utf8Path, files, (uint64_t)sizeMb << 20))
+        NATIVE_LOG(NativeLogInformation, 207, "Trace journal opened at {0} ({1} files of {2} MB).", utf8Path, files, sizeMb);
+    else
+        NATIVE_LOG(NativeLogWarning, 306, "Trace journal could not be opened at {0} (error {1}).", utf8Path, GetLastError());
+}
+
+// Opens the ECB capture when EcbCapturePath is set. The capture is replayed by
+// Omni2FA.EcbReplay to reproduce production load; it is not meant to stay on.
+void OpenEcbCapture()
+{
+    char utf8Path[MAX_PATH * 3];
+    if (!ReadPathSetting(ECB_CAPTURE_PATH_KEY, utf8Path, sizeof(utf8Path)))
+        return;
+    DWORD sizeMb = ReadDwordSetting(ECB_CAPTURE_SIZE_KEY, 1, 16384, ECB_CAPTURE_DEFAULT_SIZE_MB);
+    if (EcbCaptureOpen(utf8Path, (uint64_t)sizeMb << 20))
+        NATIVE_LOG(NativeLogInformation, 210, "ECB capture opened at {0} (limit {1} MB).", utf8Path, sizeMb);
+    else
+        NATIVE_LOG(NativeLogWarning, 309, "ECB capture could not be opened at {0} (error {1}).", utf8Path, GetLastError());
+}
+
+// Starts the metrics exporter. Samples are always recorded; MetricsPath adds a
+// Prometheus snapshot file every MetricsExportSeconds for a local collector, and
+// MetricsSummaryMinutes (0 turns it off) controls the Event Log summary.
+void StartMetrics()
+{
+    char utf8Path[MAX_PATH * 3];
+    if (!ReadPathSetting(METRICS_PATH_KEY, utf8Path, sizeof(utf8Path)))
+        utf8Path[0] = '\0';
+    DWORD exportSeconds = ReadDwordSetting(METRICS_EXPORT_KEY, 1, 3600, METRICS_DEFAULT_EXPORT_SECONDS);
+    DWORD summaryMinutes = ReadDwordSetting(METRICS_SUMMARY_KEY, 0, 10080, METRICS_DEFAULT_SUMMARY_MINUTES);
+    if (MetricsExporterStart(utf8Path, exportSeconds * 1000, summaryMinutes * 60000))
+        NATIVE_LOG(NativeLogInformation, 211, "Metrics exporter started (snapshot file: {0}, every {1} s; summary every {2} minutes).",
+            utf8Path[0] != '\0' ? utf8Path : "none", exportSeconds, summaryMinutes);
 }
 
 // Get module version information from Git-based versioning for logging
@@ -200,15 +1047,18 @@ void Initialize()
 {
     try
     {
-        ReadTraceLoggingSetting();
-        LogEvent(LogLevel::Information, 100, String::Format("Initializing Omni2FA.NPS.Plugin {0}", GetModuleInfo()));
-        AppDomain::CurrentDomain->AssemblyResolve += gcnew ResolveEventHandler(LocalAssemblyResolver);
-        g_initialized = true;
-        LogEvent(LogLevel::Information, 101, "Omni2FA.NPS.Plugin initialized.");
+        StartLogging();
+        OpenTraceJournal();
+        OpenEcbCapture();
+        StartMetrics();
+        NATIVE_LOG(NativeLogInformation, 100, "Initializing Omni2FA.NPS.Plugin {0}", ToUtf8(GetModuleInfo()));
+        AppDomain::CurrentDomain->AssemblyResolve += gcnew ResolveEventHandler(&LocalAssemblies::Resolve);
+        SetInitialized(true);
+        NATIVE_LOG(NativeLogInformation, 101, "Omni2FA.NPS.Plugin initialized.");
     }
     catch (Exception^ ex)
     {
-        LogEvent(LogLevel::Error, 401, String::Concat("Error during Initialize: ", ex->ToString()));
+        NATIVE_LOG(NativeLogError, 401, "Error during Initialize: {0}", ToUtf8(ex->ToString()));
     }
 }
 
@@ -216,69 +1066,337 @@ void Cleanup()
 {
     try
     {
-        LogEvent(LogLevel::Information, 110, "Cleaning up Omni2FA.NPS.Plugin...");
-        AppDomain::CurrentDomain->AssemblyResolve -= gcnew ResolveEventHandler(LocalAssemblyResolver);
-        g_initialized = false;
-        LogEvent(LogLevel::Information, 111, "Omni2FA.NPS.Plugin cleaned up.");
+        NATIVE_LOG(NativeLogInformation, 110, "Cleaning up Omni2FA.NPS.Plugin...");
+        NATIVE_LOG(NativeLogInformation, 112, "Native pre-filter short-circuited {0} of {1} requests.",
+            (LONG)g_shortCircuitedRequests, (LONG)g_processedRequests);
+        AppDomain::CurrentDomain->AssemblyResolve -= gcnew ResolveEventHandler(&LocalAssemblies::Resolve);
+        LocalAssemblies::SaveManifest();
+        TraceJournalClose();
+        MetricsExporterStop();
+        if (EcbCaptureIsOpen())
+        {
+            EcbCaptureClose();
+            EcbCaptureStats capture = EcbCaptureGetStats();
+            NATIVE_LOG(NativeLogInformation, 118, "ECB capture closed: {0} requests, {1} dropped, {2} bytes.",
+                capture.records, capture.dropped, capture.bytes);
+        }
+        RADIUS_ARENA_STATS arena;
+        RadiusArenaGetStats(&arena);
+        NATIVE_LOG(NativeLogInformation, 119, "Request arena: {0} requests, {1} arena allocations, {2} heap allocations, {3} peak bytes.",
+            arena.ullRequests, arena.ullArenaAllocations, arena.ullHeapAllocations, arena.ullPeakBytes);
+        if (arena.ullOverruns > 0)
+        {
+            NATIVE_LOG(NativeLogWarning, 312, "Request arena found {0} buffer overruns.", arena.ullOverruns);
+        }
+        SetInitialized(false);
+        NATIVE_LOG(NativeLogInformation, 111, "Omni2FA.NPS.Plugin cleaned up.");
     }
     catch (Exception^ ex)
     {
-        LogEvent(LogLevel::Error, 402, String::Concat("Error during Cleanup: ", ex->ToString()));
+        NATIVE_LOG(NativeLogError, 402, "Error during Cleanup: {0}", ToUtf8(ex->ToString()));
     }
 }
 
-DWORD WINAPI RadiusExtensionInit(VOID)
+// Runs Initialize once, whichever of RadiusExtensionInit and the first requests gets here first
+void EnsureInitialized()
 {
-    LogEvent(LogLevel::Trace, 1, "RadiusExtensionInit called.");
+    if (IsInitialized())
+        return;
+    LockInit();
     try
     {
-        if (!g_initialized)
+        if (!IsInitialized())
             Initialize();
+    }
+    finally
+    {
+        UnlockInit();
+    }
+}
+
+DWORD WINAPI RadiusExtensionInit(VOID)
+{
+    NATIVE_LOG(NativeLogTrace, 1, "RadiusExtensionInit called.");
+    uint64_t start = MetricsNowMicros();
+    try
+    {
+        EnsureInitialized();
         DWORD result = Omni2FA::Adapter::NpsAdapter::RadiusExtensionInit();
-        LogEvent(LogLevel::Trace, 4, String::Concat("RadiusExtensionInit completed with result: ", result.ToString()));
+        ConfigListener::Start();
+        NativeRules::Attach();
+        NativeBreaker::Attach();
+        NativeMetrics::Attach();
+        NativeAttributeMemory::Attach();
+        Warmup::Start();
+        MetricsRecordSince(MetricsPhaseInit, start);
+        NATIVE_LOG(NativeLogTrace, 4, "RadiusExtensionInit completed with result: {0}", result);
         return result;
     }
     catch (Exception^ ex)
     {
-        LogEvent(LogLevel::Error, 403, String::Concat("Error in RadiusExtensionInit: ", ex->ToString()));
+        NATIVE_LOG(NativeLogError, 403, "Error in RadiusExtensionInit: {0}", ToUtf8(ex->ToString()));
         return ERROR_GEN_FAILURE;
     }
 }
 
 VOID WINAPI RadiusExtensionTerm(VOID)
 {
-    LogEvent(LogLevel::Trace, 2, "RadiusExtensionTerm called.");
+    NATIVE_LOG(NativeLogTrace, 2, "RadiusExtensionTerm called.");
     try
     {
-        if (g_initialized)
-            Cleanup();
+        Warmup::Stop();
+        LockInit();
+        try
+        {
+            if (IsInitialized())
+                Cleanup();
+        }
+        finally
+        {
+            UnlockInit();
+        }
+        ConfigListener::Stop();
+        NativeRules::Detach();
+        NativeBreaker::Detach();
+        NativeMetrics::Detach();
+        NativeAttributeMemory::Detach();
         Omni2FA::Adapter::NpsAdapter::RadiusExtensionTerm();
-        LogEvent(LogLevel::Trace, 5, "RadiusExtensionTerm completed.");
+        NATIVE_LOG(NativeLogTrace, 5, "RadiusExtensionTerm completed.");
     }
     catch (Exception^ ex)
     {
-        LogEvent(LogLevel::Error, 404, String::Concat("Error in RadiusExtensionTerm: ", ex->ToString()));
+        NATIVE_LOG(NativeLogError, 404, "Error in RadiusExtensionTerm: {0}", ToUtf8(ex->ToString()));
     }
+    // Drain queued records before NPS unloads the DLL
+    NativeLogStop();
 }
 
-DWORD WINAPI RadiusExtensionProcess2(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
+// Managed part of RadiusExtensionProcess2, only entered for MFA candidates
+DWORD ProcessManaged(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
 {
-	LogEvent(LogLevel::Trace, 3, "RadiusExtensionProcess2 called.");
+    NATIVE_LOG(NativeLogTrace, 3, "RadiusExtensionProcess2 called.");
     try
     {
-        if (!g_initialized)
-            Initialize();
+        EnsureInitialized();
         DWORD result = Omni2FA::Adapter::NpsAdapter::RadiusExtensionProcess2(IntPtr(pECB));
-        LogEvent(LogLevel::Trace, 6, String::Concat("RadiusExtensionProcess2 completed with result: ", result.ToString()));
+        NATIVE_LOG(NativeLogTrace, 6, "RadiusExtensionProcess2 completed with result: {0}", result);
         return result;
     }
     catch (Exception^ ex)
     {
-        LogEvent(LogLevel::Error, 405, String::Concat("Error in RadiusExtensionProcess2: ", ex->ToString()));
+        NATIVE_LOG(NativeLogError, 405, "Error in RadiusExtensionProcess2: {0}", ToUtf8(ex->ToString()));
         return ERROR_GEN_FAILURE;
     }
 }
 
+// The entry point itself is native, so requests the adapter would ignore anyway
+// (accounting, authentication-point calls, already rejected requests) are answered
+// without a managed transition or any marshalling. With trace logging enabled every
+// request still goes through the adapter, so the request dumps stay complete.
+#pragma managed(push, off)
+static DWORD ElapsedMicros(const LARGE_INTEGER& from, const LARGE_INTEGER& to)
+{
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    return (DWORD)((to.QuadPart - from.QuadPart) * 1000000 / frequency.QuadPart);
+}
+
+// Copies an attribute array into a journal record; values are cut at TRACE_JOURNAL_MAX_VALUE
+static void JournalAttributes(TraceJournalWriter* writer, PRADIUS_ATTRIBUTE_ARRAY pAttrs, DWORD flags)
+{
+    DWORD size;
+    DWORD i;
+    const RADIUS_ATTRIBUTE* pAttr;
+    if (pAttrs == NULL)
+        return;
+    size = pAttrs->GetSize(pAttrs);
+    for (i = 0; i < size; ++i)
+    {
+        pAttr = pAttrs->AttributeAt(pAttrs, i);
+        if (pAttr == NULL)
+            continue;
+        if (pAttr->fDataType == rdtAddress || pAttr->fDataType == rdtInteger || pAttr->fDataType == rdtTime)
+            TraceJournalAddAttribute(writer, pAttr->dwAttrType, pAttr->fDataType, flags, &pAttr->dwValue, sizeof(DWORD));
+        else
+            TraceJournalAddAttribute(writer, pAttr->dwAttrType, pAttr->fDataType, flags, pAttr->lpValue, pAttr->cbDataLength);
+    }
+}
+
+// Copies an attribute array into a capture record; integer values are stored as their DWORD
+static void CaptureAttributes(EcbCaptureWriter* writer, PRADIUS_ATTRIBUTE_ARRAY pAttrs, DWORD flags)
+{
+    DWORD size;
+    DWORD i;
+    const RADIUS_ATTRIBUTE* pAttr;
+    if (pAttrs == NULL)
+        return;
+    size = pAttrs->GetSize(pAttrs);
+    for (i = 0; i < size; ++i)
+    {
+        pAttr = pAttrs->AttributeAt(pAttrs, i);
+        if (pAttr == NULL)
+            continue;
+        if (pAttr->fDataType == rdtAddress || pAttr->fDataType == rdtInteger || pAttr->fDataType == rdtTime)
+            EcbCaptureAddAttribute(writer, pAttr->dwAttrType, pAttr->fDataType, flags, &pAttr->dwValue, sizeof(DWORD));
+        else
+            EcbCaptureAddAttribute(writer, pAttr->dwAttrType, pAttr->fDataType, flags, pAttr->lpValue, pAttr->cbDataLength);
+    }
+}
+
+// Renders an attribute array into a trace dump, one separator before each item
+static void DumpAttributes(TraceDumpWriter* writer, PRADIUS_ATTRIBUTE_ARRAY pAttrs, const char* separator)
+{
+    DWORD size;
+    DWORD i;
+    const RADIUS_ATTRIBUTE* pAttr;
+    if (pAttrs == NULL)
+        return;
+    size = pAttrs->GetSize(pAttrs);
+    for (i = 0; i < size; ++i)
+    {
+        pAttr = pAttrs->AttributeAt(pAttrs, i);
+        if (pAttr == NULL)
+            continue;
+        if (pAttr->fDataType == rdtAddress || pAttr->fDataType == rdtInteger || pAttr->fDataType == rdtTime)
+            TraceDumpAddAttribute(writer, separator, pAttr->dwAttrType, pAttr->fDataType, &pAttr->dwValue, sizeof(DWORD));
+        else
+            TraceDumpAddAttribute(writer, separator, pAttr->dwAttrType, pAttr->fDataType, pAttr->lpValue, pAttr->cbDataLength);
+    }
+}
+
+// Logs the request and Access-Accept attributes as events 122 and 123. Both dumps
+// are rendered into one buffer from the request arena, released with the request.
+static void DumpEcb(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
+{
+    TraceDumpWriter writer;
+    char* buffer = (char*)RadiusAlloc(TRACE_DUMP_BUFFER_SIZE);
+    if (buffer == NULL)
+        return;
+    TraceDumpBegin(&writer, buffer, TRACE_DUMP_BUFFER_SIZE, g_traceDumpValueBytes);
+    DumpAttributes(&writer, pECB->GetRequest(pECB), " | ");
+    NATIVE_LOG(NativeLogTrace, 122, "Request components: {0}", TraceDumpText(&writer));
+    TraceDumpBegin(&writer, buffer, TRACE_DUMP_BUFFER_SIZE, g_traceDumpValueBytes);
+    DumpAttributes(&writer, pECB->GetResponse(pECB, rcAccessAccept), " ~ ");
+    NATIVE_LOG(NativeLogTrace, 123, "Response components: {0}", TraceDumpText(&writer));
+    RadiusFree(buffer);
+}
+
+// Records the ECB as NPS handed it over, before anything below changes it
+static void CaptureEcb(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
+{
+    EcbCaptureWriter writer;
+    EcbCaptureBegin(&writer, pECB->repPoint, pECB->rcRequestType, pECB->rcResponseType);
+    CaptureAttributes(&writer, pECB->GetRequest(pECB), 0);
+    CaptureAttributes(&writer, pECB->GetResponse(pECB, rcAccessAccept), ECB_CAPTURE_ATTR_RESPONSE);
+    EcbCaptureCommit(&writer);
+}
+
+// Name of the first MfaRules rule matching the request if it is a skip rule without
+// groups; the adapter would only accept such a request, which NPS has done already.
+static const char* FindSkipRule(PRADIUS_EXTENSION_CONTROL_BLOCK pECB, const RADIUS_ATTRIBUTE** ppUser)
+{
+    const MfaRuleSet* rules = MfaRulesCurrent();
+    MfaRuleRequest request;
+    MfaRuleMatch match;
+    if (rules == NULL)
+        return NULL;
+    ReadRuleRequest(pECB, &request, ppUser);
+    if (!MfaRulesEvaluate(rules, &request, 0, &match) || match.action != MfaRuleSkip || match.needsGroups)
+        return NULL;
+    return match.name;
+}
+
+// Returns TRUE, and counts the request, if it can be answered without the adapter:
+// it is not an MFA candidate, or a skip rule exempts it
+static BOOL ShortCircuit(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
+{
+    const char* rule;
+    const RADIUS_ATTRIBUTE* pUser = NULL;
+    RADIUS_VALUE_VIEW view;
+    char user[UNLEN + 1] = "";
+    if (g_enableTraceLogging)
+        return FALSE;
+    if (RadiusIsMfaCandidate(pECB))
+    {
+        rule = FindSkipRule(pECB, &pUser);
+        if (rule == NULL)
+            return FALSE;
+        if (RadiusViewInit(pUser, &view))
+            RadiusViewCopyString(&view, user, sizeof(user));
+        NATIVE_LOG(NativeLogInformation, 137, "MFA rule '{0}' skipped MFA for user {1}, accepting request.", rule, user);
+    }
+    InterlockedIncrement(&g_shortCircuitedRequests);
+    MetricsIncrement(MetricsCounterShortCircuited);
+    return TRUE;
+}
+
+// Same as the plain path below, plus one journal record per request with the
+// request and Access-Accept attributes as they are after the adapter ran
+static DWORD ProcessJournaled(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
+{
+    TraceJournalWriter writer;
+    TraceJournalRequestInfo info = { 0 };
+    LARGE_INTEGER start, managedStart, end;
+    DWORD result = NO_ERROR;
+    QueryPerformanceCounter(&start);
+    info.extensionPoint = pECB->repPoint;
+    info.requestType = pECB->rcRequestType;
+    info.responseTypeIn = pECB->rcResponseType;
+    if (ShortCircuit(pECB))
+    {
+        info.flags |= TRACE_JOURNAL_SHORT_CIRCUITED;
+        QueryPerformanceCounter(&end);
+    }
+    else
+    {
+        QueryPerformanceCounter(&managedStart);
+        result = ProcessManaged(pECB);
+        QueryPerformanceCounter(&end);
+        info.managedMicros = ElapsedMicros(managedStart, end);
+    }
+    info.responseTypeOut = pECB->rcResponseType;
+    info.result = result;
+    info.totalMicros = ElapsedMicros(start, end);
+    TraceJournalBeginRequest(&writer, &info);
+    JournalAttributes(&writer, pECB->GetRequest(pECB), 0);
+    JournalAttributes(&writer, pECB->GetResponse(pECB, rcAccessAccept), TRACE_JOURNAL_ATTR_RESPONSE);
+    TraceJournalCommit(&writer);
+    return result;
+}
+
+DWORD WINAPI RadiusExtensionProcess2(PRADIUS_EXTENSION_CONTROL_BLOCK pECB)
+{
+    DWORD result;
+    uint64_t start;
+    if (pECB == NULL)
+        return ERROR_INVALID_PARAMETER;
+    start = MetricsNowMicros();
+    InterlockedIncrement(&g_processedRequests);
+    // Everything RadiusAlloc hands out for this request is released in one step below
+    RadiusArenaBegin();
+    if (EcbCaptureIsOpen())
+        CaptureEcb(pECB);
+    if (g_enableTraceLogging)
+        DumpEcb(pECB);
+    if (TraceJournalIsOpen())
+    {
+        result = ProcessJournaled(pECB);
+    }
+    else if (ShortCircuit(pECB))
+    {
+        result = NO_ERROR;
+    }
+    else
+    {
+        result = ProcessManaged(pECB);
+    }
+    RadiusArenaEnd();
+    MetricsRecordSince(MetricsPhaseProcess, start);
+    return result;
+}
+#pragma managed(pop)
+
 // DllMain should not call managed code
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved)
 {
@@ -0,0 +1,226 @@
+#include "ecbcapture.h"
+#include "tracejournal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+FILE* g_file = nullptr;
+uint64_t g_maxBytes = 0;
+uint64_t g_bytes = 0;
+uint64_t g_records = 0;
+uint64_t g_dropped = 0;
+std::chrono::steady_clock::time_point g_started;
+// Also serializes the appends; capture is a diagnostic mode and records are small
+std::mutex g_captureLock;
+// Read without the lock on the request path
+volatile bool g_open = false;
+
+uint32_t Align4(uint32_t value)
+{
+    return (value + 3u) & ~3u;
+}
+
+FILE* OpenForWrite(const char* path)
+{
+#ifdef _WIN32
+    int chars = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+    if (chars <= 0)
+        return nullptr;
+    std::wstring widePath((size_t)chars, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], chars);
+    return _wfopen(widePath.c_str(), L"wb");
+#else
+    return fopen(path, "wb");
+#endif
+}
+
+EcbCaptureRecord* RecordOf(EcbCaptureWriter* writer)
+{
+    return (EcbCaptureRecord*)writer->buffer;
+}
+
+const EcbCaptureAttribute* NextAttribute(const EcbCaptureAttribute* attr)
+{
+    return (const EcbCaptureAttribute*)((const uint8_t*)(attr + 1) + Align4(attr->length));
+}
+
+}  // namespace
+
+bool EcbCaptureOpen(const char* path, uint64_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(g_captureLock);
+    if (g_file != nullptr || path == nullptr || maxBytes < sizeof(EcbCaptureFileHeader))
+        return false;
+    FILE* file = OpenForWrite(path);
+    if (file == nullptr)
+        return false;
+    // Large buffer so most appends are a memcpy
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    EcbCaptureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ECB_CAPTURE_MAGIC, 8);
+    header.version = ECB_CAPTURE_VERSION;
+    header.headerSize = sizeof(header);
+    header.createdMicros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        fclose(file);
+        return false;
+    }
+    g_file = file;
+    g_maxBytes = maxBytes;
+    g_bytes = sizeof(header);
+    g_records = 0;
+    g_dropped = 0;
+    g_started = std::chrono::steady_clock::now();
+    g_open = true;
+    return true;
+}
+
+void EcbCaptureClose()
+{
+    std::lock_guard<std::mutex> lock(g_captureLock);
+    g_open = false;
+    if (g_file == nullptr)
+        return;
+    fclose(g_file);
+    g_file = nullptr;
+}
+
+bool EcbCaptureIsOpen()
+{
+    return g_open;
+}
+
+void EcbCaptureBegin(EcbCaptureWriter* writer, uint32_t extensionPoint, uint32_t requestType, uint32_t responseType)
+{
+    EcbCaptureRecord* record = RecordOf(writer);
+    memset(record, 0, sizeof(*record));
+    record->offsetMicros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - g_started).count();
+    record->extensionPoint = extensionPoint;
+    record->requestType = requestType;
+    record->responseType = responseType;
+    writer->used = sizeof(EcbCaptureRecord);
+    writer->overflow = false;
+}
+
+void EcbCaptureAddAttribute(EcbCaptureWriter* writer, uint32_t type, uint32_t dataType, uint32_t flags,
+    const void* value, uint32_t length)
+{
+    if (TraceJournalIsSecret(type))
+    {
+        flags |= ECB_CAPTURE_ATTR_REDACTED;
+        length = 0;
+    }
+    if (value == nullptr)
+        length = 0;
+    if (length > ECB_CAPTURE_MAX_VALUE)
+    {
+        flags |= ECB_CAPTURE_ATTR_TRUNCATED;
+        length = ECB_CAPTURE_MAX_VALUE;
+    }
+    uint32_t needed = sizeof(EcbCaptureAttribute) + Align4(length);
+    EcbCaptureRecord* record = RecordOf(writer);
+    if (writer->used + needed > ECB_CAPTURE_MAX_RECORD || record->attributeCount == 0xFFFF)
+    {
+        writer->overflow = true;
+        return;
+    }
+    EcbCaptureAttribute* attr = (EcbCaptureAttribute*)(writer->buffer + writer->used);
+    attr->type = type;
+    attr->dataType = (uint8_t)dataType;
+    attr->flags = (uint8_t)flags;
+    attr->length = (uint16_t)length;
+    uint8_t* data = (uint8_t*)(attr + 1);
+    if (length > 0)
+        memcpy(data, value, length);
+    memset(data + length, 0, Align4(length) - length);
+    writer->used += needed;
+    record->attributeCount++;
+}
+
+bool EcbCaptureCommit(EcbCaptureWriter* writer)
+{
+    EcbCaptureRecord* record = RecordOf(writer);
+    record->size = writer->used;
+    std::lock_guard<std::mutex> lock(g_captureLock);
+    if (g_file == nullptr)
+        return false;
+    // A partial request would replay differently, so it is dropped rather than cut
+    if (writer->overflow || g_bytes + record->size > g_maxBytes ||
+        fwrite(writer->buffer, record->size, 1, g_file) != 1)
+    {
+        g_dropped++;
+        return false;
+    }
+    g_bytes += record->size;
+    g_records++;
+    return true;
+}
+
+EcbCaptureStats EcbCaptureGetStats()
+{
+    std::lock_guard<std::mutex> lock(g_captureLock);
+    EcbCaptureStats stats;
+    stats.records = g_records;
+    stats.dropped = g_dropped;
+    stats.bytes = g_bytes;
+    return stats;
+}
+
+int EcbCaptureRead(const uint8_t* data, size_t size, EcbCaptureVisitFn visit, void* context)
+{
+    if (data == nullptr || size < sizeof(EcbCaptureFileHeader))
+        return -1;
+    const EcbCaptureFileHeader* file = (const EcbCaptureFileHeader*)data;
+    if (memcmp(file->magic, ECB_CAPTURE_MAGIC, 8) != 0 || file->version != ECB_CAPTURE_VERSION ||
+        file->headerSize != sizeof(EcbCaptureFileHeader))
+        return -1;
+    size_t offset = file->headerSize;
+    int count = 0;
+    while (offset + sizeof(EcbCaptureRecord) <= size)
+    {
+        const EcbCaptureRecord* record = (const EcbCaptureRecord*)(data + offset);
+        if (record->size < sizeof(EcbCaptureRecord) || (record->size & 3u) != 0 || record->size > size - offset)
+            break;
+        EcbCaptureRecordView view;
+        view.record = record;
+        view.attributes = (const uint8_t*)(record + 1);
+        view.end = data + offset + record->size;
+        // Reject attribute lists that run past the record
+        const uint8_t* cursor = view.attributes;
+        const uint8_t* value;
+        uint16_t seen = 0;
+        while (EcbCaptureNextAttribute(view, &cursor, &value) != nullptr)
+            ++seen;
+        if (seen != record->attributeCount)
+            break;
+        if (visit != nullptr)
+            visit(context, view);
+        ++count;
+        offset += record->size;
+    }
+    return count;
+}
+
+const EcbCaptureAttribute* EcbCaptureNextAttribute(const EcbCaptureRecordView& view, const uint8_t** cursor,
+    const uint8_t** value)
+{
+    const EcbCaptureAttribute* attr = (const EcbCaptureAttribute*)*cursor;
+    if (*cursor + sizeof(EcbCaptureAttribute) > view.end || (const uint8_t*)NextAttribute(attr) > view.end)
+        return nullptr;
+    *value = (const uint8_t*)(attr + 1);
+    *cursor = (const uint8_t*)NextAttribute(attr);
+    return attr;
+}
@@ -0,0 +1,117 @@
+#ifndef ECBCAPTURE_H
+#define ECBCAPTURE_H
+#pragma once
+
+// Capture file of the extension control blocks seen by RadiusExtensionProcess2.
+//
+// Unlike the trace journal, which keeps the most recent traffic as it looks
+// after the adapter ran, a capture is an append-only file of the requests as
+// NPS handed them to the extension: extension point, request and response
+// types, and the request and Access-Accept attribute arrays. Records carry
+// their offset from the start of the capture, so Omni2FA.EcbReplay can play
+// the traffic back at the recorded pace or at any other rate. Writing stops
+// once the file reaches its size limit. Password attributes are stored without
+// their value.
+//
+// Records are built on the caller's stack like trace journal records; the
+// caller walks the ECB, so this module does not depend on <authif.h>.
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ECB_CAPTURE_MAGIC "O2FAECB1"
+#define ECB_CAPTURE_VERSION 1
+#define ECB_CAPTURE_MAX_RECORD 16384
+// Attribute values longer than this are cut and flagged as truncated
+#define ECB_CAPTURE_MAX_VALUE 4096
+
+// EcbCaptureAttribute.flags
+#define ECB_CAPTURE_ATTR_RESPONSE 0x1
+#define ECB_CAPTURE_ATTR_TRUNCATED 0x2
+#define ECB_CAPTURE_ATTR_REDACTED 0x4
+
+#pragma pack(push, 4)
+struct EcbCaptureFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t createdMicros;     // wall clock, microseconds since 1970
+    uint8_t reserved[16];
+};
+
+struct EcbCaptureRecord
+{
+    uint32_t size;              // whole record including this header, multiple of 4
+    uint32_t reserved;
+    uint64_t offsetMicros;      // since the capture was opened
+    uint32_t extensionPoint;    // RADIUS_EXTENSION_POINT
+    uint32_t requestType;       // RADIUS_CODE
+    uint32_t responseType;      // rcResponseType on entry
+    uint16_t attributeCount;
+    uint16_t flags;
+};
+
+struct EcbCaptureAttribute
+{
+    uint32_t type;
+    uint8_t dataType;   // RADIUS_DATA_TYPE
+    uint8_t flags;
+    uint16_t length;    // value bytes that follow, padded to 4 in the record
+};
+#pragma pack(pop)
+
+// Builds one record on the caller's stack before it is appended to the file
+struct EcbCaptureWriter
+{
+    // First member so the record header built in it is 4-byte aligned
+    uint8_t buffer[ECB_CAPTURE_MAX_RECORD];
+    uint32_t used;
+    bool overflow;
+};
+
+struct EcbCaptureStats
+{
+    uint64_t records;
+    // Records not written because the file was full or the record too large
+    uint64_t dropped;
+    uint64_t bytes;
+};
+
+// Creates (or truncates) the capture file. Writing stops at maxBytes.
+bool EcbCaptureOpen(const char* path, uint64_t maxBytes);
+void EcbCaptureClose();
+bool EcbCaptureIsOpen();
+
+void EcbCaptureBegin(EcbCaptureWriter* writer, uint32_t extensionPoint, uint32_t requestType, uint32_t responseType);
+void EcbCaptureAddAttribute(EcbCaptureWriter* writer, uint32_t type, uint32_t dataType, uint32_t flags,
+    const void* value, uint32_t length);
+// Appends the record; false if the capture is closed, full or the record overflowed
+bool EcbCaptureCommit(EcbCaptureWriter* writer);
+
+EcbCaptureStats EcbCaptureGetStats();
+
+// Reading, used by Omni2FA.EcbReplay and the tests
+struct EcbCaptureRecordView
+{
+    const EcbCaptureRecord* record;
+    const uint8_t* attributes;      // first EcbCaptureAttribute
+    const uint8_t* end;
+};
+
+typedef void (*EcbCaptureVisitFn)(void* context, const EcbCaptureRecordView& record);
+
+// Walks the records of a capture file image. Returns the number of records
+// visited, or -1 if the image is not a capture file. A record cut short by a
+// crash ends the walk.
+int EcbCaptureRead(const uint8_t* data, size_t size, EcbCaptureVisitFn visit, void* context);
+
+// Iterates the attributes of a record: *cursor starts at view.attributes.
+// Returns null after the last one; *value receives the attribute's bytes.
+const EcbCaptureAttribute* EcbCaptureNextAttribute(const EcbCaptureRecordView& view, const uint8_t** cursor,
+    const uint8_t** value);
+
+#endif // ECBCAPTURE_H
@@ -0,0 +1,80 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Minimal stand-in for the NPS extension header <authif.h> used by the CMake build on Linux
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+// Declares the RADIUS_ATTRIBUTE_ARRAY and RADIUS_EXTENSION_CONTROL_BLOCK types
+// with the same member order as the Windows SDK, so MockRadiusAttributeArray
+// can stand in for the arrays NPS passes to the extension.
+#ifndef OMNI2FA_LINUX_AUTHIF_H
+#define OMNI2FA_LINUX_AUTHIF_H
+#pragma once
+
+#include <windows.h>
+
+typedef enum _RADIUS_DATA_TYPE
+{
+    rdtUnknown,
+    rdtString,
+    rdtAddress,
+    rdtInteger,
+    rdtTime,
+    rdtIpv6Address
+} RADIUS_DATA_TYPE;
+
+typedef struct _RADIUS_ATTRIBUTE
+{
+    DWORD dwAttrType;
+    RADIUS_DATA_TYPE fDataType;
+    DWORD cbDataLength;
+    union
+    {
+        DWORD dwValue;
+        CONST BYTE* lpValue;
+    };
+} RADIUS_ATTRIBUTE, *PRADIUS_ATTRIBUTE;
+
+typedef enum _RADIUS_CODE
+{
+    rcUnknown = 0,
+    rcAccessRequest = 1,
+    rcAccessAccept = 2,
+    rcAccessReject = 3,
+    rcAccountingRequest = 4,
+    rcAccountingResponse = 5,
+    rcAccessChallenge = 11,
+    rcDiscard = 256
+} RADIUS_CODE;
+
+typedef enum _RADIUS_EXTENSION_POINT
+{
+    repAuthentication,
+    repAuthorization
+} RADIUS_EXTENSION_POINT;
+
+typedef struct _RADIUS_ATTRIBUTE_ARRAY
+{
+    DWORD cbSize;
+    DWORD (WINAPI *Add)(struct _RADIUS_ATTRIBUTE_ARRAY* _This, const RADIUS_ATTRIBUTE* pAttr);
+    const RADIUS_ATTRIBUTE* (WINAPI *AttributeAt)(const struct _RADIUS_ATTRIBUTE_ARRAY* _This, DWORD dwIndex);
+    DWORD (WINAPI *GetSize)(const struct _RADIUS_ATTRIBUTE_ARRAY* _This);
+    DWORD (WINAPI *InsertAt)(struct _RADIUS_ATTRIBUTE_ARRAY* _This, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr);
+    DWORD (WINAPI *RemoveAt)(struct _RADIUS_ATTRIBUTE_ARRAY* _This, DWORD dwIndex);
+    DWORD (WINAPI *SetAt)(struct _RADIUS_ATTRIBUTE_ARRAY* _This, DWORD dwIndex, const RADIUS_ATTRIBUTE* pAttr);
+} RADIUS_ATTRIBUTE_ARRAY, *PRADIUS_ATTRIBUTE_ARRAY;
+
+typedef struct _RADIUS_EXTENSION_CONTROL_BLOCK
+{
+    DWORD cbSize;
+    DWORD dwVersion;
+    RADIUS_EXTENSION_POINT repPoint;
+    RADIUS_CODE rcRequestType;
+    RADIUS_CODE rcResponseType;
+    PRADIUS_ATTRIBUTE_ARRAY (WINAPI *GetRequest)(struct _RADIUS_EXTENSION_CONTROL_BLOCK* This);
+    PRADIUS_ATTRIBUTE_ARRAY (WINAPI *GetResponse)(struct _RADIUS_EXTENSION_CONTROL_BLOCK* This, RADIUS_CODE rcResponseType);
+    DWORD (WINAPI *SetResponseType)(struct _RADIUS_EXTENSION_CONTROL_BLOCK* This, RADIUS_CODE rcResponseType);
+} RADIUS_EXTENSION_CONTROL_BLOCK, *PRADIUS_EXTENSION_CONTROL_BLOCK;
+
+#endif // OMNI2FA_LINUX_AUTHIF_H
@@ -0,0 +1,98 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright 2024 Omni2FA
+//
+//   Minimal stand-in for <windows.h> used by the CMake build on Linux
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+// Covers only what radutil.cpp, the radutil tests and the benchmarks need. It
+// is on the include path of the CMake build on non-Windows hosts only; the
+// Visual Studio projects use the Windows SDK headers.
+#ifndef OMNI2FA_LINUX_WINDOWS_H
+#define OMNI2FA_LINUX_WINDOWS_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define WINAPI
+#define CONST const
+#define VOID void
+
+typedef uint32_t DWORD;
+typedef uint64_t ULONGLONG;
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef BYTE* LPBYTE;
+typedef void* LPVOID;
+typedef size_t SIZE_T;
+typedef void* HANDLE;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define NO_ERROR 0L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_MORE_DATA 234L
+
+// The process heap maps onto malloc/free
+inline HANDLE GetProcessHeap()
+{
+    return (HANDLE)1;
+}
+
+inline LPVOID HeapAlloc(HANDLE, DWORD, SIZE_T dwBytes)
+{
+    return malloc(dwBytes);
+}
+
+inline BOOL HeapFree(HANDLE, DWORD, LPVOID lpMem)
+{
+    free(lpMem);
+    return TRUE;
+}
+
+// Virtual memory maps onto mmap/mprotect; only the flag combinations used by
+// the request arena guard pages are supported
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+#define PAGE_NOACCESS 0x01
+#define PAGE_READWRITE 0x04
+
+inline LPVOID VirtualAlloc(LPVOID, SIZE_T dwSize, DWORD, DWORD)
+{
+    // The size is stored in front of the returned pointer for VirtualFree
+    void* p = mmap(NULL, dwSize + 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        return NULL;
+    }
+    *(SIZE_T*)p = dwSize + 4096;
+    return (BYTE*)p + 4096;
+}
+
+inline BOOL VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, DWORD* lpflOldProtect)
+{
+    if (lpflOldProtect != NULL)
+    {
+        *lpflOldProtect = PAGE_READWRITE;
+    }
+    return mprotect(lpAddress, dwSize, flNewProtect == PAGE_NOACCESS ? PROT_NONE : PROT_READ | PROT_WRITE) == 0;
+}
+
+inline BOOL VirtualFree(LPVOID lpAddress, SIZE_T, DWORD)
+{
+    BYTE* p = (BYTE*)lpAddress - 4096;
+    return munmap(p, *(SIZE_T*)p) == 0;
+}
+
+#endif // OMNI2FA_LINUX_WINDOWS_H
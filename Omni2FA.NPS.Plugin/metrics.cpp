@@ -0,0 +1,515 @@
+#include "metrics.h"
+#include "nativelog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#endif
+
+namespace {
+
+struct ShardHistogram
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[METRICS_BUCKETS];
+};
+
+// Written by the one thread that holds it, read by snapshots
+struct Shard
+{
+    ShardHistogram phases[MetricsPhaseCount];
+    std::atomic<uint64_t> counters[MetricsCounterCount];
+    std::atomic<bool> inUse;
+    Shard* next;
+};
+
+// Shards are pushed and never removed, so readers can walk the list at any time
+std::atomic<Shard*> g_shards(nullptr);
+
+const char* const kPhaseNames[MetricsPhaseCount] = {
+    "init", "process", "lookup", "groups", "authenticate", "auth_result"
+};
+const char* const kCounterNames[MetricsCounterCount] = {
+    "short_circuited", "mfa_succeeded", "mfa_failed", "mfa_circuit_rejected", "mfa_circuit_opened"
+};
+
+std::atomic<int64_t> g_gauges[MetricsGaugeCount];
+
+// Hands the shard back when its thread exits
+struct ShardLease
+{
+    Shard* shard = nullptr;
+
+    ~ShardLease()
+    {
+        if (shard != nullptr)
+            shard->inUse.store(false, std::memory_order_release);
+    }
+};
+
+thread_local ShardLease t_lease;
+
+Shard* AcquireShard()
+{
+    for (Shard* shard = g_shards.load(std::memory_order_acquire); shard != nullptr; shard = shard->next)
+    {
+        bool expected = false;
+        if (!shard->inUse.load(std::memory_order_relaxed) &&
+            shard->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return shard;
+    }
+    Shard* shard = new Shard();
+    shard->inUse.store(true, std::memory_order_relaxed);
+    Shard* head = g_shards.load(std::memory_order_relaxed);
+    do
+    {
+        shard->next = head;
+    } while (!g_shards.compare_exchange_weak(head, shard, std::memory_order_release, std::memory_order_relaxed));
+    return shard;
+}
+
+Shard* CurrentShard()
+{
+    Shard* shard = t_lease.shard;
+    if (shard == nullptr)
+        shard = t_lease.shard = AcquireShard();
+    return shard;
+}
+
+// Only the owning thread writes, so a plain load and store is enough
+void Add(std::atomic<uint64_t>& value, uint64_t delta)
+{
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+uint32_t HighestBit(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (uint32_t)index;
+#elif defined(__GNUC__)
+    return 63u - (uint32_t)__builtin_clzll(value);
+#else
+    uint32_t index = 0;
+    while ((value >>= 1) != 0)
+        ++index;
+    return index;
+#endif
+}
+
+uint64_t WallClockMicros()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void AppendNumber(std::string& out, uint64_t value)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)value);
+    out += number;
+}
+
+#ifdef _WIN32
+std::wstring Widen(const std::string& text)
+{
+    int chars = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+    if (chars <= 0)
+        return std::wstring();
+    std::wstring wide((size_t)chars, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], chars);
+    wide.resize((size_t)chars - 1);
+    return wide;
+}
+#endif
+
+FILE* OpenForWrite(const std::string& path)
+{
+#ifdef _WIN32
+    std::wstring widePath = Widen(path);
+    return widePath.empty() ? nullptr : _wfopen(widePath.c_str(), L"wb");
+#else
+    return fopen(path.c_str(), "wb");
+#endif
+}
+
+bool ReplaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExW(Widen(from).c_str(), Widen(to).c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Exporter thread state
+std::mutex g_exporterLock;
+std::condition_variable g_wake;
+std::thread g_exporter;
+bool g_running = false;
+std::string g_path;
+uint32_t g_exportIntervalMs = 0;
+uint32_t g_summaryIntervalMs = 0;
+
+void ExporterMain()
+{
+    std::unique_ptr<MetricsSnapshot> now(new MetricsSnapshot());
+    std::unique_ptr<MetricsSnapshot> previous(new MetricsSnapshot());
+    std::unique_ptr<MetricsSnapshot> delta(new MetricsSnapshot());
+    MetricsTakeSnapshot(previous.get());
+    std::chrono::steady_clock::time_point nextExport = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point nextSummary = nextExport + std::chrono::milliseconds(g_summaryIntervalMs);
+    bool writeFailed = false;
+    std::unique_lock<std::mutex> lock(g_exporterLock);
+    while (g_running)
+    {
+        std::chrono::steady_clock::time_point wakeAt = nextExport;
+        if (g_summaryIntervalMs > 0 && nextSummary < wakeAt)
+            wakeAt = nextSummary;
+        if (g_wake.wait_until(lock, wakeAt, [] { return !g_running; }))
+            break;
+        lock.unlock();
+        std::chrono::steady_clock::time_point current = std::chrono::steady_clock::now();
+        MetricsTakeSnapshot(now.get());
+        if (current >= nextExport)
+        {
+            nextExport = current + std::chrono::milliseconds(g_exportIntervalMs);
+            if (!g_path.empty())
+            {
+                bool written = MetricsWriteSnapshotFile(g_path.c_str(), *now);
+                // Warn once per failure streak instead of every interval
+                if (!written && !writeFailed)
+                    NATIVE_LOG(NativeLogWarning, 311, "Metrics snapshot could not be written to {0}.", g_path);
+                writeFailed = !written;
+            }
+        }
+        if (g_summaryIntervalMs > 0 && current >= nextSummary)
+        {
+            nextSummary = current + std::chrono::milliseconds(g_summaryIntervalMs);
+            MetricsDelta(*now, *previous, delta.get());
+            std::swap(now, previous);
+            std::string summary = MetricsFormatSummary(*delta);
+            if (!summary.empty())
+                NATIVE_LOG(NativeLogInformation, 212, "Metrics for the last {0} minutes:\n{1}",
+                    g_summaryIntervalMs / 60000u, summary);
+        }
+        lock.lock();
+    }
+}
+
+}  // namespace
+
+uint64_t MetricsNowMicros()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MetricsRecord(int phase, uint64_t micros)
+{
+    if (phase < 0 || phase >= MetricsPhaseCount)
+        return;
+    if (micros > METRICS_MAX_VALUE)
+        micros = METRICS_MAX_VALUE;
+    ShardHistogram& histogram = CurrentShard()->phases[phase];
+    Add(histogram.buckets[MetricsBucketIndex(micros)], 1);
+    Add(histogram.sum, micros);
+    if (micros > histogram.max.load(std::memory_order_relaxed))
+        histogram.max.store(micros, std::memory_order_relaxed);
+    // Count last, so a concurrent snapshot rarely sees a count without its bucket
+    Add(histogram.count, 1);
+}
+
+void MetricsRecordSince(int phase, uint64_t startMicros)
+{
+    uint64_t now = MetricsNowMicros();
+    MetricsRecord(phase, now > startMicros ? now - startMicros : 0);
+}
+
+void MetricsIncrement(int counter)
+{
+    if (counter < 0 || counter >= MetricsCounterCount)
+        return;
+    Add(CurrentShard()->counters[counter], 1);
+}
+
+void MetricsSetGauge(int gauge, int64_t value)
+{
+    if (gauge < 0 || gauge >= MetricsGaugeCount)
+        return;
+    g_gauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+void MetricsTakeSnapshot(MetricsSnapshot* snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->takenMicros = WallClockMicros();
+    for (int g = 0; g < MetricsGaugeCount; ++g)
+        snapshot->gauges[g] = g_gauges[g].load(std::memory_order_relaxed);
+    for (Shard* shard = g_shards.load(std::memory_order_acquire); shard != nullptr; shard = shard->next)
+    {
+        snapshot->shards++;
+        for (int p = 0; p < MetricsPhaseCount; ++p)
+        {
+            const ShardHistogram& from = shard->phases[p];
+            MetricsHistogram& to = snapshot->phases[p];
+            to.count += from.count.load(std::memory_order_relaxed);
+            to.sum += from.sum.load(std::memory_order_relaxed);
+            uint64_t max = from.max.load(std::memory_order_relaxed);
+            if (max > to.max)
+                to.max = max;
+            for (uint32_t b = 0; b < METRICS_BUCKETS; ++b)
+                to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+        }
+        for (int c = 0; c < MetricsCounterCount; ++c)
+            snapshot->counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+    }
+}
+
+void MetricsDelta(const MetricsSnapshot& now, const MetricsSnapshot& before, MetricsSnapshot* delta)
+{
+    memset(delta, 0, sizeof(*delta));
+    delta->takenMicros = now.takenMicros;
+    delta->shards = now.shards;
+    for (int p = 0; p < MetricsPhaseCount; ++p)
+    {
+        const MetricsHistogram& a = now.phases[p];
+        const MetricsHistogram& b = before.phases[p];
+        MetricsHistogram& d = delta->phases[p];
+        d.count = a.count >= b.count ? a.count - b.count : 0;
+        d.sum = a.sum >= b.sum ? a.sum - b.sum : 0;
+        for (uint32_t i = 0; i < METRICS_BUCKETS; ++i)
+        {
+            d.buckets[i] = a.buckets[i] >= b.buckets[i] ? a.buckets[i] - b.buckets[i] : 0;
+            if (d.buckets[i] > 0)
+                d.max = MetricsBucketUpperBound(i);
+        }
+        if (d.max > a.max)
+            d.max = a.max;
+    }
+    for (int c = 0; c < MetricsCounterCount; ++c)
+        delta->counters[c] = now.counters[c] >= before.counters[c] ? now.counters[c] - before.counters[c] : 0;
+    for (int g = 0; g < MetricsGaugeCount; ++g)
+        delta->gauges[g] = now.gauges[g];
+}
+
+void MetricsReset()
+{
+    for (Shard* shard = g_shards.load(std::memory_order_acquire); shard != nullptr; shard = shard->next)
+    {
+        for (int p = 0; p < MetricsPhaseCount; ++p)
+        {
+            ShardHistogram& histogram = shard->phases[p];
+            histogram.count.store(0, std::memory_order_relaxed);
+            histogram.sum.store(0, std::memory_order_relaxed);
+            histogram.max.store(0, std::memory_order_relaxed);
+            for (uint32_t b = 0; b < METRICS_BUCKETS; ++b)
+                histogram.buckets[b].store(0, std::memory_order_relaxed);
+        }
+        for (int c = 0; c < MetricsCounterCount; ++c)
+            shard->counters[c].store(0, std::memory_order_relaxed);
+    }
+    for (int g = 0; g < MetricsGaugeCount; ++g)
+        g_gauges[g].store(0, std::memory_order_relaxed);
+}
+
+uint64_t MetricsValueAtPercentile(const MetricsHistogram& histogram, double percentile)
+{
+    if (histogram.count == 0)
+        return 0;
+    if (percentile < 0)
+        percentile = 0;
+    if (percentile > 100)
+        percentile = 100;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram.count + 0.999999);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < METRICS_BUCKETS; ++i)
+    {
+        seen += histogram.buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t value = MetricsBucketUpperBound(i);
+            return value < histogram.max ? value : histogram.max;
+        }
+    }
+    return histogram.max;
+}
+
+// Values below 64 get a bucket each; above, every power of two is split into
+// 32 buckets
+uint32_t MetricsBucketIndex(uint64_t value)
+{
+    if (value > METRICS_MAX_VALUE)
+        value = METRICS_MAX_VALUE;
+    uint32_t shift = HighestBit(value | 63u) - METRICS_SUB_BUCKET_BITS;
+    return (shift << METRICS_SUB_BUCKET_BITS) + (uint32_t)(value >> shift);
+}
+
+uint64_t MetricsBucketUpperBound(uint32_t index)
+{
+    if (index >= METRICS_BUCKETS)
+        index = METRICS_BUCKETS - 1;
+    uint32_t shift = index < 64u ? 0u : (index >> METRICS_SUB_BUCKET_BITS) - 1u;
+    uint64_t sub = index - (shift << METRICS_SUB_BUCKET_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+const char* MetricsPhaseName(int phase)
+{
+    return phase >= 0 && phase < MetricsPhaseCount ? kPhaseNames[phase] : "unknown";
+}
+
+const char* MetricsCounterName(int counter)
+{
+    return counter >= 0 && counter < MetricsCounterCount ? kCounterNames[counter] : "unknown";
+}
+
+std::string MetricsFormatPrometheus(const MetricsSnapshot& snapshot)
+{
+    static const struct
+    {
+        const char* label;
+        double percentile;
+    } kQuantiles[] = { { "0.5", 50 }, { "0.9", 90 }, { "0.99", 99 }, { "0.999", 99.9 } };
+
+    std::string out;
+    out.reserve(4096);
+    out += "# HELP omni2fa_phase_latency_microseconds Latency of the request phases of the NPS plugin.\n";
+    out += "# TYPE omni2fa_phase_latency_microseconds summary\n";
+    for (int p = 0; p < MetricsPhaseCount; ++p)
+    {
+        const MetricsHistogram& histogram = snapshot.phases[p];
+        std::string phase = std::string("phase=\"") + kPhaseNames[p] + "\"";
+        for (const auto& quantile : kQuantiles)
+        {
+            out += "omni2fa_phase_latency_microseconds{" + phase + ",quantile=\"" + quantile.label + "\"} ";
+            AppendNumber(out, MetricsValueAtPercentile(histogram, quantile.percentile));
+            out += "\n";
+        }
+        out += "omni2fa_phase_latency_microseconds_sum{" + phase + "} ";
+        AppendNumber(out, histogram.sum);
+        out += "\nomni2fa_phase_latency_microseconds_count{" + phase + "} ";
+        AppendNumber(out, histogram.count);
+        out += "\n";
+    }
+    out += "# HELP omni2fa_phase_latency_max_microseconds Slowest sample of each phase since the plugin was loaded.\n";
+    out += "# TYPE omni2fa_phase_latency_max_microseconds gauge\n";
+    for (int p = 0; p < MetricsPhaseCount; ++p)
+    {
+        out += std::string("omni2fa_phase_latency_max_microseconds{phase=\"") + kPhaseNames[p] + "\"} ";
+        AppendNumber(out, snapshot.phases[p].max);
+        out += "\n";
+    }
+    out += "# HELP omni2fa_events_total Request outcomes counted by the NPS plugin.\n";
+    out += "# TYPE omni2fa_events_total counter\n";
+    for (int c = 0; c < MetricsCounterCount; ++c)
+    {
+        out += std::string("omni2fa_events_total{event=\"") + kCounterNames[c] + "\"} ";
+        AppendNumber(out, snapshot.counters[c]);
+        out += "\n";
+    }
+    out += "# HELP omni2fa_mfa_breaker_state State of the MFA circuit breaker: 0 closed, 1 open, 2 half-open.\n";
+    out += "# TYPE omni2fa_mfa_breaker_state gauge\nomni2fa_mfa_breaker_state ";
+    out += std::to_string(snapshot.gauges[MetricsGaugeMfaBreakerState]);
+    out += "\n";
+    out += "# HELP omni2fa_metrics_threads Threads that have recorded metrics.\n";
+    out += "# TYPE omni2fa_metrics_threads gauge\nomni2fa_metrics_threads ";
+    AppendNumber(out, snapshot.shards);
+    out += "\n";
+    return out;
+}
+
+std::string MetricsFormatSummary(const MetricsSnapshot& snapshot)
+{
+    std::string out;
+    char line[256];
+    for (int p = 0; p < MetricsPhaseCount; ++p)
+    {
+        const MetricsHistogram& histogram = snapshot.phases[p];
+        if (histogram.count == 0)
+            continue;
+        snprintf(line, sizeof(line), "%s: %llu samples, p50 %llu us, p90 %llu us, p99 %llu us, max %llu us\n",
+            kPhaseNames[p], (unsigned long long)histogram.count,
+            (unsigned long long)MetricsValueAtPercentile(histogram, 50),
+            (unsigned long long)MetricsValueAtPercentile(histogram, 90),
+            (unsigned long long)MetricsValueAtPercentile(histogram, 99),
+            (unsigned long long)histogram.max);
+        out += line;
+    }
+    if (out.empty())
+        return out;
+    snprintf(line, sizeof(line), "short-circuited %llu, MFA succeeded %llu, MFA failed %llu, rejected by open circuit %llu",
+        (unsigned long long)snapshot.counters[MetricsCounterShortCircuited],
+        (unsigned long long)snapshot.counters[MetricsCounterMfaSucceeded],
+        (unsigned long long)snapshot.counters[MetricsCounterMfaFailed],
+        (unsigned long long)snapshot.counters[MetricsCounterMfaCircuitRejected]);
+    out += line;
+    return out;
+}
+
+bool MetricsWriteSnapshotFile(const char* path, const MetricsSnapshot& snapshot)
+{
+    if (path == nullptr || path[0] == '\0')
+        return false;
+    std::string text = MetricsFormatPrometheus(snapshot);
+    std::string target(path);
+    std::string temp = target + ".tmp";
+    FILE* file = OpenForWrite(temp);
+    if (file == nullptr)
+        return false;
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (fclose(file) != 0)
+        written = false;
+    if (!written || !ReplaceFile(temp, target))
+    {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MetricsExporterStart(const char* path, uint32_t exportIntervalMs, uint32_t summaryIntervalMs)
+{
+    std::lock_guard<std::mutex> lock(g_exporterLock);
+    if (g_running || exportIntervalMs == 0)
+        return false;
+    g_path = path != nullptr ? path : "";
+    g_exportIntervalMs = exportIntervalMs;
+    g_summaryIntervalMs = summaryIntervalMs;
+    g_running = true;
+    g_exporter = std::thread(ExporterMain);
+    return true;
+}
+
+void MetricsExporterStop()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_exporterLock);
+        if (!g_running)
+            return;
+        g_running = false;
+    }
+    g_wake.notify_all();
+    if (g_exporter.joinable())
+        g_exporter.join();
+    if (!g_path.empty())
+    {
+        std::unique_ptr<MetricsSnapshot> last(new MetricsSnapshot());
+        MetricsTakeSnapshot(last.get());
+        MetricsWriteSnapshotFile(g_path.c_str(), *last);
+    }
+}
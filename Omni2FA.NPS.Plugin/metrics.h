@@ -0,0 +1,121 @@
+#ifndef METRICS_H
+#define METRICS_H
+#pragma once
+
+// Latency histograms and counters for the phases of a request.
+//
+// Every thread records into its own shard, so recording is a handful of
+// uncontended stores: no locks, no shared cache lines and no interlocked
+// instructions. A shard is claimed from a lock-free list the first time a
+// thread records and handed back when the thread exits, so the NPS thread pool
+// reuses shards instead of growing the list. Snapshots add up all shards
+// without stopping the writers; a snapshot taken while requests are running
+// may miss the samples being written at that moment, which is fine for
+// monitoring.
+//
+// Histograms are log-linear like HdrHistogram: exact below 64 us and within
+// 1/32 (about 3%) of the value above, up to 2^36 us (19 hours).
+//
+// The exporter thread writes a snapshot file in the Prometheus text format for
+// a local collector (for example the textfile collector of windows_exporter)
+// and logs a summary of the last interval to the Event Log (event 212).
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#define METRICS_SUB_BUCKET_BITS 5
+#define METRICS_BUCKETS 1024
+#define METRICS_MAX_VALUE ((1ull << 36) - 1)
+
+// Also the index used by the managed MetricsPhase enum in Omni2FA.Net.Utils
+enum MetricsPhase
+{
+    MetricsPhaseInit = 0,       // RadiusExtensionInit
+    MetricsPhaseProcess,        // RadiusExtensionProcess2
+    MetricsPhaseLookup,         // attribute lookup in the adapter
+    MetricsPhaseGroups,         // NoMFA group resolution
+    MetricsPhaseAuthenticate,   // one /Authenticate call
+    MetricsPhaseAuthResult,     // one /AuthResult poll
+    MetricsPhaseCount
+};
+
+enum MetricsCounter
+{
+    MetricsCounterShortCircuited = 0,
+    MetricsCounterMfaSucceeded,
+    MetricsCounterMfaFailed,
+    MetricsCounterMfaCircuitRejected,   // answered without the MFA service while the breaker was open
+    MetricsCounterMfaCircuitOpened,
+    MetricsCounterCount
+};
+
+// Current values rather than counts; set by their owner, not per thread
+enum MetricsGauge
+{
+    MetricsGaugeMfaBreakerState = 0,    // MfaBreakerState
+    MetricsGaugeCount
+};
+
+struct MetricsHistogram
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[METRICS_BUCKETS];
+};
+
+struct MetricsSnapshot
+{
+    // Wall clock, microseconds since 1970
+    uint64_t takenMicros;
+    uint32_t shards;
+    MetricsHistogram phases[MetricsPhaseCount];
+    uint64_t counters[MetricsCounterCount];
+    int64_t gauges[MetricsGaugeCount];
+};
+
+// Monotonic clock for timing phases
+uint64_t MetricsNowMicros();
+
+// Out-of-range phases and counters are ignored
+void MetricsRecord(int phase, uint64_t micros);
+void MetricsRecordSince(int phase, uint64_t startMicros);
+void MetricsIncrement(int counter);
+void MetricsSetGauge(int gauge, int64_t value);
+
+// Adds up all shards. The snapshot is about 50 KB; keep it off small stacks.
+void MetricsTakeSnapshot(MetricsSnapshot* snapshot);
+// Samples recorded between two snapshots. The maximum of the interval is the
+// upper bound of its highest bucket. Gauges are taken from now.
+void MetricsDelta(const MetricsSnapshot& now, const MetricsSnapshot& before, MetricsSnapshot* delta);
+// Zeroes all shards and gauges; only for tests, with no thread recording meanwhile
+void MetricsReset();
+
+// Highest value equivalent to the sample at the percentile (0-100), capped at max
+uint64_t MetricsValueAtPercentile(const MetricsHistogram& histogram, double percentile);
+uint32_t MetricsBucketIndex(uint64_t value);
+uint64_t MetricsBucketUpperBound(uint32_t index);
+
+const char* MetricsPhaseName(int phase);
+const char* MetricsCounterName(int counter);
+
+// Prometheus text exposition format: a summary per phase, counters, gauges, shard count
+std::string MetricsFormatPrometheus(const MetricsSnapshot& snapshot);
+// One line per phase with samples: "process: 1200 requests, p50 85 us, ..."
+std::string MetricsFormatSummary(const MetricsSnapshot& snapshot);
+// Writes the Prometheus text to a temporary file and renames it over path, so
+// a collector never reads a half-written file.
+bool MetricsWriteSnapshotFile(const char* path, const MetricsSnapshot& snapshot);
+
+// Starts the exporter thread. path may be null or empty for no snapshot file;
+// a summaryIntervalMs of 0 logs no summaries. Intervals without samples are
+// not summarized.
+bool MetricsExporterStart(const char* path, uint32_t exportIntervalMs, uint32_t summaryIntervalMs);
+// Writes a last snapshot file and stops the thread.
+void MetricsExporterStop();
+
+#endif // METRICS_H
@@ -0,0 +1,287 @@
+#include "mfabreaker.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace {
+
+struct Bucket
+{
+    // Index of the bucket-sized time slot the counts belong to
+    uint64_t slot;
+    uint32_t requests;
+    uint32_t failures;
+    uint32_t slow;
+};
+
+std::mutex g_lock;
+MfaBreakerConfig g_config;
+bool g_enabled = false;
+// Written under g_lock; read without it by MfaBreakerAllow
+std::atomic<int> g_state(MfaBreakerClosed);
+Bucket g_buckets[MFA_BREAKER_BUCKETS];
+uint64_t g_openedAt = 0;
+uint64_t g_probeStarted = 0;
+bool g_probeInFlight = false;
+uint64_t g_opened = 0;
+uint64_t g_rejected = 0;
+uint64_t g_probes = 0;
+MfaBreakerListener g_listener = nullptr;
+void* g_listenerContext = nullptr;
+
+uint64_t NowMicros()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t BucketMicros()
+{
+    uint64_t micros = (uint64_t)g_config.windowMs * 1000 / MFA_BREAKER_BUCKETS;
+    return micros > 0 ? micros : 1;
+}
+
+void ClearWindow()
+{
+    memset(g_buckets, 0, sizeof(g_buckets));
+}
+
+// Adds up the buckets still inside the window; called under g_lock
+void SumWindow(uint64_t now, MfaBreakerStats* stats)
+{
+    uint64_t slot = now / BucketMicros();
+    stats->requests = 0;
+    stats->failures = 0;
+    stats->slow = 0;
+    for (const Bucket& bucket : g_buckets)
+    {
+        if (bucket.requests == 0 || bucket.slot + MFA_BREAKER_BUCKETS <= slot)
+            continue;
+        stats->requests += bucket.requests;
+        stats->failures += bucket.failures;
+        stats->slow += bucket.slow;
+    }
+}
+
+MfaBreakerStats TakeStats(uint64_t now)
+{
+    MfaBreakerStats stats;
+    stats.state = (MfaBreakerState)g_state.load(std::memory_order_relaxed);
+    SumWindow(now, &stats);
+    stats.opened = g_opened;
+    stats.rejected = g_rejected;
+    stats.probes = g_probes;
+    return stats;
+}
+
+// Changes the state under g_lock and returns the stats for the listener
+MfaBreakerStats Transition(MfaBreakerState to, uint64_t now)
+{
+    MfaBreakerStats stats = TakeStats(now);
+    if (to == MfaBreakerOpen)
+    {
+        g_openedAt = now;
+        g_opened++;
+        stats.opened = g_opened;
+    }
+    if (to != MfaBreakerHalfOpen)
+        g_probeInFlight = false;
+    if (to == MfaBreakerClosed)
+        ClearWindow();
+    g_state.store(to, std::memory_order_release);
+    return stats;
+}
+
+void Notify(MfaBreakerListener listener, void* context, MfaBreakerState from, MfaBreakerState to, const MfaBreakerStats& stats)
+{
+    if (listener != nullptr)
+        listener(from, to, &stats, context);
+}
+
+}  // namespace
+
+void MfaBreakerDefaultConfig(MfaBreakerConfig* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->failurePercent = 50;
+    config->minRequests = 10;
+    config->windowMs = 60000;
+    config->slowMs = 10000;
+    config->openMs = 30000;
+    config->probeTimeoutMs = 60000;
+}
+
+void MfaBreakerConfigure(const MfaBreakerConfig* config)
+{
+    MfaBreakerState from;
+    MfaBreakerStats stats;
+    MfaBreakerListener listener;
+    void* context;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        if (g_enabled && memcmp(&g_config, config, sizeof(g_config)) == 0)
+            return;
+        g_config = *config;
+        g_enabled = config->failurePercent > 0;
+        ClearWindow();
+        from = (MfaBreakerState)g_state.load(std::memory_order_relaxed);
+        if (from == MfaBreakerClosed)
+            return;
+        stats = Transition(MfaBreakerClosed, NowMicros());
+        listener = g_listener;
+        context = g_listenerContext;
+    }
+    Notify(listener, context, from, MfaBreakerClosed, stats);
+}
+
+void MfaBreakerSetListener(MfaBreakerListener listener, void* context)
+{
+    std::lock_guard<std::mutex> guard(g_lock);
+    g_listener = listener;
+    g_listenerContext = context;
+}
+
+bool MfaBreakerAllow()
+{
+    if (g_state.load(std::memory_order_acquire) == MfaBreakerClosed)
+        return true;
+    MfaBreakerStats stats;
+    MfaBreakerListener listener;
+    void* context;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        uint64_t now = NowMicros();
+        MfaBreakerState state = (MfaBreakerState)g_state.load(std::memory_order_relaxed);
+        if (state == MfaBreakerClosed)
+            return true;
+        if (state == MfaBreakerOpen && now - g_openedAt < (uint64_t)g_config.openMs * 1000)
+        {
+            g_rejected++;
+            return false;
+        }
+        if (state == MfaBreakerHalfOpen)
+        {
+            if (g_probeInFlight && now - g_probeStarted < (uint64_t)g_config.probeTimeoutMs * 1000)
+            {
+                g_rejected++;
+                return false;
+            }
+            // The previous probe never reported back
+            g_probeInFlight = true;
+            g_probeStarted = now;
+            g_probes++;
+            return true;
+        }
+        stats = Transition(MfaBreakerHalfOpen, now);
+        g_probeInFlight = true;
+        g_probeStarted = now;
+        g_probes++;
+        stats.probes = g_probes;
+        listener = g_listener;
+        context = g_listenerContext;
+    }
+    Notify(listener, context, MfaBreakerOpen, MfaBreakerHalfOpen, stats);
+    return true;
+}
+
+void MfaBreakerRecord(bool failed, uint64_t latencyMicros)
+{
+    MfaBreakerState from;
+    MfaBreakerState to;
+    MfaBreakerStats stats;
+    MfaBreakerListener listener;
+    void* context;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        if (!g_enabled)
+            return;
+        uint64_t now = NowMicros();
+        bool slow = !failed && g_config.slowMs > 0 && latencyMicros > (uint64_t)g_config.slowMs * 1000;
+        from = (MfaBreakerState)g_state.load(std::memory_order_relaxed);
+        if (from == MfaBreakerOpen)
+        {
+            // A call that started before the breaker opened
+            return;
+        }
+        if (from == MfaBreakerHalfOpen)
+        {
+            // Any outcome decides, whether from the probe or from a call that was already running
+            to = failed || slow ? MfaBreakerOpen : MfaBreakerClosed;
+        }
+        else
+        {
+            uint64_t slot = now / BucketMicros();
+            Bucket& bucket = g_buckets[slot % MFA_BREAKER_BUCKETS];
+            if (bucket.slot != slot)
+            {
+                memset(&bucket, 0, sizeof(bucket));
+                bucket.slot = slot;
+            }
+            bucket.requests++;
+            if (failed)
+                bucket.failures++;
+            if (slow)
+                bucket.slow++;
+            MfaBreakerStats window;
+            SumWindow(now, &window);
+            if (window.requests < g_config.minRequests || window.requests == 0 ||
+                (uint64_t)(window.failures + window.slow) * 100 < (uint64_t)g_config.failurePercent * window.requests)
+            {
+                return;
+            }
+            to = MfaBreakerOpen;
+        }
+        stats = Transition(to, now);
+        if (from == MfaBreakerHalfOpen)
+        {
+            // The window was cleared when the breaker opened; report the probe
+            stats.requests = 1;
+            stats.failures = failed ? 1 : 0;
+            stats.slow = slow ? 1 : 0;
+        }
+        if (to == MfaBreakerOpen)
+            ClearWindow();
+        listener = g_listener;
+        context = g_listenerContext;
+    }
+    Notify(listener, context, from, to, stats);
+}
+
+MfaBreakerState MfaBreakerGetState()
+{
+    return (MfaBreakerState)g_state.load(std::memory_order_acquire);
+}
+
+MfaBreakerStats MfaBreakerGetStats()
+{
+    std::lock_guard<std::mutex> guard(g_lock);
+    return TakeStats(NowMicros());
+}
+
+const char* MfaBreakerStateName(MfaBreakerState state)
+{
+    switch (state)
+    {
+    case MfaBreakerClosed: return "closed";
+    case MfaBreakerOpen: return "open";
+    case MfaBreakerHalfOpen: return "half-open";
+    }
+    return "unknown";
+}
+
+void MfaBreakerReset()
+{
+    std::lock_guard<std::mutex> guard(g_lock);
+    memset(&g_config, 0, sizeof(g_config));
+    g_enabled = false;
+    g_state.store(MfaBreakerClosed, std::memory_order_release);
+    ClearWindow();
+    g_openedAt = 0;
+    g_probeStarted = 0;
+    g_probeInFlight = false;
+    g_opened = 0;
+    g_rejected = 0;
+    g_probes = 0;
+}
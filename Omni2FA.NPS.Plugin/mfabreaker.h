@@ -0,0 +1,89 @@
+#ifndef MFABREAKER_H
+#define MFABREAKER_H
+#pragma once
+
+// Circuit breaker for the MFA service.
+//
+// Both MFA clients report the outcome of every /Authenticate call: whether the
+// service failed (unreachable, timed out, HTTP or response errors; a user who
+// denies the push is not a failure) and how long the call took. Outcomes are
+// counted in a rolling window of MFA_BREAKER_BUCKETS time buckets. Once the
+// window holds minRequests calls of which failurePercent failed or took longer
+// than slowMs, the breaker opens: the adapter then answers MFA candidates at
+// once (rejecting them, or accepting them with MfaFailOpen) instead of holding
+// an NPS thread for AuthTimeout per request. After openMs one request is let
+// through as a probe (half-open); its outcome closes the breaker or opens it
+// again. A probe that reports nothing within probeTimeoutMs is written off and
+// the next request becomes the probe.
+//
+// There is one breaker per process, like the MFA client. While closed, asking
+// for permission is one atomic load; outcomes are counted under a lock, which
+// is taken once per MFA.
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stdint.h>
+
+#define MFA_BREAKER_BUCKETS 10
+
+enum MfaBreakerState
+{
+    MfaBreakerClosed = 0,
+    MfaBreakerOpen,
+    MfaBreakerHalfOpen
+};
+
+struct MfaBreakerConfig
+{
+    // Share of failed or slow calls that opens the breaker; 0 disables it
+    uint32_t failurePercent;
+    // Calls the window must hold before the share is looked at
+    uint32_t minRequests;
+    uint32_t windowMs;
+    // Calls slower than this count as failed; 0 counts none as slow
+    uint32_t slowMs;
+    // How long the breaker stays open before a probe is let through
+    uint32_t openMs;
+    uint32_t probeTimeoutMs;
+};
+
+struct MfaBreakerStats
+{
+    MfaBreakerState state;
+    // Calls in the current window, and how many of them failed or were slow
+    uint32_t requests;
+    uint32_t failures;
+    uint32_t slow;
+    // Since the breaker was configured
+    uint64_t opened;
+    uint64_t rejected;
+    uint64_t probes;
+};
+
+// Called after every state change, outside the breaker's lock, on the thread
+// that caused it. stats are taken at the change, before the window is cleared.
+typedef void (*MfaBreakerListener)(MfaBreakerState from, MfaBreakerState to, const MfaBreakerStats* stats, void* context);
+
+// 50% of at least 10 calls in 60 s, calls over 10 s are slow, open for 30 s,
+// probe written off after 60 s
+void MfaBreakerDefaultConfig(MfaBreakerConfig* config);
+// Applies the configuration. The breaker is closed and its window cleared only
+// if the configuration differs from the current one.
+void MfaBreakerConfigure(const MfaBreakerConfig* config);
+void MfaBreakerSetListener(MfaBreakerListener listener, void* context);
+
+// Whether a request may call the service now; false while the breaker is open
+// and, while half-open, for all but the probe
+bool MfaBreakerAllow();
+// Outcome of one /Authenticate call
+void MfaBreakerRecord(bool failed, uint64_t latencyMicros);
+
+MfaBreakerState MfaBreakerGetState();
+MfaBreakerStats MfaBreakerGetStats();
+const char* MfaBreakerStateName(MfaBreakerState state);
+
+// Disables the breaker and clears its state and counters
+void MfaBreakerReset();
+
+#endif // MFABREAKER_H
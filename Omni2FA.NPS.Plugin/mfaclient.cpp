@@ -0,0 +1,1991 @@
+#include "mfaclient.h"
+#include "mfabreaker.h"
+#include "metrics.h"
+#include "nativelog.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MFA_CLIENT_MAX_REQUEST 8192
+// Status lines and header lines longer than this are treated as a malformed response
+#define MFA_CLIENT_MAX_LINE 8192
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET SocketHandle;
+const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+typedef int SocketHandle;
+const SocketHandle kInvalidSocket = -1;
+#endif
+
+// ---------------------------------------------------------------------------
+// Socket helpers; all sockets are non-blocking and waited on with poll
+// ---------------------------------------------------------------------------
+
+void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+bool SetNonBlocking(SocketHandle socket)
+{
+#ifdef _WIN32
+    u_long enabled = 1;
+    return ioctlsocket(socket, FIONBIO, &enabled) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool LastErrorWouldBlock()
+{
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+    return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+uint64_t NowMicros()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int RemainingMs(uint64_t deadline)
+{
+    uint64_t now = NowMicros();
+    if (now >= deadline)
+        return 0;
+    uint64_t ms = (deadline - now + 999) / 1000;
+    return ms > 0x7FFFFFFF ? 0x7FFFFFFF : (int)ms;
+}
+
+// Waits until one of the sockets is ready or the deadline (NowMicros) passes; a
+// deadline of 0 only checks. Returns the number of ready sockets, 0 on timeout
+// and -1 on error.
+int WaitSockets(struct pollfd* entries, uint32_t count, uint64_t deadline)
+{
+    for (;;)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            entries[i].revents = 0;
+#ifdef _WIN32
+        int ready = WSAPoll(entries, count, RemainingMs(deadline));
+#else
+        int ready = poll(entries, count, RemainingMs(deadline));
+        if (ready < 0 && errno == EINTR)
+            continue;
+#endif
+        return ready < 0 ? -1 : ready;
+    }
+}
+
+// Same for one socket: 1 when ready, 0 on timeout and -1 on error
+int WaitSocket(SocketHandle socket, short events, uint64_t deadline)
+{
+    struct pollfd entry;
+    entry.fd = socket;
+    entry.events = events;
+    int ready = WaitSockets(&entry, 1, deadline);
+    return ready > 0 ? 1 : ready;
+}
+
+// ---------------------------------------------------------------------------
+// Configuration and pre-rendered requests
+// ---------------------------------------------------------------------------
+
+// Health and latency of an endpoint, updated by the requests using it
+struct EndpointState
+{
+    // Failed exchanges in a row; from MFA_CLIENT_UNHEALTHY_FAILURES on the
+    // endpoint is skipped until retryAt (NowMicros)
+    std::atomic<uint32_t> failures{ 0 };
+    std::atomic<uint64_t> retryAt{ 0 };
+    // Updated without a lock; a lost update only makes the average lag a little
+    std::atomic<uint64_t> ewmaMicros{ 0 };
+    std::atomic<uint64_t> exchanges{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    // Recent /AuthResult latencies, oldest overwritten first
+    std::mutex lock;
+    uint32_t pollMicros[MFA_CLIENT_LATENCY_WINDOW];
+    uint32_t pollCount = 0;
+    uint32_t pollNext = 0;
+};
+
+// Immutable once published, apart from its state; requests in flight keep
+// their own reference to the set
+struct Endpoint
+{
+    MfaClientConfig config;
+    uint32_t generation;
+    // Position in the set, also the key of its pooled connections
+    uint32_t index;
+    std::unique_ptr<EndpointState> state;
+    // Request line and headers up to and including "Content-Length: "
+    std::string authenticatePrefix;
+    std::string authResultPrefix;
+    // JSON body around the user name: {"samid":" ... ","requestor":"SMK-RDG"}
+    std::string bodyPrefix;
+    std::string bodySuffix;
+};
+
+struct EndpointSet
+{
+    std::vector<std::unique_ptr<const Endpoint>> endpoints;
+};
+
+struct PooledConnection
+{
+    SocketHandle socket;
+    uint32_t generation;
+    uint32_t endpoint;
+    uint64_t idleSince;
+};
+
+// Guards the endpoints, the pool and the started flag
+std::mutex g_lock;
+std::condition_variable g_stopped;
+std::shared_ptr<const EndpointSet> g_endpoints;
+uint32_t g_generation = 0;
+// Incremented by MfaClientStop so sleeping requests notice it
+uint64_t g_epoch = 0;
+bool g_started = false;
+PooledConnection g_pool[MFA_CLIENT_MAX_POOL];
+uint32_t g_poolCount = 0;
+#ifdef _WIN32
+bool g_winsockReady = false;
+#endif
+
+std::atomic<uint64_t> g_requests(0);
+std::atomic<uint64_t> g_exchanges(0);
+std::atomic<uint64_t> g_connectionsOpened(0);
+std::atomic<uint64_t> g_connectionsReused(0);
+std::atomic<uint64_t> g_retries(0);
+std::atomic<uint64_t> g_failures(0);
+std::atomic<uint64_t> g_failovers(0);
+std::atomic<uint64_t> g_polls(0);
+std::atomic<uint64_t> g_hedges(0);
+std::atomic<uint64_t> g_hedgesWon(0);
+std::atomic<uint64_t> g_phaseMicros[MfaPhaseCount];
+std::atomic<uint64_t> g_maxPhaseMicros[MfaPhaseCount];
+
+void AppendBase64(std::string& out, const char* data, size_t length)
+{
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    for (; i + 2 < length; i += 3)
+    {
+        uint32_t block = ((uint8_t)data[i] << 16) | ((uint8_t)data[i + 1] << 8) | (uint8_t)data[i + 2];
+        out += kAlphabet[(block >> 18) & 63];
+        out += kAlphabet[(block >> 12) & 63];
+        out += kAlphabet[(block >> 6) & 63];
+        out += kAlphabet[block & 63];
+    }
+    if (i < length)
+    {
+        uint32_t block = (uint8_t)data[i] << 16;
+        if (i + 1 < length)
+            block |= (uint8_t)data[i + 1] << 8;
+        out += kAlphabet[(block >> 18) & 63];
+        out += kAlphabet[(block >> 12) & 63];
+        out += i + 1 < length ? kAlphabet[(block >> 6) & 63] : '=';
+        out += '=';
+    }
+}
+
+// Escapes like Newtonsoft.Json does for the managed client; returns false if it does not fit
+bool AppendJsonString(char* out, size_t capacity, size_t* used, const char* text)
+{
+    static const char kHex[] = "0123456789abcdef";
+    size_t at = *used;
+    for (const unsigned char* p = (const unsigned char*)text; *p != 0; ++p)
+    {
+        char escaped = 0;
+        switch (*p)
+        {
+        case '"': escaped = '"'; break;
+        case '\\': escaped = '\\'; break;
+        case '\b': escaped = 'b'; break;
+        case '\f': escaped = 'f'; break;
+        case '\n': escaped = 'n'; break;
+        case '\r': escaped = 'r'; break;
+        case '\t': escaped = 't'; break;
+        default: break;
+        }
+        if (escaped != 0)
+        {
+            if (at + 2 > capacity)
+                return false;
+            out[at++] = '\\';
+            out[at++] = escaped;
+        }
+        else if (*p < 0x20)
+        {
+            if (at + 6 > capacity)
+                return false;
+            memcpy(out + at, "\\u00", 4);
+            out[at + 4] = kHex[*p >> 4];
+            out[at + 5] = kHex[*p & 15];
+            at += 6;
+        }
+        else
+        {
+            if (at + 1 > capacity)
+                return false;
+            out[at++] = (char)*p;
+        }
+    }
+    *used = at;
+    return true;
+}
+
+std::string RenderPrefix(const MfaClientConfig& config, const char* operation)
+{
+    std::string prefix;
+    prefix.reserve(512);
+    prefix += "POST ";
+    prefix += config.basePath;
+    prefix += '/';
+    prefix += operation;
+    prefix += " HTTP/1.1\r\nHost: ";
+    bool ipv6 = strchr(config.host, ':') != nullptr;
+    if (ipv6)
+        prefix += '[';
+    prefix += config.host;
+    if (ipv6)
+        prefix += ']';
+    if (config.port != 80)
+    {
+        char port[8];
+        snprintf(port, sizeof(port), ":%u", (unsigned)config.port);
+        prefix += port;
+    }
+    prefix += "\r\n";
+    if (config.credentials[0] != '\0')
+    {
+        prefix += "Authorization: Basic ";
+        AppendBase64(prefix, config.credentials, strlen(config.credentials));
+        prefix += "\r\n";
+    }
+    prefix += "Content-Type: application/json; charset=utf-8\r\nContent-Length: ";
+    return prefix;
+}
+
+std::unique_ptr<const Endpoint> BuildEndpoint(const MfaClientConfig& config, uint32_t generation, uint32_t index)
+{
+    std::unique_ptr<Endpoint> endpoint(new Endpoint());
+    endpoint->config = config;
+    endpoint->config.host[MFA_CLIENT_MAX_HOST - 1] = '\0';
+    endpoint->config.basePath[MFA_CLIENT_MAX_PATH - 1] = '\0';
+    endpoint->config.credentials[MFA_CLIENT_MAX_CREDENTIALS - 1] = '\0';
+    endpoint->config.requestor[MFA_CLIENT_MAX_REQUESTOR - 1] = '\0';
+    if (endpoint->config.maxIdleConnections > MFA_CLIENT_MAX_POOL)
+        endpoint->config.maxIdleConnections = MFA_CLIENT_MAX_POOL;
+    endpoint->generation = generation;
+    endpoint->index = index;
+    endpoint->state.reset(new EndpointState());
+    endpoint->authenticatePrefix = RenderPrefix(endpoint->config, "Authenticate");
+    endpoint->authResultPrefix = RenderPrefix(endpoint->config, "AuthResult");
+    endpoint->bodyPrefix = "{\"samid\":\"";
+
+    char requestor[MFA_CLIENT_MAX_REQUESTOR * 6];
+    size_t used = 0;
+    AppendJsonString(requestor, sizeof(requestor), &used, endpoint->config.requestor);
+    endpoint->bodySuffix = "\",\"requestor\":\"";
+    endpoint->bodySuffix.append(requestor, used);
+    endpoint->bodySuffix += "\"}";
+    return std::unique_ptr<const Endpoint>(endpoint.release());
+}
+
+// Fills in Content-Length and the body after a pre-rendered prefix; returns the request length or 0
+size_t RenderRequest(const std::string& prefix, const char* body, size_t bodyLength, char* out, size_t capacity)
+{
+    char length[24];
+    int lengthChars = snprintf(length, sizeof(length), "%u\r\n\r\n", (unsigned)bodyLength);
+    size_t total = prefix.size() + (size_t)lengthChars + bodyLength;
+    if (lengthChars <= 0 || total > capacity)
+        return 0;
+    memcpy(out, prefix.data(), prefix.size());
+    memcpy(out + prefix.size(), length, (size_t)lengthChars);
+    memcpy(out + prefix.size() + lengthChars, body, bodyLength);
+    return total;
+}
+
+size_t RenderBody(const Endpoint& endpoint, const char* samid, char* out, size_t capacity)
+{
+    if (samid == nullptr || samid[0] == '\0' || strlen(samid) > MFA_CLIENT_MAX_USER)
+        return 0;
+    size_t used = endpoint.bodyPrefix.size();
+    if (used + endpoint.bodySuffix.size() > capacity)
+        return 0;
+    memcpy(out, endpoint.bodyPrefix.data(), used);
+    if (!AppendJsonString(out, capacity - endpoint.bodySuffix.size(), &used, samid))
+        return 0;
+    memcpy(out + used, endpoint.bodySuffix.data(), endpoint.bodySuffix.size());
+    return used + endpoint.bodySuffix.size();
+}
+
+// ---------------------------------------------------------------------------
+// Connection pool
+// ---------------------------------------------------------------------------
+
+// A pooled connection that became readable while idle was closed by the
+// server (or sent something unexpected) and cannot carry a new request
+bool IsStillOpen(SocketHandle socket)
+{
+    return WaitSocket(socket, POLLIN, 0) == 0;
+}
+
+// Connections of the current generation to other endpoints are left alone
+bool IsOtherEndpoint(const PooledConnection& pooled, const Endpoint& endpoint)
+{
+    return pooled.generation == endpoint.generation && pooled.endpoint != endpoint.index;
+}
+
+bool IsUsable(const PooledConnection& pooled, const Endpoint& endpoint, uint64_t now)
+{
+    return pooled.generation == endpoint.generation && pooled.endpoint == endpoint.index &&
+        now - pooled.idleSince <= (uint64_t)endpoint.config.idleTimeoutMs * 1000 &&
+        IsStillOpen(pooled.socket);
+}
+
+SocketHandle AcquirePooled(const Endpoint& endpoint)
+{
+    SocketHandle discard[MFA_CLIENT_MAX_POOL];
+    uint32_t discardCount = 0;
+    SocketHandle found = kInvalidSocket;
+    uint64_t now = NowMicros();
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        // Most recently returned first: it is the least likely to have timed out on the server
+        uint32_t i = g_poolCount;
+        while (i-- > 0)
+        {
+            PooledConnection& pooled = g_pool[i];
+            if (IsOtherEndpoint(pooled, endpoint))
+                continue;
+            SocketHandle socket = pooled.socket;
+            bool usable = IsUsable(pooled, endpoint, now);
+            memmove(&g_pool[i], &g_pool[i + 1], (g_poolCount - i - 1) * sizeof(PooledConnection));
+            g_poolCount--;
+            if (usable)
+            {
+                found = socket;
+                break;
+            }
+            discard[discardCount++] = socket;
+        }
+    }
+    for (uint32_t i = 0; i < discardCount; ++i)
+        CloseSocket(discard[i]);
+    return found;
+}
+
+// Closes pooled connections AcquirePooled would not hand out any more and
+// returns the number of usable ones left for the endpoint
+uint32_t PrunePool(const Endpoint& endpoint)
+{
+    SocketHandle discard[MFA_CLIENT_MAX_POOL];
+    uint32_t discardCount = 0;
+    uint32_t kept = 0;
+    uint32_t usable = 0;
+    uint64_t now = NowMicros();
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        for (uint32_t i = 0; i < g_poolCount; ++i)
+        {
+            PooledConnection& pooled = g_pool[i];
+            if (IsOtherEndpoint(pooled, endpoint))
+            {
+                g_pool[kept++] = pooled;
+            }
+            else if (IsUsable(pooled, endpoint, now))
+            {
+                g_pool[kept++] = pooled;
+                usable++;
+            }
+            else
+            {
+                discard[discardCount++] = pooled.socket;
+            }
+        }
+        g_poolCount = kept;
+    }
+    for (uint32_t i = 0; i < discardCount; ++i)
+        CloseSocket(discard[i]);
+    return usable;
+}
+
+void ReleaseToPool(const Endpoint& endpoint, SocketHandle socket)
+{
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        uint32_t pooled = 0;
+        for (uint32_t i = 0; i < g_poolCount; ++i)
+        {
+            if (g_pool[i].endpoint == endpoint.index)
+                pooled++;
+        }
+        if (g_started && endpoint.generation == g_generation && g_poolCount < MFA_CLIENT_MAX_POOL &&
+            pooled < endpoint.config.maxIdleConnections)
+        {
+            PooledConnection& entry = g_pool[g_poolCount++];
+            entry.socket = socket;
+            entry.generation = endpoint.generation;
+            entry.endpoint = endpoint.index;
+            entry.idleSince = NowMicros();
+            return;
+        }
+    }
+    CloseSocket(socket);
+}
+
+void ClosePool()
+{
+    SocketHandle discard[MFA_CLIENT_MAX_POOL];
+    uint32_t discardCount = 0;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        while (g_poolCount > 0)
+            discard[discardCount++] = g_pool[--g_poolCount].socket;
+    }
+    for (uint32_t i = 0; i < discardCount; ++i)
+        CloseSocket(discard[i]);
+}
+
+// Tries every address of the host until one connects before the deadline
+SocketHandle OpenConnection(const Endpoint& endpoint, uint64_t deadline, bool* timedOut)
+{
+    char port[8];
+    snprintf(port, sizeof(port), "%u", (unsigned)endpoint.config.port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    struct addrinfo* addresses = nullptr;
+    if (getaddrinfo(endpoint.config.host, port, &hints, &addresses) != 0)
+        return kInvalidSocket;
+
+    SocketHandle result = kInvalidSocket;
+    for (struct addrinfo* address = addresses; address != nullptr && result == kInvalidSocket; address = address->ai_next)
+    {
+        SocketHandle socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket == kInvalidSocket)
+            continue;
+        int noDelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+        if (!SetNonBlocking(socket))
+        {
+            CloseSocket(socket);
+            continue;
+        }
+        if (connect(socket, address->ai_addr, (int)address->ai_addrlen) != 0)
+        {
+            if (!LastErrorWouldBlock())
+            {
+                CloseSocket(socket);
+                continue;
+            }
+            int ready = WaitSocket(socket, POLLOUT, deadline);
+            int error = 0;
+            socklen_t errorLength = sizeof(error);
+            if (ready <= 0 ||
+                getsockopt(socket, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength) != 0 || error != 0)
+            {
+                if (ready == 0)
+                    *timedOut = true;
+                CloseSocket(socket);
+                if (*timedOut)
+                    break;
+                continue;
+            }
+        }
+        result = socket;
+    }
+    freeaddrinfo(addresses);
+    return result;
+}
+
+enum SendResult { kSent, kSendFailed, kSendTimedOut };
+
+SendResult SendAll(SocketHandle socket, const char* data, size_t length, uint64_t deadline)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (length > 0)
+    {
+        int chunk = length > 0x10000 ? 0x10000 : (int)length;
+        int sent = (int)send(socket, data, chunk, flags);
+        if (sent > 0)
+        {
+            data += sent;
+            length -= (size_t)sent;
+            continue;
+        }
+        if (sent < 0 && LastErrorWouldBlock())
+        {
+            int ready = WaitSocket(socket, POLLOUT, deadline);
+            if (ready == 0)
+                return kSendTimedOut;
+            if (ready < 0)
+                return kSendFailed;
+            continue;
+        }
+        return kSendFailed;
+    }
+    return kSent;
+}
+
+void AddPhase(MfaClientTiming* timing, MfaClientPhase phase, uint64_t micros)
+{
+    timing->phaseMicros[phase] += micros;
+}
+
+// One request on one connection. Exchange drives a single call; HedgedExchange
+// drives two and keeps the first usable answer.
+struct Call
+{
+    const Endpoint* endpoint;
+    SocketHandle socket;
+    bool reused;
+    uint64_t started;
+    uint64_t waitStart;
+    uint64_t firstByte;
+    // Whether the request may be sent again after a reused connection closed without answering
+    bool resendable;
+    MfaResponseParser parser;
+};
+
+enum CallStep { kCallNeedMore, kCallDone, kCallStale };
+
+// Opens or reuses a connection and sends the request. A pooled connection
+// that fails the send was most likely closed by the server while idle, so the
+// request is sent once more on a new connection. *sent is set as soon as any
+// of the request may have reached the service.
+MfaClientResult StartCall(Call* call, const Endpoint& endpoint, const char* request, size_t length,
+    uint64_t deadline, bool allowPooled, MfaClientTiming* timing, bool* sent)
+{
+    call->endpoint = &endpoint;
+    call->started = NowMicros();
+    call->resendable = true;
+    MfaResponseParserInit(&call->parser);
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        SocketHandle socket = attempt == 0 && allowPooled ? AcquirePooled(endpoint) : kInvalidSocket;
+        bool reused = socket != kInvalidSocket;
+        uint64_t start = NowMicros();
+        if (reused)
+        {
+            timing->connectionsReused++;
+        }
+        else
+        {
+            bool timedOut = false;
+            socket = OpenConnection(endpoint, deadline, &timedOut);
+            AddPhase(timing, MfaPhaseConnect, NowMicros() - start);
+            if (socket == kInvalidSocket)
+                return timedOut ? MfaClientTimedOut : MfaClientUnreachable;
+            timing->connectionsOpened++;
+            *sent = true;
+        }
+        timing->exchanges++;
+
+        start = NowMicros();
+        SendResult result = SendAll(socket, request, length, deadline);
+        AddPhase(timing, MfaPhaseSend, NowMicros() - start);
+        if (result != kSent)
+        {
+            CloseSocket(socket);
+            if (result == kSendFailed && reused)
+            {
+                g_retries.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            return result == kSendTimedOut ? MfaClientTimedOut : MfaClientUnreachable;
+        }
+        *sent = true;
+        call->socket = socket;
+        call->reused = reused;
+        call->waitStart = NowMicros();
+        call->firstByte = 0;
+        return MfaClientSucceeded;
+    }
+    return MfaClientUnreachable;
+}
+
+// Reads what the socket has after WaitSockets reported it (ready is 1, or -1
+// on error). The socket is closed or pooled once the call is done. kCallStale
+// means a reused connection closed before answering and the request should be
+// sent again on a new one; calls that are not resendable report Unreachable.
+CallStep ReadCall(Call* call, int ready, MfaClientTiming* timing, MfaClientResult* result)
+{
+    char buffer[MFA_CLIENT_RECV_BUFFER];
+    int received = ready < 0 ? -1 : (int)recv(call->socket, buffer, sizeof(buffer), 0);
+    if (received < 0 && ready > 0 && LastErrorWouldBlock())
+        return kCallNeedMore;
+    if (received <= 0)
+    {
+        CloseSocket(call->socket);
+        if (call->firstByte == 0)
+        {
+            AddPhase(timing, MfaPhaseWait, NowMicros() - call->waitStart);
+            if (call->reused && call->resendable)
+            {
+                g_retries.fetch_add(1, std::memory_order_relaxed);
+                return kCallStale;
+            }
+            *result = MfaClientUnreachable;
+            return kCallDone;
+        }
+        AddPhase(timing, MfaPhaseReceive, NowMicros() - call->firstByte);
+        if (received == 0 && MfaResponseParserFinish(&call->parser) == MfaResponseComplete)
+            *result = MfaClientSucceeded;
+        else
+            *result = received == 0 ? MfaClientBadResponse : MfaClientUnreachable;
+        return kCallDone;
+    }
+    if (call->firstByte == 0)
+    {
+        call->firstByte = NowMicros();
+        AddPhase(timing, MfaPhaseWait, call->firstByte - call->waitStart);
+    }
+    size_t consumed = 0;
+    MfaResponseState state = MfaResponseParserFeed(&call->parser, buffer, (size_t)received, &consumed);
+    if (state == MfaResponseNeedMore)
+        return kCallNeedMore;
+    AddPhase(timing, MfaPhaseReceive, NowMicros() - call->firstByte);
+    if (state == MfaResponseInvalid)
+    {
+        CloseSocket(call->socket);
+        *result = MfaClientBadResponse;
+        return kCallDone;
+    }
+    // Bytes after the response mean the connection is out of step; do not reuse it
+    if (call->parser.keepAlive && consumed == (size_t)received)
+        ReleaseToPool(*call->endpoint, call->socket);
+    else
+        CloseSocket(call->socket);
+    *result = MfaClientSucceeded;
+    return kCallDone;
+}
+
+bool IsSuccessStatus(uint32_t httpStatus)
+{
+    return httpStatus >= 200 && httpStatus <= 299;
+}
+
+// An answer the request can go on with
+bool IsUsableAnswer(MfaClientResult result, const MfaResponseParser& parser)
+{
+    return result == MfaClientSucceeded && IsSuccessStatus(parser.httpStatus) && parser.hasStatus;
+}
+
+// ---------------------------------------------------------------------------
+// Endpoint health and latency
+// ---------------------------------------------------------------------------
+
+bool IsHealthy(const Endpoint& endpoint, uint64_t now)
+{
+    const EndpointState& state = *endpoint.state;
+    return state.failures.load(std::memory_order_relaxed) < MFA_CLIENT_UNHEALTHY_FAILURES ||
+        now >= state.retryAt.load(std::memory_order_relaxed);
+}
+
+// Server errors count against the endpoint like transport errors; 4xx answers
+// come from a healthy server that does not like the request.
+void NoteExchange(const Endpoint& endpoint, MfaClientResult result, const MfaResponseParser& parser,
+    uint64_t micros, bool poll)
+{
+    EndpointState& state = *endpoint.state;
+    state.exchanges.fetch_add(1, std::memory_order_relaxed);
+    if (result != MfaClientSucceeded || parser.httpStatus >= 500)
+    {
+        state.failed.fetch_add(1, std::memory_order_relaxed);
+        uint32_t failures = state.failures.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (failures < MFA_CLIENT_UNHEALTHY_FAILURES)
+            return;
+        state.retryAt.store(NowMicros() + (uint64_t)endpoint.config.unhealthyMs * 1000, std::memory_order_relaxed);
+        if (failures == MFA_CLIENT_UNHEALTHY_FAILURES)
+        {
+            NATIVE_LOG(NativeLogWarning, 318, "MFA endpoint {0}:{1} failed {2} requests in a row and is skipped for {3} ms.",
+                endpoint.config.host, endpoint.config.port, failures, endpoint.config.unhealthyMs);
+        }
+        return;
+    }
+    if (state.failures.exchange(0, std::memory_order_relaxed) >= MFA_CLIENT_UNHEALTHY_FAILURES)
+        NATIVE_LOG(NativeLogInformation, 216, "MFA endpoint {0}:{1} answers again.", endpoint.config.host, endpoint.config.port);
+
+    // EWMA with a weight of 1/8 for the new sample
+    uint64_t ewma = state.ewmaMicros.load(std::memory_order_relaxed);
+    state.ewmaMicros.store(ewma == 0 ? micros : ewma - ewma / 8 + micros / 8, std::memory_order_relaxed);
+    if (!poll)
+        return;
+    std::lock_guard<std::mutex> guard(state.lock);
+    state.pollMicros[state.pollNext] = micros > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)micros;
+    state.pollNext = (state.pollNext + 1) % MFA_CLIENT_LATENCY_WINDOW;
+    if (state.pollCount < MFA_CLIENT_LATENCY_WINDOW)
+        state.pollCount++;
+}
+
+uint64_t PollP95Micros(const Endpoint& endpoint)
+{
+    uint32_t samples[MFA_CLIENT_LATENCY_WINDOW];
+    uint32_t count;
+    {
+        std::lock_guard<std::mutex> guard(endpoint.state->lock);
+        count = endpoint.state->pollCount;
+        memcpy(samples, endpoint.state->pollMicros, count * sizeof(uint32_t));
+    }
+    if (count == 0)
+        return 0;
+    uint32_t rank = (count * 95 + 99) / 100 - 1;
+    std::nth_element(samples, samples + rank, samples + count);
+    return samples[rank];
+}
+
+// Endpoint indexes in order of preference: healthy ones by EWMA latency
+// (unmeasured ones first), then the others by when they may be tried again.
+// Ties keep the configured order.
+uint32_t RankEndpoints(const EndpointSet& set, uint32_t* order)
+{
+    uint64_t now = NowMicros();
+    uint32_t count = (uint32_t)set.endpoints.size();
+    uint64_t keys[MFA_CLIENT_MAX_ENDPOINTS];
+    bool healthy[MFA_CLIENT_MAX_ENDPOINTS];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Endpoint& endpoint = *set.endpoints[i];
+        healthy[i] = IsHealthy(endpoint, now);
+        keys[i] = healthy[i] ? endpoint.state->ewmaMicros.load(std::memory_order_relaxed)
+            : endpoint.state->retryAt.load(std::memory_order_relaxed);
+        uint32_t at = i;
+        while (at > 0 && ((healthy[i] && !healthy[order[at - 1]]) ||
+            (healthy[i] == healthy[order[at - 1]] && keys[i] < keys[order[at - 1]])))
+        {
+            order[at] = order[at - 1];
+            --at;
+        }
+        order[at] = i;
+    }
+    return count;
+}
+
+// One HTTP request/response, with the retry of StartCall and ReadCall on stale
+// pooled connections. A request that is not resendable is only sent again when
+// the send itself failed: once it went out, the service may have acted on it
+// even if the connection then closed without an answer.
+MfaClientResult Exchange(const Endpoint& endpoint, const char* request, size_t length, bool resendable,
+    MfaResponseParser* parser, MfaClientTiming* timing, bool* sent)
+{
+    uint64_t deadline = NowMicros() + (uint64_t)endpoint.config.timeoutMs * 1000;
+    Call call;
+    bool allowPooled = true;
+    for (;;)
+    {
+        MfaClientResult result = StartCall(&call, endpoint, request, length, deadline, allowPooled, timing, sent);
+        if (result != MfaClientSucceeded)
+        {
+            *parser = call.parser;
+            return result;
+        }
+        call.resendable = resendable;
+        CallStep step;
+        do
+        {
+            int ready = WaitSocket(call.socket, POLLIN, deadline);
+            if (ready == 0)
+            {
+                CloseSocket(call.socket);
+                *parser = call.parser;
+                return MfaClientTimedOut;
+            }
+            step = ReadCall(&call, ready, timing, &result);
+        } while (step == kCallNeedMore);
+        if (step == kCallDone)
+        {
+            *parser = call.parser;
+            return result;
+        }
+        allowPooled = false;
+    }
+}
+
+// An /AuthResult poll sent to the primary endpoint and, if no usable answer
+// came back within hedgeMicros (or the primary failed before), to the backup
+// as well. The first usable answer wins and the other call is abandoned with
+// its connection. Polls only read the status, so asking twice is harmless.
+MfaClientResult HedgedExchange(const Endpoint& primary, const Endpoint& backup, uint64_t hedgeMicros,
+    const char* body, size_t bodyLength, MfaResponseParser* parser, MfaClientTiming* timing)
+{
+    char request[MFA_CLIENT_MAX_REQUEST];
+    size_t length = RenderRequest(primary.authResultPrefix, body, bodyLength, request, sizeof(request));
+    uint64_t now = NowMicros();
+    uint64_t deadlines[2] = { now + (uint64_t)primary.config.timeoutMs * 1000, 0 };
+    uint64_t hedgeAt = now + hedgeMicros;
+    Call calls[2];
+    MfaResponseParserInit(&calls[1].parser);
+    bool active[2] = { false, false };
+    MfaClientResult results[2] = { MfaClientUnreachable, MfaClientUnreachable };
+    bool sent = false;
+    bool hedged = false;
+
+    results[0] = StartCall(&calls[0], primary, request, length, deadlines[0], true, timing, &sent);
+    active[0] = results[0] == MfaClientSucceeded;
+    for (;;)
+    {
+        now = NowMicros();
+        if (!hedged && (!active[0] || now >= hedgeAt))
+        {
+            hedged = true;
+            g_hedges.fetch_add(1, std::memory_order_relaxed);
+            timing->hedges++;
+            length = RenderRequest(backup.authResultPrefix, body, bodyLength, request, sizeof(request));
+            deadlines[1] = now + (uint64_t)backup.config.timeoutMs * 1000;
+            results[1] = StartCall(&calls[1], backup, request, length, deadlines[1], true, timing, &sent);
+            active[1] = results[1] == MfaClientSucceeded;
+        }
+        if (!active[0] && !active[1])
+            break;
+
+        struct pollfd entries[2];
+        uint32_t which[2];
+        uint32_t count = 0;
+        uint64_t waitUntil = hedged ? 0 : hedgeAt;
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            if (!active[i])
+                continue;
+            entries[count].fd = calls[i].socket;
+            entries[count].events = POLLIN;
+            which[count++] = i;
+            if (waitUntil == 0 || deadlines[i] < waitUntil)
+                waitUntil = deadlines[i];
+        }
+        int ready = WaitSockets(entries, count, waitUntil);
+        now = NowMicros();
+        for (uint32_t e = 0; e < count; ++e)
+        {
+            uint32_t i = which[e];
+            CallStep step;
+            if (ready < 0 || entries[e].revents != 0)
+            {
+                step = ReadCall(&calls[i], ready < 0 ? -1 : 1, timing, &results[i]);
+            }
+            else if (now >= deadlines[i])
+            {
+                CloseSocket(calls[i].socket);
+                results[i] = MfaClientTimedOut;
+                step = kCallDone;
+            }
+            else
+            {
+                continue;
+            }
+            if (step == kCallStale)
+            {
+                const Endpoint& endpoint = i == 0 ? primary : backup;
+                length = RenderRequest(endpoint.authResultPrefix, body, bodyLength, request, sizeof(request));
+                results[i] = StartCall(&calls[i], endpoint, request, length, deadlines[i], false, timing, &sent);
+                active[i] = results[i] == MfaClientSucceeded;
+                continue;
+            }
+            if (step == kCallNeedMore)
+                continue;
+            active[i] = false;
+            NoteExchange(i == 0 ? primary : backup, results[i], calls[i].parser, now - calls[i].started, true);
+            if (IsUsableAnswer(results[i], calls[i].parser))
+            {
+                uint32_t other = 1 - i;
+                if (active[other])
+                    CloseSocket(calls[other].socket);
+                if (i == 1)
+                    g_hedgesWon.fetch_add(1, std::memory_order_relaxed);
+                *parser = calls[i].parser;
+                return results[i];
+            }
+        }
+    }
+    // Neither answered usably; report the primary unless only the backup got a response
+    uint32_t reported = results[0] != MfaClientSucceeded && results[1] == MfaClientSucceeded ? 1 : 0;
+    *parser = calls[reported].parser;
+    return results[reported];
+}
+
+// Sleeps between polls; returns false if the client was stopped meanwhile
+bool SleepUnlessStopped(uint32_t ms, uint64_t epoch, MfaClientTiming* timing)
+{
+    uint64_t start = NowMicros();
+    std::unique_lock<std::mutex> guard(g_lock);
+    g_stopped.wait_for(guard, std::chrono::milliseconds(ms), [epoch] { return g_epoch != epoch; });
+    bool running = g_epoch == epoch;
+    guard.unlock();
+    AddPhase(timing, MfaPhasePollDelay, NowMicros() - start);
+    return running;
+}
+
+void Record(const MfaClientTiming& timing, MfaClientResult result)
+{
+    g_exchanges.fetch_add(timing.exchanges, std::memory_order_relaxed);
+    g_connectionsOpened.fetch_add(timing.connectionsOpened, std::memory_order_relaxed);
+    g_connectionsReused.fetch_add(timing.connectionsReused, std::memory_order_relaxed);
+    if (result != MfaClientSucceeded && result != MfaClientDenied)
+        g_failures.fetch_add(1, std::memory_order_relaxed);
+    for (int phase = 0; phase < MfaPhaseCount; ++phase)
+    {
+        uint64_t micros = timing.phaseMicros[phase];
+        g_phaseMicros[phase].fetch_add(micros, std::memory_order_relaxed);
+        uint64_t max = g_maxPhaseMicros[phase].load(std::memory_order_relaxed);
+        while (micros > max && !g_maxPhaseMicros[phase].compare_exchange_weak(max, micros, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+// Hedges take at most one poll in ten, so a slow period cannot double the load
+bool HedgeAllowed()
+{
+    return g_hedges.load(std::memory_order_relaxed) * 10 < g_polls.load(std::memory_order_relaxed) + 10;
+}
+
+MfaClientResult Authenticate(const EndpointSet& set, uint64_t epoch, const char* samid, MfaClientTiming* timing)
+{
+    uint32_t order[MFA_CLIENT_MAX_ENDPOINTS];
+    uint32_t count = RankEndpoints(set, order);
+    const Endpoint* endpoint = set.endpoints[order[0]].get();
+    char body[MFA_CLIENT_MAX_USER * 6 + MFA_CLIENT_MAX_REQUESTOR * 6 + 64];
+    size_t bodyLength = RenderBody(*endpoint, samid, body, sizeof(body));
+    char request[MFA_CLIENT_MAX_REQUEST];
+    size_t length = 0;
+    if (bodyLength == 0)
+        return MfaClientNotStarted;
+
+    // The push is sent once: the next endpoint is only tried while the request never left
+    MfaResponseParser parser;
+    MfaResponseParserInit(&parser);
+    MfaClientResult result = MfaClientUnreachable;
+    uint64_t started = MetricsNowMicros();
+    for (uint32_t rank = 0; rank < count; ++rank)
+    {
+        endpoint = set.endpoints[order[rank]].get();
+        length = RenderRequest(endpoint->authenticatePrefix, body, bodyLength, request, sizeof(request));
+        if (length == 0)
+            return MfaClientNotStarted;
+        bool sent = false;
+        uint64_t exchangeStarted = NowMicros();
+        result = Exchange(*endpoint, request, length, false, &parser, timing, &sent);
+        NoteExchange(*endpoint, result, parser, NowMicros() - exchangeStarted, false);
+        if (result == MfaClientSucceeded || sent || rank + 1 == count)
+            break;
+        timing->failovers++;
+        g_failovers.fetch_add(1, std::memory_order_relaxed);
+    }
+    timing->endpoint = endpoint->index;
+    MetricsRecordSince(MetricsPhaseAuthenticate, started);
+    MfaBreakerRecord(!IsUsableAnswer(result, parser), MetricsNowMicros() - started);
+    timing->httpStatus = parser.httpStatus;
+    if (result == MfaClientTimedOut)
+    {
+        NATIVE_LOG(NativeLogError, 414, "Timeout reached while authenticating user {0}", samid);
+        return result;
+    }
+    if (result != MfaClientSucceeded && result != MfaClientBadResponse)
+    {
+        NATIVE_LOG(NativeLogError, 415, "MFA Service is unreachable while authenticating user {0}", samid);
+        return result;
+    }
+    if (result == MfaClientSucceeded && !IsSuccessStatus(parser.httpStatus))
+    {
+        NATIVE_LOG(NativeLogError, 410, "Service responded with status: {0} for user {1}", parser.httpStatus, samid);
+        return MfaClientHttpError;
+    }
+    if (result == MfaClientBadResponse || !parser.hasStatus)
+    {
+        NATIVE_LOG(NativeLogError, 411, "Invalid response from service for user: {0}", samid);
+        return MfaClientBadResponse;
+    }
+    timing->status = parser.status;
+    if (parser.status != 0)
+        return parser.status > 0 ? MfaClientSucceeded : MfaClientDenied;
+
+    // Pending: the push was sent, poll the endpoint that sent it on the same pooled connections
+    const Endpoint& primary = *endpoint;
+    length = RenderRequest(primary.authResultPrefix, body, bodyLength, request, sizeof(request));
+    if (!SleepUnlessStopped(primary.config.waitBeforePollMs, epoch, timing))
+        return MfaClientNotStarted;
+    for (uint32_t attempt = 0; attempt < primary.config.pollCount; ++attempt)
+    {
+        g_polls.fetch_add(1, std::memory_order_relaxed);
+        const Endpoint* backup = nullptr;
+        if (count > 1 && primary.config.hedgeMinMs > 0 && HedgeAllowed())
+        {
+            uint64_t now = NowMicros();
+            count = RankEndpoints(set, order);
+            for (uint32_t rank = 0; rank < count && backup == nullptr; ++rank)
+            {
+                const Endpoint* candidate = set.endpoints[order[rank]].get();
+                if (candidate != &primary && IsHealthy(*candidate, now))
+                    backup = candidate;
+            }
+        }
+        started = MetricsNowMicros();
+        if (backup != nullptr)
+        {
+            uint64_t hedgeMicros = std::max<uint64_t>((uint64_t)primary.config.hedgeMinMs * 1000, PollP95Micros(primary));
+            result = HedgedExchange(primary, *backup, hedgeMicros, body, bodyLength, &parser, timing);
+        }
+        else
+        {
+            bool sent = false;
+            uint64_t exchangeStarted = NowMicros();
+            result = Exchange(primary, request, length, true, &parser, timing, &sent);
+            NoteExchange(primary, result, parser, NowMicros() - exchangeStarted, true);
+        }
+        MetricsRecordSince(MetricsPhaseAuthResult, started);
+        timing->httpStatus = parser.httpStatus;
+        if (result == MfaClientTimedOut)
+        {
+            NATIVE_LOG(NativeLogError, 417, "Timeout reached while polling AuthResult for user {0}", samid);
+            return result;
+        }
+        if (result != MfaClientSucceeded && result != MfaClientBadResponse)
+        {
+            NATIVE_LOG(NativeLogError, 418, "MFA Service is unreachable while polling AuthResult for user {0}", samid);
+            return result;
+        }
+        if (result == MfaClientSucceeded && !IsSuccessStatus(parser.httpStatus))
+        {
+            NATIVE_LOG(NativeLogWarning, 310, "AuthResult responded with status: {0} for user {1}", parser.httpStatus, samid);
+            return MfaClientHttpError;
+        }
+        if (result == MfaClientBadResponse || !parser.hasStatus)
+        {
+            NATIVE_LOG(NativeLogError, 412, "Invalid AuthResult response for user {0}", samid);
+            return MfaClientBadResponse;
+        }
+        timing->status = parser.status;
+        if (parser.status != 0)
+            return parser.status > 0 ? MfaClientSucceeded : MfaClientDenied;
+        if (attempt + 1 < primary.config.pollCount && !SleepUnlessStopped(primary.config.pollIntervalMs, epoch, timing))
+            return MfaClientNotStarted;
+    }
+    NATIVE_LOG(NativeLogError, 413, "Authentication result not received in time for user: {0}", samid);
+    return MfaClientPending;
+}
+
+// ---------------------------------------------------------------------------
+// Response parser states
+// ---------------------------------------------------------------------------
+
+enum
+{
+    kStatusVersion = 0,
+    kStatusCode,
+    kStatusReason,
+    kHeaderStart,
+    kHeaderName,
+    kHeaderValue,
+    kHeadersEndLF,
+    kBody,
+    kBodyUntilClose,
+    kChunkSize,
+    kChunkExtension,
+    kChunkData,
+    kChunkDataCR,
+    kChunkDataLF,
+    kTrailerStart,
+    kTrailerLine,
+    kTrailerEndLF,
+    kDone
+};
+
+// Headers that affect framing; index = bit in headerCandidates
+const char* const kHeaderNames[] = { "content-length", "transfer-encoding", "connection" };
+const uint32_t kHeaderLengths[] = { 14, 17, 10 };
+enum { kContentLength = 0, kTransferEncoding, kConnection, kHeaderCount, kNoHeader = kHeaderCount };
+
+enum
+{
+    kJsonScan = 0,
+    kJsonString,
+    kJsonStringEscape,
+    kJsonKey,
+    kJsonKeyEscape,
+    kJsonAfterKey,
+    kJsonBeforeNumber,
+    kJsonNumber
+};
+
+char Lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+bool IsJsonSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+void CommitNumber(MfaResponseParser* parser)
+{
+    if (parser->digits == 0)
+        return;
+    int64_t value = parser->negative ? -parser->number : parser->number;
+    if (value > 0x7FFFFFFF)
+        value = 0x7FFFFFFF;
+    if (value < -0x7FFFFFFF)
+        value = -0x7FFFFFFF;
+    parser->status = (int32_t)value;
+    parser->hasStatus = true;
+    parser->digits = 0;
+}
+
+// Looks for "status" (any case, like Newtonsoft) among the keys of the top-level object
+void ScanJsonByte(MfaResponseParser* parser, char c)
+{
+    static const char kKey[] = "status";
+    for (;;)
+    {
+        switch (parser->jsonState)
+        {
+        case kJsonScan:
+            if (c == '"')
+            {
+                if (parser->jsonDepth == 1 && parser->expectKey)
+                {
+                    parser->jsonState = kJsonKey;
+                    parser->keyIndex = 0;
+                    parser->keyMatches = true;
+                }
+                else
+                {
+                    parser->jsonState = kJsonString;
+                }
+                parser->expectKey = false;
+            }
+            else if (c == '{')
+            {
+                parser->jsonDepth++;
+                parser->expectKey = parser->jsonDepth == 1;
+            }
+            else if (c == '[')
+            {
+                // A top-level array never has keys; depth 2 marks it as such
+                parser->jsonDepth += parser->jsonDepth == 0 ? 2 : 1;
+                parser->expectKey = false;
+            }
+            else if (c == '}' || c == ']')
+            {
+                if (parser->jsonDepth > 0)
+                    parser->jsonDepth--;
+            }
+            else if (c == ',')
+            {
+                parser->expectKey = parser->jsonDepth == 1;
+            }
+            return;
+        case kJsonString:
+            if (c == '\\')
+                parser->jsonState = kJsonStringEscape;
+            else if (c == '"')
+                parser->jsonState = kJsonScan;
+            return;
+        case kJsonStringEscape:
+            parser->jsonState = kJsonString;
+            return;
+        case kJsonKey:
+            if (c == '"')
+            {
+                parser->jsonState = parser->keyMatches && parser->keyIndex == 6 ? kJsonAfterKey : kJsonScan;
+            }
+            else if (c == '\\')
+            {
+                parser->keyMatches = false;
+                parser->jsonState = kJsonKeyEscape;
+            }
+            else
+            {
+                if (parser->keyIndex >= 6 || Lower(c) != kKey[parser->keyIndex])
+                    parser->keyMatches = false;
+                parser->keyIndex++;
+            }
+            return;
+        case kJsonKeyEscape:
+            parser->jsonState = kJsonKey;
+            return;
+        case kJsonAfterKey:
+            if (IsJsonSpace(c))
+                return;
+            if (c == ':')
+            {
+                parser->jsonState = kJsonBeforeNumber;
+                return;
+            }
+            parser->jsonState = kJsonScan;
+            continue;
+        case kJsonBeforeNumber:
+            if (IsJsonSpace(c))
+                return;
+            parser->negative = c == '-';
+            parser->number = 0;
+            parser->digits = 0;
+            if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                parser->jsonState = kJsonNumber;
+                if (c == '-')
+                    return;
+                continue;
+            }
+            parser->jsonState = kJsonScan;
+            continue;
+        case kJsonNumber:
+            if (c >= '0' && c <= '9')
+            {
+                if (parser->number < 0x7FFFFFFFFFFFLL)
+                    parser->number = parser->number * 10 + (c - '0');
+                parser->digits++;
+                return;
+            }
+            CommitNumber(parser);
+            parser->jsonState = kJsonScan;
+            continue;
+        default:
+            return;
+        }
+    }
+}
+
+void ScanJson(MfaResponseParser* parser, const char* data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+        ScanJsonByte(parser, data[i]);
+}
+
+void FinishJson(MfaResponseParser* parser)
+{
+    if (parser->jsonState == kJsonNumber)
+        CommitNumber(parser);
+    parser->jsonState = kJsonScan;
+}
+
+// Applies a header once its line is complete
+void EndHeader(MfaResponseParser* parser)
+{
+    if (parser->headerMatched == kConnection)
+    {
+        // valueFlag: "close" seen, altMatchIndex == 10: "keep-alive" seen
+        if (parser->valueFlag)
+            parser->keepAlive = false;
+        else if (parser->altMatchIndex == 10)
+            parser->keepAlive = true;
+    }
+    else if (parser->headerMatched == kTransferEncoding && parser->valueFlag)
+    {
+        parser->chunked = true;
+    }
+}
+
+// Tracks a case-insensitive token inside a header value; returns true once it has been seen
+bool MatchToken(uint32_t* index, const char* token, uint32_t tokenLength, char c)
+{
+    if (*index >= tokenLength)
+        return true;
+    if (Lower(c) == token[*index])
+        (*index)++;
+    else
+        *index = Lower(c) == token[0] ? 1 : 0;
+    return *index >= tokenLength;
+}
+
+// Decides how the body is delimited once the blank line after the headers is seen
+MfaResponseState EndHeaders(MfaResponseParser* parser)
+{
+    if (parser->httpStatus >= 100 && parser->httpStatus < 200)
+    {
+        // Interim response (100 Continue); the real one follows
+        int minor = parser->httpMinor;
+        MfaResponseParserInit(parser);
+        parser->httpMinor = minor;
+        return MfaResponseNeedMore;
+    }
+    if (parser->httpStatus == 204 || parser->httpStatus == 304)
+    {
+        parser->state = kDone;
+        return MfaResponseComplete;
+    }
+    if (parser->chunked)
+    {
+        parser->state = kChunkSize;
+        parser->remaining = 0;
+        parser->chunkDigits = 0;
+        return MfaResponseNeedMore;
+    }
+    if (parser->hasContentLength)
+    {
+        parser->remaining = parser->contentLength;
+        if (parser->remaining == 0)
+        {
+            parser->state = kDone;
+            return MfaResponseComplete;
+        }
+        parser->state = kBody;
+        return MfaResponseNeedMore;
+    }
+    parser->state = kBodyUntilClose;
+    parser->keepAlive = false;
+    return MfaResponseNeedMore;
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Response parser
+// ---------------------------------------------------------------------------
+
+void MfaResponseParserInit(MfaResponseParser* parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = kStatusVersion;
+    parser->jsonState = kJsonScan;
+}
+
+MfaResponseState MfaResponseParserFeed(MfaResponseParser* parser, const char* data, size_t length, size_t* consumed)
+{
+    static const char kVersion[] = "HTTP/1.";
+    size_t i = 0;
+    MfaResponseState result = MfaResponseNeedMore;
+    while (i < length && result == MfaResponseNeedMore)
+    {
+        char c = data[i];
+        switch (parser->state)
+        {
+        case kStatusVersion:
+            if (parser->matchIndex < 7)
+            {
+                if (c != kVersion[parser->matchIndex])
+                    result = MfaResponseInvalid;
+                parser->matchIndex++;
+            }
+            else if (parser->matchIndex == 7)
+            {
+                if (c < '0' || c > '9')
+                    result = MfaResponseInvalid;
+                parser->httpMinor = c - '0';
+                parser->keepAlive = parser->httpMinor >= 1;
+                parser->matchIndex++;
+            }
+            else if (c == ' ')
+            {
+                parser->state = kStatusCode;
+                parser->matchIndex = 0;
+            }
+            else
+            {
+                result = MfaResponseInvalid;
+            }
+            ++i;
+            break;
+        case kStatusCode:
+            if (c >= '0' && c <= '9' && parser->matchIndex < 3)
+            {
+                parser->httpStatus = parser->httpStatus * 10 + (uint32_t)(c - '0');
+                parser->matchIndex++;
+            }
+            else if (parser->matchIndex == 3 && (c == ' ' || c == '\r' || c == '\n'))
+            {
+                parser->state = c == '\n' ? kHeaderStart : kStatusReason;
+            }
+            else
+            {
+                result = MfaResponseInvalid;
+            }
+            ++i;
+            break;
+        case kStatusReason:
+        case kTrailerLine:
+        {
+            // Skipped up to the end of the line without looking at each byte
+            const char* end = (const char*)memchr(data + i, '\n', length - i);
+            size_t skip = end != nullptr ? (size_t)(end - (data + i)) : length - i;
+            parser->lineLength += (uint32_t)skip;
+            i += skip;
+            if (parser->lineLength > MFA_CLIENT_MAX_LINE)
+            {
+                result = MfaResponseInvalid;
+            }
+            else if (end != nullptr)
+            {
+                parser->state = parser->state == kStatusReason ? kHeaderStart : kTrailerStart;
+                parser->lineLength = 0;
+                ++i;
+            }
+            break;
+        }
+        case kHeaderStart:
+            if (c == '\r')
+            {
+                parser->state = kHeadersEndLF;
+                ++i;
+                break;
+            }
+            if (c == '\n')
+            {
+                ++i;
+                result = EndHeaders(parser);
+                break;
+            }
+            parser->state = kHeaderName;
+            parser->headerCandidates = (1u << kHeaderCount) - 1;
+            parser->headerMatched = kNoHeader;
+            parser->matchIndex = 0;
+            parser->lineLength = 0;
+            break;
+        case kHeaderName:
+            if (c == ':')
+            {
+                parser->headerMatched = kNoHeader;
+                for (uint32_t h = 0; h < kHeaderCount; ++h)
+                {
+                    if ((parser->headerCandidates & (1u << h)) != 0 && parser->matchIndex == kHeaderLengths[h])
+                        parser->headerMatched = h;
+                }
+                parser->state = kHeaderValue;
+                parser->matchIndex = 0;
+                parser->altMatchIndex = 0;
+                parser->valueFlag = false;
+                if (parser->headerMatched == kContentLength)
+                {
+                    parser->contentLength = 0;
+                    parser->hasContentLength = false;
+                }
+            }
+            else if (c == '\n' || c == '\r' || ++parser->lineLength > MFA_CLIENT_MAX_LINE)
+            {
+                result = MfaResponseInvalid;
+            }
+            else
+            {
+                char lower = Lower(c);
+                for (uint32_t h = 0; h < kHeaderCount; ++h)
+                {
+                    if (parser->matchIndex >= kHeaderLengths[h] || kHeaderNames[h][parser->matchIndex] != lower)
+                        parser->headerCandidates &= ~(1u << h);
+                }
+                parser->matchIndex++;
+            }
+            ++i;
+            break;
+        case kHeaderValue:
+            if (c == '\n')
+            {
+                EndHeader(parser);
+                parser->state = kHeaderStart;
+            }
+            else if (c != '\r')
+            {
+                if (++parser->lineLength > MFA_CLIENT_MAX_LINE)
+                {
+                    result = MfaResponseInvalid;
+                }
+                else if (parser->headerMatched == kContentLength)
+                {
+                    if (c >= '0' && c <= '9')
+                    {
+                        if (parser->contentLength > 0xFFFFFFFFull)
+                            result = MfaResponseInvalid;
+                        parser->contentLength = parser->contentLength * 10 + (uint64_t)(c - '0');
+                        parser->hasContentLength = true;
+                    }
+                    else if (c != ' ' && c != '\t')
+                    {
+                        result = MfaResponseInvalid;
+                    }
+                }
+                else if (parser->headerMatched == kTransferEncoding)
+                {
+                    if (MatchToken(&parser->matchIndex, "chunked", 7, c))
+                        parser->valueFlag = true;
+                }
+                else if (parser->headerMatched == kConnection)
+                {
+                    if (MatchToken(&parser->matchIndex, "close", 5, c))
+                        parser->valueFlag = true;
+                    MatchToken(&parser->altMatchIndex, "keep-alive", 10, c);
+                }
+            }
+            ++i;
+            break;
+        case kHeadersEndLF:
+            ++i;
+            result = c == '\n' ? EndHeaders(parser) : MfaResponseInvalid;
+            break;
+        case kBody:
+        {
+            size_t take = length - i;
+            if ((uint64_t)take > parser->remaining)
+                take = (size_t)parser->remaining;
+            ScanJson(parser, data + i, take);
+            parser->remaining -= take;
+            i += take;
+            if (parser->remaining == 0)
+            {
+                FinishJson(parser);
+                parser->state = kDone;
+                result = MfaResponseComplete;
+            }
+            break;
+        }
+        case kBodyUntilClose:
+            ScanJson(parser, data + i, length - i);
+            i = length;
+            break;
+        case kChunkSize:
+            if ((c >= '0' && c <= '9') || (Lower(c) >= 'a' && Lower(c) <= 'f'))
+            {
+                uint32_t digit = c <= '9' ? (uint32_t)(c - '0') : (uint32_t)(Lower(c) - 'a' + 10);
+                if (parser->remaining > 0xFFFFFFFull)
+                    result = MfaResponseInvalid;
+                parser->remaining = parser->remaining * 16 + digit;
+                parser->chunkDigits++;
+            }
+            else if (c == ';' || c == ' ' || c == '\t')
+            {
+                parser->state = kChunkExtension;
+            }
+            else if (c == '\n' && parser->chunkDigits > 0)
+            {
+                parser->chunkDigits = 0;
+                parser->state = parser->remaining == 0 ? kTrailerStart : kChunkData;
+            }
+            else if (c != '\r' || parser->chunkDigits == 0)
+            {
+                result = MfaResponseInvalid;
+            }
+            ++i;
+            break;
+        case kChunkExtension:
+            if (c == '\n')
+            {
+                if (parser->chunkDigits == 0)
+                    result = MfaResponseInvalid;
+                parser->chunkDigits = 0;
+                parser->state = parser->remaining == 0 ? kTrailerStart : kChunkData;
+            }
+            ++i;
+            break;
+        case kChunkData:
+        {
+            size_t take = length - i;
+            if ((uint64_t)take > parser->remaining)
+                take = (size_t)parser->remaining;
+            ScanJson(parser, data + i, take);
+            parser->remaining -= take;
+            i += take;
+            if (parser->remaining == 0)
+                parser->state = kChunkDataCR;
+            break;
+        }
+        case kChunkDataCR:
+            if (c == '\r')
+                parser->state = kChunkDataLF;
+            else if (c == '\n')
+                parser->state = kChunkSize;
+            else
+                result = MfaResponseInvalid;
+            parser->remaining = 0;
+            parser->chunkDigits = 0;
+            ++i;
+            break;
+        case kChunkDataLF:
+            if (c == '\n')
+                parser->state = kChunkSize;
+            else
+                result = MfaResponseInvalid;
+            ++i;
+            break;
+        case kTrailerStart:
+            if (c == '\r')
+            {
+                parser->state = kTrailerEndLF;
+                ++i;
+            }
+            else if (c == '\n')
+            {
+                ++i;
+                FinishJson(parser);
+                parser->state = kDone;
+                result = MfaResponseComplete;
+            }
+            else
+            {
+                parser->state = kTrailerLine;
+                parser->lineLength = 0;
+            }
+            break;
+        case kTrailerEndLF:
+            ++i;
+            if (c == '\n')
+            {
+                FinishJson(parser);
+                parser->state = kDone;
+                result = MfaResponseComplete;
+            }
+            else
+            {
+                result = MfaResponseInvalid;
+            }
+            break;
+        default:
+            result = MfaResponseComplete;
+            break;
+        }
+    }
+    if (consumed != nullptr)
+        *consumed = i;
+    return result;
+}
+
+MfaResponseState MfaResponseParserFinish(MfaResponseParser* parser)
+{
+    if (parser->state == kDone)
+        return MfaResponseComplete;
+    if (parser->state != kBodyUntilClose)
+        return MfaResponseInvalid;
+    FinishJson(parser);
+    parser->state = kDone;
+    return MfaResponseComplete;
+}
+
+// ---------------------------------------------------------------------------
+// Client
+// ---------------------------------------------------------------------------
+
+void MfaClientDefaultConfig(MfaClientConfig* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->port = 80;
+    strcpy(config->requestor, "SMK-RDG");
+    config->timeoutMs = 60000;
+    config->waitBeforePollMs = 10000;
+    config->pollIntervalMs = 1000;
+    config->pollCount = 60;
+    config->maxIdleConnections = 16;
+    config->idleTimeoutMs = 30000;
+    config->hedgeMinMs = 100;
+    config->unhealthyMs = 10000;
+}
+
+bool MfaClientParseUrl(const char* url, MfaClientConfig* config)
+{
+    static const char kScheme[] = "http://";
+    if (url == nullptr)
+        return false;
+    while (*url == ' ')
+        ++url;
+    for (int i = 0; i < 7; ++i)
+    {
+        if (Lower(url[i]) != kScheme[i])
+            return false;
+    }
+    const char* host = url + 7;
+    const char* hostEnd;
+    const char* rest;
+    if (*host == '[')
+    {
+        // IPv6 literal
+        ++host;
+        hostEnd = strchr(host, ']');
+        if (hostEnd == nullptr)
+            return false;
+        rest = hostEnd + 1;
+    }
+    else
+    {
+        hostEnd = host;
+        while (*hostEnd != '\0' && *hostEnd != ':' && *hostEnd != '/')
+            ++hostEnd;
+        rest = hostEnd;
+    }
+    size_t hostLength = (size_t)(hostEnd - host);
+    if (hostLength == 0 || hostLength >= MFA_CLIENT_MAX_HOST)
+        return false;
+
+    uint32_t port = 80;
+    if (*rest == ':')
+    {
+        ++rest;
+        port = 0;
+        int digits = 0;
+        while (*rest >= '0' && *rest <= '9' && digits < 6)
+        {
+            port = port * 10 + (uint32_t)(*rest++ - '0');
+            ++digits;
+        }
+        if (digits == 0 || port == 0 || port > 65535)
+            return false;
+    }
+    if (*rest != '\0' && *rest != '/')
+        return false;
+    size_t pathLength = strlen(rest);
+    while (pathLength > 0 && (rest[pathLength - 1] == '/' || rest[pathLength - 1] == ' '))
+        --pathLength;
+    if (pathLength >= MFA_CLIENT_MAX_PATH || memchr(rest, '?', pathLength) != nullptr ||
+        memchr(rest, '#', pathLength) != nullptr || memchr(rest, ' ', pathLength) != nullptr)
+    {
+        return false;
+    }
+
+    memcpy(config->host, host, hostLength);
+    config->host[hostLength] = '\0';
+    config->port = (uint16_t)port;
+    memcpy(config->basePath, rest, pathLength);
+    config->basePath[pathLength] = '\0';
+    return true;
+}
+
+bool MfaClientStart(const MfaClientConfig* config)
+{
+    return MfaClientStartEndpoints(config, 1);
+}
+
+bool MfaClientStartEndpoints(const MfaClientConfig* configs, uint32_t count)
+{
+    if (configs == nullptr || count == 0 || count > MFA_CLIENT_MAX_ENDPOINTS)
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (configs[i].host[0] == '\0' || configs[i].port == 0)
+            return false;
+    }
+#ifdef _WIN32
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        if (!g_winsockReady)
+        {
+            WSADATA data;
+            if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+                return false;
+            g_winsockReady = true;
+        }
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        g_generation++;
+        std::shared_ptr<EndpointSet> set = std::make_shared<EndpointSet>();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            MfaClientConfig config = configs[0];
+            memcpy(config.host, configs[i].host, sizeof(config.host));
+            config.port = configs[i].port;
+            memcpy(config.basePath, configs[i].basePath, sizeof(config.basePath));
+            set->endpoints.push_back(BuildEndpoint(config, g_generation, i));
+        }
+        g_endpoints = set;
+        g_started = true;
+    }
+    // Connections of the previous configuration may point at another server
+    ClosePool();
+    return true;
+}
+
+void MfaClientStop()
+{
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        g_started = false;
+        g_epoch++;
+        g_endpoints.reset();
+    }
+    g_stopped.notify_all();
+    ClosePool();
+}
+
+bool MfaClientIsStarted()
+{
+    std::lock_guard<std::mutex> guard(g_lock);
+    return g_started;
+}
+
+MfaClientResult MfaClientAuthenticate(const char* samid, MfaClientTiming* timing)
+{
+    MfaClientTiming local;
+    if (timing == nullptr)
+        timing = &local;
+    memset(timing, 0, sizeof(*timing));
+
+    std::shared_ptr<const EndpointSet> endpoints;
+    uint64_t epoch;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        if (!g_started)
+            return MfaClientNotStarted;
+        endpoints = g_endpoints;
+        epoch = g_epoch;
+    }
+    g_requests.fetch_add(1, std::memory_order_relaxed);
+    uint64_t start = NowMicros();
+    MfaClientResult result = Authenticate(*endpoints, epoch, samid, timing);
+    timing->totalMicros = NowMicros() - start;
+    Record(*timing, result);
+    return result;
+}
+
+uint32_t MfaClientWarmUp(uint32_t connections)
+{
+    std::shared_ptr<const EndpointSet> endpoints;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        if (!g_started)
+            return 0;
+        endpoints = g_endpoints;
+    }
+    uint32_t opened = 0;
+    uint64_t now = NowMicros();
+    for (const std::unique_ptr<const Endpoint>& endpoint : endpoints->endpoints)
+    {
+        // Unhealthy endpoints are left to the request that tries them again
+        if (!IsHealthy(*endpoint, now))
+            continue;
+        uint32_t wanted = std::min(connections, endpoint->config.maxIdleConnections);
+        uint32_t pooled = PrunePool(*endpoint);
+        while (pooled < wanted)
+        {
+            bool timedOut = false;
+            SocketHandle socket = OpenConnection(*endpoint, NowMicros() + (uint64_t)endpoint->config.timeoutMs * 1000, &timedOut);
+            if (socket == kInvalidSocket)
+                break;
+            g_connectionsOpened.fetch_add(1, std::memory_order_relaxed);
+            ReleaseToPool(*endpoint, socket);
+            ++pooled;
+            ++opened;
+        }
+    }
+    return opened;
+}
+
+MfaClientStats MfaClientGetStats()
+{
+    MfaClientStats stats;
+    stats.requests = g_requests.load(std::memory_order_relaxed);
+    stats.exchanges = g_exchanges.load(std::memory_order_relaxed);
+    stats.connectionsOpened = g_connectionsOpened.load(std::memory_order_relaxed);
+    stats.connectionsReused = g_connectionsReused.load(std::memory_order_relaxed);
+    stats.retries = g_retries.load(std::memory_order_relaxed);
+    stats.failures = g_failures.load(std::memory_order_relaxed);
+    stats.failovers = g_failovers.load(std::memory_order_relaxed);
+    stats.hedges = g_hedges.load(std::memory_order_relaxed);
+    stats.hedgesWon = g_hedgesWon.load(std::memory_order_relaxed);
+    for (int phase = 0; phase < MfaPhaseCount; ++phase)
+    {
+        stats.phaseMicros[phase] = g_phaseMicros[phase].load(std::memory_order_relaxed);
+        stats.maxPhaseMicros[phase] = g_maxPhaseMicros[phase].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+uint32_t MfaClientGetEndpointStats(MfaClientEndpointStats* stats, uint32_t capacity)
+{
+    std::shared_ptr<const EndpointSet> endpoints;
+    {
+        std::lock_guard<std::mutex> guard(g_lock);
+        endpoints = g_endpoints;
+    }
+    if (endpoints == nullptr)
+        return 0;
+    uint64_t now = NowMicros();
+    uint32_t count = (uint32_t)endpoints->endpoints.size();
+    for (uint32_t i = 0; i < count && i < capacity; ++i)
+    {
+        const Endpoint& endpoint = *endpoints->endpoints[i];
+        MfaClientEndpointStats& entry = stats[i];
+        memcpy(entry.host, endpoint.config.host, sizeof(entry.host));
+        entry.port = endpoint.config.port;
+        entry.healthy = IsHealthy(endpoint, now);
+        entry.ewmaMicros = endpoint.state->ewmaMicros.load(std::memory_order_relaxed);
+        entry.pollP95Micros = PollP95Micros(endpoint);
+        entry.exchanges = endpoint.state->exchanges.load(std::memory_order_relaxed);
+        entry.failures = endpoint.state->failed.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+const char* MfaClientResultName(MfaClientResult result)
+{
+    switch (result)
+    {
+    case MfaClientSucceeded: return "succeeded";
+    case MfaClientDenied: return "denied";
+    case MfaClientPending: return "pending";
+    case MfaClientUnreachable: return "unreachable";
+    case MfaClientTimedOut: return "timed out";
+    case MfaClientHttpError: return "HTTP error";
+    case MfaClientBadResponse: return "bad response";
+    case MfaClientNotStarted: return "not started";
+    }
+    return "unknown";
+}
+
+const char* MfaClientPhaseName(MfaClientPhase phase)
+{
+    switch (phase)
+    {
+    case MfaPhaseConnect: return "connect";
+    case MfaPhaseSend: return "send";
+    case MfaPhaseWait: return "wait";
+    case MfaPhaseReceive: return "receive";
+    case MfaPhasePollDelay: return "poll delay";
+    case MfaPhaseCount: break;
+    }
+    return "unknown";
+}
+
+std::string MfaClientFormatTiming(const MfaClientTiming& timing)
+{
+    std::string text;
+    char part[64];
+    for (int phase = 0; phase < MfaPhaseCount; ++phase)
+    {
+        snprintf(part, sizeof(part), "%s %.1f ms, ", MfaClientPhaseName((MfaClientPhase)phase),
+            timing.phaseMicros[phase] / 1000.0);
+        text += part;
+    }
+    snprintf(part, sizeof(part), "total %.1f ms", timing.totalMicros / 1000.0);
+    text += part;
+    return text;
+}
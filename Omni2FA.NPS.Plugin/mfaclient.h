@@ -0,0 +1,245 @@
+#ifndef MFACLIENT_H
+#define MFACLIENT_H
+#pragma once
+
+// Native client for the MFA service (/Authenticate and /AuthResult).
+//
+// Requests go over a small pool of persistent HTTP/1.1 keep-alive connections,
+// so a push and its polls normally reuse one TCP connection instead of opening
+// a new one per call. The request line, headers and the constant parts of the
+// JSON body are rendered once when the client is configured; per request only
+// the user name and Content-Length are filled in. Responses are parsed in place
+// in the receive buffer by an incremental parser that only extracts the HTTP
+// status, the framing headers and the top-level "status" field of the body.
+// Each exchange is split into connect, send, wait (time to first byte),
+// receive and poll delay phases, reported per call and summed in the stats.
+//
+// The client may be given several endpoints: instances of one MFA service
+// that share its state, so any of them can answer /AuthResult for a push sent
+// by another. Each endpoint keeps an EWMA of its exchange latency, a window of
+// recent /AuthResult latencies and a health flag. /Authenticate goes to the
+// healthy endpoint with the lowest EWMA and moves on to the next one only if
+// the request never left (the connection could not be opened), so a user never
+// gets two pushes. /AuthResult polls go to the endpoint that sent the push;
+// when one has not been answered after the p95 of that endpoint's recent polls
+// (at least hedgeMinMs), the same poll is also sent to the next best endpoint
+// and the first usable answer wins. An endpoint that fails
+// MFA_CLIENT_UNHEALTHY_FAILURES exchanges in a row is skipped for
+// unhealthyMs, then tried again.
+//
+// Only plain http:// endpoints are supported; TLS stays with the managed
+// Authenticator.
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#define MFA_CLIENT_MAX_HOST 256
+#define MFA_CLIENT_MAX_PATH 256
+#define MFA_CLIENT_MAX_CREDENTIALS 256
+#define MFA_CLIENT_MAX_REQUESTOR 64
+// User names longer than this (in UTF-8 bytes) are rejected
+#define MFA_CLIENT_MAX_USER 256
+// Idle connections kept open at most
+#define MFA_CLIENT_MAX_POOL 64
+#define MFA_CLIENT_RECV_BUFFER 4096
+#define MFA_CLIENT_MAX_ENDPOINTS 8
+#define MFA_CLIENT_UNHEALTHY_FAILURES 3
+// Recent /AuthResult latencies kept per endpoint for the hedge delay
+#define MFA_CLIENT_LATENCY_WINDOW 32
+
+enum MfaClientResult
+{
+    MfaClientSucceeded = 0,
+    // The service answered with a negative status
+    MfaClientDenied,
+    // The status was still pending after the last poll
+    MfaClientPending,
+    // Connect, send or receive failed
+    MfaClientUnreachable,
+    // No complete response within timeoutMs
+    MfaClientTimedOut,
+    // The service answered with a non-2xx HTTP status
+    MfaClientHttpError,
+    // The response had no numeric "status" field or was not valid HTTP
+    MfaClientBadResponse,
+    // MfaClientStart was not called, the user name is invalid, or the client was stopped
+    MfaClientNotStarted
+};
+
+enum MfaClientPhase
+{
+    MfaPhaseConnect = 0,
+    MfaPhaseSend,
+    MfaPhaseWait,       // from the end of the send to the first response byte
+    MfaPhaseReceive,    // from the first to the last response byte
+    MfaPhasePollDelay,  // WaitBeforePoll and PollInterval sleeps
+    MfaPhaseCount
+};
+
+struct MfaClientConfig
+{
+    char host[MFA_CLIENT_MAX_HOST];
+    uint16_t port;
+    // Path prefix of the service without a trailing slash, may be empty
+    char basePath[MFA_CLIENT_MAX_PATH];
+    // "user:password" for basic authentication, empty for none
+    char credentials[MFA_CLIENT_MAX_CREDENTIALS];
+    char requestor[MFA_CLIENT_MAX_REQUESTOR];
+    // Limit for one HTTP exchange, connect included (AuthTimeout)
+    uint32_t timeoutMs;
+    uint32_t waitBeforePollMs;
+    uint32_t pollIntervalMs;
+    // Number of /AuthResult calls at most (PollMaxSeconds)
+    uint32_t pollCount;
+    uint32_t maxIdleConnections;
+    // Pooled connections unused for longer than this are closed instead of reused
+    uint32_t idleTimeoutMs;
+    // Lower bound of the delay before a slow /AuthResult poll is hedged; 0
+    // turns hedging off. Only used with several endpoints.
+    uint32_t hedgeMinMs;
+    // How long an endpoint that kept failing is skipped
+    uint32_t unhealthyMs;
+};
+
+// Outcome of one MfaClientAuthenticate call
+struct MfaClientTiming
+{
+    uint64_t phaseMicros[MfaPhaseCount];
+    uint64_t totalMicros;
+    uint32_t exchanges;             // HTTP requests sent, retries and hedges included
+    uint32_t connectionsOpened;
+    uint32_t connectionsReused;
+    uint32_t httpStatus;            // of the last response, 0 if none
+    int32_t status;                 // last "status" value received
+    uint32_t endpoint;              // index of the endpoint that took /Authenticate
+    uint32_t failovers;             // endpoints given up on before /Authenticate was sent
+    uint32_t hedges;                // polls also sent to a second endpoint
+};
+
+struct MfaClientStats
+{
+    uint64_t requests;
+    uint64_t exchanges;
+    uint64_t connectionsOpened;
+    uint64_t connectionsReused;
+    // Requests resent on a new connection after a pooled one turned out to be closed
+    uint64_t retries;
+    uint64_t failures;
+    uint64_t failovers;
+    uint64_t hedges;
+    // Hedged polls answered by the second endpoint first
+    uint64_t hedgesWon;
+    uint64_t phaseMicros[MfaPhaseCount];
+    uint64_t maxPhaseMicros[MfaPhaseCount];
+};
+
+struct MfaClientEndpointStats
+{
+    char host[MFA_CLIENT_MAX_HOST];
+    uint16_t port;
+    bool healthy;
+    uint64_t ewmaMicros;
+    // p95 of the recent /AuthResult polls, 0 before the first
+    uint64_t pollP95Micros;
+    uint64_t exchanges;
+    uint64_t failures;
+};
+
+// Fills in the defaults of the managed Authenticator (port 80, 60 s timeout,
+// 10 s before the first poll, 1 s interval, 60 polls, requestor SMK-RDG),
+// hedging after at least 100 ms and unhealthy endpoints skipped for 10 s.
+void MfaClientDefaultConfig(MfaClientConfig* config);
+
+// Sets host, port and basePath from "http://host[:port][/path]". Returns false
+// for any other scheme (https included) or a malformed URL.
+bool MfaClientParseUrl(const char* url, MfaClientConfig* config);
+
+// Starts the client or applies a new configuration. Connections opened for the
+// previous configuration are closed when they are next returned to the pool.
+bool MfaClientStart(const MfaClientConfig* config);
+// Same with several endpoints (at most MFA_CLIENT_MAX_ENDPOINTS), in order of
+// preference while none has latency samples yet. Everything but host, port
+// and basePath is taken from the first configuration.
+bool MfaClientStartEndpoints(const MfaClientConfig* configs, uint32_t count);
+// Closes pooled connections and wakes requests sleeping between polls, which
+// then return MfaClientNotStarted.
+void MfaClientStop();
+bool MfaClientIsStarted();
+
+// Sends /Authenticate for the user (UTF-8) and polls /AuthResult until the
+// status is final, like Authenticator.AuthenticateAsync. Blocks the caller.
+// The outcome of /Authenticate is reported to the circuit breaker
+// (mfabreaker.h); asking it whether to call at all is up to the caller.
+// timing may be null.
+MfaClientResult MfaClientAuthenticate(const char* samid, MfaClientTiming* timing);
+
+// Opens connections to the service until the given number of usable idle
+// connections is pooled per healthy endpoint (at most maxIdleConnections), after dropping pooled
+// ones that timed out or were closed by the server. Called at startup and
+// periodically after, so the first requests need not connect. Returns the
+// number of connections opened.
+uint32_t MfaClientWarmUp(uint32_t connections);
+
+MfaClientStats MfaClientGetStats();
+// Fills at most capacity entries and returns the number of endpoints
+uint32_t MfaClientGetEndpointStats(MfaClientEndpointStats* stats, uint32_t capacity);
+const char* MfaClientResultName(MfaClientResult result);
+const char* MfaClientPhaseName(MfaClientPhase phase);
+// "connect 0.4 ms, send 0.1 ms, ..., total 12.3 ms" for trace events
+std::string MfaClientFormatTiming(const MfaClientTiming& timing);
+
+// Incremental HTTP/1.1 response parser, exposed for tests. Data is scanned in
+// place; nothing is copied out of the caller's buffer.
+enum MfaResponseState
+{
+    MfaResponseNeedMore = 0,
+    MfaResponseComplete,
+    MfaResponseInvalid
+};
+
+struct MfaResponseParser
+{
+    // Results
+    uint32_t httpStatus;
+    int32_t status;
+    bool hasStatus;
+    bool keepAlive;
+
+    // Framing
+    int state;
+    int httpMinor;
+    uint64_t contentLength;
+    uint64_t remaining;
+    bool hasContentLength;
+    bool chunked;
+    uint32_t chunkDigits;
+    // Header being matched: candidate bit mask and position in the name or value
+    uint32_t headerCandidates;
+    uint32_t headerMatched;
+    uint32_t matchIndex;
+    uint32_t altMatchIndex;
+    bool valueFlag;
+    uint32_t lineLength;
+
+    // Body scan for the top-level "status" field
+    int jsonState;
+    int jsonDepth;
+    bool expectKey;
+    uint32_t keyIndex;
+    bool keyMatches;
+    bool negative;
+    int64_t number;
+    uint32_t digits;
+};
+
+void MfaResponseParserInit(MfaResponseParser* parser);
+// Consumes bytes up to the end of the response; *consumed receives how many.
+MfaResponseState MfaResponseParserFeed(MfaResponseParser* parser, const char* data, size_t length, size_t* consumed);
+// Called when the peer closed the connection; completes a body delimited by the close.
+MfaResponseState MfaResponseParserFinish(MfaResponseParser* parser);
+
+#endif // MFACLIENT_H
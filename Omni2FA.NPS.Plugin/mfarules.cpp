@@ -0,0 +1,695 @@
+#include "mfarules.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+enum Field { kPolicy = 0, kCrp, kNas, kCalled, kTime, kGroups, kFieldCount };
+
+const char* const kFieldNames[kFieldCount] = { "policy", "crp", "nas", "called", "time", "groups" };
+const char* const kDayNames[7] = { "mon", "tue", "wed", "thu", "fri", "sat", "sun" };
+
+const uint32_t kMinutesPerDay = 24 * 60;
+
+uint8_t Lower(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+std::string LowerCopy(const std::string& text)
+{
+    std::string lower(text);
+    for (size_t i = 0; i < lower.size(); ++i)
+        lower[i] = (char)Lower((uint8_t)lower[i]);
+    return lower;
+}
+
+std::string Trim(const std::string& text)
+{
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && (text[begin] == ' ' || text[begin] == '\t'))
+        ++begin;
+    while (end > begin && (text[end - 1] == ' ' || text[end - 1] == '\t'))
+        --end;
+    return text.substr(begin, end - begin);
+}
+
+// Splits at every separator and trims the parts
+std::vector<std::string> Split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;)
+    {
+        size_t next = text.find(separator, start);
+        parts.push_back(Trim(text.substr(start, next == std::string::npos ? std::string::npos : next - start)));
+        if (next == std::string::npos)
+            return parts;
+        start = next + 1;
+    }
+}
+
+// FNV-1a over the lower-cased bytes
+uint32_t HashName(const char* text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= Lower((uint8_t)text[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned LowestBit(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (unsigned)index;
+#elif defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(mask);
+#else
+    unsigned index = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Open-addressing hash set of names, each with the mask of the rules that list it
+class NameSet
+{
+public:
+    void Add(const std::string& name, uint32_t rule)
+    {
+        std::string lower = LowerCopy(name);
+        for (size_t i = 0; i < pending_.size(); ++i)
+        {
+            if (pending_[i].first == lower)
+            {
+                pending_[i].second |= 1ull << rule;
+                return;
+            }
+        }
+        pending_.push_back(std::make_pair(lower, 1ull << rule));
+    }
+
+    // Builds the table at no more than half load
+    void Finish()
+    {
+        size_t capacity = 8;
+        while (capacity < pending_.size() * 2)
+            capacity *= 2;
+        slots_.assign(capacity, Slot());
+        for (size_t i = 0; i < pending_.size(); ++i)
+        {
+            const std::string& name = pending_[i].first;
+            uint32_t hash = HashName(name.data(), name.size());
+            size_t index = hash & (capacity - 1);
+            while (slots_[index].rules != 0)
+                index = (index + 1) & (capacity - 1);
+            slots_[index].hash = hash;
+            slots_[index].offset = (uint32_t)pool_.size();
+            slots_[index].length = (uint32_t)name.size();
+            slots_[index].rules = pending_[i].second;
+            pool_ += name;
+        }
+        pending_.clear();
+    }
+
+    uint64_t Find(const char* text, size_t length) const
+    {
+        if (text == nullptr)
+            return 0;
+        uint32_t hash = HashName(text, length);
+        size_t mask = slots_.size() - 1;
+        for (size_t index = hash & mask; slots_[index].rules != 0; index = (index + 1) & mask)
+        {
+            const Slot& slot = slots_[index];
+            if (slot.hash != hash || slot.length != length)
+                continue;
+            const char* name = pool_.data() + slot.offset;
+            size_t i = 0;
+            while (i < length && Lower((uint8_t)text[i]) == (uint8_t)name[i])
+                ++i;
+            if (i == length)
+                return slot.rules;
+        }
+        return 0;
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t hash = 0;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        // 0 marks a free slot; a listed name always belongs to a rule
+        uint64_t rules = 0;
+    };
+
+    std::vector<std::pair<std::string, uint64_t>> pending_;
+    std::vector<Slot> slots_;
+    // Lower-cased names back to back
+    std::string pool_;
+};
+
+// Binary radix tree over IPv4 prefixes. Walking an address ORs the masks of
+// all prefixes that contain it, longest last.
+class PrefixTree
+{
+public:
+    PrefixTree() : nodes_(1) {}
+
+    void Add(uint32_t prefix, unsigned length, uint32_t rule)
+    {
+        uint32_t node = 0;
+        for (unsigned depth = 0; depth < length; ++depth)
+        {
+            unsigned bit = (prefix >> (31 - depth)) & 1;
+            if (nodes_[node].child[bit] == 0)
+            {
+                nodes_[node].child[bit] = (uint32_t)nodes_.size();
+                nodes_.push_back(Node());
+            }
+            node = nodes_[node].child[bit];
+        }
+        nodes_[node].rules |= 1ull << rule;
+    }
+
+    uint64_t Find(uint32_t address) const
+    {
+        uint64_t rules = nodes_[0].rules;
+        uint32_t node = 0;
+        for (unsigned depth = 0; depth < 32; ++depth)
+        {
+            node = nodes_[node].child[(address >> (31 - depth)) & 1];
+            if (node == 0)
+                break;
+            rules |= nodes_[node].rules;
+        }
+        return rules;
+    }
+
+private:
+    struct Node
+    {
+        // 0 means no child; the root is never anyone's child
+        uint32_t child[2] = { 0, 0 };
+        uint64_t rules = 0;
+    };
+
+    std::vector<Node> nodes_;
+};
+
+// A Called-Station-Id pattern split at its '*'s. The first piece is anchored
+// at the start, the last at the end and the ones between are found in order;
+// '?' in a piece matches any one character.
+struct Pattern
+{
+    std::string text;
+    std::vector<std::pair<uint32_t, uint32_t>> pieces;
+    uint64_t rules = 0;
+
+    void Compile(const std::string& pattern)
+    {
+        text = LowerCopy(pattern);
+        size_t start = 0;
+        for (;;)
+        {
+            size_t star = text.find('*', start);
+            size_t end = star == std::string::npos ? text.size() : star;
+            pieces.push_back(std::make_pair((uint32_t)start, (uint32_t)(end - start)));
+            if (star == std::string::npos)
+                break;
+            start = star + 1;
+        }
+    }
+
+    bool PieceAt(const std::pair<uint32_t, uint32_t>& piece, const char* value, size_t at) const
+    {
+        for (uint32_t i = 0; i < piece.second; ++i)
+        {
+            char c = text[piece.first + i];
+            if (c != '?' && (uint8_t)c != Lower((uint8_t)value[at + i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool Match(const char* value, size_t length) const
+    {
+        const std::pair<uint32_t, uint32_t>& first = pieces.front();
+        const std::pair<uint32_t, uint32_t>& last = pieces.back();
+        if (pieces.size() == 1)
+            return length == first.second && PieceAt(first, value, 0);
+        if (length < (size_t)first.second + last.second ||
+            !PieceAt(first, value, 0) || !PieceAt(last, value, length - last.second))
+            return false;
+        size_t position = first.second;
+        size_t end = length - last.second;
+        for (size_t p = 1; p + 1 < pieces.size(); ++p)
+        {
+            const std::pair<uint32_t, uint32_t>& piece = pieces[p];
+            while (position + piece.second <= end && !PieceAt(piece, value, position))
+                ++position;
+            if (position + piece.second > end)
+                return false;
+            position += piece.second;
+        }
+        return true;
+    }
+};
+
+struct TimeWindow
+{
+    // Bit 0 is Monday
+    uint8_t days;
+    uint16_t start;
+    uint16_t end;
+
+    bool Contains(uint32_t minuteOfWeek) const
+    {
+        unsigned day = (minuteOfWeek / kMinutesPerDay) % 7;
+        uint32_t minute = minuteOfWeek % kMinutesPerDay;
+        if (start < end)
+            return ((days >> day) & 1) != 0 && minute >= start && minute < end;
+        // Runs past midnight: the evening of a listed day or the morning after it
+        return (((days >> day) & 1) != 0 && minute >= start) ||
+            (((days >> ((day + 6) % 7)) & 1) != 0 && minute < end);
+    }
+};
+
+struct Rule
+{
+    std::string name;
+    MfaRuleAction action = MfaRuleRequire;
+    uint32_t fields = 0;
+    std::vector<TimeWindow> windows;
+};
+
+void Fail(char* error, size_t errorSize, size_t rule, const char* format, ...)
+{
+    char detail[MFA_RULES_MAX_ERROR];
+    va_list args;
+    if (error == nullptr || errorSize == 0)
+        return;
+    va_start(args, format);
+    vsnprintf(detail, sizeof(detail), format, args);
+    va_end(args);
+    snprintf(error, errorSize, "rule %u: %s", (unsigned)(rule + 1), detail);
+}
+
+bool ParseNumber(const std::string& text, size_t* position, unsigned maxDigits, unsigned* value)
+{
+    unsigned digits = 0;
+    *value = 0;
+    while (*position < text.size() && text[*position] >= '0' && text[*position] <= '9' && digits < maxDigits)
+    {
+        *value = *value * 10 + (unsigned)(text[*position] - '0');
+        ++*position;
+        ++digits;
+    }
+    return digits > 0;
+}
+
+// a.b.c.d or a.b.c.d/length
+bool ParsePrefix(const std::string& text, uint32_t* prefix, unsigned* length)
+{
+    size_t position = 0;
+    unsigned octet;
+    *prefix = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        if ((i > 0 && (position >= text.size() || text[position++] != '.')) ||
+            !ParseNumber(text, &position, 3, &octet) || octet > 255)
+            return false;
+        *prefix = (*prefix << 8) | octet;
+    }
+    *length = 32;
+    if (position < text.size() && text[position] == '/')
+    {
+        ++position;
+        if (!ParseNumber(text, &position, 2, length) || *length > 32)
+            return false;
+    }
+    if (position != text.size())
+        return false;
+    if (*length < 32)
+        *prefix &= *length == 0 ? 0 : ~0u << (32 - *length);
+    return true;
+}
+
+bool ParseDay(const std::string& text, unsigned* day)
+{
+    std::string lower = LowerCopy(text);
+    for (unsigned i = 0; i < 7; ++i)
+    {
+        if (lower == kDayNames[i])
+        {
+            *day = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// HH:MM, with 24:00 allowed as the end of a window
+bool ParseClock(const std::string& text, size_t* position, uint16_t* minutes)
+{
+    unsigned hour;
+    unsigned minute;
+    if (!ParseNumber(text, position, 2, &hour) || *position >= text.size() || text[(*position)++] != ':' ||
+        !ParseNumber(text, position, 2, &minute) || minute > 59 || hour > 24 || (hour == 24 && minute != 0))
+        return false;
+    *minutes = (uint16_t)(hour * 60 + minute);
+    return true;
+}
+
+// [Day[-Day]] HH:MM-HH:MM
+bool ParseWindow(const std::string& text, TimeWindow* window)
+{
+    std::string clock = text;
+    window->days = 0x7F;
+    size_t space = text.find(' ');
+    if (space != std::string::npos)
+    {
+        std::string days = Trim(text.substr(0, space));
+        clock = Trim(text.substr(space + 1));
+        size_t dash = days.find('-');
+        unsigned first;
+        unsigned last;
+        if (!ParseDay(days.substr(0, dash), &first) ||
+            !ParseDay(dash == std::string::npos ? days : days.substr(dash + 1), &last))
+            return false;
+        window->days = 0;
+        for (unsigned day = first;; day = (day + 1) % 7)
+        {
+            window->days |= (uint8_t)(1 << day);
+            if (day == last)
+                break;
+        }
+    }
+    size_t position = 0;
+    if (!ParseClock(clock, &position, &window->start) || window->start >= kMinutesPerDay ||
+        position >= clock.size() || clock[position++] != '-' ||
+        !ParseClock(clock, &position, &window->end) || position != clock.size())
+        return false;
+    return true;
+}
+
+bool StartsWithWord(const std::string& text, const char* word)
+{
+    size_t length = strlen(word);
+    return text.size() >= length && LowerCopy(text.substr(0, length)) == word &&
+        (text.size() == length || text[length] == ' ' || text[length] == '\t');
+}
+
+std::atomic<MfaRuleSet*> g_current(nullptr);
+std::mutex g_retiredLock;
+std::vector<MfaRuleSet*> g_retired;
+
+} // namespace
+
+struct MfaRuleSet
+{
+    uint64_t tag = 0;
+    std::vector<Rule> rules;
+    uint64_t all = 0;
+    // Rules without a condition on the field, which the field never rules out
+    uint64_t unconditional[kFieldCount];
+    NameSet policies;
+    NameSet crps;
+    PrefixTree nas;
+    std::vector<Pattern> patterns;
+};
+
+namespace {
+
+bool CompileCondition(MfaRuleSet* set, uint32_t index, const std::string& condition, char* error, size_t errorSize)
+{
+    Rule& rule = set->rules[index];
+    size_t equals = condition.find('=');
+    if (equals == std::string::npos)
+    {
+        Fail(error, errorSize, index, "condition '%s' has no '='", condition.c_str());
+        return false;
+    }
+    std::string name = LowerCopy(Trim(condition.substr(0, equals)));
+    int field = 0;
+    while (field < kFieldCount && name != kFieldNames[field])
+        ++field;
+    if (field == kFieldCount)
+    {
+        Fail(error, errorSize, index, "unknown field '%s'", name.c_str());
+        return false;
+    }
+    if ((rule.fields & (1u << field)) != 0)
+    {
+        Fail(error, errorSize, index, "field '%s' is given twice", name.c_str());
+        return false;
+    }
+    rule.fields |= 1u << field;
+    std::vector<std::string> values = Split(condition.substr(equals + 1), ',');
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const std::string& value = values[i];
+        if (value.empty())
+        {
+            Fail(error, errorSize, index, "field '%s' has an empty value", name.c_str());
+            return false;
+        }
+        switch (field)
+        {
+        case kPolicy:
+            set->policies.Add(value, index);
+            break;
+        case kCrp:
+            set->crps.Add(value, index);
+            break;
+        case kNas:
+        {
+            uint32_t prefix;
+            unsigned length;
+            if (!ParsePrefix(value, &prefix, &length))
+            {
+                Fail(error, errorSize, index, "invalid IPv4 prefix '%s'", value.c_str());
+                return false;
+            }
+            set->nas.Add(prefix, length, index);
+            break;
+        }
+        case kCalled:
+        {
+            std::string lower = LowerCopy(value);
+            size_t p = 0;
+            while (p < set->patterns.size() && set->patterns[p].text != lower)
+                ++p;
+            if (p == set->patterns.size())
+            {
+                set->patterns.push_back(Pattern());
+                set->patterns.back().Compile(value);
+            }
+            set->patterns[p].rules |= 1ull << index;
+            break;
+        }
+        case kTime:
+        {
+            TimeWindow window;
+            if (!ParseWindow(value, &window))
+            {
+                Fail(error, errorSize, index, "invalid time window '%s'", value.c_str());
+                return false;
+            }
+            rule.windows.push_back(window);
+            break;
+        }
+        default:
+            // Group names are resolved and checked by the caller
+            break;
+        }
+    }
+    return true;
+}
+
+bool CompileRule(MfaRuleSet* set, uint32_t index, const char* text, char* error, size_t errorSize)
+{
+    std::string rule = Trim(text != nullptr ? text : "");
+    size_t colon = rule.find(':');
+    if (colon == std::string::npos || Trim(rule.substr(0, colon)).empty())
+    {
+        Fail(error, errorSize, index, "expected 'name: mfa|skip [if conditions]'");
+        return false;
+    }
+    Rule& compiled = set->rules[index];
+    compiled.name = Trim(rule.substr(0, colon));
+    std::string rest = Trim(rule.substr(colon + 1));
+    if (StartsWithWord(rest, "mfa"))
+    {
+        compiled.action = MfaRuleRequire;
+        rest = Trim(rest.substr(3));
+    }
+    else if (StartsWithWord(rest, "skip"))
+    {
+        compiled.action = MfaRuleSkip;
+        rest = Trim(rest.substr(4));
+    }
+    else
+    {
+        Fail(error, errorSize, index, "expected 'mfa' or 'skip' after the name");
+        return false;
+    }
+    if (rest.empty())
+        return true;
+    if (!StartsWithWord(rest, "if"))
+    {
+        Fail(error, errorSize, index, "expected 'if' before the conditions");
+        return false;
+    }
+    std::vector<std::string> conditions = Split(rest.substr(2), '&');
+    for (size_t i = 0; i < conditions.size(); ++i)
+    {
+        if (!CompileCondition(set, index, conditions[i], error, errorSize))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+MfaRuleSet* MfaRulesCompile(const char* const* rules, size_t count, uint64_t tag, char* error, size_t errorSize)
+{
+    if (error != nullptr && errorSize > 0)
+        error[0] = '\0';
+    if (count > MFA_RULES_MAX_RULES || (count > 0 && rules == nullptr))
+    {
+        if (error != nullptr && errorSize > 0)
+            snprintf(error, errorSize, "%u rules, at most %d are supported", (unsigned)count, MFA_RULES_MAX_RULES);
+        return nullptr;
+    }
+    MfaRuleSet* set = new MfaRuleSet();
+    set->tag = tag;
+    set->rules.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!CompileRule(set, (uint32_t)i, rules[i], error, errorSize))
+        {
+            delete set;
+            return nullptr;
+        }
+    }
+    set->all = count == 64 ? ~0ull : (1ull << count) - 1;
+    for (int field = 0; field < kFieldCount; ++field)
+    {
+        set->unconditional[field] = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if ((set->rules[i].fields & (1u << field)) == 0)
+                set->unconditional[field] |= 1ull << i;
+        }
+    }
+    set->policies.Finish();
+    set->crps.Finish();
+    return set;
+}
+
+void MfaRulesFree(MfaRuleSet* rules)
+{
+    delete rules;
+}
+
+size_t MfaRulesCount(const MfaRuleSet* rules)
+{
+    return rules != nullptr ? rules->rules.size() : 0;
+}
+
+uint64_t MfaRulesTag(const MfaRuleSet* rules)
+{
+    return rules != nullptr ? rules->tag : 0;
+}
+
+bool MfaRulesEvaluate(const MfaRuleSet* rules, const MfaRuleRequest* request, uint32_t firstRule, MfaRuleMatch* match)
+{
+    if (rules == nullptr || request == nullptr || match == nullptr || firstRule >= rules->rules.size())
+        return false;
+    uint64_t candidates = rules->all & (~0ull << firstRule);
+    candidates &= rules->unconditional[kPolicy] | rules->policies.Find(request->policy, request->policyLength);
+    candidates &= rules->unconditional[kCrp] | rules->crps.Find(request->crp, request->crpLength);
+    candidates &= rules->unconditional[kNas] | (request->hasNasIp ? rules->nas.Find(request->nasIp) : 0);
+    // Patterns and time windows are only checked for rules still in the running
+    if ((candidates & ~rules->unconditional[kCalled]) != 0)
+    {
+        uint64_t matched = 0;
+        for (size_t i = 0; i < rules->patterns.size(); ++i)
+        {
+            const Pattern& pattern = rules->patterns[i];
+            if ((pattern.rules & candidates & ~matched) != 0 && request->calledStationId != nullptr &&
+                pattern.Match(request->calledStationId, request->calledStationIdLength))
+                matched |= pattern.rules;
+        }
+        candidates &= rules->unconditional[kCalled] | matched;
+    }
+    uint64_t timed = candidates & ~rules->unconditional[kTime];
+    while (timed != 0)
+    {
+        unsigned index = LowestBit(timed);
+        const std::vector<TimeWindow>& windows = rules->rules[index].windows;
+        bool inside = false;
+        for (size_t i = 0; i < windows.size() && !inside; ++i)
+            inside = windows[i].Contains(request->minuteOfWeek);
+        if (!inside)
+            candidates &= ~(1ull << index);
+        timed &= timed - 1;
+    }
+    if (candidates == 0)
+        return false;
+    const Rule& rule = rules->rules[LowestBit(candidates)];
+    match->rule = LowestBit(candidates);
+    match->action = rule.action;
+    match->needsGroups = (rule.fields & (1u << kGroups)) != 0;
+    match->name = rule.name.c_str();
+    return true;
+}
+
+uint32_t MfaRulesMinuteOfWeek(int dayOfWeek, int hour, int minute)
+{
+    return (uint32_t)(((dayOfWeek + 6) % 7) * kMinutesPerDay + hour * 60 + minute);
+}
+
+void MfaRulesInstall(MfaRuleSet* rules)
+{
+    MfaRuleSet* previous = g_current.exchange(rules, std::memory_order_acq_rel);
+    if (previous == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard(g_retiredLock);
+    g_retired.push_back(previous);
+}
+
+const MfaRuleSet* MfaRulesCurrent()
+{
+    return g_current.load(std::memory_order_acquire);
+}
+
+void MfaRulesShutdown()
+{
+    delete g_current.exchange(nullptr, std::memory_order_acq_rel);
+    std::lock_guard<std::mutex> guard(g_retiredLock);
+    for (size_t i = 0; i < g_retired.size(); ++i)
+        delete g_retired[i];
+    g_retired.clear();
+}
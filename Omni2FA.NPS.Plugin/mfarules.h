@@ -0,0 +1,100 @@
+#ifndef MFARULES_H
+#define MFARULES_H
+#pragma once
+
+// Compiled MFA policy rules (MfaRules).
+//
+// Each rule names the requests it applies to and whether they need MFA:
+//
+//   Office Wi-Fi: skip if nas=10.1.0.0/16,10.2.0.0/16 & called=*:CORP-WIFI
+//   VPN: mfa if policy=Secure VPN,Remote VPN & time=Mon-Fri 18:00-08:00,Sat-Sun 00:00-24:00
+//   Admins: mfa if groups=DOMAIN\NPS Admins
+//
+// Conditions are joined with '&' and all of them must hold; the values of one
+// condition are separated by ',' and any of them may match. The fields are
+// policy (Policy-Name), crp (the connection request policy), nas (IPv4
+// NAS-IP-Address prefixes), called (Called-Station-Id patterns with '*' and
+// '?'), time (local time windows, a window ending before it starts runs past
+// midnight) and groups. Names and patterns are compared ignoring ASCII case.
+// The first rule, in configured order, whose conditions all hold decides.
+//
+// The rules are compiled once per configuration into one decision structure
+// for the whole set: a hashed set of all policy and CRP names, a radix tree of
+// all NAS prefixes and the precompiled patterns, each mapping to the bit mask
+// of the rules that list it. A request is evaluated with one lookup per field
+// and a few mask operations, without allocating. Group membership is not known
+// natively; a rule with a groups condition is reported with needsGroups and the
+// caller checks the groups itself, continuing after that rule if they do not
+// match.
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Rules in one set at most; a rule is one bit of the evaluation masks
+#define MFA_RULES_MAX_RULES 64
+#define MFA_RULES_MAX_ERROR 256
+
+enum MfaRuleAction
+{
+    MfaRuleRequire = 0,
+    MfaRuleSkip
+};
+
+// Fields of the request a rule can test
+struct MfaRuleRequest
+{
+    // Policy-Name and the CRP name, may be null
+    const char* policy;
+    size_t policyLength;
+    const char* crp;
+    size_t crpLength;
+    const char* calledStationId;
+    size_t calledStationIdLength;
+    // NAS-IP-Address as a.b.c.d = (a << 24) | (b << 16) | (c << 8) | d
+    uint32_t nasIp;
+    bool hasNasIp;
+    // Local time, see MfaRulesMinuteOfWeek
+    uint32_t minuteOfWeek;
+};
+
+struct MfaRuleMatch
+{
+    // Position of the rule in the configured list
+    uint32_t rule;
+    MfaRuleAction action;
+    // The rule also has a groups condition, which the caller has to check
+    bool needsGroups;
+    // NUL-terminated, owned by the rule set
+    const char* name;
+};
+
+struct MfaRuleSet;
+
+// Compiles count rules (UTF-8). On the first invalid rule returns null and
+// describes the problem in error ("rule 2: unknown field 'vlan'").
+// tag identifies the rule text, so a caller can tell whether the set it sees
+// was compiled from the rules it has.
+MfaRuleSet* MfaRulesCompile(const char* const* rules, size_t count, uint64_t tag, char* error, size_t errorSize);
+void MfaRulesFree(MfaRuleSet* rules);
+size_t MfaRulesCount(const MfaRuleSet* rules);
+uint64_t MfaRulesTag(const MfaRuleSet* rules);
+
+// Finds the first rule at or after firstRule whose conditions, other than
+// groups, hold for the request. Returns false if there is none.
+bool MfaRulesEvaluate(const MfaRuleSet* rules, const MfaRuleRequest* request, uint32_t firstRule, MfaRuleMatch* match);
+
+// Minutes since Monday 00:00; dayOfWeek counts from 0 = Sunday like SYSTEMTIME
+uint32_t MfaRulesMinuteOfWeek(int dayOfWeek, int hour, int minute);
+
+// The process-wide set used by RadiusExtensionProcess2. Install takes
+// ownership; null removes the rules. Requests may still be evaluating the
+// previous set, so replaced sets are only freed by MfaRulesShutdown, when no
+// request is in progress any more.
+void MfaRulesInstall(MfaRuleSet* rules);
+const MfaRuleSet* MfaRulesCurrent();
+void MfaRulesShutdown();
+
+#endif // MFARULES_H
@@ -0,0 +1,356 @@
+#include "nativelog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define NATIVE_LOG_MAX_SINKS 4
+#define NATIVE_LOG_IDLE_MS 20
+
+volatile int g_nativeLogLevel = NativeLogInformation;
+
+namespace {
+
+// Bounded MPSC queue in the style of Vyukov's array queue: each slot carries a
+// sequence number that tells producers whether it is free and the consumer
+// whether it has been published. Producers only ever CAS the enqueue position.
+struct Slot
+{
+    NativeLogRecord record;
+    std::atomic<uint64_t> sequence;
+};
+
+struct Sink
+{
+    NativeLogSinkFn fn;
+    void* context;
+};
+
+Slot g_ring[NATIVE_LOG_RING_SIZE];
+std::atomic<uint64_t> g_enqueuePos(0);
+std::atomic<uint64_t> g_dequeuePos(0);
+std::atomic<bool> g_ringReady(false);
+std::once_flag g_ringInit;
+
+std::atomic<uint64_t> g_written(0);
+std::atomic<uint64_t> g_dropped(0);
+std::atomic<uint64_t> g_flushed(0);
+
+Sink g_sinks[NATIVE_LOG_MAX_SINKS];
+int g_sinkCount = 0;
+
+// Serializes consumers: the flusher thread and explicit NativeLogFlush calls
+std::mutex g_consumerLock;
+std::mutex g_threadLock;
+std::condition_variable g_wake;
+std::thread g_flusher;
+bool g_running = false;
+
+void InitRing()
+{
+    for (uint64_t i = 0; i < NATIVE_LOG_RING_SIZE; ++i)
+        g_ring[i].sequence.store(i, std::memory_order_relaxed);
+    g_ringReady.store(true, std::memory_order_release);
+}
+
+uint32_t CurrentThreadId()
+{
+#ifdef _WIN32
+    return (uint32_t)GetCurrentThreadId();
+#else
+    static thread_local uint32_t id = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    return id;
+#endif
+}
+
+uint64_t NowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void AppendArg(std::string& out, const NativeLogRecord& record, const NativeLogArg& arg)
+{
+    char number[32];
+    switch (arg.type)
+    {
+    case NativeLogArgInt:
+        snprintf(number, sizeof(number), "%lld", (long long)arg.i);
+        out += number;
+        break;
+    case NativeLogArgUInt:
+        snprintf(number, sizeof(number), "%llu", (unsigned long long)arg.u);
+        out += number;
+        break;
+    case NativeLogArgText:
+        out.append(record.text + arg.text.offset, arg.text.length);
+        break;
+    case NativeLogArgHeapText:
+        if (arg.heap != nullptr)
+            out += arg.heap;
+        break;
+    default:
+        break;
+    }
+}
+
+void ReleaseRecord(NativeLogRecord& record)
+{
+    for (uint32_t i = 0; i < record.argCount; ++i)
+    {
+        if (record.args[i].type == NativeLogArgHeapText)
+        {
+            free(record.args[i].heap);
+            record.args[i].heap = nullptr;
+        }
+    }
+}
+
+// Consumes every published record. Must be called with g_consumerLock held.
+bool DrainLocked()
+{
+    bool any = false;
+    std::string message;
+    for (;;)
+    {
+        uint64_t pos = g_dequeuePos.load(std::memory_order_relaxed);
+        Slot& slot = g_ring[pos & (NATIVE_LOG_RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+            return any;
+        message = NativeLogFormat(slot.record);
+        for (int i = 0; i < g_sinkCount; ++i)
+            g_sinks[i].fn(g_sinks[i].context, slot.record.level, slot.record.eventCode, message.c_str());
+        ReleaseRecord(slot.record);
+        g_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        slot.sequence.store(pos + NATIVE_LOG_RING_SIZE, std::memory_order_release);
+        g_flushed.fetch_add(1, std::memory_order_relaxed);
+        any = true;
+    }
+}
+
+void FlusherMain()
+{
+    std::unique_lock<std::mutex> lock(g_threadLock);
+    while (g_running)
+    {
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> consumer(g_consumerLock);
+            DrainLocked();
+        }
+        lock.lock();
+        // Producers never signal, so publishing stays lock-free; the flusher polls
+        g_wake.wait_for(lock, std::chrono::milliseconds(NATIVE_LOG_IDLE_MS));
+    }
+}
+
+} // namespace
+
+NativeLogRecord* NativeLogBegin(int level, int eventCode, const char* format)
+{
+    if (!g_ringReady.load(std::memory_order_acquire))
+        std::call_once(g_ringInit, InitRing);
+    uint64_t pos = g_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;)
+    {
+        slot = &g_ring[pos & (NATIVE_LOG_RING_SIZE - 1)];
+        uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0)
+        {
+            if (g_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Ring is full; never block an NPS worker thread
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+        {
+            pos = g_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    NativeLogRecord* record = &slot->record;
+    record->timestamp = NowMs();
+    record->threadId = CurrentThreadId();
+    record->level = level;
+    record->eventCode = eventCode;
+    record->argCount = 0;
+    record->format = format;
+    record->textUsed = 0;
+    return record;
+}
+
+void NativeLogCommit(NativeLogRecord* record)
+{
+    // record is the first member of its Slot
+    Slot* slot = reinterpret_cast<Slot*>(record);
+    uint64_t seq = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(seq + 1, std::memory_order_release);
+    g_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NativeLogAppendArg(NativeLogRecord* record, const char* value, size_t length)
+{
+    NativeLogArg& arg = record->args[record->argCount++];
+    if (value == nullptr)
+        length = 0;
+    if (length <= NATIVE_LOG_TEXT_SIZE - record->textUsed)
+    {
+        arg.type = NativeLogArgText;
+        arg.text.offset = record->textUsed;
+        arg.text.length = (uint32_t)length;
+        if (length > 0)
+            memcpy(record->text + record->textUsed, value, length);
+        record->textUsed += (uint32_t)length;
+        return;
+    }
+    // Only long strings such as exception text leave the ring
+    arg.type = NativeLogArgHeapText;
+    arg.heap = (char*)malloc(length + 1);
+    if (arg.heap != nullptr)
+    {
+        memcpy(arg.heap, value, length);
+        arg.heap[length] = '\0';
+    }
+}
+
+std::string NativeLogFormat(const NativeLogRecord& record)
+{
+    std::string out;
+    const char* p = record.format;
+    if (p == nullptr)
+        return out;
+    out.reserve(strlen(p) + record.textUsed + 16);
+    while (*p != '\0')
+    {
+        if (p[0] == '{' && p[1] >= '0' && p[1] <= '9' && p[2] == '}')
+        {
+            uint32_t index = (uint32_t)(p[1] - '0');
+            if (index < record.argCount)
+                AppendArg(out, record, record.args[index]);
+            p += 3;
+            continue;
+        }
+        out += *p++;
+    }
+    return out;
+}
+
+void NativeLogStart()
+{
+    std::call_once(g_ringInit, InitRing);
+    std::lock_guard<std::mutex> lock(g_threadLock);
+    if (g_running)
+        return;
+    g_running = true;
+    g_flusher = std::thread(FlusherMain);
+}
+
+void NativeLogStop()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_threadLock);
+        if (!g_running)
+            return;
+        g_running = false;
+    }
+    g_wake.notify_all();
+    if (g_flusher.joinable())
+        g_flusher.join();
+    std::lock_guard<std::mutex> consumer(g_consumerLock);
+    DrainLocked();
+}
+
+void NativeLogFlush()
+{
+    uint64_t target = g_enqueuePos.load(std::memory_order_acquire);
+    std::lock_guard<std::mutex> consumer(g_consumerLock);
+    // A producer may hold a reserved slot that it has not committed yet
+    while (DrainLocked(), g_dequeuePos.load(std::memory_order_relaxed) < target)
+        std::this_thread::yield();
+}
+
+void NativeLogSetLevel(int level)
+{
+    g_nativeLogLevel = level;
+}
+
+int NativeLogGetLevel()
+{
+    return g_nativeLogLevel;
+}
+
+bool NativeLogAddSink(NativeLogSinkFn sink, void* context)
+{
+    if (sink == nullptr || g_sinkCount >= NATIVE_LOG_MAX_SINKS)
+        return false;
+    g_sinks[g_sinkCount].fn = sink;
+    g_sinks[g_sinkCount].context = context;
+    ++g_sinkCount;
+    return true;
+}
+
+void NativeLogClearSinks()
+{
+    g_sinkCount = 0;
+}
+
+NativeLogStats NativeLogGetStats()
+{
+    NativeLogStats stats;
+    stats.written = g_written.load(std::memory_order_relaxed);
+    stats.dropped = g_dropped.load(std::memory_order_relaxed);
+    stats.flushed = g_flushed.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void NativeLogFileSink(void* context, int level, int eventCode, const char* message)
+{
+    static const char* const names[] = { "TRACE", "INFO", "WARN", "ERROR" };
+    FILE* file = (FILE*)context;
+    if (file == nullptr)
+        return;
+    const char* name = (level >= NativeLogTrace && level <= NativeLogError) ? names[level] : "?";
+    fprintf(file, "%s %d %s\n", name, eventCode, message);
+    fflush(file);
+}
+
+#ifdef _WIN32
+void NativeLogEventLogSink(void* context, int level, int eventCode, const char* message)
+{
+    // Only called from the consumer, so the lazily registered handle needs no lock
+    static HANDLE source = NULL;
+    if (source == NULL)
+    {
+        source = RegisterEventSourceW(NULL, (const wchar_t*)context);
+        if (source == NULL)
+            return;
+    }
+    std::string text = (level == NativeLogTrace) ? std::string("[TRACE] ") + message : std::string(message);
+    int chars = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+    if (chars <= 0)
+        return;
+    std::wstring wide((size_t)chars, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], chars);
+    WORD type = EVENTLOG_INFORMATION_TYPE;
+    if (level == NativeLogWarning)
+        type = EVENTLOG_WARNING_TYPE;
+    else if (level >= NativeLogError)
+        type = EVENTLOG_ERROR_TYPE;
+    LPCWSTR strings[1] = { wide.c_str() };
+    ReportEventW(source, type, 0, (DWORD)eventCode, NULL, 1, 0, strings, NULL);
+}
+#endif
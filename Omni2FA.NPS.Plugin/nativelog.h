@@ -0,0 +1,186 @@
+#ifndef NATIVELOG_H
+#define NATIVELOG_H
+#pragma once
+
+// Asynchronous event logger for the native wrapper.
+//
+// Callers append fixed-size binary records (level, event code, a static format
+// string and up to NATIVE_LOG_MAX_ARGS arguments) to a lock-free ring buffer.
+// A background flusher thread formats the records and hands the text to the
+// registered sinks, so NPS worker threads never format strings or wait for
+// Event Log I/O. When the ring is full records are dropped and counted rather
+// than blocking the caller.
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+enum NativeLogLevel
+{
+    NativeLogTrace = 0,
+    NativeLogInformation = 1,
+    NativeLogWarning = 2,
+    NativeLogError = 3,
+    NativeLogOff = 4
+};
+
+// Levels below NATIVE_LOG_MIN_LEVEL are compiled out entirely
+#ifndef NATIVE_LOG_MIN_LEVEL
+#define NATIVE_LOG_MIN_LEVEL NativeLogTrace
+#endif
+
+#define NATIVE_LOG_MAX_ARGS 4
+#define NATIVE_LOG_TEXT_SIZE 160
+#define NATIVE_LOG_RING_SIZE 1024
+
+enum NativeLogArgType
+{
+    NativeLogArgNone = 0,
+    NativeLogArgInt,
+    NativeLogArgUInt,
+    // Offset/length into the record's inline text buffer
+    NativeLogArgText,
+    // Heap copy of a string too long for the inline buffer, freed by the flusher
+    NativeLogArgHeapText
+};
+
+struct NativeLogArg
+{
+    NativeLogArgType type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        struct
+        {
+            uint32_t offset;
+            uint32_t length;
+        } text;
+        char* heap;
+    };
+};
+
+struct NativeLogRecord
+{
+    uint64_t timestamp;     // milliseconds since the Unix epoch
+    uint32_t threadId;
+    int32_t level;
+    int32_t eventCode;
+    uint32_t argCount;
+    const char* format;     // must be a string literal, it is read by the flusher
+    NativeLogArg args[NATIVE_LOG_MAX_ARGS];
+    uint32_t textUsed;
+    char text[NATIVE_LOG_TEXT_SIZE];
+};
+
+// A sink receives fully formatted messages on the flusher thread only
+typedef void (*NativeLogSinkFn)(void* context, int level, int eventCode, const char* message);
+
+struct NativeLogStats
+{
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t flushed;
+};
+
+// Starts the flusher thread. Safe to call more than once.
+void NativeLogStart();
+// Drains pending records and stops the flusher thread.
+void NativeLogStop();
+// Blocks until every record submitted before the call has reached the sinks.
+void NativeLogFlush();
+
+// Runtime level gate: records below the level are discarded before any work.
+void NativeLogSetLevel(int level);
+int NativeLogGetLevel();
+
+// Sinks are registered before NativeLogStart. Returns false if there is no room.
+bool NativeLogAddSink(NativeLogSinkFn sink, void* context);
+void NativeLogClearSinks();
+
+// Built-in sinks. The file sink appends one line per record to an open FILE*
+// passed as context. The Event Log sink writes to the Application log; context
+// is the event source name (const wchar_t*).
+void NativeLogFileSink(void* context, int level, int eventCode, const char* message);
+#ifdef _WIN32
+void NativeLogEventLogSink(void* context, int level, int eventCode, const char* message);
+#endif
+
+NativeLogStats NativeLogGetStats();
+
+// Formats a record; used by the flusher and exposed for tests.
+std::string NativeLogFormat(const NativeLogRecord& record);
+
+// Reserves a ring slot, or returns nullptr if the ring is full.
+NativeLogRecord* NativeLogBegin(int level, int eventCode, const char* format);
+// Publishes a record obtained from NativeLogBegin.
+void NativeLogCommit(NativeLogRecord* record);
+
+extern volatile int g_nativeLogLevel;
+
+inline bool NativeLogIsEnabled(int level)
+{
+    return level >= NATIVE_LOG_MIN_LEVEL && level >= g_nativeLogLevel;
+}
+
+// Argument capture. Only copies are made here; formatting happens later.
+inline void NativeLogAppendArg(NativeLogRecord* record, long long value)
+{
+    NativeLogArg& arg = record->args[record->argCount++];
+    arg.type = NativeLogArgInt;
+    arg.i = value;
+}
+inline void NativeLogAppendArg(NativeLogRecord* record, int value) { NativeLogAppendArg(record, (long long)value); }
+inline void NativeLogAppendArg(NativeLogRecord* record, long value) { NativeLogAppendArg(record, (long long)value); }
+inline void NativeLogAppendArg(NativeLogRecord* record, unsigned long long value)
+{
+    NativeLogArg& arg = record->args[record->argCount++];
+    arg.type = NativeLogArgUInt;
+    arg.u = value;
+}
+inline void NativeLogAppendArg(NativeLogRecord* record, unsigned int value) { NativeLogAppendArg(record, (unsigned long long)value); }
+inline void NativeLogAppendArg(NativeLogRecord* record, unsigned long value) { NativeLogAppendArg(record, (unsigned long long)value); }
+void NativeLogAppendArg(NativeLogRecord* record, const char* value, size_t length);
+inline void NativeLogAppendArg(NativeLogRecord* record, const char* value)
+{
+    NativeLogAppendArg(record, value, value != nullptr ? strlen(value) : 0);
+}
+inline void NativeLogAppendArg(NativeLogRecord* record, const std::string& value)
+{
+    NativeLogAppendArg(record, value.c_str(), value.size());
+}
+
+inline void NativeLogAppendArgs(NativeLogRecord*) {}
+
+template <typename T, typename... Rest>
+inline void NativeLogAppendArgs(NativeLogRecord* record, const T& first, const Rest&... rest)
+{
+    static_assert(sizeof...(Rest) < NATIVE_LOG_MAX_ARGS, "too many log arguments");
+    NativeLogAppendArg(record, first);
+    NativeLogAppendArgs(record, rest...);
+}
+
+// Writes a record. The format uses {0}..{3} placeholders like String.Format.
+template <typename... Args>
+inline void NativeLogWrite(int level, int eventCode, const char* format, const Args&... args)
+{
+    if (!NativeLogIsEnabled(level))
+        return;
+    NativeLogRecord* record = NativeLogBegin(level, eventCode, format);
+    if (record == nullptr)
+        return;
+    NativeLogAppendArgs(record, args...);
+    NativeLogCommit(record);
+}
+
+// Arguments are not evaluated at all when the level is disabled
+#define NATIVE_LOG(level, eventCode, ...) \
+    do { \
+        if ((level) >= NATIVE_LOG_MIN_LEVEL && NativeLogIsEnabled(level)) \
+            NativeLogWrite((level), (eventCode), __VA_ARGS__); \
+    } while (0)
+
+#endif // NATIVELOG_H
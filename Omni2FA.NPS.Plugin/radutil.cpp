@@ -1,15 +1,298 @@
 #include "pch.h"
 #include <windows.h>
+#include <string.h>
+#include <atomic>
 #include "radutil.h"
+#ifdef RADIUS_ARENA_GUARD
+#include <vector>
+#endif
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RADIUS_USE_SSE2 1
+#endif
+
+/* Arena blocks are RADIUS_ARENA_BLOCK_SIZE bytes, header included, so that in
+ * guard builds the data ends exactly at the no-access page. */
+#define RADIUS_ARENA_ALIGN 16
+#define RADIUS_ARENA_PAGE 4096
+#define RADIUS_ARENA_CANARY 16
+#define RADIUS_ARENA_CANARY_BYTE 0xFD
+#define RADIUS_ARENA_POISON_BYTE 0xDD
+
+typedef struct _RADIUS_ARENA_BLOCK
+{
+    struct _RADIUS_ARENA_BLOCK* pNext;
+    SIZE_T cbUsed;
+    BYTE* pData;
+    BYTE* pEnd;
+} RADIUS_ARENA_BLOCK, *PRADIUS_ARENA_BLOCK;
+
+/* Per-thread arena. The counters are added to the shared totals once per
+ * request, so the allocation path touches no shared cache line. */
+struct RadiusArena
+{
+    PRADIUS_ARENA_BLOCK pFirst;
+    PRADIUS_ARENA_BLOCK pCurrent;
+    DWORD dwDepth;
+    DWORD dwBlocks;
+    ULONGLONG ullAllocations;
+    ULONGLONG ullBytes;
+#ifdef RADIUS_ARENA_GUARD
+    /* Start of every allocation of the request, for the canary check */
+    std::vector<BYTE*> allocations;
+    std::vector<SIZE_T> sizes;
+#endif
+
+    ~RadiusArena();
+};
+
+static thread_local RadiusArena t_arena;
+
+static std::atomic<ULONGLONG> g_arenaRequests(0);
+static std::atomic<ULONGLONG> g_arenaAllocations(0);
+static std::atomic<ULONGLONG> g_heapAllocations(0);
+static std::atomic<ULONGLONG> g_blocksAllocated(0);
+static std::atomic<ULONGLONG> g_blocksReleased(0);
+static std::atomic<ULONGLONG> g_peakBytes(0);
+static std::atomic<ULONGLONG> g_overruns(0);
+
+static SIZE_T RadiusArenaAlign(SIZE_T cb)
+{
+    return (cb + (RADIUS_ARENA_ALIGN - 1)) & ~(SIZE_T)(RADIUS_ARENA_ALIGN - 1);
+}
+static PRADIUS_ARENA_BLOCK RadiusArenaNewBlock(VOID)
+{
+    BYTE* pBase;
+    PRADIUS_ARENA_BLOCK pBlock;
+#ifdef RADIUS_ARENA_GUARD
+    DWORD dwOld;
+    pBase = (BYTE*)VirtualAlloc(NULL, RADIUS_ARENA_BLOCK_SIZE + RADIUS_ARENA_PAGE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (pBase == NULL)
+    {
+        return NULL;
+    }
+    if (!VirtualProtect(pBase + RADIUS_ARENA_BLOCK_SIZE, RADIUS_ARENA_PAGE, PAGE_NOACCESS, &dwOld))
+    {
+        VirtualFree(pBase, 0, MEM_RELEASE);
+        return NULL;
+    }
+#else
+    pBase = (BYTE*)HeapAlloc(GetProcessHeap(), 0, RADIUS_ARENA_BLOCK_SIZE);
+    if (pBase == NULL)
+    {
+        return NULL;
+    }
+#endif
+    pBlock = (PRADIUS_ARENA_BLOCK)pBase;
+    pBlock->pNext = NULL;
+    pBlock->cbUsed = 0;
+    pBlock->pData = pBase + RadiusArenaAlign(sizeof(RADIUS_ARENA_BLOCK));
+    pBlock->pEnd = pBase + RADIUS_ARENA_BLOCK_SIZE;
+    g_blocksAllocated.fetch_add(1, std::memory_order_relaxed);
+    return pBlock;
+}
+static VOID RadiusArenaFreeBlock(PRADIUS_ARENA_BLOCK pBlock)
+{
+#ifdef RADIUS_ARENA_GUARD
+    VirtualFree(pBlock, 0, MEM_RELEASE);
+#else
+    HeapFree(GetProcessHeap(), 0, pBlock);
+#endif
+    g_blocksReleased.fetch_add(1, std::memory_order_relaxed);
+}
+RadiusArena::~RadiusArena()
+{
+    PRADIUS_ARENA_BLOCK pBlock, pNext;
+    for (pBlock = pFirst; pBlock != NULL; pBlock = pNext)
+    {
+        pNext = pBlock->pNext;
+        RadiusArenaFreeBlock(pBlock);
+    }
+}
+/* Bump allocation from the current block, moving on to the next kept block or
+ * a new one when it is full. Returns NULL if no block could be allocated. */
+static LPVOID RadiusArenaAllocate(RadiusArena* pArena, SIZE_T dwBytes)
+{
+    SIZE_T cbNeeded;
+    BYTE* p;
+    PRADIUS_ARENA_BLOCK pBlock, pNew;
+#ifdef RADIUS_ARENA_GUARD
+    cbNeeded = RadiusArenaAlign(dwBytes + RADIUS_ARENA_CANARY);
+#else
+    cbNeeded = RadiusArenaAlign(dwBytes != 0 ? dwBytes : 1);
+#endif
+    pBlock = pArena->pCurrent;
+    while ((pBlock == NULL) || (pBlock->pData + pBlock->cbUsed + cbNeeded > pBlock->pEnd))
+    {
+        if ((pBlock != NULL) && (pBlock->pNext != NULL))
+        {
+            pBlock = pBlock->pNext;
+            continue;
+        }
+        pNew = RadiusArenaNewBlock();
+        if (pNew == NULL)
+        {
+            return NULL;
+        }
+        if (pBlock == NULL)
+        {
+            pArena->pFirst = pNew;
+        }
+        else
+        {
+            pBlock->pNext = pNew;
+        }
+        pArena->dwBlocks++;
+        pBlock = pNew;
+    }
+    pArena->pCurrent = pBlock;
+    p = pBlock->pData + pBlock->cbUsed;
+    pBlock->cbUsed += cbNeeded;
+    pArena->ullAllocations++;
+    pArena->ullBytes += cbNeeded;
+#ifdef RADIUS_ARENA_GUARD
+    memset(p + dwBytes, RADIUS_ARENA_CANARY_BYTE, cbNeeded - dwBytes);
+    pArena->allocations.push_back(p);
+    pArena->sizes.push_back(dwBytes);
+#endif
+    return p;
+}
+/* Returns TRUE if lpMem lies in one of the calling thread's arena blocks */
+static BOOL RadiusArenaOwns(const RadiusArena* pArena, LPVOID lpMem)
+{
+    PRADIUS_ARENA_BLOCK pBlock;
+    for (pBlock = pArena->pFirst; pBlock != NULL; pBlock = pBlock->pNext)
+    {
+        if (((BYTE*)lpMem >= pBlock->pData) && ((BYTE*)lpMem < pBlock->pEnd))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
 LPVOID WINAPI RadiusAlloc(SIZE_T dwBytes)
 {
+    RadiusArena* pArena = &t_arena;
+    LPVOID p;
+    if ((pArena->dwDepth > 0) && (dwBytes <= RADIUS_ARENA_MAX_ALLOC))
+    {
+        p = RadiusArenaAllocate(pArena, dwBytes);
+        if (p != NULL)
+        {
+            return p;
+        }
+    }
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
     return HeapAlloc(GetProcessHeap(), 0, dwBytes);
 }
 VOID WINAPI RadiusFree(LPVOID lpMem)
 {
+    if (lpMem == NULL)
+    {
+        return;
+    }
+    /* Arena memory is released by RadiusArenaEnd */
+    if (RadiusArenaOwns(&t_arena, lpMem))
+    {
+        return;
+    }
     HeapFree(GetProcessHeap(), 0, lpMem);
 }
+VOID WINAPI RadiusArenaBegin(VOID)
+{
+    t_arena.dwDepth++;
+}
+VOID WINAPI RadiusArenaEnd(VOID)
+{
+    RadiusArena* pArena = &t_arena;
+    PRADIUS_ARENA_BLOCK pBlock, pKeep, pNext;
+    ULONGLONG ullPeak;
+    DWORD dwKept;
+    if ((pArena->dwDepth == 0) || (--pArena->dwDepth > 0))
+    {
+        return;
+    }
+#ifdef RADIUS_ARENA_GUARD
+    {
+        SIZE_T i, j, cbCanary;
+        for (i = 0; i < pArena->allocations.size(); ++i)
+        {
+            BYTE* pCanary = pArena->allocations[i] + pArena->sizes[i];
+            cbCanary = RadiusArenaAlign(pArena->sizes[i] + RADIUS_ARENA_CANARY) - pArena->sizes[i];
+            for (j = 0; j < cbCanary; ++j)
+            {
+                if (pCanary[j] != RADIUS_ARENA_CANARY_BYTE)
+                {
+                    g_overruns.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+        pArena->allocations.clear();
+        pArena->sizes.clear();
+    }
+#endif
+    /* Keep the first RADIUS_ARENA_KEEP_BLOCKS blocks for the next request */
+    dwKept = 0;
+    pKeep = NULL;
+    for (pBlock = pArena->pFirst; pBlock != NULL; pBlock = pNext)
+    {
+        pNext = pBlock->pNext;
+        if (dwKept < RADIUS_ARENA_KEEP_BLOCKS)
+        {
+#ifdef RADIUS_ARENA_GUARD
+            memset(pBlock->pData, RADIUS_ARENA_POISON_BYTE, pBlock->cbUsed);
+#endif
+            pBlock->cbUsed = 0;
+            pKeep = pBlock;
+            dwKept++;
+        }
+        else
+        {
+            pKeep->pNext = NULL;
+            RadiusArenaFreeBlock(pBlock);
+            pArena->dwBlocks--;
+        }
+    }
+    pArena->pCurrent = pArena->pFirst;
+    g_arenaRequests.fetch_add(1, std::memory_order_relaxed);
+    if (pArena->ullAllocations > 0)
+    {
+        g_arenaAllocations.fetch_add(pArena->ullAllocations, std::memory_order_relaxed);
+    }
+    ullPeak = g_peakBytes.load(std::memory_order_relaxed);
+    while ((pArena->ullBytes > ullPeak) &&
+           !g_peakBytes.compare_exchange_weak(ullPeak, pArena->ullBytes, std::memory_order_relaxed))
+    {
+    }
+    pArena->ullAllocations = 0;
+    pArena->ullBytes = 0;
+}
+VOID WINAPI RadiusArenaGetStats(PRADIUS_ARENA_STATS pStats)
+{
+    if (pStats == NULL)
+    {
+        return;
+    }
+    pStats->ullRequests = g_arenaRequests.load(std::memory_order_relaxed);
+    pStats->ullArenaAllocations = g_arenaAllocations.load(std::memory_order_relaxed);
+    pStats->ullHeapAllocations = g_heapAllocations.load(std::memory_order_relaxed);
+    pStats->ullBlocksAllocated = g_blocksAllocated.load(std::memory_order_relaxed);
+    pStats->ullBlocksReleased = g_blocksReleased.load(std::memory_order_relaxed);
+    pStats->ullPeakBytes = g_peakBytes.load(std::memory_order_relaxed);
+    pStats->ullOverruns = g_overruns.load(std::memory_order_relaxed);
+}
+VOID WINAPI RadiusArenaResetStats(VOID)
+{
+    g_arenaRequests.store(0, std::memory_order_relaxed);
+    g_arenaAllocations.store(0, std::memory_order_relaxed);
+    g_heapAllocations.store(0, std::memory_order_relaxed);
+    g_blocksAllocated.store(0, std::memory_order_relaxed);
+    g_blocksReleased.store(0, std::memory_order_relaxed);
+    g_peakBytes.store(0, std::memory_order_relaxed);
+    g_overruns.store(0, std::memory_order_relaxed);
+}
 DWORD WINAPI RadiusFindFirstIndex(PRADIUS_ATTRIBUTE_ARRAY pAttrs,DWORD dwAttrType)
 {
     DWORD dwIndex, dwSize;
@@ -63,4 +346,1034 @@ DWORD WINAPI RadiusReplaceFirstAttribute(PRADIUS_ATTRIBUTE_ARRAY pAttrs,const RA
         /* It doesn't exist, so add it to the end of the array. */
         return pAttrs->Add(pAttrs, pSrc);
     }
-}
\ No newline at end of file
+}
+/* What RadiusApplyEdits does to the attributes of one type */
+typedef struct _RADIUS_EDIT_PLAN
+{
+    DWORD dwAttrType;
+    /* First and last attribute of the type in the array before the edits */
+    DWORD dwFirst;
+    DWORD dwLast;
+    /* The attributes found by the scan are removed */
+    BOOL fRemove;
+    /* New value of the attribute at dwFirst, or NULL to keep it */
+    const RADIUS_ATTRIBUTE* pOverwrite;
+} RADIUS_EDIT_PLAN;
+/* Returns the plan slot of the attribute type or RADIUS_ATTR_NOT_FOUND. */
+static DWORD RadiusEditFindPlan(const RADIUS_EDIT_PLAN* pPlans, DWORD nPlans, DWORD dwAttrType)
+{
+    DWORD dwSlot;
+    for (dwSlot = 0; dwSlot < nPlans; ++dwSlot)
+    {
+        if (pPlans[dwSlot].dwAttrType == dwAttrType)
+        {
+            return dwSlot;
+        }
+    }
+    return RADIUS_ATTR_NOT_FOUND;
+}
+DWORD WINAPI RadiusApplyEdits(PRADIUS_ATTRIBUTE_ARRAY pAttrs, const RADIUS_ATTRIBUTE_EDIT* pEdits, DWORD cEdits)
+{
+    RADIUS_EDIT_PLAN plans[RADIUS_EDIT_MAX_TYPES];
+    /* Appended attributes in order, as edit positions; RADIUS_ATTR_NOT_FOUND
+     * marks one that a later raeRemoveAll dropped again */
+    DWORD appends[RADIUS_EDIT_MAX_EDITS];
+    DWORD appendSlots[RADIUS_EDIT_MAX_EDITS];
+    DWORD nPlans, nAppends, dwEdit, dwSlot, dwIndex, dwSize, dwLow, dwHigh, dwAppend, dwResult;
+    BOOL fScan, fRemove;
+    const RADIUS_ATTRIBUTE* pAttr;
+    if ((pAttrs == NULL) || ((pEdits == NULL) && (cEdits > 0)) || (cEdits > RADIUS_EDIT_MAX_EDITS))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    /* Validate the batch and give every attribute type a plan slot */
+    nPlans = 0;
+    fScan = FALSE;
+    for (dwEdit = 0; dwEdit < cEdits; ++dwEdit)
+    {
+        if ((pEdits[dwEdit].eOperation != raeUpsert) && (pEdits[dwEdit].eOperation != raeAppend) &&
+            (pEdits[dwEdit].eOperation != raeRemoveAll))
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+        if (pEdits[dwEdit].eOperation != raeAppend)
+        {
+            fScan = TRUE;
+        }
+        if (RadiusEditFindPlan(plans, nPlans, pEdits[dwEdit].attr.dwAttrType) == RADIUS_ATTR_NOT_FOUND)
+        {
+            if (nPlans == RADIUS_EDIT_MAX_TYPES)
+            {
+                return ERROR_INVALID_PARAMETER;
+            }
+            plans[nPlans].dwAttrType = pEdits[dwEdit].attr.dwAttrType;
+            plans[nPlans].dwFirst = RADIUS_ATTR_NOT_FOUND;
+            plans[nPlans].dwLast = RADIUS_ATTR_NOT_FOUND;
+            plans[nPlans].fRemove = FALSE;
+            plans[nPlans].pOverwrite = NULL;
+            ++nPlans;
+        }
+    }
+    /* One pass over the array finds the existing attributes of every type.
+     * A batch of appends only does not need it. */
+    dwSize = fScan ? pAttrs->GetSize(pAttrs) : 0;
+    for (dwIndex = 0; dwIndex < dwSize; ++dwIndex)
+    {
+        pAttr = pAttrs->AttributeAt(pAttrs, dwIndex);
+        if (pAttr == NULL)
+        {
+            continue;
+        }
+        dwSlot = RadiusEditFindPlan(plans, nPlans, pAttr->dwAttrType);
+        if (dwSlot != RADIUS_ATTR_NOT_FOUND)
+        {
+            if (plans[dwSlot].dwFirst == RADIUS_ATTR_NOT_FOUND)
+            {
+                plans[dwSlot].dwFirst = dwIndex;
+            }
+            plans[dwSlot].dwLast = dwIndex;
+        }
+    }
+    /* Replay the edits on the plan. An upsert overwrites the first existing
+     * attribute unless a raeRemoveAll dropped them, then the first attribute
+     * appended by this batch, and otherwise appends. */
+    nAppends = 0;
+    for (dwEdit = 0; dwEdit < cEdits; ++dwEdit)
+    {
+        dwSlot = RadiusEditFindPlan(plans, nPlans, pEdits[dwEdit].attr.dwAttrType);
+        switch (pEdits[dwEdit].eOperation)
+        {
+        case raeRemoveAll:
+            plans[dwSlot].fRemove = TRUE;
+            plans[dwSlot].pOverwrite = NULL;
+            for (dwAppend = 0; dwAppend < nAppends; ++dwAppend)
+            {
+                if (appendSlots[dwAppend] == dwSlot)
+                {
+                    appends[dwAppend] = RADIUS_ATTR_NOT_FOUND;
+                }
+            }
+            break;
+        case raeUpsert:
+            if (!plans[dwSlot].fRemove && (plans[dwSlot].dwFirst != RADIUS_ATTR_NOT_FOUND))
+            {
+                plans[dwSlot].pOverwrite = &pEdits[dwEdit].attr;
+                break;
+            }
+            for (dwAppend = 0; dwAppend < nAppends; ++dwAppend)
+            {
+                if ((appendSlots[dwAppend] == dwSlot) && (appends[dwAppend] != RADIUS_ATTR_NOT_FOUND))
+                {
+                    appends[dwAppend] = dwEdit;
+                    break;
+                }
+            }
+            if (dwAppend < nAppends)
+            {
+                break;
+            }
+            /* fall through */
+        default:
+            appends[nAppends] = dwEdit;
+            appendSlots[nAppends] = dwSlot;
+            ++nAppends;
+            break;
+        }
+    }
+    /* Overwrites first: they do not move anything */
+    dwLow = RADIUS_ATTR_NOT_FOUND;
+    dwHigh = 0;
+    fRemove = FALSE;
+    for (dwSlot = 0; dwSlot < nPlans; ++dwSlot)
+    {
+        if (plans[dwSlot].pOverwrite != NULL)
+        {
+            dwResult = pAttrs->SetAt(pAttrs, plans[dwSlot].dwFirst, plans[dwSlot].pOverwrite);
+            if (dwResult != NO_ERROR)
+            {
+                return dwResult;
+            }
+        }
+        if (plans[dwSlot].fRemove && (plans[dwSlot].dwFirst != RADIUS_ATTR_NOT_FOUND))
+        {
+            fRemove = TRUE;
+            if (plans[dwSlot].dwFirst < dwLow)
+            {
+                dwLow = plans[dwSlot].dwFirst;
+            }
+            if (plans[dwSlot].dwLast > dwHigh)
+            {
+                dwHigh = plans[dwSlot].dwLast;
+            }
+        }
+    }
+    /* Removals from the back, so the positions still to visit do not move */
+    if (fRemove)
+    {
+        dwIndex = dwHigh + 1;
+        while (dwIndex-- > dwLow)
+        {
+            pAttr = pAttrs->AttributeAt(pAttrs, dwIndex);
+            if (pAttr == NULL)
+            {
+                continue;
+            }
+            dwSlot = RadiusEditFindPlan(plans, nPlans, pAttr->dwAttrType);
+            if ((dwSlot != RADIUS_ATTR_NOT_FOUND) && plans[dwSlot].fRemove)
+            {
+                dwResult = pAttrs->RemoveAt(pAttrs, dwIndex);
+                if (dwResult != NO_ERROR)
+                {
+                    return dwResult;
+                }
+            }
+        }
+    }
+    for (dwAppend = 0; dwAppend < nAppends; ++dwAppend)
+    {
+        if (appends[dwAppend] != RADIUS_ATTR_NOT_FOUND)
+        {
+            dwResult = pAttrs->Add(pAttrs, &pEdits[appends[dwAppend]].attr);
+            if (dwResult != NO_ERROR)
+            {
+                return dwResult;
+            }
+        }
+    }
+    return NO_ERROR;
+}
+/* Maps an attribute type to its home slot in the index hash table. */
+static DWORD RadiusIndexHash(DWORD dwAttrType)
+{
+    return (dwAttrType * 0x9E3779B1u) >> 25 & (RADIUS_INDEX_SLOTS - 1);
+}
+/* Returns the table entry for the attribute type or NULL if the type is not
+ * present in the array. */
+static PRADIUS_ATTRIBUTE_INDEX_ENTRY RadiusIndexLookup(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwAttrType)
+{
+    DWORD dwSlot, dwProbe;
+    PRADIUS_ATTRIBUTE_INDEX_ENTRY pEntry;
+    dwSlot = RadiusIndexHash(dwAttrType);
+    for (dwProbe = 0; dwProbe < RADIUS_INDEX_SLOTS; ++dwProbe)
+    {
+        pEntry = &pIndex->entries[(dwSlot + dwProbe) & (RADIUS_INDEX_SLOTS - 1)];
+        if (pEntry->dwCount == 0)
+        {
+            return NULL;
+        }
+        if (pEntry->dwAttrType == dwAttrType)
+        {
+            return pEntry;
+        }
+    }
+    return NULL;
+}
+/* Makes sure the index reflects the current array. Returns FALSE if the index
+ * cannot be used and callers must fall back to a linear scan. */
+static BOOL RadiusIndexEnsure(PRADIUS_ATTRIBUTE_INDEX pIndex)
+{
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL))
+    {
+        return FALSE;
+    }
+    if (!pIndex->fValid)
+    {
+        RadiusIndexBuild(pIndex);
+    }
+    return !pIndex->fOverflow;
+}
+VOID WINAPI RadiusIndexInit(PRADIUS_ATTRIBUTE_INDEX pIndex, PRADIUS_ATTRIBUTE_ARRAY pAttrs)
+{
+    if (pIndex == NULL)
+    {
+        return;
+    }
+    pIndex->pAttrs = pAttrs;
+    pIndex->fValid = FALSE;
+    pIndex->fOverflow = FALSE;
+    pIndex->dwSize = 0;
+    pIndex->dwTypes = 0;
+}
+DWORD WINAPI RadiusIndexBuild(PRADIUS_ATTRIBUTE_INDEX pIndex)
+{
+    DWORD dwIndex, dwSize, dwSlot;
+    const RADIUS_ATTRIBUTE* pAttr;
+    PRADIUS_ATTRIBUTE_INDEX_ENTRY pEntry;
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    memset(pIndex->entries, 0, sizeof(pIndex->entries));
+    pIndex->dwTypes = 0;
+    pIndex->fOverflow = FALSE;
+    dwSize = pIndex->pAttrs->GetSize(pIndex->pAttrs);
+    pIndex->dwSize = dwSize;
+    pIndex->fValid = TRUE;
+    if (dwSize > RADIUS_INDEX_MAX_ATTRIBUTES)
+    {
+        pIndex->fOverflow = TRUE;
+        return NO_ERROR;
+    }
+    /* Single pass: cache every attribute pointer and chain attributes of the
+     * same type together through next[]. */
+    for (dwIndex = 0; dwIndex < dwSize; ++dwIndex)
+    {
+        pAttr = pIndex->pAttrs->AttributeAt(pIndex->pAttrs, dwIndex);
+        pIndex->attributes[dwIndex] = pAttr;
+        pIndex->next[dwIndex] = RADIUS_ATTR_NOT_FOUND;
+        if (pAttr == NULL)
+        {
+            continue;
+        }
+        dwSlot = RadiusIndexHash(pAttr->dwAttrType);
+        for (;;)
+        {
+            pEntry = &pIndex->entries[dwSlot];
+            if ((pEntry->dwCount == 0) || (pEntry->dwAttrType == pAttr->dwAttrType))
+            {
+                break;
+            }
+            dwSlot = (dwSlot + 1) & (RADIUS_INDEX_SLOTS - 1);
+        }
+        if (pEntry->dwCount == 0)
+        {
+            /* Keep at least one free slot so that probing always terminates. */
+            if (pIndex->dwTypes == RADIUS_INDEX_SLOTS - 1)
+            {
+                pIndex->fOverflow = TRUE;
+                return NO_ERROR;
+            }
+            pEntry->dwAttrType = pAttr->dwAttrType;
+            pEntry->dwFirst = dwIndex;
+            ++pIndex->dwTypes;
+        }
+        else
+        {
+            pIndex->next[pEntry->dwLast] = dwIndex;
+        }
+        pEntry->dwLast = dwIndex;
+        ++pEntry->dwCount;
+    }
+    return NO_ERROR;
+}
+VOID WINAPI RadiusIndexInvalidate(PRADIUS_ATTRIBUTE_INDEX pIndex)
+{
+    if (pIndex != NULL)
+    {
+        pIndex->fValid = FALSE;
+    }
+}
+DWORD WINAPI RadiusIndexFindFirstIndex(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwAttrType)
+{
+    PRADIUS_ATTRIBUTE_INDEX_ENTRY pEntry;
+    if (!RadiusIndexEnsure(pIndex))
+    {
+        return RadiusFindFirstIndex(pIndex != NULL ? pIndex->pAttrs : NULL, dwAttrType);
+    }
+    pEntry = RadiusIndexLookup(pIndex, dwAttrType);
+    return (pEntry != NULL) ? pEntry->dwFirst : RADIUS_ATTR_NOT_FOUND;
+}
+DWORD WINAPI RadiusIndexFindLastIndex(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwAttrType)
+{
+    DWORD dwIndex, dwLast;
+    const RADIUS_ATTRIBUTE* pAttr;
+    PRADIUS_ATTRIBUTE_INDEX_ENTRY pEntry;
+    if (!RadiusIndexEnsure(pIndex))
+    {
+        if ((pIndex == NULL) || (pIndex->pAttrs == NULL))
+        {
+            return RADIUS_ATTR_NOT_FOUND;
+        }
+        dwLast = RADIUS_ATTR_NOT_FOUND;
+        for (dwIndex = 0; dwIndex < pIndex->dwSize; ++dwIndex)
+        {
+            pAttr = pIndex->pAttrs->AttributeAt(pIndex->pAttrs, dwIndex);
+            if ((pAttr != NULL) && (pAttr->dwAttrType == dwAttrType))
+            {
+                dwLast = dwIndex;
+            }
+        }
+        return dwLast;
+    }
+    pEntry = RadiusIndexLookup(pIndex, dwAttrType);
+    return (pEntry != NULL) ? pEntry->dwLast : RADIUS_ATTR_NOT_FOUND;
+}
+DWORD WINAPI RadiusIndexFindNextIndex(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwIndex)
+{
+    DWORD dwNext, dwAttrType;
+    const RADIUS_ATTRIBUTE* pAttr;
+    if (!RadiusIndexEnsure(pIndex))
+    {
+        if ((pIndex == NULL) || (pIndex->pAttrs == NULL) || (dwIndex >= pIndex->dwSize))
+        {
+            return RADIUS_ATTR_NOT_FOUND;
+        }
+        pAttr = pIndex->pAttrs->AttributeAt(pIndex->pAttrs, dwIndex);
+        if (pAttr == NULL)
+        {
+            return RADIUS_ATTR_NOT_FOUND;
+        }
+        dwAttrType = pAttr->dwAttrType;
+        for (dwNext = dwIndex + 1; dwNext < pIndex->dwSize; ++dwNext)
+        {
+            pAttr = pIndex->pAttrs->AttributeAt(pIndex->pAttrs, dwNext);
+            if ((pAttr != NULL) && (pAttr->dwAttrType == dwAttrType))
+            {
+                return dwNext;
+            }
+        }
+        return RADIUS_ATTR_NOT_FOUND;
+    }
+    if (dwIndex >= pIndex->dwSize)
+    {
+        return RADIUS_ATTR_NOT_FOUND;
+    }
+    return pIndex->next[dwIndex];
+}
+DWORD WINAPI RadiusIndexCount(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwAttrType)
+{
+    DWORD dwIndex, dwCount;
+    PRADIUS_ATTRIBUTE_INDEX_ENTRY pEntry;
+    if (!RadiusIndexEnsure(pIndex))
+    {
+        dwCount = 0;
+        for (dwIndex = RadiusIndexFindFirstIndex(pIndex, dwAttrType);
+             dwIndex != RADIUS_ATTR_NOT_FOUND;
+             dwIndex = RadiusIndexFindNextIndex(pIndex, dwIndex))
+        {
+            ++dwCount;
+        }
+        return dwCount;
+    }
+    pEntry = RadiusIndexLookup(pIndex, dwAttrType);
+    return (pEntry != NULL) ? pEntry->dwCount : 0;
+}
+const RADIUS_ATTRIBUTE* WINAPI RadiusIndexAttributeAt(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwIndex)
+{
+    if (!RadiusIndexEnsure(pIndex))
+    {
+        if ((pIndex == NULL) || (pIndex->pAttrs == NULL) || (dwIndex >= pIndex->dwSize))
+        {
+            return NULL;
+        }
+        return pIndex->pAttrs->AttributeAt(pIndex->pAttrs, dwIndex);
+    }
+    return (dwIndex < pIndex->dwSize) ? pIndex->attributes[dwIndex] : NULL;
+}
+const RADIUS_ATTRIBUTE* WINAPI RadiusIndexFindFirstAttribute(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwAttrType)
+{
+    DWORD dwIndex;
+    dwIndex = RadiusIndexFindFirstIndex(pIndex, dwAttrType);
+    if (dwIndex != RADIUS_ATTR_NOT_FOUND)
+    {
+        return RadiusIndexAttributeAt(pIndex, dwIndex);
+    }
+    else
+    {
+        return NULL;
+    }
+}
+DWORD WINAPI RadiusIndexAdd(PRADIUS_ATTRIBUTE_INDEX pIndex, const RADIUS_ATTRIBUTE* pSrc)
+{
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL) || (pSrc == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    pIndex->fValid = FALSE;
+    return pIndex->pAttrs->Add(pIndex->pAttrs, pSrc);
+}
+DWORD WINAPI RadiusIndexSetAt(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwIndex, const RADIUS_ATTRIBUTE* pSrc)
+{
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL) || (pSrc == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    pIndex->fValid = FALSE;
+    return pIndex->pAttrs->SetAt(pIndex->pAttrs, dwIndex, pSrc);
+}
+DWORD WINAPI RadiusIndexInsertAt(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwIndex, const RADIUS_ATTRIBUTE* pSrc)
+{
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL) || (pSrc == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    pIndex->fValid = FALSE;
+    return pIndex->pAttrs->InsertAt(pIndex->pAttrs, dwIndex, pSrc);
+}
+DWORD WINAPI RadiusIndexRemoveAt(PRADIUS_ATTRIBUTE_INDEX pIndex, DWORD dwIndex)
+{
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    pIndex->fValid = FALSE;
+    return pIndex->pAttrs->RemoveAt(pIndex->pAttrs, dwIndex);
+}
+DWORD WINAPI RadiusIndexReplaceFirstAttribute(PRADIUS_ATTRIBUTE_INDEX pIndex, const RADIUS_ATTRIBUTE* pSrc)
+{
+    DWORD dwIndex;
+    if ((pIndex == NULL) || (pIndex->pAttrs == NULL) || (pSrc == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    dwIndex = RadiusIndexFindFirstIndex(pIndex, pSrc->dwAttrType);
+    if (dwIndex != RADIUS_ATTR_NOT_FOUND)
+    {
+        return RadiusIndexSetAt(pIndex, dwIndex, pSrc);
+    }
+    else
+    {
+        return RadiusIndexAdd(pIndex, pSrc);
+    }
+}
+/* The wanted attribute types of a batched lookup, packed four per vector so
+ * that one attribute type is compared against the whole set at once. */
+typedef struct _RADIUS_TYPE_SET
+{
+#ifdef RADIUS_USE_SSE2
+    __m128i lanes[RADIUS_FIND_MAX_TYPES / 4];
+#endif
+    DWORD types[RADIUS_FIND_MAX_TYPES];
+    DWORD nTypes;
+    DWORD nVectors;
+    DWORD dwValidMask;
+} RADIUS_TYPE_SET;
+static VOID RadiusTypeSetInit(RADIUS_TYPE_SET* pSet, const DWORD* pTypes, DWORD nTypes)
+{
+    DWORD i;
+    for (i = 0; i < RADIUS_FIND_MAX_TYPES; ++i)
+    {
+        pSet->types[i] = (i < nTypes) ? pTypes[i] : 0;
+    }
+    pSet->nTypes = nTypes;
+    pSet->nVectors = (nTypes + 3) / 4;
+    pSet->dwValidMask = (1u << nTypes) - 1;
+#ifdef RADIUS_USE_SSE2
+    for (i = 0; i < pSet->nVectors; ++i)
+    {
+        pSet->lanes[i] = _mm_loadu_si128((const __m128i*)&pSet->types[i * 4]);
+    }
+#endif
+}
+/* Returns a bit mask with bit i set if dwAttrType equals the i-th wanted type. */
+static DWORD RadiusTypeSetMatch(const RADIUS_TYPE_SET* pSet, DWORD dwAttrType)
+{
+    DWORD i, dwMask;
+    dwMask = 0;
+#ifdef RADIUS_USE_SSE2
+    __m128i probe = _mm_set1_epi32((int)dwAttrType);
+    for (i = 0; i < pSet->nVectors; ++i)
+    {
+        dwMask |= (DWORD)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(probe, pSet->lanes[i]))) << (i * 4);
+    }
+#else
+    for (i = 0; i < pSet->nTypes; ++i)
+    {
+        if (pSet->types[i] == dwAttrType)
+        {
+            dwMask |= 1u << i;
+        }
+    }
+#endif
+    /* Padding lanes hold zero and must not match attribute type 0. */
+    return dwMask & pSet->dwValidMask;
+}
+/* Returns the position of the lowest set bit; dwMask must not be zero. */
+static DWORD RadiusLowestBit(DWORD dwMask)
+{
+    DWORD dwBit;
+    dwBit = 0;
+    while ((dwMask & 1) == 0)
+    {
+        dwMask >>= 1;
+        ++dwBit;
+    }
+    return dwBit;
+}
+DWORD WINAPI RadiusFindAttributes(PRADIUS_ATTRIBUTE_ARRAY pAttrs, const DWORD* pTypes, DWORD nTypes, const RADIUS_ATTRIBUTE** ppOut)
+{
+    DWORD dwIndex, dwSize, dwMask, dwPending, dwSlot, i;
+    const RADIUS_ATTRIBUTE* pAttr;
+    RADIUS_TYPE_SET set;
+    if ((pTypes == NULL) || (ppOut == NULL) || (nTypes > RADIUS_FIND_MAX_TYPES))
+    {
+        return RADIUS_ATTR_NOT_FOUND;
+    }
+    for (i = 0; i < nTypes; ++i)
+    {
+        ppOut[i] = NULL;
+    }
+    if ((pAttrs == NULL) || (nTypes == 0))
+    {
+        return 0;
+    }
+    RadiusTypeSetInit(&set, pTypes, nTypes);
+    /* Types that have not been found yet; the walk stops once all are. */
+    dwPending = set.dwValidMask;
+    dwSize = pAttrs->GetSize(pAttrs);
+    for (dwIndex = 0; (dwIndex < dwSize) && (dwPending != 0); ++dwIndex)
+    {
+        pAttr = pAttrs->AttributeAt(pAttrs, dwIndex);
+        if (pAttr == NULL)
+        {
+            continue;
+        }
+        dwMask = RadiusTypeSetMatch(&set, pAttr->dwAttrType) & dwPending;
+        /* The same type may be listed more than once in pTypes. */
+        while (dwMask != 0)
+        {
+            dwSlot = RadiusLowestBit(dwMask);
+            ppOut[dwSlot] = pAttr;
+            dwMask &= dwMask - 1;
+            dwPending &= ~(1u << dwSlot);
+        }
+    }
+    dwMask = set.dwValidMask & ~dwPending;
+    for (i = 0; dwMask != 0; dwMask &= dwMask - 1)
+    {
+        ++i;
+    }
+    return i;
+}
+DWORD WINAPI RadiusFindAllAttributes(PRADIUS_ATTRIBUTE_ARRAY pAttrs, const DWORD* pTypes, DWORD nTypes, PRADIUS_ATTRIBUTE_MATCH pMatches, DWORD cMatches, DWORD* pcFound)
+{
+    DWORD dwIndex, dwSize, dwMask, dwFound;
+    const RADIUS_ATTRIBUTE* pAttr;
+    RADIUS_TYPE_SET set;
+    if ((pTypes == NULL) || (pcFound == NULL) || (nTypes > RADIUS_FIND_MAX_TYPES) || ((pMatches == NULL) && (cMatches != 0)))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    *pcFound = 0;
+    if ((pAttrs == NULL) || (nTypes == 0))
+    {
+        return NO_ERROR;
+    }
+    RadiusTypeSetInit(&set, pTypes, nTypes);
+    dwFound = 0;
+    dwSize = pAttrs->GetSize(pAttrs);
+    for (dwIndex = 0; dwIndex < dwSize; ++dwIndex)
+    {
+        pAttr = pAttrs->AttributeAt(pAttrs, dwIndex);
+        if (pAttr == NULL)
+        {
+            continue;
+        }
+        dwMask = RadiusTypeSetMatch(&set, pAttr->dwAttrType);
+        if (dwMask == 0)
+        {
+            continue;
+        }
+        /* An attribute is reported once, against the first slot of its type. */
+        if (dwFound < cMatches)
+        {
+            pMatches[dwFound].dwTypeSlot = RadiusLowestBit(dwMask);
+            pMatches[dwFound].dwIndex = dwIndex;
+            pMatches[dwFound].pAttr = pAttr;
+        }
+        ++dwFound;
+    }
+    *pcFound = dwFound;
+    return (dwFound > cMatches) ? ERROR_MORE_DATA : NO_ERROR;
+}
+BOOL WINAPI RadiusIsMfaCandidate(const RADIUS_EXTENSION_CONTROL_BLOCK* pECB)
+{
+    if (pECB == NULL)
+    {
+        return FALSE;
+    }
+    return (pECB->repPoint == repAuthorization) &&
+           (pECB->rcRequestType == rcAccessRequest) &&
+           (pECB->rcResponseType == rcAccessAccept);
+}
+static BOOL RadiusViewIsBlank(BYTE b)
+{
+    return (b == ' ') || ((b >= '\t') && (b <= '\r'));
+}
+static BOOL RadiusViewIsText(const RADIUS_VALUE_VIEW* pView)
+{
+    return (pView != NULL) && ((pView->fDataType == rdtString) || (pView->fDataType == rdtUnknown));
+}
+BOOL WINAPI RadiusViewInit(const RADIUS_ATTRIBUTE* pAttr, PRADIUS_VALUE_VIEW pView)
+{
+    const BYTE* pb;
+    DWORD cb;
+    if ((pAttr == NULL) || (pView == NULL))
+    {
+        return FALSE;
+    }
+    pView->dwAttrType = pAttr->dwAttrType;
+    pView->fDataType = pAttr->fDataType;
+    pView->pbData = NULL;
+    pView->cbData = 0;
+    pView->dwValue = 0;
+    switch (pAttr->fDataType)
+    {
+    case rdtAddress:
+    case rdtInteger:
+    case rdtTime:
+        pView->dwValue = pAttr->dwValue;
+        return TRUE;
+    case rdtIpv6Address:
+        pView->pbData = pAttr->lpValue;
+        pView->cbData = (pAttr->lpValue != NULL) ? pAttr->cbDataLength : 0;
+        return TRUE;
+    default:
+        break;
+    }
+    pb = pAttr->lpValue;
+    cb = (pb != NULL) ? pAttr->cbDataLength : 0;
+    if ((cb > 0) && (pb[cb - 1] == 0))
+    {
+        cb--;
+    }
+    else
+    {
+        while ((cb > 0) && RadiusViewIsBlank(pb[cb - 1]))
+        {
+            cb--;
+        }
+        while ((cb > 0) && RadiusViewIsBlank(pb[0]))
+        {
+            pb++;
+            cb--;
+        }
+    }
+    pView->pbData = pb;
+    pView->cbData = cb;
+    return TRUE;
+}
+BOOL WINAPI RadiusViewGetInteger(const RADIUS_VALUE_VIEW* pView, DWORD* pdwValue)
+{
+    if ((pView == NULL) || (pdwValue == NULL) || (pView->fDataType != rdtInteger))
+    {
+        return FALSE;
+    }
+    *pdwValue = pView->dwValue;
+    return TRUE;
+}
+BOOL WINAPI RadiusViewGetIpv4(const RADIUS_VALUE_VIEW* pView, DWORD* pdwAddress)
+{
+    if ((pView == NULL) || (pdwAddress == NULL) || (pView->fDataType != rdtAddress))
+    {
+        return FALSE;
+    }
+    *pdwAddress = pView->dwValue;
+    return TRUE;
+}
+BOOL WINAPI RadiusViewGetIpv6(const RADIUS_VALUE_VIEW* pView, BYTE pbAddress[16])
+{
+    if ((pView == NULL) || (pbAddress == NULL) || (pView->fDataType != rdtIpv6Address) ||
+        (pView->cbData != 16))
+    {
+        return FALSE;
+    }
+    memcpy(pbAddress, pView->pbData, 16);
+    return TRUE;
+}
+BOOL WINAPI RadiusViewGetTime(const RADIUS_VALUE_VIEW* pView, DWORD* pdwValue)
+{
+    if ((pView == NULL) || (pdwValue == NULL) || (pView->fDataType != rdtTime))
+    {
+        return FALSE;
+    }
+    *pdwValue = pView->dwValue;
+    return TRUE;
+}
+BOOL WINAPI RadiusViewEquals(const RADIUS_VALUE_VIEW* pView, const char* pszValue, DWORD cchValue, BOOL fIgnoreCase)
+{
+    DWORD i;
+    BYTE a, b;
+    if (!RadiusViewIsText(pView) || ((pszValue == NULL) && (cchValue > 0)))
+    {
+        return FALSE;
+    }
+    if (pView->cbData != cchValue)
+    {
+        return FALSE;
+    }
+    if (!fIgnoreCase)
+    {
+        return (cchValue == 0) || (memcmp(pView->pbData, pszValue, cchValue) == 0);
+    }
+    for (i = 0; i < cchValue; i++)
+    {
+        a = pView->pbData[i];
+        b = (BYTE)pszValue[i];
+        if (a == b)
+        {
+            continue;
+        }
+        /* Same letter in the other case: equal once bit 0x20 is set */
+        if (((a | 0x20) != (b | 0x20)) || ((a | 0x20) < 'a') || ((a | 0x20) > 'z'))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+DWORD WINAPI RadiusViewCopyString(const RADIUS_VALUE_VIEW* pView, char* pszBuffer, DWORD cchBuffer)
+{
+    if (!RadiusViewIsText(pView) || (pszBuffer == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (pView->cbData >= cchBuffer)
+    {
+        return ERROR_MORE_DATA;
+    }
+    if (pView->cbData > 0)
+    {
+        memcpy(pszBuffer, pView->pbData, pView->cbData);
+    }
+    pszBuffer[pView->cbData] = '\0';
+    return NO_ERROR;
+}
+/* Returns TRUE if the sub-attributes fill the value exactly. */
+static BOOL RadiusVsaIsWellFormed(const BYTE* pbData, DWORD cbData)
+{
+    const BYTE* pbEnd = pbData + cbData;
+    while (pbData < pbEnd)
+    {
+        if ((pbEnd - pbData < 2) || (pbData[1] < 2) || (pbData[1] > pbEnd - pbData))
+        {
+            return FALSE;
+        }
+        pbData += pbData[1];
+    }
+    return TRUE;
+}
+VOID WINAPI RadiusVsaIterInit(PRADIUS_VSA_ITERATOR pIter, PRADIUS_ATTRIBUTE_ARRAY pAttrs)
+{
+    if (pIter == NULL)
+    {
+        return;
+    }
+    pIter->pAttrs = pAttrs;
+    pIter->dwSize = (pAttrs != NULL) ? pAttrs->GetSize(pAttrs) : 0;
+    pIter->dwNextAttr = 0;
+    pIter->dwAttrIndex = RADIUS_ATTR_NOT_FOUND;
+    pIter->dwVendorId = 0;
+    pIter->pbNext = NULL;
+    pIter->pbEnd = NULL;
+}
+BOOL WINAPI RadiusVsaIterNext(PRADIUS_VSA_ITERATOR pIter, PRADIUS_VSA_VIEW pVsa)
+{
+    const RADIUS_ATTRIBUTE* pAttr;
+    const BYTE* pbValue;
+    if ((pIter == NULL) || (pVsa == NULL))
+    {
+        return FALSE;
+    }
+    for (;;)
+    {
+        if (pIter->pbNext < pIter->pbEnd)
+        {
+            /* The attribute was checked as a whole when the walk entered it */
+            pVsa->dwVendorId = pIter->dwVendorId;
+            pVsa->bVendorType = pIter->pbNext[0];
+            pVsa->pbData = pIter->pbNext + 2;
+            pVsa->cbData = pIter->pbNext[1] - 2;
+            pVsa->dwAttrIndex = pIter->dwAttrIndex;
+            pIter->pbNext += pIter->pbNext[1];
+            return TRUE;
+        }
+        if (pIter->dwNextAttr >= pIter->dwSize)
+        {
+            return FALSE;
+        }
+        pIter->dwAttrIndex = pIter->dwNextAttr++;
+        pAttr = pIter->pAttrs->AttributeAt(pIter->pAttrs, pIter->dwAttrIndex);
+        if ((pAttr == NULL) || (pAttr->dwAttrType != RADIUS_VSA_ATTRIBUTE_TYPE) ||
+            (pAttr->fDataType != rdtString && pAttr->fDataType != rdtUnknown) ||
+            (pAttr->lpValue == NULL) || (pAttr->cbDataLength < 4 + 2))
+        {
+            continue;
+        }
+        pbValue = pAttr->lpValue;
+        if (!RadiusVsaIsWellFormed(pbValue + 4, pAttr->cbDataLength - 4))
+        {
+            continue;
+        }
+        pIter->dwVendorId = ((DWORD)pbValue[0] << 24) | ((DWORD)pbValue[1] << 16) | ((DWORD)pbValue[2] << 8) | pbValue[3];
+        pIter->pbNext = pbValue + 4;
+        pIter->pbEnd = pbValue + pAttr->cbDataLength;
+    }
+}
+BOOL WINAPI RadiusFindVsa(PRADIUS_ATTRIBUTE_ARRAY pAttrs, DWORD dwVendorId, BYTE bVendorType, PRADIUS_VSA_VIEW pVsa)
+{
+    RADIUS_VSA_ITERATOR iter;
+    if ((pAttrs == NULL) || (pVsa == NULL))
+    {
+        return FALSE;
+    }
+    RadiusVsaIterInit(&iter, pAttrs);
+    while (RadiusVsaIterNext(&iter, pVsa))
+    {
+        if ((pVsa->dwVendorId == dwVendorId) && (pVsa->bVendorType == bVendorType))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+/* Maps a (vendor ID, vendor type) key to its home slot in a VSA index. */
+static DWORD RadiusVsaIndexHash(DWORD dwVendorId, BYTE bVendorType)
+{
+    return ((dwVendorId * 0x9E3779B1u) ^ (bVendorType * 0x85EBCA6Bu)) >> 25 & (RADIUS_VSA_INDEX_SLOTS - 1);
+}
+/* Returns the entry of the key, or the free slot where it belongs. The index
+ * holds fewer keys than slots, so probing always ends. */
+static PRADIUS_VSA_INDEX_ENTRY RadiusVsaIndexSlot(const RADIUS_VSA_INDEX* pIndex, DWORD dwVendorId, BYTE bVendorType)
+{
+    DWORD dwSlot;
+    const RADIUS_VSA_INDEX_ENTRY* pEntry;
+    dwSlot = RadiusVsaIndexHash(dwVendorId, bVendorType);
+    for (;;)
+    {
+        pEntry = &pIndex->entries[dwSlot];
+        if ((pEntry->dwCount == 0) || ((pEntry->dwVendorId == dwVendorId) && (pEntry->bVendorType == bVendorType)))
+        {
+            return (PRADIUS_VSA_INDEX_ENTRY)pEntry;
+        }
+        dwSlot = (dwSlot + 1) & (RADIUS_VSA_INDEX_SLOTS - 1);
+    }
+}
+DWORD WINAPI RadiusVsaIndexBuild(PRADIUS_VSA_INDEX pIndex, PRADIUS_ATTRIBUTE_ARRAY pAttrs)
+{
+    RADIUS_VSA_ITERATOR iter;
+    RADIUS_VSA_VIEW vsa;
+    PRADIUS_VSA_INDEX_ENTRY pEntry;
+    if ((pIndex == NULL) || (pAttrs == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    memset(pIndex->entries, 0, sizeof(pIndex->entries));
+    pIndex->dwCount = 0;
+    RadiusVsaIterInit(&iter, pAttrs);
+    while (RadiusVsaIterNext(&iter, &vsa))
+    {
+        if (pIndex->dwCount == RADIUS_VSA_INDEX_MAX)
+        {
+            return ERROR_MORE_DATA;
+        }
+        pIndex->vsas[pIndex->dwCount] = vsa;
+        pIndex->next[pIndex->dwCount] = RADIUS_ATTR_NOT_FOUND;
+        pEntry = RadiusVsaIndexSlot(pIndex, vsa.dwVendorId, vsa.bVendorType);
+        if (pEntry->dwCount == 0)
+        {
+            pEntry->dwVendorId = vsa.dwVendorId;
+            pEntry->bVendorType = vsa.bVendorType;
+            pEntry->dwFirst = pIndex->dwCount;
+        }
+        else
+        {
+            pIndex->next[pEntry->dwLast] = pIndex->dwCount;
+        }
+        pEntry->dwLast = pIndex->dwCount;
+        ++pEntry->dwCount;
+        ++pIndex->dwCount;
+    }
+    return NO_ERROR;
+}
+const RADIUS_VSA_VIEW* WINAPI RadiusVsaIndexFind(const RADIUS_VSA_INDEX* pIndex, DWORD dwVendorId, BYTE bVendorType)
+{
+    const RADIUS_VSA_INDEX_ENTRY* pEntry;
+    if (pIndex == NULL)
+    {
+        return NULL;
+    }
+    pEntry = RadiusVsaIndexSlot(pIndex, dwVendorId, bVendorType);
+    return (pEntry->dwCount > 0) ? &pIndex->vsas[pEntry->dwFirst] : NULL;
+}
+const RADIUS_VSA_VIEW* WINAPI RadiusVsaIndexFindNext(const RADIUS_VSA_INDEX* pIndex, const RADIUS_VSA_VIEW* pVsa)
+{
+    DWORD dwPosition;
+    if ((pIndex == NULL) || (pVsa < pIndex->vsas) || (pVsa >= pIndex->vsas + pIndex->dwCount))
+    {
+        return NULL;
+    }
+    dwPosition = (DWORD)(pVsa - pIndex->vsas);
+    return (pIndex->next[dwPosition] != RADIUS_ATTR_NOT_FOUND) ? &pIndex->vsas[pIndex->next[dwPosition]] : NULL;
+}
+DWORD WINAPI RadiusVsaIndexCount(const RADIUS_VSA_INDEX* pIndex, DWORD dwVendorId, BYTE bVendorType)
+{
+    if (pIndex == NULL)
+    {
+        return 0;
+    }
+    return RadiusVsaIndexSlot(pIndex, dwVendorId, bVendorType)->dwCount;
+}
+VOID WINAPI RadiusVsaBuilderInit(PRADIUS_VSA_BUILDER pBuilder, PRADIUS_ATTRIBUTE_ARRAY pAttrs)
+{
+    if (pBuilder == NULL)
+    {
+        return;
+    }
+    pBuilder->pAttrs = pAttrs;
+    pBuilder->dwVendorId = 0;
+    pBuilder->cbUsed = 0;
+    pBuilder->dwAttributes = 0;
+}
+DWORD WINAPI RadiusVsaBuilderAdd(PRADIUS_VSA_BUILDER pBuilder, DWORD dwVendorId, BYTE bVendorType, const BYTE* pbData, DWORD cbData)
+{
+    DWORD dwResult;
+    if ((pBuilder == NULL) || (pBuilder->pAttrs == NULL) || (cbData > RADIUS_VSA_MAX_DATA) ||
+        ((pbData == NULL) && (cbData > 0)))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    /* Next fit: with the order kept, closing an attribute only when the next
+     * sub-attribute does not fit gives the fewest attributes. */
+    if ((pBuilder->cbUsed > 0) &&
+        ((pBuilder->dwVendorId != dwVendorId) || (pBuilder->cbUsed + 2 + cbData > RADIUS_VSA_MAX_VALUE)))
+    {
+        dwResult = RadiusVsaBuilderFlush(pBuilder);
+        if (dwResult != NO_ERROR)
+        {
+            return dwResult;
+        }
+    }
+    if (pBuilder->cbUsed == 0)
+    {
+        pBuilder->dwVendorId = dwVendorId;
+        pBuilder->value[0] = (BYTE)(dwVendorId >> 24);
+        pBuilder->value[1] = (BYTE)(dwVendorId >> 16);
+        pBuilder->value[2] = (BYTE)(dwVendorId >> 8);
+        pBuilder->value[3] = (BYTE)dwVendorId;
+        pBuilder->cbUsed = 4;
+    }
+    pBuilder->value[pBuilder->cbUsed] = bVendorType;
+    pBuilder->value[pBuilder->cbUsed + 1] = (BYTE)(cbData + 2);
+    if (cbData > 0)
+    {
+        memcpy(pBuilder->value + pBuilder->cbUsed + 2, pbData, cbData);
+    }
+    pBuilder->cbUsed += 2 + cbData;
+    return NO_ERROR;
+}
+DWORD WINAPI RadiusVsaBuilderFlush(PRADIUS_VSA_BUILDER pBuilder)
+{
+    RADIUS_ATTRIBUTE attr;
+    DWORD dwResult;
+    if ((pBuilder == NULL) || (pBuilder->pAttrs == NULL))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (pBuilder->cbUsed == 0)
+    {
+        return NO_ERROR;
+    }
+    attr.dwAttrType = RADIUS_VSA_ATTRIBUTE_TYPE;
+    attr.fDataType = rdtString;
+    attr.cbDataLength = pBuilder->cbUsed;
+    attr.lpValue = pBuilder->value;
+    /* NPS copies the value, so the buffer can be reused right away */
+    dwResult = pBuilder->pAttrs->Add(pBuilder->pAttrs, &attr);
+    pBuilder->cbUsed = 0;
+    if (dwResult == NO_ERROR)
+    {
+        ++pBuilder->dwAttributes;
+    }
+    return dwResult;
+}
@@ -21,6 +21,70 @@ extern "C" {
             LPVOID lpMem
         );
 
+    /* Between RadiusArenaBegin and RadiusArenaEnd, RadiusAlloc serves blocks of
+     * up to RADIUS_ARENA_MAX_ALLOC bytes from a bump arena owned by the calling
+     * thread, and RadiusFree ignores them; RadiusArenaEnd releases all of them
+     * in one step. The arena keeps its memory for the next request, so a warm
+     * thread allocates nothing from the process heap. Larger blocks, and all
+     * blocks outside a request, come from the process heap as before.
+     * Arena memory must be freed, if at all, on the thread that allocated it
+     * and must not be used after RadiusArenaEnd.
+     *
+     * Builds with RADIUS_ARENA_GUARD (the default for _DEBUG) put a no-access
+     * page behind every arena block, a canary behind every allocation that is
+     * checked by RadiusArenaEnd, and fill released memory with 0xDD. */
+#define RADIUS_ARENA_BLOCK_SIZE (64 * 1024)
+#define RADIUS_ARENA_MAX_ALLOC (8 * 1024)
+    /* Blocks a thread keeps across requests; blocks beyond are returned */
+#define RADIUS_ARENA_KEEP_BLOCKS 4
+
+#if !defined(RADIUS_ARENA_GUARD) && defined(_DEBUG)
+#define RADIUS_ARENA_GUARD 1
+#endif
+
+    typedef struct _RADIUS_ARENA_STATS
+    {
+        /* Arena scopes ended by RadiusArenaEnd */
+        ULONGLONG ullRequests;
+        ULONGLONG ullArenaAllocations;
+        /* Oversize blocks and blocks requested outside an arena scope */
+        ULONGLONG ullHeapAllocations;
+        /* Arena blocks taken from and given back to the system */
+        ULONGLONG ullBlocksAllocated;
+        ULONGLONG ullBlocksReleased;
+        /* Most arena bytes used by a single request */
+        ULONGLONG ullPeakBytes;
+        /* Damaged canaries found by RadiusArenaEnd (guard builds only) */
+        ULONGLONG ullOverruns;
+    } RADIUS_ARENA_STATS, *PRADIUS_ARENA_STATS;
+
+    /* Starts an arena scope on the calling thread. Scopes nest; only the
+     * outermost RadiusArenaEnd releases the memory. */
+    VOID
+        WINAPI
+        RadiusArenaBegin(
+            VOID
+        );
+
+    VOID
+        WINAPI
+        RadiusArenaEnd(
+            VOID
+        );
+
+    /* Totals over all threads */
+    VOID
+        WINAPI
+        RadiusArenaGetStats(
+            PRADIUS_ARENA_STATS pStats
+        );
+
+    VOID
+        WINAPI
+        RadiusArenaResetStats(
+            VOID
+        );
+
 #define RADIUS_ATTR_NOT_FOUND ((DWORD)-1)
 
     /* Returns the index of the first attribute with the desired type or
@@ -50,6 +114,507 @@ extern "C" {
             const RADIUS_ATTRIBUTE* pSrc
         );
 
+    /* Operations of a batched edit, see RadiusApplyEdits. */
+    typedef enum _RADIUS_EDIT_OPERATION
+    {
+        /* Overwrites the first attribute of the type or appends the attribute
+         * if there is none, like RadiusReplaceFirstAttribute. */
+        raeUpsert = 0,
+        /* Appends the attribute, e.g. another Class or Vendor-Specific. */
+        raeAppend,
+        /* Removes every attribute of the type; only attr.dwAttrType is used. */
+        raeRemoveAll
+    } RADIUS_EDIT_OPERATION;
+
+    typedef struct _RADIUS_ATTRIBUTE_EDIT
+    {
+        RADIUS_EDIT_OPERATION eOperation;
+        RADIUS_ATTRIBUTE attr;
+    } RADIUS_ATTRIBUTE_EDIT, *PRADIUS_ATTRIBUTE_EDIT;
+
+    /* Largest batch accepted by RadiusApplyEdits and the number of distinct
+     * attribute types its edits may touch. */
+#define RADIUS_EDIT_MAX_EDITS 64
+#define RADIUS_EDIT_MAX_TYPES 16
+
+    /* Applies cEdits edits with the same result as applying them one after
+     * the other, but plans them first with a single pass over the array: each
+     * surviving attribute is written at most once with SetAt, removals run
+     * once from the back of the array, and new attributes are appended last.
+     * Invalid batches (NULL pointers, unknown operations, too many edits or
+     * types) are rejected with ERROR_INVALID_PARAMETER before the array is
+     * touched. Otherwise returns NO_ERROR or the first error returned by NPS.
+     * The array is changed in three phases whatever the order of the edits:
+     * overwrites, then removals, then appends. On an error the phases before
+     * the failing one are already applied and the failing phase may be
+     * partly applied, e.g. a failed SetAt leaves earlier overwrites in place
+     * but skips every removal and append of the batch, and a failed Add
+     * comes after all overwrites and removals. An attribute index over the
+     * array must be invalidated afterwards, also after an error. */
+    DWORD
+        WINAPI
+        RadiusApplyEdits(
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs,
+            const RADIUS_ATTRIBUTE_EDIT* pEdits,
+            DWORD cEdits
+        );
+
+    /* Number of hash slots in an attribute index. Must be a power of two and
+     * bounds the number of distinct attribute types that can be indexed. */
+#define RADIUS_INDEX_SLOTS 128
+
+    /* Largest attribute array that can be indexed. Larger arrays are still
+     * handled, but lookups fall back to the linear scan functions above. */
+#define RADIUS_INDEX_MAX_ATTRIBUTES 512
+
+    /* Position of the first and last attribute of one type and the number of
+     * attributes of that type. */
+    typedef struct _RADIUS_ATTRIBUTE_INDEX_ENTRY
+    {
+        DWORD dwAttrType;
+        DWORD dwFirst;
+        DWORD dwLast;
+        DWORD dwCount;
+    } RADIUS_ATTRIBUTE_INDEX_ENTRY, *PRADIUS_ATTRIBUTE_INDEX_ENTRY;
+
+    /* Per-request index over a RADIUS_ATTRIBUTE_ARRAY, built in a single pass
+     * over the array. The index caches the attribute pointers returned by
+     * AttributeAt, so any change to the array must either go through the
+     * RadiusIndexAdd/SetAt/InsertAt/RemoveAt functions below or be followed
+     * by a call to RadiusIndexInvalidate. The structure is self-contained and
+     * can live on the stack; initialize it with RadiusIndexInit. */
+    typedef struct _RADIUS_ATTRIBUTE_INDEX
+    {
+        PRADIUS_ATTRIBUTE_ARRAY pAttrs;
+        BOOL fValid;
+        BOOL fOverflow;
+        DWORD dwSize;
+        DWORD dwTypes;
+        RADIUS_ATTRIBUTE_INDEX_ENTRY entries[RADIUS_INDEX_SLOTS];
+        const RADIUS_ATTRIBUTE* attributes[RADIUS_INDEX_MAX_ATTRIBUTES];
+        /* Index of the next attribute of the same type, or
+         * RADIUS_ATTR_NOT_FOUND for the last one. */
+        DWORD next[RADIUS_INDEX_MAX_ATTRIBUTES];
+    } RADIUS_ATTRIBUTE_INDEX, *PRADIUS_ATTRIBUTE_INDEX;
+
+    /* Binds the index to an attribute array. The index itself is built lazily
+     * on the first lookup. */
+    VOID
+        WINAPI
+        RadiusIndexInit(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs
+        );
+
+    /* Rebuilds the index with one pass over the attribute array. */
+    DWORD
+        WINAPI
+        RadiusIndexBuild(
+            PRADIUS_ATTRIBUTE_INDEX pIndex
+        );
+
+    /* Marks the index as stale, so the next lookup rebuilds it. */
+    VOID
+        WINAPI
+        RadiusIndexInvalidate(
+            PRADIUS_ATTRIBUTE_INDEX pIndex
+        );
+
+    /* Returns the index of the first attribute with the desired type or
+     * RADIUS_ATTR_NOT_FOUND if no such attribute exists. */
+    DWORD
+        WINAPI
+        RadiusIndexFindFirstIndex(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwAttrType
+        );
+
+    /* Returns the index of the last attribute with the desired type or
+     * RADIUS_ATTR_NOT_FOUND if no such attribute exists. */
+    DWORD
+        WINAPI
+        RadiusIndexFindLastIndex(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwAttrType
+        );
+
+    /* Returns the index of the next attribute with the same type as the one at
+     * dwIndex or RADIUS_ATTR_NOT_FOUND if it is the last one. */
+    DWORD
+        WINAPI
+        RadiusIndexFindNextIndex(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwIndex
+        );
+
+    /* Returns the number of attributes with the desired type. */
+    DWORD
+        WINAPI
+        RadiusIndexCount(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwAttrType
+        );
+
+    /* Returns the attribute at the given position of the indexed array. */
+    const RADIUS_ATTRIBUTE*
+        WINAPI
+        RadiusIndexAttributeAt(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwIndex
+        );
+
+    /* Returns the first attribute with the desired type or NULL if no such
+     * attribute exists. */
+    const RADIUS_ATTRIBUTE*
+        WINAPI
+        RadiusIndexFindFirstAttribute(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwAttrType
+        );
+
+    /* Wrappers around the RADIUS_ATTRIBUTE_ARRAY mutators that keep the index
+     * consistent with the array. */
+    DWORD
+        WINAPI
+        RadiusIndexAdd(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            const RADIUS_ATTRIBUTE* pSrc
+        );
+
+    DWORD
+        WINAPI
+        RadiusIndexSetAt(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwIndex,
+            const RADIUS_ATTRIBUTE* pSrc
+        );
+
+    DWORD
+        WINAPI
+        RadiusIndexInsertAt(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwIndex,
+            const RADIUS_ATTRIBUTE* pSrc
+        );
+
+    DWORD
+        WINAPI
+        RadiusIndexRemoveAt(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            DWORD dwIndex
+        );
+
+    /* Same as RadiusReplaceFirstAttribute, but uses the index to locate the
+     * attribute to replace. */
+    DWORD
+        WINAPI
+        RadiusIndexReplaceFirstAttribute(
+            PRADIUS_ATTRIBUTE_INDEX pIndex,
+            const RADIUS_ATTRIBUTE* pSrc
+        );
+
+    /* Maximum number of attribute types that can be resolved by a single
+     * RadiusFindAttributes/RadiusFindAllAttributes call. */
+#define RADIUS_FIND_MAX_TYPES 16
+
+    /* One attribute matched by RadiusFindAllAttributes. */
+    typedef struct _RADIUS_ATTRIBUTE_MATCH
+    {
+        /* Position of the matched type in the pTypes array. */
+        DWORD dwTypeSlot;
+        /* Position of the attribute in the attribute array. */
+        DWORD dwIndex;
+        const RADIUS_ATTRIBUTE* pAttr;
+    } RADIUS_ATTRIBUTE_MATCH, *PRADIUS_ATTRIBUTE_MATCH;
+
+    /* Resolves up to RADIUS_FIND_MAX_TYPES attribute types with a single pass
+     * over the array. ppOut must have room for nTypes entries; each entry
+     * receives the first attribute of the corresponding type or NULL. Returns
+     * the number of types that were found, or RADIUS_ATTR_NOT_FOUND if the
+     * parameters are invalid. */
+    DWORD
+        WINAPI
+        RadiusFindAttributes(
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs,
+            const DWORD* pTypes,
+            DWORD nTypes,
+            const RADIUS_ATTRIBUTE** ppOut
+        );
+
+    /* Same as RadiusFindAttributes, but returns every matching attribute in
+     * array order, which is needed for multi-valued types such as Class and
+     * Vendor-Specific. *pcFound receives the total number of matches; if it
+     * is larger than cMatches, only the first cMatches are stored and
+     * ERROR_MORE_DATA is returned. */
+    DWORD
+        WINAPI
+        RadiusFindAllAttributes(
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs,
+            const DWORD* pTypes,
+            DWORD nTypes,
+            PRADIUS_ATTRIBUTE_MATCH pMatches,
+            DWORD cMatches,
+            DWORD* pcFound
+        );
+
+    /* Returns TRUE if the request can need MFA, i.e. it is an Access-Request
+     * at the authorization extension point that NPS has already accepted.
+     * Everything else (accounting, authentication-point calls, rejected or
+     * discarded requests) is left untouched by the adapter and can be
+     * answered without entering managed code. */
+    BOOL
+        WINAPI
+        RadiusIsMfaCandidate(
+            const RADIUS_EXTENSION_CONTROL_BLOCK* pECB
+        );
+
+    /* Read-only view of an attribute value. pbData points into the buffer
+     * owned by NPS, so a view is only valid as long as the attribute it was
+     * made from. */
+    typedef struct _RADIUS_VALUE_VIEW
+    {
+        DWORD dwAttrType;
+        RADIUS_DATA_TYPE fDataType;
+        /* Value bytes for rdtString, rdtUnknown and rdtIpv6Address. Text
+         * values are trimmed like the managed Str.sanitize: without a trailing
+         * NUL, or else without leading and trailing blanks. */
+        const BYTE* pbData;
+        DWORD cbData;
+        /* Value for rdtAddress, rdtInteger and rdtTime */
+        DWORD dwValue;
+    } RADIUS_VALUE_VIEW, *PRADIUS_VALUE_VIEW;
+
+    /* Fills pView from the attribute without copying the value. Returns FALSE
+     * if pAttr is NULL. */
+    BOOL
+        WINAPI
+        RadiusViewInit(
+            const RADIUS_ATTRIBUTE* pAttr,
+            PRADIUS_VALUE_VIEW pView
+        );
+
+    /* Typed accessors. Each returns FALSE if the view holds another type. */
+    BOOL
+        WINAPI
+        RadiusViewGetInteger(
+            const RADIUS_VALUE_VIEW* pView,
+            DWORD* pdwValue
+        );
+
+    /* The address is returned in network byte order, as NPS stores it. */
+    BOOL
+        WINAPI
+        RadiusViewGetIpv4(
+            const RADIUS_VALUE_VIEW* pView,
+            DWORD* pdwAddress
+        );
+
+    BOOL
+        WINAPI
+        RadiusViewGetIpv6(
+            const RADIUS_VALUE_VIEW* pView,
+            BYTE pbAddress[16]
+        );
+
+    BOOL
+        WINAPI
+        RadiusViewGetTime(
+            const RADIUS_VALUE_VIEW* pView,
+            DWORD* pdwValue
+        );
+
+    /* Compares a text value with cchValue bytes of pszValue in place. With
+     * fIgnoreCase, ASCII letters match regardless of case; other bytes must
+     * be equal. */
+    BOOL
+        WINAPI
+        RadiusViewEquals(
+            const RADIUS_VALUE_VIEW* pView,
+            const char* pszValue,
+            DWORD cchValue,
+            BOOL fIgnoreCase
+        );
+
+    /* Copies a text value into pszBuffer and terminates it with NUL. Returns
+     * ERROR_MORE_DATA, and copies nothing, if it needs more than cchBuffer
+     * bytes including the NUL. */
+    DWORD
+        WINAPI
+        RadiusViewCopyString(
+            const RADIUS_VALUE_VIEW* pView,
+            char* pszBuffer,
+            DWORD cchBuffer
+        );
+
+    /* Vendor-Specific attributes (type 26, RFC 2865 section 5.26) carry a
+     * 4-byte vendor ID in network byte order followed by one or more
+     * sub-attributes of vendor type, vendor length and value; the vendor
+     * length counts its own two header bytes. */
+#define RADIUS_VSA_ATTRIBUTE_TYPE 26
+#define RADIUS_VSA_MAX_VALUE 253
+#define RADIUS_VSA_MAX_DATA (RADIUS_VSA_MAX_VALUE - 4 - 2)
+#define RADIUS_VENDOR_MICROSOFT 311
+#define RADIUS_VENDOR_CISCO 9
+
+    /* One sub-attribute. pbData points into the attribute value owned by NPS,
+     * so the view is only valid as long as that attribute. */
+    typedef struct _RADIUS_VSA_VIEW
+    {
+        DWORD dwVendorId;
+        BYTE bVendorType;
+        const BYTE* pbData;
+        DWORD cbData;
+        /* Position of the Vendor-Specific attribute in the array */
+        DWORD dwAttrIndex;
+    } RADIUS_VSA_VIEW, *PRADIUS_VSA_VIEW;
+
+    /* Walks every sub-attribute of every Vendor-Specific attribute of an
+     * array in order, without allocating. Attributes whose sub-attributes do
+     * not add up to the value length, e.g. vendors with another layout, are
+     * skipped as a whole. The array must not change during the walk. */
+    typedef struct _RADIUS_VSA_ITERATOR
+    {
+        PRADIUS_ATTRIBUTE_ARRAY pAttrs;
+        DWORD dwSize;
+        /* Next attribute to look at */
+        DWORD dwNextAttr;
+        /* Rest of the attribute being walked */
+        DWORD dwAttrIndex;
+        DWORD dwVendorId;
+        const BYTE* pbNext;
+        const BYTE* pbEnd;
+    } RADIUS_VSA_ITERATOR, *PRADIUS_VSA_ITERATOR;
+
+    VOID
+        WINAPI
+        RadiusVsaIterInit(
+            PRADIUS_VSA_ITERATOR pIter,
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs
+        );
+
+    /* Fills pVsa with the next sub-attribute. Returns FALSE at the end. */
+    BOOL
+        WINAPI
+        RadiusVsaIterNext(
+            PRADIUS_VSA_ITERATOR pIter,
+            PRADIUS_VSA_VIEW pVsa
+        );
+
+    /* Finds the first sub-attribute of the vendor and vendor type with one
+     * walk of the array. Returns FALSE if there is none. */
+    BOOL
+        WINAPI
+        RadiusFindVsa(
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs,
+            DWORD dwVendorId,
+            BYTE bVendorType,
+            PRADIUS_VSA_VIEW pVsa
+        );
+
+    /* Number of hash slots and of sub-attributes in a VSA index. */
+#define RADIUS_VSA_INDEX_SLOTS 128
+#define RADIUS_VSA_INDEX_MAX 64
+
+    typedef struct _RADIUS_VSA_INDEX_ENTRY
+    {
+        DWORD dwVendorId;
+        BYTE bVendorType;
+        DWORD dwFirst;
+        DWORD dwLast;
+        DWORD dwCount;
+    } RADIUS_VSA_INDEX_ENTRY, *PRADIUS_VSA_INDEX_ENTRY;
+
+    /* Index of the sub-attributes of an array by (vendor ID, vendor type),
+     * built with one walk, for callers that look up several of them. Like
+     * RADIUS_ATTRIBUTE_INDEX it can live on the stack and must be rebuilt
+     * after the array changes. */
+    typedef struct _RADIUS_VSA_INDEX
+    {
+        DWORD dwCount;
+        RADIUS_VSA_VIEW vsas[RADIUS_VSA_INDEX_MAX];
+        /* Position of the next sub-attribute with the same key, or
+         * RADIUS_ATTR_NOT_FOUND for the last one. */
+        DWORD next[RADIUS_VSA_INDEX_MAX];
+        RADIUS_VSA_INDEX_ENTRY entries[RADIUS_VSA_INDEX_SLOTS];
+    } RADIUS_VSA_INDEX, *PRADIUS_VSA_INDEX;
+
+    /* Indexes the sub-attributes of pAttrs. Returns ERROR_MORE_DATA if there
+     * are more than RADIUS_VSA_INDEX_MAX; only the first ones are indexed,
+     * and RadiusVsaIterNext still reaches the rest. */
+    DWORD
+        WINAPI
+        RadiusVsaIndexBuild(
+            PRADIUS_VSA_INDEX pIndex,
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs
+        );
+
+    /* Returns the first sub-attribute with the key or NULL. */
+    const RADIUS_VSA_VIEW*
+        WINAPI
+        RadiusVsaIndexFind(
+            const RADIUS_VSA_INDEX* pIndex,
+            DWORD dwVendorId,
+            BYTE bVendorType
+        );
+
+    /* Returns the next sub-attribute with the same key as pVsa, which must
+     * come from the same index, or NULL. */
+    const RADIUS_VSA_VIEW*
+        WINAPI
+        RadiusVsaIndexFindNext(
+            const RADIUS_VSA_INDEX* pIndex,
+            const RADIUS_VSA_VIEW* pVsa
+        );
+
+    DWORD
+        WINAPI
+        RadiusVsaIndexCount(
+            const RADIUS_VSA_INDEX* pIndex,
+            DWORD dwVendorId,
+            BYTE bVendorType
+        );
+
+    /* Packs sub-attributes into as few Vendor-Specific attributes as their
+     * order allows: each is added to the attribute being built while it fits
+     * in RADIUS_VSA_MAX_VALUE bytes and the vendor is the same, otherwise that
+     * attribute is added to the array and a new one is started. The value is
+     * built in the structure itself, which can live on the stack. */
+    typedef struct _RADIUS_VSA_BUILDER
+    {
+        PRADIUS_ATTRIBUTE_ARRAY pAttrs;
+        DWORD dwVendorId;
+        DWORD cbUsed;
+        /* Vendor-Specific attributes added to the array so far */
+        DWORD dwAttributes;
+        BYTE value[RADIUS_VSA_MAX_VALUE];
+    } RADIUS_VSA_BUILDER, *PRADIUS_VSA_BUILDER;
+
+    VOID
+        WINAPI
+        RadiusVsaBuilderInit(
+            PRADIUS_VSA_BUILDER pBuilder,
+            PRADIUS_ATTRIBUTE_ARRAY pAttrs
+        );
+
+    /* Adds a sub-attribute of at most RADIUS_VSA_MAX_DATA bytes. Returns
+     * NO_ERROR or the error of the Add that made room for it. */
+    DWORD
+        WINAPI
+        RadiusVsaBuilderAdd(
+            PRADIUS_VSA_BUILDER pBuilder,
+            DWORD dwVendorId,
+            BYTE bVendorType,
+            const BYTE* pbData,
+            DWORD cbData
+        );
+
+    /* Adds the attribute being built, if any, to the array. */
+    DWORD
+        WINAPI
+        RadiusVsaBuilderFlush(
+            PRADIUS_VSA_BUILDER pBuilder
+        );
+
 
 #ifdef __cplusplus
 }
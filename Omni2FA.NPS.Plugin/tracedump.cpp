@@ -0,0 +1,259 @@
+#include "tracedump.h"
+#include "tracejournal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRACE_DUMP_USE_SSE2 1
+#endif
+
+namespace {
+
+// RADIUS_DATA_TYPE, without pulling in authif.h
+enum { kRdtUnknown, kRdtString, kRdtAddress, kRdtInteger, kRdtTime, kRdtIpv6Address };
+
+// Room kept back for the "..." that marks a full buffer and the NUL
+const size_t kEllipsisRoom = 4;
+
+const char kHex[] = "0123456789ABCDEF";
+
+bool IsPrintable(uint8_t c)
+{
+    return c >= 0x20 && c < 0x7F;
+}
+
+// Output for every byte value: the byte itself or its \xNN escape
+struct EscapeTable
+{
+    char text[256][4];
+    uint8_t length[256];
+
+    EscapeTable()
+    {
+        for (int c = 0; c < 256; ++c)
+        {
+            if (IsPrintable((uint8_t)c))
+            {
+                text[c][0] = (char)c;
+                length[c] = 1;
+            }
+            else
+            {
+                text[c][0] = '\\';
+                text[c][1] = 'x';
+                text[c][2] = kHex[c >> 4];
+                text[c][3] = kHex[c & 0x0F];
+                length[c] = 4;
+            }
+        }
+    }
+};
+
+const EscapeTable kEscapes;
+
+// Ends the dump with "..." in the room kept for it
+void MarkFull(TraceDumpWriter* writer)
+{
+    writer->full = true;
+    memcpy(writer->buffer + writer->used, "...", 3);
+    writer->used += 3;
+    writer->buffer[writer->used] = '\0';
+}
+
+// Appends text if it fits before the room kept for the ellipsis, else marks the dump full
+bool Append(TraceDumpWriter* writer, const char* text, size_t length)
+{
+    if (writer->full)
+        return false;
+    if (writer->used + length + kEllipsisRoom > writer->capacity)
+    {
+        MarkFull(writer);
+        return false;
+    }
+    memcpy(writer->buffer + writer->used, text, length);
+    writer->used += length;
+    writer->buffer[writer->used] = '\0';
+    return true;
+}
+
+bool Append(TraceDumpWriter* writer, const char* text)
+{
+    return Append(writer, text, strlen(text));
+}
+
+// Appends value in decimal without going through snprintf
+bool AppendNumber(TraceDumpWriter* writer, uint32_t value)
+{
+    char digits[10];
+    size_t count = 0;
+    do
+    {
+        digits[sizeof(digits) - 1 - count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return Append(writer, digits + sizeof(digits) - count, count);
+}
+
+void AppendText(TraceDumpWriter* writer, const uint8_t* value, uint32_t length)
+{
+    if (length > 0 && value[length - 1] == '\0')
+        --length;
+    size_t shown = length < writer->valueBytes ? length : writer->valueBytes;
+    size_t available = writer->capacity - writer->used - kEllipsisRoom;
+    size_t consumed = 0;
+    size_t written = TraceDumpEscape(value, shown, writer->buffer + writer->used, available, &consumed);
+    writer->used += written;
+    writer->buffer[writer->used] = '\0';
+    if (consumed < shown)
+    {
+        MarkFull(writer);
+        return;
+    }
+    if (shown < length)
+        Append(writer, "...", 3);
+}
+
+void AppendHex(TraceDumpWriter* writer, const uint8_t* value, uint32_t length)
+{
+    char pair[2];
+    uint32_t shown = length < writer->valueBytes ? length : writer->valueBytes;
+    for (uint32_t i = 0; i < shown; ++i)
+    {
+        pair[0] = kHex[value[i] >> 4];
+        pair[1] = kHex[value[i] & 0x0F];
+        if (!Append(writer, pair, 2))
+            return;
+    }
+    if (shown < length)
+        Append(writer, "...", 3);
+}
+
+// Same text as VendorSpecificAttribute.ToString: VSA: ID=VendorId, Type=VendorType, Data=1234
+void AppendVendorSpecific(TraceDumpWriter* writer, const uint8_t* value, uint32_t length)
+{
+    char text[48];
+    if (length < 6)
+    {
+        AppendHex(writer, value, length);
+        return;
+    }
+    uint32_t vendorId = ((uint32_t)value[0] << 24) | ((uint32_t)value[1] << 16) | ((uint32_t)value[2] << 8) | value[3];
+    snprintf(text, sizeof(text), "VSA: ID=%u, Type=%u, Data=", vendorId, value[4]);
+    if (Append(writer, text))
+        AppendHex(writer, value + 6, length - 6);
+}
+
+} // namespace
+
+size_t TraceDumpEscape(const uint8_t* src, size_t length, char* dst, size_t capacity, size_t* consumed)
+{
+    size_t in = 0;
+    size_t out = 0;
+#ifdef TRACE_DUMP_USE_SSE2
+    const __m128i low = _mm_set1_epi8(0x1F);
+    const __m128i high = _mm_set1_epi8(0x7F);
+    // Room for 16 escapes, so a chunk never needs a capacity check
+    while (in + 16 <= length && out + 64 <= capacity)
+    {
+        // Bytes >= 0x80 are negative as signed chars and fail the first compare
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + in));
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high));
+        if (_mm_movemask_epi8(printable) == 0xFFFF)
+        {
+            _mm_storeu_si128((__m128i*)(dst + out), v);
+            out += 16;
+        }
+        else
+        {
+            // Always store four characters and advance by the real length
+            for (int i = 0; i < 16; ++i)
+            {
+                uint8_t c = src[in + i];
+                memcpy(dst + out, kEscapes.text[c], 4);
+                out += kEscapes.length[c];
+            }
+        }
+        in += 16;
+    }
+#endif
+    while (in < length)
+    {
+        uint8_t c = src[in];
+        if (out + kEscapes.length[c] > capacity)
+            break;
+        memcpy(dst + out, kEscapes.text[c], kEscapes.length[c]);
+        out += kEscapes.length[c];
+        ++in;
+    }
+    if (consumed != nullptr)
+        *consumed = in;
+    return out;
+}
+
+void TraceDumpBegin(TraceDumpWriter* writer, char* buffer, size_t capacity, uint32_t valueBytes)
+{
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    writer->used = 0;
+    writer->valueBytes = valueBytes;
+    writer->full = buffer == nullptr || capacity < kEllipsisRoom;
+    if (buffer != nullptr && capacity > 0)
+        buffer[0] = '\0';
+}
+
+void TraceDumpAddAttribute(TraceDumpWriter* writer, const char* separator, uint32_t type, uint32_t dataType,
+    const void* value, uint32_t length)
+{
+    char text[48];
+    const uint8_t* bytes = (const uint8_t*)value;
+    if (writer->full)
+        return;
+    const char* name = TraceJournalAttributeName(type);
+    if (!Append(writer, separator) ||
+        !(name != nullptr ? Append(writer, name) : AppendNumber(writer, type)) ||
+        !Append(writer, ": ", 2))
+        return;
+    if (TraceJournalIsSecret(type))
+    {
+        Append(writer, "<redacted>");
+        return;
+    }
+    if (bytes == nullptr || length == 0)
+        return;
+    if ((dataType == kRdtAddress || dataType == kRdtInteger || dataType == kRdtTime) && length == 4)
+    {
+        uint32_t dw;
+        memcpy(&dw, bytes, 4);
+        if (dataType != kRdtAddress)
+        {
+            AppendNumber(writer, dw);
+            return;
+        }
+        // dwValue arrives in network byte order
+        for (int i = 0; i < 4; ++i)
+        {
+            if ((i > 0 && !Append(writer, ".", 1)) || !AppendNumber(writer, bytes[i]))
+                return;
+        }
+        return;
+    }
+    if (dataType == kRdtIpv6Address && length == 16)
+    {
+        snprintf(text, sizeof(text), "%x:%x:%x:%x:%x:%x:%x:%x",
+            (bytes[0] << 8) | bytes[1], (bytes[2] << 8) | bytes[3], (bytes[4] << 8) | bytes[5], (bytes[6] << 8) | bytes[7],
+            (bytes[8] << 8) | bytes[9], (bytes[10] << 8) | bytes[11], (bytes[12] << 8) | bytes[13], (bytes[14] << 8) | bytes[15]);
+        Append(writer, text);
+        return;
+    }
+    if (type == 26)
+        AppendVendorSpecific(writer, bytes, length);
+    else
+        AppendText(writer, bytes, length);
+}
+
+const char* TraceDumpText(const TraceDumpWriter* writer)
+{
+    return writer->buffer != nullptr && writer->capacity > 0 ? writer->buffer : "";
+}
@@ -0,0 +1,50 @@
+#ifndef TRACEDUMP_H
+#define TRACEDUMP_H
+#pragma once
+
+// Attribute dumps of events 122 and 123.
+//
+// With EnableTraceLogging every request and its Access-Accept response are
+// logged as lists of "Name: value" items. The writer renders them straight
+// into one caller-provided buffer, in the format of the trace journal decoder:
+// printable ASCII is copied 16 bytes at a time by a vectorized kernel and any
+// other byte becomes \xNN, secrets are redacted, and a value is cut after a
+// byte budget so EAP-Message and State do not flood the Event Log. When the
+// buffer is full the dump ends with "...".
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the buffer one dump is rendered into
+#define TRACE_DUMP_BUFFER_SIZE 8192
+// Value bytes shown per attribute, see TraceDumpValueBytes
+#define TRACE_DUMP_DEFAULT_VALUE_BYTES 128
+#define TRACE_DUMP_MAX_VALUE_BYTES 4096
+
+struct TraceDumpWriter
+{
+    char* buffer;
+    size_t capacity;
+    size_t used;
+    uint32_t valueBytes;
+    bool full;
+};
+
+// Starts an empty dump in buffer; capacity includes the terminating NUL
+void TraceDumpBegin(TraceDumpWriter* writer, char* buffer, size_t capacity, uint32_t valueBytes);
+// Appends separator and "Name: value"; dataType is a RADIUS_DATA_TYPE value and
+// integer values are passed as their DWORD
+void TraceDumpAddAttribute(TraceDumpWriter* writer, const char* separator, uint32_t type, uint32_t dataType,
+    const void* value, uint32_t length);
+// The NUL-terminated dump
+const char* TraceDumpText(const TraceDumpWriter* writer);
+
+// Escapes up to length bytes of src into dst without writing past capacity.
+// Returns the number of characters written; *consumed receives the number of
+// source bytes they represent. No NUL is written.
+size_t TraceDumpEscape(const uint8_t* src, size_t length, char* dst, size_t capacity, size_t* consumed);
+
+#endif // TRACEDUMP_H
@@ -0,0 +1,585 @@
+#include "tracejournal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Mirrors RADIUS_DATA_TYPE and RADIUS_CODE from authif.h, which this file does not include
+enum { kRdtUnknown, kRdtString, kRdtAddress, kRdtInteger, kRdtTime, kRdtIpv6Address };
+
+struct Segment
+{
+    uint8_t* base;
+    uint64_t capacity;
+    std::atomic<uint64_t> offset;
+    std::atomic<int> writers;
+    uint32_t generation;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+Segment g_segments[TRACE_JOURNAL_MAX_FILES];
+uint32_t g_fileCount = 0;
+uint32_t g_generation = 0;
+std::atomic<Segment*> g_current(nullptr);
+// Taken only to open, close and rotate; the append path never locks
+std::mutex g_journalLock;
+
+uint32_t Align4(uint32_t value)
+{
+    return (value + 3u) & ~3u;
+}
+
+uint64_t NowMicros()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint32_t CurrentThreadId()
+{
+#ifdef _WIN32
+    return (uint32_t)GetCurrentThreadId();
+#else
+    static thread_local uint32_t id = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    return id;
+#endif
+}
+
+bool MapSegment(Segment& seg, const std::string& path, uint64_t capacity)
+{
+#ifdef _WIN32
+    int chars = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    if (chars <= 0)
+        return false;
+    std::wstring widePath((size_t)chars, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], chars);
+    seg.file = CreateFileW(widePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (seg.file == INVALID_HANDLE_VALUE)
+        return false;
+    seg.mapping = CreateFileMappingW(seg.file, NULL, PAGE_READWRITE,
+        (DWORD)(capacity >> 32), (DWORD)(capacity & 0xFFFFFFFFu), NULL);
+    if (seg.mapping == NULL)
+    {
+        CloseHandle(seg.file);
+        return false;
+    }
+    seg.base = (uint8_t*)MapViewOfFile(seg.mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)capacity);
+    if (seg.base == NULL)
+    {
+        CloseHandle(seg.mapping);
+        CloseHandle(seg.file);
+        return false;
+    }
+#else
+    seg.fd = open(path.c_str(), O_RDWR | O_CREAT, 0640);
+    if (seg.fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(seg.fd, &st) != 0 || ((uint64_t)st.st_size != capacity && ftruncate(seg.fd, (off_t)capacity) != 0))
+    {
+        close(seg.fd);
+        return false;
+    }
+    void* base = mmap(NULL, (size_t)capacity, PROT_READ | PROT_WRITE, MAP_SHARED, seg.fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(seg.fd);
+        return false;
+    }
+    seg.base = (uint8_t*)base;
+#endif
+    seg.capacity = capacity;
+    return true;
+}
+
+void UnmapSegment(Segment& seg)
+{
+    if (seg.base == nullptr)
+        return;
+#ifdef _WIN32
+    FlushViewOfFile(seg.base, 0);
+    UnmapViewOfFile(seg.base);
+    CloseHandle(seg.mapping);
+    CloseHandle(seg.file);
+#else
+    msync(seg.base, (size_t)seg.capacity, MS_ASYNC);
+    munmap(seg.base, (size_t)seg.capacity);
+    close(seg.fd);
+#endif
+    seg.base = nullptr;
+}
+
+// A file that was written by an earlier run keeps its generation so the
+// decoder can still order it against the files written by this run
+uint32_t ExistingGeneration(const Segment& seg)
+{
+    const TraceJournalFileHeader* header = (const TraceJournalFileHeader*)seg.base;
+    if (memcmp(header->magic, TRACE_JOURNAL_MAGIC, 8) != 0 || header->version != TRACE_JOURNAL_VERSION ||
+        header->capacity != seg.capacity)
+        return 0;
+    return header->generation;
+}
+
+// Starts a new generation in a segment that no writer is using
+void ResetSegment(Segment& seg, uint32_t index, uint32_t generation)
+{
+    TraceJournalFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_JOURNAL_MAGIC, 8);
+    header.version = TRACE_JOURNAL_VERSION;
+    header.headerSize = sizeof(TraceJournalFileHeader);
+    header.generation = generation;
+    header.fileIndex = index;
+    header.capacity = seg.capacity;
+    header.createdMicros = NowMicros();
+    memcpy(seg.base, &header, sizeof(header));
+    // Invalidate the first record so a reader never sees the previous generation's data
+    memset(seg.base + sizeof(header), 0, sizeof(TraceJournalRecordHeader));
+    seg.generation = generation;
+    seg.offset.store(sizeof(TraceJournalFileHeader), std::memory_order_relaxed);
+}
+
+void Rotate(Segment* full)
+{
+    std::lock_guard<std::mutex> lock(g_journalLock);
+    if (g_current.load(std::memory_order_acquire) != full)
+        return;
+    uint32_t index = (uint32_t)(full - g_segments);
+    uint32_t nextIndex = (index + 1) % g_fileCount;
+    Segment& next = g_segments[nextIndex];
+    // Writers still finishing a record in the oldest file must be done before it is reused
+    while (next.writers.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+    ResetSegment(next, nextIndex, ++g_generation);
+    g_current.store(&next, std::memory_order_seq_cst);
+}
+
+bool Append(TraceJournalRecordHeader* record)
+{
+    for (uint32_t attempt = 0; attempt <= g_fileCount; ++attempt)
+    {
+        Segment* seg = g_current.load(std::memory_order_seq_cst);
+        if (seg == nullptr)
+            return false;
+        seg->writers.fetch_add(1, std::memory_order_seq_cst);
+        if (g_current.load(std::memory_order_seq_cst) != seg)
+        {
+            seg->writers.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+        uint64_t offset = seg->offset.fetch_add(record->size, std::memory_order_relaxed);
+        if (offset + record->size <= seg->capacity)
+        {
+            uint8_t* target = seg->base + offset;
+            memcpy(target, record, record->size);
+            // The generation is stored last; a reader stops at the first record whose
+            // generation does not match the file, which covers torn and stale records
+            std::atomic_thread_fence(std::memory_order_release);
+            ((volatile TraceJournalRecordHeader*)target)->generation = seg->generation;
+            seg->writers.fetch_sub(1, std::memory_order_release);
+            return true;
+        }
+        seg->writers.fetch_sub(1, std::memory_order_release);
+        if (record->size > seg->capacity - sizeof(TraceJournalFileHeader))
+            return false;
+        Rotate(seg);
+    }
+    return false;
+}
+
+const char* AttributeName(uint32_t type)
+{
+    static const struct { uint32_t type; const char* name; } names[] = {
+        { 1, "UserName" }, { 2, "UserPassword" }, { 3, "CHAPPassword" }, { 4, "NASIPAddress" },
+        { 5, "NASPort" }, { 6, "ServiceType" }, { 7, "FramedProtocol" }, { 8, "FramedIPAddress" },
+        { 9, "FramedIPNetmask" }, { 10, "FramedRouting" }, { 11, "FilterId" }, { 12, "FramedMTU" },
+        { 13, "FramedCompression" }, { 14, "LoginIPHost" }, { 15, "LoginService" }, { 16, "LoginPort" },
+        { 18, "ReplyMessage" }, { 19, "CallbackNumber" }, { 20, "CallbackId" }, { 22, "FramedRoute" },
+        { 23, "FramedIPXNetwork" }, { 24, "State" }, { 25, "Class" }, { 26, "VendorSpecific" },
+        { 27, "SessionTimeout" }, { 28, "IdleTimeout" }, { 29, "TerminationAction" },
+        { 30, "CalledStationId" }, { 31, "CallingStationId" }, { 32, "NASIdentifier" },
+        { 33, "ProxyState" }, { 44, "AcctSessionId" }, { 61, "NASPortType" }, { 64, "TunnelType" },
+        { 65, "MediumType" }, { 69, "TunnelPassword" }, { 77, "ConnectInfo" }, { 79, "EAPMessage" },
+        { 80, "MessageAuthenticator" }, { 81, "TunnelPrivateGroupID" }, { 87, "NASPortId" },
+        { 95, "NASIPv6Address" }, { 262, "Code" }, { 263, "Identifier" }, { 264, "Authenticator" },
+        { 265, "SrcIPAddress" }, { 266, "SrcPort" }, { 267, "Provider" }, { 268, "StrippedUserName" },
+        { 269, "FQUserName" }, { 270, "PolicyName" }, { 271, "UniqueId" }, { 272, "ExtensionState" },
+        { 273, "EAPTLV" }, { 274, "RejectReasonCode" }, { 275, "CRPPolicyName" }, { 276, "ProviderName" },
+        { 277, "ClearTextPassword" }, { 278, "SrcIPv6Address" }
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        if (names[i].type == type)
+            return names[i].name;
+    }
+    return nullptr;
+}
+
+const char* CodeName(uint32_t code)
+{
+    switch (code)
+    {
+    case 0: return "Unknown";
+    case 1: return "AccessRequest";
+    case 2: return "AccessAccept";
+    case 3: return "AccessReject";
+    case 4: return "AccountingRequest";
+    case 5: return "AccountingResponse";
+    case 11: return "AccessChallenge";
+    case 256: return "Discard";
+    default: return nullptr;
+    }
+}
+
+std::string Number(uint64_t value)
+{
+    char text[24];
+    snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+    return text;
+}
+
+std::string CodeText(uint32_t code)
+{
+    const char* name = CodeName(code);
+    return name != nullptr ? std::string(name) : Number(code);
+}
+
+// Renders a value the way Radius.AttributesToList and Str.sanitize do
+std::string AttributeValue(const TraceJournalAttribute* attr)
+{
+    const uint8_t* value = (const uint8_t*)(attr + 1);
+    if (attr->flags & TRACE_JOURNAL_ATTR_REDACTED)
+        return "<redacted>";
+    if ((attr->dataType == kRdtAddress || attr->dataType == kRdtInteger || attr->dataType == kRdtTime) && attr->length == 4)
+    {
+        uint32_t dw;
+        memcpy(&dw, value, 4);
+        if (attr->dataType == kRdtAddress)
+        {
+            // dwValue arrives in network byte order
+            char text[16];
+            snprintf(text, sizeof(text), "%u.%u.%u.%u", value[0], value[1], value[2], value[3]);
+            return text;
+        }
+        return Number(dw);
+    }
+    if (attr->dataType == kRdtIpv6Address && attr->length == 16)
+    {
+        char text[40];
+        snprintf(text, sizeof(text), "%x:%x:%x:%x:%x:%x:%x:%x",
+            (value[0] << 8) | value[1], (value[2] << 8) | value[3], (value[4] << 8) | value[5], (value[6] << 8) | value[7],
+            (value[8] << 8) | value[9], (value[10] << 8) | value[11], (value[12] << 8) | value[13], (value[14] << 8) | value[15]);
+        return text;
+    }
+    uint32_t length = attr->length;
+    if (length > 0 && value[length - 1] == '\0')
+        --length;
+    std::string out;
+    out.reserve(length);
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        uint8_t c = value[i];
+        if (c >= 0x20 && c < 0x7F)
+        {
+            out += (char)c;
+        }
+        else
+        {
+            char hex[5];
+            snprintf(hex, sizeof(hex), "\\x%02X", c);
+            out += hex;
+        }
+    }
+    if (attr->flags & TRACE_JOURNAL_ATTR_TRUNCATED)
+        out += "...";
+    return out;
+}
+
+const TraceJournalAttribute* NextAttribute(const TraceJournalAttribute* attr)
+{
+    return (const TraceJournalAttribute*)((const uint8_t*)(attr + 1) + Align4(attr->length));
+}
+
+const TraceJournalAttribute* FindAttribute(const TraceJournalRecordView& record, uint32_t type)
+{
+    const TraceJournalAttribute* attr = (const TraceJournalAttribute*)record.attributes;
+    for (uint16_t i = 0; i < record.request->attributeCount; ++i, attr = NextAttribute(attr))
+    {
+        if (attr->type == type && !(attr->flags & TRACE_JOURNAL_ATTR_RESPONSE))
+            return attr;
+    }
+    return nullptr;
+}
+
+std::string LookupValue(const TraceJournalRecordView& record, uint32_t type)
+{
+    const TraceJournalAttribute* attr = FindAttribute(record, type);
+    return attr != nullptr ? AttributeValue(attr) : std::string();
+}
+
+std::string Timestamp(uint64_t micros)
+{
+    time_t seconds = (time_t)(micros / 1000000);
+    struct tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char text[64];
+    snprintf(text, sizeof(text), "%04d-%02d-%02d %02d:%02d:%02d.%06uZ", utc.tm_year + 1900, utc.tm_mon + 1,
+        utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, (unsigned)(micros % 1000000));
+    return text;
+}
+
+} // namespace
+
+bool TraceJournalOpen(const char* basePath, uint32_t fileCount, uint64_t fileBytes)
+{
+    if (basePath == nullptr || fileCount == 0 || fileCount > TRACE_JOURNAL_MAX_FILES ||
+        fileBytes < sizeof(TraceJournalFileHeader) + TRACE_JOURNAL_MAX_RECORD)
+        return false;
+    TraceJournalClose();
+    std::lock_guard<std::mutex> lock(g_journalLock);
+    uint32_t newest = 0;
+    uint32_t newestIndex = fileCount - 1;
+    for (uint32_t i = 0; i < fileCount; ++i)
+    {
+        Segment& seg = g_segments[i];
+        seg.writers.store(0, std::memory_order_relaxed);
+        if (!MapSegment(seg, std::string(basePath) + "." + Number(i), fileBytes))
+        {
+            for (uint32_t j = 0; j < i; ++j)
+                UnmapSegment(g_segments[j]);
+            return false;
+        }
+        uint32_t generation = ExistingGeneration(seg);
+        seg.generation = generation;
+        if (generation > newest)
+        {
+            newest = generation;
+            newestIndex = i;
+        }
+    }
+    g_fileCount = fileCount;
+    g_generation = newest;
+    // Continue after the newest file of the previous run instead of overwriting it
+    uint32_t first = (newestIndex + 1) % fileCount;
+    ResetSegment(g_segments[first], first, ++g_generation);
+    g_current.store(&g_segments[first], std::memory_order_seq_cst);
+    return true;
+}
+
+void TraceJournalClose()
+{
+    std::lock_guard<std::mutex> lock(g_journalLock);
+    if (g_current.load(std::memory_order_acquire) == nullptr)
+        return;
+    g_current.store(nullptr, std::memory_order_seq_cst);
+    for (uint32_t i = 0; i < g_fileCount; ++i)
+    {
+        while (g_segments[i].writers.load(std::memory_order_seq_cst) != 0)
+            std::this_thread::yield();
+        UnmapSegment(g_segments[i]);
+    }
+    g_fileCount = 0;
+}
+
+bool TraceJournalIsOpen()
+{
+    return g_current.load(std::memory_order_acquire) != nullptr;
+}
+
+void TraceJournalBeginRequest(TraceJournalWriter* writer, const TraceJournalRequestInfo* info)
+{
+    TraceJournalRecordHeader* header = (TraceJournalRecordHeader*)writer->buffer;
+    header->size = 0;
+    header->generation = 0;
+    header->timestampMicros = NowMicros();
+    header->threadId = CurrentThreadId();
+    header->kind = TRACE_JOURNAL_KIND_REQUEST;
+    header->eventCode = 120;
+    TraceJournalRequestInfo* request = (TraceJournalRequestInfo*)(header + 1);
+    *request = *info;
+    request->attributeCount = 0;
+    request->reserved = 0;
+    writer->used = sizeof(TraceJournalRecordHeader) + sizeof(TraceJournalRequestInfo);
+    writer->overflow = false;
+}
+
+void TraceJournalAddAttribute(TraceJournalWriter* writer, uint32_t type, uint32_t dataType, uint32_t flags,
+    const void* value, uint32_t length)
+{
+    if (TraceJournalIsSecret(type))
+    {
+        flags |= TRACE_JOURNAL_ATTR_REDACTED;
+        length = 0;
+    }
+    if (value == nullptr)
+        length = 0;
+    if (length > TRACE_JOURNAL_MAX_VALUE)
+    {
+        flags |= TRACE_JOURNAL_ATTR_TRUNCATED;
+        length = TRACE_JOURNAL_MAX_VALUE;
+    }
+    uint32_t needed = sizeof(TraceJournalAttribute) + Align4(length);
+    if (writer->used + needed > TRACE_JOURNAL_MAX_RECORD)
+    {
+        writer->overflow = true;
+        return;
+    }
+    TraceJournalAttribute* attr = (TraceJournalAttribute*)(writer->buffer + writer->used);
+    attr->type = type;
+    attr->dataType = (uint8_t)dataType;
+    attr->flags = (uint8_t)flags;
+    attr->length = (uint16_t)length;
+    uint8_t* data = (uint8_t*)(attr + 1);
+    if (length > 0)
+        memcpy(data, value, length);
+    memset(data + length, 0, Align4(length) - length);
+    writer->used += needed;
+    TraceJournalRequestInfo* request = (TraceJournalRequestInfo*)(writer->buffer + sizeof(TraceJournalRecordHeader));
+    request->attributeCount++;
+}
+
+bool TraceJournalCommit(TraceJournalWriter* writer)
+{
+    // A record that did not fit still goes out with the attributes that did
+    TraceJournalRecordHeader* header = (TraceJournalRecordHeader*)writer->buffer;
+    header->size = writer->used;
+    header->generation = 0;
+    return Append(header) && !writer->overflow;
+}
+
+bool TraceJournalIsSecret(uint32_t type)
+{
+    // User-Password, CHAP-Password, Tunnel-Password, ARAP-Password, ClearTextPassword
+    return type == 2 || type == 3 || type == 69 || type == 70 || type == 277;
+}
+
+const char* TraceJournalAttributeName(uint32_t type)
+{
+    return AttributeName(type);
+}
+
+int TraceJournalRead(const uint8_t* data, size_t size, uint32_t* generation, TraceJournalVisitFn visit, void* context)
+{
+    if (data == nullptr || size < sizeof(TraceJournalFileHeader))
+        return -1;
+    const TraceJournalFileHeader* file = (const TraceJournalFileHeader*)data;
+    if (memcmp(file->magic, TRACE_JOURNAL_MAGIC, 8) != 0 || file->version != TRACE_JOURNAL_VERSION ||
+        file->headerSize != sizeof(TraceJournalFileHeader))
+        return -1;
+    if (generation != nullptr)
+        *generation = file->generation;
+    size_t end = (size_t)file->capacity < size ? (size_t)file->capacity : size;
+    size_t offset = file->headerSize;
+    int count = 0;
+    while (offset + sizeof(TraceJournalRecordHeader) <= end)
+    {
+        const TraceJournalRecordHeader* header = (const TraceJournalRecordHeader*)(data + offset);
+        if (header->generation != file->generation || header->size < sizeof(TraceJournalRecordHeader) ||
+            (header->size & 3u) != 0 || offset + header->size > end)
+            break;
+        TraceJournalRecordView view;
+        view.header = header;
+        view.request = nullptr;
+        view.attributes = nullptr;
+        view.end = data + offset + header->size;
+        if (header->kind == TRACE_JOURNAL_KIND_REQUEST &&
+            header->size >= sizeof(TraceJournalRecordHeader) + sizeof(TraceJournalRequestInfo))
+        {
+            view.request = (const TraceJournalRequestInfo*)(header + 1);
+            view.attributes = (const uint8_t*)(view.request + 1);
+            // Reject attribute lists that run past the record
+            const TraceJournalAttribute* attr = (const TraceJournalAttribute*)view.attributes;
+            for (uint16_t i = 0; i < view.request->attributeCount; ++i)
+            {
+                if ((const uint8_t*)(attr + 1) > view.end || (const uint8_t*)NextAttribute(attr) > view.end)
+                {
+                    view.request = nullptr;
+                    break;
+                }
+                attr = NextAttribute(attr);
+            }
+        }
+        if (visit != nullptr)
+            visit(context, view);
+        ++count;
+        offset += header->size;
+    }
+    return count;
+}
+
+std::string TraceJournalFormatRequest(const TraceJournalRecordView& record)
+{
+    std::string out = "[" + Timestamp(record.header->timestampMicros) + "] thread " + Number(record.header->threadId) + "\n";
+    if (record.request == nullptr)
+        return out + "(malformed record)\n";
+    const TraceJournalRequestInfo& info = *record.request;
+
+    std::string params = "NPS request start\n";
+    params += "-ExtensionPoint: " + std::string(info.extensionPoint == 0 ? "Authentication" :
+        info.extensionPoint == 1 ? "Authorization" : Number(info.extensionPoint).c_str()) + "\n";
+    params += "-RequestType: " + CodeText(info.requestType) + "\n";
+    params += "-ResponseType: " + CodeText(info.responseTypeIn) + "\n";
+    out += "120 RadiusExtensionProcess2 called with params:\n" + params;
+
+    std::string details = params;
+    std::string userName = LookupValue(record, 1);
+    if (!userName.empty())
+    {
+        details += "-UserName: " + userName + "\n";
+        details += "-NAS IPAddress: " + LookupValue(record, 4) + "\n";
+        details += "-Src IPAddress: " + LookupValue(record, 265) + "\n";
+        details += "-Connection Request Policy Name: '" + LookupValue(record, 275) + "'\n";
+        details += "-Network Policy Name: '" + LookupValue(record, 270) + "'\n";
+    }
+    out += "121 Authorization request\n" + details;
+
+    std::string request;
+    std::string response;
+    const TraceJournalAttribute* attr = (const TraceJournalAttribute*)record.attributes;
+    for (uint16_t i = 0; i < info.attributeCount; ++i, attr = NextAttribute(attr))
+    {
+        const char* name = AttributeName(attr->type);
+        std::string item = (name != nullptr ? std::string(name) : Number(attr->type)) + ": " + AttributeValue(attr);
+        if (attr->flags & TRACE_JOURNAL_ATTR_RESPONSE)
+            response += " ~ " + item;
+        else
+            request += " | " + item;
+    }
+    out += "122 Request components: " + request + "\n";
+    out += "123 Response components: " + response + "\n";
+
+    out += "Result: " + Number(info.result) + ", ResponseType: " + CodeText(info.responseTypeIn) + " -> " +
+        CodeText(info.responseTypeOut);
+    if (info.flags & TRACE_JOURNAL_SHORT_CIRCUITED)
+        out += ", short-circuited by the native pre-filter";
+    else
+        out += ", adapter " + Number(info.managedMicros) + " us";
+    out += ", total " + Number(info.totalMicros) + " us\n";
+    return out;
+}
@@ -0,0 +1,130 @@
+#ifndef TRACEJOURNAL_H
+#define TRACEJOURNAL_H
+#pragma once
+
+// Binary trace journal for the native wrapper.
+//
+// Each request is appended as one compact binary record to a set of
+// memory-mapped journal files (<path>.0 .. <path>.N-1). Writers reserve space
+// with a single atomic add and copy the record in place; when a file is full
+// the next one is reused, so the journal keeps the most recent traffic. The
+// decoder (Omni2FA.TraceDecoder) turns the records back into the text of
+// events 120-123 offline.
+//
+// This header is included from /clr code and must not pull in <atomic>,
+// <mutex> or <thread>.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#define TRACE_JOURNAL_MAGIC "O2FAJRN1"
+#define TRACE_JOURNAL_VERSION 1
+#define TRACE_JOURNAL_MAX_FILES 16
+#define TRACE_JOURNAL_MAX_RECORD 8192
+// Attribute values longer than this are cut and flagged as truncated
+#define TRACE_JOURNAL_MAX_VALUE 512
+
+// Record kinds
+#define TRACE_JOURNAL_KIND_REQUEST 1
+
+// TraceJournalRequestInfo.flags
+#define TRACE_JOURNAL_SHORT_CIRCUITED 0x1
+
+// TraceJournalAttribute.flags
+#define TRACE_JOURNAL_ATTR_RESPONSE 0x1
+#define TRACE_JOURNAL_ATTR_TRUNCATED 0x2
+#define TRACE_JOURNAL_ATTR_REDACTED 0x4
+
+#pragma pack(push, 4)
+struct TraceJournalFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t generation;
+    uint32_t fileIndex;
+    uint64_t capacity;
+    uint64_t createdMicros;
+    uint8_t reserved[24];
+};
+
+struct TraceJournalRecordHeader
+{
+    uint32_t size;          // whole record including this header, multiple of 4
+    uint32_t generation;    // written last; must match the file header
+    uint64_t timestampMicros;
+    uint32_t threadId;
+    uint16_t kind;
+    uint16_t eventCode;
+};
+
+struct TraceJournalRequestInfo
+{
+    uint32_t extensionPoint;    // RADIUS_EXTENSION_POINT
+    uint32_t requestType;       // RADIUS_CODE
+    uint32_t responseTypeIn;    // rcResponseType on entry
+    uint32_t responseTypeOut;   // rcResponseType after the adapter ran
+    uint32_t result;            // value returned to NPS
+    uint32_t flags;
+    uint32_t managedMicros;     // time spent in the managed adapter
+    uint32_t totalMicros;       // time spent in RadiusExtensionProcess2
+    uint16_t attributeCount;
+    uint16_t reserved;
+};
+
+struct TraceJournalAttribute
+{
+    uint32_t type;
+    uint8_t dataType;   // RADIUS_DATA_TYPE
+    uint8_t flags;
+    uint16_t length;    // value bytes that follow, padded to 4 in the record
+};
+#pragma pack(pop)
+
+// Builds one request record on the caller's stack before it is copied into the journal
+struct TraceJournalWriter
+{
+    // First member so the record headers built in it are 4-byte aligned
+    uint8_t buffer[TRACE_JOURNAL_MAX_RECORD];
+    uint32_t used;
+    bool overflow;
+};
+
+// Opens or creates the journal files. fileBytes is the size of each file.
+bool TraceJournalOpen(const char* basePath, uint32_t fileCount, uint64_t fileBytes);
+void TraceJournalClose();
+bool TraceJournalIsOpen();
+
+// Record building
+void TraceJournalBeginRequest(TraceJournalWriter* writer, const TraceJournalRequestInfo* info);
+void TraceJournalAddAttribute(TraceJournalWriter* writer, uint32_t type, uint32_t dataType, uint32_t flags,
+    const void* value, uint32_t length);
+// Copies the record into the journal; false if the journal is closed or the record overflowed
+bool TraceJournalCommit(TraceJournalWriter* writer);
+
+// Attribute types whose values are never written (passwords and secrets)
+bool TraceJournalIsSecret(uint32_t type);
+// Name of the attribute type as in RadiusAttributeType, or nullptr if unknown
+const char* TraceJournalAttributeName(uint32_t type);
+
+// Reading, used by the decoder and the tests
+struct TraceJournalRecordView
+{
+    const TraceJournalRecordHeader* header;
+    const TraceJournalRequestInfo* request;
+    const uint8_t* attributes;      // first TraceJournalAttribute
+    const uint8_t* end;
+};
+
+typedef void (*TraceJournalVisitFn)(void* context, const TraceJournalRecordView& record);
+
+// Walks the records of one journal file image. Returns the number of records
+// visited, or -1 if the image is not a journal file. *generation receives the
+// file generation so callers can order several files.
+int TraceJournalRead(const uint8_t* data, size_t size, uint32_t* generation, TraceJournalVisitFn visit, void* context);
+
+// Renders a request record as the text of events 120-123
+std::string TraceJournalFormatRequest(const TraceJournalRecordView& record);
+
+#endif // TRACEJOURNAL_H
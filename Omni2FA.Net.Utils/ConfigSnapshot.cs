@@ -0,0 +1,417 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Immutable view of the SOFTWARE\Omni2FA.NPS settings. A new instance is built for every
+    /// change and published by <see cref="ConfigStore"/>; request threads only ever read it.
+    /// </summary>
+    public sealed class ConfigSnapshot {
+        public const string EnableTraceLoggingKey = "EnableTraceLogging";
+        public const string TraceDumpValueBytesKey = "TraceDumpValueBytes";
+        public const string MfaEnabledNpsPolicyKey = "MfaEnabledNPSPolicy";
+        public const string NoMfaGroupsKey = "NoMfaGroups";
+        public const string AuthTimeoutKey = "AuthTimeout";
+        public const string ServiceUrlKey = "ServiceUrl";
+        public const string WaitBeforePollKey = "WaitBeforePoll";
+        public const string PollIntervalKey = "PollInterval";
+        public const string PollMaxSecondsKey = "PollMaxSeconds";
+        public const string IgnoreSslErrorsKey = "IgnoreSslErrors";
+        public const string BasicAuthUsernameKey = "BasicAuthUsername";
+        public const string BasicAuthPasswordKey = "BasicAuthPassword";
+        public const string MfaCacheSecondsKey = "MfaCacheSeconds";
+        public const string MfaCacheFailureSecondsKey = "MfaCacheFailureSeconds";
+        public const string MfaCacheMaxEntriesKey = "MfaCacheMaxEntries";
+        public const string GroupCacheSecondsKey = "GroupCacheSeconds";
+        public const string GroupCacheNegativeSecondsKey = "GroupCacheNegativeSeconds";
+        public const string GroupCacheMaxEntriesKey = "GroupCacheMaxEntries";
+        public const string GroupResolveTimeoutSecondsKey = "GroupResolveTimeoutSeconds";
+        public const string NativeMfaClientKey = "NativeMfaClient";
+        public const string MfaMaxConcurrentKey = "MfaMaxConcurrent";
+        public const string MfaMaxQueueKey = "MfaMaxQueue";
+        public const string MfaQueueTimeoutSecondsKey = "MfaQueueTimeoutSeconds";
+        public const string MfaFailOpenKey = "MfaFailOpen";
+        public const string MfaCoalesceRequestsKey = "MfaCoalesceRequests";
+        public const string MfaRulesKey = "MfaRules";
+        public const string MfaKeepWarmSecondsKey = "MfaKeepWarmSeconds";
+        public const string MfaBreakerFailurePercentKey = "MfaBreakerFailurePercent";
+        public const string MfaBreakerMinRequestsKey = "MfaBreakerMinRequests";
+        public const string MfaBreakerWindowSecondsKey = "MfaBreakerWindowSeconds";
+        public const string MfaBreakerSlowSecondsKey = "MfaBreakerSlowSeconds";
+        public const string MfaBreakerOpenSecondsKey = "MfaBreakerOpenSeconds";
+        public const string MfaHedgeMinMsKey = "MfaHedgeMinMs";
+
+        private readonly Dictionary<string, string> _values;
+        private readonly HashSet<string> _noMfaGroupSids;
+
+        private ConfigSnapshot(Dictionary<string, string> values, long version) {
+            _values = values;
+            Version = version;
+            LoadedAt = DateTime.UtcNow;
+            EnableTraceLogging  = GetBool(EnableTraceLoggingKey, false);
+            TraceDumpValueBytes = GetInt(TraceDumpValueBytesKey, 128);
+            MfaEnabledNpsPolicy = GetString(MfaEnabledNpsPolicyKey, string.Empty).Trim();
+            AuthTimeout         = GetInt(AuthTimeoutKey, 60);
+            ServiceUrls         = GetString(ServiceUrlKey, string.Empty)
+                .Split(new[] { ';', ',' }, StringSplitOptions.RemoveEmptyEntries)
+                .Select(url => url.Trim())
+                .Where(url => url.Length > 0)
+                .DefaultIfEmpty("http://localhost:8000")
+                .ToList()
+                .AsReadOnly();
+            ServiceUrl          = ServiceUrls[0];
+            WaitBeforePoll      = GetInt(WaitBeforePollKey, 10);
+            PollInterval        = GetInt(PollIntervalKey, 1);
+            PollMaxSeconds      = GetInt(PollMaxSecondsKey, 60);
+            IgnoreSslErrors     = GetBool(IgnoreSslErrorsKey, false);
+            BasicAuthUsername   = GetString(BasicAuthUsernameKey, "");
+            BasicAuthPassword   = GetString(BasicAuthPasswordKey, "");
+            MfaCacheSeconds        = Math.Max(0, GetInt(MfaCacheSecondsKey, 0));
+            MfaCacheFailureSeconds = Math.Max(0, GetInt(MfaCacheFailureSecondsKey, 0));
+            MfaCacheMaxEntries     = Math.Max(1, GetInt(MfaCacheMaxEntriesKey, 10000));
+            GroupCacheSeconds         = Math.Max(0, GetInt(GroupCacheSecondsKey, 60));
+            GroupCacheNegativeSeconds = Math.Max(0, GetInt(GroupCacheNegativeSecondsKey, 10));
+            GroupCacheMaxEntries      = Math.Max(1, GetInt(GroupCacheMaxEntriesKey, 10000));
+            NativeMfaClient = GetBool(NativeMfaClientKey, false);
+            MfaMaxConcurrent       = Math.Max(0, GetInt(MfaMaxConcurrentKey, 0));
+            MfaMaxQueue            = Math.Max(0, GetInt(MfaMaxQueueKey, 100));
+            MfaQueueTimeoutSeconds = Math.Max(0, GetInt(MfaQueueTimeoutSecondsKey, 10));
+            MfaFailOpen            = GetBool(MfaFailOpenKey, false);
+            MfaCoalesceRequests    = GetBool(MfaCoalesceRequestsKey, true);
+            MfaKeepWarmSeconds     = Math.Max(0, GetInt(MfaKeepWarmSecondsKey, 20));
+            MfaBreakerFailurePercent = Math.Min(100, Math.Max(0, GetInt(MfaBreakerFailurePercentKey, 50)));
+            MfaBreakerMinRequests    = Math.Max(1, GetInt(MfaBreakerMinRequestsKey, 10));
+            MfaBreakerWindowSeconds  = Math.Max(1, GetInt(MfaBreakerWindowSecondsKey, 60));
+            MfaBreakerSlowSeconds    = Math.Max(0, GetInt(MfaBreakerSlowSecondsKey, 10));
+            MfaBreakerOpenSeconds    = Math.Max(1, GetInt(MfaBreakerOpenSecondsKey, 30));
+            MfaHedgeMinMs            = Math.Max(0, GetInt(MfaHedgeMinMsKey, 100));
+            GroupResolveTimeoutSeconds = Math.Max(0, GetInt(GroupResolveTimeoutSecondsKey, GroupSidResolver.DefaultTimeoutSeconds));
+            NoMfaGroups = GetString(NoMfaGroupsKey, string.Empty)
+                .Split(new[] { ';', ',' }, StringSplitOptions.RemoveEmptyEntries)
+                .Select(name => name.Trim())
+                .Where(name => name.Length > 0)
+                .ToList()
+                .AsReadOnly();
+            _noMfaGroupSids = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+            MfaRules = GetString(MfaRulesKey, string.Empty)
+                .Split(new[] { ';' }, StringSplitOptions.RemoveEmptyEntries)
+                .Select(rule => rule.Trim())
+                .Where(rule => rule.Length > 0)
+                .ToList()
+                .AsReadOnly();
+            MfaRulesTag = HashRules(MfaRules);
+            Rules = MfaRules.Select(MfaRule.Parse).ToList().AsReadOnly();
+        }
+
+        /// <summary>
+        /// Increases by one with every snapshot published by the same store.
+        /// </summary>
+        public long Version { get; }
+
+        /// <summary>
+        /// UTC time the snapshot was built.
+        /// </summary>
+        public DateTime LoadedAt { get; }
+
+        public bool EnableTraceLogging { get; }
+
+        /// <summary>
+        /// Value bytes shown per attribute in the trace dumps of events 122 and 123; the plugin uses
+        /// the default of 128 for values outside 1..4096.
+        /// </summary>
+        public int TraceDumpValueBytes { get; }
+
+        /// <summary>
+        /// Name of the NPS policy MFA is limited to; empty means every policy.
+        /// </summary>
+        public string MfaEnabledNpsPolicy { get; }
+
+        /// <summary>
+        /// Group names as configured in NoMfaGroups.
+        /// </summary>
+        public IReadOnlyList<string> NoMfaGroups { get; }
+
+        /// <summary>
+        /// SIDs of the NoMfaGroups that could be resolved when the snapshot was built.
+        /// </summary>
+        public IReadOnlyCollection<string> NoMfaGroupSids => _noMfaGroupSids;
+
+        /// <summary>
+        /// The same SIDs in binary form, for matching against a <see cref="GroupMembership"/>.
+        /// </summary>
+        public SidSet NoMfaSidSet { get; private set; } = SidSet.Empty;
+
+        public int AuthTimeout { get; }
+
+        /// <summary>
+        /// First of the <see cref="ServiceUrls"/>; the only one the managed Authenticator uses.
+        /// </summary>
+        public string ServiceUrl { get; }
+
+        /// <summary>
+        /// ServiceUrl split on ';' or ','. The native MFA client spreads requests over all of them.
+        /// </summary>
+        public IReadOnlyList<string> ServiceUrls { get; }
+
+        public int WaitBeforePoll { get; }
+        public int PollInterval { get; }
+        public int PollMaxSeconds { get; }
+        public bool IgnoreSslErrors { get; }
+        public string BasicAuthUsername { get; }
+        public string BasicAuthPassword { get; }
+
+        /// <summary>
+        /// How long a successful MFA is reused for the same user, NAS and policy; 0 disables the cache.
+        /// </summary>
+        public int MfaCacheSeconds { get; }
+
+        /// <summary>
+        /// How long a failed MFA is remembered; 0 (the default) never caches failures.
+        /// </summary>
+        public int MfaCacheFailureSeconds { get; }
+
+        public int MfaCacheMaxEntries { get; }
+
+        /// <summary>
+        /// How long a user's group membership is reused; 0 looks groups up on every request.
+        /// </summary>
+        public int GroupCacheSeconds { get; }
+
+        /// <summary>
+        /// How long "user not found" and failed group lookups are reused.
+        /// </summary>
+        public int GroupCacheNegativeSeconds { get; }
+
+        public int GroupCacheMaxEntries { get; }
+
+        /// <summary>
+        /// How long building a snapshot waits for the directory to resolve the configured groups; slower
+        /// groups keep their last known SID until the lookup finishes in the background.
+        /// </summary>
+        public int GroupResolveTimeoutSeconds { get; }
+
+        /// <summary>
+        /// Lets the native plugin talk to an http:// ServiceUrl itself instead of the managed Authenticator.
+        /// </summary>
+        public bool NativeMfaClient { get; }
+
+        /// <summary>
+        /// MFA exchanges allowed to run at the same time; 0 (the default) sets no limit.
+        /// </summary>
+        public int MfaMaxConcurrent { get; }
+
+        /// <summary>
+        /// Requests allowed to wait for a free MFA slot; more are turned away at once.
+        /// </summary>
+        public int MfaMaxQueue { get; }
+
+        /// <summary>
+        /// How long a request waits for a free MFA slot before it is turned away.
+        /// </summary>
+        public int MfaQueueTimeoutSeconds { get; }
+
+        /// <summary>
+        /// Accept instead of reject requests turned away by the MFA concurrency limit or the open circuit breaker.
+        /// </summary>
+        public bool MfaFailOpen { get; }
+
+        /// <summary>
+        /// Let retransmitted requests (same user, NAS and policy) wait for the MFA already in progress.
+        /// </summary>
+        public bool MfaCoalesceRequests { get; }
+
+        /// <summary>
+        /// How often the plugin keeps its connections to the MFA service open between requests; 0 only opens them at startup.
+        /// </summary>
+        public int MfaKeepWarmSeconds { get; }
+
+        /// <summary>
+        /// Share (percent) of failed or slow /Authenticate calls that opens the circuit breaker; 0 disables it.
+        /// </summary>
+        public int MfaBreakerFailurePercent { get; }
+
+        /// <summary>
+        /// Calls the breaker window must hold before <see cref="MfaBreakerFailurePercent"/> is looked at.
+        /// </summary>
+        public int MfaBreakerMinRequests { get; }
+
+        /// <summary>
+        /// Length of the rolling window of /Authenticate outcomes.
+        /// </summary>
+        public int MfaBreakerWindowSeconds { get; }
+
+        /// <summary>
+        /// /Authenticate calls slower than this count as failed; 0 counts none as slow.
+        /// </summary>
+        public int MfaBreakerSlowSeconds { get; }
+
+        /// <summary>
+        /// How long the breaker stays open before one request is let through as a probe.
+        /// </summary>
+        public int MfaBreakerOpenSeconds { get; }
+
+        /// <summary>
+        /// Lower bound of the delay after which a slow /AuthResult poll is also sent to a second ServiceUrl; 0 disables hedging.
+        /// </summary>
+        public int MfaHedgeMinMs { get; }
+
+        /// <summary>
+        /// Rule texts of MfaRules in configured order, separated by ';' (one per line in a REG_MULTI_SZ value).
+        /// The first matching rule decides whether a request needs MFA; without a match MfaEnabledNPSPolicy applies.
+        /// </summary>
+        public IReadOnlyList<string> MfaRules { get; }
+
+        /// <summary>
+        /// The parsed <see cref="MfaRules"/>, same order.
+        /// </summary>
+        public IReadOnlyList<MfaRule> Rules { get; }
+
+        /// <summary>
+        /// Hash of the <see cref="MfaRules"/> texts. Snapshots with the same rules have the same tag, so the
+        /// plugin compiles them only when they change and the adapter can tell that the compiled rules are its own.
+        /// </summary>
+        public long MfaRulesTag { get; }
+
+        /// <summary>
+        /// Checks if a group SID is one of the NoMfaGroups.
+        /// </summary>
+        public bool IsNoMfaGroup(string sid) {
+            return sid != null && _noMfaGroupSids.Contains(sid);
+        }
+
+        /// <summary>
+        /// Builds a snapshot from raw setting values and resolves the NoMfaGroups to SIDs.
+        /// </summary>
+        /// <param name="values">Setting values by name, as returned by an <see cref="IConfigSource"/></param>
+        /// <param name="version">Version to stamp on the snapshot</param>
+        /// <param name="resolveGroup">Group resolver, normally <see cref="Groups.ResolveGroup"/></param>
+        public static ConfigSnapshot Build(IDictionary<string, string> values, long version, Func<string, GroupResolutionResult> resolveGroup) {
+            return ResolveGroups(Create(values, version), resolveGroup);
+        }
+
+        /// <summary>
+        /// Builds a snapshot and resolves all its groups at once through <paramref name="groups"/>,
+        /// waiting at most <see cref="GroupResolveTimeoutSeconds"/> for the directory.
+        /// </summary>
+        /// <param name="lookup">False answers from the SIDs already known, without asking the directory</param>
+        public static ConfigSnapshot Build(IDictionary<string, string> values, long version, GroupSidResolver groups, bool lookup = true) {
+            var snapshot = Create(values, version);
+            var names = snapshot.NoMfaGroups.Concat(snapshot.Rules.SelectMany(rule => rule.Groups));
+            var resolved = lookup
+                ? groups.ResolveAll(names, TimeSpan.FromSeconds(snapshot.GroupResolveTimeoutSeconds))
+                : groups.ResolveKnown(names);
+            return ResolveGroups(snapshot, name => resolved.TryGetValue(name, out var result) ? result : null);
+        }
+
+        private static ConfigSnapshot Create(IDictionary<string, string> values, long version) {
+            var copy = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            if (values != null) {
+                foreach (var pair in values) {
+                    copy[pair.Key] = pair.Value;
+                }
+            }
+            return new ConfigSnapshot(copy, version);
+        }
+
+        private static ConfigSnapshot ResolveGroups(ConfigSnapshot snapshot, Func<string, GroupResolutionResult> resolveGroup) {
+            if (!string.IsNullOrEmpty(snapshot.MfaEnabledNpsPolicy)) {
+                Log.Event(Log.Level.Information, 201, $"MFA-enabled NPS policy set to: {snapshot.MfaEnabledNpsPolicy}");
+            }
+            else {
+                Log.Event(Log.Level.Information, 202, "MfaEnabledNPSPolicy registry value is empty or missing.");
+            }
+
+            if (snapshot.NoMfaGroups.Count == 0) {
+                Log.Event(Log.Level.Warning, 304, "NoMfaGroups registry value is empty or missing.");
+            }
+            foreach (var groupName in snapshot.NoMfaGroups) {
+                var result = resolveGroup?.Invoke(groupName);
+                if (result != null && result.Success) {
+                    snapshot._noMfaGroupSids.Add(result.Sid);
+                    Log.Event(Log.Level.Information, 140, $"NoMFA group added ({result.ContextName}): {groupName} (SID: {result.Sid})");
+                }
+                else if (result != null && !string.IsNullOrEmpty(result.Error)) {
+                    Log.Event(Log.Level.Warning, 302, $"Error resolving group '{groupName}' in {result.ContextName}: {result.Error}");
+                }
+                else {
+                    Log.Event(Log.Level.Warning, 303, $"NoMFA group not found: {groupName}");
+                }
+            }
+            snapshot.NoMfaSidSet = SidSet.FromStrings(snapshot._noMfaGroupSids);
+
+            foreach (var rule in snapshot.Rules.Where(rule => rule.HasGroups)) {
+                var sids = new List<string>();
+                foreach (var groupName in rule.Groups) {
+                    var result = resolveGroup?.Invoke(groupName);
+                    if (result != null && result.Success) {
+                        sids.Add(result.Sid);
+                    }
+                    else if (result != null && !string.IsNullOrEmpty(result.Error)) {
+                        Log.Event(Log.Level.Warning, 315, $"Error resolving group '{groupName}' of MFA rule '{rule.Name}' in {result.ContextName}: {result.Error}");
+                    }
+                    else {
+                        Log.Event(Log.Level.Warning, 315, $"Group '{groupName}' of MFA rule '{rule.Name}' not found");
+                    }
+                }
+                rule.GroupSids = SidSet.FromStrings(sids);
+            }
+            return snapshot;
+        }
+
+        /// <summary>
+        /// The setting values the snapshot was built from.
+        /// </summary>
+        internal IDictionary<string, string> Values => _values;
+
+        /// <summary>
+        /// True if the snapshot was built from exactly these setting values.
+        /// </summary>
+        internal bool HasSameValues(IDictionary<string, string> values) {
+            if (values == null || values.Count != _values.Count) {
+                return false;
+            }
+            foreach (var pair in values) {
+                if (!_values.TryGetValue(pair.Key, out var current) || !string.Equals(current, pair.Value, StringComparison.Ordinal)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // FNV-1a over the rule texts, each followed by a NUL; string.GetHashCode is not stable enough for this
+        private static long HashRules(IReadOnlyList<string> rules) {
+            ulong hash = 14695981039346656037;
+            foreach (var rule in rules) {
+                foreach (char c in rule) {
+                    hash = (hash ^ c) * 1099511628211;
+                }
+                hash *= 1099511628211;
+            }
+            return (long)hash;
+        }
+
+        // Same parsing rules as the Registry helper: numbers via int.TryParse, flags are on only when 1
+        private int GetInt(string name, int defaultValue) {
+            if (_values.TryGetValue(name, out var val) && int.TryParse(val, out int result))
+                return result;
+            return defaultValue;
+        }
+
+        private bool GetBool(string name, bool defaultValue) {
+            if (_values.TryGetValue(name, out var val) && int.TryParse(val, out int result))
+                return result == 1;
+            return defaultValue;
+        }
+
+        private string GetString(string name, string defaultValue) {
+            return _values.TryGetValue(name, out var val) && val != null ? val : defaultValue;
+        }
+    }
+}
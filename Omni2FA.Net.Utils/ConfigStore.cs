@@ -0,0 +1,231 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Publishes the current <see cref="ConfigSnapshot"/> and replaces it when the settings change.
+    /// <para>Reading <see cref="Current"/> is a single volatile load, so request threads never wait.
+    /// Snapshots are built, including group SID resolution, on the watcher thread (or the caller of
+    /// <see cref="Reload"/>) and swapped in whole; a request keeps using the snapshot it started with.
+    /// Groups are resolved through a <see cref="GroupSidResolver"/>; when its background lookups change a
+    /// SID, the current settings are rebuilt with the new SIDs as the next version.</para>
+    /// </summary>
+    public sealed class ConfigStore : IDisposable {
+        public const string RegPath = @"SOFTWARE\Omni2FA.NPS";
+        // Re-read even without a notification this often, in case one was missed
+        public const int DefaultRecheckMs = 60000;
+
+        private static readonly object _sharedLock = new object();
+        private static ConfigStore _shared;
+
+        private readonly IConfigSource _source;
+        private readonly GroupSidResolver _groups;
+        private readonly object _reloadLock = new object();
+        private readonly object _watchLock = new object();
+        private readonly ManualResetEvent _stop = new ManualResetEvent(false);
+        private ConfigSnapshot _current;
+        private Thread _watcher;
+        private bool _disposed = false;
+
+        /// <summary>
+        /// Raised after a new snapshot has been published, on the thread that built it.
+        /// </summary>
+        public event Action<ConfigSnapshot> Changed;
+
+        /// <param name="source">Where the settings are read from; owned by the store</param>
+        /// <param name="resolveGroup">Resolves NoMfaGroups entries; defaults to <see cref="Groups.ResolveGroup"/></param>
+        /// <param name="groupSnapshotPath">File that keeps the resolved group SIDs across restarts; null for none</param>
+        public ConfigStore(IConfigSource source, Func<string, GroupResolutionResult> resolveGroup = null, string groupSnapshotPath = null) {
+            _source = source ?? throw new ArgumentNullException(nameof(source));
+            _groups = new GroupSidResolver(resolveGroup ?? Groups.ResolveGroup, groupSnapshotPath);
+            _groups.Revalidated += OnGroupsRevalidated;
+        }
+
+        /// <summary>
+        /// The process-wide store backed by HKLM\SOFTWARE\Omni2FA.NPS, shared by the wrapper,
+        /// the adapter and the authenticator.
+        /// </summary>
+        public static ConfigStore Shared {
+            get {
+                var store = Volatile.Read(ref _shared);
+                if (store != null) {
+                    return store;
+                }
+                lock (_sharedLock) {
+                    if (_shared == null) {
+                        Volatile.Write(ref _shared, new ConfigStore(new RegistryConfigSource(RegPath), null, GroupSidResolver.DefaultSnapshotPath()));
+                    }
+                    return _shared;
+                }
+            }
+        }
+
+        public IConfigSource Source => _source;
+
+        public GroupSidResolver GroupSids => _groups;
+
+        /// <summary>
+        /// The latest snapshot. Loads the settings on first use; after that it never blocks.
+        /// </summary>
+        public ConfigSnapshot Current {
+            get {
+                var snapshot = Volatile.Read(ref _current);
+                return snapshot ?? LoadFirst();
+            }
+        }
+
+        /// <summary>
+        /// Reads the settings and publishes a new snapshot if they differ from the current one.
+        /// </summary>
+        /// <returns>True if a new snapshot was published</returns>
+        public bool Reload() {
+            lock (_reloadLock) {
+                var current = Volatile.Read(ref _current);
+                long version = current == null ? 1 : current.Version + 1;
+                ConfigSnapshot snapshot;
+                try {
+                    var values = _source.Load();
+                    if (current != null && current.HasSameValues(values)) {
+                        return false;
+                    }
+                    snapshot = ConfigSnapshot.Build(values, version, _groups);
+                }
+                catch (Exception ex) {
+                    Log.Event(Log.Level.Warning, 307, $"Configuration could not be read from {_source.Name}, keeping version {current?.Version ?? 0}: {ex.Message}");
+                    return false;
+                }
+                Volatile.Write(ref _current, snapshot);
+                if (current != null) {
+                    Log.Event(Log.Level.Information, 208, $"Configuration reloaded from {_source.Name} (version {snapshot.Version})");
+                }
+                RaiseChanged(snapshot);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Starts the background thread that waits for changes in the source and reloads.
+        /// Does nothing if it is already running.
+        /// </summary>
+        /// <param name="recheckMs">Upper bound between two reads when no change is signaled</param>
+        public void StartWatching(int recheckMs = DefaultRecheckMs) {
+            if (_disposed) throw new ObjectDisposedException(nameof(ConfigStore));
+            lock (_watchLock) {
+                if (_watcher != null) {
+                    return;
+                }
+                _stop.Reset();
+                _watcher = new Thread(() => Watch(recheckMs)) {
+                    IsBackground = true,
+                    Name = "Omni2FA config watcher"
+                };
+                _watcher.Start();
+            }
+        }
+
+        /// <summary>
+        /// Stops the watcher thread and waits for it to exit.
+        /// </summary>
+        public void StopWatching() {
+            Thread watcher;
+            lock (_watchLock) {
+                watcher = _watcher;
+                _watcher = null;
+                if (watcher == null) {
+                    return;
+                }
+                _stop.Set();
+            }
+            watcher.Join();
+        }
+
+        public bool IsWatching {
+            get {
+                lock (_watchLock) {
+                    return _watcher != null;
+                }
+            }
+        }
+
+        private void Watch(int recheckMs) {
+            while (!_stop.WaitOne(0)) {
+                bool changed;
+                try {
+                    changed = _source.WaitForChange(_stop, recheckMs);
+                }
+                catch (Exception ex) {
+                    Log.Event(Log.Level.Warning, 307, $"Waiting for configuration changes in {_source.Name} failed: {ex.Message}");
+                    changed = !_stop.WaitOne(recheckMs);
+                }
+                if (changed && !_stop.WaitOne(0)) {
+                    Log.Event(Log.Level.Trace, 13, $"Configuration change detected in {_source.Name}");
+                    Reload();
+                }
+            }
+        }
+
+        private ConfigSnapshot LoadFirst() {
+            Reload();
+            lock (_reloadLock) {
+                if (_current == null) {
+                    // Source could not be read at all: run on defaults until it can
+                    Volatile.Write(ref _current, ConfigSnapshot.Build(new Dictionary<string, string>(), 1, _groups));
+                }
+                return _current;
+            }
+        }
+
+        // Background group lookups changed a SID: same settings, new version, no directory calls
+        private void OnGroupsRevalidated() {
+            lock (_reloadLock) {
+                var current = Volatile.Read(ref _current);
+                if (current == null || _disposed) {
+                    return;
+                }
+                ConfigSnapshot snapshot;
+                try {
+                    snapshot = ConfigSnapshot.Build(current.Values, current.Version + 1, _groups, lookup: false);
+                }
+                catch (Exception ex) {
+                    Log.Event(Log.Level.Warning, 307, $"Configuration could not be rebuilt with revalidated group SIDs, keeping version {current.Version}: {ex.Message}");
+                    return;
+                }
+                Volatile.Write(ref _current, snapshot);
+                Log.Event(Log.Level.Information, 143, $"Configuration rebuilt with revalidated group SIDs (version {snapshot.Version})");
+                RaiseChanged(snapshot);
+            }
+        }
+
+        private void RaiseChanged(ConfigSnapshot snapshot) {
+            var handlers = Changed;
+            if (handlers == null) {
+                return;
+            }
+            foreach (Action<ConfigSnapshot> handler in handlers.GetInvocationList()) {
+                try {
+                    handler(snapshot);
+                }
+                catch (Exception ex) {
+                    Log.Event(Log.Level.Warning, 307, $"Configuration change handler failed: {ex.Message}");
+                }
+            }
+        }
+
+        public void Dispose() {
+            if (!_disposed) {
+                _groups.Revalidated -= OnGroupsRevalidated;
+                StopWatching();
+                _source.Dispose();
+                _stop.Dispose();
+                _disposed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Threading;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Reads settings from a text file with one Name=Value pair per line, using the same
+    /// value names as the registry. Lines starting with # or ; are comments and values
+    /// may be quoted. The file is polled for changes, so it works on any platform.
+    /// </summary>
+    /// <example>
+    /// ServiceUrl=https://mfa.example.com
+    /// NoMfaGroups=DOMAIN\Group1;DOMAIN\Group2
+    /// PollInterval=2
+    /// </example>
+    public sealed class FileConfigSource : IConfigSource {
+        private readonly int _pollMs;
+        private long _stamp = 0;
+
+        /// <param name="path">Settings file; it does not have to exist yet</param>
+        /// <param name="pollMs">How often the file time and size are checked</param>
+        public FileConfigSource(string path, int pollMs = 250) {
+            Path = path;
+            _pollMs = Math.Max(10, pollMs);
+        }
+
+        public string Path { get; }
+
+        public string Name => Path;
+
+        public IDictionary<string, string> Load() {
+            var values = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            // Stamp before reading, so a write that lands while reading is seen on the next poll
+            Interlocked.Exchange(ref _stamp, Stamp());
+            if (!File.Exists(Path)) {
+                return values;
+            }
+            foreach (var rawLine in File.ReadAllLines(Path)) {
+                var line = rawLine.Trim();
+                if (line.Length == 0 || line[0] == '#' || line[0] == ';') {
+                    continue;
+                }
+                int separator = line.IndexOf('=');
+                if (separator <= 0) {
+                    continue;
+                }
+                var name = line.Substring(0, separator).Trim();
+                var value = line.Substring(separator + 1).Trim();
+                if (value.Length >= 2 && value[0] == '"' && value[value.Length - 1] == '"') {
+                    value = value.Substring(1, value.Length - 2);
+                }
+                values[name] = value;
+            }
+            return values;
+        }
+
+        public bool WaitForChange(WaitHandle stop, int timeoutMs) {
+            int waited = 0;
+            while (waited < timeoutMs) {
+                int slice = Math.Min(_pollMs, timeoutMs - waited);
+                if (stop.WaitOne(slice)) {
+                    return false;
+                }
+                waited += slice;
+                if (Stamp() != Interlocked.Read(ref _stamp)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        private long Stamp() {
+            try {
+                var info = new FileInfo(Path);
+                return info.Exists ? info.LastWriteTimeUtc.Ticks ^ (info.Length << 1) ^ 1 : 0;
+            }
+            catch (Exception) {
+                return 0;
+            }
+        }
+
+        public void Dispose() {
+        }
+    }
+}
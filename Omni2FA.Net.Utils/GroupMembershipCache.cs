@@ -0,0 +1,298 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Group SIDs of one user as returned by an <see cref="IGroupDirectory"/>.
+    /// </summary>
+    public sealed class GroupMembership {
+        public GroupMembership(string userName, SidSet groupSids, string error) {
+            UserName = userName;
+            GroupSids = groupSids;
+            Error = error;
+        }
+
+        public string UserName { get; }
+
+        /// <summary>
+        /// Null if the user was not found or the lookup failed.
+        /// </summary>
+        public SidSet GroupSids { get; }
+
+        public string Error { get; }
+
+        public bool Success => GroupSids != null && string.IsNullOrEmpty(Error);
+
+        /// <summary>
+        /// Converts a <see cref="Groups.ResolveUserGroups"/> result.
+        /// </summary>
+        public static GroupMembership FromResult(string userName, UserResolutionResult result) {
+            if (result == null) {
+                return new GroupMembership(userName, null, null);
+            }
+            if (!string.IsNullOrEmpty(result.Error)) {
+                return new GroupMembership(userName, null, result.Error);
+            }
+            return new GroupMembership(userName, SidSet.FromStrings(result.GroupSids), null);
+        }
+    }
+
+    /// <summary>
+    /// Bounded cache of user group memberships in front of an <see cref="IGroupDirectory"/>.
+    /// <para>Found users are kept for the TTL; "not found" and failed lookups for the shorter
+    /// negative TTL, so a burst of requests for a bad user name does not hit the directory each
+    /// time. A found entry used after 80% of its TTL is reloaded in the background while the
+    /// cached one keeps being served, so busy users never wait for the directory.</para>
+    /// </summary>
+    public sealed class GroupMembershipCache {
+        public const int DefaultCapacity = 10000;
+        private const double RefreshAheadFraction = 0.8;
+
+        private readonly IGroupDirectory _directory;
+        private readonly Action<Action> _schedule;
+        private readonly Func<long> _clock;
+        private readonly Shard[] _shards;
+        private readonly int _shardMask;
+        private readonly long _ttlTicks;
+        private readonly long _refreshTicks;
+        private readonly long _negativeTtlTicks;
+        private long _refreshes;
+        private long _refreshFailures;
+
+        /// <param name="directory">Where memberships are loaded from</param>
+        /// <param name="capacity">Maximum number of users kept</param>
+        /// <param name="ttl">How long a found user is kept; zero or less disables caching</param>
+        /// <param name="negativeTtl">How long "not found" and failed lookups are kept</param>
+        /// <param name="schedule">Runs background refreshes; defaults to the thread pool</param>
+        /// <param name="clock">Current time in TimeSpan ticks; defaults to a monotonic clock</param>
+        public GroupMembershipCache(IGroupDirectory directory, int capacity, TimeSpan ttl, TimeSpan negativeTtl,
+            Action<Action> schedule = null, Func<long> clock = null) {
+            if (capacity <= 0) throw new ArgumentOutOfRangeException(nameof(capacity));
+            _directory = directory ?? throw new ArgumentNullException(nameof(directory));
+            _schedule = schedule ?? (work => ThreadPool.QueueUserWorkItem(_ => work()));
+            _clock = clock ?? MonotonicTicks;
+            Capacity = capacity;
+            Ttl = ttl > TimeSpan.Zero ? ttl : TimeSpan.Zero;
+            NegativeTtl = negativeTtl > TimeSpan.Zero ? negativeTtl : TimeSpan.Zero;
+            _ttlTicks = Ttl.Ticks;
+            _refreshTicks = (long)(Ttl.Ticks * RefreshAheadFraction);
+            _negativeTtlTicks = NegativeTtl.Ticks;
+
+            // Never more shards than entries, or some shards could hold nothing
+            int shards = 1;
+            while (shards < Environment.ProcessorCount * 2 && shards < 256 && shards * 2 <= capacity) {
+                shards <<= 1;
+            }
+            _shards = new Shard[shards];
+            _shardMask = shards - 1;
+            int perShard = capacity / shards;
+            int remainder = capacity % shards;
+            for (int i = 0; i < shards; i++) {
+                _shards[i] = new Shard(perShard + (i < remainder ? 1 : 0));
+            }
+        }
+
+        public int Capacity { get; }
+        public TimeSpan Ttl { get; }
+        public TimeSpan NegativeTtl { get; }
+
+        /// <summary>
+        /// Returns the groups of a user, from the cache when possible.
+        /// </summary>
+        public GroupMembership Resolve(string userName) {
+            if (string.IsNullOrWhiteSpace(userName)) {
+                return new GroupMembership(userName, null, null);
+            }
+            if (_ttlTicks == 0 && _negativeTtlTicks == 0) {
+                return GroupMembership.FromResult(userName, _directory.ResolveUserGroups(userName));
+            }
+
+            string key = userName.Trim().ToUpperInvariant();
+            var shard = ShardFor(key);
+            long now = _clock();
+            var entry = shard.Get(key, now);
+            if (entry != null) {
+                if (entry.RefreshAt != 0 && now >= entry.RefreshAt && Interlocked.CompareExchange(ref entry.Refreshing, 1, 0) == 0) {
+                    _schedule(() => Refresh(shard, key, userName));
+                }
+                return entry.Membership;
+            }
+
+            var membership = GroupMembership.FromResult(userName, _directory.ResolveUserGroups(userName));
+            Store(shard, key, membership, _clock());
+            return membership;
+        }
+
+        public void Clear() {
+            foreach (var shard in _shards) {
+                shard.Clear();
+            }
+        }
+
+        public GroupMembershipCacheStats GetStats() {
+            var stats = new GroupMembershipCacheStats {
+                Refreshes = Interlocked.Read(ref _refreshes),
+                RefreshFailures = Interlocked.Read(ref _refreshFailures)
+            };
+            foreach (var shard in _shards) {
+                shard.AddStats(ref stats);
+            }
+            return stats;
+        }
+
+        private void Refresh(Shard shard, string key, string userName) {
+            try {
+                var membership = GroupMembership.FromResult(userName, _directory.ResolveUserGroups(userName));
+                if (membership.Success) {
+                    Store(shard, key, membership, _clock());
+                    Interlocked.Increment(ref _refreshes);
+                    return;
+                }
+                Interlocked.Increment(ref _refreshFailures);
+            }
+            catch (Exception) {
+                Interlocked.Increment(ref _refreshFailures);
+            }
+            // The stale entry stays marked as refreshing, so a failing directory is not asked
+            // again on every request; it is served until it expires and then looked up normally
+        }
+
+        private void Store(Shard shard, string key, GroupMembership membership, long now) {
+            long ttl = membership.Success ? _ttlTicks : _negativeTtlTicks;
+            if (ttl == 0) {
+                return;
+            }
+            long refreshAt = membership.Success ? now + _refreshTicks : 0;
+            shard.Set(key, new Entry(membership, now + ttl, refreshAt));
+        }
+
+        private Shard ShardFor(string key) {
+            uint hash = (uint)StringComparer.Ordinal.GetHashCode(key);
+            hash ^= hash >> 16;
+            hash *= 0x45d9f3b;
+            hash ^= hash >> 16;
+            return _shards[hash & _shardMask];
+        }
+
+        private static readonly double TicksPerTimestamp = (double)TimeSpan.TicksPerSecond / Stopwatch.Frequency;
+
+        private static long MonotonicTicks() {
+            return (long)(Stopwatch.GetTimestamp() * TicksPerTimestamp);
+        }
+
+        private sealed class Entry {
+            public readonly GroupMembership Membership;
+            public readonly long ExpiresAt;
+            // 0 for entries that are not refreshed ahead (negative ones)
+            public readonly long RefreshAt;
+            public int Refreshing;
+
+            public Entry(GroupMembership membership, long expiresAt, long refreshAt) {
+                Membership = membership;
+                ExpiresAt = expiresAt;
+                RefreshAt = refreshAt;
+            }
+        }
+
+        private sealed class Shard {
+            private readonly object _lock = new object();
+            private readonly int _capacity;
+            private readonly Dictionary<string, LinkedListNode<KeyValuePair<string, Entry>>> _map =
+                new Dictionary<string, LinkedListNode<KeyValuePair<string, Entry>>>(StringComparer.Ordinal);
+            // Most recently used first
+            private readonly LinkedList<KeyValuePair<string, Entry>> _lru = new LinkedList<KeyValuePair<string, Entry>>();
+            private long _hits;
+            private long _negativeHits;
+            private long _misses;
+            private long _evictions;
+
+            public Shard(int capacity) {
+                _capacity = capacity;
+            }
+
+            public Entry Get(string key, long now) {
+                lock (_lock) {
+                    if (_map.TryGetValue(key, out var node)) {
+                        var entry = node.Value.Value;
+                        if (now < entry.ExpiresAt) {
+                            _lru.Remove(node);
+                            _lru.AddFirst(node);
+                            if (entry.Membership.Success) {
+                                _hits++;
+                            }
+                            else {
+                                _negativeHits++;
+                            }
+                            return entry;
+                        }
+                        _map.Remove(key);
+                        _lru.Remove(node);
+                    }
+                    _misses++;
+                    return null;
+                }
+            }
+
+            public void Set(string key, Entry entry) {
+                lock (_lock) {
+                    if (_map.TryGetValue(key, out var node)) {
+                        node.Value = new KeyValuePair<string, Entry>(key, entry);
+                        _lru.Remove(node);
+                        _lru.AddFirst(node);
+                        return;
+                    }
+                    if (_map.Count >= _capacity) {
+                        _map.Remove(_lru.Last.Value.Key);
+                        _lru.RemoveLast();
+                        _evictions++;
+                    }
+                    _map.Add(key, _lru.AddFirst(new KeyValuePair<string, Entry>(key, entry)));
+                }
+            }
+
+            public void Clear() {
+                lock (_lock) {
+                    _map.Clear();
+                    _lru.Clear();
+                }
+            }
+
+            public void AddStats(ref GroupMembershipCacheStats stats) {
+                lock (_lock) {
+                    stats.Hits += _hits;
+                    stats.NegativeHits += _negativeHits;
+                    stats.Misses += _misses;
+                    stats.Evictions += _evictions;
+                    stats.Count += _map.Count;
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Counters of a <see cref="GroupMembershipCache"/>.
+    /// </summary>
+    public struct GroupMembershipCacheStats {
+        public long Hits;
+        /// <summary>Cached "not found" or failed lookups served</summary>
+        public long NegativeHits;
+        public long Misses;
+        public long Evictions;
+        public long Refreshes;
+        public long RefreshFailures;
+        public long Count;
+
+        public override string ToString() {
+            return $"hits: {Hits}, negative hits: {NegativeHits}, misses: {Misses}, evictions: {Evictions}, " +
+                $"refreshes: {Refreshes} ({RefreshFailures} failed), entries: {Count}";
+        }
+    }
+}
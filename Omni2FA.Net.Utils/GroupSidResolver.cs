@@ -0,0 +1,323 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.DirectoryServices.AccountManagement;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Resolves the group names of the configuration (NoMfaGroups and MfaRules groups) to SIDs.
+    /// <para>All names are looked up in parallel and the caller waits at most the given timeout; a lookup
+    /// that is slower, or fails, is answered with the SID it had last time, and its late result is applied
+    /// in the background. Successful results are kept in a small snapshot file, so after a restart the
+    /// SIDs are available at once and are only revalidated against the directory in the background.
+    /// <see cref="Revalidated"/> is raised when a background lookup changes an answer already handed out.</para>
+    /// </summary>
+    public sealed class GroupSidResolver {
+        public const int DefaultTimeoutSeconds = 5;
+        public const string SnapshotFileName = "Omni2FA.NPS.groups";
+        private const string SnapshotHeader = "# Omni2FA group SIDs v1";
+
+        private readonly Func<string, GroupResolutionResult> _resolve;
+        private readonly object _lock = new object();
+        // Last answer per group name; the ones loaded from the snapshot file are marked until looked up again
+        private readonly Dictionary<string, Known> _known = new Dictionary<string, Known>(StringComparer.OrdinalIgnoreCase);
+        private readonly Dictionary<string, Task> _lookups = new Dictionary<string, Task>(StringComparer.OrdinalIgnoreCase);
+        // Names a ResolveAll call is currently waiting for; their results are not reported as revalidations
+        private readonly Dictionary<string, int> _awaited = new Dictionary<string, int>(StringComparer.OrdinalIgnoreCase);
+        private string _saved;
+        private bool _saveFailed;
+        private int _raiseQueued;
+
+        /// <summary>
+        /// Raised on a thread-pool thread when a background lookup found a different SID (or none) for a
+        /// group than the last <see cref="ResolveAll"/> or <see cref="ResolveKnown"/> returned.
+        /// </summary>
+        public event Action Revalidated;
+
+        /// <param name="resolve">Looks up one group, normally <see cref="Groups.ResolveGroup"/>; may block</param>
+        /// <param name="snapshotPath">File the SIDs are loaded from and saved to; null keeps them in memory only</param>
+        public GroupSidResolver(Func<string, GroupResolutionResult> resolve, string snapshotPath = null) {
+            _resolve = resolve ?? throw new ArgumentNullException(nameof(resolve));
+            SnapshotPath = snapshotPath;
+            if (snapshotPath != null) {
+                LoadSnapshot();
+            }
+        }
+
+        public string SnapshotPath { get; }
+
+        /// <summary>
+        /// The snapshot file next to this assembly, or null if its location is unknown.
+        /// </summary>
+        public static string DefaultSnapshotPath() {
+            try {
+                var dir = Path.GetDirectoryName(typeof(GroupSidResolver).Assembly.Location);
+                return string.IsNullOrEmpty(dir) ? null : Path.Combine(dir, SnapshotFileName);
+            }
+            catch (Exception) {
+                return null;
+            }
+        }
+
+        /// <summary>
+        /// Looks up all groups in parallel and returns their results by name.
+        /// <para>Groups known from the snapshot file are answered from it without waiting. For the others
+        /// the call waits up to <paramref name="timeout"/>; slower or failed lookups fall back to the last
+        /// known SID, or to a result with an error if there is none.</para>
+        /// </summary>
+        public IDictionary<string, GroupResolutionResult> ResolveAll(IEnumerable<string> names, TimeSpan timeout) {
+            var wanted = Distinct(names);
+            var answers = new Dictionary<string, GroupResolutionResult>(StringComparer.OrdinalIgnoreCase);
+            var waiting = new List<KeyValuePair<string, Task>>();
+            lock (_lock) {
+                Prune(wanted);
+                foreach (var name in wanted) {
+                    var lookup = StartLookup(name);
+                    if (_known.TryGetValue(name, out var known) && known.FromSnapshot) {
+                        answers[name] = Serve(name, known);
+                        continue;
+                    }
+                    _awaited.TryGetValue(name, out int count);
+                    _awaited[name] = count + 1;
+                    waiting.Add(new KeyValuePair<string, Task>(name, lookup));
+                }
+            }
+
+            if (waiting.Count > 0) {
+                // Lookups never fault (errors become results), so this only returns early on the timeout
+                Task.WaitAll(waiting.Select(pair => pair.Value).ToArray(), timeout > TimeSpan.Zero ? timeout : TimeSpan.Zero);
+            }
+
+            lock (_lock) {
+                foreach (var pair in waiting) {
+                    string name = pair.Key;
+                    if (--_awaited[name] == 0) {
+                        _awaited.Remove(name);
+                    }
+                    _known.TryGetValue(name, out var known);
+                    if (!pair.Value.IsCompleted) {
+                        if (known != null && known.Result.Success) {
+                            Log.Event(Log.Level.Warning, 302, $"Group '{name}' not resolved within {timeout.TotalSeconds:0.#} s, using its last known SID {known.Result.Sid}");
+                            answers[name] = Serve(name, known);
+                        }
+                        else {
+                            answers[name] = Serve(name, new Known(new GroupResolutionResult {
+                                GroupName = name,
+                                Error = $"not resolved within {timeout.TotalSeconds:0.#} s"
+                            }, null));
+                        }
+                    }
+                    else {
+                        answers[name] = Serve(name, known);
+                    }
+                }
+            }
+            return answers;
+        }
+
+        /// <summary>
+        /// Returns the last known results without asking the directory, to rebuild the configuration
+        /// after <see cref="Revalidated"/>.
+        /// </summary>
+        public IDictionary<string, GroupResolutionResult> ResolveKnown(IEnumerable<string> names) {
+            var answers = new Dictionary<string, GroupResolutionResult>(StringComparer.OrdinalIgnoreCase);
+            lock (_lock) {
+                foreach (var name in Distinct(names)) {
+                    if (_known.TryGetValue(name, out var known)) {
+                        answers[name] = Serve(name, known);
+                    }
+                }
+            }
+            return answers;
+        }
+
+        /// <summary>
+        /// Number of groups with a known SID.
+        /// </summary>
+        public int KnownCount {
+            get {
+                lock (_lock) {
+                    return _known.Values.Count(known => known.Result.Success);
+                }
+            }
+        }
+
+        private static List<string> Distinct(IEnumerable<string> names) {
+            return (names ?? Enumerable.Empty<string>())
+                .Where(name => !string.IsNullOrWhiteSpace(name))
+                .Distinct(StringComparer.OrdinalIgnoreCase)
+                .ToList();
+        }
+
+        // Called under _lock: returns the lookup already running for the name, or starts one
+        private Task StartLookup(string name) {
+            if (!_lookups.TryGetValue(name, out var lookup)) {
+                lookup = Task.Run(() => Lookup(name));
+                _lookups[name] = lookup;
+            }
+            return lookup;
+        }
+
+        private void Lookup(string name) {
+            GroupResolutionResult result;
+            try {
+                result = _resolve(name) ?? new GroupResolutionResult { GroupName = name };
+            }
+            catch (Exception ex) {
+                result = new GroupResolutionResult { GroupName = name, Error = ex.Message };
+            }
+
+            bool changed = false;
+            lock (_lock) {
+                _lookups.Remove(name);
+                _known.TryGetValue(name, out var previous);
+                Known current;
+                if (!string.IsNullOrEmpty(result.Error) && previous != null && previous.Result.Success) {
+                    // A failing directory does not take away a SID that was valid; the error is kept for the log
+                    current = new Known(previous.Result, result.Error);
+                }
+                else {
+                    current = new Known(result, result.Error);
+                }
+                _known[name] = current;
+                if (!_awaited.ContainsKey(name) && previous != null && previous.Served
+                    && !string.Equals(previous.ServedSid, current.Result.Sid, StringComparison.OrdinalIgnoreCase)) {
+                    Log.Event(Log.Level.Trace, 34, $"Group '{name}' resolved in the background to {current.Result.Sid ?? "no SID"} (was {previous.ServedSid ?? "no SID"})");
+                    changed = true;
+                }
+                SaveSnapshot();
+            }
+            if (changed && Interlocked.Exchange(ref _raiseQueued, 1) == 0) {
+                // Raised from its own work item: a handler that rebuilds the configuration may call
+                // ResolveAll and wait for lookups, this one included
+                ThreadPool.QueueUserWorkItem(_ => RaiseRevalidated());
+            }
+        }
+
+        private void RaiseRevalidated() {
+            Interlocked.Exchange(ref _raiseQueued, 0);
+            try {
+                Revalidated?.Invoke();
+            }
+            catch (Exception ex) {
+                Log.Event(Log.Level.Warning, 307, $"Group SID revalidation handler failed: {ex.Message}");
+            }
+        }
+
+        // Called under _lock: records what was handed out so a later background result can be compared with it
+        private GroupResolutionResult Serve(string name, Known known) {
+            if (!string.IsNullOrEmpty(known.LastError) && known.Result.Success) {
+                Log.Event(Log.Level.Warning, 302, $"Error resolving group '{name}' in {known.Result.ContextName}: {known.LastError}; using its last known SID {known.Result.Sid}");
+            }
+            // The error is reported once; the entry keeps whether it still needs confirming by a lookup
+            _known[name] = new Known(known.Result, null, known.FromSnapshot) { Served = true, ServedSid = known.Result.Sid };
+            return known.Result;
+        }
+
+        // Called under _lock: forgets groups that are no longer configured
+        private void Prune(List<string> wanted) {
+            var keep = new HashSet<string>(wanted, StringComparer.OrdinalIgnoreCase);
+            foreach (var name in _known.Keys.Where(name => !keep.Contains(name)).ToList()) {
+                _known.Remove(name);
+            }
+        }
+
+        private void LoadSnapshot() {
+            try {
+                if (!File.Exists(SnapshotPath)) {
+                    return;
+                }
+                var lines = File.ReadAllLines(SnapshotPath, Encoding.UTF8);
+                if (lines.Length == 0 || lines[0] != SnapshotHeader) {
+                    Log.Event(Log.Level.Warning, 319, $"Group SID snapshot {SnapshotPath} has an unknown format and is ignored");
+                    return;
+                }
+                int loaded;
+                lock (_lock) {
+                    foreach (var line in lines.Skip(1)) {
+                        var parts = line.Split('\t');
+                        if (parts.Length != 3 || parts[0].Length == 0 || !parts[1].StartsWith("S-", StringComparison.OrdinalIgnoreCase)) {
+                            continue;
+                        }
+                        bool isLocal = parts[2] == "L";
+                        _known[parts[0]] = new Known(new GroupResolutionResult {
+                            GroupName = parts[0],
+                            Sid = parts[1],
+                            IsLocal = isLocal,
+                            ContextType = isLocal ? ContextType.Machine : ContextType.Domain
+                        }, null, true);
+                    }
+                    _saved = FormatSnapshot();
+                    loaded = _known.Count;
+                }
+                Log.Event(Log.Level.Information, 142, $"Loaded {loaded} group SIDs from {SnapshotPath}; revalidating them in the background");
+            }
+            catch (Exception ex) {
+                Log.Event(Log.Level.Warning, 319, $"Group SID snapshot {SnapshotPath} could not be read: {ex.Message}");
+            }
+        }
+
+        // Called under _lock; the file is small and only written when a SID changes
+        private void SaveSnapshot() {
+            if (SnapshotPath == null) {
+                return;
+            }
+            var text = FormatSnapshot();
+            if (text == _saved) {
+                return;
+            }
+            try {
+                var temp = SnapshotPath + ".tmp";
+                File.WriteAllText(temp, text, new UTF8Encoding(false));
+                if (File.Exists(SnapshotPath)) {
+                    File.Replace(temp, SnapshotPath, null);
+                }
+                else {
+                    File.Move(temp, SnapshotPath);
+                }
+                _saved = text;
+                _saveFailed = false;
+            }
+            catch (Exception ex) {
+                if (!_saveFailed) {
+                    Log.Event(Log.Level.Warning, 319, $"Group SID snapshot {SnapshotPath} could not be written: {ex.Message}");
+                    _saveFailed = true;
+                }
+            }
+        }
+
+        private string FormatSnapshot() {
+            var text = new StringBuilder(SnapshotHeader).Append('\n');
+            foreach (var pair in _known.Where(pair => pair.Value.Result.Success).OrderBy(pair => pair.Key, StringComparer.OrdinalIgnoreCase)) {
+                text.Append(pair.Key).Append('\t').Append(pair.Value.Result.Sid).Append('\t')
+                    .Append(pair.Value.Result.IsLocal ? 'L' : 'D').Append('\n');
+            }
+            return text.ToString();
+        }
+
+        private sealed class Known {
+            public readonly GroupResolutionResult Result;
+            // Error of the last lookup when Result is an older successful one
+            public readonly string LastError;
+            public readonly bool FromSnapshot;
+            public bool Served;
+            public string ServedSid;
+
+            public Known(GroupResolutionResult result, string lastError, bool fromSnapshot = false) {
+                Result = result;
+                LastError = lastError;
+                FromSnapshot = fromSnapshot;
+            }
+        }
+    }
+}
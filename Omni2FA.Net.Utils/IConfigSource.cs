@@ -0,0 +1,34 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Where <see cref="ConfigStore"/> reads its settings from: the registry on NPS servers,
+    /// or a plain text file for tests and non-Windows hosts.
+    /// </summary>
+    public interface IConfigSource : IDisposable {
+        /// <summary>
+        /// Human-readable location used in log messages.
+        /// </summary>
+        string Name { get; }
+
+        /// <summary>
+        /// Reads all setting values by name. A missing location yields an empty dictionary.
+        /// </summary>
+        IDictionary<string, string> Load();
+
+        /// <summary>
+        /// Blocks the watcher thread until the settings may have changed, the timeout elapses
+        /// or <paramref name="stop"/> is set. Only ever called from a single thread.
+        /// </summary>
+        /// <returns>True if the settings should be read again, false on stop or when nothing changed</returns>
+        bool WaitForChange(WaitHandle stop, int timeoutMs);
+    }
+}
@@ -0,0 +1,29 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Looks up the groups of a user. Lets <see cref="GroupMembershipCache"/> run against
+    /// Active Directory in NPS and against a fake directory in tests.
+    /// </summary>
+    public interface IGroupDirectory {
+        /// <summary>
+        /// Same contract as <see cref="Groups.ResolveUserGroups"/>: null if the user does not exist,
+        /// a result with <see cref="UserResolutionResult.Error"/> set if the lookup failed.
+        /// </summary>
+        UserResolutionResult ResolveUserGroups(string userName);
+    }
+
+    /// <summary>
+    /// The local SAM or Active Directory, through <see cref="Groups"/>.
+    /// </summary>
+    public sealed class PrincipalGroupDirectory : IGroupDirectory {
+        public UserResolutionResult ResolveUserGroups(string userName) {
+            return Groups.ResolveUserGroups(userName);
+        }
+    }
+}
@@ -148,19 +148,7 @@ namespace Omni2FA.Net.Utils {
                 logMessage.Add($"-Network Policy Name: '{Radius.AttributeLookup(control.Request, RadiusAttributeType.PolicyName)}'");
             }
             Event(Level.Trace, 121, "Authorization request", logMessage);
-
-            string s = "";
-            foreach (var attr in Radius.AttributesToList(control.Request)) {
-                s += " | " + Str.sanitize(attr);
-            }
-            Event(Level.Trace, 122, $"Request components: {s}");
-
-
-            s = "";
-            foreach (var attr in Radius.AttributesToList(control.Response[RadiusCode.AccessAccept])) {
-                s += " ~ " + Str.sanitize(attr);
-            }
-            Event(Level.Trace, 123, $"Response components: {s}");
+            // Events 122 and 123, the full attribute dumps, are written by the native plugin
         }
 
         /// <summary>
@@ -0,0 +1,72 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Diagnostics;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Request phases with a latency histogram; the values are the indexes of MetricsPhase in metrics.h.
+    /// </summary>
+    public enum MetricsPhase {
+        Init = 0,
+        Process = 1,
+        Lookup = 2,
+        Groups = 3,
+        Authenticate = 4,
+        AuthResult = 5
+    }
+
+    /// <summary>
+    /// Counted request outcomes; the values are the indexes of MetricsCounter in metrics.h.
+    /// </summary>
+    public enum MetricsCounter {
+        ShortCircuited = 0,
+        MfaSucceeded = 1,
+        MfaFailed = 2,
+        MfaCircuitRejected = 3,
+        MfaCircuitOpened = 4
+    }
+
+    /// <summary>
+    /// Forwards phase timings and counters to the per-thread histograms of Omni2FA.NPS.Plugin.
+    /// Nothing is recorded until the plugin sets the sinks, e.g. in unit tests.
+    /// </summary>
+    public static class Metrics {
+        /// <summary>
+        /// Set by Omni2FA.NPS.Plugin: phase index and duration in microseconds.
+        /// </summary>
+        public static Action<int, long> Sink;
+
+        /// <summary>
+        /// Set by Omni2FA.NPS.Plugin: counter index.
+        /// </summary>
+        public static Action<int> CounterSink;
+
+        /// <summary>
+        /// Returns a timestamp to pass to <see cref="Record"/> when the phase ends.
+        /// </summary>
+        public static long Start() {
+            return Stopwatch.GetTimestamp();
+        }
+
+        /// <summary>
+        /// Records the time elapsed since <paramref name="start"/> for the phase.
+        /// </summary>
+        public static void Record(MetricsPhase phase, long start) {
+            var sink = Sink;
+            if (sink == null) {
+                return;
+            }
+            long ticks = Stopwatch.GetTimestamp() - start;
+            sink((int)phase, ticks * 1000000 / Stopwatch.Frequency);
+        }
+
+        public static void Increment(MetricsCounter counter) {
+            CounterSink?.Invoke((int)counter);
+        }
+    }
+}
@@ -0,0 +1,47 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Diagnostics;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Forwards to the circuit breaker of Omni2FA.NPS.Plugin (mfabreaker.h), which both MFA clients share.
+    /// Without the sinks, e.g. in unit tests, every call is allowed and nothing is recorded.
+    /// </summary>
+    public static class MfaBreaker {
+        /// <summary>
+        /// Set by Omni2FA.NPS.Plugin: whether a request may call the MFA service now.
+        /// </summary>
+        public static Func<bool> AllowSink;
+
+        /// <summary>
+        /// Set by Omni2FA.NPS.Plugin: whether the /Authenticate call failed and its duration in microseconds.
+        /// </summary>
+        public static Action<bool, long> RecordSink;
+
+        /// <summary>
+        /// False while the breaker is open and, while it is half-open, for all requests but the probe.
+        /// </summary>
+        public static bool Allow() {
+            var sink = AllowSink;
+            return sink == null || sink();
+        }
+
+        /// <summary>
+        /// Reports one /Authenticate call that started at the <see cref="Metrics.Start"/> timestamp <paramref name="start"/>.
+        /// A user who denies the push is not a failure.
+        /// </summary>
+        public static void Record(bool failed, long start) {
+            var sink = RecordSink;
+            if (sink == null) {
+                return;
+            }
+            long ticks = Stopwatch.GetTimestamp() - start;
+            sink(failed, ticks * 1000000 / Stopwatch.Frequency);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// One entry of the MfaRules setting, e.g. <c>Admins: mfa if policy=Secure VPN &amp; groups=DOMAIN\NPS Admins</c>.
+    /// <para>The plugin compiles and evaluates the rules natively (mfarules.cpp). Only what that
+    /// cannot do is kept here: the action and name for logging, and the groups condition, which
+    /// needs the group SIDs of the user.</para>
+    /// </summary>
+    public sealed class MfaRule {
+        private MfaRule(string name, bool requiresMfa, IReadOnlyList<string> groups) {
+            Name = name;
+            RequiresMfa = requiresMfa;
+            Groups = groups;
+            GroupSids = SidSet.Empty;
+        }
+
+        public string Name { get; }
+
+        /// <summary>
+        /// True for <c>mfa</c> rules, false for <c>skip</c> rules.
+        /// </summary>
+        public bool RequiresMfa { get; }
+
+        /// <summary>
+        /// Group names of the groups condition; empty if the rule has none.
+        /// </summary>
+        public IReadOnlyList<string> Groups { get; }
+
+        public bool HasGroups => Groups.Count > 0;
+
+        /// <summary>
+        /// SIDs of the groups that could be resolved, set when the snapshot is built.
+        /// </summary>
+        public SidSet GroupSids { get; internal set; }
+
+        /// <summary>
+        /// Reads the parts of a rule the adapter needs. The text is not validated; the plugin
+        /// rejects the whole rule set if any rule is invalid.
+        /// </summary>
+        public static MfaRule Parse(string text) {
+            text = (text ?? string.Empty).Trim();
+            int colon = text.IndexOf(':');
+            string name = colon >= 0 ? text.Substring(0, colon).Trim() : text;
+            string rest = colon >= 0 ? text.Substring(colon + 1).Trim() : string.Empty;
+            bool requiresMfa = !StartsWithWord(rest, "skip");
+            var groups = new List<string>();
+            int conditions = rest.IndexOf(" if ", StringComparison.OrdinalIgnoreCase);
+            if (conditions >= 0) {
+                foreach (var condition in rest.Substring(conditions + 4).Split('&')) {
+                    int equals = condition.IndexOf('=');
+                    if (equals > 0 && string.Equals(condition.Substring(0, equals).Trim(), "groups", StringComparison.OrdinalIgnoreCase)) {
+                        groups.AddRange(condition.Substring(equals + 1).Split(',')
+                            .Select(group => group.Trim())
+                            .Where(group => group.Length > 0));
+                    }
+                }
+            }
+            return new MfaRule(name, requiresMfa, groups.AsReadOnly());
+        }
+
+        private static bool StartsWithWord(string text, string word) {
+            return text.StartsWith(word, StringComparison.OrdinalIgnoreCase) &&
+                (text.Length == word.Length || char.IsWhiteSpace(text[word.Length]));
+        }
+    }
+}
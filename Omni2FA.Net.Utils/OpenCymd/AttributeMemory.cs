@@ -0,0 +1,36 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+namespace OpenCymd.Nps.Plugin {
+    using System;
+    using System.Runtime.InteropServices;
+
+    /// <summary>
+    /// Allocator for the native attribute values built by <see cref="RadiusAttribute"/>.
+    /// Omni2FA.NPS.Plugin points it at RadiusAlloc/RadiusFree, so the values come from the request arena;
+    /// without the plugin, e.g. in unit tests, the process heap is used.
+    /// </summary>
+    public static class AttributeMemory {
+        /// <summary>
+        /// Allocates the given number of bytes of unmanaged memory.
+        /// </summary>
+        public static Func<int, IntPtr> Allocate = Marshal.AllocHGlobal;
+
+        /// <summary>
+        /// Releases memory returned by <see cref="Allocate"/>.
+        /// </summary>
+        public static Action<IntPtr> Free = Marshal.FreeHGlobal;
+
+        /// <summary>
+        /// Restores the process heap allocator.
+        /// </summary>
+        public static void Reset() {
+            Allocate = Marshal.AllocHGlobal;
+            Free = Marshal.FreeHGlobal;
+        }
+    }
+}
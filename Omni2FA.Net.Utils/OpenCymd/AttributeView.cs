@@ -0,0 +1,368 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+
+namespace OpenCymd.Nps.Plugin {
+    using System;
+    using System.Net;
+    using System.Runtime.InteropServices;
+    using System.Text;
+
+    using OpenCymd.Nps.Plugin.Native;
+
+    /// <summary>
+    /// Read-only view of an attribute value in the buffer owned by NPS, the managed counterpart of
+    /// RADIUS_VALUE_VIEW in radutil.h. Text values are trimmed like <c>Str.sanitize</c> without being copied;
+    /// comparisons run in place and a string is only made by <see cref="ToString"/>.
+    /// A view is only valid during the request its attribute belongs to.
+    /// </summary>
+    public struct AttributeView {
+        private readonly int attributeId;
+
+        private readonly RADIUS_DATA_TYPE dataType;
+
+        private readonly IntPtr data;
+
+        private readonly int offset;
+
+        private readonly int length;
+
+        private readonly uint dwValue;
+
+        // Value of an attribute built in managed code, which has no native buffer
+        private readonly object managedValue;
+
+        internal AttributeView(int attributeId, RADIUS_DATA_TYPE dataType, IntPtr data, int length, uint dwValue) {
+            this.attributeId = attributeId;
+            this.dataType = dataType;
+            this.data = data;
+            this.offset = 0;
+            this.length = data == IntPtr.Zero ? 0 : length;
+            this.dwValue = dwValue;
+            this.managedValue = null;
+            if (IsText(dataType) && attributeId != (int)RadiusAttributeType.VendorSpecific) {
+                this.Trim(ref this.offset, ref this.length);
+            }
+        }
+
+        internal AttributeView(int attributeId, object value) {
+            this.attributeId = attributeId;
+            this.dataType = RADIUS_DATA_TYPE.rdtUnknown;
+            this.data = IntPtr.Zero;
+            this.offset = 0;
+            this.length = 0;
+            this.dwValue = 0;
+            this.managedValue = value;
+        }
+
+        // View of a sub-attribute value at offset within a native Vendor-Specific value
+        private AttributeView(IntPtr data, int offset, int length) {
+            this.attributeId = (int)RadiusAttributeType.VendorSpecific;
+            this.dataType = RADIUS_DATA_TYPE.rdtString;
+            this.data = data;
+            this.offset = offset;
+            this.length = length;
+            this.dwValue = 0;
+            this.managedValue = null;
+        }
+
+        /// <summary>
+        /// Returns a view of a text value of <paramref name="length"/> bytes at <paramref name="data"/>.
+        /// </summary>
+        public static AttributeView FromBuffer(int attributeId, IntPtr data, int length) {
+            return new AttributeView(attributeId, RADIUS_DATA_TYPE.rdtString, data, length, 0);
+        }
+
+        /// <summary>
+        /// Gets the ID of the attribute according to RFC2865, 0 for the view of a missing attribute.
+        /// </summary>
+        public int AttributeId {
+            get {
+                return this.attributeId;
+            }
+        }
+
+        /// <summary>
+        /// Gets a value indicating whether the view refers to no attribute.
+        /// </summary>
+        public bool IsEmpty {
+            get {
+                return this.attributeId == 0 && this.managedValue == null;
+            }
+        }
+
+        /// <summary>
+        /// Gets the length in bytes of a native text or IPv6 value.
+        /// </summary>
+        public int Length {
+            get {
+                return this.length;
+            }
+        }
+
+        /// <summary>
+        /// Returns the byte at <paramref name="index"/> of a native text or IPv6 value.
+        /// </summary>
+        public byte this[int index] {
+            get {
+                if (index < 0 || index >= this.length) {
+                    throw new ArgumentOutOfRangeException("index");
+                }
+
+                return Marshal.ReadByte(this.data, this.offset + index);
+            }
+        }
+
+        /// <summary>
+        /// Finds the first sub-attribute of <paramref name="vendorId"/> and <paramref name="vendorType"/> in a
+        /// Vendor-Specific value, the managed counterpart of RadiusFindVsa in radutil.h. The value is walked in
+        /// place and <paramref name="value"/> views the sub-attribute data without copying it. A native value
+        /// with a malformed sub-attribute is skipped as a whole.
+        /// </summary>
+        public bool TryGetVendorAttribute(uint vendorId, byte vendorType, out AttributeView value) {
+            value = default(AttributeView);
+            if (this.attributeId != (int)RadiusAttributeType.VendorSpecific) {
+                return false;
+            }
+
+            if (this.managedValue != null) {
+                var vsa = this.managedValue as VendorSpecificAttribute;
+                if (vsa == null || vsa.VendorId != vendorId || vsa.VendorType != vendorType) {
+                    return false;
+                }
+
+                value = new AttributeView(this.attributeId, vsa.Data);
+                return true;
+            }
+
+            if (this.data == IntPtr.Zero || this.offset != 0 || this.length < 6 ||
+                VendorSpecificAttribute.ReadVendorId(this.data) != vendorId) {
+                return false;
+            }
+
+            int found = -1;
+            int position = 4;
+            while (position < this.length) {
+                int subLength = this.length - position < 2 ? 0 : Marshal.ReadByte(this.data, position + 1);
+                if (subLength < 2 || subLength > this.length - position) {
+                    return false;
+                }
+
+                if (found < 0 && Marshal.ReadByte(this.data, position) == vendorType) {
+                    found = position;
+                }
+
+                position += subLength;
+            }
+
+            if (found < 0) {
+                return false;
+            }
+
+            value = new AttributeView(this.data, found + 2, Marshal.ReadByte(this.data, found + 1) - 2);
+            return true;
+        }
+
+        public bool TryGetInteger(out uint value) {
+            if (this.managedValue != null) {
+                if (this.managedValue is uint) {
+                    value = (uint)this.managedValue;
+                    return true;
+                }
+
+                if (this.managedValue is int) {
+                    value = (uint)(int)this.managedValue;
+                    return true;
+                }
+
+                value = 0;
+                return false;
+            }
+
+            value = this.dwValue;
+            return this.dataType == RADIUS_DATA_TYPE.rdtInteger;
+        }
+
+        public bool TryGetTime(out DateTime value) {
+            if (this.managedValue != null) {
+                var managed = this.managedValue as DateTime?;
+                value = managed ?? default(DateTime);
+                return managed.HasValue;
+            }
+
+            value = this.dataType == RADIUS_DATA_TYPE.rdtTime ? new DateTime(this.dwValue) : default(DateTime);
+            return this.dataType == RADIUS_DATA_TYPE.rdtTime;
+        }
+
+        public bool TryGetAddress(out IPAddress value) {
+            if (this.managedValue != null) {
+                value = this.managedValue as IPAddress;
+                return value != null;
+            }
+
+            switch (this.dataType) {
+                case RADIUS_DATA_TYPE.rdtAddress:
+                    // as of Win 2008, dwValue arrives in Network Byte Order, which is exactly what the constructor expects
+                    value = new IPAddress(this.dwValue);
+                    return true;
+                case RADIUS_DATA_TYPE.rdtIpv6Address:
+                    if (this.length == 16) {
+                        value = new IPAddress(this.ToArray());
+                        return true;
+                    }
+
+                    break;
+            }
+
+            value = null;
+            return false;
+        }
+
+        /// <summary>
+        /// Compares the text value with <paramref name="value"/> without copying it. Ordinal and
+        /// OrdinalIgnoreCase are compared in place as long as both sides are ASCII; anything else
+        /// compares <see cref="ToString"/>.
+        /// </summary>
+        public bool Equals(string value, StringComparison comparison) {
+            if (value == null) {
+                return false;
+            }
+
+            if (this.managedValue == null && IsText(this.dataType) &&
+                (comparison == StringComparison.Ordinal || comparison == StringComparison.OrdinalIgnoreCase)) {
+                bool? result = this.EqualsAscii(value, comparison == StringComparison.OrdinalIgnoreCase);
+                if (result.HasValue) {
+                    return result.Value;
+                }
+            }
+
+            return string.Equals(this.ToString(), value, comparison);
+        }
+
+        /// <summary>
+        /// Copies a native text or IPv6 value into a new array.
+        /// </summary>
+        public byte[] ToArray() {
+            var bytes = new byte[this.length];
+            if (this.length > 0) {
+                Marshal.Copy(this.data + this.offset, bytes, 0, this.length);
+            }
+
+            return bytes;
+        }
+
+        /// <summary>
+        /// Returns the value as <c>Radius.AttributeLookup</c> reports it; text is decoded with the ANSI code page.
+        /// </summary>
+        public override string ToString() {
+            if (this.managedValue != null) {
+                var bytes = this.managedValue as byte[];
+                return Sanitize(bytes != null ? Encoding.Default.GetString(bytes) : this.managedValue.ToString());
+            }
+
+            if (this.IsEmpty) {
+                return string.Empty;
+            }
+
+            // A sub-attribute view starts past the vendor header and shows its data as text
+            if (this.attributeId == (int)RadiusAttributeType.VendorSpecific && this.data != IntPtr.Zero && this.offset == 0) {
+                return Sanitize(new VendorSpecificAttribute(this.data).ToString());
+            }
+
+            switch (this.dataType) {
+                case RADIUS_DATA_TYPE.rdtInteger:
+                    return this.dwValue.ToString();
+                case RADIUS_DATA_TYPE.rdtTime:
+                    return new DateTime(this.dwValue).ToString();
+                case RADIUS_DATA_TYPE.rdtAddress:
+                case RADIUS_DATA_TYPE.rdtIpv6Address:
+                    IPAddress address;
+                    return this.TryGetAddress(out address) ? address.ToString() : string.Empty;
+            }
+
+            if (this.length == 0) {
+                return string.Empty;
+            }
+
+            return Marshal.PtrToStringAnsi(this.data + this.offset, this.length);
+        }
+
+        private static bool IsText(RADIUS_DATA_TYPE dataType) {
+            return dataType == RADIUS_DATA_TYPE.rdtString || dataType == RADIUS_DATA_TYPE.rdtUnknown;
+        }
+
+        private static bool IsBlank(byte b) {
+            return b == ' ' || (b >= '\t' && b <= '\r');
+        }
+
+        // Same rule as Str.sanitize: drop a trailing NUL, or else trim blanks
+        private static string Sanitize(string value) {
+            if (value.Length == 0) {
+                return value;
+            }
+
+            return value[value.Length - 1] == '\0' ? value.Substring(0, value.Length - 1) : value.Trim();
+        }
+
+        private void Trim(ref int start, ref int count) {
+            if (count == 0) {
+                return;
+            }
+
+            if (Marshal.ReadByte(this.data, start + count - 1) == 0) {
+                count--;
+                return;
+            }
+
+            while (count > 0 && IsBlank(Marshal.ReadByte(this.data, start + count - 1))) {
+                count--;
+            }
+
+            while (count > 0 && IsBlank(Marshal.ReadByte(this.data, start))) {
+                start++;
+                count--;
+            }
+        }
+
+        // Null if either side has a non-ASCII character, whose case folding depends on the code page
+        private bool? EqualsAscii(string value, bool ignoreCase) {
+            if (value.Length != this.length) {
+                foreach (char c in value) {
+                    if (c >= 0x80) {
+                        return null;
+                    }
+                }
+
+                for (int i = 0; i < this.length; i++) {
+                    if (Marshal.ReadByte(this.data, this.offset + i) >= 0x80) {
+                        return null;
+                    }
+                }
+
+                return false;
+            }
+
+            bool equal = true;
+            for (int i = 0; i < this.length; i++) {
+                int a = Marshal.ReadByte(this.data, this.offset + i);
+                int b = value[i];
+                if (a >= 0x80 || b >= 0x80) {
+                    return null;
+                }
+
+                if (a == b) {
+                    continue;
+                }
+
+                if (!ignoreCase || (a | 0x20) != (b | 0x20) || (a | 0x20) < 'a' || (a | 0x20) > 'z') {
+                    equal = false;
+                }
+            }
+
+            return equal;
+        }
+    }
+}
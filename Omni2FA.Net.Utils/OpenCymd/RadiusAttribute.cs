@@ -90,6 +90,24 @@ namespace OpenCymd.Nps.Plugin {
             }
         }
 
+        /// <summary>
+        /// Gets a view of the value in the buffer owned by NPS, without copying it like <see cref="Value"/> does.
+        /// </summary>
+        public virtual AttributeView View {
+            get {
+                if (this.value != null || this.radiusAttributePtr == IntPtr.Zero) {
+                    return new AttributeView((int)this.attributeId, this.value);
+                }
+
+                return new AttributeView(
+                    (int)this.radiusAttribute.dwAttrType,
+                    this.radiusAttribute.fDataType,
+                    IsBufferType(this.radiusAttribute.fDataType) ? this.radiusAttribute.Value.lpValue : IntPtr.Zero,
+                    (int)this.radiusAttribute.cbDataLength,
+                    IsBufferType(this.radiusAttribute.fDataType) ? 0 : this.radiusAttribute.Value.dwValue);
+            }
+        }
+
         /// <summary>
         /// Gets the native representation of this attribute. The caller is responsible to free the memory allocated in this method with a call to <see cref="FreeNativeAttribute"/>.
         /// </summary>
@@ -113,7 +131,7 @@ namespace OpenCymd.Nps.Plugin {
 
             var ip = this.value as IPAddress;
             if (ip != null && ip.AddressFamily == AddressFamily.InterNetworkV6) {
-                Marshal.FreeHGlobal(this.radiusAttribute.Value.lpValue);
+                AttributeMemory.Free(this.radiusAttribute.Value.lpValue);
                 this.radiusAttribute = null;
                 return;
             }
@@ -121,7 +139,7 @@ namespace OpenCymd.Nps.Plugin {
             if (this.value is string ||
                 this.value is byte[] ||
                 this.value is VendorSpecificAttribute) {
-                Marshal.FreeHGlobal(this.radiusAttribute.Value.lpValue);
+                AttributeMemory.Free(this.radiusAttribute.Value.lpValue);
                 this.radiusAttribute = null;
             }
         }
@@ -136,7 +154,7 @@ namespace OpenCymd.Nps.Plugin {
                         break;
                     case AddressFamily.InterNetworkV6:
                         this.radiusAttribute.fDataType = RADIUS_DATA_TYPE.rdtIpv6Address;
-                        this.radiusAttribute.Value.lpValue = Marshal.AllocHGlobal(ip.GetAddressBytes().Length);
+                        this.radiusAttribute.Value.lpValue = AttributeMemory.Allocate(ip.GetAddressBytes().Length);
                         this.radiusAttribute.cbDataLength = (uint)ip.GetAddressBytes().Length;
                         Marshal.Copy(
                             ip.GetAddressBytes(), 0, this.radiusAttribute.Value.lpValue, ip.GetAddressBytes().Length);
@@ -154,7 +172,7 @@ namespace OpenCymd.Nps.Plugin {
 
                 // Marshal.StringToHGlobal* are inappropriate as they are not UTF8 and include a terminating null char
                 var utf8 = Encoding.UTF8.GetBytes(s);
-                this.radiusAttribute.Value.lpValue = Marshal.AllocHGlobal(utf8.Length);
+                this.radiusAttribute.Value.lpValue = AttributeMemory.Allocate(utf8.Length);
                 Marshal.Copy(utf8, 0, this.radiusAttribute.Value.lpValue, utf8.Length);
                 this.radiusAttribute.cbDataLength = (uint)utf8.Length;
                 return;
@@ -182,7 +200,7 @@ namespace OpenCymd.Nps.Plugin {
             var bytes = this.value as byte[];
             if (bytes != null) {
                 this.radiusAttribute.fDataType = RADIUS_DATA_TYPE.rdtString;
-                this.radiusAttribute.Value.lpValue = Marshal.AllocHGlobal(bytes.Length);
+                this.radiusAttribute.Value.lpValue = AttributeMemory.Allocate(bytes.Length);
                 this.radiusAttribute.cbDataLength = (uint)bytes.Length;
                 Marshal.Copy(bytes, 0, this.radiusAttribute.Value.lpValue, bytes.Length);
                 return;
@@ -192,7 +210,7 @@ namespace OpenCymd.Nps.Plugin {
             if (vsa != null) {
                 this.radiusAttribute.fDataType = RADIUS_DATA_TYPE.rdtString;
                 byte[] vsaData = vsa;
-                this.radiusAttribute.Value.lpValue = Marshal.AllocHGlobal(vsaData.Length);
+                this.radiusAttribute.Value.lpValue = AttributeMemory.Allocate(vsaData.Length);
                 this.radiusAttribute.cbDataLength = (uint)vsaData.Length;
                 Marshal.Copy(vsaData, 0, this.radiusAttribute.Value.lpValue, vsaData.Length);
                 return;
@@ -201,6 +219,12 @@ namespace OpenCymd.Nps.Plugin {
             throw new ArgumentException(string.Format("Type {0} is not supported.", this.value.GetType().FullName));
         }
 
+        private static bool IsBufferType(RADIUS_DATA_TYPE dataType) {
+            return dataType == RADIUS_DATA_TYPE.rdtString ||
+                dataType == RADIUS_DATA_TYPE.rdtUnknown ||
+                dataType == RADIUS_DATA_TYPE.rdtIpv6Address;
+        }
+
         private object GetAttributeValue() {
             object result = null;
             if (this.radiusAttribute.dwAttrType == (uint)RadiusAttributeType.VendorSpecific) {
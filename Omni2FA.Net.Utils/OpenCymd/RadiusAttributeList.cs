@@ -105,9 +105,11 @@ namespace OpenCymd.Nps.Plugin
         /// <inheritdoc/>
         public IEnumerator<RadiusAttribute> GetEnumerator()
         {
-            for (var i = 0; i < this.Count; i++)
+            // One GetSize call for the whole loop instead of one per attribute
+            var count = this.Count;
+            for (uint i = 0; i < count; i++)
             {
-                yield return this[i];
+                yield return new RadiusAttribute(this.radiusAttributeArray.AttributeAt(this.radiusAttributeArrayPtr, i));
             }
         }
 
@@ -158,7 +160,8 @@ namespace OpenCymd.Nps.Plugin
                 throw new ArgumentNullException("item");
             }
 
-            for (uint i = 0; i < this.Count; i++)
+            var count = (uint)this.Count;
+            for (uint i = 0; i < count; i++)
             {
                 // warning: this is a hack and assumes that the dwAttrType is the first item in the RADIUS_ATTRIBUTE struct.
                 if ((uint)Marshal.ReadInt32(this.radiusAttributeArray.AttributeAt(this.radiusAttributeArrayPtr, i)) == item.AttributeId)
@@ -173,9 +176,10 @@ namespace OpenCymd.Nps.Plugin
         /// <inheritdoc/>
         public void CopyTo(RadiusAttribute[] array, int arrayIndex)
         {
-            for (var i = 0; i < this.Count; i++)
+            var count = this.Count;
+            for (var i = 0; i < count; i++)
             {
-                array[i + arrayIndex] = this[i];
+                array[i + arrayIndex] = new RadiusAttribute(this.radiusAttributeArray.AttributeAt(this.radiusAttributeArrayPtr, (uint)i));
             }
         }
 
@@ -204,7 +208,8 @@ namespace OpenCymd.Nps.Plugin
                 throw new ArgumentNullException("item");
             }
 
-            for (uint i = 0; i < this.Count; i++)
+            var count = (uint)this.Count;
+            for (uint i = 0; i < count; i++)
             {
                 // warning: this is a hack and assumes that the dwAttrType is the first item in the RADIUS_ATTRIBUTE struct.
                 if ((uint)Marshal.ReadInt32(this.radiusAttributeArray.AttributeAt(this.radiusAttributeArrayPtr, i)) == item.AttributeId)
@@ -17,7 +17,6 @@
 namespace OpenCymd.Nps.Plugin
 {
     using System;
-    using System.Linq;
     using System.Runtime.InteropServices;
     using System.Text;
 
@@ -30,7 +29,11 @@ namespace OpenCymd.Nps.Plugin
     {
         private readonly IntPtr vsaPtr;
 
-        private readonly RADIUS_VSA_FORMAT vsa;
+        private readonly uint vendorId;
+
+        private readonly byte vendorType;
+
+        private readonly byte vendorLength;
 
         private byte[] data;
 
@@ -52,12 +55,9 @@ namespace OpenCymd.Nps.Plugin
                 throw new ArgumentException("data cannot be longer than (Byte.MaxValue - 2)", "data");
             }
 
-            this.vsa = new RADIUS_VSA_FORMAT
-                           {
-                               VendorId = BitConverter.GetBytes(vendorId).Reverse().ToArray(),
-                               VendorType = vendorType,
-                               VendorLength = (byte)(data.Length + 2)
-                           };
+            this.vendorId = vendorId;
+            this.vendorType = vendorType;
+            this.vendorLength = (byte)(data.Length + 2);
             this.data = new byte[data.Length];
             Array.Copy(data, this.data, data.Length);
         }
@@ -69,7 +69,11 @@ namespace OpenCymd.Nps.Plugin
         internal VendorSpecificAttribute(IntPtr vsaPtr)
         {
             this.vsaPtr = vsaPtr;
-            this.vsa = (RADIUS_VSA_FORMAT)Marshal.PtrToStructure(vsaPtr, typeof(RADIUS_VSA_FORMAT));
+
+            // Read the RADIUS_VSA_FORMAT header in place; the vendor id is in network byte order
+            this.vendorId = ReadVendorId(vsaPtr);
+            this.vendorType = Marshal.ReadByte(vsaPtr, 4);
+            this.vendorLength = Marshal.ReadByte(vsaPtr, 5);
         }
 
         /// <summary>
@@ -79,8 +83,7 @@ namespace OpenCymd.Nps.Plugin
         {
             get
             {
-                // flip bytes to convert from network byte order
-                return BitConverter.ToUInt32(this.vsa.VendorId.Reverse().ToArray(), 0);
+                return this.vendorId;
             }
         }
 
@@ -91,7 +94,7 @@ namespace OpenCymd.Nps.Plugin
         {
             get
             {
-                return this.vsa.VendorType;
+                return this.vendorType;
             }
         }
 
@@ -104,8 +107,8 @@ namespace OpenCymd.Nps.Plugin
             {
                 if (this.data == null)
                 {
-                    this.data = new byte[this.vsa.VendorLength - 2];
-                    Marshal.Copy(this.vsaPtr + Marshal.SizeOf(typeof(RADIUS_VSA_FORMAT)), this.data, 0, this.vsa.VendorLength - 2);
+                    this.data = new byte[this.vendorLength - 2];
+                    Marshal.Copy(this.vsaPtr + Marshal.SizeOf(typeof(RADIUS_VSA_FORMAT)), this.data, 0, this.vendorLength - 2);
                 }
 
                 return this.data;
@@ -119,7 +122,12 @@ namespace OpenCymd.Nps.Plugin
         {
             get
             {
-                return this.vsa;
+                return new RADIUS_VSA_FORMAT
+                           {
+                               VendorId = new[] { (byte)(this.vendorId >> 24), (byte)(this.vendorId >> 16), (byte)(this.vendorId >> 8), (byte)this.vendorId },
+                               VendorType = this.vendorType,
+                               VendorLength = this.vendorLength
+                           };
             }
         }
 
@@ -130,10 +138,13 @@ namespace OpenCymd.Nps.Plugin
         /// <returns>Byte array of the attribute, including the mandatory Vendor-Id.</returns>
         public static implicit operator byte[](VendorSpecificAttribute vsa)
         {
-            var raw = new byte[4 + vsa.vsa.VendorLength];
-            vsa.vsa.VendorId.CopyTo(raw, 0);
+            var raw = new byte[4 + vsa.vendorLength];
+            raw[0] = (byte)(vsa.vendorId >> 24);
+            raw[1] = (byte)(vsa.vendorId >> 16);
+            raw[2] = (byte)(vsa.vendorId >> 8);
+            raw[3] = (byte)vsa.vendorId;
             raw[4] = vsa.VendorType;
-            raw[5] = vsa.vsa.VendorLength;
+            raw[5] = vsa.vendorLength;
             vsa.Data.CopyTo(raw, 6);
             return raw;
         }
@@ -157,5 +168,14 @@ namespace OpenCymd.Nps.Plugin
 
             return sb.ToString();
         }
+
+        /// <summary>
+        /// Reads the 4-byte vendor id at <paramref name="ptr"/>, which is in network byte order.
+        /// </summary>
+        internal static uint ReadVendorId(IntPtr ptr)
+        {
+            return ((uint)Marshal.ReadByte(ptr, 0) << 24) | ((uint)Marshal.ReadByte(ptr, 1) << 16) |
+                   ((uint)Marshal.ReadByte(ptr, 2) << 8) | Marshal.ReadByte(ptr, 3);
+        }
     }
 }
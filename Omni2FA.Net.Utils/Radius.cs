@@ -7,11 +7,51 @@ using System.Text;
 namespace Omni2FA.Net.Utils {
     public static class Radius {
         public static string AttributeLookup(IList<RadiusAttribute> attributesList, RadiusAttributeType attributeType) {
-            var a = attributesList.FirstOrDefault(x => x.AttributeId.Equals((int)attributeType));
-            if (a == null)
-                return string.Empty;
-            var ret_val = (a.Value is byte[] val) ? Encoding.Default.GetString(val) : a.Value.ToString();
-            return Str.sanitize(ret_val);
+            var start = Metrics.Start();
+            try {
+                return FindView(attributesList, attributeType).ToString();
+            }
+            finally {
+                Metrics.Record(MetricsPhase.Lookup, start);
+            }
+        }
+        /* View of the first attribute of the type, empty if there is none; nothing is copied */
+        public static AttributeView AttributeLookupView(IList<RadiusAttribute> attributesList, RadiusAttributeType attributeType) {
+            var start = Metrics.Start();
+            try {
+                return FindView(attributesList, attributeType);
+            }
+            finally {
+                Metrics.Record(MetricsPhase.Lookup, start);
+            }
+        }
+        /* View of the first sub-attribute of the vendor and vendor type across the Vendor-Specific attributes, empty if there is none; nothing is copied */
+        public static AttributeView VendorAttributeLookupView(IList<RadiusAttribute> attributesList, uint vendorId, byte vendorType) {
+            var start = Metrics.Start();
+            try {
+                AttributeView value;
+                foreach (var a in attributesList) {
+                    if (a.AttributeId == (int)RadiusAttributeType.VendorSpecific && a.View.TryGetVendorAttribute(vendorId, vendorType, out value))
+                        return value;
+                }
+                return default(AttributeView);
+            }
+            finally {
+                Metrics.Record(MetricsPhase.Lookup, start);
+            }
+        }
+        /* Compares the first attribute of the type with value in place */
+        public static bool AttributeEquals(IList<RadiusAttribute> attributesList, RadiusAttributeType attributeType, string value, StringComparison comparison) {
+            var view = AttributeLookupView(attributesList, attributeType);
+            return !view.IsEmpty && view.Equals(value, comparison);
+        }
+        /* foreach reads the size once; indexing RadiusAttributeList reads it again for every attribute */
+        private static AttributeView FindView(IList<RadiusAttribute> attributesList, RadiusAttributeType attributeType) {
+            foreach (var a in attributesList) {
+                if (a.AttributeId == (int)attributeType)
+                    return a.View;
+            }
+            return default(AttributeView);
         }
         /* Get all attributes*/
         public static List<string> AttributesToList(IList<RadiusAttribute> attributesList) {
@@ -0,0 +1,109 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using Microsoft.Win32;
+using Microsoft.Win32.SafeHandles;
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Reads settings from a key under HKEY_LOCAL_MACHINE and waits for changes with
+    /// RegNotifyChangeKeyValue.
+    /// </summary>
+    public sealed class RegistryConfigSource : IConfigSource {
+        private const int REG_NOTIFY_CHANGE_LAST_SET = 0x4;
+
+        [DllImport("advapi32.dll")]
+        private static extern int RegNotifyChangeKeyValue(SafeRegistryHandle hKey, bool bWatchSubtree,
+            int dwNotifyFilter, SafeWaitHandle hEvent, bool fAsynchronous);
+
+        private readonly AutoResetEvent _changed = new AutoResetEvent(false);
+        private RegistryKey _watchKey;
+        private bool _armed = false;
+        private bool _disposed = false;
+
+        public RegistryConfigSource(string keyPath) {
+            KeyPath = keyPath;
+        }
+
+        public string KeyPath { get; }
+
+        public string Name => @"HKLM\" + KeyPath;
+
+        public IDictionary<string, string> Load() {
+            if (_disposed) throw new ObjectDisposedException(nameof(RegistryConfigSource));
+            var values = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            using (var key = Microsoft.Win32.Registry.LocalMachine.OpenSubKey(KeyPath, false)) {
+                if (key == null) {
+                    return values;
+                }
+                foreach (var name in key.GetValueNames()) {
+                    var val = key.GetValue(name);
+                    if (val is string[] multi) {
+                        values[name] = string.Join(";", multi);
+                    }
+                    else if (val != null) {
+                        values[name] = val.ToString();
+                    }
+                }
+            }
+            return values;
+        }
+
+        public bool WaitForChange(WaitHandle stop, int timeoutMs) {
+            if (_disposed) throw new ObjectDisposedException(nameof(RegistryConfigSource));
+            if (!_armed) {
+                Arm();
+            }
+            if (!_armed) {
+                // Key does not exist (yet): look again after the timeout
+                return WaitHandle.WaitAny(new[] { stop }, timeoutMs) == WaitHandle.WaitTimeout;
+            }
+            int signaled = WaitHandle.WaitAny(new WaitHandle[] { stop, _changed }, timeoutMs);
+            if (signaled == 1) {
+                // The notification fires once; it is registered again on the next call
+                _armed = false;
+                return true;
+            }
+            // On timeout the store re-reads and compares, which covers a missed notification
+            return signaled == WaitHandle.WaitTimeout;
+        }
+
+        // Asynchronous notifications end when the registering thread exits, which is
+        // why this is only done from WaitForChange on the watcher thread
+        private void Arm() {
+            try {
+                if (_watchKey == null) {
+                    _watchKey = Microsoft.Win32.Registry.LocalMachine.OpenSubKey(KeyPath, false);
+                    if (_watchKey == null) {
+                        return;
+                    }
+                }
+                _armed = RegNotifyChangeKeyValue(_watchKey.Handle, false, REG_NOTIFY_CHANGE_LAST_SET,
+                    _changed.SafeWaitHandle, true) == 0;
+            }
+            catch (Exception) {
+                _armed = false;
+            }
+            if (!_armed) {
+                _watchKey?.Dispose();
+                _watchKey = null;
+            }
+        }
+
+        public void Dispose() {
+            if (!_disposed) {
+                _watchKey?.Dispose();
+                _watchKey = null;
+                _changed.Dispose();
+                _disposed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,248 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Text;
+
+namespace Omni2FA.Net.Utils {
+    /// <summary>
+    /// Immutable set of security identifiers kept in their binary form in one byte array.
+    /// <para>A domain SID takes 28 bytes here instead of a ~46 character string plus object
+    /// overhead. Entries are ordered by a 64-bit fingerprint, so two sets are intersected by
+    /// walking both in order, without hashing or allocating.</para>
+    /// </summary>
+    public sealed class SidSet {
+        public static readonly SidSet Empty = new SidSet(new byte[0], new int[] { 0 }, new ulong[0]);
+
+        private readonly byte[] _data;
+        // Start of each SID in _data, plus the end of the last one
+        private readonly int[] _offsets;
+        private readonly ulong[] _fingerprints;
+
+        private SidSet(byte[] data, int[] offsets, ulong[] fingerprints) {
+            _data = data;
+            _offsets = offsets;
+            _fingerprints = fingerprints;
+        }
+
+        public int Count => _fingerprints.Length;
+
+        /// <summary>
+        /// Bytes used by the binary SIDs.
+        /// </summary>
+        public int DataSize => _data.Length;
+
+        /// <summary>
+        /// Builds a set from SIDs in string form (S-1-5-21-...). Strings that are not valid
+        /// SIDs are skipped; duplicates are stored once.
+        /// </summary>
+        public static SidSet FromStrings(IEnumerable<string> sids) {
+            if (sids == null) {
+                return Empty;
+            }
+            var entries = new List<KeyValuePair<ulong, byte[]>>();
+            foreach (var sid in sids) {
+                var binary = ToBinary(sid);
+                if (binary != null) {
+                    entries.Add(new KeyValuePair<ulong, byte[]>(Fingerprint(binary, 0, binary.Length), binary));
+                }
+            }
+            if (entries.Count == 0) {
+                return Empty;
+            }
+            entries.Sort((a, b) => {
+                int order = a.Key.CompareTo(b.Key);
+                return order != 0 ? order : CompareBytes(a.Value, 0, a.Value.Length, b.Value, 0, b.Value.Length);
+            });
+
+            var fingerprints = new List<ulong>(entries.Count);
+            var offsets = new List<int>(entries.Count + 1);
+            int size = 0;
+            byte[] previous = null;
+            foreach (var entry in entries) {
+                if (previous != null && CompareBytes(previous, 0, previous.Length, entry.Value, 0, entry.Value.Length) == 0) {
+                    continue;
+                }
+                fingerprints.Add(entry.Key);
+                offsets.Add(size);
+                size += entry.Value.Length;
+                previous = entry.Value;
+            }
+            offsets.Add(size);
+
+            var data = new byte[size];
+            int at = 0;
+            previous = null;
+            foreach (var entry in entries) {
+                if (previous != null && CompareBytes(previous, 0, previous.Length, entry.Value, 0, entry.Value.Length) == 0) {
+                    continue;
+                }
+                Buffer.BlockCopy(entry.Value, 0, data, at, entry.Value.Length);
+                at += entry.Value.Length;
+                previous = entry.Value;
+            }
+            return new SidSet(data, offsets.ToArray(), fingerprints.ToArray());
+        }
+
+        /// <summary>
+        /// Checks a single SID given as a string.
+        /// </summary>
+        public bool Contains(string sid) {
+            var binary = ToBinary(sid);
+            if (binary == null) {
+                return false;
+            }
+            ulong fingerprint = Fingerprint(binary, 0, binary.Length);
+            int index = Array.BinarySearch(_fingerprints, fingerprint);
+            if (index < 0) {
+                return false;
+            }
+            // Step back to the first entry with this fingerprint, then compare all of them
+            while (index > 0 && _fingerprints[index - 1] == fingerprint) {
+                index--;
+            }
+            for (; index < _fingerprints.Length && _fingerprints[index] == fingerprint; index++) {
+                if (CompareBytes(_data, _offsets[index], _offsets[index + 1] - _offsets[index], binary, 0, binary.Length) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// <summary>
+        /// Number of SIDs present in both sets. Does not allocate.
+        /// </summary>
+        public int CountCommon(SidSet other) {
+            return Intersect(other, false);
+        }
+
+        /// <summary>
+        /// True if the sets share at least one SID. Does not allocate.
+        /// </summary>
+        public bool Overlaps(SidSet other) {
+            return Intersect(other, true) > 0;
+        }
+
+        /// <summary>
+        /// The SIDs in string form, in set order.
+        /// </summary>
+        public IEnumerable<string> ToStrings() {
+            for (int i = 0; i < Count; i++) {
+                yield return ToString(_data, _offsets[i], _offsets[i + 1] - _offsets[i]);
+            }
+        }
+
+        private int Intersect(SidSet other, bool stopAtFirst) {
+            if (other == null || Count == 0 || other.Count == 0) {
+                return 0;
+            }
+            int common = 0;
+            int i = 0;
+            int j = 0;
+            while (i < _fingerprints.Length && j < other._fingerprints.Length) {
+                ulong a = _fingerprints[i];
+                ulong b = other._fingerprints[j];
+                int order = a.CompareTo(b);
+                if (order == 0) {
+                    order = CompareBytes(_data, _offsets[i], _offsets[i + 1] - _offsets[i],
+                        other._data, other._offsets[j], other._offsets[j + 1] - other._offsets[j]);
+                }
+                if (order < 0) {
+                    i++;
+                }
+                else if (order > 0) {
+                    j++;
+                }
+                else {
+                    common++;
+                    if (stopAtFirst) {
+                        break;
+                    }
+                    i++;
+                    j++;
+                }
+            }
+            return common;
+        }
+
+        /// <summary>
+        /// Converts "S-1-5-21-..." to the binary layout Windows uses: revision, sub-authority
+        /// count, 48-bit big-endian identifier authority and little-endian 32-bit sub-authorities.
+        /// Returns null if the string is not a valid SID.
+        /// </summary>
+        public static byte[] ToBinary(string sid) {
+            if (string.IsNullOrEmpty(sid)) {
+                return null;
+            }
+            var parts = sid.Trim().Split('-');
+            if (parts.Length < 3 || parts.Length > 18 || !string.Equals(parts[0], "S", StringComparison.OrdinalIgnoreCase)) {
+                return null;
+            }
+            if (!byte.TryParse(parts[1], NumberStyles.None, CultureInfo.InvariantCulture, out byte revision)) {
+                return null;
+            }
+            if (!ulong.TryParse(parts[2], NumberStyles.None, CultureInfo.InvariantCulture, out ulong authority) || authority > 0xFFFFFFFFFFFFUL) {
+                return null;
+            }
+            int subCount = parts.Length - 3;
+            var binary = new byte[8 + 4 * subCount];
+            binary[0] = revision;
+            binary[1] = (byte)subCount;
+            for (int i = 0; i < 6; i++) {
+                binary[2 + i] = (byte)(authority >> (8 * (5 - i)));
+            }
+            for (int i = 0; i < subCount; i++) {
+                if (!uint.TryParse(parts[3 + i], NumberStyles.None, CultureInfo.InvariantCulture, out uint sub)) {
+                    return null;
+                }
+                int at = 8 + 4 * i;
+                binary[at] = (byte)sub;
+                binary[at + 1] = (byte)(sub >> 8);
+                binary[at + 2] = (byte)(sub >> 16);
+                binary[at + 3] = (byte)(sub >> 24);
+            }
+            return binary;
+        }
+
+        private static string ToString(byte[] data, int offset, int length) {
+            ulong authority = 0;
+            for (int i = 0; i < 6; i++) {
+                authority = (authority << 8) | data[offset + 2 + i];
+            }
+            var text = new StringBuilder("S-");
+            text.Append(data[offset].ToString(CultureInfo.InvariantCulture)).Append('-');
+            text.Append(authority.ToString(CultureInfo.InvariantCulture));
+            for (int at = offset + 8; at + 4 <= offset + length; at += 4) {
+                uint sub = (uint)(data[at] | data[at + 1] << 8 | data[at + 2] << 16 | data[at + 3] << 24);
+                text.Append('-').Append(sub.ToString(CultureInfo.InvariantCulture));
+            }
+            return text.ToString();
+        }
+
+        // FNV-1a, 64 bit
+        private static ulong Fingerprint(byte[] data, int offset, int length) {
+            ulong hash = 14695981039346656037UL;
+            for (int i = 0; i < length; i++) {
+                hash ^= data[offset + i];
+                hash *= 1099511628211UL;
+            }
+            return hash;
+        }
+
+        private static int CompareBytes(byte[] a, int aOffset, int aLength, byte[] b, int bOffset, int bLength) {
+            int length = Math.Min(aLength, bLength);
+            for (int i = 0; i < length; i++) {
+                int order = a[aOffset + i].CompareTo(b[bOffset + i]);
+                if (order != 0) {
+                    return order;
+                }
+            }
+            return aLength.CompareTo(bLength);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+// --------------------------------------------------------------------------------------------------------------------
+// <copyright>
+//   Copyright bvelush 2025 (https://github.com/bvelush)
+//
+//   Offline decoder for the binary trace journal written by Omni2FA.NPS.Plugin
+// </copyright>
+// --------------------------------------------------------------------------------------------------------------------
+//
+// Usage: Omni2FA.TraceDecoder <journal path> [<journal path> ...]
+//
+// A journal path is either the TraceJournalPath registry value (the decoder
+// then reads <path>.0 .. <path>.15 that exist) or a single journal file.
+// Files are printed oldest generation first, so the output is in write order.
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "tracejournal.h"
+
+namespace {
+
+struct JournalFile {
+    std::string path;
+    std::vector<uint8_t> data;
+    uint32_t generation;
+};
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    data.clear();
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(file);
+    return true;
+}
+
+void AddFile(const std::string& path, std::vector<JournalFile>& files) {
+    JournalFile file;
+    file.path = path;
+    file.generation = 0;
+    if (!ReadFile(path, file.data))
+        return;
+    if (TraceJournalRead(file.data.data(), file.data.size(), &file.generation, nullptr, nullptr) < 0) {
+        fprintf(stderr, "%s: not a trace journal file\n", path.c_str());
+        return;
+    }
+    files.push_back(std::move(file));
+}
+
+void PrintRecord(void* context, const TraceJournalRecordView& record) {
+    (void)context;
+    if (record.header->kind == TRACE_JOURNAL_KIND_REQUEST) {
+        fputs(TraceJournalFormatRequest(record).c_str(), stdout);
+        fputs("\n", stdout);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <journal path> [<journal path> ...]\n", argv[0]);
+        return 2;
+    }
+    std::vector<JournalFile> files;
+    for (int i = 1; i < argc; ++i) {
+        FILE* single = fopen(argv[i], "rb");
+        if (single != nullptr) {
+            fclose(single);
+            AddFile(argv[i], files);
+            continue;
+        }
+        for (int index = 0; index < TRACE_JOURNAL_MAX_FILES; ++index)
+            AddFile(std::string(argv[i]) + "." + std::to_string(index), files);
+    }
+    if (files.empty()) {
+        fprintf(stderr, "No journal files found.\n");
+        return 1;
+    }
+    std::sort(files.begin(), files.end(), [](const JournalFile& a, const JournalFile& b) {
+        return a.generation < b.generation;
+    });
+    int total = 0;
+    for (const JournalFile& file : files) {
+        total += TraceJournalRead(file.data.data(), file.data.size(), nullptr, &PrintRecord, nullptr);
+    }
+    fprintf(stderr, "%d record(s) in %u file(s).\n", total, (unsigned)files.size());
+    return 0;
+}